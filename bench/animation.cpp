@@ -0,0 +1,93 @@
+#include "bench.hpp"
+
+#include <zabato/animator.hpp>
+#include <zabato/time.hpp>
+
+#include <stdio.h>
+
+using namespace zabato;
+
+namespace
+{
+/** @brief The lookup `animation_track` used before playback cursors. */
+size_t linear_find(const vector<key_position> &keys, real time)
+{
+    for (size_t i = 0; i < keys.size() - 1; ++i)
+        if (time < keys[i + 1].timestamp)
+            return i;
+    return 0;
+}
+
+animation_track make_track(size_t key_count)
+{
+    animation_track track;
+    track.positions.resize(key_count);
+    for (size_t i = 0; i < key_count; ++i)
+    {
+        track.positions[i].position  = vec3<real>(real(int32_t(i)));
+        track.positions[i].timestamp = real(int32_t(i)) / ICE_SCALE;
+    }
+    return track;
+}
+
+double ns_per_lookup(zabato::time start, zabato::time end, size_t lookups)
+{
+    return double((end - start).as_nanoseconds()) / double(lookups);
+}
+} // namespace
+
+int main()
+{
+    // ICE_R16 timestamps hold at most 32767 steps of 1/64 tick.
+    const size_t key_counts[] = {8, 64, 512, 4096, 32000};
+    const size_t steps        = 200000;
+
+    printf("%10s %14s %14s %14s\n",
+           "keys",
+           "linear ns",
+           "cursor ns",
+           "seek ns");
+
+    for (size_t key_count : key_counts)
+    {
+        animation_track track = make_track(key_count);
+        const real duration   = track.positions.back().timestamp;
+        const real dt         = duration / real(int32_t(steps));
+
+        // Monotonic playback with the old linear scan.
+        zabato::time start = zabato::time::now();
+        real t             = real(0);
+        for (size_t i = 0; i < steps; ++i, t += dt)
+            bench::do_not_optimize(linear_find(track.positions, t));
+        double linear = ns_per_lookup(start, zabato::time::now(), steps);
+
+        // Monotonic playback with a persistent cursor.
+        size_t cursor = 0;
+        start         = zabato::time::now();
+        t             = real(0);
+        for (size_t i = 0; i < steps; ++i, t += dt)
+            bench::do_not_optimize(
+                animation_track::find_key(track.positions, t, cursor));
+        double cursored = ns_per_lookup(start, zabato::time::now(), steps);
+
+        // Random seeks, which always take the binary search path.
+        uint32_t seed = 12345;
+        start         = zabato::time::now();
+        for (size_t i = 0; i < steps; ++i)
+        {
+            seed      = seed * 1664525u + 1013904223u;
+            real seek = duration * (real(int32_t(seed >> 8)) / real(1 << 24));
+            bench::do_not_optimize(
+                animation_track::find_key(track.positions, seek, cursor));
+        }
+        double seek = ns_per_lookup(start, zabato::time::now(), steps);
+
+        printf("%10zu %14.2f %14.2f %14.2f\n",
+               key_count,
+               linear,
+               cursored,
+               seek);
+    }
+
+    return 0;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <zabato/real.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace bench
+{
+/**
+ * @brief A small deterministic generator, so every run and every benchmark
+ * variant sees the same inputs.
+ */
+struct lcg
+{
+    uint32_t seed = 12345;
+
+    /** @return The next 24 bit value. */
+    uint32_t next()
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    }
+
+    /** @return A value in `[0, 1)`. */
+    zabato::real unit()
+    {
+        return zabato::real(int32_t(next())) / zabato::real(1 << 24);
+    }
+
+    zabato::real range(zabato::real lo, zabato::real hi)
+    {
+        return lo + (hi - lo) * unit();
+    }
+
+    /** @return An index in `[0, count)`. */
+    size_t index(size_t count) { return next() % count; }
+};
+
+/**
+ * @brief Keeps the optimizer from discarding the measured work that produced
+ * `value`. Costs no more than keeping `value` in a register.
+ */
+template <class T> inline void do_not_optimize(const T &value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static volatile T sink;
+    sink = value;
+#endif
+}
+} // namespace bench
@@ -0,0 +1,298 @@
+#include "bench.hpp"
+
+#include <zabato/collision.hpp>
+#include <zabato/collision_world.hpp>
+#include <zabato/ray_batch.hpp>
+#include <zabato/time.hpp>
+
+#include <stdio.h>
+
+using namespace zabato;
+
+namespace
+{
+const real world_size = real(1000);
+
+const char *policy_name(const custom_real<float_policy> *) { return "float"; }
+
+template <int F>
+const char *policy_name(const custom_real<fixed_point_policy<F>> *)
+{
+    return "fixed";
+}
+
+using bench::lcg;
+
+vec2<real> random_point(lcg &rng)
+{
+    return {rng.range(real(0), world_size), rng.range(real(0), world_size)};
+}
+
+/** @brief A randomized mix of rects, circles and polygons. */
+struct scene
+{
+    vector<rect_shape> rects;
+    vector<circle_shape> circles;
+    vector<polygon_shape> polygons;
+    vector<const collision_shape *> shapes;
+
+    scene(size_t count, lcg &rng)
+    {
+        rects.resize(count / 3);
+        circles.resize(count / 3);
+        polygons.resize(count - 2 * (count / 3));
+
+        for (rect_shape &rect : rects)
+        {
+            rect.position = random_point(rng);
+            rect.size     = {rng.range(real(2), real(20)),
+                             rng.range(real(2), real(20))};
+        }
+        for (circle_shape &circle : circles)
+        {
+            circle.position = random_point(rng);
+            circle.radius   = rng.range(real(1), real(10));
+        }
+
+        vector<vec2<real>> cloud, hull, scratch;
+        for (polygon_shape &poly : polygons)
+        {
+            const vec2<real> center = random_point(rng);
+            cloud.clear();
+            for (int i = 0; i < 8; ++i)
+            {
+                vec2<real> offset = {rng.range(real(-10), real(10)),
+                                     rng.range(real(-10), real(10))};
+                cloud.push_back(center + offset);
+            }
+            create_convex_hull(cloud.data(), cloud.size(), hull, scratch);
+            poly.set_vertices(hull);
+        }
+
+        for (const rect_shape &rect : rects)
+            shapes.push_back(&rect);
+        for (const circle_shape &circle : circles)
+            shapes.push_back(&circle);
+        for (const polygon_shape &poly : polygons)
+            shapes.push_back(&poly);
+    }
+};
+
+vision_cone random_cone(lcg &rng)
+{
+    vision_cone cone;
+    cone.position  = random_point(rng);
+    real heading   = rng.range(real(0), real::pi() * real(2));
+    cone.direction = {cos(heading), sin(heading)};
+    cone.angle     = rng.range(real(0.3), real(1.2));
+    cone.near_dist = real(0);
+    cone.far_dist  = rng.range(real(50), real(300));
+    return cone;
+}
+
+/** @brief Prints one CSV row. */
+void report(const char *benchmark,
+            size_t shapes,
+            size_t queries,
+            zabato::time start,
+            zabato::time end)
+{
+    const double ns  = double((end - start).as_nanoseconds());
+    const double per = queries ? ns / double(queries) : 0.0;
+    printf("%s,%s,%zu,%zu,%.2f,%.0f\n",
+           policy_name((const real *)nullptr),
+           benchmark,
+           shapes,
+           queries,
+           per,
+           per > 0.0 ? 1e9 / per : 0.0);
+}
+
+void bench_test_collision(const scene &s, lcg &rng)
+{
+    const size_t queries = 200000;
+    const size_t count   = s.shapes.size();
+
+    vector<collision_pair> pairs;
+    for (size_t i = 0; i < queries; ++i)
+    {
+        const collision_shape *first = s.shapes[rng.index(count)];
+        pairs.push_back({first, s.shapes[rng.index(count)]});
+    }
+
+    zabato::time start = zabato::time::now();
+    for (const collision_pair &pair : pairs)
+        bench::do_not_optimize(
+            test_collision(*pair.first, *pair.second).collides);
+    report("test_collision", count, queries, start, zabato::time::now());
+
+    // The same pairs on the next frame, through the contact cache.
+    contact_cache cache;
+    for (const collision_pair &pair : pairs)
+        cache.test(*pair.first, *pair.second);
+    cache.end_frame();
+
+    start = zabato::time::now();
+    for (const collision_pair &pair : pairs)
+        bench::do_not_optimize(cache.test(*pair.first, *pair.second).collides);
+    report("contact_cache", count, queries, start, zabato::time::now());
+}
+
+void bench_raycast(const scene &s, lcg &rng)
+{
+    const size_t count   = s.shapes.size();
+    const size_t queries = count > 1000 ? 2000 : 20000;
+
+    vector<vec2<real>> origins, directions;
+    for (size_t i = 0; i < queries; ++i)
+    {
+        origins.push_back(random_point(rng));
+        directions.push_back(normalize(random_point(rng) - origins.back()));
+    }
+
+    zabato::time start = zabato::time::now();
+    for (size_t i = 0; i < queries; ++i)
+        bench::do_not_optimize(
+            raycast(origins[i], directions[i], world_size, s.shapes).hit);
+    report("raycast", count, queries, start, zabato::time::now());
+
+    ray_obstacle_set set;
+    set.assign(s.shapes);
+    start = zabato::time::now();
+    for (size_t i = 0; i < queries; ++i)
+        bench::do_not_optimize(
+            set.raycast(origins[i], directions[i], world_size).hit);
+    report("raycast_packet", count, queries, start, zabato::time::now());
+
+    collision_world world;
+    for (const collision_shape *shape : s.shapes)
+        world.insert(shape);
+    start = zabato::time::now();
+    for (size_t i = 0; i < queries; ++i)
+        bench::do_not_optimize(
+            world.raycast(origins[i], directions[i], world_size).hit);
+    report("world_raycast", count, queries, start, zabato::time::now());
+}
+
+void bench_visibility(const scene &s, lcg &rng)
+{
+    const size_t count   = s.shapes.size();
+    const size_t queries = count > 1000 ? 1000 : 10000;
+
+    vector<vision_cone> cones;
+    vector<const collision_shape *> targets;
+    for (size_t i = 0; i < queries; ++i)
+    {
+        cones.push_back(random_cone(rng));
+        targets.push_back(s.shapes[rng.index(count)]);
+    }
+
+    zabato::time start = zabato::time::now();
+    for (size_t i = 0; i < queries; ++i)
+    {
+        visibility_result v = check_visibility(cones[i], *targets[i], s.shapes);
+        bench::do_not_optimize(v.in_vision_cone);
+    }
+    report("check_visibility", count, queries, start, zabato::time::now());
+
+    collision_world world;
+    for (const collision_shape *shape : s.shapes)
+        world.insert(shape);
+
+    start = zabato::time::now();
+    for (size_t i = 0; i < queries; ++i)
+    {
+        visibility_result v = world.check_visibility(cones[i], *targets[i]);
+        bench::do_not_optimize(v.in_vision_cone);
+    }
+    report(
+        "world_check_visibility", count, queries, start, zabato::time::now());
+
+    // Every observer against every shape, counted per observer.
+    const size_t observers = 64;
+    vector<visibility_pair> seen;
+    start = zabato::time::now();
+    world.check_visibility(cones.data(), observers, world, seen);
+    bench::do_not_optimize(seen.size());
+    report("bulk_visibility", count, observers, start, zabato::time::now());
+}
+
+void bench_broadphase(const scene &s)
+{
+    const size_t count = s.shapes.size();
+
+    collision_world world;
+    zabato::time start = zabato::time::now();
+    for (const collision_shape *shape : s.shapes)
+        world.insert(shape);
+    report("world_insert", count, count, start, zabato::time::now());
+
+    vector<collision_pair> pairs;
+    start = zabato::time::now();
+    world.query_pairs(pairs);
+    report("world_query_pairs", count, count, start, zabato::time::now());
+
+    vector<collision_result> results;
+    results.resize(pairs.size());
+    start = zabato::time::now();
+    test_collisions(pairs.data(), pairs.size(), results.data());
+    report("test_collisions", count, pairs.size(), start, zabato::time::now());
+}
+
+void bench_convex_hull(lcg &rng)
+{
+    const size_t point_counts[] = {16, 256, 4096};
+    vector<vec2<real>> points, hull, scratch;
+
+    for (size_t point_count : point_counts)
+    {
+        const size_t queries = 200000 / point_count;
+        points.clear();
+        for (size_t i = 0; i < point_count; ++i)
+            points.push_back(random_point(rng));
+
+        zabato::time start = zabato::time::now();
+        for (size_t i = 0; i < queries; ++i)
+        {
+            create_convex_hull(points.data(), points.size(), hull, scratch);
+            bench::do_not_optimize(hull.size());
+        }
+        report("create_convex_hull",
+               point_count,
+               queries,
+               start,
+               zabato::time::now());
+
+        convex_hull_builder builder;
+        start = zabato::time::now();
+        for (const vec2<real> &point : points)
+            builder.add_point(point);
+        bench::do_not_optimize(builder.get_vertices().size());
+        report("hull_add_point",
+               point_count,
+               point_count,
+               start,
+               zabato::time::now());
+    }
+}
+} // namespace
+
+int main()
+{
+    const size_t densities[] = {64, 512, 4096};
+
+    printf("policy,benchmark,shapes,queries,ns_per_query,queries_per_sec\n");
+
+    lcg rng;
+    for (size_t density : densities)
+    {
+        scene s(density, rng);
+        bench_test_collision(s, rng);
+        bench_raycast(s, rng);
+        bench_visibility(s, rng);
+        bench_broadphase(s);
+    }
+    bench_convex_hull(rng);
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+#include "bench.hpp"
+
+#include <zabato/color.hpp>
+#include <zabato/time.hpp>
+#include <zabato/vector.hpp>
+
+#include <stdio.h>
+
+using namespace zabato;
+
+namespace
+{
+const size_t pixel_count = 256 * 256;
+const size_t rounds      = 64;
+
+uint32_t next(uint32_t &seed)
+{
+    seed = seed * 1664525u + 1013904223u;
+    return seed;
+}
+
+/** @brief Prints one CSV row. */
+void report(const char *conversion, const char *path, zabato::time start)
+{
+    const zabato::time end = zabato::time::now();
+    const double ns        = double((end - start).as_nanoseconds());
+    printf("%s,%s,%.3f\n",
+           conversion,
+           path,
+           ns / double(pixel_count * rounds));
+}
+
+/**
+ * @brief Times a per-pixel conversion through `color` against the bulk one
+ * on the same pixels.
+ */
+template <typename Src, typename Dst, typename PerPixel, typename Bulk>
+void measure(const char *conversion,
+             const vector<Src> &src,
+             PerPixel per_pixel,
+             Bulk bulk)
+{
+    vector<Dst> dst(src.size());
+
+    zabato::time start = zabato::time::now();
+    for (size_t r = 0; r < rounds; ++r)
+    {
+        for (size_t i = 0; i < src.size(); ++i)
+            dst[i] = per_pixel(src[i]);
+        bench::do_not_optimize(dst[r].value);
+    }
+    report(conversion, "per_pixel", start);
+
+    start = zabato::time::now();
+    for (size_t r = 0; r < rounds; ++r)
+    {
+        bulk(span<const Src>(src.data(), src.size()),
+             span<Dst>(dst.data(), dst.size()));
+        bench::do_not_optimize(dst[r].value);
+    }
+    report(conversion, "bulk", start);
+}
+} // namespace
+
+int main()
+{
+    uint32_t seed = 12345;
+    vector<color5551> c5551(pixel_count);
+    vector<color4444> c4444(pixel_count);
+    vector<color8888> c8888(pixel_count);
+    vector<uint8_t> indices(pixel_count);
+    vector<color8888> palette(256);
+    for (size_t i = 0; i < pixel_count; ++i)
+    {
+        const uint32_t v = next(seed);
+        c5551[i].value   = uint16_t(v);
+        c4444[i].value   = uint16_t(v >> 16);
+        c8888[i].value   = v;
+        indices[i]       = uint8_t(v >> 24);
+    }
+    for (size_t i = 0; i < palette.size(); ++i)
+        palette[i].value = next(seed);
+
+    printf("conversion,path,ns_per_pixel\n");
+
+    measure<color5551, color8888>(
+        "5551_to_8888",
+        c5551,
+        [](color5551 c) { return color8888(c.as_color()); },
+        [](span<const color5551> s, span<color8888> d)
+        { convert_colors(s, d); });
+    measure<color4444, color8888>(
+        "4444_to_8888",
+        c4444,
+        [](color4444 c) { return color8888(c.as_color()); },
+        [](span<const color4444> s, span<color8888> d)
+        { convert_colors(s, d); });
+    measure<color8888, color5551>(
+        "8888_to_5551",
+        c8888,
+        [](color8888 c) { return color5551(color(c)); },
+        [](span<const color8888> s, span<color5551> d)
+        { convert_colors(s, d); });
+    measure<color8888, color4444>(
+        "8888_to_4444",
+        c8888,
+        [](color8888 c) { return color4444(color(c)); },
+        [](span<const color8888> s, span<color4444> d)
+        { convert_colors(s, d); });
+    measure<color8888, color4444>(
+        "8888_to_4444_dither",
+        c8888,
+        [](color8888 c) { return color4444(color(c)); },
+        [](span<const color8888> s, span<color4444> d)
+        { convert_colors(s, d, 256); });
+
+    vector<color8888> expanded(pixel_count);
+    zabato::time start = zabato::time::now();
+    for (size_t r = 0; r < rounds; ++r)
+    {
+        expand_palette(span<const uint8_t>(indices.data(), indices.size()),
+                       8,
+                       span<const color8888>(palette.data(), palette.size()),
+                       span<color8888>(expanded.data(), expanded.size()));
+        bench::do_not_optimize(expanded[r].value);
+    }
+    report("palette256_to_8888", "bulk", start);
+
+    return 0;
+}
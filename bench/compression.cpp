@@ -0,0 +1,689 @@
+#include "bench.hpp"
+
+#include <zabato/berg.h>
+#include <zabato/ice_fs.hpp>
+#include <zabato/ice_packer.hpp>
+#include <zabato/stream.hpp>
+#include <zabato/string.hpp>
+#include <zabato/time.hpp>
+#include <zabato/utils.hpp>
+#include <zabato/vector.hpp>
+
+#include <filesystem>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+
+#include <psapi.h>
+#else
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+using namespace zabato;
+
+// Measures Berg at every level over a corpus, then `ice_fs` over archives
+// packed from it, and prints one row per measurement as CSV, or JSON with
+// `--json`, so runs on different commits can be diffed:
+//
+//   bench_compression [--corpus DIR] [--runs N] [--work DIR] [--json]
+//                     [--block-size BYTES]
+//
+// Point `--corpus` at a standard corpus, e.g. Silesia or Canterbury,
+// unpacked; without it a generated corpus of text, a binary table, random
+// bytes and small text files stands in. Every measurement is repeated
+// `--runs` times and reported as p50, p90 and p99 of the runs. Berg reports
+// compress and decompress MB/s and the ratio of every file of 64 KiB or more,
+// and of the whole corpus. The archives are packed raw and with Berg blocks
+// and are timed mapped and read with `pread`, for mount, path lookup, whole
+// file reads and 4 KiB reads at random offsets. Cold runs drop the archive
+// from the OS page cache first, which only Linux allows; elsewhere they are
+// left out. Archives and the generated corpus go to `--work`, removed at the
+// end.
+
+namespace
+{
+/** @brief Files smaller than this only count towards the whole corpus. */
+constexpr size_t min_item_size = 64 * 1024;
+
+/** @brief The size and count of the random reads. */
+constexpr size_t seek_size  = 4096;
+constexpr size_t seek_count = 256;
+
+struct options
+{
+    const char *corpus = nullptr;
+    const char *work   = "bench_compression.tmp";
+    size_t runs        = 10;
+    size_t block_size  = 64 * 1024;
+    bool json          = false;
+};
+
+bool parse_options(int argc, char **argv, options &out)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--corpus") && has_value)
+            out.corpus = argv[++i];
+        else if (!strcmp(argv[i], "--runs") && has_value)
+            out.runs = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--work") && has_value)
+            out.work = argv[++i];
+        else if (!strcmp(argv[i], "--block-size") && has_value)
+            out.block_size = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--json"))
+            out.json = true;
+        else
+            return false;
+    }
+    return out.runs > 0 && out.block_size > 0;
+}
+
+using bench::lcg;
+
+struct corpus_file
+{
+    string path; ///< Relative to the corpus, with `/` separators.
+    vector<uint8_t> data;
+};
+
+/**
+ * @brief Prints rows as CSV or as a JSON array of objects, each under the
+ * current suite, variant and cache state.
+ */
+struct report_writer
+{
+    bool json           = false;
+    const char *suite   = "-";
+    const char *variant = "-";
+    const char *cache   = "-";
+    size_t rows         = 0;
+
+    void begin()
+    {
+        if (json)
+            printf("[");
+        else
+            printf("suite,item,variant,cache,metric,unit,p50,p90,p99\n");
+    }
+
+    void end() { printf(json ? "\n]\n" : ""); }
+
+    /** @brief Prints the percentiles of `samples`, sorting them. */
+    void row(const char *item,
+             const char *metric,
+             const char *unit,
+             vector<double> &samples)
+    {
+        if (samples.empty())
+            return;
+        sort(samples.begin(), samples.end());
+        auto percentile = [&](size_t p)
+        { return samples[(samples.size() - 1) * p / 100]; };
+
+        if (json)
+            printf("%s\n  {\"suite\": \"%s\", \"item\": \"%s\", "
+                   "\"variant\": \"%s\", \"cache\": \"%s\", "
+                   "\"metric\": \"%s\", \"unit\": \"%s\", "
+                   "\"p50\": %.4f, \"p90\": %.4f, \"p99\": %.4f}",
+                   rows ? "," : "",
+                   suite,
+                   item,
+                   variant,
+                   cache,
+                   metric,
+                   unit,
+                   percentile(50),
+                   percentile(90),
+                   percentile(99));
+        else
+            printf("%s,%s,%s,%s,%s,%s,%.4f,%.4f,%.4f\n",
+                   suite,
+                   item,
+                   variant,
+                   cache,
+                   metric,
+                   unit,
+                   percentile(50),
+                   percentile(90),
+                   percentile(99));
+        ++rows;
+    }
+
+    /** @brief Prints a measurement taken once. */
+    void value(const char *item, const char *metric, const char *unit, double v)
+    {
+        vector<double> samples;
+        samples.push_back(v);
+        row(item, metric, unit, samples);
+    }
+};
+
+double megabytes_per_second(uint64_t bytes, uint64_t nanoseconds)
+{
+    return nanoseconds ? double(bytes) * 1e3 / double(nanoseconds) : 0.0;
+}
+
+/** @return The peak resident memory of the process in bytes, or 0. */
+uint64_t peak_memory()
+{
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+#if defined(__APPLE__)
+    return uint64_t(usage.ru_maxrss);
+#else
+    return uint64_t(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+/**
+ * @brief Drops a file from the OS page cache, so the next reads go to the
+ * disk. Pages still mapped by a process stay.
+ * @return False where that is not possible.
+ */
+bool evict_from_cache(const char *path)
+{
+#if defined(__linux__)
+    const int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+    const bool ok = fdatasync(fd) == 0 &&
+                    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(fd);
+    return ok;
+#else
+    (void)path;
+    return false;
+#endif
+}
+
+/** @brief Makes a path safe as an item in both CSV and JSON. */
+string item_name(const string &path)
+{
+    string name = path;
+    for (size_t i = 0; i < name.size(); ++i)
+        if (name[i] == ',' || name[i] == '"' || name[i] == '\\')
+            name[i] = '_';
+    return name;
+}
+
+bool load_corpus(const char *dir, vector<corpus_file> &files)
+{
+    std::error_code ec;
+    const std::filesystem::path base(dir);
+    for (const auto &entry :
+         std::filesystem::recursive_directory_iterator(base, ec))
+    {
+        if (!entry.is_regular_file() || entry.file_size() == 0)
+            continue;
+
+        FILE *in = fopen(entry.path().string().c_str(), "rb");
+        if (!in)
+            continue;
+        corpus_file file;
+        const std::filesystem::path relative =
+            std::filesystem::relative(entry.path(), base);
+        file.path = relative.generic_string().c_str();
+        file.data.resize((size_t)entry.file_size());
+        const size_t got = fread(file.data.data(), 1, file.data.size(), in);
+        fclose(in);
+        if (got == file.data.size())
+            files.push_back(move(file));
+    }
+    sort(files.begin(),
+         files.end(),
+         [](const corpus_file &a, const corpus_file &b)
+         { return strcmp(a.path.c_str(), b.path.c_str()) < 0; });
+    return !ec && !files.empty();
+}
+
+void append_bytes(vector<uint8_t> &out, const void *data, size_t size)
+{
+    const size_t at = out.size();
+    out.resize(at + size);
+    memcpy(out.data() + at, data, size);
+}
+
+/** @brief Appends words of a small vocabulary, like a script or a log. */
+void append_text(lcg &rng, vector<uint8_t> &out, size_t size)
+{
+    static const char *const words[] = {
+        "the",    "player", "enters",   "a",     "dark",  "room",
+        "with",   "three",  "doors",    "and",   "one",   "torch",
+        "health", "=",      "100;",     "if",    "(",     ")",
+        "return", "node",   "texture",  "mesh",  "level", "spawn",
+        "enemy",  "at",     "position", "0.5,",  "1.0,",  "-2.25",
+    };
+    const size_t word_count = sizeof(words) / sizeof(words[0]);
+    while (out.size() < size)
+    {
+        const char *word = words[rng.next() % word_count];
+        append_bytes(out, word, strlen(word));
+        out.push_back(rng.next() % 12 == 0 ? '\n' : ' ');
+    }
+    out.resize(size);
+}
+
+/**
+ * @brief A corpus covering the range of what compresses: text, a table of
+ * records with slowly changing fields, bytes that do not compress, and small
+ * files as a game has many of.
+ */
+void make_corpus(vector<corpus_file> &files)
+{
+    lcg rng;
+
+    corpus_file text{"text.txt", {}};
+    append_text(rng, text.data, 4 << 20);
+    files.push_back(move(text));
+
+    corpus_file table{"table.bin", {}};
+    for (uint32_t id = 0; table.data.size() < (4 << 20); ++id)
+    {
+        const uint32_t record[4] = {
+            id, id / 16, 1000 + rng.next() % 64, rng.next() % 3};
+        append_bytes(table.data, record, sizeof(record));
+    }
+    files.push_back(move(table));
+
+    corpus_file noise{"random.bin", {}};
+    noise.data.resize(1 << 20);
+    for (uint8_t &byte : noise.data)
+        byte = uint8_t(rng.next());
+    files.push_back(move(noise));
+
+    for (int i = 0; i < 32; ++i)
+    {
+        char path[32];
+        snprintf(path, sizeof(path), "small/%02d.txt", i);
+        corpus_file small{string(path), {}};
+        append_text(rng, small.data, 2048 + rng.next() % 6144);
+        files.push_back(move(small));
+    }
+}
+
+bool write_corpus(const std::filesystem::path &dir,
+                  const vector<corpus_file> &files)
+{
+    for (const corpus_file &file : files)
+    {
+        const std::filesystem::path path = dir / file.path.c_str();
+        std::error_code ec;
+        std::filesystem::create_directories(path.parent_path(), ec);
+        FILE *out = fopen(path.string().c_str(), "wb");
+        if (!out)
+            return false;
+        const size_t put = fwrite(file.data.data(), 1, file.data.size(), out);
+        fclose(out);
+        if (put != file.data.size())
+            return false;
+    }
+    return true;
+}
+
+uint64_t total_size(const vector<corpus_file> &files)
+{
+    uint64_t total = 0;
+    for (const corpus_file &file : files)
+        total += file.data.size();
+    return total;
+}
+
+size_t largest_size(const vector<corpus_file> &files)
+{
+    size_t largest = 0;
+    for (const corpus_file &file : files)
+        largest = max(largest, file.data.size());
+    return largest;
+}
+
+/** @brief Compresses and decompresses every file at every level. */
+bool bench_berg(const options &opts,
+                const vector<corpus_file> &files,
+                report_writer &out)
+{
+    const size_t largest = largest_size(files);
+    const size_t bound   = berg_estimate_max_compressed_size(largest);
+    vector<uint32_t> context_memory((berg_context_size() + 3) / 4);
+    berg_context *context =
+        berg_context_init(context_memory.data(), context_memory.size() * 4);
+    if (!context)
+        return false;
+
+    vector<uint8_t> compressed(bound);
+    vector<uint8_t> restored(largest);
+    out.suite = "berg";
+    out.cache = "-";
+    for (int level = BERG_LEVEL_FASTEST; level <= BERG_LEVEL_MAX; ++level)
+    {
+        const berg_config config = berg_get_level_config(level);
+        char variant[16];
+        snprintf(variant, sizeof(variant), "level%d", level);
+        out.variant = variant;
+
+        vector<vector<double>> compress_speed, decompress_speed;
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            compress_speed.emplace_back();
+            decompress_speed.emplace_back();
+        }
+        vector<size_t> compressed_size(files.size());
+        vector<double> all_compress, all_decompress;
+        for (size_t run = 0; run < opts.runs; ++run)
+        {
+            uint64_t compress_time = 0, decompress_time = 0;
+            for (size_t i = 0; i < files.size(); ++i)
+            {
+                const vector<uint8_t> &data = files[i].data;
+                size_t size = 0, restored_size = 0;
+
+                const uint64_t start = time::now().as_nanoseconds();
+                berg_error_t error   = berg_compress_ctx(context,
+                                                       data.data(),
+                                                       data.size(),
+                                                       compressed.data(),
+                                                       compressed.size(),
+                                                       &size,
+                                                       &config);
+                const uint64_t middle = time::now().as_nanoseconds();
+                if (error == BERG_OK)
+                    error = berg_decompress(compressed.data(),
+                                            size,
+                                            restored.data(),
+                                            restored.size(),
+                                            &restored_size);
+                const uint64_t end = time::now().as_nanoseconds();
+
+                if (error != BERG_OK || restored_size != data.size() ||
+                    (run == 0 &&
+                     memcmp(restored.data(), data.data(), data.size()) != 0))
+                {
+                    fprintf(stderr,
+                            "berg level %d failed on %s\n",
+                            level,
+                            files[i].path.c_str());
+                    return false;
+                }
+
+                compress_speed[i].push_back(
+                    megabytes_per_second(data.size(), middle - start));
+                decompress_speed[i].push_back(
+                    megabytes_per_second(data.size(), end - middle));
+                compressed_size[i] = size;
+                compress_time += middle - start;
+                decompress_time += end - middle;
+            }
+
+            const uint64_t total = total_size(files);
+            all_compress.push_back(megabytes_per_second(total, compress_time));
+            all_decompress.push_back(
+                megabytes_per_second(total, decompress_time));
+        }
+
+        uint64_t all_compressed = 0;
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            all_compressed += compressed_size[i];
+            if (files[i].data.size() < min_item_size)
+                continue;
+
+            const string item = item_name(files[i].path);
+            out.row(item.c_str(), "compress", "MB/s", compress_speed[i]);
+            out.row(item.c_str(), "decompress", "MB/s", decompress_speed[i]);
+            out.value(item.c_str(),
+                      "ratio",
+                      "x",
+                      double(files[i].data.size()) /
+                          double(max(compressed_size[i], size_t(1))));
+        }
+        out.row("all", "compress", "MB/s", all_compress);
+        out.row("all", "decompress", "MB/s", all_decompress);
+        out.value("all",
+                  "ratio",
+                  "x",
+                  double(total_size(files)) /
+                      double(max(all_compressed, uint64_t(1))));
+
+        // Neither side allocates: the compressor works in the context and
+        // the output, the decompressor in the output alone.
+        out.value("all",
+                  "compress_memory",
+                  "bytes",
+                  double(berg_context_size() + bound));
+        out.value("all", "decompress_memory", "bytes", double(largest));
+    }
+    return true;
+}
+
+bool pack_archive(const char *corpus, const char *path, size_t block_size)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return false;
+    bool ok = false;
+    {
+        file_stream stream(file);
+        fs::ice_packer packer(stream);
+        ok = !packer.pack(string(corpus), true, block_size).has_error();
+    }
+    fclose(file);
+    return ok;
+}
+
+/**
+ * @brief Times mounting an archive, looking up and reading every file, then
+ * reads at random offsets after mounting again, so those start cold too.
+ * Warm runs start after one that fills the cache.
+ */
+bool bench_archive(const options &opts,
+                   const vector<corpus_file> &files,
+                   const char *path,
+                   bool mapped,
+                   bool cold,
+                   report_writer &out)
+{
+    vector<size_t> seekable;
+    for (size_t i = 0; i < files.size(); ++i)
+        if (files[i].data.size() >= seek_size)
+            seekable.push_back(i);
+    vector<uint8_t> contents(largest_size(files));
+
+    vector<double> mount_time, lookup_time, read_speed, seek_time;
+    lcg rng;
+    const size_t warmup = cold ? 0 : 1;
+    for (size_t run = 0; run < warmup + opts.runs; ++run)
+    {
+        if (cold)
+            evict_from_cache(path);
+
+        const uint64_t start = time::now().as_nanoseconds();
+        fs::ice_fs archive(path, mapped);
+        const uint64_t mounted = time::now().as_nanoseconds();
+
+        size_t found = 0;
+        for (const corpus_file &file : files)
+            found += archive.exists(file.path);
+        const uint64_t looked_up = time::now().as_nanoseconds();
+
+        uint64_t bytes = 0;
+        for (const corpus_file &file : files)
+        {
+            fs::file *in = archive.open(file.path, fs::open_mode::read);
+            if (!in)
+                break;
+            bytes += in->read(buffer(contents.data(), file.data.size()));
+            in->close();
+            delete in;
+        }
+        const uint64_t read = time::now().as_nanoseconds();
+        archive.unmount();
+
+        if (found != files.size() || bytes != total_size(files))
+        {
+            fprintf(stderr, "%s: entries missing or short\n", path);
+            return false;
+        }
+
+        if (cold)
+            evict_from_cache(path);
+        archive.mount(path, mapped);
+        vector<fs::file *> handles;
+        for (size_t i : seekable)
+            handles.push_back(archive.open(files[i].path, fs::open_mode::read));
+
+        const uint64_t seek_start = time::now().as_nanoseconds();
+        for (size_t op = 0; op < seek_count && !handles.empty(); ++op)
+        {
+            const size_t pick  = rng.next() % handles.size();
+            const size_t size  = files[seekable[pick]].data.size();
+            const size_t where = rng.next() % (size - seek_size + 1);
+            handles[pick]->seek((int64_t)where, fs::origin::begin);
+            handles[pick]->read(buffer(contents.data(), seek_size));
+        }
+        const uint64_t seek_end = time::now().as_nanoseconds();
+
+        for (fs::file *handle : handles)
+        {
+            handle->close();
+            delete handle;
+        }
+
+        if (run < warmup)
+            continue;
+        mount_time.push_back(double(mounted - start) / 1e3);
+        lookup_time.push_back(double(looked_up - mounted) /
+                              double(files.size()));
+        read_speed.push_back(
+            megabytes_per_second(total_size(files), read - looked_up));
+        if (!handles.empty())
+            seek_time.push_back(double(seek_end - seek_start) / 1e3 /
+                                double(seek_count));
+    }
+
+    out.cache = cold ? "cold" : "warm";
+    out.row("all", "mount", "us", mount_time);
+    out.row("all", "lookup", "ns", lookup_time);
+    out.row("all", "read", "MB/s", read_speed);
+    out.row("all", "seek_read_4k", "us", seek_time);
+    return true;
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    options opts;
+    if (!parse_options(argc, argv, opts))
+    {
+        fprintf(stderr,
+                "usage: %s [--corpus DIR] [--runs N] [--work DIR] [--json] "
+                "[--block-size BYTES]\n",
+                argv[0]);
+        return 2;
+    }
+
+    std::error_code ec;
+    const std::filesystem::path work(opts.work);
+    std::filesystem::create_directories(work, ec);
+
+    vector<corpus_file> files;
+    std::string corpus;
+    if (opts.corpus)
+    {
+        corpus = opts.corpus;
+        if (!load_corpus(opts.corpus, files))
+        {
+            fprintf(stderr, "%s: no files to read\n", opts.corpus);
+            return 1;
+        }
+    }
+    else
+    {
+        make_corpus(files);
+        corpus = (work / "corpus").string();
+        if (!write_corpus(corpus, files))
+        {
+            fprintf(stderr, "%s: cannot write the corpus\n", corpus.c_str());
+            return 1;
+        }
+    }
+
+    report_writer out;
+    out.json = opts.json;
+    out.begin();
+    bool ok = bench_berg(opts, files, out);
+
+    struct archive_variant
+    {
+        const char *name;
+        const char *file;
+        size_t block_size;
+        bool mapped;
+    };
+    const archive_variant variants[] = {
+        {"raw_mapped", "raw.ice", 0, true},
+        {"raw_pread", "raw.ice", 0, false},
+        {"blocks_mapped", "blocks.ice", opts.block_size, true},
+        {"blocks_pread", "blocks.ice", opts.block_size, false},
+    };
+
+    out.suite       = "ice_fs";
+    bool cold_known = false, can_evict = false;
+    for (const archive_variant &variant : variants)
+    {
+        if (!ok)
+            break;
+        const std::string path = (work / variant.file).string();
+        if (!std::filesystem::exists(path))
+        {
+            if (!pack_archive(corpus.c_str(), path.c_str(), variant.block_size))
+            {
+                fprintf(stderr, "%s: cannot pack\n", path.c_str());
+                ok = false;
+                break;
+            }
+            out.variant = variant.file;
+            out.cache   = "-";
+            out.value("all",
+                      "archive_size",
+                      "bytes",
+                      double(std::filesystem::file_size(path, ec)));
+        }
+
+        if (!cold_known)
+        {
+            cold_known = true;
+            can_evict  = evict_from_cache(path.c_str());
+            if (!can_evict)
+                fprintf(stderr, "no page cache control, cold runs left out\n");
+        }
+
+        out.variant = variant.name;
+        ok          = bench_archive(
+            opts, files, path.c_str(), variant.mapped, false, out);
+        if (ok && can_evict)
+            ok = bench_archive(
+                opts, files, path.c_str(), variant.mapped, true, out);
+    }
+
+    out.suite   = "process";
+    out.variant = "-";
+    out.cache   = "-";
+    out.value("all", "peak_memory", "bytes", double(peak_memory()));
+    out.end();
+
+    std::filesystem::remove_all(work, ec);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,223 @@
+#include "bench.hpp"
+
+#include <zabato/hash_map.hpp>
+#include <zabato/string.hpp>
+#include <zabato/time.hpp>
+#include <zabato/vector.hpp>
+
+#include <stdio.h>
+
+using namespace zabato;
+
+namespace
+{
+/**
+ * @brief The linear probing table `hash_map` used before control bytes, each
+ * entry holding its own state and deletions leaving tombstones.
+ */
+template <typename Key, typename Value, typename Hasher = hash<Key>>
+class linear_map
+{
+public:
+    explicit linear_map(size_t capacity)
+        : m_entries(new entry[capacity]), m_capacity(capacity)
+    {
+    }
+
+    ~linear_map() { delete[] m_entries; }
+
+    bool add(const Key &key, const Value &value)
+    {
+        entry *target = find_entry(key);
+        if (target->state == entry_state::occupied)
+            return false;
+        target->key   = key;
+        target->value = value;
+        target->state = entry_state::occupied;
+        m_size++;
+        return true;
+    }
+
+    Value *find(const Key &key)
+    {
+        entry *target = find_entry(key);
+        return target->state == entry_state::occupied ? &target->value
+                                                      : nullptr;
+    }
+
+    bool erase(const Key &key)
+    {
+        entry *target = find_entry(key);
+        if (target->state != entry_state::occupied)
+            return false;
+        target->state = entry_state::tombstone;
+        m_size--;
+        return true;
+    }
+
+private:
+    enum class entry_state : uint8_t
+    {
+        empty,
+        tombstone,
+        occupied
+    };
+
+    struct entry
+    {
+        Key key;
+        Value value;
+        entry_state state = entry_state::empty;
+    };
+
+    entry *find_entry(const Key &key)
+    {
+        size_t index     = m_hasher(key) % m_capacity;
+        entry *tombstone = nullptr;
+
+        for (size_t count = 0; count < m_capacity; count++)
+        {
+            entry *current = &m_entries[index];
+            if (current->state == entry_state::occupied)
+            {
+                if (current->key == key)
+                    return current;
+            }
+            else if (current->state == entry_state::empty)
+                return tombstone ? tombstone : current;
+            else if (!tombstone)
+                tombstone = current;
+
+            index = (index + 1) % m_capacity;
+        }
+        return tombstone;
+    }
+
+    entry *m_entries;
+    size_t m_capacity;
+    size_t m_size = 0;
+    Hasher m_hasher;
+};
+
+using bench::lcg;
+
+uint32_t make_key(uint32_t i, const uint32_t *) { return i * 2654435761u; }
+
+string make_key(uint32_t i, const string *)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "resource/%u.ice", i);
+    return string(text);
+}
+
+const char *key_name(const uint32_t *) { return "uint32"; }
+const char *key_name(const string *) { return "string"; }
+
+/** @brief Prints one CSV row. */
+void report(const char *map,
+            const char *benchmark,
+            const char *key,
+            size_t capacity,
+            size_t count,
+            size_t operations,
+            zabato::time start)
+{
+    const zabato::time end = zabato::time::now();
+    const double ns        = double((end - start).as_nanoseconds());
+    printf("%s,%s,%s,%zu,%.2f,%.2f\n",
+           map,
+           benchmark,
+           key,
+           capacity,
+           double(count) / double(capacity),
+           operations ? ns / double(operations) : 0.0);
+}
+
+/**
+ * @brief Fills a table of `capacity` slots with `count` keys, then measures
+ * hits, misses and erase/insert churn.
+ */
+template <typename Map, typename Key>
+void bench_map(const char *name,
+               size_t capacity,
+               size_t count,
+               const vector<Key> &keys,
+               const vector<Key> &missing,
+               const vector<uint32_t> &order)
+{
+    const char *key  = key_name((const Key *)nullptr);
+    const size_t ops = order.size();
+
+    Map map(capacity);
+    zabato::time start = zabato::time::now();
+    for (size_t i = 0; i < count; ++i)
+        map.add(keys[i], uint32_t(i));
+    report(name, "insert", key, capacity, count, count, start);
+
+    start = zabato::time::now();
+    for (size_t i = 0; i < ops; ++i)
+        bench::do_not_optimize(*map.find(keys[order[i] % count]));
+    report(name, "find_hit", key, capacity, count, ops, start);
+
+    start = zabato::time::now();
+    for (size_t i = 0; i < ops; ++i)
+        bench::do_not_optimize(map.find(missing[order[i] % count]) != nullptr);
+    report(name, "find_miss", key, capacity, count, ops, start);
+
+    // Erase and reinsert: tombstones build up in the linear table.
+    start = zabato::time::now();
+    for (size_t i = 0; i < ops; ++i)
+    {
+        const Key &k = keys[order[i] % count];
+        map.erase(k);
+        map.add(k, uint32_t(i));
+    }
+    report(name, "churn", key, capacity, count, ops, start);
+
+    start = zabato::time::now();
+    for (size_t i = 0; i < ops; ++i)
+        bench::do_not_optimize(map.find(missing[order[i] % count]) != nullptr);
+    report(name, "find_miss_churned", key, capacity, count, ops, start);
+}
+
+template <typename Key> void bench_key(lcg &rng)
+{
+    const size_t capacities[] = {1024, 16384, 262144};
+    const uint32_t loads[]    = {25, 50, 75}; // percent of the capacity
+    const size_t ops          = 200000;
+
+    for (size_t capacity : capacities)
+    {
+        vector<Key> keys, missing;
+        for (uint32_t i = 0; i < capacity; ++i)
+        {
+            keys.push_back(make_key(2 * i, (const Key *)nullptr));
+            missing.push_back(make_key(2 * i + 1, (const Key *)nullptr));
+        }
+
+        vector<uint32_t> order;
+        for (size_t i = 0; i < ops; ++i)
+            order.push_back(rng.next());
+
+        for (uint32_t load : loads)
+        {
+            const size_t count = capacity * load / 100;
+            bench_map<linear_map<Key, uint32_t>>(
+                "linear", capacity, count, keys, missing, order);
+            bench_map<hash_map<Key, uint32_t>>(
+                "control_bytes", capacity, count, keys, missing, order);
+        }
+    }
+}
+} // namespace
+
+int main()
+{
+    printf("map,benchmark,key,capacity,load,ns_per_op\n");
+
+    lcg rng;
+    bench_key<uint32_t>(rng);
+    bench_key<string>(rng);
+
+    return 0;
+}
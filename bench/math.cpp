@@ -0,0 +1,123 @@
+#include "bench.hpp"
+
+#include <zabato/math.hpp>
+#include <zabato/real.hpp>
+#include <zabato/time.hpp>
+
+#include <math.h>
+#include <stdio.h>
+
+using namespace zabato;
+
+namespace
+{
+/** @brief The generic `mat4 * mat4`, as used before the SIMD path. */
+mat4<real> scalar_mul(const mat4<real> &a, const mat4<real> &b)
+{
+    mat4<real> r;
+    for (int j = 0; j < 4; ++j)
+        for (int i = 0; i < 4; ++i)
+            r.m[j][i] = a.m[0][i] * b.m[j][0] + a.m[1][i] * b.m[j][1] +
+                        a.m[2][i] * b.m[j][2] + a.m[3][i] * b.m[j][3];
+    return r;
+}
+
+/** @brief The generic `mat4 * vec4`, as used before the SIMD path. */
+vec4<real> scalar_mul(const mat4<real> &m, const vec4<real> &v)
+{
+    return vec4<real>(m.m00 * v.x + m.m01 * v.y + m.m02 * v.z + m.m03 * v.w,
+                      m.m10 * v.x + m.m11 * v.y + m.m12 * v.z + m.m13 * v.w,
+                      m.m20 * v.x + m.m21 * v.y + m.m22 * v.z + m.m23 * v.w,
+                      m.m30 * v.x + m.m31 * v.y + m.m32 * v.z + m.m33 * v.w);
+}
+
+mat4<real> make_matrix(uint32_t &seed)
+{
+    mat4<real> m;
+    for (int i = 0; i < 16; ++i)
+    {
+        seed        = seed * 1664525u + 1013904223u;
+        (&m.m00)[i] = real(int32_t(seed >> 16)) / real(65536);
+    }
+    return m;
+}
+
+double ns_per_op(zabato::time start, zabato::time end, size_t ops)
+{
+    return double((end - start).as_nanoseconds()) / double(ops);
+}
+} // namespace
+
+int main()
+{
+    // Bone-palette sized chains, like animator::calculate_bone_transform.
+    const size_t matrix_count = 64;
+    const size_t rounds       = 20000;
+
+    mat4<real> matrices[matrix_count];
+    uint32_t seed = 12345;
+    for (mat4<real> &m : matrices)
+        m = make_matrix(seed);
+
+    // Both paths must agree before their timings mean anything.
+    float max_error = 0;
+    for (size_t i = 0; i + 1 < matrix_count; ++i)
+    {
+        const mat4<real> s = scalar_mul(matrices[i], matrices[i + 1]);
+        const mat4<real> v = matrices[i] * matrices[i + 1];
+        for (int k = 0; k < 16; ++k)
+            max_error = fmaxf(max_error,
+                              fabsf(float((&s.m00)[k] - (&v.m00)[k])));
+    }
+
+    printf("%-14s %12s %12s\n", "operation", "scalar ns", "simd ns");
+
+    const size_t ops = rounds * matrix_count;
+
+    zabato::time start = zabato::time::now();
+    mat4<real> acc     = mat4<real>::identity();
+    for (size_t r = 0; r < rounds; ++r)
+        for (const mat4<real> &m : matrices)
+            acc = scalar_mul(m, acc);
+    bench::do_not_optimize(float(acc.m00));
+    const double scalar_mm = ns_per_op(start, zabato::time::now(), ops);
+
+    start = zabato::time::now();
+    acc   = mat4<real>::identity();
+    for (size_t r = 0; r < rounds; ++r)
+        for (const mat4<real> &m : matrices)
+            acc = m * acc;
+    bench::do_not_optimize(float(acc.m00));
+    const double simd_mm = ns_per_op(start, zabato::time::now(), ops);
+
+    printf("%-14s %12.2f %12.2f\n", "mat4 * mat4", scalar_mm, simd_mm);
+
+    // Every matrix transforms a batch of points, as CPU skinning does.
+    const size_t point_count = 256;
+    const size_t point_ops   = (rounds / 16) * matrix_count * point_count;
+
+    vec4<real> points[point_count];
+    vec4<real> out[point_count];
+    for (size_t i = 0; i < point_count; ++i)
+        points[i] = vec4<real>(real(int32_t(i)), real(1), real(2), real(1));
+
+    start = zabato::time::now();
+    for (size_t r = 0; r < rounds / 16; ++r)
+        for (const mat4<real> &m : matrices)
+            for (size_t i = 0; i < point_count; ++i)
+                out[i] = scalar_mul(m, points[i]);
+    bench::do_not_optimize(float(out[point_count - 1].x));
+    const double scalar_mv = ns_per_op(start, zabato::time::now(), point_ops);
+
+    start = zabato::time::now();
+    for (size_t r = 0; r < rounds / 16; ++r)
+        for (const mat4<real> &m : matrices)
+            for (size_t i = 0; i < point_count; ++i)
+                out[i] = m * points[i];
+    bench::do_not_optimize(float(out[point_count - 1].x));
+    const double simd_mv = ns_per_op(start, zabato::time::now(), point_ops);
+
+    printf("%-14s %12.2f %12.2f\n", "mat4 * vec4", scalar_mv, simd_mv);
+    printf("max abs difference: %g\n", max_error);
+    return 0;
+}
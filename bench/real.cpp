@@ -0,0 +1,144 @@
+#include "bench.hpp"
+
+#include <zabato/real.hpp>
+#include <zabato/time.hpp>
+
+#include <math.h>
+#include <stdio.h>
+
+using namespace zabato;
+
+namespace
+{
+using fixed = custom_real<fixed_point_policy<16>>;
+
+const size_t sample_count = 4096;
+const size_t rounds       = 256;
+
+/** @brief Inputs shared by both policies, as doubles. */
+struct samples
+{
+    double angles[sample_count]; ///< Radians in [-8, 8].
+    double values[sample_count]; ///< Positive values in (0, 1000].
+    double xs[sample_count];     ///< Coordinates in [-4, 4].
+    double ys[sample_count];     ///< Coordinates in [-4, 4].
+
+    samples()
+    {
+        uint32_t seed = 12345;
+        for (size_t i = 0; i < sample_count; ++i)
+        {
+            angles[i] = next(seed) * 16.0 - 8.0;
+            values[i] = next(seed) * 1000.0 + 0.01;
+            xs[i]     = next(seed) * 8.0 - 4.0;
+            ys[i]     = next(seed) * 8.0 - 4.0;
+        }
+    }
+
+    static double next(uint32_t &seed)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        return double(seed >> 8) / double(1 << 24);
+    }
+};
+
+/** @brief Times one function over every sample and measures its largest
+ * error against double precision libm. */
+struct result
+{
+    double ns        = 0;
+    double max_error = 0;
+};
+
+template <typename T, typename Fn, typename Ref>
+result measure(const double *a, const double *b, Fn fn, Ref reference)
+{
+    T in_a[sample_count], in_b[sample_count];
+    for (size_t i = 0; i < sample_count; ++i)
+    {
+        in_a[i] = T(a[i]);
+        in_b[i] = T(b ? b[i] : 0.0);
+    }
+
+    result r;
+    for (size_t i = 0; i < sample_count; ++i)
+    {
+        const double expected = reference(double(in_a[i]), double(in_b[i]));
+        const double error    = fabs(double(fn(in_a[i], in_b[i])) - expected);
+        r.max_error           = fmax(r.max_error, error);
+    }
+
+    T acc              = T(0);
+    zabato::time start = zabato::time::now();
+    for (size_t round = 0; round < rounds; ++round)
+        for (size_t i = 0; i < sample_count; ++i)
+            acc += fn(in_a[i], in_b[i]);
+    zabato::time end = zabato::time::now();
+    bench::do_not_optimize(double(acc));
+
+    r.ns = double((end - start).as_nanoseconds()) /
+           double(rounds * sample_count);
+    return r;
+}
+
+template <typename Fn, typename Ref>
+void compare(const char *name,
+             const double *a,
+             const double *b,
+             Fn fn,
+             Ref reference)
+{
+    const result f = measure<real>(a, b, fn, reference);
+    const result x = measure<fixed>(a, b, fn, reference);
+    printf("%-8s %10.2f %10.2f %12.3g %12.3g\n",
+           name,
+           f.ns,
+           x.ns,
+           f.max_error,
+           x.max_error);
+}
+} // namespace
+
+int main()
+{
+    static samples s;
+
+    printf("%-8s %10s %10s %12s %12s\n",
+           "function",
+           "float ns",
+           "fixed ns",
+           "float error",
+           "fixed error");
+
+    compare(
+        "sin",
+        s.angles,
+        nullptr,
+        [](auto a, auto) { return sin(a); },
+        [](double a, double) { return ::sin(a); });
+    compare(
+        "cos",
+        s.angles,
+        nullptr,
+        [](auto a, auto) { return cos(a); },
+        [](double a, double) { return ::cos(a); });
+    compare(
+        "sqrt",
+        s.values,
+        nullptr,
+        [](auto a, auto) { return sqrt(a); },
+        [](double a, double) { return ::sqrt(a); });
+    compare(
+        "rsqrt",
+        s.values,
+        nullptr,
+        [](auto a, auto) { return rsqrt(a); },
+        [](double a, double) { return 1.0 / ::sqrt(a); });
+    compare(
+        "atan2",
+        s.ys,
+        s.xs,
+        [](auto y, auto x) { return atan2(y, x); },
+        [](double y, double x) { return ::atan2(y, x); });
+    return 0;
+}
@@ -0,0 +1,359 @@
+#include "bench.hpp"
+
+#include <zabato/bounds.hpp>
+#include <zabato/controller.hpp>
+#include <zabato/mesh.hpp>
+#include <zabato/node.hpp>
+#include <zabato/null_gpu.hpp>
+#include <zabato/profiler.hpp>
+#include <zabato/render_queue.hpp>
+#include <zabato/scene_file.hpp>
+#include <zabato/time.hpp>
+#include <zabato/utils.hpp>
+#include <zabato/world.hpp>
+#include <zabato/xml_serializer.hpp>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace zabato;
+
+// Steps a scene headless with a fixed time step and prints per-phase timing
+// percentiles as JSON, for tracking performance on machines without a
+// display:
+//
+//   bench_scene [--frames N] [--warmup N] [--dt SECONDS]
+//               [--scene FILE.xml|FILE.ice] [--no-render]
+//
+// Without `--scene` a generated scene of spinning nodes is used. A `.ice`
+// scene is one compiled by `zabato_scene`, and the time either kind took to
+// load is reported. Rendering
+// goes to a `null_gpu`, so the render phases time culling, sorting and
+// submission on the CPU, and the counts of what would have been drawn are
+// reported alongside.
+
+namespace
+{
+struct options
+{
+    size_t frames     = 1000;
+    size_t warmup     = 60;
+    real dt           = real(1) / real(60);
+    const char *scene = nullptr;
+    bool render       = true;
+};
+
+bool parse_options(int argc, char **argv, options &out)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        const bool has_value = i + 1 < argc;
+        if (!strcmp(argv[i], "--frames") && has_value)
+            out.frames = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--warmup") && has_value)
+            out.warmup = strtoul(argv[++i], nullptr, 10);
+        else if (!strcmp(argv[i], "--dt") && has_value)
+            out.dt = real(float(atof(argv[++i])));
+        else if (!strcmp(argv[i], "--scene") && has_value)
+            out.scene = argv[++i];
+        else if (!strcmp(argv[i], "--no-render"))
+            out.render = false;
+        else
+            return false;
+    }
+    return out.frames > 0;
+}
+
+using bench::lcg;
+
+/** @brief Spins its spatial about the vertical axis, standing in for logic. */
+class spin_controller : public controller
+{
+public:
+    static const rtti TYPE;
+    const rtti &type() const override { return TYPE; }
+
+    explicit spin_controller(real speed) : m_speed(speed) {}
+
+    void update(real dt) override
+    {
+        spatial *target = static_cast<spatial *>(get_object());
+        m_angle += m_speed * dt;
+
+        transformation local = target->get_local();
+        local.set_rotate(
+            quat_from_axis_angle(vec3<real>(real(0), real(1), real(0)),
+                                 m_angle));
+        target->set_local(local);
+    }
+
+private:
+    real m_speed;
+    real m_angle = real(0);
+};
+
+const rtti spin_controller::TYPE("bench.spin_controller", &controller::TYPE);
+
+/**
+ * @brief A grid of groups of spinning nodes around the origin, each node
+ * with a unit bound, part of it in view of the benchmark's camera.
+ */
+node *make_scene(size_t groups, size_t nodes_per_group)
+{
+    lcg rng;
+    node *root = new node();
+
+    const size_t side = size_t(ceilf(sqrtf(float(groups))));
+    for (size_t g = 0; g < groups; ++g)
+    {
+        node *group = new node();
+        transformation placement;
+        placement.set_translate(
+            vec3<real>(real(int32_t(g % side) * 20 - int32_t(side) * 10),
+                       real(0),
+                       real(int32_t(g / side) * 20 - int32_t(side) * 10)));
+        group->set_local(placement);
+        root->attach_child(group);
+
+        for (size_t n = 0; n < nodes_per_group; ++n)
+        {
+            node *leaf = new node();
+            transformation local;
+            local.set_translate(vec3<real>(rng.range(real(-8), real(8)),
+                                           rng.range(real(0), real(4)),
+                                           rng.range(real(-8), real(8))));
+            leaf->set_local(local);
+            leaf->set_model_bound({vec3<real>(real(0)), real(1)});
+            leaf->add_controller(
+                new spin_controller(rng.range(real(-3), real(3))));
+            group->attach_child(leaf);
+        }
+    }
+    return root;
+}
+
+/** @brief The mesh drawn for every visible spatial, a unit cube. */
+void make_cube(mesh &cube)
+{
+    cube.init(mesh_flags::none, primitive_type::triangles);
+    cube.set_vertex_count(8);
+    for (uint16_t i = 0; i < 8; ++i)
+        cube.set_position(i,
+                          vec3<real>(real(i & 1 ? 1 : -1),
+                                     real(i & 2 ? 1 : -1),
+                                     real(i & 4 ? 1 : -1)));
+
+    static const uint16_t faces[12][3] = {
+        {0, 2, 1}, {1, 2, 3}, {4, 5, 6}, {5, 7, 6}, {0, 1, 4}, {1, 5, 4},
+        {2, 6, 3}, {3, 6, 7}, {0, 4, 2}, {2, 4, 6}, {1, 3, 5}, {3, 7, 5},
+    };
+    cube.set_primitive_count(12);
+    for (uint16_t i = 0; i < 12; ++i)
+    {
+        triangle_primitive triangle;
+        triangle.v0 = faces[i][0];
+        triangle.v1 = faces[i][1];
+        triangle.v2 = faces[i][2];
+        cube.set_primitive(i, triangle);
+    }
+}
+
+/** @brief The per-frame nanoseconds of one phase or profiler zone. */
+struct timing_series
+{
+    const char *name;
+    vector<uint64_t> samples;
+};
+
+timing_series &find_series(vector<timing_series> &series, const char *name)
+{
+    for (timing_series &s : series)
+        if (s.name == name)
+            return s;
+    series.push_back({name, {}});
+    return series.back();
+}
+
+void print_series(const timing_series &series, bool last)
+{
+    vector<uint64_t> sorted = series.samples;
+    sort(sorted.begin(), sorted.end());
+
+    uint64_t total = 0;
+    for (uint64_t sample : sorted)
+        total += sample;
+    auto percentile = [&](size_t p)
+    { return double(sorted[(sorted.size() - 1) * p / 100]) / 1e6; };
+
+    printf("    \"%s\": {\"mean\": %.4f, \"p50\": %.4f, \"p90\": %.4f, "
+           "\"p99\": %.4f, \"max\": %.4f}%s\n",
+           series.name,
+           double(total) / double(sorted.size()) / 1e6,
+           percentile(50),
+           percentile(90),
+           percentile(99),
+           double(sorted.back()) / 1e6,
+           last ? "" : ",");
+}
+} // namespace
+
+int main(int argc, char **argv)
+{
+    options opts;
+    if (!parse_options(argc, argv, opts))
+    {
+        fprintf(stderr,
+                "usage: %s [--frames N] [--warmup N] [--dt SECONDS] "
+                "[--scene FILE.xml|FILE.ice] [--no-render]\n",
+                argv[0]);
+        return 2;
+    }
+
+    object::initialize_factory();
+
+    spatial *root = nullptr;
+    xml_serializer serializer;
+    scene_file compiled;
+    uint64_t load_time = 0;
+    if (opts.scene)
+    {
+        const uint64_t start = time::now().as_nanoseconds();
+        const size_t length  = strlen(opts.scene);
+        if (length > 4 && !strcmp(opts.scene + length - 4, ".ice"))
+        {
+            if (FILE *file = fopen(opts.scene, "rb"))
+            {
+                file_stream in(file);
+                ice_reader reader(in);
+                if (!deserialize(reader, compiled).has_error())
+                    root = compiled.get_root();
+                fclose(file);
+            }
+        }
+        else
+        {
+            object *loaded = serializer.load(opts.scene);
+            if (loaded && loaded->is_derived(spatial::TYPE))
+                root = static_cast<spatial *>(loaded);
+        }
+        load_time = time::now().as_nanoseconds() - start;
+
+        if (!root)
+        {
+            fprintf(stderr, "%s: not a scene\n", opts.scene);
+            return 1;
+        }
+    }
+    else
+    {
+        root = make_scene(64, 64);
+    }
+
+    world scene;
+    scene.set_scene_root(root);
+    scene.register_controllers_recursive(root);
+
+    // A fixed camera looking down at the middle of the scene.
+    const mat4<real> view =
+        mat4_look_at(vec3<real>(real(0), real(60), real(-120)),
+                     vec3<real>(real(0)),
+                     vec3<real>(real(0), real(1), real(0)));
+    const mat4<real> projection = mat4_perspective_fov(
+        real(1.0f), real(16.0f / 9.0f), real(0.5f), real(500));
+    const frustum view_frustum = frustum::from_matrix(projection * view);
+
+    mesh cube;
+    make_cube(cube);
+    null_gpu device;
+    vector<spatial *> visible;
+    render_queue queue;
+    queue.set_depth_range(real(0.5f), real(500));
+
+    // Phases first, in order, then profiler zones as they show up.
+    vector<timing_series> series;
+    const char *phases[] = {"frame", "update", "cull", "queue", "submit"};
+    for (const char *phase : phases)
+        series.push_back({phase, {}});
+
+    size_t draw_calls = 0, vertices = 0, state_changes = 0;
+    profile_frame profile;
+    for (size_t frame = 0; frame < opts.warmup + opts.frames; ++frame)
+    {
+        const bool measured = frame >= opts.warmup;
+        uint64_t stamps[5];
+        stamps[0] = time::now().as_nanoseconds();
+
+        scene.update(opts.dt);
+        stamps[1] = time::now().as_nanoseconds();
+
+        if (opts.render)
+        {
+            visible.clear();
+            root->collect_visible(view_frustum, frustum::all_planes, visible);
+            stamps[2] = time::now().as_nanoseconds();
+
+            queue.clear();
+            for (spatial *s : visible)
+            {
+                const mat4<real> model_view =
+                    view * s->get_world_transform().to_matrix();
+                queue.add(&cube, nullptr, model_view, -model_view.m23, false);
+            }
+            queue.sort();
+            stamps[3] = time::now().as_nanoseconds();
+
+            device.new_frame();
+            queue.submit(device);
+            stamps[4] = time::now().as_nanoseconds();
+        }
+        else
+        {
+            stamps[2] = stamps[3] = stamps[4] = stamps[1];
+        }
+
+        collect_profile_frame(profile);
+        if (!measured)
+            continue;
+
+        series[0].samples.push_back(stamps[4] - stamps[0]);
+        for (size_t i = 1; i < 5; ++i)
+            series[i].samples.push_back(stamps[i] - stamps[i - 1]);
+
+        // Zones add up per frame, a zone missing from a frame counting 0.
+        const size_t measured_frames = frame - opts.warmup + 1;
+        for (const profile_zone &zone : profile.zones)
+        {
+            timing_series &s =
+                find_series(series, get_symbol_name(zone.name));
+            s.samples.resize(measured_frames, 0);
+            s.samples.back() += zone.duration;
+        }
+        for (size_t i = 5; i < series.size(); ++i)
+            series[i].samples.resize(measured_frames, 0);
+
+        const gpu_frame_stats stats = device.get_frame_stats();
+        draw_calls += stats.draw_calls;
+        vertices += stats.vertices;
+        state_changes += stats.state_changes;
+    }
+
+    printf("{\n");
+    printf("  \"frames\": %zu,\n", opts.frames);
+    printf("  \"dt\": %.6f,\n", double(float(opts.dt)));
+    printf("  \"scene\": \"%s\",\n", opts.scene ? opts.scene : "generated");
+    printf("  \"load_ms\": %.4f,\n", double(load_time) / 1e6);
+    printf("  \"profiler\": %s,\n", profiling ? "true" : "false");
+    printf("  \"ms\": {\n");
+    for (size_t i = 0; i < series.size(); ++i)
+        print_series(series[i], i + 1 == series.size());
+    printf("  },\n");
+    printf("  \"per_frame\": {\"draw_calls\": %.1f, \"vertices\": %.1f, "
+           "\"state_changes\": %.1f}\n",
+           double(draw_calls) / double(opts.frames),
+           double(vertices) / double(opts.frames),
+           double(state_changes) / double(opts.frames));
+    printf("}\n");
+    return 0;
+}
@@ -0,0 +1,62 @@
+-- Microbenchmarks. Not built by default: `xmake build bench_<name>` and
+-- `xmake run bench_<name>` to run one.
+
+target("bench_animation")
+    set_kind("binary")
+    set_default(false)
+    set_languages("c++23")
+    add_files("animation.cpp")
+    add_deps("cstd", "zabato")
+
+target("bench_collision")
+    set_kind("binary")
+    set_default(false)
+    set_languages("c++23")
+    add_files("collision.cpp")
+    add_deps("cstd", "zabato")
+
+target("bench_color")
+    set_kind("binary")
+    set_default(false)
+    set_languages("c++23")
+    add_files("color.cpp")
+    add_deps("cstd")
+
+target("bench_compression")
+    set_kind("binary")
+    set_default(false)
+    set_languages("c++23")
+    add_files("compression.cpp")
+    add_deps("cstd", "berg")
+
+    if is_plat("windows") then
+        add_syslinks("psapi")
+    end
+
+target("bench_hash_map")
+    set_kind("binary")
+    set_default(false)
+    set_languages("c++23")
+    add_files("hash_map.cpp")
+    add_deps("cstd")
+
+target("bench_math")
+    set_kind("binary")
+    set_default(false)
+    set_languages("c++23")
+    add_files("math.cpp")
+    add_deps("cstd")
+
+target("bench_scene")
+    set_kind("binary")
+    set_default(false)
+    set_languages("c++23")
+    add_files("scene.cpp")
+    add_deps("cstd", "zabato")
+
+target("bench_real")
+    set_kind("binary")
+    set_default(false)
+    set_languages("c++23")
+    add_files("real.cpp")
+    add_deps("cstd")
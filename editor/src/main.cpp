@@ -1,14 +1,47 @@
 #include <zabato/gpu.hpp>
 #include <zabato/imgui.hpp>
+#include <zabato/log.hpp>
+#include <zabato/simulation_loop.hpp>
 #include <zabato/window.hpp>
 
-#include <iostream>
+#include "performance_hud.hpp"
 
 using namespace zabato;
 
+namespace
+{
+/** @brief What the simulation thread advances and the render loop draws. */
+struct editor_state
+{
+    vec2<real> marker;
+};
+
+void tick_editor(void *user,
+                 const input_snapshot &input,
+                 real dt,
+                 editor_state &state)
+{
+    const real speed = real(100);
+    vec2<real> move;
+    if (input.is_key_down(key_code::left))
+        move.x -= real(1);
+    if (input.is_key_down(key_code::right))
+        move.x += real(1);
+    if (input.is_key_down(key_code::up))
+        move.y -= real(1);
+    if (input.is_key_down(key_code::down))
+        move.y += real(1);
+    move += vec2<real>(
+        input.state.get_gamepad_analog(0, gamepad_analog::left_x),
+        input.state.get_gamepad_analog(0, gamepad_analog::left_y));
+    state.marker += move * (speed * dt);
+}
+} // namespace
+
 int main(int argc, char **argv)
 {
-    std::cout << "hello world!" << std::endl;
+    start_logging();
+    LOG_INFO("hello world!");
 
     init_window_system();
     window *window =
@@ -18,10 +51,34 @@ int main(int argc, char **argv)
     gpu *gpu = init_gpu();
     imgui::init(window);
 
+    resource_manager resources;
+    performance_hud hud;
+
+    // Gameplay ticks at a fixed rate on its own thread, fed input snapshots,
+    // so a slow frame here does not slow it down.
+    simulation_loop<editor_state> simulation;
+    simulation.start(tick_editor, nullptr, editor_state());
+    input_snapshot input;
+
     auto last_time = get_time();
     while (!window->should_close())
     {
+        auto current_time = get_time();
+        real delta_time =
+            (real)(current_time - last_time) * (real(1) / real(1000));
+        last_time = current_time;
+        hud.new_frame(delta_time);
+
         poll_events();
+        capture_input(input);
+        simulation.publish_input(input);
+
+        simulation.update_frame();
+        const simulation_frame<editor_state> &frame = simulation.get_frame();
+        const real alpha = simulation.get_alpha(time::now().as_nanoseconds());
+        const vec2<real> marker =
+            frame.previous.marker +
+            (frame.current.marker - frame.previous.marker) * alpha;
 
         imgui::new_frame();
         ImGui::ShowDemoWindow();
@@ -32,23 +89,30 @@ int main(int argc, char **argv)
         if (ImGui::Button("Click Me"))
             click_count++;
         ImGui::Text("Clicks: %d", click_count);
+        ImGui::Text("Tick %llu, marker (%.1f, %.1f)",
+                    (unsigned long long)frame.tick,
+                    (float)marker.x,
+                    (float)marker.y);
         ImGui::End();
 
-        auto current_time = get_time();
-        real delta_time =
-            (real)(current_time - last_time) * (real(1) / real(1000));
-        last_time = current_time;
+        hud.draw(*gpu, resources);
 
+        frame_arena::reset();
+        reset_frame_memory_stats();
         gpu->new_frame();
         gpu->clear({0.243, 0.1, 0.15, 1.0}, 1.0);
 
         ImGui::Render();
+        gpu->begin_timing("imgui");
         imgui::render_draw_data(ImGui::GetDrawData());
+        gpu->end_timing();
 
         window->swap_buffers();
     }
 
+    simulation.stop();
     zabato::imgui::shutdown();
+    stop_logging();
 
     return 0;
 }
@@ -0,0 +1,183 @@
+#include "performance_hud.hpp"
+
+#include <zabato/imgui.hpp>
+#include <zabato/memory_tracking.hpp>
+
+#include <stdio.h>
+
+namespace zabato
+{
+namespace
+{
+/**
+ * @brief Draws the zones of a frame as a flame graph, one band per thread
+ * with the enclosing zones on top.
+ */
+void draw_flame_graph(const profile_frame &frame)
+{
+    const float row_height = ImGui::GetTextLineHeightWithSpacing();
+    const float width      = ImGui::GetContentRegionAvail().x;
+    const ImVec2 origin    = ImGui::GetCursorScreenPos();
+    const float scale =
+        frame.duration > 0 ? width / float(frame.duration) : 0.0f;
+
+    // The zones of a thread are contiguous, each band starts below the last.
+    uint32_t rows = 0, band = 0, thread = UINT32_MAX;
+    ImDrawList *draw_list = ImGui::GetWindowDrawList();
+    for (const profile_zone &zone : frame.zones)
+    {
+        if (zone.thread != thread)
+        {
+            thread = zone.thread;
+            band   = rows;
+        }
+        rows = max(rows, band + zone.depth + 1);
+
+        const float x0 = origin.x + float(zone.start - frame.start) * scale;
+        const float x1 = x0 + float(zone.duration) * scale;
+        const float y0 = origin.y + float(band + zone.depth) * row_height;
+        const ImVec2 top_left(x0, y0);
+        const ImVec2 bottom_right(max(x1, x0 + 1), y0 + row_height - 1);
+        const ImU32 color = ImGui::GetColorU32(
+            ImVec4(0.9f, 0.3f + 0.1f * float(zone.depth % 6), 0.2f, 1.0f));
+        draw_list->AddRectFilled(top_left, bottom_right, color);
+
+        const char *name = get_symbol_name(zone.name);
+        if (ImGui::CalcTextSize(name).x < x1 - x0)
+            draw_list->AddText(top_left, IM_COL32_BLACK, name);
+        if (ImGui::IsMouseHoveringRect(top_left, bottom_right))
+            ImGui::SetTooltip("%s: %.3f ms",
+                              name,
+                              double(zone.duration) / 1e6);
+    }
+    ImGui::Dummy(ImVec2(width, float(rows) * row_height));
+}
+} // namespace
+
+void performance_hud::new_frame(real frame_time)
+{
+    m_frame_times[m_frame_index] = float(frame_time) * 1000.0f;
+    m_frame_index                = (m_frame_index + 1) % history_size;
+
+    collect_profile_frame(m_profile);
+    if (m_recording)
+        m_recorded.push_back(m_profile);
+}
+
+void performance_hud::draw(gpu &gpu, const resource_manager &resources)
+{
+    if (ImGui::IsKeyPressed(ImGuiKey_F1, false))
+        m_visible = !m_visible;
+    if (!m_visible)
+        return;
+
+    ImGui::SetNextWindowSize(ImVec2(420, 480), ImGuiCond_FirstUseEver);
+    if (ImGui::Begin("Performance", &m_visible))
+    {
+        draw_frame_times();
+        if (profiling && ImGui::CollapsingHeader("CPU zones"))
+            draw_profiler();
+        if (ImGui::CollapsingHeader("GPU", ImGuiTreeNodeFlags_DefaultOpen))
+            draw_gpu(gpu);
+        if (memory_tracking && ImGui::CollapsingHeader("Memory"))
+            draw_memory();
+        if (ImGui::CollapsingHeader("Resources"))
+            draw_resources(resources);
+    }
+    ImGui::End();
+}
+
+void performance_hud::draw_frame_times()
+{
+    float total = 0.0f, worst = 0.0f;
+    for (float time : m_frame_times)
+    {
+        total += time;
+        worst = max(worst, time);
+    }
+
+    char overlay[64];
+    snprintf(overlay,
+             sizeof(overlay),
+             "avg %.2f ms, max %.2f ms",
+             double(total / float(history_size)),
+             double(worst));
+    ImGui::PlotLines("##frame_times",
+                     m_frame_times,
+                     int(history_size),
+                     int(m_frame_index),
+                     overlay,
+                     0.0f,
+                     max(worst, 1000.0f / 30.0f),
+                     ImVec2(ImGui::GetContentRegionAvail().x, 64));
+}
+
+void performance_hud::draw_profiler()
+{
+    ImGui::Text("%.3f ms, %zu zones",
+                double(m_profile.duration) / 1e6,
+                m_profile.zones.size());
+    ImGui::SameLine();
+    if (ImGui::Button(m_recording ? "Save trace" : "Record trace"))
+    {
+        if (m_recording)
+        {
+            if (FILE *file = fopen("trace.json", "wb"))
+            {
+                file_stream out(file);
+                write_chrome_trace(m_recorded, out);
+                fclose(file);
+            }
+            m_recorded.clear();
+        }
+        m_recording = !m_recording;
+    }
+    draw_flame_graph(m_profile);
+}
+
+void performance_hud::draw_gpu(gpu &gpu)
+{
+    // Read before the GPU's `new_frame`, so these cover the whole last frame.
+    const gpu_frame_stats stats = gpu.get_frame_stats();
+    ImGui::Text("%zu draws, %zu vertices", stats.draw_calls, stats.vertices);
+    ImGui::Text("%zu texture binds, %zu state changes",
+                stats.texture_binds,
+                stats.state_changes);
+    for (const gpu_timing &timing : gpu.get_timings())
+        ImGui::Text("%*s%s: %.3f ms",
+                    int(timing.depth * 2),
+                    "",
+                    timing.name,
+                    double(timing.nanoseconds) / 1e6);
+}
+
+void performance_hud::draw_memory()
+{
+    for (size_t i = 0; i < (size_t)memory_category::count; ++i)
+    {
+        const memory_category category = (memory_category)i;
+        const memory_stats stats       = get_memory_stats(category);
+        ImGui::Text("%s: %zu KiB (peak %zu KiB), %zu blocks, %zu this frame",
+                    get_memory_category_name(category),
+                    stats.live_bytes / 1024,
+                    stats.peak_bytes / 1024,
+                    stats.live_allocations,
+                    stats.frame_allocations);
+    }
+}
+
+void performance_hud::draw_resources(const resource_manager &resources)
+{
+    const resource_stats stats = resources.get_stats();
+    const uint64_t requests    = stats.hits + stats.misses;
+    ImGui::Text("%zu resident, %zu KiB",
+                stats.resident_count,
+                stats.resident_bytes / 1024);
+    ImGui::Text("%llu hits, %llu misses (%.1f%% hit), %llu evictions",
+                (unsigned long long)stats.hits,
+                (unsigned long long)stats.misses,
+                requests ? 100.0 * double(stats.hits) / double(requests) : 0.0,
+                (unsigned long long)stats.evictions);
+    ImGui::Text("%zu files prefetched", resources.prefetched());
+}
+} // namespace zabato
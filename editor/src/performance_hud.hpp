@@ -0,0 +1,48 @@
+#pragma once
+
+#include <zabato/gpu.hpp>
+#include <zabato/profiler.hpp>
+#include <zabato/resource.hpp>
+
+namespace zabato
+{
+/**
+ * @class performance_hud
+ * @brief An overlay of the engine's counters, toggled with F1: frame times,
+ * profiler zones, GPU timings and counters, memory and resource cache stats.
+ */
+class performance_hud
+{
+public:
+    /** @brief The frames the frame time plot spans. */
+    static constexpr size_t history_size = 240;
+
+    /**
+     * @brief Records the last frame. Call once per frame, before `draw`.
+     * @param frame_time The seconds the last frame took.
+     */
+    void new_frame(real frame_time);
+
+    /** @brief Draws the overlay, if shown, into the current ImGui frame. */
+    void draw(gpu &gpu, const resource_manager &resources);
+
+    bool is_visible() const { return m_visible; }
+    void set_visible(bool visible) { m_visible = visible; }
+
+private:
+    void draw_frame_times();
+    void draw_profiler();
+    void draw_gpu(gpu &gpu);
+    void draw_memory();
+    void draw_resources(const resource_manager &resources);
+
+    bool m_visible = true;
+
+    float m_frame_times[history_size] = {}; ///< Milliseconds, a ring.
+    size_t m_frame_index              = 0;  ///< The next entry to write.
+
+    profile_frame m_profile; ///< The zones of the last frame.
+    vector<profile_frame> m_recorded;
+    bool m_recording = false;
+};
+} // namespace zabato
@@ -18,6 +18,66 @@
 #include <zabato/berg.h>
 #include <zabato/crc32.h>
 
+/*
+ * Kernel selection. Define BERG_NO_SIMD to build the portable kernels only.
+ * Word-at-a-time match extension needs a little-endian target, others fall
+ * back to comparing bytes.
+ */
+#if !defined(BERG_NO_SIMD)
+#if defined(__SSE2__) || defined(_M_X64) ||                                  \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define BERG_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define BERG_NEON 1
+#include <arm_neon.h>
+#endif
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if (defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__) ||  \
+    defined(_M_X64) || defined(_M_IX86) || defined(_M_ARM64) ||              \
+    defined(__x86_64__) || defined(__i386__)
+#define BERG_LITTLE_ENDIAN 1
+#endif
+
+/*
+ * CRC32 kernel selection. The instructions are not part of the baseline of
+ * any of these targets, so the kernels are compiled for them on their own and
+ * picked at runtime, falling back to the tables of crc32.h. ARMv8 needs no
+ * runtime check when the compiler already targets the CRC extension.
+ */
+#if !defined(BERG_NO_SIMD)
+#if (defined(__GNUC__) || defined(__clang__)) &&                               \
+    (defined(__x86_64__) || defined(__i386__))
+#define BERG_CRC32_PCLMUL 1
+#define BERG_TARGET_PCLMUL __attribute__((target("sse2,pclmul")))
+#include <cpuid.h>
+#include <wmmintrin.h>
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define BERG_CRC32_PCLMUL 1
+#define BERG_TARGET_PCLMUL
+#include <wmmintrin.h>
+#elif defined(BERG_LITTLE_ENDIAN) &&                                           \
+    (defined(__ARM_FEATURE_CRC32) || defined(_M_ARM64))
+#define BERG_CRC32_ARM 1
+#define BERG_TARGET_CRC
+#if !defined(_MSC_VER)
+#include <arm_acle.h>
+#endif
+#elif defined(BERG_LITTLE_ENDIAN) && defined(__aarch64__) &&                   \
+    defined(__linux__) && defined(__GNUC__) && !defined(__clang__)
+#define BERG_CRC32_ARM 1
+#define BERG_CRC32_ARM_HWCAP 1
+#define BERG_TARGET_CRC __attribute__((target("+crc")))
+#include <arm_acle.h>
+#include <sys/auxv.h>
+#endif
+#endif
+
 #ifdef __cplusplus
 extern "C"
 {
@@ -33,10 +93,16 @@ extern "C"
 #define BERG_MAX_DIRECT_LITERAL_COUNT ((size_t)2)
 #define BERG_MIN_EXTENDED_LITERAL_COUNT                                        \
     ((size_t)(BERG_MAX_DIRECT_LITERAL_COUNT + 1))
-#define BERG_HASH_SIZE ((size_t)16384)
-#define BERG_MAX_CHAIN_LENGTH ((size_t)8)
+#define BERG_HASH_BITS 14
+#define BERG_MIN_HASH_BITS 10
+#define BERG_HASH_SIZE ((size_t)1 << BERG_HASH_BITS)
 #define BERG_CHAIN_MASK ((size_t)0xFFFF)
 
+/* Positions priced at once by the optimal parse. */
+#define BERG_OPTIMAL_WINDOW ((size_t)2048)
+/* Longest match the optimal parse prices, longer ones are always taken. */
+#define BERG_OPTIMAL_MAX_NICE_LENGTH ((size_t)256)
+
 #define CHECK_ERR(err)                                                         \
     do                                                                         \
     {                                                                          \
@@ -62,12 +128,364 @@ typedef struct
     size_t length;
 } berg_match_result_t;
 
+/*
+ * Tables of the match finder. Entries hold input positions plus `base`, so
+ * entries of earlier inputs compressed with the same tables, at most `base`,
+ * read as empty without clearing anything. A chain entry is only read for a
+ * position added to the current input, which wrote it first, so the chain
+ * table is never cleared either. With a dictionary, positions count from the
+ * start of the dictionary, which is added ahead of the input.
+ */
 typedef struct
 {
     uint32_t hash_table[BERG_HASH_SIZE];
     uint32_t chain_table[BERG_CHAIN_MASK + 1];
+    uint32_t base;             /* Table value of dictionary position 0 */
+    uint32_t hash_shift;       /* 32 minus the hash bits of this input */
+    const uint8_t *dictionary; /* Bytes preceding the input, may be NULL */
+    uint32_t dictionary_size;  /* At most BERG_MAX_DICTIONARY_SIZE */
 } berg_hash_matcher_t;
 
+struct berg_context
+{
+    berg_hash_matcher_t matcher;
+    uint32_t next_base;     /* Above every value in the tables */
+    uint32_t clean_entries; /* Leading hash entries that hold table values */
+};
+
+/* Cheapest known way to encode the input up to a position. */
+typedef struct
+{
+    uint32_t price;    /* Encoded bytes, relative to the window start */
+    uint32_t literals; /* Literal run ending here, 0 after a match */
+    uint32_t length;   /* Length of the match ending here, 0 for a literal */
+    uint16_t offset;   /* Offset of that match */
+} berg_optimal_node_t;
+
+/* Bytes a wildcopy may write past the end of a copy. */
+#define BERG_WILDCOPY_SLACK ((size_t)16)
+
+/* Longest token: two bytes and two 32-bit varints. */
+#define BERG_MAX_TOKEN_SIZE ((size_t)12)
+
+struct berg_decoder
+{
+    uint8_t window[BERG_DEFAULT_WINDOW_SIZE]; /* Last output, as a ring */
+    uint8_t header[BERG_MAX_TOKEN_SIZE];      /* Token split across inputs */
+    size_t header_size;                       /* Bytes in `header` */
+    size_t original_size;                     /* Bytes to decompress */
+    size_t output_pos;                        /* Bytes decompressed so far */
+    size_t literals;                          /* Literals left to copy */
+    size_t match_offset;                      /* Offset of the match */
+    size_t match_length;                      /* Match bytes left to copy */
+};
+
+/* Kernels */
+
+/* Index of the lowest set bit, `value` must not be 0. */
+static inline unsigned berg_ctz64(uint64_t value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctzll(value);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return (unsigned)index;
+#else
+    unsigned count = 0;
+    while ((value & 1) == 0)
+    {
+        value >>= 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+static inline uint64_t berg_load64(const uint8_t *data)
+{
+    uint64_t value;
+    memcpy(&value, data, sizeof(value));
+    return value;
+}
+
+static inline void berg_copy8(uint8_t *dst, const uint8_t *src)
+{
+    memcpy(dst, src, 8);
+}
+
+static inline void berg_copy16(uint8_t *dst, const uint8_t *src)
+{
+#if defined(BERG_SSE2)
+    _mm_storeu_si128((__m128i *)dst, _mm_loadu_si128((const __m128i *)src));
+#elif defined(BERG_NEON)
+    vst1q_u8(dst, vld1q_u8(src));
+#else
+    memcpy(dst, src, 16);
+#endif
+}
+
+/*
+ * Length of the common prefix of `a` and `b`, at most `max_len`. Compares 16
+ * bytes at a time with SIMD and 8 at a time with XOR and count trailing
+ * zeros, never reading past `max_len`.
+ */
+static inline size_t
+berg_match_length(const uint8_t *a, const uint8_t *b, size_t max_len)
+{
+    size_t len = 0;
+
+#if defined(BERG_SSE2)
+    while (len + 16 <= max_len)
+    {
+        __m128i x     = _mm_loadu_si128((const __m128i *)(a + len));
+        __m128i y     = _mm_loadu_si128((const __m128i *)(b + len));
+        unsigned diff = (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+        diff ^= 0xFFFFu;
+        if (diff != 0)
+            return len + berg_ctz64(diff);
+        len += 16;
+    }
+#elif defined(BERG_NEON)
+    while (len + 16 <= max_len)
+    {
+        uint8x16_t eq = vceqq_u8(vld1q_u8(a + len), vld1q_u8(b + len));
+        /* Narrow to 4 bits per byte, all set where the bytes match. */
+        uint64_t mask = vget_lane_u64(
+            vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(eq), 4)), 0);
+        if (mask != ~(uint64_t)0)
+            return len + (berg_ctz64(~mask) >> 2);
+        len += 16;
+    }
+#endif
+
+#if defined(BERG_LITTLE_ENDIAN)
+    while (len + 8 <= max_len)
+    {
+        uint64_t diff = berg_load64(a + len) ^ berg_load64(b + len);
+        if (diff != 0)
+            return len + (berg_ctz64(diff) >> 3);
+        len += 8;
+    }
+#endif
+
+    while (len < max_len && a[len] == b[len])
+        len++;
+    return len;
+}
+
+/*
+ * Copies `len` literal bytes. Copies 16 bytes at a time, overrunning by up to
+ * 15, when both buffers have the slack for it, and exactly otherwise.
+ */
+static inline void berg_copy_literals(uint8_t *dst,
+                                      const uint8_t *dst_end,
+                                      const uint8_t *src,
+                                      const uint8_t *src_end,
+                                      size_t len)
+{
+    if ((size_t)(dst_end - dst) >= len + BERG_WILDCOPY_SLACK &&
+        (size_t)(src_end - src) >= len + BERG_WILDCOPY_SLACK)
+    {
+        uint8_t *end = dst + len;
+        do
+        {
+            berg_copy16(dst, src);
+            dst += 16;
+            src += 16;
+        } while (dst < end);
+        return;
+    }
+    memcpy(dst, src, len);
+}
+
+/*
+ * Copies a match of `len` bytes from `offset` bytes back, which may overlap
+ * the output. With enough slack before `dst_end` it copies in 16-byte steps
+ * (offsets of 16 or more) or 8-byte steps, first spreading short offsets so
+ * that the source stays at least 8 bytes behind. Near the end it copies byte
+ * by byte.
+ */
+static inline void berg_copy_match(uint8_t *dst,
+                                   const uint8_t *dst_end,
+                                   size_t offset,
+                                   size_t len)
+{
+    /* Smallest multiple of each offset below 8 that reaches 8. */
+    static const uint8_t spread[8] = {0, 8, 8, 9, 8, 10, 12, 14};
+
+    const uint8_t *src = dst - offset;
+    uint8_t *end       = dst + len;
+    size_t i;
+
+    if ((size_t)(dst_end - dst) < len + BERG_WILDCOPY_SLACK)
+    {
+        while (dst < end)
+            *dst++ = *src++;
+        return;
+    }
+
+    if (offset >= 16)
+    {
+        do
+        {
+            berg_copy16(dst, src);
+            dst += 16;
+            src += 16;
+        } while (dst < end);
+        return;
+    }
+
+    if (offset < 8)
+    {
+        for (i = 0; i < 8; i++)
+            dst[i] = src[i];
+        dst += 8;
+        src = dst - spread[offset];
+    }
+
+    while (dst < end)
+    {
+        berg_copy8(dst, src);
+        dst += 8;
+        src += 8;
+    }
+}
+
+/* CRC32 kernels */
+
+#if defined(BERG_CRC32_PCLMUL)
+/*
+ * Folding constants of the reflected CRC-32 polynomial, from Intel's "Fast
+ * CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction".
+ */
+static const uint64_t berg_crc32_k1k2[2] = {0x0154442bd4, 0x01c6e41596};
+static const uint64_t berg_crc32_k3k4[2] = {0x01751997d0, 0x00ccaa009e};
+static const uint64_t berg_crc32_k5k0[2] = {0x0163cd6124, 0x0000000000};
+static const uint64_t berg_crc32_poly[2] = {0x01db710641, 0x01f7011641};
+
+/* Multiplies both halves of `x` by `k` and adds `data`: one fold step. */
+BERG_TARGET_PCLMUL static inline __m128i
+berg_crc32_fold(__m128i x, __m128i k, __m128i data)
+{
+    __m128i lo = _mm_clmulepi64_si128(x, k, 0x00);
+    __m128i hi = _mm_clmulepi64_si128(x, k, 0x11);
+    return _mm_xor_si128(_mm_xor_si128(hi, lo), data);
+}
+
+/*
+ * Updates the CRC register (not inverted) with `size` bytes, a multiple of 16
+ * and at least 64. Folds four 16-byte lanes at a time, then one, then reduces
+ * the remaining 128 bits with a Barrett reduction.
+ */
+BERG_TARGET_PCLMUL static uint32_t
+berg_crc32_pclmul(uint32_t crc, const uint8_t *data, size_t size)
+{
+    const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+    __m128i k, x0, x1, x2, x3, t;
+
+    x0 = _mm_loadu_si128((const __m128i *)(data + 0x00));
+    x1 = _mm_loadu_si128((const __m128i *)(data + 0x10));
+    x2 = _mm_loadu_si128((const __m128i *)(data + 0x20));
+    x3 = _mm_loadu_si128((const __m128i *)(data + 0x30));
+    x0 = _mm_xor_si128(x0, _mm_cvtsi32_si128((int)crc));
+    data += 64;
+    size -= 64;
+
+    k = _mm_loadu_si128((const __m128i *)berg_crc32_k1k2);
+    for (; size >= 64; data += 64, size -= 64)
+    {
+        x0 = berg_crc32_fold(
+            x0, k, _mm_loadu_si128((const __m128i *)(data + 0x00)));
+        x1 = berg_crc32_fold(
+            x1, k, _mm_loadu_si128((const __m128i *)(data + 0x10)));
+        x2 = berg_crc32_fold(
+            x2, k, _mm_loadu_si128((const __m128i *)(data + 0x20)));
+        x3 = berg_crc32_fold(
+            x3, k, _mm_loadu_si128((const __m128i *)(data + 0x30)));
+    }
+
+    k  = _mm_loadu_si128((const __m128i *)berg_crc32_k3k4);
+    x0 = berg_crc32_fold(x0, k, x1);
+    x0 = berg_crc32_fold(x0, k, x2);
+    x0 = berg_crc32_fold(x0, k, x3);
+    for (; size >= 16; data += 16, size -= 16)
+        x0 = berg_crc32_fold(x0, k, _mm_loadu_si128((const __m128i *)data));
+
+    /* 128 bits to 64. */
+    t  = _mm_clmulepi64_si128(x0, k, 0x10);
+    x0 = _mm_xor_si128(_mm_srli_si128(x0, 8), t);
+    k  = _mm_loadl_epi64((const __m128i *)berg_crc32_k5k0);
+    t  = _mm_srli_si128(x0, 4);
+    x0 = _mm_clmulepi64_si128(_mm_and_si128(x0, mask32), k, 0x00);
+    x0 = _mm_xor_si128(x0, t);
+
+    /* Barrett reduction to 32 bits. */
+    k  = _mm_loadu_si128((const __m128i *)berg_crc32_poly);
+    t  = _mm_and_si128(x0, mask32);
+    t  = _mm_clmulepi64_si128(t, k, 0x10);
+    t  = _mm_and_si128(t, mask32);
+    t  = _mm_clmulepi64_si128(t, k, 0x00);
+    x0 = _mm_xor_si128(x0, t);
+    return (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x0, 4));
+}
+
+static bool berg_crc32_detect(void)
+{
+#if defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+    return (info[2] & (1 << 1)) != 0 && (info[3] & (1 << 26)) != 0;
+#else
+    unsigned eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx))
+        return false;
+    return (ecx & bit_PCLMUL) != 0 && (edx & bit_SSE2) != 0;
+#endif
+}
+#elif defined(BERG_CRC32_ARM)
+/* Updates a CRC (inverted, as crc32.h keeps it) with the CRC32 instructions. */
+BERG_TARGET_CRC static uint32_t
+berg_crc32_arm(uint32_t crc, const uint8_t *data, size_t size)
+{
+    crc = ~crc;
+    for (; size > 0 && ((uintptr_t)data & 7) != 0; size--)
+        crc = __crc32b(crc, *data++);
+    for (; size >= 8; data += 8, size -= 8)
+        crc = __crc32d(crc, berg_load64(data));
+    for (; size > 0; size--)
+        crc = __crc32b(crc, *data++);
+    return ~crc;
+}
+
+static bool berg_crc32_detect(void)
+{
+#if defined(BERG_CRC32_ARM_HWCAP)
+#ifndef HWCAP_CRC32
+#define HWCAP_CRC32 (1 << 7)
+#endif
+    return (getauxval(AT_HWCAP) & HWCAP_CRC32) != 0;
+#else
+    return true;
+#endif
+}
+#endif
+
+#if defined(BERG_CRC32_PCLMUL) || defined(BERG_CRC32_ARM)
+/*
+ * 0 until probed, then 1 without the instructions and 2 with them. Threads
+ * probing at the same time all store the same answer.
+ */
+static volatile int berg_crc32_support = 0;
+
+static inline bool berg_crc32_accelerated(void)
+{
+    if (berg_crc32_support == 0)
+        berg_crc32_support = berg_crc32_detect() ? 2 : 1;
+    return berg_crc32_support == 2;
+}
+#endif
+
 /* Little-endian helper functions */
 static inline uint16_t berg_read_le16(const uint8_t *data)
 {
@@ -94,8 +512,14 @@ static inline void berg_write_le32(uint8_t *data, uint32_t value)
     data[3] = (uint8_t)((value >> 24) & 0xFF);
 }
 
-static uint32_t berg_calculate_hash(const uint8_t *data);
-static void berg_reset_matcher(berg_hash_matcher_t *matcher);
+static uint32_t berg_calculate_hash(const uint8_t *data, uint32_t shift);
+static berg_error_t berg_prepare_matcher(berg_context *context,
+                                         const void *dictionary,
+                                         size_t dictionary_size,
+                                         size_t input_size);
+static void berg_add_dictionary(berg_hash_matcher_t *matcher,
+                                const uint8_t *input,
+                                size_t input_size);
 static void berg_add_position(berg_hash_matcher_t *matcher,
                               const uint8_t *input,
                               size_t pos,
@@ -104,11 +528,16 @@ static berg_match_result_t berg_find_best_match(berg_hash_matcher_t *matcher,
                                                 const uint8_t *input,
                                                 size_t pos,
                                                 size_t lookahead_size,
-                                                size_t input_size);
+                                                size_t input_size,
+                                                size_t max_chain_length,
+                                                size_t nice_length);
 
 /* Internal compression/decompression functions */
 static inline berg_error_t
-berg_compress_raw_internal(const void *input,
+berg_compress_raw_internal(berg_context *context,
+                           const void *dictionary,
+                           size_t dictionary_size,
+                           const void *input,
                            size_t input_size,
                            void *userdata,
                            berg_write_callback_t write,
@@ -127,22 +556,98 @@ static berg_error_t berg_decode_varint(const uint8_t *input,
                                        size_t *value);
 
 /* Hash matcher implementation */
-inline static uint32_t berg_calculate_hash(const uint8_t *data)
+inline static uint32_t berg_calculate_hash(const uint8_t *data,
+                                           uint32_t shift)
 {
     uint32_t sequence = ((uint32_t)data[0] << 16) | ((uint32_t)data[1] << 8) |
                         (uint32_t)data[2];
-    return (sequence * 2654435761UL) >> (32 - 14);
+    return (uint32_t)(sequence * 2654435761u) >> shift;
 }
 
-inline static void berg_reset_matcher(berg_hash_matcher_t *matcher)
+/*
+ * Sets the matcher of a context up for an input. Small inputs hash into
+ * the start of the table only, with about two entries per position, and
+ * only entries never used before are cleared. Everything is cleared again
+ * when positions would overflow. Only the last BERG_MAX_DICTIONARY_SIZE
+ * bytes of the dictionary are in reach of the input, the rest is ignored.
+ */
+inline static berg_error_t berg_prepare_matcher(berg_context *context,
+                                                const void *dictionary,
+                                                size_t dictionary_size,
+                                                size_t input_size)
 {
-    size_t i;
+    berg_hash_matcher_t *matcher = &context->matcher;
+    uint32_t bits                = BERG_MIN_HASH_BITS;
+    uint32_t entries, i;
+
+    if (dictionary_size > BERG_MAX_DICTIONARY_SIZE)
+    {
+        dictionary = (const uint8_t *)dictionary + dictionary_size -
+                     BERG_MAX_DICTIONARY_SIZE;
+        dictionary_size = BERG_MAX_DICTIONARY_SIZE;
+    }
+    matcher->dictionary      = (const uint8_t *)dictionary;
+    matcher->dictionary_size = (uint32_t)dictionary_size;
+
+    if (input_size >= UINT32_MAX - dictionary_size)
+        return BERG_ERROR_INVALID_PARAM;
+    input_size += dictionary_size;
+
+    while (bits < BERG_HASH_BITS && ((size_t)1 << (bits - 1)) < input_size)
+        bits++;
 
-    for (i = 0; i < BERG_HASH_SIZE; i++)
+    if (input_size > UINT32_MAX - context->next_base)
+    {
+        context->next_base     = 0;
+        context->clean_entries = 0;
+    }
+
+    entries = (uint32_t)1 << bits;
+    for (i = context->clean_entries; i < entries; i++)
         matcher->hash_table[i] = 0;
+    if (context->clean_entries < entries)
+        context->clean_entries = entries;
 
-    for (i = 0; i < BERG_CHAIN_MASK + 1; i++)
-        matcher->chain_table[i] = 0;
+    matcher->base       = context->next_base;
+    matcher->hash_shift = 32 - bits;
+    context->next_base += (uint32_t)input_size;
+    return BERG_OK;
+}
+
+/*
+ * Adds the dictionary positions to the tables, ahead of the input. The last
+ * two sequences run into the input and are hashed from a copy.
+ */
+inline static void berg_add_dictionary(berg_hash_matcher_t *matcher,
+                                       const uint8_t *input,
+                                       size_t input_size)
+{
+    const uint8_t *dictionary = matcher->dictionary;
+    const size_t size         = matcher->dictionary_size;
+    uint8_t joined[3];
+    size_t pos, i;
+
+    for (pos = 0; pos < size; pos++)
+    {
+        const uint8_t *data = dictionary + pos;
+        uint32_t hash, value;
+
+        if (pos + 3 > size)
+        {
+            if (pos + 3 > size + input_size)
+                break;
+            for (i = 0; i < 3; i++)
+                joined[i] = pos + i < size ? dictionary[pos + i]
+                                           : input[pos + i - size];
+            data = joined;
+        }
+
+        hash  = berg_calculate_hash(data, matcher->hash_shift);
+        value = matcher->base + (uint32_t)pos;
+        matcher->chain_table[value & BERG_CHAIN_MASK] =
+            matcher->hash_table[hash];
+        matcher->hash_table[hash] = value;
+    }
 }
 
 inline static void berg_add_position(berg_hash_matcher_t *matcher,
@@ -150,18 +655,43 @@ inline static void berg_add_position(berg_hash_matcher_t *matcher,
                                      size_t pos,
                                      size_t input_size)
 {
-    uint32_t hash;
-    size_t hash_idx, chain_idx;
+    uint32_t hash, value;
+    size_t chain_idx;
 
     if (pos + 3 > input_size)
         return;
 
-    hash      = berg_calculate_hash(input + pos);
-    hash_idx  = hash & (BERG_HASH_SIZE - 1);
-    chain_idx = pos & BERG_CHAIN_MASK;
+    hash      = berg_calculate_hash(input + pos, matcher->hash_shift);
+    value     = matcher->base + matcher->dictionary_size + (uint32_t)pos;
+    chain_idx = value & BERG_CHAIN_MASK;
 
-    matcher->chain_table[chain_idx] = matcher->hash_table[hash_idx];
-    matcher->hash_table[hash_idx]   = (uint32_t)pos;
+    matcher->chain_table[chain_idx] = matcher->hash_table[hash];
+    matcher->hash_table[hash]       = value;
+}
+
+/*
+ * Length of a match starting `distance` bytes back from `pos` that begins in
+ * the dictionary, and may run on into the input.
+ */
+inline static size_t
+berg_dictionary_match_length(const berg_hash_matcher_t *matcher,
+                             const uint8_t *input,
+                             size_t pos,
+                             size_t distance,
+                             size_t max_len)
+{
+    const size_t back = distance - pos; /* Dictionary bytes in reach */
+    const uint8_t *candidate =
+        matcher->dictionary + matcher->dictionary_size - back;
+    size_t length;
+
+    if (back >= max_len)
+        return berg_match_length(input + pos, candidate, max_len);
+
+    length = berg_match_length(input + pos, candidate, back);
+    if (length < back)
+        return length;
+    return back + berg_match_length(input + pos + back, input, max_len - back);
 }
 
 inline static berg_match_result_t
@@ -169,54 +699,58 @@ berg_find_best_match(berg_hash_matcher_t *matcher,
                      const uint8_t *input,
                      size_t pos,
                      size_t lookahead_size,
-                     size_t input_size)
+                     size_t input_size,
+                     size_t max_chain_length,
+                     size_t nice_length)
 {
     berg_match_result_t best = {0, 0};
-    uint32_t hash, candidate_pos;
-    size_t hash_idx, chain_idx, chain_length, distance, match_len, max_len;
+    uint32_t hash, candidate_pos, current_pos;
+    size_t chain_idx, chain_length, distance, match_len, max_len;
     const uint8_t *current, *candidate;
 
     if (pos + 3 > input_size || lookahead_size < BERG_MIN_MATCH_LENGTH)
         return best;
 
-    hash          = berg_calculate_hash(input + pos);
-    hash_idx      = hash & (BERG_HASH_SIZE - 1);
-    candidate_pos = matcher->hash_table[hash_idx];
+    hash          = berg_calculate_hash(input + pos, matcher->hash_shift);
+    candidate_pos = matcher->hash_table[hash];
+    current_pos   = matcher->base + matcher->dictionary_size + (uint32_t)pos;
     chain_length  = 0;
     current       = input + pos;
     max_len =
         (lookahead_size < input_size - pos) ? lookahead_size : input_size - pos;
 
-    while (candidate_pos != 0 && chain_length < BERG_MAX_CHAIN_LENGTH &&
-           pos > candidate_pos)
+    /* Position 0 and earlier inputs read as empty */
+    while (candidate_pos > matcher->base && chain_length < max_chain_length &&
+           current_pos > candidate_pos)
     {
-        distance = pos - candidate_pos;
+        distance = current_pos - candidate_pos;
 
         if (distance > BERG_MAX_DISTANCE)
             break;
 
-        candidate = input + candidate_pos;
-
-        if (candidate[0] == current[0] &&
-            (best.length == 0 ||
-             candidate[best.length] == current[best.length]))
+        match_len = 0;
+        if (distance > pos)
         {
+            match_len = berg_dictionary_match_length(
+                matcher, input, pos, distance, max_len);
+        }
+        else
+        {
+            candidate = current - distance;
 
-            match_len = 0;
-            while (match_len < max_len &&
-                   current[match_len] == candidate[match_len])
-            {
-                match_len++;
-            }
+            if (candidate[0] == current[0] &&
+                (best.length == 0 ||
+                 candidate[best.length] == current[best.length]))
+                match_len = berg_match_length(current, candidate, max_len);
+        }
 
-            if (match_len >= BERG_MIN_MATCH_LENGTH && match_len > best.length)
-            {
-                best.offset = (uint16_t)distance;
-                best.length = (uint16_t)match_len;
+        if (match_len >= BERG_MIN_MATCH_LENGTH && match_len > best.length)
+        {
+            best.offset = (uint16_t)distance;
+            best.length = (uint16_t)match_len;
 
-                if (match_len >= max_len || match_len >= 16)
-                    break;
-            }
+            if (match_len >= max_len || match_len >= nice_length)
+                break;
         }
 
         chain_idx     = candidate_pos & BERG_CHAIN_MASK;
@@ -451,7 +985,38 @@ inline static berg_error_t berg_encode_token(berg_write_callback_t write,
 berg_config berg_get_default_config(void)
 {
     berg_config config;
-    config.lookahead_size = BERG_DEFAULT_LOOKAHEAD_SIZE;
+    config.lookahead_size   = BERG_DEFAULT_LOOKAHEAD_SIZE;
+    config.max_chain_length = BERG_DEFAULT_MAX_CHAIN_LENGTH;
+    config.nice_length      = BERG_DEFAULT_NICE_LENGTH;
+    config.parse            = BERG_PARSE_GREEDY;
+    return config;
+}
+
+berg_config berg_get_level_config(int level)
+{
+    static const struct
+    {
+        size_t max_chain_length;
+        size_t nice_length;
+        berg_parse_t parse;
+    } levels[BERG_LEVEL_MAX] = {
+        {1, 16, BERG_PARSE_GREEDY},
+        {2, 16, BERG_PARSE_GREEDY},
+        {8, 16, BERG_PARSE_GREEDY},
+        {32, 16, BERG_PARSE_LAZY},
+        {128, 24, BERG_PARSE_LAZY},
+        {128, 64, BERG_PARSE_OPTIMAL},
+    };
+    berg_config config = berg_get_default_config();
+
+    if (level < BERG_LEVEL_FASTEST)
+        level = BERG_LEVEL_FASTEST;
+    if (level > BERG_LEVEL_MAX)
+        level = BERG_LEVEL_MAX;
+
+    config.max_chain_length = levels[level - 1].max_chain_length;
+    config.nice_length      = levels[level - 1].nice_length;
+    config.parse            = levels[level - 1].parse;
     return config;
 }
 
@@ -461,12 +1026,64 @@ size_t berg_estimate_max_compressed_size(size_t input_size)
     return input_size + (input_size / 2) + 64;
 }
 
+uint32_t berg_crc32(uint32_t crc, const void *data, size_t size)
+{
+    const uint8_t *bytes = (const uint8_t *)data;
+
+#if defined(BERG_CRC32_PCLMUL)
+    if (bytes && size >= 64 && berg_crc32_accelerated())
+    {
+        const size_t folded = size & ~(size_t)15;
+        crc                 = ~berg_crc32_pclmul(~crc, bytes, folded);
+        bytes += folded;
+        size -= folded;
+    }
+#elif defined(BERG_CRC32_ARM)
+    if (bytes && berg_crc32_accelerated())
+        return berg_crc32_arm(crc, bytes, size);
+#endif
+
+    return berg_calculate_crc32(crc, bytes, size);
+}
+
+size_t berg_context_size(void) { return sizeof(berg_context); }
+
+berg_context *berg_context_init(void *memory, size_t size)
+{
+    berg_context *context = (berg_context *)memory;
+
+    if (!memory || size < sizeof(berg_context) ||
+        ((uintptr_t)memory % sizeof(uint32_t)) != 0)
+        return NULL;
+
+    context->next_base     = 0;
+    context->clean_entries = 0;
+    return context;
+}
+
 berg_error_t berg_compress(const void *input,
                            size_t input_size,
                            void *output,
                            size_t output_capacity,
                            size_t *compressed_size,
                            const berg_config *config)
+{
+    return berg_compress_ctx(NULL,
+                             input,
+                             input_size,
+                             output,
+                             output_capacity,
+                             compressed_size,
+                             config);
+}
+
+berg_error_t berg_compress_ctx(berg_context *context,
+                               const void *input,
+                               size_t input_size,
+                               void *output,
+                               size_t output_capacity,
+                               size_t *compressed_size,
+                               const berg_config *config)
 {
     uint8_t *output_data = (uint8_t *)output;
     size_t output_pos    = 0;
@@ -497,13 +1114,14 @@ berg_error_t berg_compress(const void *input,
     output_pos += 4;
 
     /* Compress data using raw compression */
-    result = berg_compress_raw(input,
-                               input_size,
-                               output_data + output_pos,
-                               output_capacity - output_pos -
-                                   4, /* Reserve 4 bytes for checksum */
-                               &raw_compressed_size,
-                               config);
+    result = berg_compress_raw_ctx(context,
+                                   input,
+                                   input_size,
+                                   output_data + output_pos,
+                                   output_capacity - output_pos -
+                                       4, /* Reserve 4 bytes for checksum */
+                                   &raw_compressed_size,
+                                   config);
     if (result != BERG_OK)
         return result;
 
@@ -512,7 +1130,7 @@ berg_error_t berg_compress(const void *input,
     /* Calculate and write checksum */
     if (output_pos + 4 > output_capacity)
         return BERG_ERROR_BUFFER_TOO_SMALL;
-    data_checksum = berg_calculate_crc32(0, input, input_size);
+    data_checksum = berg_crc32(0, input, input_size);
     berg_write_le32(output_data + output_pos, data_checksum);
     output_pos += 4;
 
@@ -525,6 +1143,21 @@ berg_error_t berg_decompress(const void *compressed,
                              void *output,
                              size_t output_capacity,
                              size_t *decompressed_size)
+{
+    return berg_decompress_flags(compressed,
+                                 compressed_size,
+                                 output,
+                                 output_capacity,
+                                 decompressed_size,
+                                 BERG_DECOMPRESS_DEFAULT);
+}
+
+berg_error_t berg_decompress_flags(const void *compressed,
+                                   size_t compressed_size,
+                                   void *output,
+                                   size_t output_capacity,
+                                   size_t *decompressed_size,
+                                   unsigned flags)
 {
     const uint8_t *input_data = (const uint8_t *)compressed;
     size_t original_size;
@@ -562,20 +1195,222 @@ berg_error_t berg_decompress(const void *compressed,
                                  output_capacity,
                                  original_size,
                                  decompressed_size);
-    if (result < 0)
+    if (result < 0 || (flags & BERG_DECOMPRESS_NO_VERIFY))
         return result;
 
     /* Verify checksum */
-    calculated_checksum = berg_calculate_crc32(0, output, *decompressed_size);
+    calculated_checksum = berg_crc32(0, output, *decompressed_size);
     if (stored_checksum != calculated_checksum)
         return BERG_ERROR_CORRUPT_DATA;
 
     return BERG_OK;
 }
 
+/* Fills the fields a configuration left at 0 with their defaults. */
+inline static berg_config berg_resolve_config(const berg_config *config)
+{
+    berg_config cfg = config ? *config : berg_get_default_config();
+
+    if (cfg.max_chain_length == 0)
+        cfg.max_chain_length = BERG_DEFAULT_MAX_CHAIN_LENGTH;
+    if (cfg.nice_length == 0)
+        cfg.nice_length = BERG_DEFAULT_NICE_LENGTH;
+    return cfg;
+}
+
+inline static uint32_t berg_varint_size(size_t value)
+{
+    uint32_t size = 1;
+    while (value >= 0x80)
+    {
+        value >>= 7;
+        size++;
+    }
+    return size;
+}
+
+/* Bytes taken by a run of literals, excluding the token. */
+inline static uint32_t berg_literal_price(size_t count)
+{
+    uint32_t price = (uint32_t)count;
+    if (count > BERG_MAX_DIRECT_LITERAL_COUNT)
+        price += berg_varint_size(count - BERG_MIN_EXTENDED_LITERAL_COUNT);
+    return price;
+}
+
+/* Bytes taken by a match, including the token. */
+inline static uint32_t berg_match_price(size_t length)
+{
+    uint32_t price = 2;
+    if (length > BERG_MAX_DIRECT_MATCH_LENGTH)
+        price += berg_varint_size(length - BERG_MIN_EXTENDED_MATCH_LENGTH);
+    return price;
+}
+
+inline static berg_error_t berg_emit_match(berg_write_callback_t write,
+                                           void *userdata,
+                                           const uint8_t *input,
+                                           size_t literal_start,
+                                           size_t match_start,
+                                           berg_match_result_t match)
+{
+    berg_token_t token;
+    token.literal_count = match_start - literal_start;
+    token.match_offset  = match.offset;
+    token.match_length  = match.length;
+    return berg_encode_token(write, userdata, input + literal_start, &token);
+}
+
+/*
+ * Optimal parse. Every position of a window is priced in bytes from its
+ * predecessors, as one more literal or as the end of a match of any length
+ * up to the longest one found, then the cheapest path is emitted. Offsets
+ * all cost the same, so one match per position is enough. A match of at
+ * least the nice length is taken as is and closes the window.
+ */
+static inline berg_error_t
+berg_compress_optimal(const uint8_t *input,
+                      size_t input_size,
+                      void *userdata,
+                      berg_write_callback_t write,
+                      const berg_config *cfg,
+                      berg_hash_matcher_t *matcher)
+{
+    berg_optimal_node_t
+        nodes[BERG_OPTIMAL_WINDOW + BERG_OPTIMAL_MAX_NICE_LENGTH + 1];
+    uint32_t path[BERG_OPTIMAL_WINDOW];
+    size_t pos = 0, literal_start = 0;
+    const size_t nice_length = cfg->nice_length < BERG_OPTIMAL_MAX_NICE_LENGTH
+                                   ? cfg->nice_length
+                                   : BERG_OPTIMAL_MAX_NICE_LENGTH;
+
+    while (pos < input_size)
+    {
+        const size_t span = input_size - pos < BERG_OPTIMAL_WINDOW
+                                ? input_size - pos
+                                : BERG_OPTIMAL_WINDOW;
+        berg_match_result_t forced = {0, 0};
+        size_t i, length, end, path_length;
+
+        nodes[0].price    = 0;
+        nodes[0].literals = (uint32_t)(pos - literal_start);
+        nodes[0].length   = 0;
+        nodes[0].offset   = 0;
+        for (i = 1; i <= span + nice_length; i++)
+            nodes[i].price = UINT32_MAX;
+
+        for (i = 0; i < span; i++)
+        {
+            const berg_optimal_node_t node = nodes[i];
+            berg_match_result_t match;
+            uint32_t price;
+
+            match = berg_find_best_match(matcher,
+                                         input,
+                                         pos + i,
+                                         cfg->lookahead_size,
+                                         input_size,
+                                         cfg->max_chain_length,
+                                         nice_length);
+            berg_add_position(matcher, input, pos + i, input_size);
+
+            if (match.offset > 0 && match.length >= nice_length)
+            {
+                forced = match;
+                break;
+            }
+
+            price = node.price + (berg_literal_price(node.literals + 1) -
+                                  berg_literal_price(node.literals));
+            if (price < nodes[i + 1].price)
+            {
+                nodes[i + 1].price    = price;
+                nodes[i + 1].literals = node.literals + 1;
+                nodes[i + 1].length   = 0;
+                nodes[i + 1].offset   = 0;
+            }
+
+            if (match.offset == 0 || match.length < BERG_MIN_MATCH_LENGTH)
+                continue;
+
+            for (length = BERG_MIN_MATCH_LENGTH; length <= match.length;
+                 length++)
+            {
+                berg_optimal_node_t *next = &nodes[i + length];
+
+                price = node.price + berg_match_price(length);
+                if (price < next->price)
+                {
+                    next->price    = price;
+                    next->literals = 0;
+                    next->length   = (uint32_t)length;
+                    next->offset   = match.offset;
+                }
+            }
+        }
+        end = i;
+
+        /* Walk the cheapest path back, recording where its matches end */
+        path_length = 0;
+        for (i = end; i > 0;)
+        {
+            if (nodes[i].length == 0)
+            {
+                i--;
+                continue;
+            }
+            path[path_length++] = (uint32_t)i;
+            i -= nodes[i].length;
+        }
+
+        while (path_length > 0)
+        {
+            const berg_optimal_node_t *node = &nodes[path[--path_length]];
+            const size_t match_end          = pos + path[path_length];
+            berg_match_result_t match;
+
+            match.offset = node->offset;
+            match.length = node->length;
+            CHECK_ERR(berg_emit_match(write,
+                                      userdata,
+                                      input,
+                                      literal_start,
+                                      match_end - match.length,
+                                      match));
+            literal_start = match_end;
+        }
+
+        pos += end;
+        if (forced.offset > 0)
+        {
+            CHECK_ERR(berg_emit_match(
+                write, userdata, input, literal_start, pos, forced));
+            for (i = 1; i < forced.length; i++)
+                berg_add_position(matcher, input, pos + i, input_size);
+            pos += forced.length;
+            literal_start = pos;
+        }
+    }
+
+    if (literal_start < input_size)
+    {
+        berg_token_t token;
+        token.literal_count = input_size - literal_start;
+        token.match_offset  = 0;
+        token.match_length  = 0;
+        CHECK_ERR(berg_encode_token(
+            write, userdata, input + literal_start, &token));
+    }
+
+    return BERG_OK;
+}
+
 /* Placeholder implementations for remaining API functions */
 static inline berg_error_t
-berg_compress_raw_internal(const void *input,
+berg_compress_raw_internal(berg_context *context,
+                           const void *dictionary,
+                           size_t dictionary_size,
+                           const void *input,
                            size_t input_size,
                            void *userdata,
                            berg_write_callback_t write,
@@ -583,17 +1418,39 @@ berg_compress_raw_internal(const void *input,
 {
     const uint8_t *input_data = (const uint8_t *)input;
     berg_config cfg;
-    berg_hash_matcher_t matcher;
+    berg_context local_context;
+    berg_hash_matcher_t *matcher;
     size_t pos = 0, literal_start;
     berg_token_t token;
-    berg_match_result_t match;
-    uint16_t token_value;
+    berg_match_result_t match, next_match;
+    bool has_next_match = false;
+    berg_error_t result;
 
-    if (!input || !write || input_size == 0)
+    if (!input || !write || input_size == 0 ||
+        (!dictionary && dictionary_size > 0))
         return BERG_ERROR_INVALID_PARAM;
 
-    cfg = config ? *config : berg_get_default_config();
-    berg_reset_matcher(&matcher);
+    cfg = berg_resolve_config(config);
+    if (cfg.parse != BERG_PARSE_GREEDY && cfg.parse != BERG_PARSE_LAZY &&
+        cfg.parse != BERG_PARSE_OPTIMAL)
+        return BERG_ERROR_INVALID_PARAM;
+
+    if (!context)
+    {
+        context                = &local_context;
+        context->next_base     = 0;
+        context->clean_entries = 0;
+    }
+    result =
+        berg_prepare_matcher(context, dictionary, dictionary_size, input_size);
+    if (result < 0)
+        return result;
+    matcher = &context->matcher;
+    berg_add_dictionary(matcher, input_data, input_size);
+
+    if (cfg.parse == BERG_PARSE_OPTIMAL)
+        return berg_compress_optimal(
+            input_data, input_size, userdata, write, &cfg, matcher);
 
     /* Compress data (no header) */
     while (pos < input_size)
@@ -611,12 +1468,43 @@ berg_compress_raw_internal(const void *input,
                                         ? cfg.lookahead_size
                                         : input_size - pos;
 
-            match = berg_find_best_match(
-                &matcher, input_data, pos, lookahead_size, input_size);
-            berg_add_position(&matcher, input_data, pos, input_size);
+            if (has_next_match)
+                match = next_match;
+            else
+                match = berg_find_best_match(matcher,
+                                             input_data,
+                                             pos,
+                                             lookahead_size,
+                                             input_size,
+                                             cfg.max_chain_length,
+                                             cfg.nice_length);
+            has_next_match = false;
+            berg_add_position(matcher, input_data, pos, input_size);
 
             if (match.offset > 0 && match.length >= BERG_MIN_MATCH_LENGTH)
             {
+                /* Lazy matching: emit a literal if the match at the next
+                 * byte ends further, not only one byte later */
+                if (cfg.parse == BERG_PARSE_LAZY &&
+                    match.length < cfg.nice_length)
+                {
+                    next_match = berg_find_best_match(matcher,
+                                                      input_data,
+                                                      pos + 1,
+                                                      cfg.lookahead_size,
+                                                      input_size,
+                                                      cfg.max_chain_length,
+                                                      cfg.nice_length);
+                    if (next_match.offset > 0 &&
+                        next_match.length > match.length + 1)
+                    {
+                        has_next_match = true;
+                        token.literal_count++;
+                        pos++;
+                        continue;
+                    }
+                }
+
                 token.match_offset = match.offset;
                 token.match_length = match.length;
                 break;
@@ -629,7 +1517,7 @@ berg_compress_raw_internal(const void *input,
         }
 
         assert(token.literal_count <= input_size - literal_start);
-        assert(token.match_offset <= pos);
+        assert(token.match_offset <= pos + matcher->dictionary_size);
 
         /* Encode token */
         CHECK_ERR(berg_encode_token(
@@ -640,7 +1528,7 @@ berg_compress_raw_internal(const void *input,
         {
             size_t i;
             for (i = 0; i < token.match_length; i++)
-                berg_add_position(&matcher, input_data, pos + i, input_size);
+                berg_add_position(matcher, input_data, pos + i, input_size);
             pos += token.match_length;
         }
     }
@@ -675,14 +1563,58 @@ berg_error_t berg_compress_raw(const void *input,
                                size_t output_capacity,
                                size_t *compressed_size,
                                const berg_config *config)
+{
+    return berg_compress_raw_ctx(NULL,
+                                 input,
+                                 input_size,
+                                 output,
+                                 output_capacity,
+                                 compressed_size,
+                                 config);
+}
+
+berg_error_t berg_compress_raw_ctx(berg_context *context,
+                                   const void *input,
+                                   size_t input_size,
+                                   void *output,
+                                   size_t output_capacity,
+                                   size_t *compressed_size,
+                                   const berg_config *config)
+{
+    return berg_compress_raw_dict(context,
+                                  NULL,
+                                  0,
+                                  input,
+                                  input_size,
+                                  output,
+                                  output_capacity,
+                                  compressed_size,
+                                  config);
+}
+
+berg_error_t berg_compress_raw_dict(berg_context *context,
+                                    const void *dictionary,
+                                    size_t dictionary_size,
+                                    const void *input,
+                                    size_t input_size,
+                                    void *output,
+                                    size_t output_capacity,
+                                    size_t *compressed_size,
+                                    const berg_config *config)
 {
     raw_internal_data_t data;
     data.buffer      = (uint8_t *)output;
     data.buffer_size = output_capacity;
     data.buffer_pos  = 0;
 
-    CHECK_ERR(berg_compress_raw_internal(
-        input, input_size, &data, write_internal_callback, config));
+    CHECK_ERR(berg_compress_raw_internal(context,
+                                         dictionary,
+                                         dictionary_size,
+                                         input,
+                                         input_size,
+                                         &data,
+                                         write_internal_callback,
+                                         config));
 
     *compressed_size = data.buffer_pos;
     return BERG_OK;
@@ -703,6 +1635,7 @@ berg_decompress_raw_internal(const void *compressed,
     size_t i, copy_start, copy_offset;
 
     uint8_t window[BERG_DEFAULT_WINDOW_SIZE] = {0};
+    const size_t window_mask                 = BERG_DEFAULT_WINDOW_SIZE - 1;
 
     if (!compressed || !write || compressed_size == 0)
         return BERG_ERROR_INVALID_PARAM;
@@ -721,10 +1654,19 @@ berg_decompress_raw_internal(const void *compressed,
             return BERG_ERROR_CORRUPT_DATA;
 
         CHECK_ERR(write(input_data + pos, token.literal_count, userdata));
-        size_t i;
-        for (i = 0; i < token.literal_count; i++)
-            window[(output_pos + i) % BERG_DEFAULT_WINDOW_SIZE] =
-                input_data[pos + i];
+
+        /* Keep the last window of output, in at most two pieces */
+        copy_start = token.literal_count > BERG_DEFAULT_WINDOW_SIZE
+                         ? token.literal_count - BERG_DEFAULT_WINDOW_SIZE
+                         : 0;
+        for (i = copy_start; i < token.literal_count; i += copy_offset)
+        {
+            size_t at   = (output_pos + i) & window_mask;
+            copy_offset = BERG_DEFAULT_WINDOW_SIZE - at;
+            if (copy_offset > token.literal_count - i)
+                copy_offset = token.literal_count - i;
+            memcpy(window + at, input_data + pos + i, copy_offset);
+        }
 
         pos += token.literal_count;
 
@@ -739,14 +1681,25 @@ berg_decompress_raw_internal(const void *compressed,
 
             copy_start = output_pos - token.match_offset;
 
-            for (i = 0; i < token.match_length; i++)
+            /*
+             * Bytes are copied one by one as the match may overlap itself,
+             * but written in contiguous runs of the window rather than one
+             * callback per byte.
+             */
+            for (i = 0; i < token.match_length;)
             {
-                copy_offset =
-                    i < token.match_offset ? i : (i % token.match_offset);
-                uint8_t *data = &window[(copy_start + copy_offset) %
-                                        BERG_DEFAULT_WINDOW_SIZE];
-                CHECK_ERR(write(data, 1, userdata));
-                window[(output_pos + i) % BERG_DEFAULT_WINDOW_SIZE] = *data;
+                size_t at  = (output_pos + i) & window_mask;
+                size_t run = BERG_DEFAULT_WINDOW_SIZE - at;
+                size_t j;
+                if (run > token.match_length - i)
+                    run = token.match_length - i;
+
+                for (j = 0; j < run; j++)
+                    window[at + j] =
+                        window[(copy_start + i + j) & window_mask];
+
+                CHECK_ERR(write(window + at, run, userdata));
+                i += run;
             }
             assert(output_pos <= original_size - token.match_length);
             output_pos += token.match_length;
@@ -760,6 +1713,78 @@ berg_decompress_raw_internal(const void *compressed,
     return BERG_OK;
 }
 
+/*
+ * Decompresses straight into a flat buffer, where matches are copied from the
+ * output itself with the wildcopy kernels instead of through a window. A
+ * match reaching back past the output start begins in the dictionary.
+ */
+static inline berg_error_t
+berg_decompress_raw_flat(const uint8_t *dictionary,
+                         size_t dictionary_size,
+                         const uint8_t *input,
+                         size_t compressed_size,
+                         uint8_t *output,
+                         size_t original_size,
+                         size_t *decompressed_size)
+{
+    const uint8_t *input_end  = input + compressed_size;
+    const uint8_t *output_end = output + original_size;
+    size_t pos = 0, output_pos = 0;
+    berg_token_t token;
+
+    while (pos < compressed_size && output_pos < original_size)
+    {
+        if (pos + 2 > compressed_size)
+            return BERG_ERROR_CORRUPT_DATA;
+
+        CHECK_ERR(berg_decode_token(input, &pos, compressed_size, &token));
+
+        if (token.literal_count > compressed_size - pos ||
+            token.literal_count > original_size - output_pos)
+            return BERG_ERROR_CORRUPT_DATA;
+
+        berg_copy_literals(output + output_pos,
+                           output_end,
+                           input + pos,
+                           input_end,
+                           token.literal_count);
+        pos += token.literal_count;
+        output_pos += token.literal_count;
+
+        if (token.match_offset > 0)
+        {
+            size_t length = token.match_length;
+
+            if (token.match_offset > output_pos + dictionary_size ||
+                length > original_size - output_pos)
+                return BERG_ERROR_CORRUPT_DATA;
+
+            if (token.match_offset > output_pos)
+            {
+                const size_t back  = token.match_offset - output_pos;
+                const size_t count = length < back ? length : back;
+
+                memcpy(output + output_pos,
+                       dictionary + dictionary_size - back,
+                       count);
+                output_pos += count;
+                length -= count;
+                if (length == 0)
+                    continue;
+            }
+
+            berg_copy_match(
+                output + output_pos, output_end, token.match_offset, length);
+            output_pos += length;
+        }
+    }
+
+    *decompressed_size = output_pos;
+    if (output_pos != original_size)
+        return BERG_ERROR_CORRUPT_DATA;
+    return BERG_OK;
+}
+
 berg_error_t berg_decompress_raw(const void *compressed,
                                  size_t compressed_size,
                                  void *output,
@@ -767,23 +1792,276 @@ berg_error_t berg_decompress_raw(const void *compressed,
                                  size_t original_size,
                                  size_t *decompressed_size)
 {
-    raw_internal_data_t data;
-    data.buffer      = (uint8_t *)output;
-    data.buffer_size = output_capacity;
-    data.buffer_pos  = 0;
+    return berg_decompress_raw_dict(NULL,
+                                    0,
+                                    compressed,
+                                    compressed_size,
+                                    output,
+                                    output_capacity,
+                                    original_size,
+                                    decompressed_size);
+}
 
-    CHECK_ERR(berg_decompress_raw_internal(compressed,
-                                           compressed_size,
-                                           &data,
-                                           write_internal_callback,
-                                           original_size));
+berg_error_t berg_decompress_raw_dict(const void *dictionary,
+                                      size_t dictionary_size,
+                                      const void *compressed,
+                                      size_t compressed_size,
+                                      void *output,
+                                      size_t output_capacity,
+                                      size_t original_size,
+                                      size_t *decompressed_size)
+{
+    if (!compressed || !output || !decompressed_size || compressed_size == 0 ||
+        (!dictionary && dictionary_size > 0))
+        return BERG_ERROR_INVALID_PARAM;
 
-    *decompressed_size = data.buffer_pos;
-    if (original_size != data.buffer_pos)
-        return BERG_ERROR_CORRUPT_DATA;
+    *decompressed_size = 0;
+    if (original_size > output_capacity)
+        return BERG_ERROR_BUFFER_TOO_SMALL;
+
+    if (dictionary_size > BERG_MAX_DICTIONARY_SIZE)
+    {
+        dictionary = (const uint8_t *)dictionary + dictionary_size -
+                     BERG_MAX_DICTIONARY_SIZE;
+        dictionary_size = BERG_MAX_DICTIONARY_SIZE;
+    }
+
+    return berg_decompress_raw_flat((const uint8_t *)dictionary,
+                                    dictionary_size,
+                                    (const uint8_t *)compressed,
+                                    compressed_size,
+                                    (uint8_t *)output,
+                                    original_size,
+                                    decompressed_size);
+}
+
+size_t berg_decoder_size(void) { return sizeof(berg_decoder); }
+
+berg_decoder *
+berg_decoder_init(void *memory, size_t size, size_t original_size)
+{
+    berg_decoder *decoder = (berg_decoder *)memory;
+
+    if (!memory || size < sizeof(berg_decoder) ||
+        ((uintptr_t)memory % sizeof(size_t)) != 0)
+        return NULL;
+
+    decoder->header_size   = 0;
+    decoder->original_size = original_size;
+    decoder->output_pos    = 0;
+    decoder->literals      = 0;
+    decoder->match_offset  = 0;
+    decoder->match_length  = 0;
+    return decoder;
+}
+
+/*
+ * Size of the token starting at `data`, or 0 while `size` bytes do not hold
+ * all of it. Varints stop counting at their longest valid size, decoding
+ * then reports the longer ones.
+ */
+static inline size_t berg_token_size(const uint8_t *data, size_t size)
+{
+    const size_t max_varint_size = (BERG_MAX_TOKEN_SIZE - 2) / 2;
+    size_t pos = 2, fields = 0, i, start;
+    uint16_t token_value;
+
+    if (size < 2)
+        return 0;
+
+    token_value = berg_read_le16(data);
+    if ((token_value & 0xC000) == 0xC000)
+        fields++;
+    if ((token_value & 0x0003) == 0x0003)
+        fields++;
+
+    for (i = 0; i < fields; i++)
+    {
+        start = pos;
+        do
+        {
+            if (pos >= size)
+                return 0;
+        } while ((data[pos++] & 0x80) && pos - start < max_varint_size);
+    }
+    return pos;
+}
+
+/*
+ * Decodes the next token, straight from the input when it holds the longest
+ * possible token, otherwise a byte at a time through the header buffer
+ * until it holds the whole token.
+ */
+static inline berg_error_t berg_decoder_next_token(berg_decoder *decoder,
+                                                   const uint8_t *input,
+                                                   size_t input_size,
+                                                   size_t *pos,
+                                                   berg_token_t *token,
+                                                   bool *decoded)
+{
+    size_t header_pos;
+
+    *decoded = false;
+    if (decoder->header_size == 0 && input_size - *pos >= BERG_MAX_TOKEN_SIZE)
+    {
+        CHECK_ERR(berg_decode_token(input, pos, input_size, token));
+        *decoded = true;
+        return BERG_OK;
+    }
+
+    while (*pos < input_size)
+    {
+        decoder->header[decoder->header_size++] = input[(*pos)++];
+        if (berg_token_size(decoder->header, decoder->header_size) == 0)
+            continue;
+
+        header_pos = 0;
+        CHECK_ERR(berg_decode_token(
+            decoder->header, &header_pos, decoder->header_size, token));
+        decoder->header_size = 0;
+        *decoded             = true;
+        return BERG_OK;
+    }
     return BERG_OK;
 }
 
+/*
+ * Copies match bytes into the output of the current call, which starts at
+ * `output`. Bytes from before the call come from the window, the rest from
+ * the output itself.
+ */
+static inline void berg_decoder_copy_match(berg_decoder *decoder,
+                                           uint8_t *output,
+                                           const uint8_t *output_end,
+                                           size_t out,
+                                           size_t count)
+{
+    const size_t window_mask = BERG_DEFAULT_WINDOW_SIZE - 1;
+    const size_t offset      = decoder->match_offset;
+    uint8_t *dst             = output + out;
+    size_t i;
+
+    if (offset > out)
+    {
+        const size_t from = decoder->output_pos - offset;
+        const size_t n    = count < offset - out ? count : offset - out;
+        for (i = 0; i < n; i++)
+            dst[i] = decoder->window[(from + i) & window_mask];
+        dst += n;
+        count -= n;
+    }
+
+    if (count > 0)
+        berg_copy_match(dst, output_end, offset, count);
+}
+
+/* Keeps the last window of the output of a call, in at most two pieces. */
+static inline void berg_decoder_keep_window(berg_decoder *decoder,
+                                            const uint8_t *output,
+                                            size_t count)
+{
+    const size_t window_mask = BERG_DEFAULT_WINDOW_SIZE - 1;
+    const size_t start       = decoder->output_pos - count;
+    size_t i, at, run;
+
+    i = count > BERG_DEFAULT_WINDOW_SIZE ? count - BERG_DEFAULT_WINDOW_SIZE
+                                         : 0;
+    for (; i < count; i += run)
+    {
+        at  = (start + i) & window_mask;
+        run = BERG_DEFAULT_WINDOW_SIZE - at;
+        if (run > count - i)
+            run = count - i;
+        memcpy(decoder->window + at, output + i, run);
+    }
+}
+
+berg_error_t berg_decoder_decompress(berg_decoder *decoder,
+                                     const void *input,
+                                     size_t input_size,
+                                     size_t *input_used,
+                                     void *output,
+                                     size_t output_capacity,
+                                     size_t *output_written)
+{
+    const uint8_t *input_data = (const uint8_t *)input;
+    uint8_t *output_data      = (uint8_t *)output;
+    const uint8_t *output_end = output_data + output_capacity;
+    size_t pos = 0, out = 0, count;
+    berg_error_t result = BERG_OK;
+    berg_token_t token;
+    bool decoded;
+
+    if (!decoder || !input_used || !output_written ||
+        (!input && input_size > 0) || (!output && output_capacity > 0))
+        return BERG_ERROR_INVALID_PARAM;
+
+    while (decoder->output_pos < decoder->original_size)
+    {
+        if (decoder->literals > 0)
+        {
+            count = decoder->literals;
+            if (count > input_size - pos)
+                count = input_size - pos;
+            if (count > output_capacity - out)
+                count = output_capacity - out;
+            if (count == 0)
+                break;
+
+            memcpy(output_data + out, input_data + pos, count);
+            pos += count;
+            out += count;
+            decoder->output_pos += count;
+            decoder->literals -= count;
+            continue;
+        }
+
+        if (decoder->match_length > 0)
+        {
+            count = decoder->match_length;
+            if (count > output_capacity - out)
+                count = output_capacity - out;
+            if (count == 0)
+                break;
+
+            berg_decoder_copy_match(
+                decoder, output_data, output_end, out, count);
+            out += count;
+            decoder->output_pos += count;
+            decoder->match_length -= count;
+            continue;
+        }
+
+        result = berg_decoder_next_token(
+            decoder, input_data, input_size, &pos, &token, &decoded);
+        if (result < 0 || !decoded)
+            break;
+
+        if (token.literal_count >
+                decoder->original_size - decoder->output_pos ||
+            token.match_offset > decoder->output_pos + token.literal_count ||
+            token.match_length > decoder->original_size -
+                                     decoder->output_pos - token.literal_count)
+        {
+            result = BERG_ERROR_CORRUPT_DATA;
+            break;
+        }
+
+        decoder->literals     = token.literal_count;
+        decoder->match_offset = token.match_offset;
+        decoder->match_length = token.match_offset > 0 ? token.match_length
+                                                       : 0;
+    }
+
+    berg_decoder_keep_window(decoder, output_data, out);
+    *input_used     = pos;
+    *output_written = out;
+    if (result < 0)
+        return result;
+    return decoder->output_pos < decoder->original_size ? BERG_OK_MORE
+                                                        : BERG_OK;
+}
+
 typedef struct raw_internal_data_it_t
 {
     uint8_t *buffer;
@@ -843,6 +2121,25 @@ berg_error_t berg_compress_raw_stream(const void *input,
                                       void *buffer,
                                       size_t buffer_size,
                                       const berg_config *config)
+{
+    return berg_compress_raw_stream_ctx(NULL,
+                                        input,
+                                        input_size,
+                                        callback,
+                                        user_data,
+                                        buffer,
+                                        buffer_size,
+                                        config);
+}
+
+berg_error_t berg_compress_raw_stream_ctx(berg_context *context,
+                                          const void *input,
+                                          size_t input_size,
+                                          berg_write_callback_t callback,
+                                          void *user_data,
+                                          void *buffer,
+                                          size_t buffer_size,
+                                          const berg_config *config)
 {
     raw_internal_data_it_t data;
     data.buffer        = (uint8_t *)buffer;
@@ -852,8 +2149,14 @@ berg_error_t berg_compress_raw_stream(const void *input,
     data.callback      = callback;
     data.user_data     = user_data;
 
-    CHECK_ERR(berg_compress_raw_internal(
-        input, input_size, &data, write_internal_it_callback, config));
+    CHECK_ERR(berg_compress_raw_internal(context,
+                                         NULL,
+                                         0,
+                                         input,
+                                         input_size,
+                                         &data,
+                                         write_internal_it_callback,
+                                         config));
 
     return BERG_OK;
 }
@@ -893,6 +2196,25 @@ berg_error_t berg_compress_stream(const void *input,
                                   void *buffer,
                                   size_t buffer_size,
                                   const berg_config *config)
+{
+    return berg_compress_stream_ctx(NULL,
+                                    input,
+                                    input_size,
+                                    callback,
+                                    user_data,
+                                    buffer,
+                                    buffer_size,
+                                    config);
+}
+
+berg_error_t berg_compress_stream_ctx(berg_context *context,
+                                      const void *input,
+                                      size_t input_size,
+                                      berg_write_callback_t callback,
+                                      void *user_data,
+                                      void *buffer,
+                                      size_t buffer_size,
+                                      const berg_config *config)
 {
     uint8_t header_buf[8];
     uint32_t checksum;
@@ -911,11 +2233,17 @@ berg_error_t berg_compress_stream(const void *input,
     CHECK_ERR(callback(header_buf, 8, user_data));
 
     /* Stream the compressed raw data */
-    CHECK_ERR(berg_compress_raw_stream(
-        input, input_size, callback, user_data, buffer, buffer_size, config));
+    CHECK_ERR(berg_compress_raw_stream_ctx(context,
+                                           input,
+                                           input_size,
+                                           callback,
+                                           user_data,
+                                           buffer,
+                                           buffer_size,
+                                           config));
 
     /* Calculate and write checksum of original data */
-    checksum = berg_calculate_crc32(0, input, input_size);
+    checksum = berg_crc32(0, input, input_size);
     berg_write_le32(header_buf, checksum); // Reuse buffer
     CHECK_ERR(callback(header_buf, 4, user_data));
 
@@ -942,7 +2270,7 @@ write_and_checksum_callback(const void *data, size_t size, void *userdata)
     decompress_stream_data_t *stream_data =
         (decompress_stream_data_t *)userdata;
     stream_data->running_crc =
-        berg_calculate_crc32(stream_data->running_crc, data, size);
+        berg_crc32(stream_data->running_crc, data, size);
     return stream_data->user_callback(data, size, stream_data->user_data);
 }
 
@@ -952,6 +2280,23 @@ berg_error_t berg_decompress_stream(const void *compressed,
                                     void *user_data,
                                     void *buffer,
                                     size_t buffer_size)
+{
+    return berg_decompress_stream_flags(compressed,
+                                        compressed_size,
+                                        callback,
+                                        user_data,
+                                        buffer,
+                                        buffer_size,
+                                        BERG_DECOMPRESS_DEFAULT);
+}
+
+berg_error_t berg_decompress_stream_flags(const void *compressed,
+                                          size_t compressed_size,
+                                          berg_write_callback_t callback,
+                                          void *user_data,
+                                          void *buffer,
+                                          size_t buffer_size,
+                                          unsigned flags)
 {
     const uint8_t *input_data = (const uint8_t *)compressed;
     size_t original_size;
@@ -975,6 +2320,15 @@ berg_error_t berg_decompress_stream(const void *compressed,
     original_size   = berg_read_le32(input_data + 4);
     stored_checksum = berg_read_le32(input_data + compressed_size - 4);
 
+    if (flags & BERG_DECOMPRESS_NO_VERIFY)
+        return berg_decompress_raw_stream(input_data + 8,
+                                          compressed_size - 12,
+                                          original_size,
+                                          callback,
+                                          user_data,
+                                          buffer,
+                                          buffer_size);
+
     /* Set up the state for the checksum-calculating callback */
     stream_state.user_callback = callback;
     stream_state.user_data     = user_data;
@@ -3,9 +3,17 @@
 
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
 
 #define BERG_DEFAULT_WINDOW_SIZE ((size_t)4096)
 #define BERG_DEFAULT_LOOKAHEAD_SIZE ((size_t)256)
+#define BERG_DEFAULT_MAX_CHAIN_LENGTH ((size_t)8)
+#define BERG_DEFAULT_NICE_LENGTH ((size_t)16)
+#define BERG_MAX_DICTIONARY_SIZE ((size_t)4095)
+
+#define BERG_LEVEL_FASTEST 1
+#define BERG_LEVEL_DEFAULT 3
+#define BERG_LEVEL_MAX 6
 
 #ifdef __cplusplus
 extern "C"
@@ -17,6 +25,7 @@ extern "C"
  */
 typedef enum berg_error_t
 {
+    BERG_OK_MORE                    = 2,
     BERG_OK_NO_OUTPUT               = 1,
     BERG_OK                         = 0,
     BERG_ERROR_INVALID_PARAM        = -1,
@@ -27,15 +36,67 @@ typedef enum berg_error_t
     BERG_ERROR_CALLBACK_FAILED      = -6
 } berg_error_t;
 
+/**
+ * @brief How the compressor chooses between literals and matches
+ */
+typedef enum berg_parse_t
+{
+    /** Takes the longest match found at each position */
+    BERG_PARSE_GREEDY = 0,
+    /** Defers a match by one byte when the next position has a longer one */
+    BERG_PARSE_LAZY = 1,
+    /** Picks the cheapest encoding over windows of positions */
+    BERG_PARSE_OPTIMAL = 2
+} berg_parse_t;
+
+/**
+ * @brief Options of the decompress functions that check the CRC32
+ */
+typedef enum berg_decompress_flag_t
+{
+    BERG_DECOMPRESS_DEFAULT = 0,
+    /** Skips the CRC32 check, for data already known to be intact */
+    BERG_DECOMPRESS_NO_VERIFY = 1 << 0
+} berg_decompress_flag_t;
+
 /**
  * @struct berg_config
  * @brief Configuration parameters for Berg compression
+ *
+ * Only the compressor reads these, every configuration decodes at the same
+ * speed. Fields left at 0 take their default, so `{.lookahead_size = n}`
+ * initializers behave as before.
  */
 typedef struct berg_config
 {
-    size_t lookahead_size; ///< Size of the lookahead buffer
+    size_t lookahead_size;   ///< Size of the lookahead buffer
+    size_t max_chain_length; ///< Hash chain candidates tried per position
+    size_t nice_length;      ///< Match length that ends the search early
+    berg_parse_t parse;      ///< Literal/match selection strategy
 } berg_config;
 
+/**
+ * @brief Reusable compression state
+ *
+ * Holds the match finder tables (about 320 KB) between compress calls.
+ * Without a context each call sets up temporary tables on the stack and
+ * clears the part it hashes into. A context lets a new input reuse them
+ * without any clearing: entries from earlier inputs are told apart by their
+ * position base. The context lives in caller memory, see
+ * `berg_context_init`, and serves one call at a time.
+ */
+typedef struct berg_context berg_context;
+
+/**
+ * @brief Incremental raw decompression state
+ *
+ * Decompresses a raw stream fed in pieces of any size into output buffers
+ * of any size, keeping only the last window of output (about 4 KB), see
+ * `berg_decoder_decompress`. The decoder lives in caller memory, see
+ * `berg_decoder_init`.
+ */
+typedef struct berg_decoder berg_decoder;
+
 /**
  * @brief Callback function for streaming output
  * @param buffer Pointer to data to write
@@ -53,6 +114,19 @@ typedef berg_error_t (*berg_write_callback_t)(const void *buffer,
  */
 berg_config berg_get_default_config(void);
 
+/**
+ * @brief Get the configuration of a compression level
+ *
+ * Level 1 tries one candidate per position, level 2 two, level 3 is the
+ * default configuration. Levels 4 and 5 search deeper chains with lazy
+ * matching and level 6 uses the optimal parse. Levels outside
+ * [BERG_LEVEL_FASTEST, BERG_LEVEL_MAX] are clamped.
+ *
+ * @param level Compression level
+ * @return Berg configuration for the level
+ */
+berg_config berg_get_level_config(int level);
+
 /**
  * @brief Estimate maximum compressed size for given input size
  * @param input_size Size of input data
@@ -60,6 +134,77 @@ berg_config berg_get_default_config(void);
  */
 size_t berg_estimate_max_compressed_size(size_t input_size);
 
+/**
+ * @brief Update a CRC32 (the IEEE polynomial of zlib and the Berg format)
+ *
+ * Same results as `berg_calculate_crc32` of crc32.h, using the carry-less
+ * multiply (x86) or CRC32 (ARMv8) instructions when the CPU has them.
+ *
+ * @param crc CRC of the preceding data, 0 to start
+ * @param data Pointer to the data
+ * @param size Size of the data in bytes
+ * @return CRC of the preceding data followed by `data`
+ */
+uint32_t berg_crc32(uint32_t crc, const void *data, size_t size);
+
+/**
+ * @brief Get the memory needed for a compression context
+ * @return Size in bytes
+ */
+size_t berg_context_size(void);
+
+/**
+ * @brief Initialize a compression context in caller memory
+ * @param memory Memory for the context, 4-byte aligned, kept alive while the
+ * context is used
+ * @param size Size of the memory, at least `berg_context_size()`
+ * @return The context, or NULL if the memory is unsuitable
+ */
+berg_context *berg_context_init(void *memory, size_t size);
+
+/**
+ * @brief Get the memory needed for an incremental decoder
+ * @return Size in bytes
+ */
+size_t berg_decoder_size(void);
+
+/**
+ * @brief Initialize an incremental decoder for one raw stream
+ * @param memory Memory for the decoder, aligned like `size_t`, kept alive
+ * while the decoder is used
+ * @param size Size of the memory, at least `berg_decoder_size()`
+ * @param original_size Size of the decompressed data
+ * @return The decoder, or NULL if the memory is unsuitable
+ */
+berg_decoder *
+berg_decoder_init(void *memory, size_t size, size_t original_size);
+
+/**
+ * @brief Decompress the next piece of a raw stream
+ *
+ * Consumes compressed bytes and writes decompressed bytes until either runs
+ * out. Unused input must be passed again on the next call, in front of the
+ * bytes that follow it. Output bytes past `output_written` may be
+ * overwritten.
+ *
+ * @param decoder Decoder from `berg_decoder_init`
+ * @param input The next compressed bytes
+ * @param input_size Number of compressed bytes available
+ * @param input_used Receives the number of compressed bytes consumed
+ * @param output Buffer for the decompressed bytes
+ * @param output_capacity Size of the output buffer in bytes
+ * @param output_written Receives the number of bytes written
+ * @return BERG_OK once the whole stream is decompressed, BERG_OK_MORE if it
+ * needs more input or output space, error code on failure
+ */
+berg_error_t berg_decoder_decompress(berg_decoder *decoder,
+                                     const void *input,
+                                     size_t input_size,
+                                     size_t *input_used,
+                                     void *output,
+                                     size_t output_capacity,
+                                     size_t *output_written);
+
 /**
  * @brief Compress data using preallocated output buffer
  * @param input Pointer to input data
@@ -77,6 +222,19 @@ berg_error_t berg_compress(const void *input,
                            size_t *compressed_size,
                            const berg_config *config);
 
+/**
+ * @brief Compress data like `berg_compress`, reusing a context
+ * @param context Context from `berg_context_init`, NULL for temporary tables
+ * @see berg_compress
+ */
+berg_error_t berg_compress_ctx(berg_context *context,
+                               const void *input,
+                               size_t input_size,
+                               void *output,
+                               size_t output_capacity,
+                               size_t *compressed_size,
+                               const berg_config *config);
+
 /**
  * @brief Decompress data using preallocated output buffer
  * @param compressed Pointer to compressed data
@@ -92,6 +250,18 @@ berg_error_t berg_decompress(const void *compressed,
                              size_t output_capacity,
                              size_t *decompressed_size);
 
+/**
+ * @brief Decompress data like `berg_decompress`, with options
+ * @param flags Combination of `berg_decompress_flag_t` values
+ * @see berg_decompress
+ */
+berg_error_t berg_decompress_flags(const void *compressed,
+                                   size_t compressed_size,
+                                   void *output,
+                                   size_t output_capacity,
+                                   size_t *decompressed_size,
+                                   unsigned flags);
+
 /**
  * @brief Raw compress data (no header) using preallocated output buffer
  * @param input Pointer to input data
@@ -109,6 +279,42 @@ berg_error_t berg_compress_raw(const void *input,
                                size_t *compressed_size,
                                const berg_config *config);
 
+/**
+ * @brief Raw compress data like `berg_compress_raw`, reusing a context
+ * @param context Context from `berg_context_init`, NULL for temporary tables
+ * @see berg_compress_raw
+ */
+berg_error_t berg_compress_raw_ctx(berg_context *context,
+                                   const void *input,
+                                   size_t input_size,
+                                   void *output,
+                                   size_t output_capacity,
+                                   size_t *compressed_size,
+                                   const berg_config *config);
+
+/**
+ * @brief Raw compress data like `berg_compress_raw_ctx`, with matches also
+ * reaching into a preset dictionary
+ *
+ * The dictionary acts as data preceding the input, so small inputs that
+ * share content with it compress well. Only its last
+ * BERG_MAX_DICTIONARY_SIZE bytes are used. The output must be decompressed
+ * with `berg_decompress_raw_dict` and the same dictionary.
+ *
+ * @param dictionary The dictionary, NULL if `dictionary_size` is 0
+ * @param dictionary_size Size of the dictionary in bytes
+ * @see berg_compress_raw_ctx
+ */
+berg_error_t berg_compress_raw_dict(berg_context *context,
+                                    const void *dictionary,
+                                    size_t dictionary_size,
+                                    const void *input,
+                                    size_t input_size,
+                                    void *output,
+                                    size_t output_capacity,
+                                    size_t *compressed_size,
+                                    const berg_config *config);
+
 /**
  * @brief Raw decompress data (no header) using preallocated output buffer
  * @param compressed Pointer to compressed data
@@ -126,6 +332,21 @@ berg_error_t berg_decompress_raw(const void *compressed,
                                  size_t original_size,
                                  size_t *decompressed_size);
 
+/**
+ * @brief Raw decompress data compressed by `berg_compress_raw_dict`
+ * @param dictionary The dictionary it was compressed with
+ * @param dictionary_size Size of the dictionary in bytes
+ * @see berg_decompress_raw
+ */
+berg_error_t berg_decompress_raw_dict(const void *dictionary,
+                                      size_t dictionary_size,
+                                      const void *compressed,
+                                      size_t compressed_size,
+                                      void *output,
+                                      size_t output_capacity,
+                                      size_t original_size,
+                                      size_t *decompressed_size);
+
 /**
  * @brief Raw compress data with streaming output via callback
  * @param input Pointer to input data
@@ -145,6 +366,20 @@ berg_error_t berg_compress_raw_stream(const void *input,
                                       size_t buffer_size,
                                       const berg_config *config);
 
+/**
+ * @brief Raw compress data with streaming output, reusing a context
+ * @param context Context from `berg_context_init`, NULL for temporary tables
+ * @see berg_compress_raw_stream
+ */
+berg_error_t berg_compress_raw_stream_ctx(berg_context *context,
+                                          const void *input,
+                                          size_t input_size,
+                                          berg_write_callback_t callback,
+                                          void *user_data,
+                                          void *buffer,
+                                          size_t buffer_size,
+                                          const berg_config *config);
+
 /**
  * @brief Raw decompress data with streaming output via callback
  * @param compressed Pointer to compressed data
@@ -172,6 +407,20 @@ berg_error_t berg_compress_stream(const void *input,
                                   size_t buffer_size,
                                   const berg_config *config);
 
+/**
+ * @brief Compress data with streaming output, reusing a context
+ * @param context Context from `berg_context_init`, NULL for temporary tables
+ * @see berg_compress_stream
+ */
+berg_error_t berg_compress_stream_ctx(berg_context *context,
+                                      const void *input,
+                                      size_t input_size,
+                                      berg_write_callback_t callback,
+                                      void *user_data,
+                                      void *buffer,
+                                      size_t buffer_size,
+                                      const berg_config *config);
+
 berg_error_t berg_decompress_stream(const void *compressed,
                                     size_t compressed_size,
                                     berg_write_callback_t callback,
@@ -179,6 +428,19 @@ berg_error_t berg_decompress_stream(const void *compressed,
                                     void *buffer,
                                     size_t buffer_size);
 
+/**
+ * @brief Decompress data with streaming output, with options
+ * @param flags Combination of `berg_decompress_flag_t` values
+ * @see berg_decompress_stream
+ */
+berg_error_t berg_decompress_stream_flags(const void *compressed,
+                                          size_t compressed_size,
+                                          berg_write_callback_t callback,
+                                          void *user_data,
+                                          void *buffer,
+                                          size_t buffer_size,
+                                          unsigned flags);
+
 #ifdef __cplusplus
 }
 #endif
@@ -1,3 +1,5 @@
+#define _POSIX_C_SOURCE 200809L // clock_gettime and fileno in C99
+
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -6,6 +8,8 @@
 #include <zabato/berg.h>
 
 // TODO: support others operation system
+#include <pthread.h>
+#include <time.h>
 #include <unistd.h>
 
 typedef struct
@@ -319,6 +323,15 @@ void print_usage(void)
             "for pipes)\n");
     fprintf(stderr,
             "  -f, --force                   - Overwrite output files\n");
+    fprintf(stderr,
+            "  --no-verify                   - Skip the checksum when "
+            "decompressing\n");
+    fprintf(stderr,
+            "  -j, --threads <n>             - Compress in independent "
+            "blocks on n threads (0: all cores)\n");
+    fprintf(stderr,
+            "  -l, --level <1-6>             - Compression level (default "
+            "3, 6: smallest)\n");
     fprintf(stderr, "  -h, --help                    - Show this help\n");
     fprintf(stderr, "\nPipe Examples:\n");
     fprintf(
@@ -338,6 +351,18 @@ void print_usage(void)
 
 bool is_pipe_mode() { return !isatty(fileno(stdin)); }
 
+static double now_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static double megabytes_per_second(size_t size, double seconds)
+{
+    return seconds > 0.0 ? (double)size / (1024.0 * 1024.0) / seconds : 0.0;
+}
+
 #define STREAM_BUFFER_SIZE (1024 * 1024)
 
 typedef struct
@@ -376,11 +401,315 @@ static inline uint32_t read_le32(const uint8_t *data)
            ((uint32_t)data[2] << 16) | ((uint32_t)data[3] << 24);
 }
 
+static inline void write_le32(uint8_t *data, uint32_t value)
+{
+    data[0] = (uint8_t)value;
+    data[1] = (uint8_t)(value >> 8);
+    data[2] = (uint8_t)(value >> 16);
+    data[3] = (uint8_t)(value >> 24);
+}
+
+/*
+ * Block mode, for compressing on several threads.
+ *
+ * The input is split into BLOCK_SIZE blocks compressed on their own, and
+ * written in order, so the file does not depend on the thread count:
+ *   "BRGB", original size, block size, block count (4 bytes each, LE)
+ *   block count + 1 offsets of the blocks, relative to the first one
+ *   the blocks, stored as is when compressing does not shrink them
+ *   CRC32 of the original data
+ */
+#define BLOCK_SIZE (64 * 1024)
+#define BLOCK_HEADER_SIZE 16
+#define MAX_THREADS 64
+
+typedef struct
+{
+    const uint8_t *input; // The block to compress or decompress
+    size_t input_size;
+    uint8_t *output; // Slot for the result, output_capacity long
+    size_t output_capacity;
+    size_t output_size;
+    berg_error_t error;
+} Block;
+
+typedef struct
+{
+    Block *blocks;
+    size_t count;
+    size_t next; // Next block to take, under lock
+    bool decompress;
+    const berg_config *config;
+    pthread_mutex_t lock;
+} BlockQueue;
+
+static void process_block(Block *block,
+                          bool decompress,
+                          berg_context *context,
+                          const berg_config *config)
+{
+    if (decompress)
+    {
+        if (block->input_size == block->output_capacity)
+        {
+            memcpy(block->output, block->input, block->input_size);
+            block->output_size = block->input_size;
+            block->error       = BERG_OK;
+            return;
+        }
+        block->error = berg_decompress_raw(block->input,
+                                           block->input_size,
+                                           block->output,
+                                           block->output_capacity,
+                                           block->output_capacity,
+                                           &block->output_size);
+        if (block->error >= 0 && block->output_size != block->output_capacity)
+            block->error = BERG_ERROR_CORRUPT_DATA;
+        return;
+    }
+
+    block->error = berg_compress_raw_ctx(context,
+                                         block->input,
+                                         block->input_size,
+                                         block->output,
+                                         block->output_capacity,
+                                         &block->output_size,
+                                         config);
+    if (block->error >= 0 && block->output_size >= block->input_size)
+    {
+        memcpy(block->output, block->input, block->input_size);
+        block->output_size = block->input_size;
+    }
+}
+
+static void *block_worker(void *arg)
+{
+    BlockQueue *queue = (BlockQueue *)arg;
+
+    // One compression context per thread, reused across its blocks. Without
+    // one, blocks are compressed with temporary tables.
+    size_t size           = berg_context_size();
+    void *memory          = queue->decompress ? NULL : malloc(size);
+    berg_context *context = berg_context_init(memory, size);
+
+    for (;;)
+    {
+        pthread_mutex_lock(&queue->lock);
+        size_t index = queue->next++;
+        pthread_mutex_unlock(&queue->lock);
+
+        if (index >= queue->count)
+            break;
+        process_block(
+            &queue->blocks[index], queue->decompress, context, queue->config);
+    }
+
+    free(memory);
+    return NULL;
+}
+
+// Runs every block on `thread_count` threads, the calling one included.
+static berg_error_t run_blocks(Block *blocks,
+                               size_t count,
+                               bool decompress,
+                               const berg_config *config,
+                               unsigned thread_count)
+{
+    BlockQueue queue = {
+        .blocks     = blocks,
+        .count      = count,
+        .next       = 0,
+        .decompress = decompress,
+        .config     = config,
+    };
+    pthread_t threads[MAX_THREADS];
+    unsigned started = 0;
+    size_t i;
+
+    pthread_mutex_init(&queue.lock, NULL);
+    if (thread_count > MAX_THREADS)
+        thread_count = MAX_THREADS;
+    if (thread_count > count)
+        thread_count = (unsigned)count;
+
+    // Blocks left by threads that fail to start run on this one.
+    while (started + 1 < thread_count &&
+           pthread_create(&threads[started], NULL, block_worker, &queue) == 0)
+        started++;
+
+    block_worker(&queue);
+    for (i = 0; i < started; ++i)
+        pthread_join(threads[i], NULL);
+    pthread_mutex_destroy(&queue.lock);
+
+    for (i = 0; i < count; ++i)
+        if (blocks[i].error < 0)
+            return blocks[i].error;
+    return BERG_OK;
+}
+
+static unsigned resolve_thread_count(unsigned thread_count)
+{
+    if (thread_count == 0)
+    {
+        long online  = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = online > 0 ? (unsigned)online : 1;
+    }
+    return thread_count;
+}
+
+bool is_block_file(const ByteBuffer *input)
+{
+    return input->size >= 4 && memcmp(input->data, "BRGB", 4) == 0;
+}
+
+berg_error_t compress_blocks(const ByteBuffer *input,
+                             FILE *f,
+                             const berg_config *config,
+                             unsigned thread_count,
+                             size_t *total_written)
+{
+    size_t count     = (input->size + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    size_t header    = BLOCK_HEADER_SIZE + (count + 1) * 4;
+    size_t slot_size = berg_estimate_max_compressed_size(BLOCK_SIZE);
+    Block *blocks    = (Block *)calloc(count ? count : 1, sizeof(Block));
+    uint8_t *table   = (uint8_t *)malloc(header);
+    uint8_t *slots   = (uint8_t *)malloc(count * slot_size + 1);
+    berg_error_t err = BERG_OK;
+    uint8_t crc[4];
+    size_t i, offset = 0;
+
+    if (!blocks || !table || !slots)
+    {
+        free(blocks);
+        free(table);
+        free(slots);
+        return BERG_ERROR_BUFFER_TOO_SMALL;
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+        size_t at   = i * BLOCK_SIZE;
+        size_t left = input->size - at;
+
+        blocks[i].input           = input->data + at;
+        blocks[i].input_size      = left < BLOCK_SIZE ? left : BLOCK_SIZE;
+        blocks[i].output          = slots + i * slot_size;
+        blocks[i].output_capacity = slot_size;
+    }
+
+    err = run_blocks(
+        blocks, count, false, config, resolve_thread_count(thread_count));
+    if (err >= 0)
+    {
+        memcpy(table, "BRGB", 4);
+        write_le32(table + 4, (uint32_t)input->size);
+        write_le32(table + 8, BLOCK_SIZE);
+        write_le32(table + 12, (uint32_t)count);
+        write_le32(table + BLOCK_HEADER_SIZE, 0);
+        for (i = 0; i < count; ++i)
+        {
+            offset += blocks[i].output_size;
+            write_le32(table + BLOCK_HEADER_SIZE + (i + 1) * 4,
+                       (uint32_t)offset);
+        }
+
+        write_le32(crc, berg_crc32(0, input->data, input->size));
+        if (fwrite(table, 1, header, f) != header)
+            err = BERG_ERROR_CALLBACK_FAILED;
+        for (i = 0; err >= 0 && i < count; ++i)
+            if (fwrite(blocks[i].output, 1, blocks[i].output_size, f) !=
+                blocks[i].output_size)
+                err = BERG_ERROR_CALLBACK_FAILED;
+        if (err >= 0 && fwrite(crc, 1, 4, f) != 4)
+            err = BERG_ERROR_CALLBACK_FAILED;
+        *total_written = header + offset + 4;
+    }
+
+    free(blocks);
+    free(table);
+    free(slots);
+    return err;
+}
+
+berg_error_t decompress_blocks(const ByteBuffer *input,
+                               FILE *f,
+                               unsigned thread_count,
+                               bool verify,
+                               uint32_t *original_size)
+{
+    const uint8_t *data = input->data;
+    uint32_t size, block_size, count;
+    size_t header, i;
+    Block *blocks;
+    ByteBuffer output;
+    berg_error_t err;
+
+    if (input->size < BLOCK_HEADER_SIZE + 8)
+        return BERG_ERROR_CORRUPT_DATA;
+
+    size       = read_le32(data + 4);
+    block_size = read_le32(data + 8);
+    count      = read_le32(data + 12);
+    header     = BLOCK_HEADER_SIZE + ((size_t)count + 1) * 4;
+    if (block_size == 0 ||
+        count != ((uint64_t)size + block_size - 1) / block_size ||
+        header + 4 > input->size)
+        return BERG_ERROR_CORRUPT_DATA;
+
+    byte_buffer_init(&output);
+    blocks = (Block *)calloc(count ? count : 1, sizeof(Block));
+    if (!blocks || !byte_buffer_resize(&output, size ? size : 1))
+    {
+        free(blocks);
+        byte_buffer_free(&output);
+        return BERG_ERROR_BUFFER_TOO_SMALL;
+    }
+    output.size = size;
+
+    err = BERG_OK;
+    for (i = 0; i < count; ++i)
+    {
+        size_t begin = read_le32(data + BLOCK_HEADER_SIZE + i * 4);
+        size_t end   = read_le32(data + BLOCK_HEADER_SIZE + (i + 1) * 4);
+        size_t at    = (size_t)i * block_size;
+        size_t left  = size - at;
+        if (begin > end || header + end + 4 > input->size)
+        {
+            err = BERG_ERROR_CORRUPT_DATA;
+            break;
+        }
+
+        blocks[i].input           = data + header + begin;
+        blocks[i].input_size      = end - begin;
+        blocks[i].output          = output.data + at;
+        blocks[i].output_capacity = left < block_size ? left : block_size;
+    }
+
+    if (err >= 0)
+        err = run_blocks(
+            blocks, count, true, NULL, resolve_thread_count(thread_count));
+    if (err >= 0 && verify &&
+        berg_crc32(0, output.data, size) != read_le32(data + input->size - 4))
+        err = BERG_ERROR_CORRUPT_DATA;
+    if (err >= 0 && write_buffer_to_output(&output, f) != 0)
+        err = BERG_ERROR_CALLBACK_FAILED;
+
+    *original_size = size;
+    free(blocks);
+    byte_buffer_free(&output);
+    return err;
+}
+
 int main(int argc, char *argv[])
 {
     bool decompress_mode    = false;
     bool stdout_mode        = false;
     bool force_mode         = false;
+    bool block_mode         = false;
+    bool verify             = true;
+    unsigned thread_count   = 0;
+    int level               = BERG_LEVEL_DEFAULT;
     const char *input_file  = NULL;
     const char *output_file = NULL;
 
@@ -401,6 +730,39 @@ int main(int argc, char *argv[])
         {
             force_mode = true;
         }
+        else if (strcmp(arg, "--no-verify") == 0)
+        {
+            verify = false;
+        }
+        else if (strcmp(arg, "-j") == 0 || strcmp(arg, "--threads") == 0)
+        {
+            if (arg_idx + 1 >= argc)
+            {
+                fprintf(stderr, "Error: %s requires a thread count\n", arg);
+                print_usage();
+                return 1;
+            }
+            block_mode   = true;
+            thread_count = (unsigned)strtoul(argv[++arg_idx], NULL, 10);
+        }
+        else if (strcmp(arg, "-l") == 0 || strcmp(arg, "--level") == 0)
+        {
+            if (arg_idx + 1 >= argc)
+            {
+                fprintf(stderr, "Error: %s requires a level\n", arg);
+                print_usage();
+                return 1;
+            }
+            level = (int)strtol(argv[++arg_idx], NULL, 10);
+            if (level < BERG_LEVEL_FASTEST || level > BERG_LEVEL_MAX)
+            {
+                fprintf(stderr,
+                        "Error: level must be between %d and %d\n",
+                        BERG_LEVEL_FASTEST,
+                        BERG_LEVEL_MAX);
+                return 1;
+            }
+        }
         else if (strcmp(arg, "-h") == 0 || strcmp(arg, "--help") == 0)
         {
             print_usage();
@@ -492,18 +854,33 @@ int main(int argc, char *argv[])
                 return 1;
             }
 
-            berg_config configs[] = {{8}, {12}, {18}, {24}};
+            berg_config configs[] = {{.lookahead_size = 8},
+                                     {.lookahead_size = 12},
+                                     {.lookahead_size = 18},
+                                     {.lookahead_size = 24},
+                                     berg_get_level_config(1),
+                                     berg_get_level_config(2),
+                                     berg_get_level_config(3),
+                                     berg_get_level_config(4),
+                                     berg_get_level_config(5),
+                                     berg_get_level_config(6)};
 
             const char *config_names[] = {"Small (8 byte lookahead)",
                                           "Medium (12 byte lookahead)",
                                           "Default (18 byte lookahead)",
-                                          "Large (24 byte lookahead)"};
+                                          "Large (24 byte lookahead)",
+                                          "Level 1 (fastest)",
+                                          "Level 2",
+                                          "Level 3 (default)",
+                                          "Level 4 (lazy matching)",
+                                          "Level 5 (lazy, deeper chains)",
+                                          "Level 6 (optimal parse)"};
 
             fprintf(stderr, "\nTesting different configurations:\n");
             fprintf(stderr, "=================================\n");
 
             int i;
-            for (i = 0; i < 4; ++i)
+            for (i = 0; i < (int)(sizeof(configs) / sizeof(configs[0])); ++i)
             {
                 fprintf(stderr, "\n--- %s ---\n", config_names[i]);
 
@@ -514,12 +891,14 @@ int main(int argc, char *argv[])
                 byte_buffer_resize(&compressed_data, max_size);
 
                 size_t compressed_data_size = 0;
+                double start                = now_seconds();
                 berg_error_t err            = berg_compress(input_data.data,
                                                  input_data.size,
                                                  compressed_data.data,
                                                  compressed_data.capacity,
                                                  &compressed_data_size,
                                                  &configs[i]);
+                double compress_time        = now_seconds() - start;
 
                 if (err < 0)
                 {
@@ -534,11 +913,13 @@ int main(int argc, char *argv[])
                 byte_buffer_resize(&decompressed_data, input_data.size);
 
                 size_t decompressed_data_size = 0;
-                berg_decompress(compressed_data.data,
-                                compressed_data.size,
-                                decompressed_data.data,
-                                decompressed_data.capacity,
-                                &decompressed_data_size);
+                start = now_seconds();
+                err   = berg_decompress(compressed_data.data,
+                                      compressed_data.size,
+                                      decompressed_data.data,
+                                      decompressed_data.capacity,
+                                      &decompressed_data_size);
+                double decompress_time = now_seconds() - start;
                 decompressed_data.size = decompressed_data_size;
                 if (err < 0)
                 {
@@ -563,6 +944,13 @@ int main(int argc, char *argv[])
                                    (double)input_data.size;
                     fprintf(stderr, "Compression ratio: %.2f%%\n", ratio);
                 }
+                fprintf(stderr,
+                        "Compression speed: %.1f MB/s\n",
+                        megabytes_per_second(input_data.size, compress_time));
+                fprintf(stderr,
+                        "Decompression speed: %.1f MB/s\n",
+                        megabytes_per_second(input_data.size,
+                                             decompress_time));
                 fprintf(stderr, "Correctness: %s\n", correct ? "PASS" : "FAIL");
 
                 byte_buffer_free(&compressed_data);
@@ -694,14 +1082,40 @@ int main(int argc, char *argv[])
 
     uint8_t stream_buffer[STREAM_BUFFER_SIZE];
 
-    if (decompress_mode)
+    if (decompress_mode && is_block_file(&input_data))
+    {
+        uint32_t original_size = 0;
+        berg_error_t err       = decompress_blocks(
+            &input_data, out_f, thread_count, verify, &original_size);
+
+        if (err < 0)
+        {
+            fprintf(stderr,
+                    "ERROR: Decompression failed with error code: %d\n",
+                    (int)err);
+            byte_buffer_free(&input_data);
+            if (out_f != stdout)
+                fclose(out_f);
+            return 1;
+        }
+
+        if (!using_stdout)
+        {
+            fprintf(stderr, "Decompression completed successfully!\n");
+            fprintf(stderr, "Compressed size: %zu bytes\n", input_data.size);
+            fprintf(stderr, "Decompressed size: %u bytes\n", original_size);
+        }
+    }
+    else if (decompress_mode)
     {
-        berg_error_t err = berg_decompress_stream(input_data.data,
-                                                  input_data.size,
-                                                  file_write_callback,
-                                                  out_f,
-                                                  stream_buffer,
-                                                  sizeof(stream_buffer));
+        berg_error_t err = berg_decompress_stream_flags(
+            input_data.data,
+            input_data.size,
+            file_write_callback,
+            out_f,
+            stream_buffer,
+            sizeof(stream_buffer),
+            verify ? BERG_DECOMPRESS_DEFAULT : BERG_DECOMPRESS_NO_VERIFY);
 
         if (err < 0)
         {
@@ -727,15 +1141,23 @@ int main(int argc, char *argv[])
     else // Compress
     {
         FileWriteInfo write_info = {out_f, 0};
-        berg_config config       = berg_get_default_config();
-
-        berg_error_t err = berg_compress_stream(input_data.data,
-                                                input_data.size,
-                                                file_write_and_count_callback,
-                                                &write_info,
-                                                stream_buffer,
-                                                sizeof(stream_buffer),
-                                                &config);
+        berg_config config       = berg_get_level_config(level);
+
+        berg_error_t err;
+        if (block_mode)
+            err = compress_blocks(&input_data,
+                                  out_f,
+                                  &config,
+                                  thread_count,
+                                  &write_info.total_written);
+        else
+            err = berg_compress_stream(input_data.data,
+                                       input_data.size,
+                                       file_write_and_count_callback,
+                                       &write_info,
+                                       stream_buffer,
+                                       sizeof(stream_buffer),
+                                       &config);
 
         if (err < 0)
         {
@@ -11,4 +11,8 @@ target("cli_berg")
     add_files("main.c")
     
     add_deps("berg")
-    set_basename("berg")
\ No newline at end of file
+    set_basename("berg")
+
+    if not is_plat("windows") then
+        add_syslinks("pthread")
+    end
\ No newline at end of file
@@ -1,7 +1,23 @@
-#include <iostream>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
 #include <zabato/gl.hpp>
+#include <zabato/log.hpp>
 #include <zabato/window.hpp>
 
+#ifndef GL_UNSIGNED_SHORT_4_4_4_4_REV
+#define GL_UNSIGNED_SHORT_4_4_4_4_REV 0x8365
+#endif
+#ifndef GL_UNSIGNED_SHORT_1_5_5_5_REV
+#define GL_UNSIGNED_SHORT_1_5_5_5_REV 0x8366
+#endif
+#ifndef GL_COLOR_INDEX4_EXT
+#define GL_COLOR_INDEX4_EXT 0x80E4
+#endif
+#ifndef GL_COLOR_INDEX8_EXT
+#define GL_COLOR_INDEX8_EXT 0x80E5
+#endif
+
 namespace zabato
 {
 #ifndef __EMSCRIPTEN__
@@ -20,10 +36,11 @@ void GLAPIENTRY gl_message_callback(GLenum source,
     if (severity == GL_DEBUG_SEVERITY_NOTIFICATION)
         return;
 
-    std::cerr << "GL CALLBACK: "
-              << (type == GL_DEBUG_TYPE_ERROR ? "** GL ERROR **" : "")
-              << " type = 0x" << std::hex << type << ", severity = 0x"
-              << severity << ", message = " << message << std::endl;
+    LOG_ERROR("GL CALLBACK: %s type = 0x%x, severity = 0x%x, message = %s",
+              type == GL_DEBUG_TYPE_ERROR ? "** GL ERROR **" : "",
+              (unsigned)type,
+              (unsigned)severity,
+              message);
 }
 #endif // __EMSCRIPTEN__
 
@@ -69,47 +86,11 @@ GLenum to_gl_shade_model(shade_model sm)
     return 0;
 }
 
-size_t palette_count(color_format format)
-{
-    switch (format)
-    {
-    case color_format::palette16:
-        return 16;
-    case color_format::palette64:
-        return 64;
-    case color_format::palette128:
-        return 128;
-    case color_format::palette256:
-        return 256;
-    default:
-        return 0;
-    }
-}
-
-size_t color_format_bits(color_format format)
-{
-    switch (format)
-    {
-    case color_format::rgba5551:
-        return 16;
-    case color_format::rgba4444:
-        return 16;
-    case color_format::palette16:
-        return 4;
-    case color_format::palette64:
-    case color_format::palette128:
-    case color_format::palette256:
-        return 8;
-    default:
-        return 0;
-    }
-}
-
 size_t calculate_texture_data_size(uint16_t width,
                                    uint16_t height,
                                    color_format format)
 {
-    size_t pcount = palette_count(format);
+    size_t pcount = color_format_palette_count(format);
     if (pcount > 0)
     {
         size_t palette_size = pcount * sizeof(uint32_t);
@@ -123,8 +104,18 @@ size_t calculate_texture_data_size(uint16_t width,
     }
 }
 
-GlTexture::GlTexture(uint16_t width, uint16_t height, color_format format)
-    : m_width(width), m_height(height), m_format(format)
+static uint32_t next_texture_serial()
+{
+    static uint32_t next_serial = 0;
+    return ++next_serial;
+}
+
+GlTexture::GlTexture(uint16_t width,
+                     uint16_t height,
+                     color_format format,
+                     const GlTextureSupport &support)
+    : m_serial(next_texture_serial()), m_width(width), m_height(height),
+      m_format(format), m_support(support)
 {
     glGenTextures(1, &m_handle);
 }
@@ -151,15 +142,97 @@ void GlTexture::load(uint16_t width,
         calculate_texture_data_size(width, height, format);
     if (data_size < expected_size)
     {
-        std::cerr << "Error loading texture: provided data size (" << data_size
-                  << ") is less than expected size (" << expected_size << ")."
-                  << std::endl;
+        LOG_ERROR("Error loading texture: provided data size (%zu) is less "
+                  "than expected size (%zu).",
+                  data_size,
+                  expected_size);
         return;
     }
+    if (expected_size == 0)
+        return; // Invalid format
 
     const uint8_t *byte_data = static_cast<const uint8_t *>(data);
-    m_pixel_data.assign(byte_data, byte_data + expected_size);
+    if (m_support.keep_pixel_data)
+        m_pixel_data.assign(byte_data, byte_data + expected_size);
+    else
+        m_pixel_data = {};
 
+    glBindTexture(GL_TEXTURE_2D, m_handle);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // 16-bit and index rows are not padded to 4 bytes.
+    GLint unpack_alignment = 4;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &unpack_alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+    const bool packed = m_support.packed_pixels;
+    if (packed && m_format == color_format::rgba5551)
+        glTexImage2D(GL_TEXTURE_2D,
+                     0,
+                     GL_RGB5_A1,
+                     m_width,
+                     m_height,
+                     0,
+                     GL_RGBA,
+                     GL_UNSIGNED_SHORT_1_5_5_5_REV,
+                     byte_data);
+    else if (packed && m_format == color_format::rgba4444)
+        glTexImage2D(GL_TEXTURE_2D,
+                     0,
+                     GL_RGBA4,
+                     m_width,
+                     m_height,
+                     0,
+                     GL_RGBA,
+                     GL_UNSIGNED_SHORT_4_4_4_4_REV,
+                     byte_data);
+    else if (!upload_indexed(byte_data))
+        upload_expanded(byte_data);
+
+    glPixelStorei(GL_UNPACK_ALIGNMENT, unpack_alignment);
+}
+
+bool GlTexture::upload_indexed(const uint8_t *data)
+{
+    const size_t pcount = color_format_palette_count(m_format);
+    if (pcount == 0 || !m_support.color_table)
+        return false;
+
+    const uint8_t *indices = data + pcount * sizeof(uint32_t);
+    GLenum internal_format = GL_COLOR_INDEX8_EXT;
+
+    // GL takes no 4-bit indices, so nibbles go up as bytes.
+    vector<uint8_t> expanded;
+    if (m_format == color_format::palette16)
+    {
+        internal_format = GL_COLOR_INDEX4_EXT;
+        expanded.resize(size_t(m_width) * m_height);
+        for (size_t i = 0; i < expanded.size(); ++i)
+            expanded[i] = (indices[i / 2] >> (i % 2 ? 0 : 4)) & 0xF;
+        indices = expanded.data();
+    }
+
+    m_support.color_table(GL_TEXTURE_2D,
+                          GL_RGBA8,
+                          GLsizei(pcount),
+                          GL_RGBA,
+                          GL_UNSIGNED_BYTE,
+                          data);
+    glTexImage2D(GL_TEXTURE_2D,
+                 0,
+                 internal_format,
+                 m_width,
+                 m_height,
+                 0,
+                 GL_COLOR_INDEX,
+                 GL_UNSIGNED_BYTE,
+                 indices);
+    return true;
+}
+
+void GlTexture::upload_expanded(const uint8_t *data)
+{
     vector<uint32_t> buffer;
     buffer.resize(m_width * m_height);
     GLint internal_format = GL_RGBA8;
@@ -168,23 +241,22 @@ void GlTexture::load(uint16_t width,
     {
     case color_format::rgba5551:
     {
-        internal_format        = GL_RGB5_A1;
-        const uint16_t *pixels = static_cast<const uint16_t *>(data);
-        for (size_t i = 0; i < buffer.size(); ++i)
-        {
-            color color(color5551{pixels[i]});
-            buffer[i] = color8888(color).value;
-        }
+        internal_format = GL_RGB5_A1;
+        convert_colors(
+            span<const color5551>(reinterpret_cast<const color5551 *>(data),
+                                  buffer.size()),
+            span<color8888>(reinterpret_cast<color8888 *>(buffer.data()),
+                            buffer.size()));
         break;
     }
     case color_format::rgba4444:
     {
-        internal_format        = GL_RGBA4;
-        const uint16_t *pixels = static_cast<const uint16_t *>(data);
-        for (size_t i = 0; i < buffer.size(); ++i)
-        {
-            buffer[i] = color8888(color(color4444{pixels[i]})).value;
-        }
+        internal_format = GL_RGBA4;
+        convert_colors(
+            span<const color4444>(reinterpret_cast<const color4444 *>(data),
+                                  buffer.size()),
+            span<color8888>(reinterpret_cast<color8888 *>(buffer.data()),
+                            buffer.size()));
         break;
     }
     case color_format::palette16:
@@ -192,32 +264,25 @@ void GlTexture::load(uint16_t width,
     case color_format::palette128:
     case color_format::palette256:
     {
-        internal_format         = GL_RGBA8;
-        const bool is_nibble    = m_format == color_format::palette16;
-        const size_t pcount     = palette_count(m_format);
-        const uint32_t *palette = static_cast<const uint32_t *>(data);
+        internal_format          = GL_RGBA8;
+        const uint32_t bits      = m_format == color_format::palette16 ? 4 : 8;
+        const size_t pcount      = color_format_palette_count(m_format);
+        const color8888 *palette = reinterpret_cast<const color8888 *>(data);
         const uint8_t *indices =
             reinterpret_cast<const uint8_t *>(palette + pcount);
 
-        for (size_t i = 0; i < buffer.size(); i++)
-        {
-            uint8_t index = is_nibble
-                                ? (indices[i / 2] >> (i % 2 ? 0 : 4)) & 0xF
-                                : indices[i];
-            if (index < pcount)
-            {
-                buffer[i] = palette[index];
-            }
-        }
+        expand_palette(
+            span<const uint8_t>(indices, (buffer.size() * bits + 7) / 8),
+            bits,
+            span<const color8888>(palette, pcount),
+            span<color8888>(reinterpret_cast<color8888 *>(buffer.data()),
+                            buffer.size()));
         break;
     }
     default:
         return; // Invalid format
     }
 
-    glBindTexture(GL_TEXTURE_2D, m_handle);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
     glTexImage2D(GL_TEXTURE_2D,
                  0,
                  internal_format,
@@ -243,7 +308,7 @@ void GlTexture::copy(uint16_t *width,
         *format = m_format;
     if (size)
         *size = m_pixel_data.size();
-    if (pixel_data)
+    if (pixel_data && !m_pixel_data.empty())
     {
         memcpy(pixel_data, m_pixel_data.data(), m_pixel_data.size());
     }
@@ -264,7 +329,7 @@ GlDisplayList::GlDisplayList()
     m_handle = glGenLists(1);
     if (m_handle == 0)
     {
-        std::cerr << "Failed to generate display list!" << std::endl;
+        LOG_ERROR("Failed to generate display list!");
     }
 }
 
@@ -281,26 +346,176 @@ void GlDisplayList::destroy()
 
 GLuint GlDisplayList::get_handle() const { return m_handle; }
 
+/**
+ * @brief Converts `count` consecutive `real` values at `p` to `float` in place.
+ * Only needed when `real` is not backed by `float` (e.g. fixed point).
+ */
+static void convert_reals_to_floats(uint8_t *p, size_t count)
+{
+    static_assert(sizeof(real) == sizeof(float));
+    for (size_t i = 0; i < count; ++i)
+    {
+        real r;
+        memcpy(&r, p + i * sizeof(real), sizeof(real));
+        float f = float(r);
+        memcpy(p + i * sizeof(float), &f, sizeof(float));
+    }
+}
+
+/**
+ * @brief Rewrites the four `{int16_t bone_id, ICE_R16 weight}` pairs at `p`
+ * with native-endian weights, still scaled by `ICE_SCALE`, so GL can read
+ * every pair as two `GL_SHORT`s. The ids are already native.
+ */
+static void convert_bone_weights(uint8_t *p)
+{
+    for (size_t i = 0; i < 4; ++i)
+    {
+        uint8_t *weight_ptr = p + i * 2 * sizeof(int16_t) + sizeof(int16_t);
+        ICE_R16 weight;
+        memcpy(&weight, weight_ptr, sizeof(weight));
+        const int16_t value = int16_t(weight.v);
+        memcpy(weight_ptr, &value, sizeof(value));
+    }
+}
+
+GlVertexBuffer::~GlVertexBuffer() { destroy(); }
+
+void GlVertexBuffer::destroy()
+{
+    m_data.clear();
+    m_vertex_count = 0;
+}
+
+void GlVertexBuffer::load(const vertex_layout &layout,
+                          size_t vertex_count,
+                          const void *data)
+{
+    m_layout       = layout;
+    m_vertex_count = vertex_count;
+
+    const size_t size = vertex_count * layout.stride;
+    m_data.resize(size);
+    memcpy(m_data.data(), data, size);
+
+    if constexpr (!std::is_same_v<real::storage_type, float>)
+    {
+        for (size_t i = 0; i < vertex_count; ++i)
+        {
+            uint8_t *v = m_data.data() + i * layout.stride;
+            convert_reals_to_floats(v, 3);
+            if (layout.normal_offset >= 0)
+                convert_reals_to_floats(v + layout.normal_offset, 3);
+            if (layout.color_offset >= 0)
+                convert_reals_to_floats(v + layout.color_offset, 4);
+            if (layout.texcoord_offset >= 0)
+                convert_reals_to_floats(v + layout.texcoord_offset, 2);
+        }
+    }
+
+    if (layout.boneweight_offset >= 0)
+        for (size_t i = 0; i < vertex_count; ++i)
+            convert_bone_weights(m_data.data() + i * layout.stride +
+                                 layout.boneweight_offset);
+}
+
+GlIndexBuffer::~GlIndexBuffer() { destroy(); }
+
+void GlIndexBuffer::destroy() { m_indices.clear(); }
+
+void GlIndexBuffer::load(size_t index_count, const uint16_t *indices)
+{
+    m_indices.assign(indices, indices + index_count);
+}
+
 GlGpu::GlGpu() {}
 
+/** @brief Only the lighting terms reach GL, the texture is bound apart. */
+static bool operator==(const material &a, const material &b)
+{
+    return a.ambient.value == b.ambient.value &&
+           a.diffuse.value == b.diffuse.value &&
+           a.specular.value == b.specular.value &&
+           a.emission.value == b.emission.value && a.shininess == b.shininess;
+}
+
+template <class T>
+bool GlGpu::update_state(CachedState<T> &state, const T &value)
+{
+    // Compiled into a list, not applied, so GL's state does not change.
+    if (m_compiling_list)
+    {
+        m_compiling_list->set_records_state(true);
+        ++m_state_stats.issued;
+        return true;
+    }
+
+    if (state.known && state.value == value)
+    {
+        ++m_state_stats.filtered;
+        return false;
+    }
+
+    state.value = value;
+    state.known = true;
+    ++m_state_stats.issued;
+    ++m_frame_stats.state_changes;
+    return true;
+}
+
+void GlGpu::set_capability(GLenum cap, CachedState<bool> &state, bool enabled)
+{
+    if (!update_state(state, enabled))
+        return;
+    if (enabled)
+        glEnable(cap);
+    else
+        glDisable(cap);
+}
+
+void GlGpu::invalidate_state_cache()
+{
+    m_depth_test.known   = false;
+    m_blend.known        = false;
+    m_scissor_test.known = false;
+    m_lighting.known     = false;
+    m_fog.known          = false;
+    m_texture_2d.known   = false;
+    m_blend_func.known   = false;
+    m_texture.known      = false;
+    m_shade_model.known  = false;
+    m_material.known     = false;
+}
+
 void GlGpu::new_frame()
 {
-    glEnable(GL_DEPTH_TEST);
+    m_frame_stats = {};
+    m_timers.new_frame();
+
+    enable_depth_test(true);
     glDepthFunc(GL_LESS);
-    glEnable(GL_TEXTURE_2D);
-    glDisable(GL_BLEND);
+    set_capability(GL_TEXTURE_2D, m_texture_2d, true);
+    enable_blend(false);
     glMatrixMode(GL_TEXTURE);
     glLoadIdentity();
 }
 
-void GlGpu::begin(primitive_type type) { glBegin(to_gl_primitive_type(type)); }
+void GlGpu::begin(primitive_type type)
+{
+    count_draw(0);
+    glBegin(to_gl_primitive_type(type));
+}
 void GlGpu::end() { glEnd(); }
 void GlGpu::vertex(const vec3<real> &v)
 {
+    if (!m_compiling_list)
+        ++m_frame_stats.vertices;
     glVertex3f(float(v.x), float(v.y), float(v.z));
 }
 void GlGpu::vertex(real x, real y, real z)
 {
+    if (!m_compiling_list)
+        ++m_frame_stats.vertices;
     glVertex3f(float(x), float(y), float(z));
 }
 
@@ -396,17 +611,6 @@ void GlGpu::load_matrix(const mat4<real> &m)
 void GlGpu::push_matrix() { glPushMatrix(); }
 void GlGpu::pop_matrix() { glPopMatrix(); }
 
-void GlGpu::set_shade_model(shade_model model)
-{
-    glShadeModel(to_gl_shade_model(model));
-}
-void GlGpu::enable_lighting(bool enabled)
-{
-    if (enabled)
-        glEnable(GL_LIGHTING);
-    else
-        glDisable(GL_LIGHTING);
-}
 void GlGpu::set_light(int id, const light *l)
 {
     const GLenum light_id = GL_LIGHT0 + id;
@@ -448,52 +652,416 @@ void GlGpu::set_light(int id, const light *l)
         glLightf(light_id, GL_SPOT_EXPONENT, float(l->spot_exponent));
     }
 }
+
+void GlGpu::set_shade_model(shade_model model)
+{
+    const GLenum gl_model = to_gl_shade_model(model);
+    if (update_state(m_shade_model, gl_model))
+        glShadeModel(gl_model);
+}
+
+void GlGpu::enable_lighting(bool enabled)
+{
+    set_capability(GL_LIGHTING, m_lighting, enabled);
+}
+
 void GlGpu::set_material(const material *m)
-{ /* ... implementation needed ... */ }
+{
+    // GL's initial material, for draws without one.
+    static const material default_material = {
+        .texture   = nullptr,
+        .ambient   = color5551(real(0.2f), real(0.2f), real(0.2f), real(1)),
+        .diffuse   = color5551(real(0.8f), real(0.8f), real(0.8f), real(1)),
+        .specular  = color5551(real(0), real(0), real(0), real(1)),
+        .emission  = color5551(real(0), real(0), real(0), real(1)),
+        .shininess = real(0),
+    };
+
+    const material &mat = m ? *m : default_material;
+    if (!update_state(m_material, mat))
+        return;
+
+    const auto apply = [](GLenum name, const color5551 &c)
+    {
+        const struct color f = c.as_color();
+        const float v[]      = {float(f.r), float(f.g), float(f.b), float(f.a)};
+        glMaterialfv(GL_FRONT_AND_BACK, name, v);
+    };
+    apply(GL_AMBIENT, mat.ambient);
+    apply(GL_DIFFUSE, mat.diffuse);
+    apply(GL_SPECULAR, mat.specular);
+    apply(GL_EMISSION, mat.emission);
+    glMaterialf(GL_FRONT_AND_BACK, GL_SHININESS, float(mat.shininess));
+}
+
+bool has_gl_extension(const char *name)
+{
+    const char *extensions =
+        reinterpret_cast<const char *>(glGetString(GL_EXTENSIONS));
+    const size_t length = strlen(name);
+    for (const char *at = extensions; at && (at = strstr(at, name));
+         at += length)
+    {
+        const bool starts = at == extensions || at[-1] == ' ';
+        if (starts && (at[length] == ' ' || at[length] == '\0'))
+            return true;
+    }
+    return false;
+}
+
+static GlTextureSupport probe_texture_support()
+{
+    GlTextureSupport support;
+
+    int major = 0, minor = 0;
+    const char *version =
+        reinterpret_cast<const char *>(glGetString(GL_VERSION));
+    if (version && sscanf(version, "%d.%d", &major, &minor) == 2)
+        support.packed_pixels = major > 1 || (major == 1 && minor >= 2);
+
+    if (has_gl_extension("GL_EXT_paletted_texture"))
+        support.color_table = reinterpret_cast<decltype(support.color_table)>(
+            get_proc_address("glColorTableEXT"));
+    return support;
+}
 
 texture *
 GlGpu::create_texture(uint16_t width, uint16_t height, color_format format)
 {
-    return new GlTexture(width, height, format);
+    if (!m_texture_support_probed)
+    {
+        m_texture_support_probed = true;
+        m_texture_support        = probe_texture_support();
+    }
+
+    GlTextureSupport support = m_texture_support;
+    support.keep_pixel_data  = m_keep_texture_data;
+    return new GlTexture(width, height, format, support);
 }
+
 void GlGpu::bind_texture(texture *tex)
 {
-    if (tex)
+    if (!tex)
     {
-        glBindTexture(GL_TEXTURE_2D,
-                      static_cast<GlTexture *>(tex)->get_handle());
+        unbind_texture();
+        return;
     }
-    else
+
+    set_capability(GL_TEXTURE_2D, m_texture_2d, true);
+
+    const GlTexture *gl_tex = static_cast<const GlTexture *>(tex);
+    if (update_state(m_texture, gl_tex->get_serial()))
     {
-        glBindTexture(GL_TEXTURE_2D, 0);
+        if (!m_compiling_list)
+            ++m_frame_stats.texture_binds;
+        glBindTexture(GL_TEXTURE_2D, gl_tex->get_handle());
     }
 }
-void GlGpu::unbind_texture() { glBindTexture(GL_TEXTURE_2D, 0); }
+
+void GlGpu::unbind_texture()
+{
+    set_capability(GL_TEXTURE_2D, m_texture_2d, false);
+}
 
 display_list *GlGpu::create_display_list() { return new GlDisplayList(); }
 
 void GlGpu::begin_display_list(display_list *list)
 {
-    if (!list)
-        return;
-    glNewList(static_cast<GlDisplayList *>(list)->get_handle(), GL_COMPILE);
+    m_compiling_list = static_cast<GlDisplayList *>(list);
+    m_compiling_list->set_records_state(false);
+    glNewList(m_compiling_list->get_handle(), GL_COMPILE);
 }
 
-void GlGpu::end_display_list() { glEndList(); }
+void GlGpu::end_display_list()
+{
+    glEndList();
+    m_compiling_list = nullptr;
+}
 
 void GlGpu::call_display_list(const display_list *list)
 {
-    if (!list)
+    const GlDisplayList *gl_list = static_cast<const GlDisplayList *>(list);
+    count_draw(0);
+    glCallList(gl_list->get_handle());
+    if (gl_list->records_state())
+        invalidate_state_cache();
+}
+
+vertex_buffer *GlGpu::create_vertex_buffer() { return new GlVertexBuffer(); }
+
+index_buffer *GlGpu::create_index_buffer() { return new GlIndexBuffer(); }
+
+void enable_vertex_arrays(const GlVertexBuffer &vb)
+{
+    enable_vertex_arrays(vb.get_layout(), vb.get_data());
+}
+
+void enable_vertex_arrays(const vertex_layout &layout, const uint8_t *base)
+{
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glVertexPointer(3, GL_FLOAT, layout.stride, base);
+
+    if (layout.normal_offset >= 0)
+    {
+        glEnableClientState(GL_NORMAL_ARRAY);
+        glNormalPointer(GL_FLOAT, layout.stride, base + layout.normal_offset);
+    }
+
+    if (layout.color_offset >= 0)
+    {
+        glEnableClientState(GL_COLOR_ARRAY);
+        glColorPointer(4, GL_FLOAT, layout.stride, base + layout.color_offset);
+    }
+
+    if (layout.texcoord_offset >= 0)
+    {
+        glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+        glTexCoordPointer(
+            2, GL_FLOAT, layout.stride, base + layout.texcoord_offset);
+    }
+}
+
+void disable_vertex_arrays()
+{
+    glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+    glDisableClientState(GL_COLOR_ARRAY);
+    glDisableClientState(GL_NORMAL_ARRAY);
+    glDisableClientState(GL_VERTEX_ARRAY);
+}
+
+void GlGpu::draw_indexed(primitive_type type,
+                         const vertex_buffer *vertices,
+                         const index_buffer *indices)
+{
+    if (!vertices || !indices)
         return;
-    glCallList(static_cast<const GlDisplayList *>(list)->get_handle());
+
+    auto vb = static_cast<const GlVertexBuffer *>(vertices);
+    auto ib = static_cast<const GlIndexBuffer *>(indices);
+
+    count_draw(ib->get_index_count());
+    enable_vertex_arrays(*vb);
+    glDrawElements(to_gl_primitive_type(type),
+                   (GLsizei)ib->get_index_count(),
+                   GL_UNSIGNED_SHORT,
+                   ib->get_data());
+    disable_vertex_arrays();
 }
 
-void GlGpu::enable_fog(bool enabled)
+void GlGpu::draw_indexed_range(primitive_type type,
+                               const vertex_buffer *vertices,
+                               const index_buffer *indices,
+                               size_t first_index,
+                               size_t index_count)
 {
-    if (enabled)
-        glEnable(GL_FOG);
+    if (!vertices || !indices)
+        return;
+
+    auto vb = static_cast<const GlVertexBuffer *>(vertices);
+    auto ib = static_cast<const GlIndexBuffer *>(indices);
+    if (first_index + index_count > ib->get_index_count())
+        return;
+
+    count_draw(index_count);
+    enable_vertex_arrays(*vb);
+    glDrawElements(to_gl_primitive_type(type),
+                   (GLsizei)index_count,
+                   GL_UNSIGNED_SHORT,
+                   ib->get_data() + first_index);
+    disable_vertex_arrays();
+}
+
+bool GlGpu::draw_skinned(primitive_type type,
+                         const vertex_buffer *vertices,
+                         const index_buffer *indices,
+                         const mat4<real> *palette,
+                         size_t palette_size)
+{
+    if (!vertices || !indices || !palette)
+        return false;
+
+    auto vb = static_cast<const GlVertexBuffer *>(vertices);
+    auto ib = static_cast<const GlIndexBuffer *>(indices);
+    if (vb->get_layout().boneweight_offset < 0)
+        return false;
+
+    if (!m_skinning_initialized)
+    {
+        m_skinning_initialized = true;
+        if (!m_skinning.init())
+            LOG_WARNING("GPU skinning unavailable, using CPU skinning.");
+    }
+
+    if (!m_skinning.draw(
+            to_gl_primitive_type(type), *vb, *ib, palette, palette_size))
+        return false;
+
+    count_draw(ib->get_index_count());
+    return true;
+}
+
+/**
+ * @brief Meshes up to this many vertices are instanced by merging
+ * pre-transformed copies, larger ones by one draw per instance.
+ */
+static constexpr size_t max_pretransformed_vertices = 256;
+
+/** @brief The most vertices a merged batch holds, for 16-bit indices. */
+static constexpr size_t max_batch_vertices = 65536;
+
+bool GlGpu::draw_instanced(primitive_type type,
+                           const vertex_buffer *vertices,
+                           const index_buffer *indices,
+                           const mat4<real> *model_views,
+                           size_t count)
+{
+    if (!vertices || !indices || !model_views)
+        return false;
+    if (count == 0)
+        return true;
+
+    auto vb = static_cast<const GlVertexBuffer *>(vertices);
+    auto ib = static_cast<const GlIndexBuffer *>(indices);
+
+    const GLenum mode = to_gl_primitive_type(type);
+    glMatrixMode(GL_MODELVIEW);
+    glPushMatrix();
+
+    // Strips and fans cannot be concatenated into one draw.
+    const bool mergeable =
+        mode == GL_TRIANGLES || mode == GL_LINES || mode == GL_POINTS;
+    if (mergeable && count > 1 && vb->get_vertex_count() > 0 &&
+        vb->get_vertex_count() <= max_pretransformed_vertices)
+    {
+        draw_pretransformed(mode, *vb, *ib, model_views, count);
+    }
     else
-        glDisable(GL_FOG);
+    {
+        enable_vertex_arrays(*vb);
+        for (size_t i = 0; i < count; ++i)
+        {
+            mat4<float> m = model_views[i];
+            glLoadMatrixf(&m.m00);
+            count_draw(ib->get_index_count());
+            glDrawElements(mode,
+                           (GLsizei)ib->get_index_count(),
+                           GL_UNSIGNED_SHORT,
+                           ib->get_data());
+        }
+        disable_vertex_arrays();
+    }
+
+    glPopMatrix();
+    return true;
+}
+
+/**
+ * @brief Draws small instances by copying them, transformed to eye space,
+ * into one vertex array and drawing it with an identity modelview matrix, so
+ * each batch of instances costs a single `glDrawElements`.
+ */
+void GlGpu::draw_pretransformed(GLenum mode,
+                                const GlVertexBuffer &vertices,
+                                const GlIndexBuffer &indices,
+                                const mat4<real> *model_views,
+                                size_t count)
+{
+    const vertex_layout &layout = vertices.get_layout();
+    const size_t stride         = layout.stride;
+    const size_t vertex_count   = vertices.get_vertex_count();
+    const size_t index_count    = indices.get_index_count();
+    const size_t vertex_bytes   = vertex_count * stride;
+    const size_t per_batch      = max_batch_vertices / vertex_count;
+
+    m_instance_vertices.resize(min(per_batch, count) * vertex_bytes);
+    m_instance_indices.resize(min(per_batch, count) * index_count);
+
+    glLoadIdentity();
+    enable_vertex_arrays(layout, m_instance_vertices.data());
+    for (size_t first = 0; first < count; first += per_batch)
+    {
+        const size_t batch = min(per_batch, count - first);
+        for (size_t k = 0; k < batch; ++k)
+        {
+            const mat4<float> m = model_views[first + k];
+            uint8_t *dst        = m_instance_vertices.data() + k * vertex_bytes;
+            memcpy(dst, vertices.get_data(), vertex_bytes);
+
+            for (size_t v = 0; v < vertex_count; ++v, dst += stride)
+            {
+                float p[3];
+                memcpy(p, dst, sizeof(p));
+                const float out[3] = {
+                    m.m00 * p[0] + m.m01 * p[1] + m.m02 * p[2] + m.m03,
+                    m.m10 * p[0] + m.m11 * p[1] + m.m12 * p[2] + m.m13,
+                    m.m20 * p[0] + m.m21 * p[1] + m.m22 * p[2] + m.m23};
+                memcpy(dst, out, sizeof(out));
+
+                if (layout.normal_offset < 0)
+                    continue;
+
+                // Renormalized, as GL_NORMALIZE would for scaled instances.
+                float n[3];
+                memcpy(n, dst + layout.normal_offset, sizeof(n));
+                float tn[3] = {m.m00 * n[0] + m.m01 * n[1] + m.m02 * n[2],
+                               m.m10 * n[0] + m.m11 * n[1] + m.m12 * n[2],
+                               m.m20 * n[0] + m.m21 * n[1] + m.m22 * n[2]};
+                const float len =
+                    sqrtf(tn[0] * tn[0] + tn[1] * tn[1] + tn[2] * tn[2]);
+                if (len > 0.0f)
+                    for (float &c : tn)
+                        c /= len;
+                memcpy(dst + layout.normal_offset, tn, sizeof(tn));
+            }
+
+            const uint16_t *src = indices.get_data();
+            uint16_t *out       = m_instance_indices.data() + k * index_count;
+            const size_t base   = k * vertex_count;
+            for (size_t i = 0; i < index_count; ++i)
+                out[i] = uint16_t(src[i] + base);
+        }
+
+        count_draw(batch * index_count);
+        glDrawElements(mode,
+                       (GLsizei)(batch * index_count),
+                       GL_UNSIGNED_SHORT,
+                       m_instance_indices.data());
+    }
+    disable_vertex_arrays();
+}
+
+void GlGpu::count_draw(size_t vertices)
+{
+    // Compiled into a list, counted when the list is called.
+    if (m_compiling_list)
+        return;
+    ++m_frame_stats.draw_calls;
+    m_frame_stats.vertices += vertices;
+}
+
+void GlGpu::begin_timing(const char *name)
+{
+    if (!m_timers_initialized)
+    {
+        m_timers_initialized = true;
+        if (!m_timers.init())
+            LOG_WARNING("GPU timer queries unavailable.");
+    }
+    m_timers.begin(name);
+}
+
+void GlGpu::end_timing() { m_timers.end(); }
+
+span<const gpu_timing> GlGpu::get_timings() const
+{
+    return m_timers.get_timings();
+}
+
+gpu_frame_stats GlGpu::get_frame_stats() const { return m_frame_stats; }
+
+void GlGpu::enable_fog(bool enabled)
+{
+    set_capability(GL_FOG, m_fog, enabled);
 }
 void GlGpu::set_fog_start(float start) { glFogf(GL_FOG_START, start); }
 void GlGpu::set_fog_end(float end) { glFogf(GL_FOG_END, end); }
@@ -536,34 +1104,27 @@ GLenum to_gl_blend_factor(blend_factor bf)
 
 void GlGpu::enable_depth_test(bool enabled)
 {
-    if (enabled)
-        glEnable(GL_DEPTH_TEST);
-    else
-        glDisable(GL_DEPTH_TEST);
+    set_capability(GL_DEPTH_TEST, m_depth_test, enabled);
 }
 
 void GlGpu::enable_blend(bool enabled)
 {
+    set_capability(GL_BLEND, m_blend, enabled);
     if (enabled)
-    {
-        glEnable(GL_BLEND);
-        glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    }
-    else
-        glDisable(GL_BLEND);
+        set_blend_func(blend_factor::src_alpha,
+                       blend_factor::one_minus_src_alpha);
 }
 
 void GlGpu::set_blend_func(blend_factor src, blend_factor dst)
 {
-    glBlendFunc(to_gl_blend_factor(src), to_gl_blend_factor(dst));
+    const uint32_t factors = (uint32_t(src) << 8) | uint32_t(dst);
+    if (update_state(m_blend_func, factors))
+        glBlendFunc(to_gl_blend_factor(src), to_gl_blend_factor(dst));
 }
 
 void GlGpu::enable_scissor_test(bool enabled)
 {
-    if (enabled)
-        glEnable(GL_SCISSOR_TEST);
-    else
-        glDisable(GL_SCISSOR_TEST);
+    set_capability(GL_SCISSOR_TEST, m_scissor_test, enabled);
 }
 
 void GlGpu::set_scissor(int x, int y, int width, int height)
@@ -578,30 +1139,29 @@ void GlGpu::set_viewport_rect(int x, int y, int width, int height)
 
 gpu *init_gpu()
 {
-    std::cout << "Initializing GPU..." << std::endl;
+    LOG_INFO("Initializing GPU...");
 
 #ifndef __EMSCRIPTEN__
     // GLAD is only needed for desktop OpenGL
     // Emscripten provides GL functions directly through emulation
     if (!gladLoadGLLoader((GLADloadproc)get_proc_address))
     {
-        std::cout << "gladLoadGLLoader failed, trying gladLoadGL..."
-                  << std::endl;
+        LOG_WARNING("gladLoadGLLoader failed, trying gladLoadGL...");
         if (!gladLoadGL())
         {
-            std::cerr << "Failed to load GL functions!" << std::endl;
+            LOG_ERROR("Failed to load GL functions!");
             return nullptr;
         }
     }
-    std::cout << "GL functions loaded successfully" << std::endl;
+    LOG_INFO("GL functions loaded successfully");
 #else
-    std::cout << "Emscripten: initialize_gl4es()" << std::endl;
+    LOG_INFO("Emscripten: initialize_gl4es()");
     initialize_gl4es();
 #endif
 
-    std::cout << "GL Version: " << glGetString(GL_VERSION) << std::endl;
-    std::cout << "GL Vendor: " << glGetString(GL_VENDOR) << std::endl;
-    std::cout << "GL Renderer: " << glGetString(GL_RENDERER) << std::endl;
+    LOG_INFO("GL Version: %s", (const char *)glGetString(GL_VERSION));
+    LOG_INFO("GL Vendor: %s", (const char *)glGetString(GL_VENDOR));
+    LOG_INFO("GL Renderer: %s", (const char *)glGetString(GL_RENDERER));
 
 #ifndef NDEBUG
 #ifndef __EMSCRIPTEN__
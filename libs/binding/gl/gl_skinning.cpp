@@ -0,0 +1,291 @@
+#include <zabato/gl.hpp>
+#include <zabato/log.hpp>
+#include <zabato/window.hpp>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#ifndef GL_VERTEX_SHADER
+#define GL_VERTEX_SHADER 0x8B31
+#endif
+#ifndef GL_COMPILE_STATUS
+#define GL_COMPILE_STATUS 0x8B81
+#endif
+#ifndef GL_LINK_STATUS
+#define GL_LINK_STATUS 0x8B82
+#endif
+#ifndef GL_INFO_LOG_LENGTH
+#define GL_INFO_LOG_LENGTH 0x8B84
+#endif
+#ifndef GL_MAX_VERTEX_UNIFORM_COMPONENTS
+#define GL_MAX_VERTEX_UNIFORM_COMPONENTS 0x8B4A
+#endif
+
+namespace zabato
+{
+namespace
+{
+/** @brief GL 2.0 entry points needed by the skinning program. */
+struct gl2_functions
+{
+    GLuint(APIENTRY *create_shader)(GLenum);
+    void(APIENTRY *shader_source)(GLuint,
+                                  GLsizei,
+                                  const GLchar *const *,
+                                  const GLint *);
+    void(APIENTRY *compile_shader)(GLuint);
+    void(APIENTRY *get_shader_iv)(GLuint, GLenum, GLint *);
+    void(APIENTRY *get_shader_info_log)(GLuint, GLsizei, GLsizei *, GLchar *);
+    void(APIENTRY *delete_shader)(GLuint);
+    GLuint(APIENTRY *create_program)();
+    void(APIENTRY *attach_shader)(GLuint, GLuint);
+    void(APIENTRY *link_program)(GLuint);
+    void(APIENTRY *get_program_iv)(GLuint, GLenum, GLint *);
+    void(APIENTRY *get_program_info_log)(GLuint, GLsizei, GLsizei *, GLchar *);
+    void(APIENTRY *delete_program)(GLuint);
+    void(APIENTRY *use_program)(GLuint);
+    GLint(APIENTRY *get_uniform_location)(GLuint, const GLchar *);
+    GLint(APIENTRY *get_attrib_location)(GLuint, const GLchar *);
+    void(APIENTRY *uniform_1i)(GLint, GLint);
+    void(APIENTRY *uniform_matrix_4fv)(GLint,
+                                       GLsizei,
+                                       GLboolean,
+                                       const GLfloat *);
+    void(APIENTRY *vertex_attrib_pointer)(
+        GLuint, GLint, GLenum, GLboolean, GLsizei, const void *);
+    void(APIENTRY *enable_vertex_attrib_array)(GLuint);
+    void(APIENTRY *disable_vertex_attrib_array)(GLuint);
+};
+
+gl2_functions gl2 = {};
+
+template <typename T> bool load_proc(T &fn, const char *name)
+{
+    fn = reinterpret_cast<T>(get_proc_address(name));
+    return fn != nullptr;
+}
+
+bool load_gl2_functions()
+{
+    bool ok = true;
+    ok &= load_proc(gl2.create_shader, "glCreateShader");
+    ok &= load_proc(gl2.shader_source, "glShaderSource");
+    ok &= load_proc(gl2.compile_shader, "glCompileShader");
+    ok &= load_proc(gl2.get_shader_iv, "glGetShaderiv");
+    ok &= load_proc(gl2.get_shader_info_log, "glGetShaderInfoLog");
+    ok &= load_proc(gl2.delete_shader, "glDeleteShader");
+    ok &= load_proc(gl2.create_program, "glCreateProgram");
+    ok &= load_proc(gl2.attach_shader, "glAttachShader");
+    ok &= load_proc(gl2.link_program, "glLinkProgram");
+    ok &= load_proc(gl2.get_program_iv, "glGetProgramiv");
+    ok &= load_proc(gl2.get_program_info_log, "glGetProgramInfoLog");
+    ok &= load_proc(gl2.delete_program, "glDeleteProgram");
+    ok &= load_proc(gl2.use_program, "glUseProgram");
+    ok &= load_proc(gl2.get_uniform_location, "glGetUniformLocation");
+    ok &= load_proc(gl2.get_attrib_location, "glGetAttribLocation");
+    ok &= load_proc(gl2.uniform_1i, "glUniform1i");
+    ok &= load_proc(gl2.uniform_matrix_4fv, "glUniformMatrix4fv");
+    ok &= load_proc(gl2.vertex_attrib_pointer, "glVertexAttribPointer");
+    ok &= load_proc(gl2.enable_vertex_attrib_array,
+                    "glEnableVertexAttribArray");
+    ok &= load_proc(gl2.disable_vertex_attrib_array,
+                    "glDisableVertexAttribArray");
+    return ok;
+}
+
+/** @return The major version of the current context, parsed from GL_VERSION. */
+int gl_major_version()
+{
+    const char *version =
+        reinterpret_cast<const char *>(glGetString(GL_VERSION));
+    return version ? atoi(version) : 0;
+}
+
+// Bone weights are four {int16 bone_id, int16 weight} pairs, the weights made
+// native by GlVertexBuffer::load, read as two GL_SHORT vec4 attributes:
+// (id0, w0, id1, w1) and (id2, w2, id3, w3).
+const char *const skinning_vertex_source = R"(
+uniform mat4 u_bones[MAX_BONES];
+uniform bool u_lighting;
+attribute vec4 a_bones01;
+attribute vec4 a_bones23;
+
+mat4 influence(float id, float weight)
+{
+    if (id < 0.0 || weight <= 0.0)
+        return mat4(0.0);
+    return u_bones[int(min(id, float(MAX_BONES - 1)))] * weight;
+}
+
+void main()
+{
+    float w0 = a_bones01.y / WEIGHT_SCALE;
+    float w1 = a_bones01.w / WEIGHT_SCALE;
+    float w2 = a_bones23.y / WEIGHT_SCALE;
+    float w3 = a_bones23.w / WEIGHT_SCALE;
+
+    mat4 skin = influence(a_bones01.x, w0) + influence(a_bones01.z, w1) +
+                influence(a_bones23.x, w2) + influence(a_bones23.z, w3);
+    float total = max(w0, 0.0) + max(w1, 0.0) + max(w2, 0.0) + max(w3, 0.0);
+    if (total > 0.0)
+        skin = skin * (1.0 / total);
+    else
+        skin = mat4(1.0);
+
+    vec4 position = skin * gl_Vertex;
+    vec3 normal   = (skin * vec4(gl_Normal, 0.0)).xyz;
+    vec4 eye      = gl_ModelViewMatrix * position;
+
+    vec4 color = gl_Color;
+    if (u_lighting)
+    {
+        vec3 n = normalize(gl_NormalMatrix * normal);
+        vec3 l = gl_LightSource[0].position.w == 0.0
+                     ? normalize(gl_LightSource[0].position.xyz)
+                     : normalize(gl_LightSource[0].position.xyz - eye.xyz);
+        float diffuse = max(dot(n, l), 0.0);
+        color.rgb *= (gl_LightSource[0].ambient.rgb +
+                      gl_LightSource[0].diffuse.rgb * diffuse);
+    }
+
+    gl_Position     = gl_ModelViewProjectionMatrix * position;
+    gl_FrontColor   = color;
+    gl_TexCoord[0]  = gl_TextureMatrix[0] * gl_MultiTexCoord0;
+    gl_FogFragCoord = abs(eye.z);
+}
+)";
+
+GLuint compile_vertex_shader(size_t max_bones)
+{
+    char header[128];
+    snprintf(header,
+             sizeof(header),
+             "#version 110\n#define MAX_BONES %d\n#define WEIGHT_SCALE %.1f\n",
+             (int)max_bones,
+             float(ICE_SCALE));
+
+    const GLchar *sources[] = {header, skinning_vertex_source};
+
+    GLuint shader = gl2.create_shader(GL_VERTEX_SHADER);
+    gl2.shader_source(shader, 2, sources, nullptr);
+    gl2.compile_shader(shader);
+
+    GLint status = 0;
+    gl2.get_shader_iv(shader, GL_COMPILE_STATUS, &status);
+    if (!status)
+    {
+        char log[1024] = {};
+        gl2.get_shader_info_log(shader, sizeof(log), nullptr, log);
+        LOG_ERROR("Skinning shader failed to compile: %s", log);
+        gl2.delete_shader(shader);
+        return 0;
+    }
+    return shader;
+}
+} // namespace
+
+GlSkinningProgram::~GlSkinningProgram()
+{
+    if (m_program && gl2.delete_program)
+        gl2.delete_program(m_program);
+}
+
+bool GlSkinningProgram::init()
+{
+#ifdef __EMSCRIPTEN__
+    return false;
+#else
+    if (m_program)
+        return true;
+
+    if (gl_major_version() < 2 || !load_gl2_functions())
+        return false;
+
+    // Leave room for the built-in matrices and light state.
+    GLint components = 0;
+    glGetIntegerv(GL_MAX_VERTEX_UNIFORM_COMPONENTS, &components);
+    const size_t max_bones = components > 128 ? (components - 128) / 16 : 0;
+    if (max_bones == 0)
+        return false;
+
+    const size_t bones = min(max_bones, (size_t)128);
+    GLuint shader      = compile_vertex_shader(bones);
+    if (!shader)
+        return false;
+
+    GLuint program = gl2.create_program();
+    gl2.attach_shader(program, shader);
+    gl2.link_program(program);
+    gl2.delete_shader(shader);
+
+    GLint status = 0;
+    gl2.get_program_iv(program, GL_LINK_STATUS, &status);
+    if (!status)
+    {
+        char log[1024] = {};
+        gl2.get_program_info_log(program, sizeof(log), nullptr, log);
+        LOG_ERROR("Skinning program failed to link: %s", log);
+        gl2.delete_program(program);
+        return false;
+    }
+
+    m_program           = program;
+    m_max_bones         = bones;
+    m_bones_location    = gl2.get_uniform_location(program, "u_bones");
+    m_lighting_location = gl2.get_uniform_location(program, "u_lighting");
+    m_bones01_location  = gl2.get_attrib_location(program, "a_bones01");
+    m_bones23_location  = gl2.get_attrib_location(program, "a_bones23");
+    return true;
+#endif
+}
+
+bool GlSkinningProgram::draw(GLenum mode,
+                             const GlVertexBuffer &vertices,
+                             const GlIndexBuffer &indices,
+                             const mat4<real> *palette,
+                             size_t palette_size)
+{
+    if (!m_program || palette_size == 0 || palette_size > m_max_bones)
+        return false;
+
+    const vertex_layout &layout = vertices.get_layout();
+    if (layout.boneweight_offset < 0 || m_bones01_location < 0 ||
+        m_bones23_location < 0)
+        return false;
+
+    m_palette.resize(palette_size * 16);
+    for (size_t i = 0; i < palette_size; ++i)
+    {
+        mat4<float> m = palette[i];
+        memcpy(m_palette.data() + i * 16, &m.m00, 16 * sizeof(float));
+    }
+
+    gl2.use_program(m_program);
+    gl2.uniform_matrix_4fv(
+        m_bones_location, (GLsizei)palette_size, GL_FALSE, m_palette.data());
+    gl2.uniform_1i(m_lighting_location, glIsEnabled(GL_LIGHTING) ? 1 : 0);
+
+    const uint8_t *weights = vertices.get_data() + layout.boneweight_offset;
+    const GLuint bones01   = (GLuint)m_bones01_location;
+    const GLuint bones23   = (GLuint)m_bones23_location;
+
+    enable_vertex_arrays(vertices);
+    gl2.enable_vertex_attrib_array(bones01);
+    gl2.enable_vertex_attrib_array(bones23);
+    gl2.vertex_attrib_pointer(
+        bones01, 4, GL_SHORT, GL_FALSE, layout.stride, weights);
+    gl2.vertex_attrib_pointer(
+        bones23, 4, GL_SHORT, GL_FALSE, layout.stride, weights + 8);
+
+    glDrawElements(mode,
+                   (GLsizei)indices.get_index_count(),
+                   GL_UNSIGNED_SHORT,
+                   indices.get_data());
+
+    gl2.disable_vertex_attrib_array(bones23);
+    gl2.disable_vertex_attrib_array(bones01);
+    disable_vertex_arrays();
+    gl2.use_program(0);
+    return true;
+}
+} // namespace zabato
@@ -0,0 +1,149 @@
+#include <zabato/gl.hpp>
+#include <zabato/window.hpp>
+
+#include <stdio.h>
+
+#ifndef GL_QUERY_RESULT
+#define GL_QUERY_RESULT 0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE
+#define GL_QUERY_RESULT_AVAILABLE 0x8867
+#endif
+#ifndef GL_TIMESTAMP
+#define GL_TIMESTAMP 0x8E28
+#endif
+
+namespace zabato
+{
+namespace
+{
+/** @brief GL 3.3 / ARB_timer_query entry points needed by the timer. */
+struct timer_functions
+{
+    void(APIENTRY *gen_queries)(GLsizei, GLuint *);
+    void(APIENTRY *delete_queries)(GLsizei, const GLuint *);
+    void(APIENTRY *query_counter)(GLuint, GLenum);
+    void(APIENTRY *get_query_object_iv)(GLuint, GLenum, GLint *);
+    void(APIENTRY *get_query_object_ui64v)(GLuint, GLenum, uint64_t *);
+};
+
+timer_functions gl_timer = {};
+
+template <typename T> bool load_proc(T &fn, const char *name)
+{
+    fn = reinterpret_cast<T>(get_proc_address(name));
+    return fn != nullptr;
+}
+
+bool load_timer_functions()
+{
+    bool ok = true;
+    ok &= load_proc(gl_timer.gen_queries, "glGenQueries");
+    ok &= load_proc(gl_timer.delete_queries, "glDeleteQueries");
+    ok &= load_proc(gl_timer.query_counter, "glQueryCounter");
+    ok &= load_proc(gl_timer.get_query_object_iv, "glGetQueryObjectiv");
+    ok &= load_proc(gl_timer.get_query_object_ui64v, "glGetQueryObjectui64v");
+    return ok;
+}
+
+/** @return Whether the context has timestamp queries. */
+bool has_timer_queries()
+{
+    int major = 0, minor = 0;
+    const char *version =
+        reinterpret_cast<const char *>(glGetString(GL_VERSION));
+    if (version && sscanf(version, "%d.%d", &major, &minor) == 2 &&
+        (major > 3 || (major == 3 && minor >= 3)))
+        return true;
+    return has_gl_extension("GL_ARB_timer_query");
+}
+} // namespace
+
+GlTimerQueries::~GlTimerQueries()
+{
+    if (!m_available)
+        return;
+    for (frame &f : m_frames)
+        gl_timer.delete_queries(GLsizei(2 * max_scopes), f.queries);
+}
+
+bool GlTimerQueries::init()
+{
+    if (!has_timer_queries() || !load_timer_functions())
+        return false;
+
+    for (frame &f : m_frames)
+        gl_timer.gen_queries(GLsizei(2 * max_scopes), f.queries);
+    m_available = true;
+    return true;
+}
+
+void GlTimerQueries::begin(const char *name)
+{
+    if (!m_available)
+        return;
+
+    frame &f = m_frames[m_frame];
+    if (f.scope_count == max_scopes)
+    {
+        m_open.push_back(max_scopes);
+        return;
+    }
+
+    const size_t scope = f.scope_count++;
+    f.names[scope]     = name;
+    f.depths[scope]    = uint32_t(m_open.size());
+    gl_timer.query_counter(f.queries[2 * scope], GL_TIMESTAMP);
+    m_open.push_back(scope);
+}
+
+void GlTimerQueries::end()
+{
+    if (!m_available || m_open.empty())
+        return;
+
+    const size_t scope = m_open.back();
+    m_open.pop_back();
+    if (scope < max_scopes)
+        gl_timer.query_counter(m_frames[m_frame].queries[2 * scope + 1],
+                               GL_TIMESTAMP);
+}
+
+void GlTimerQueries::new_frame()
+{
+    if (!m_available)
+        return;
+
+    while (!m_open.empty())
+        end();
+
+    m_frame  = (m_frame + 1) % frame_latency;
+    frame &f = m_frames[m_frame];
+
+    // A frame the GPU is still behind is dropped rather than waited for, the
+    // last timings read stay.
+    bool ready = f.scope_count > 0;
+    for (size_t i = 0; ready && i < 2 * f.scope_count; ++i)
+    {
+        GLint available = 0;
+        gl_timer.get_query_object_iv(
+            f.queries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        ready = available != 0;
+    }
+
+    if (ready)
+    {
+        m_timings.resize(f.scope_count);
+        for (size_t i = 0; i < f.scope_count; ++i)
+        {
+            uint64_t start = 0, stop = 0;
+            gl_timer.get_query_object_ui64v(
+                f.queries[2 * i], GL_QUERY_RESULT, &start);
+            gl_timer.get_query_object_ui64v(
+                f.queries[2 * i + 1], GL_QUERY_RESULT, &stop);
+            m_timings[i] = {f.names[i], f.depths[i], stop - start};
+        }
+    }
+    f.scope_count = 0;
+}
+} // namespace zabato
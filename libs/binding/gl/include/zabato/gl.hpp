@@ -16,10 +16,47 @@ GLenum to_gl_primitive_type(primitive_type pt);
 GLenum to_gl_matrix_mode(matrix_mode mm);
 GLenum to_gl_shade_model(shade_model sm);
 
+/** @return Whether the context advertises `name` in its extension string. */
+bool has_gl_extension(const char *name);
+
+/**
+ * @struct GlTextureSupport
+ * @brief How `GlTexture` can upload each color format, probed by `GlGpu`.
+ */
+struct GlTextureSupport
+{
+    /** GL 1.2 packed pixel types, so 16-bit formats upload as they are. */
+    bool packed_pixels = false;
+
+    /**
+     * `glColorTableEXT` of EXT_paletted_texture, so palette formats upload as
+     * indices looked up in the palette by GL. Null when unsupported.
+     */
+    void(APIENTRY *color_table)(
+        GLenum, GLenum, GLsizei, GLenum, GLenum, const void *) = nullptr;
+
+    /** Whether textures keep a copy of their pixel data, for `copy`. */
+    bool keep_pixel_data = false;
+};
+
+/**
+ * @class GlTexture
+ * @brief A GL texture that keeps its color format on the GPU when the context
+ * allows it.
+ *
+ * rgba5551 and rgba4444 upload as 16-bit pixels on GL 1.2+, and palette
+ * formats as 8 or 4-bit indices with the palette as the texture's color table
+ * where EXT_paletted_texture is available. Anything else is expanded to RGBA8
+ * on the CPU. The pixel data is only kept when `GlTextureSupport` asks for it,
+ * `copy` otherwise reports a size of 0.
+ */
 class GlTexture : public texture
 {
 public:
-    GlTexture(uint16_t width, uint16_t height, color_format format);
+    GlTexture(uint16_t width,
+              uint16_t height,
+              color_format format,
+              const GlTextureSupport &support = {});
     ~GlTexture() override;
 
     void destroy() override;
@@ -37,18 +74,168 @@ public:
 
     GLuint get_handle() const { return m_handle; }
 
+    /**
+     * @return A number no other texture ever had. GL reuses deleted handles,
+     * so the state cache tells textures apart by this instead.
+     */
+    uint32_t get_serial() const { return m_serial; }
+
     color_format get_format() const override;
 
     vec2<uint16_t> get_size() const override;
 
 private:
+    /** @brief Uploads palette indices and the palette, false if unsupported. */
+    bool upload_indexed(const uint8_t *data);
+
+    /** @brief Uploads the pixels expanded to RGBA8. */
+    void upload_expanded(const uint8_t *data);
+
     GLuint m_handle = 0;
+    uint32_t m_serial;
     uint16_t m_width;
     uint16_t m_height;
     color_format m_format;
-    vector<uint8_t> m_pixel_data;
+    GlTextureSupport m_support;
+    vector<uint8_t, gpu_shadow_allocator<uint8_t>> m_pixel_data;
 };
 
+class GlDisplayList;
+class GlVertexBuffer;
+class GlIndexBuffer;
+
+/**
+ * @class GlSkinningProgram
+ * @brief GLSL 1.10 vertex program that blends up to four bones per vertex.
+ *
+ * The loader only exposes GL 1.1, so the shader entry points are resolved at
+ * runtime through `get_proc_address` and the program is only available on
+ * GL 2.0+ contexts. It replaces the fixed-function vertex stage only, so
+ * texturing and fog still go through fixed-function fragment processing.
+ */
+class GlSkinningProgram
+{
+public:
+    GlSkinningProgram() = default;
+    ~GlSkinningProgram();
+
+    /**
+     * @brief Loads the entry points and compiles the program.
+     * @return False if the context cannot run the program.
+     */
+    bool init();
+
+    /** @return The largest palette the program can take, 0 if unavailable. */
+    size_t get_max_bones() const { return m_max_bones; }
+
+    /**
+     * @brief Draws indexed primitives with GPU skinning.
+     * @return False if the program is unavailable or the palette too large.
+     */
+    bool draw(GLenum mode,
+              const GlVertexBuffer &vertices,
+              const GlIndexBuffer &indices,
+              const mat4<real> *palette,
+              size_t palette_size);
+
+private:
+    GLuint m_program          = 0;
+    GLint m_bones_location    = -1;
+    GLint m_lighting_location = -1;
+    GLint m_bones01_location  = -1;
+    GLint m_bones23_location  = -1;
+    size_t m_max_bones        = 0;
+    vector<float> m_palette;
+};
+
+/**
+ * @class GlTimerQueries
+ * @brief Times scopes of GPU work with `GL_TIMESTAMP` queries, of GL 3.3 or
+ * ARB_timer_query.
+ *
+ * Every scope writes a timestamp as it opens and as it closes, so scopes
+ * nest, which `GL_TIME_ELAPSED` queries cannot. Each frame has its own set
+ * of queries, read back when the set comes round again `frame_latency`
+ * frames later and only once the GPU has passed all of them, so reading
+ * never stalls. The entry points are resolved like `GlSkinningProgram`'s.
+ */
+class GlTimerQueries
+{
+public:
+    /** @brief The frames in flight, each with its own queries. */
+    static constexpr size_t frame_latency = 2;
+
+    /** @brief The scopes timed per frame, later ones are left out. */
+    static constexpr size_t max_scopes = 64;
+
+    GlTimerQueries() = default;
+    ~GlTimerQueries();
+
+    /**
+     * @brief Loads the entry points and creates the queries.
+     * @return False if the context cannot time the GPU, in which case the
+     * other calls do nothing.
+     */
+    bool init();
+
+    void begin(const char *name);
+    void end();
+
+    /**
+     * @brief Closes the scopes left open, and reads back the oldest frame if
+     * the GPU is done with it before recording over its queries.
+     */
+    void new_frame();
+
+    /** @return The scopes of the latest frame read back. */
+    span<const gpu_timing> get_timings() const
+    {
+        return span<const gpu_timing>(m_timings.data(), m_timings.size());
+    }
+
+private:
+    struct frame
+    {
+        GLuint queries[2 * max_scopes]; ///< Opening and closing timestamps.
+        const char *names[max_scopes];
+        uint32_t depths[max_scopes];
+        size_t scope_count;
+    };
+
+    frame m_frames[frame_latency] = {};
+    size_t m_frame                = 0;
+    bool m_available              = false;
+
+    /** @brief The open scopes of the frame, `max_scopes` if not timed. */
+    vector<size_t> m_open;
+    vector<gpu_timing> m_timings;
+};
+
+/**
+ * @struct GlStateStats
+ * @brief State changes `GlGpu` sent to GL, and the ones it dropped because GL
+ * was already in that state.
+ */
+struct GlStateStats
+{
+    size_t issued   = 0;
+    size_t filtered = 0;
+};
+
+/**
+ * @class GlGpu
+ * @brief The fixed-function GL backend.
+ *
+ * Capabilities, the blend function, the bound texture, the shade model and
+ * the material are shadowed, so setting a state GL already has costs no GL
+ * call. State set while compiling a display list is recorded rather than
+ * applied, so it bypasses the cache, and calling a list that recorded state
+ * forgets the cache.
+ *
+ * The frame statistics count the states and texture binds that reach GL
+ * past the cache, and leave out what is compiled into display lists, which
+ * counts when the list is called.
+ */
 class GlGpu : public gpu
 {
 public:
@@ -104,6 +291,32 @@ public:
     void end_display_list() override;
     void call_display_list(const display_list *list) override;
 
+    vertex_buffer *create_vertex_buffer() override;
+    index_buffer *create_index_buffer() override;
+    void draw_indexed(primitive_type type,
+                      const vertex_buffer *vertices,
+                      const index_buffer *indices) override;
+    void draw_indexed_range(primitive_type type,
+                            const vertex_buffer *vertices,
+                            const index_buffer *indices,
+                            size_t first_index,
+                            size_t index_count) override;
+    bool draw_skinned(primitive_type type,
+                      const vertex_buffer *vertices,
+                      const index_buffer *indices,
+                      const mat4<real> *palette,
+                      size_t palette_size) override;
+    bool draw_instanced(primitive_type type,
+                        const vertex_buffer *vertices,
+                        const index_buffer *indices,
+                        const mat4<real> *model_views,
+                        size_t count) override;
+
+    void begin_timing(const char *name) override;
+    void end_timing() override;
+    span<const gpu_timing> get_timings() const override;
+    gpu_frame_stats get_frame_stats() const override;
+
     void enable_fog(bool enabled) override;
     void set_fog_start(float start) override;
     void set_fog_end(float end) override;
@@ -115,6 +328,72 @@ public:
     void enable_scissor_test(bool enabled) override;
     void set_scissor(int x, int y, int width, int height) override;
     void set_viewport_rect(int x, int y, int width, int height) override;
+
+    /**
+     * @brief Forgets the shadowed state, so the next change of every state
+     * reaches GL. Call after code outside `GlGpu` touched GL state.
+     */
+    void invalidate_state_cache();
+
+    /**
+     * @brief Sets whether textures created afterwards keep a copy of their
+     * pixel data, so `texture::copy` can return it, off by default.
+     */
+    void set_keep_texture_data(bool keep) { m_keep_texture_data = keep; }
+
+    /** @return The state changes sent and dropped since the last reset. */
+    const GlStateStats &get_state_stats() const { return m_state_stats; }
+    void reset_state_stats() { m_state_stats = {}; }
+
+private:
+    /** @brief The value GL holds for a state, if known. */
+    template <class T> struct CachedState
+    {
+        T value    = {};
+        bool known = false;
+    };
+
+    /** @return Whether `value` must be sent to GL, counting the outcome. */
+    template <class T> bool update_state(CachedState<T> &state, const T &value);
+
+    void set_capability(GLenum cap, CachedState<bool> &state, bool enabled);
+
+    /** @brief Counts a draw of `vertices` vertices sent to GL. */
+    void count_draw(size_t vertices);
+
+    void draw_pretransformed(GLenum mode,
+                             const GlVertexBuffer &vertices,
+                             const GlIndexBuffer &indices,
+                             const mat4<real> *model_views,
+                             size_t count);
+
+    GlSkinningProgram m_skinning;
+    bool m_skinning_initialized = false;
+
+    GlTimerQueries m_timers;
+    bool m_timers_initialized = false;
+    gpu_frame_stats m_frame_stats;
+
+    GlTextureSupport m_texture_support;
+    bool m_texture_support_probed = false;
+    bool m_keep_texture_data      = false;
+
+    CachedState<bool> m_depth_test;
+    CachedState<bool> m_blend;
+    CachedState<bool> m_scissor_test;
+    CachedState<bool> m_lighting;
+    CachedState<bool> m_fog;
+    CachedState<bool> m_texture_2d;
+    CachedState<uint32_t> m_blend_func; ///< Source and destination factors.
+    CachedState<uint32_t> m_texture;    ///< Serial of the bound texture.
+    CachedState<GLenum> m_shade_model;
+    CachedState<material> m_material;
+    GlDisplayList *m_compiling_list = nullptr;
+    GlStateStats m_state_stats;
+
+    /** @brief Instances merged by `draw_pretransformed`, reused every call. */
+    vector<uint8_t, gpu_shadow_allocator<uint8_t>> m_instance_vertices;
+    vector<uint16_t, gpu_shadow_allocator<uint16_t>> m_instance_indices;
 };
 
 /**
@@ -129,8 +408,77 @@ public:
     void destroy() override final;
     GLuint get_handle() const;
 
+    /** @return Whether the list sets state, leaving GL's state unknown. */
+    bool records_state() const { return m_records_state; }
+    void set_records_state(bool records) { m_records_state = records; }
+
 private:
-    GLuint m_handle = 0;
+    GLuint m_handle      = 0;
+    bool m_records_state = false;
 };
 
+/**
+ * @class GlVertexBuffer
+ * @brief Concrete implementation of `vertex_buffer` for OpenGL.
+ *
+ * The context only exposes GL 1.1, so the vertices are retained as a
+ * client-side array already converted to `GL_FLOAT`, with native-endian bone
+ * weights, and handed to `glDrawElements` through `glVertexPointer` and
+ * friends.
+ */
+class GlVertexBuffer : public vertex_buffer
+{
+public:
+    GlVertexBuffer() = default;
+    virtual ~GlVertexBuffer();
+    void destroy() override final;
+    void load(const vertex_layout &layout,
+              size_t vertex_count,
+              const void *data) override;
+    size_t get_vertex_count() const override { return m_vertex_count; }
+
+    const uint8_t *get_data() const { return m_data.data(); }
+    const vertex_layout &get_layout() const { return m_layout; }
+
+private:
+    vector<uint8_t, gpu_shadow_allocator<uint8_t>> m_data;
+    vertex_layout m_layout = {};
+    size_t m_vertex_count  = 0;
+};
+
+/**
+ * @class GlIndexBuffer
+ * @brief Concrete implementation of `index_buffer` for OpenGL.
+ */
+class GlIndexBuffer : public index_buffer
+{
+public:
+    GlIndexBuffer() = default;
+    virtual ~GlIndexBuffer();
+    void destroy() override final;
+    void load(size_t index_count, const uint16_t *indices) override;
+    size_t get_index_count() const override { return m_indices.size(); }
+
+    const uint16_t *get_data() const { return m_indices.data(); }
+
+private:
+    vector<uint16_t, gpu_shadow_allocator<uint16_t>> m_indices;
+};
+
+/**
+ * @brief Points the fixed-function client arrays at a vertex buffer.
+ */
+void enable_vertex_arrays(const GlVertexBuffer &vb);
+
+/**
+ * @brief Points the fixed-function client arrays at interleaved `GL_FLOAT`
+ * vertices laid out as `layout`.
+ */
+void enable_vertex_arrays(const vertex_layout &layout, const uint8_t *base);
+
+/**
+ * @brief Disables every client array enabled by `enable_vertex_arrays`.
+ */
+void disable_vertex_arrays();
+
 } // namespace zabato
\ No newline at end of file
@@ -1,7 +1,7 @@
 target("zabato_gl")
     set_kind("static")
     set_languages("c++23")
-    add_files("gl.cpp")
+    add_files("gl.cpp", "gl_skinning.cpp", "gl_timer.cpp")
     add_includedirs("include", {public = true})
     add_deps("zabato")
     
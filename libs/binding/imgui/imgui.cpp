@@ -1,8 +1,11 @@
 #include <zabato/gpu.hpp>
 #include <zabato/imgui.hpp>
+#include <zabato/log.hpp>
 #include <zabato/vector.hpp>
 #include <zabato/window.hpp>
 
+#include <stddef.h>
+
 namespace
 {
 zabato::window *g_window                    = nullptr;
@@ -11,6 +14,121 @@ zabato::texture *g_font_texture             = nullptr;
 uint64_t g_time                             = 0;
 zabato::window_flags g_backend_window_flags = zabato::window_flags::none;
 
+/** @brief A vertex of `ImDrawVert` converted to the engine's layout. */
+struct ui_vertex
+{
+    zabato::vec3<zabato::real> position;
+    zabato::color color;
+    zabato::vec2<zabato::real> uv;
+};
+
+static_assert(sizeof(ImDrawIdx) == sizeof(uint16_t),
+              "Index buffers hold 16-bit indices.");
+
+// Streaming buffers every draw list is uploaded into, null on GPUs without
+// retained geometry.
+bool g_streaming_checked               = false;
+zabato::vertex_buffer *g_vertex_buffer = nullptr;
+zabato::index_buffer *g_index_buffer   = nullptr;
+zabato::vector<ui_vertex> g_vertices;
+
+zabato::color to_color(ImU32 col)
+{
+    const zabato::real scale = zabato::real(1.0f) / zabato::real(255.0f);
+    return zabato::color(
+        (zabato::real)((col >> IM_COL32_R_SHIFT) & 0xFF) * scale,
+        (zabato::real)((col >> IM_COL32_G_SHIFT) & 0xFF) * scale,
+        (zabato::real)((col >> IM_COL32_B_SHIFT) & 0xFF) * scale,
+        (zabato::real)((col >> IM_COL32_A_SHIFT) & 0xFF) * scale);
+}
+
+void create_streaming_buffers()
+{
+    g_streaming_checked = true;
+    g_vertex_buffer     = g_gpu->create_vertex_buffer();
+    g_index_buffer      = g_gpu->create_index_buffer();
+    if (g_vertex_buffer && g_index_buffer)
+        return;
+
+    delete g_vertex_buffer;
+    delete g_index_buffer;
+    g_vertex_buffer = nullptr;
+    g_index_buffer  = nullptr;
+}
+
+void destroy_streaming_buffers()
+{
+    if (g_vertex_buffer)
+    {
+        g_vertex_buffer->destroy();
+        delete g_vertex_buffer;
+        g_vertex_buffer = nullptr;
+    }
+
+    if (g_index_buffer)
+    {
+        g_index_buffer->destroy();
+        delete g_index_buffer;
+        g_index_buffer = nullptr;
+    }
+
+    g_vertices.clear();
+    g_streaming_checked = false;
+}
+
+/**
+ * @brief Uploads a draw list's vertices and indices into the streaming
+ * buffers, replacing the previous list while keeping their storage.
+ * @return False if the GPU has no retained geometry.
+ */
+bool upload_draw_list(const ImDrawList *cmd_list)
+{
+    if (!g_vertex_buffer || !g_index_buffer)
+        return false;
+
+    const int vertex_count = cmd_list->VtxBuffer.Size;
+    g_vertices.resize(vertex_count);
+    for (int i = 0; i < vertex_count; ++i)
+    {
+        const ImDrawVert &v = cmd_list->VtxBuffer.Data[i];
+        ui_vertex &out      = g_vertices[i];
+        out.position.x      = zabato::real(v.pos.x);
+        out.position.y      = zabato::real(v.pos.y);
+        out.position.z      = zabato::real(0);
+        out.color           = to_color(v.col);
+        out.uv.x            = zabato::real(v.uv.x);
+        out.uv.y            = zabato::real(v.uv.y);
+    }
+
+    zabato::vertex_layout layout;
+    layout.stride          = sizeof(ui_vertex);
+    layout.color_offset    = offsetof(ui_vertex, color);
+    layout.texcoord_offset = offsetof(ui_vertex, uv);
+    g_vertex_buffer->load(layout, vertex_count, g_vertices.data());
+    g_index_buffer->load(cmd_list->IdxBuffer.Size, cmd_list->IdxBuffer.Data);
+    return true;
+}
+
+/** @brief Draws a command vertex by vertex, for GPUs without retained
+ * geometry. */
+void render_immediate(const ImDrawList *cmd_list, const ImDrawCmd *pcmd)
+{
+    const ImDrawVert *vtx_buffer = cmd_list->VtxBuffer.Data;
+    const ImDrawIdx *idx_buffer  = cmd_list->IdxBuffer.Data;
+
+    g_gpu->begin(zabato::primitive_type::triangles);
+    for (unsigned int i = 0; i < pcmd->ElemCount; i++)
+    {
+        ImDrawIdx idx       = idx_buffer[pcmd->IdxOffset + i];
+        const ImDrawVert &v = vtx_buffer[idx];
+
+        g_gpu->color(to_color(v.col));
+        g_gpu->tex_coord(v.uv.x, v.uv.y);
+        g_gpu->vertex(v.pos.x, v.pos.y, 0.0f);
+    }
+    g_gpu->end();
+}
+
 void update_modifiers(zabato::modifier_keys mods)
 {
     ImGuiIO &io = ImGui::GetIO();
@@ -300,9 +418,12 @@ void mouse_button_cb(zabato::window *w,
     else if (button == zabato::mouse_button::middle)
         imgui_button = 2;
 
-    std::cout << "[ImGui] Mouse Button: " << (int)button
-              << " Action: " << (int)action << " ImGuiBtn: " << imgui_button
-              << " Pos: " << io.MousePos.x << "," << io.MousePos.y << std::endl;
+    LOG_TRACE("[ImGui] Mouse Button: %d Action: %d ImGuiBtn: %d Pos: %g,%g",
+              (int)button,
+              (int)action,
+              imgui_button,
+              (double)io.MousePos.x,
+              (double)io.MousePos.y);
 
     if (imgui_button != -1)
         io.AddMouseButtonEvent(imgui_button,
@@ -327,7 +448,7 @@ namespace zabato::imgui
 {
 void init(zabato::window *win)
 {
-    std::cout << "[ImGui] Init called with window: " << win << std::endl;
+    LOG_INFO("[ImGui] Init called with window: %p", (void *)win);
     g_window = win;
     g_gpu    = zabato::init_gpu();
 
@@ -360,6 +481,7 @@ void shutdown()
         g_font_texture->destroy();
         g_font_texture = nullptr;
     }
+    destroy_streaming_buffers();
     ImGui::DestroyContext();
     g_window = nullptr;
     g_gpu    = nullptr;
@@ -393,11 +515,10 @@ void new_frame()
     // Font texture
     if (!g_font_texture)
     {
-        std::cout << "[ImGui] Creating font texture..." << std::endl;
+        LOG_INFO("[ImGui] Creating font texture...");
         if (!g_gpu)
         {
-            std::cerr << "[ImGui] Error: GPU is null during texture creation!"
-                      << std::endl;
+            LOG_ERROR("[ImGui] Error: GPU is null during texture creation!");
         }
         else
         {
@@ -406,23 +527,19 @@ void new_frame()
             io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
 
             vector<uint16_t> tex_data(width * height);
-            for (int i = 0; i < width * height; ++i)
-            {
-                uint8_t r = pixels[i * 4 + 0];
-                uint8_t g = pixels[i * 4 + 1];
-                uint8_t b = pixels[i * 4 + 2];
-                uint8_t a = pixels[i * 4 + 3];
-
-                color c(color8888(r, g, b, a));
-                tex_data[i] = zabato::color4444(c).value;
-            }
+            convert_colors(
+                span<const color8888>(
+                    reinterpret_cast<const color8888 *>(pixels),
+                    tex_data.size()),
+                span<color4444>(reinterpret_cast<color4444 *>(tex_data.data()),
+                                tex_data.size()));
 
             g_font_texture = g_gpu->create_texture(
                 width, height, zabato::color_format::rgba4444);
             if (g_font_texture)
             {
-                std::cout << "[ImGui] Texture created: " << g_font_texture
-                          << std::endl;
+                LOG_INFO("[ImGui] Texture created: %p",
+                         (void *)g_font_texture);
                 g_font_texture->load(width,
                                      height,
                                      zabato::color_format::rgba4444,
@@ -432,8 +549,7 @@ void new_frame()
             }
             else
             {
-                std::cerr << "[ImGui] Error: Failed to create texture object!"
-                          << std::endl;
+                LOG_ERROR("[ImGui] Error: Failed to create texture object!");
             }
         }
     }
@@ -455,16 +571,11 @@ void render_draw_data(ImDrawData *draw_data)
         io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
 
         vector<uint16_t> tex_data(width * height);
-        for (int i = 0; i < width * height; ++i)
-        {
-            uint8_t r = pixels[i * 4 + 0];
-            uint8_t g = pixels[i * 4 + 1];
-            uint8_t b = pixels[i * 4 + 2];
-            uint8_t a = pixels[i * 4 + 3];
-            color c(color8888(r, g, b, a));
-
-            tex_data[i] = zabato::color4444(c).value;
-        }
+        convert_colors(
+            span<const color8888>(reinterpret_cast<const color8888 *>(pixels),
+                                  tex_data.size()),
+            span<color4444>(reinterpret_cast<color4444 *>(tex_data.data()),
+                            tex_data.size()));
 
         g_font_texture = g_gpu->create_texture(
             width, height, zabato::color_format::rgba4444);
@@ -476,6 +587,9 @@ void render_draw_data(ImDrawData *draw_data)
         io.Fonts->SetTexID((ImTextureID)g_font_texture);
     }
 
+    if (!g_streaming_checked)
+        create_streaming_buffers();
+
     int fb_width =
         (int)(draw_data->DisplaySize.x * draw_data->FramebufferScale.x);
     int fb_height =
@@ -518,9 +632,8 @@ void render_draw_data(ImDrawData *draw_data)
     // Render command lists
     for (int n = 0; n < draw_data->CmdListsCount; n++)
     {
-        const ImDrawList *cmd_list   = draw_data->CmdLists[n];
-        const ImDrawVert *vtx_buffer = cmd_list->VtxBuffer.Data;
-        const ImDrawIdx *idx_buffer  = cmd_list->IdxBuffer.Data;
+        const ImDrawList *cmd_list = draw_data->CmdLists[n];
+        const bool streamed        = upload_draw_list(cmd_list);
 
         for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
         {
@@ -555,26 +668,14 @@ void render_draw_data(ImDrawData *draw_data)
                 else
                     g_gpu->unbind_texture();
 
-                g_gpu->begin(zabato::primitive_type::triangles);
-                for (unsigned int i = 0; i < pcmd->ElemCount; i++)
-                {
-                    ImDrawIdx idx       = idx_buffer[pcmd->IdxOffset + i];
-                    const ImDrawVert &v = vtx_buffer[idx];
-
-                    real r = (real)((v.col >> IM_COL32_R_SHIFT) & 0xFF) *
-                             (real(1.0f) / real(255.0f));
-                    real g = (real)((v.col >> IM_COL32_G_SHIFT) & 0xFF) *
-                             (real(1.0f) / real(255.0f));
-                    real b = (real)((v.col >> IM_COL32_B_SHIFT) & 0xFF) *
-                             (real(1.0f) / real(255.0f));
-                    real a = (real)((v.col >> IM_COL32_A_SHIFT) & 0xFF) *
-                             (real(1.0f) / real(255.0f));
-
-                    g_gpu->color(color(r, g, b, a));
-                    g_gpu->tex_coord(v.uv.x, v.uv.y);
-                    g_gpu->vertex(v.pos.x, v.pos.y, 0.0f);
-                }
-                g_gpu->end();
+                if (streamed)
+                    g_gpu->draw_indexed_range(zabato::primitive_type::triangles,
+                                              g_vertex_buffer,
+                                              g_index_buffer,
+                                              pcmd->IdxOffset,
+                                              pcmd->ElemCount);
+                else
+                    render_immediate(cmd_list, pcmd);
             }
         }
     }
@@ -38,7 +38,9 @@ void new_frame();
  * @brief Renders the ImGui draw data using the Zabato GPU API.
  *
  * This function handles setting up the GPU state (scissor test, blending, etc.)
- * and executing the draw commands generated by ImGui.
+ * and executing the draw commands generated by ImGui. Each draw list is
+ * uploaded into reused retained buffers and every command is a single indexed
+ * draw; GPUs without retained geometry get the commands vertex by vertex.
  *
  * @param draw_data Pointer to the ImDrawData structure retrieved via
  * `ImGui::GetDrawData()`.
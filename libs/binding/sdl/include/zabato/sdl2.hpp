@@ -12,6 +12,7 @@ key_code to_keycode(SDL_Scancode scancode);
 button_state to_button_state(Uint8 state, Uint8 repeat);
 modifier_keys to_modifier_keys(SDL_Keymod mod);
 gamepad_button to_gamepad_button(int sdl_button);
+gamepad_analog to_gamepad_analog(int sdl_axis);
 
 int to_sdl_mouse(mouse_button btn);
 SDL_Scancode to_sdl_scancode(key_code key);
@@ -2,9 +2,10 @@
 #include "sdl2_keymap.hpp"
 #include "zabato/window.hpp"
 #include <SDL2/SDL.h>
-#include <iostream>
 #include <zabato/hash_map.hpp>
+#include <zabato/log.hpp>
 #include <zabato/sdl2.hpp>
+#include <zabato/time.hpp>
 
 namespace zabato
 {
@@ -14,6 +15,63 @@ static hash_map<int, SDL_GameController *> g_controllers;
 static gamepad_callback g_gamepad_cb = nullptr;
 static int g_display_indices[32];
 static monitor *g_monitor_pointers[32];
+static input_state g_input;
+
+/** @return The index a controller was opened with, or -1. */
+static int find_gamepad(SDL_JoystickID instance)
+{
+    for (auto const &[index, ctl, _] : g_controllers)
+        if (SDL_JoystickInstanceID(SDL_GameControllerGetJoystick(ctl)) ==
+            instance)
+            return index;
+    return -1;
+}
+
+/** @brief Normalizes an axis from [-32768, 32767] to [-1, 1]. */
+static real to_analog(Sint16 value)
+{
+    if (value < 0)
+        return static_cast<real>(value) * (real(1.0) / real(32768.0));
+    return static_cast<real>(value) * (real(1.0) / real(32767.0));
+}
+
+/** @brief Records an event in `g_input`. */
+static void record_input(const SDL_Event *event)
+{
+    switch (event->type)
+    {
+    case SDL_KEYDOWN:
+    case SDL_KEYUP:
+        if (!event->key.repeat)
+            g_input.on_key(to_keycode(event->key.keysym.scancode),
+                           event->key.state == SDL_PRESSED);
+        break;
+    case SDL_MOUSEMOTION:
+        g_input.on_cursor({static_cast<real>(event->motion.x),
+                           static_cast<real>(event->motion.y)});
+        break;
+    case SDL_MOUSEBUTTONDOWN:
+    case SDL_MOUSEBUTTONUP:
+        g_input.on_mouse_button(to_mouse_button(event->button.button),
+                                event->button.state == SDL_PRESSED);
+        break;
+    case SDL_MOUSEWHEEL:
+        g_input.on_scroll({static_cast<real>(event->wheel.x),
+                           static_cast<real>(event->wheel.y)});
+        break;
+    case SDL_CONTROLLERBUTTONDOWN:
+    case SDL_CONTROLLERBUTTONUP:
+        g_input.on_gamepad_button(find_gamepad(event->cbutton.which),
+                                  to_gamepad_button(event->cbutton.button),
+                                  event->cbutton.state == SDL_PRESSED);
+        break;
+    case SDL_CONTROLLERAXISMOTION:
+        g_input.on_gamepad_analog(find_gamepad(event->caxis.which),
+                                  to_gamepad_analog(event->caxis.axis),
+                                  to_analog(event->caxis.value));
+        break;
+    }
+}
 
 void dispatch_gamepad_event(SDL_Event *event)
 {
@@ -28,6 +86,7 @@ void dispatch_gamepad_event(SDL_Event *event)
         if (controller)
         {
             g_controllers.add_or_set(joy_index, controller);
+            g_input.on_gamepad_connected(joy_index, true);
             if (g_gamepad_cb)
             {
                 g_gamepad_cb(joy_index, connect_event::connected);
@@ -56,6 +115,7 @@ void dispatch_gamepad_event(SDL_Event *event)
         if (jid != -1)
         {
             g_controllers.erase(jid);
+            g_input.on_gamepad_connected(jid, false);
             if (g_gamepad_cb)
                 g_gamepad_cb(jid, connect_event::disconnected);
         }
@@ -68,6 +128,7 @@ void dispatch_event(SDL_Event *event)
     Sdl2Window *win = nullptr;
     Uint32 windowID = 0;
 
+    record_input(event);
     switch (event->type)
     {
     case SDL_KEYDOWN:
@@ -157,7 +218,7 @@ Sdl2Window::Sdl2Window(int x,
     m_handle = SDL_CreateWindow(title, win_x, win_y, width, height, sdl_flags);
     if (!m_handle)
     {
-        std::cerr << "SDL_CreateWindow Error: " << SDL_GetError() << std::endl;
+        LOG_ERROR("SDL_CreateWindow Error: %s", SDL_GetError());
         exit(EXIT_FAILURE);
     }
 
@@ -165,8 +226,7 @@ Sdl2Window::Sdl2Window(int x,
     m_context = SDL_GL_CreateContext(m_handle);
     if (!m_context)
     {
-        std::cerr << "SDL_GL_CreateContext Error: " << SDL_GetError()
-                  << std::endl;
+        LOG_ERROR("SDL_GL_CreateContext Error: %s", SDL_GetError());
         SDL_DestroyWindow(m_handle);
         exit(EXIT_FAILURE);
     }
@@ -603,7 +663,7 @@ bool init_window_system()
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_JOYSTICK |
                  SDL_INIT_GAMECONTROLLER) != 0)
     {
-        std::cerr << "SDL_Init Error: " << SDL_GetError() << std::endl;
+        LOG_ERROR("SDL_Init Error: %s", SDL_GetError());
         return false;
     }
 
@@ -640,32 +700,40 @@ window *create_window(int x,
     return new Sdl2Window(x, y, width, height, title, flags);
 }
 
-void poll_events()
+static void drain_events()
 {
     SDL_Event event;
     while (SDL_PollEvent(&event))
         dispatch_event(&event);
 }
 
+void poll_events()
+{
+    g_input.begin_frame();
+    drain_events();
+}
+
 void wait_events()
 {
+    g_input.begin_frame();
     SDL_Event event;
     if (SDL_WaitEvent(&event))
     {
         dispatch_event(&event);
-        poll_events();
+        drain_events();
     }
 }
 
 void wait_events_timeout(double timeout)
 {
+    g_input.begin_frame();
     SDL_Event event;
     if (SDL_WaitEventTimeout(&event, (int)(timeout * 1000.0)))
     {
         dispatch_event(&event);
 
         // After dispatching, poll for any other pending events
-        poll_events();
+        drain_events();
     }
 }
 
@@ -714,14 +782,7 @@ bool get_gamepad_state(int jid, gamepad_state *state)
     {
         Sint16 axis_val = SDL_GameControllerGetAxis(
             controller, to_sdl_gamepad_axis(static_cast<gamepad_analog>(i)));
-
-        // Normalize from [-32768, 32767] to [-1.0, 1.0]
-        if (axis_val < 0)
-            state->analogs[i] =
-                static_cast<real>(axis_val) * (real(1.0) / real(32768.0));
-        else
-            state->analogs[i] =
-                static_cast<real>(axis_val) * (real(1.0) / real(32767.0));
+        state->analogs[i] = to_analog(axis_val);
     }
 
     return true;
@@ -737,6 +798,14 @@ const char *get_gamepad_name(int jid)
 
 void set_gamepad_callback(gamepad_callback cb) { g_gamepad_cb = cb; }
 
+const input_state &get_input() { return g_input; }
+
+void capture_input(input_snapshot &snapshot)
+{
+    snapshot.state = g_input;
+    snapshot.time  = time::now().as_nanoseconds();
+}
+
 gl_proc get_proc_address(const char *procname)
 {
     return reinterpret_cast<gl_proc>(SDL_GL_GetProcAddress(procname));
@@ -168,6 +168,27 @@ inline SDL_GameControllerAxis to_sdl_gamepad_axis(gamepad_analog axis)
     }
 }
 
+inline gamepad_analog to_gamepad_analog(int sdl_axis)
+{
+    switch (sdl_axis)
+    {
+    case SDL_CONTROLLER_AXIS_LEFTX:
+        return gamepad_analog::left_x;
+    case SDL_CONTROLLER_AXIS_LEFTY:
+        return gamepad_analog::left_y;
+    case SDL_CONTROLLER_AXIS_RIGHTX:
+        return gamepad_analog::right_x;
+    case SDL_CONTROLLER_AXIS_RIGHTY:
+        return gamepad_analog::right_y;
+    case SDL_CONTROLLER_AXIS_TRIGGERLEFT:
+        return gamepad_analog::l2;
+    case SDL_CONTROLLER_AXIS_TRIGGERRIGHT:
+        return gamepad_analog::r2;
+    default:
+        return gamepad_analog::max;
+    }
+}
+
 inline key_code to_keycode(SDL_Scancode k)
 {
     switch (k)
@@ -1,15 +1,27 @@
 #pragma once
 
+#include <zabato/memory_tracking.hpp>
+
 #include <malloc.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 namespace zabato
 {
-static size_t g_total_memory_allocated = 0;
-
-// TODO: improve this allocator
-template <class T> class allocator
+/**
+ * @class allocator
+ * @brief The default allocator of the containers, over malloc and realloc.
+ *
+ * With ZABATO_MEMORY_TRACKING defined (the `memory_tracking` build option)
+ * every block carries a header with its size, and its bytes are counted
+ * against `Category`, see `get_memory_stats`. Otherwise blocks come straight
+ * from malloc and tracking costs nothing.
+ *
+ * @tparam Category What the memory is counted as when tracking.
+ */
+template <class T, memory_category Category = memory_category::containers>
+class allocator
 {
 public:
     using value_type      = T;
@@ -23,55 +35,61 @@ public:
     template <class U> class rebind
     {
     public:
-        using other = allocator<U>;
+        using other = allocator<U, Category>;
     };
 
     allocator() = default;
 
-    template <class U> constexpr allocator(const allocator<U> &) noexcept {}
+    template <class U>
+    constexpr allocator(const allocator<U, Category> &) noexcept
+    {
+    }
 
     T *allocate(size_t n)
     {
-        if (n > ((size_t)-1) / sizeof(T))
-            // if (n > ((size_t)-1 - header_size()) / sizeof(T))
+        if (n > ((size_t)-1 - header_size()) / sizeof(T))
             return nullptr;
 
-        size_t total_size = n * sizeof(T);
+        const size_t total_size = n * sizeof(T);
 
-        uint8_t *block = (uint8_t *)malloc(total_size);
-        // uint8_t *block = (uint8_t *)malloc(total_size + header_size());
+        uint8_t *block = (uint8_t *)malloc(total_size + header_size());
         if (!block)
             return nullptr;
 
-        // *(size_t *)block = total_size;
-        // g_total_memory_allocated += total_size;
-
-        // return (T *)(block + header_size());
-        return (T *)block;
+        if constexpr (memory_tracking)
+        {
+            *(size_t *)block = total_size;
+            track_allocation(Category, total_size);
+        }
+        return (T *)(block + header_size());
     }
 
     T *reallocate(T *p, size_t n)
     {
         if (!p)
-        {
             return allocate(n);
-        }
+        if (n > ((size_t)-1 - header_size()) / sizeof(T))
+            return nullptr;
 
-        // uint8_t *block  = (uint8_t *)p - header_size();
-        // size_t old_size = *(size_t *)block;
-        size_t new_size = n * sizeof(T);
+        uint8_t *block        = (uint8_t *)p - header_size();
+        const size_t new_size = n * sizeof(T);
+
+        size_t old_size = 0;
+        if constexpr (memory_tracking)
+            old_size = *(size_t *)block;
 
         uint8_t *new_block =
-            // (uint8_t *)realloc(block, new_size + header_size());
-            (uint8_t *)realloc(p, new_size);
+            (uint8_t *)realloc(block, new_size + header_size());
         if (!new_block)
             return nullptr;
 
-        // *(size_t *)new_block = new_size;
-        // g_total_memory_allocated += (new_size - old_size);
-
-        // return (T *)(new_block + header_size());
-        return (T *)new_block;
+        if constexpr (memory_tracking)
+        {
+            *(size_t *)new_block = new_size;
+            track_deallocation(Category, old_size);
+            track_allocation(Category, new_size);
+        }
+        return (T *)(new_block + header_size());
     }
 
     void deallocate(T *p, size_t n)
@@ -80,22 +98,322 @@ public:
         if (!p)
             return;
 
-        // uint8_t *block = (uint8_t *)p - header_size();
-        // uint8_t *block     = (uint8_t *)p - header_size();
-        // size_t stored_size = *(size_t *)block;
-        // g_total_memory_allocated -= stored_size;
+        uint8_t *block = (uint8_t *)p - header_size();
+        if constexpr (memory_tracking)
+            track_deallocation(Category, *(size_t *)block);
 
-        free(p);
+        free(block);
     }
 
 private:
-    /*
+    /** @brief Room for the size, keeping blocks aligned. 0 without tracking. */
     static constexpr size_t header_size()
     {
+        if constexpr (!memory_tracking)
+            return 0;
         return ((sizeof(size_t) + alignof(max_align_t) - 1) /
                 alignof(max_align_t)) *
                alignof(max_align_t);
     }
-    */
 };
+
+/** @brief Allocates memory counted as `memory_category::resources`. */
+template <class T>
+using resource_allocator = allocator<T, memory_category::resources>;
+
+/** @brief Allocates memory counted as `memory_category::scene`. */
+template <class T> using scene_allocator = allocator<T, memory_category::scene>;
+
+/** @brief Allocates memory counted as `memory_category::gpu_shadow`. */
+template <class T>
+using gpu_shadow_allocator = allocator<T, memory_category::gpu_shadow>;
+
+/**
+ * @class linear_arena
+ * @brief A bump allocator over one block, rewound all at once.
+ *
+ * Allocations are carved one after another from the block, each behind a
+ * small header holding its size. Freeing or growing the last allocation
+ * happens in place, anything else is only reclaimed by `rewind` or `reset`.
+ * An arena is used by one thread at a time.
+ */
+class linear_arena
+{
+public:
+    /** @brief Alignment of every allocation, also the header size. */
+    static constexpr size_t alignment = alignof(max_align_t);
+
+    linear_arena() = default;
+    explicit linear_arena(size_t capacity) { set_capacity(capacity); }
+    ~linear_arena() { free(m_data); }
+
+    linear_arena(const linear_arena &)            = delete;
+    linear_arena &operator=(const linear_arena &) = delete;
+
+    /**
+     * @brief Replaces the block with one of `capacity` bytes, dropping every
+     * allocation.
+     * @return False if the block could not be allocated.
+     */
+    bool set_capacity(size_t capacity)
+    {
+        free(m_data);
+        m_data     = capacity ? (uint8_t *)malloc(capacity) : nullptr;
+        m_capacity = m_data ? capacity : 0;
+        m_used     = 0;
+        m_peak     = 0;
+        return m_data || capacity == 0;
+    }
+
+    /** @return An allocation of `size` bytes, or null if it does not fit. */
+    void *allocate(size_t size)
+    {
+        const size_t padded = round_up(size);
+        if (padded < size || padded > m_capacity - m_used ||
+            alignment > m_capacity - m_used - padded)
+            return nullptr;
+
+        uint8_t *header   = m_data + m_used;
+        *(size_t *)header = size;
+
+        m_used += alignment + padded;
+        if (m_used > m_peak)
+            m_peak = m_used;
+        return header + alignment;
+    }
+
+    /**
+     * @brief Resizes an allocation, in place when it is the last one or when
+     * it shrinks, otherwise by copying it to a new one.
+     * @return The allocation, or null if it does not fit, in which case `p`
+     * is left as it was.
+     */
+    void *reallocate(void *p, size_t size)
+    {
+        if (!p)
+            return allocate(size);
+
+        size_t &stored = *(size_t *)((uint8_t *)p - alignment);
+        if (is_last(p))
+        {
+            const size_t begin  = (uint8_t *)p - m_data;
+            const size_t padded = round_up(size);
+            if (padded < size || padded > m_capacity - begin)
+                return nullptr;
+            stored = size;
+            m_used = begin + padded;
+            if (m_used > m_peak)
+                m_peak = m_used;
+            return p;
+        }
+
+        if (size <= stored)
+        {
+            stored = size;
+            return p;
+        }
+
+        void *moved = allocate(size);
+        if (moved)
+            memcpy(moved, p, stored);
+        return moved;
+    }
+
+    /** @brief Frees an allocation, which only reclaims the last one. */
+    void deallocate(void *p)
+    {
+        if (p && is_last(p))
+            m_used = (uint8_t *)p - alignment - m_data;
+    }
+
+    /** @return True if `p` points into the block of this arena. */
+    bool owns(const void *p) const
+    {
+        return p >= m_data && p < m_data + m_capacity;
+    }
+
+    /** @return The size of an allocation, as last requested. */
+    static size_t size_of(const void *p)
+    {
+        return *(const size_t *)((const uint8_t *)p - alignment);
+    }
+
+    /** @return A position to `rewind` to, freeing what comes after it. */
+    size_t get_marker() const { return m_used; }
+
+    /** @brief Frees every allocation made after `get_marker` returned. */
+    void rewind(size_t marker)
+    {
+        if (marker < m_used)
+            m_used = marker;
+    }
+
+    /** @brief Frees every allocation. */
+    void reset() { m_used = 0; }
+
+    size_t get_used() const { return m_used; }
+    size_t get_capacity() const { return m_capacity; }
+
+    /** @return The most bytes in use at once, to size the block. */
+    size_t get_peak() const { return m_peak; }
+
+private:
+    static size_t round_up(size_t size)
+    {
+        return (size + alignment - 1) & ~(alignment - 1);
+    }
+
+    bool is_last(const void *p) const
+    {
+        return (const uint8_t *)p + round_up(size_of(p)) == m_data + m_used;
+    }
+
+    uint8_t *m_data   = nullptr;
+    size_t m_capacity = 0;
+    size_t m_used     = 0;
+    size_t m_peak     = 0;
+};
+
+/**
+ * @class arena_scope
+ * @brief Rewinds an arena to where it was when the scope was entered.
+ *
+ * Memory allocated inside the scope, including the growth of containers
+ * created before it, must not be used once it ends.
+ */
+class arena_scope
+{
+public:
+    explicit arena_scope(linear_arena &arena)
+        : m_arena(arena), m_marker(arena.get_marker())
+    {
+    }
+    ~arena_scope() { m_arena.rewind(m_marker); }
+
+    arena_scope(const arena_scope &)            = delete;
+    arena_scope &operator=(const arena_scope &) = delete;
+
+private:
+    linear_arena &m_arena;
+    size_t m_marker;
+};
+
+/**
+ * @class arena_allocator
+ * @brief An allocator drawing from the `linear_arena` of `Arena::get()`.
+ *
+ * Containers construct their allocator themselves, so the arena is found
+ * through `Arena`, any type with a static `linear_arena &get()`. When the
+ * arena is full the allocator falls back to the heap, and frees either kind
+ * where it came from. Memory must be freed on the thread that allocated it
+ * when `get` returns a per-thread arena, as `frame_arena` does.
+ *
+ * @code
+ *   struct level_arena
+ *   {
+ *       static linear_arena &get();
+ *   };
+ *   vector<node *, arena_allocator<node *, level_arena>> nodes;
+ * @endcode
+ */
+template <class T, class Arena> class arena_allocator
+{
+public:
+    using value_type      = T;
+    using pointer         = T *;
+    using const_pointer   = const T *;
+    using reference       = T &;
+    using const_reference = const T &;
+    using size_type       = size_t;
+    using difference_type = ptrdiff_t;
+
+    template <class U> class rebind
+    {
+    public:
+        using other = arena_allocator<U, Arena>;
+    };
+
+    arena_allocator() = default;
+
+    template <class U>
+    constexpr arena_allocator(const arena_allocator<U, Arena> &) noexcept
+    {
+    }
+
+    T *allocate(size_t n)
+    {
+        if (n > ((size_t)-1) / sizeof(T))
+            return nullptr;
+
+        void *block = Arena::get().allocate(n * sizeof(T));
+        if (!block)
+            block = malloc(n * sizeof(T));
+        return (T *)block;
+    }
+
+    T *reallocate(T *p, size_t n)
+    {
+        if (!p)
+            return allocate(n);
+        if (n > ((size_t)-1) / sizeof(T))
+            return nullptr;
+
+        linear_arena &arena = Arena::get();
+        const size_t size   = n * sizeof(T);
+        if (!arena.owns(p))
+            return (T *)realloc(p, size);
+
+        void *block = arena.reallocate(p, size);
+        if (block)
+            return (T *)block;
+
+        // Out of arena, the allocation moves to the heap.
+        block = malloc(size);
+        if (!block)
+            return nullptr;
+        memcpy(block, p, linear_arena::size_of(p));
+        arena.deallocate(p);
+        return (T *)block;
+    }
+
+    void deallocate(T *p, size_t n)
+    {
+        (void)n;
+        if (!p)
+            return;
+
+        linear_arena &arena = Arena::get();
+        if (arena.owns(p))
+            arena.deallocate(p);
+        else
+            free(p);
+    }
+};
+
+/**
+ * @brief The per-thread scratch arena behind `frame_allocator`.
+ *
+ * Every thread gets its own arena of `default_capacity` bytes on first use.
+ * The main loop calls `reset` once per frame, next to `gpu::new_frame`, so
+ * frame allocations live until the next frame starts and must not be used
+ * after it. `reset` only rewinds the arena of the calling thread; code that
+ * may run on other threads should put its temporaries under an `arena_scope`
+ * instead.
+ */
+struct frame_arena
+{
+    static constexpr size_t default_capacity = 1024 * 1024;
+
+    static linear_arena &get()
+    {
+        thread_local linear_arena arena(default_capacity);
+        return arena;
+    }
+
+    /** @brief Frees every frame allocation of the calling thread. */
+    static void reset() { get().reset(); }
+};
+
+/** @brief Allocates from the calling thread's frame arena. */
+template <class T> using frame_allocator = arena_allocator<T, frame_arena>;
 } // namespace zabato
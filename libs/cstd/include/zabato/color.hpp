@@ -3,6 +3,7 @@
 #include <cstdint>
 #include <zabato/math.hpp>
 #include <zabato/real.hpp>
+#include <zabato/span.hpp>
 
 #include <stdint.h>
 
@@ -541,4 +542,61 @@ inline constexpr tuple<color, color> analogous(const color &c)
 
 #pragma endregion
 
+#pragma region Bulk Conversions
+
+/**
+ * @brief Converts a run of pixels, e.g. a whole texture, with SSE2 or NEON
+ * where available.
+ *
+ * Unlike the per-pixel constructors these never go through `real`, but round
+ * the same: a channel widens to the nearest 8-bit value and the 1-bit alpha
+ * becomes 0 or 255.
+ *
+ * @param src The pixels to convert.
+ * @param dst Receives `src.size()` pixels, must be at least as large.
+ */
+void convert_colors(span<const color5551> src, span<color8888> dst);
+
+/** @copydoc convert_colors(span<const color5551>, span<color8888>) */
+void convert_colors(span<const color4444> src, span<color8888> dst);
+
+/**
+ * @brief Narrows a run of pixels to rgba5551, truncating the channels like
+ * `color5551(const color &)`. Alpha is set from 128 up.
+ *
+ * @param src The pixels to convert.
+ * @param dst Receives `src.size()` pixels, must be at least as large.
+ * @param dither_width When not 0, `src` is an image of rows this wide and the
+ * color channels get a 4x4 ordered dither, which hides the banding of smooth
+ * gradients. Dithered runs are converted without SIMD.
+ */
+void convert_colors(span<const color8888> src,
+                    span<color5551> dst,
+                    uint32_t dither_width = 0);
+
+/**
+ * @brief Narrows a run of pixels to rgba4444, rounding the channels like
+ * `color4444(const color &)`.
+ * @copydetails convert_colors(span<const color8888>, span<color5551>, uint32_t)
+ */
+void convert_colors(span<const color8888> src,
+                    span<color4444> dst,
+                    uint32_t dither_width = 0);
+
+/**
+ * @brief Looks up palette indices, as stored by the palette texture formats.
+ *
+ * @param indices The indices, 4-bit ones two to a byte with the first in the
+ * high nibble.
+ * @param index_bits 4 or 8.
+ * @param palette The colors. Indices past its end give transparent black.
+ * @param dst Receives one color per index, as many as fit.
+ */
+void expand_palette(span<const uint8_t> indices,
+                    uint32_t index_bits,
+                    span<const color8888> palette,
+                    span<color8888> dst);
+
+#pragma endregion
+
 } // namespace zabato
\ No newline at end of file
@@ -44,6 +44,18 @@ public:
     const char *c_str() const { return m_buffer; }
     /** @brief Returns pointer to data. */
     const char *data() const { return m_buffer; }
+    /** @brief Returns pointer to data, for writing up to `capacity()`. */
+    char *data() { return m_buffer; }
+
+    /** @brief Returns the longest string it holds. */
+    static constexpr size_t capacity() { return MaxSize - 1; }
+
+    /** @brief Sets the size after writing through `data()`. */
+    void resize(size_t size)
+    {
+        m_size           = uint8_t(size < MaxSize ? size : MaxSize - 1);
+        m_buffer[m_size] = '\0';
+    }
 
     /** @brief Returns size of string. */
     size_t size() const { return m_size; }
@@ -80,6 +80,14 @@ public:
      * @return The current byte offset from the beginning of the file.
      */
     virtual uint64_t tell() const = 0;
+
+    /**
+     * @brief Moves past the next `size` bytes and returns them in place, for
+     * files held in memory such as the entries of a mapped archive.
+     * @return The bytes, valid while the file is open, or null with the
+     * position unchanged.
+     */
+    virtual const uint8_t *view(size_t size) { return nullptr; }
 };
 
 /**
@@ -191,6 +199,39 @@ public:
      * @return True if successful, false otherwise.
      */
     virtual bool mkdir(string_view path) = 0;
+
+    /**
+     * @brief Gets where a file is stored, so that a batch of reads can visit
+     * the storage in order.
+     * @param path The path to the file.
+     * @return A key ordering the files of this file system by their position,
+     * e.g. the offset in an archive. The default, 0 for every file, keeps the
+     * order the files are given in.
+     */
+    virtual uint64_t get_storage_offset(string_view path)
+    {
+        (void)path;
+        return 0;
+    }
+
+    /**
+     * @brief Starts watching the files for changes made behind the file
+     * system's back, e.g. by an editor, for `poll_changes`.
+     * @return False if the file system cannot watch, the default.
+     */
+    virtual bool watch() { return false; }
+
+    /**
+     * @brief Takes the changes seen since the last call, without blocking.
+     * @param paths Receives the absolute paths of the files created,
+     * modified, moved or removed. A file may be listed more than once.
+     * @return The number of paths appended.
+     */
+    virtual size_t poll_changes(vector<string> &paths)
+    {
+        (void)paths;
+        return 0;
+    }
 };
 
 /**
@@ -200,6 +241,12 @@ public:
  * structure. It dispatches calls to the appropriate underlying file system
  * based on the path.
  *
+ * The mount points form a trie of path components, so a lookup walks the
+ * components of the path once, whatever the number of mounts, and the
+ * deepest mount met wins. Paths are normalized into a buffer on the stack,
+ * so `open`, `exists` and the other calls do not allocate unless the path is
+ * longer than `path_buffer` holds.
+ *
  * Usage:
  * @code
  *   virtual_fs vfs;
@@ -211,39 +258,38 @@ public:
 class virtual_fs : public file_system
 {
 public:
+    /** @brief Holds a normalized path on the stack. */
+    using path_buffer = fixed_string<256>;
+
+    virtual_fs() { m_nodes.push_back(mount_node()); }
+
     /**
-     * @brief Mounts a filesystem at a specific path.
-     * The path is normalized before mounting.
+     * @brief Mounts a filesystem at a specific path, replacing the one
+     * mounted there, if any. The path is normalized before mounting.
      *
      * @param mount_point The virtual path to mount at (e.g., "/mnt/disk").
      * @param fs Pointer to the file system instance to mount.
      */
     void mount(const string &mount_point, file_system *fs)
     {
-        string mp = normalize(mount_point);
-
-        // Ensure mount point is absolute for consistency
-        if (!is_absolute(mp))
-        {
-            string tmp = "/";
-            tmp += mp;
-            mp = normalize(tmp);
-        }
-
-        // Remove trailing slash for consistency in matching (unless root)
-        if (mp.length() > 1 && mp.back() == '/')
+        string mp        = rooted(mount_point);
+        uint32_t at      = 0;
+        string_view rest = mp;
+        for (string_view name; next_component(rest, name);)
         {
-            mp.pop_back();
+            uint32_t child = find_child(at, name);
+            if (child == no_node)
+            {
+                child = (uint32_t)m_nodes.size();
+                m_nodes.push_back(mount_node());
+                m_nodes[child].name         = name;
+                m_nodes[child].next_sibling = m_nodes[at].first_child;
+                m_nodes[at].first_child     = child;
+            }
+            at = child;
         }
-
-        m_mounts.push_back({mp, fs});
-
-        // Sort by length descending ensures longest prefix match wins
-        // e.g. "/usr/bin" is checked before "/usr"
-        sort(m_mounts.begin(),
-             m_mounts.end(),
-             [](const auto &a, const auto &b)
-             { return a.path.length() > b.path.length(); });
+        m_nodes[at].fs          = fs;
+        m_nodes[at].mount_point = mp;
     }
 
     /**
@@ -252,60 +298,37 @@ public:
      */
     void unmount(const string &mount_point)
     {
-        string mp = normalize(mount_point);
-        // Ensure normalization matches mount logic
-        if (!is_absolute(mp))
-        {
-            string tmp = "/";
-            tmp += mp;
-            mp = normalize(tmp);
-        }
-        if (mp.length() > 1 && mp.back() == '/')
-        {
-            mp.pop_back();
-        }
-
-        for (auto it = m_mounts.begin(); it != m_mounts.end(); ++it)
-        {
-            if (it->path == mp)
-            {
-                // Remove the mount point by copying the last element over it
-                // then popping the back. The order is destroyed, so we re-sort.
-                *it = m_mounts.back();
-                m_mounts.pop_back();
-
-                // Restore sort invariant (Longest path first)
-                sort(m_mounts.begin(),
-                     m_mounts.end(),
-                     [](const auto &a, const auto &b)
-                     { return a.path.length() > b.path.length(); });
-                return;
-            }
-        }
+        string mp        = rooted(mount_point);
+        uint32_t at      = 0;
+        string_view rest = mp;
+        for (string_view name; at != no_node && next_component(rest, name);)
+            at = find_child(at, name);
+
+        // The node stays, mount points are few and often mounted again.
+        if (at != no_node)
+            m_nodes[at].fs = nullptr;
     }
 
     /** @copydoc file_system::open */
     file *open(string_view path, open_mode mode) override
     {
-        auto [fs, relative_path] = resolve(path);
-        if (!fs)
-            return nullptr;
-        return fs->open(relative_path, mode);
+        resolved r;
+        return resolve(path, r) ? r.fs->open(r.relative, mode) : nullptr;
     }
 
     /** @copydoc file_system::exists */
     bool exists(string_view path) override
     {
-        auto [fs, relative_path] = resolve(path);
-        return fs && fs->exists(relative_path);
+        resolved r;
+        return resolve(path, r) && r.fs->exists(r.relative);
     }
 
     /** @copydoc file_system::ls */
     vector<file_info> ls(string_view path) override
     {
-        auto [fs, relative_path] = resolve(path);
-        if (fs)
-            return fs->ls(relative_path);
+        resolved r;
+        if (resolve(path, r))
+            return r.fs->ls(r.relative);
         return {};
     }
 
@@ -316,111 +339,174 @@ public:
         if (path == "/" || path.empty())
             return true;
 
-        auto [fs, relative_path] = resolve(path);
-        return fs && fs->is_dir(relative_path);
+        resolved r;
+        return resolve(path, r) && r.fs->is_dir(r.relative);
     }
 
     /** @copydoc file_system::is_file */
     bool is_file(string_view path) override
     {
-        auto [fs, relative_path] = resolve(path);
-        return fs && fs->is_file(relative_path);
+        resolved r;
+        return resolve(path, r) && r.fs->is_file(r.relative);
     }
 
     /** @copydoc file_system::is_read_only */
     bool is_read_only(string_view path) override
     {
-        auto [fs, relative_path] = resolve(path);
-        return fs ? fs->is_read_only(relative_path) : true;
+        resolved r;
+        return resolve(path, r) ? r.fs->is_read_only(r.relative) : true;
     }
 
     /** @copydoc file_system::mkdir */
     bool mkdir(string_view path) override
     {
-        auto [fs, relative_path] = resolve(path);
-        return fs && fs->mkdir(relative_path);
+        resolved r;
+        return resolve(path, r) && r.fs->mkdir(r.relative);
     }
 
     /** @copydoc file_system::remove */
     bool remove(string_view path) override
     {
-        auto [fs, relative_path] = resolve(path);
-        return fs && fs->remove(relative_path);
+        resolved r;
+        return resolve(path, r) && r.fs->remove(r.relative);
     }
 
-private:
-    struct MountPoint
+    /** @copydoc file_system::get_storage_offset */
+    uint64_t get_storage_offset(string_view path) override
     {
-        string path;
-        file_system *fs;
-    };
-    vector<MountPoint> m_mounts;
+        resolved r;
+        return resolve(path, r) ? r.fs->get_storage_offset(r.relative) : 0;
+    }
 
     /**
-     * @brief Resolves a virtual path to a concrete filesystem and a relative
-     * path within it. Uses path normalization to handle ".." and "." correctly.
+     * @brief Watches every mounted file system that can.
+     * @return True if at least one watches.
      */
-    tuple<file_system *, string> resolve(string_view path) const
+    bool watch() override
     {
-        string normalized = normalize(path);
+        bool watching = false;
+        for (const mount_node &node : m_nodes)
+            if (node.fs && node.fs->watch())
+                watching = true;
+        return watching;
+    }
 
-        if (!is_absolute(normalized))
+    /**
+     * @brief Takes the changes of every mounted file system, with their
+     * mount point prepended.
+     */
+    size_t poll_changes(vector<string> &paths) override
+    {
+        const size_t first = paths.size();
+        for (const mount_node &node : m_nodes)
         {
-            normalized.prepend("/");
-            normalized = normalize(normalized);
+            const size_t from = paths.size();
+            if (!node.fs || node.fs->poll_changes(paths) == 0 ||
+                string_view(node.mount_point) == "/")
+                continue;
+            for (size_t i = from; i < paths.size(); ++i)
+                paths[i].prepend(node.mount_point);
         }
+        return paths.size() - first;
+    }
 
-        const MountPoint *longest_mount = nullptr;
-        size_t longest_match            = 0;
+private:
+    static constexpr uint32_t no_node = 0xFFFFFFFF;
 
-        for (const auto &mp : m_mounts)
-        {
-            if (normalized.starts_with(mp.path))
-            {
-                size_t len = mp.path.length();
-
-                bool is_root_mount = (len == 1 && mp.path[0] == '/');
-                bool exact_match   = (normalized.length() == len);
-                bool prefix_match =
-                    (normalized.length() > len && normalized[len] == '/');
-
-                if (is_root_mount || exact_match || prefix_match)
-                {
-                    if (len > longest_match) // Prefer longest specific mount
-                    {
-                        longest_mount = &mp;
-                        longest_match = len;
-                    }
-                }
-            }
-        }
+    /** @brief A component of a mount point; the root node is the first. */
+    struct mount_node
+    {
+        string name;
+        string mount_point;              ///< The whole path, once mounted.
+        file_system *fs       = nullptr; ///< Null if nothing is mounted here.
+        uint32_t first_child  = no_node;
+        uint32_t next_sibling = no_node;
+    };
 
-        if (longest_mount)
+    /** @brief A path resolved to a mounted file system. */
+    struct resolved
+    {
+        file_system *fs = nullptr;
+        string_view relative; ///< Into `buffer` or `overflow`.
+        path_buffer buffer;
+        string overflow; ///< Only used by paths too long for `buffer`.
+    };
+
+    vector<mount_node> m_nodes;
+
+    /** @return The path normalized and made absolute. */
+    static string rooted(string_view path)
+    {
+        string res;
+        res.resize(path.size() + 1);
+        res.resize(normalize(path, res.data(), path.size() + 1, true));
+        return res;
+    }
+
+    /** @brief Takes the next component off the front of a normalized path. */
+    static bool next_component(string_view &rest, string_view &name)
+    {
+        while (!rest.empty() && is_separator(rest.front()))
+            rest.remove_prefix(1);
+        if (rest.empty())
+            return false;
+
+        size_t end = rest.find('/');
+        if (end == string_view::npos)
+            end = rest.size();
+        name = rest.substr(0, end);
+        rest.remove_prefix(end);
+        return true;
+    }
+
+    uint32_t find_child(uint32_t parent, string_view name) const
+    {
+        uint32_t child = m_nodes[parent].first_child;
+        while (child != no_node && string_view(m_nodes[child].name) != name)
+            child = m_nodes[child].next_sibling;
+        return child;
+    }
+
+    /**
+     * @brief Resolves a virtual path to a concrete filesystem and a relative
+     * path within it. Uses path normalization to handle ".." and "." correctly.
+     * @return False if no file system is mounted over the path.
+     */
+    bool resolve(string_view path, resolved &out) const
+    {
+        string_view normalized;
+        if (normalize(path, out.buffer, true))
+            normalized = out.buffer;
+        else
+            normalized = out.overflow = rooted(path);
+
+        // The deepest mount on the way wins, e.g. "/usr/bin" over "/usr".
+        file_system *fs  = m_nodes[0].fs;
+        size_t mount_end = 0;
+
+        uint32_t at      = 0;
+        string_view rest = normalized;
+        for (string_view name; next_component(rest, name);)
         {
-            // Strip the mount point from the path
-            string_view sub_path;
-            if (longest_mount->path.length() == 1 &&
-                longest_mount->path[0] == '/')
-                sub_path = normalized;
-            else
-                sub_path = string_view(normalized)
-                               .substr(longest_mount->path.length());
-
-            if (sub_path.empty())
-                return {longest_mount->fs, "/"};
-
-            if (sub_path.front() != '/')
+            at = find_child(at, name);
+            if (at == no_node)
+                break;
+            if (m_nodes[at].fs)
             {
-                string res = "/";
-                res.reserve(sub_path.length() + 1);
-                res += sub_path;
-                return {longest_mount->fs, res};
+                fs        = m_nodes[at].fs;
+                mount_end = normalized.size() - rest.size();
             }
-
-            return {longest_mount->fs, string(sub_path)};
         }
 
-        return {nullptr, ""};
+        if (!fs)
+            return false;
+
+        // Strip the mount point from the path
+        out.fs       = fs;
+        out.relative = normalized.substr(mount_end);
+        if (out.relative.empty())
+            out.relative = "/";
+        return true;
     }
 };
 } // namespace zabato::fs
\ No newline at end of file
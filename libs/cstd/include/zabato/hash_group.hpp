@@ -0,0 +1,220 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ZABATO_HASH_GROUP_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define ZABATO_HASH_GROUP_NEON
+#endif
+
+namespace zabato
+{
+namespace detail
+{
+/**
+ * @brief Control bytes of the open-addressing tables (`hash_map`,
+ * `hash_set`).
+ *
+ * Every slot has one control byte, kept in an array apart from the slots. A
+ * full slot stores the low 7 bits of its hash (0 to 127), so a lookup only
+ * compares keys whose fragment matches. The other states have the high bit
+ * set.
+ */
+constexpr int8_t ctrl_empty   = -128; ///< Never filled since the last rehash
+constexpr int8_t ctrl_deleted = -2;   ///< Erased, probe chains run past it
+
+/** @brief The number of control bytes matched at once. */
+constexpr size_t group_width = 16;
+
+/** @return True if the control byte is of a full slot. */
+inline bool ctrl_is_full(int8_t ctrl) { return ctrl >= 0; }
+
+/** @brief Spreads a hash, so its low and high bits both carry entropy. */
+inline size_t mix_hash(size_t hash)
+{
+    const uint64_t h = uint64_t(hash) * 0x9E3779B97F4A7C15ull;
+    return size_t(h ^ (h >> 32));
+}
+
+/** @return The part of a mixed hash that picks the first group to probe. */
+inline size_t hash_h1(size_t hash) { return hash >> 7; }
+
+/** @return The part of a mixed hash stored in the control byte. */
+inline int8_t hash_h2(size_t hash) { return int8_t(hash & 0x7f); }
+
+/** @brief A set of slots within a group, one bit per slot. */
+class group_mask
+{
+public:
+    explicit group_mask(uint32_t bits) : m_bits(bits) {}
+
+    explicit operator bool() const { return m_bits != 0; }
+
+    /** @return The first slot of the set. */
+    uint32_t lowest() const { return uint32_t(__builtin_ctz(m_bits)); }
+
+    /** @brief Removes the first slot from the set. */
+    void clear_lowest() { m_bits &= m_bits - 1; }
+
+private:
+    uint32_t m_bits;
+};
+
+/** @brief `group_width` control bytes, matched with SSE2 or NEON. */
+class group
+{
+public:
+    explicit group(const int8_t *ctrl)
+    {
+#if defined(ZABATO_HASH_GROUP_SSE2)
+        m_ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i *>(ctrl));
+#elif defined(ZABATO_HASH_GROUP_NEON)
+        m_ctrl = vld1q_s8(ctrl);
+#else
+        memcpy(m_ctrl, ctrl, group_width);
+#endif
+    }
+
+    /** @return The full slots whose hash fragment is `h2`. */
+    group_mask match(int8_t h2) const { return match_byte(h2); }
+
+    /** @return The empty slots. */
+    group_mask match_empty() const { return match_byte(ctrl_empty); }
+
+    /** @return The slots an insertion may use, empty or deleted. */
+    group_mask match_empty_or_deleted() const
+    {
+#if defined(ZABATO_HASH_GROUP_SSE2)
+        return group_mask(uint32_t(_mm_movemask_epi8(m_ctrl)));
+#elif defined(ZABATO_HASH_GROUP_NEON)
+        return to_mask(vcltzq_s8(m_ctrl));
+#else
+        uint32_t bits = 0;
+        for (size_t i = 0; i < group_width; ++i)
+            bits |= uint32_t(m_ctrl[i] < 0) << i;
+        return group_mask(bits);
+#endif
+    }
+
+private:
+    group_mask match_byte(int8_t value) const
+    {
+#if defined(ZABATO_HASH_GROUP_SSE2)
+        const __m128i equal = _mm_cmpeq_epi8(m_ctrl, _mm_set1_epi8(value));
+        return group_mask(uint32_t(_mm_movemask_epi8(equal)));
+#elif defined(ZABATO_HASH_GROUP_NEON)
+        return to_mask(vceqq_s8(m_ctrl, vdupq_n_s8(value)));
+#else
+        uint32_t bits = 0;
+        for (size_t i = 0; i < group_width; ++i)
+            bits |= uint32_t(m_ctrl[i] == value) << i;
+        return group_mask(bits);
+#endif
+    }
+
+#if defined(ZABATO_HASH_GROUP_SSE2)
+    __m128i m_ctrl;
+#elif defined(ZABATO_HASH_GROUP_NEON)
+    /** @brief Packs the lanes of a comparison into one bit each. */
+    static group_mask to_mask(uint8x16_t lanes)
+    {
+        static const uint8_t weights[16] = {
+            1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+        const uint8x16_t bits = vandq_u8(lanes, vld1q_u8(weights));
+        return group_mask(uint32_t(vaddv_u8(vget_low_u8(bits))) |
+                          uint32_t(vaddv_u8(vget_high_u8(bits))) << 8);
+    }
+
+    int8x16_t m_ctrl;
+#else
+    int8_t m_ctrl[group_width];
+#endif
+};
+
+/**
+ * @brief The groups a lookup visits, in order.
+ *
+ * Tables hold a power of two number of groups, and the triangular steps
+ * (1, 2, 3, ...) then visit each of them once.
+ */
+class probe_sequence
+{
+public:
+    probe_sequence(size_t hash, size_t capacity)
+        : m_mask(capacity / group_width - 1), m_group(hash_h1(hash) & m_mask)
+    {
+    }
+
+    /** @return The index of the first slot of the current group. */
+    size_t offset() const { return m_group * group_width; }
+
+    /** @brief Moves to the next group. */
+    void next()
+    {
+        ++m_step;
+        m_group = (m_group + m_step) & m_mask;
+    }
+
+private:
+    size_t m_mask;
+    size_t m_group;
+    size_t m_step = 0;
+};
+
+/**
+ * @return The capacity of a table with room for `count` slots, a power of two
+ * and a multiple of `group_width`.
+ */
+inline size_t normalize_capacity(size_t count)
+{
+    size_t capacity = group_width;
+    while (capacity < count)
+        capacity <<= 1;
+    return capacity;
+}
+
+/** @return The number of slots a table fills before growing, 7/8 of them. */
+inline size_t max_load(size_t capacity) { return capacity - capacity / 8; }
+
+/**
+ * @return The first empty or deleted slot on the probe sequence of a hash.
+ * The table must have one.
+ */
+inline size_t
+find_insert_slot(const int8_t *ctrl, size_t capacity, size_t hash)
+{
+    probe_sequence seq(hash, capacity);
+    for (;;)
+    {
+        const group g(ctrl + seq.offset());
+        const group_mask free = g.match_empty_or_deleted();
+        if (free)
+            return seq.offset() + free.lowest();
+        seq.next();
+    }
+}
+
+/**
+ * @brief Marks a slot as erased.
+ *
+ * A lookup stops at the first group holding an empty slot, so while the group
+ * of the slot still has one, no probe sequence runs past it and the slot can
+ * go back to empty. Only slots of groups that were full become deleted.
+ *
+ * @return True if the slot became empty, false if it became deleted.
+ */
+inline bool erase_ctrl(int8_t *ctrl, size_t index)
+{
+    const size_t first = index & ~(group_width - 1);
+    const bool empty   = bool(group(ctrl + first).match_empty());
+    ctrl[index]        = empty ? ctrl_empty : ctrl_deleted;
+    return empty;
+}
+} // namespace detail
+} // namespace zabato
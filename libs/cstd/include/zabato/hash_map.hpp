@@ -1,16 +1,24 @@
 #pragma once
 
 #include <zabato/allocator.hpp>
+#include <zabato/hash_group.hpp>
 #include <zabato/utils.hpp>
 
-#include <assert.h>
+#include <new>
 
 namespace zabato
 {
 /**
  * @class hash_map
- * @brief A dictionary container implemented using open-addressing with linear
- * probing.
+ * @brief A dictionary container implemented using open-addressing over
+ * groups of control bytes.
+ *
+ * Each slot has a control byte in an array apart from the entries, holding
+ * 7 bits of the hash of its key, or marking it empty or deleted. Lookups
+ * match a whole group of control bytes against the hash at once (SSE2 or
+ * NEON when available), and only compare the keys that match. Erasing
+ * leaves the other entries in place.
+ *
  * @tparam Key The type of keys.
  * @tparam Value The type of values.
  * @tparam Hasher A function object to compute the hash of a key.
@@ -25,29 +33,26 @@ template <typename Key,
 class hash_map
 {
 public:
-    enum class entry_state : uint8_t
-    {
-        empty,
-        tombstone,
-        occupied
-    };
-
     struct entry
     {
         Key key;
         Value value;
-        entry_state state;
     };
 
 private:
     using entry_allocator_type =
         typename Allocator::template rebind<entry>::other;
+    using ctrl_allocator_type =
+        typename Allocator::template rebind<int8_t>::other;
+
+    static constexpr size_t npos = size_t(-1);
 
 public:
     class iterator
     {
     public:
-        iterator(entry *ptr, entry *end) : m_ptr(ptr), m_end(end)
+        iterator(const int8_t *ctrl, entry *ptr, const int8_t *end)
+            : m_ctrl(ctrl), m_ptr(ptr), m_end(end)
         {
             // Advance to the first valid element
             advance_to_occupied();
@@ -59,8 +64,9 @@ public:
         /** @brief Pre-increment operator */
         iterator &operator++()
         {
-            if (m_ptr != m_end)
+            if (m_ctrl != m_end)
             {
+                m_ctrl++;
                 m_ptr++;
                 advance_to_occupied();
             }
@@ -88,21 +94,25 @@ public:
     private:
         void advance_to_occupied()
         {
-            while (m_ptr != m_end && m_ptr->state != entry_state::occupied)
+            while (m_ctrl != m_end && !detail::ctrl_is_full(*m_ctrl))
             {
+                m_ctrl++;
                 m_ptr++;
             }
         }
 
+        const int8_t *m_ctrl;
         entry *m_ptr;
-        entry *m_end;
+        const int8_t *m_end;
     };
 
     class const_iterator
     {
     public:
-        const_iterator(const entry *ptr, const entry *end)
-            : m_ptr(ptr), m_end(end)
+        const_iterator(const int8_t *ctrl,
+                       const entry *ptr,
+                       const int8_t *end)
+            : m_ctrl(ctrl), m_ptr(ptr), m_end(end)
         {
             // Advance to the first valid element
             advance_to_occupied();
@@ -114,8 +124,9 @@ public:
         /** @brief Pre-increment operator */
         const_iterator &operator++()
         {
-            if (m_ptr != m_end)
+            if (m_ctrl != m_end)
             {
+                m_ctrl++;
                 m_ptr++;
                 advance_to_occupied();
             }
@@ -142,54 +153,66 @@ public:
     private:
         void advance_to_occupied()
         {
-            while (m_ptr != m_end && m_ptr->state != entry_state::occupied)
+            while (m_ctrl != m_end && !detail::ctrl_is_full(*m_ctrl))
             {
+                m_ctrl++;
                 m_ptr++;
             }
         }
 
+        const int8_t *m_ctrl;
         const entry *m_ptr;
-        const entry *m_end;
+        const int8_t *m_end;
     };
 
     /** @brief Constructs an empty hash_map. */
     hash_map() noexcept
-        : m_entries(nullptr), m_size(0), m_capacity(0), m_allocator(),
-          m_hasher(), m_key_equal()
+        : m_ctrl(nullptr), m_entries(nullptr), m_size(0), m_capacity(0),
+          m_growth_left(0), m_allocator(), m_ctrl_allocator(), m_hasher(),
+          m_key_equal()
     {
     }
 
-    /** @brief Constructs an empty hash_map with an initial capacity. */
-    hash_map(size_t capacity) : hash_map() { resize(capacity); }
+    /**
+     * @brief Constructs an empty hash_map with an initial capacity.
+     * @param capacity The minimum number of slots, rounded up to a power of
+     * two.
+     */
+    hash_map(size_t capacity) : hash_map()
+    {
+        if (capacity > 0)
+            resize(detail::normalize_capacity(capacity));
+    }
 
     /** @brief Destroys the hash_map and its elements. */
     ~hash_map() { clear_and_free(); }
 
-    iterator begin() { return iterator(m_entries, m_entries + m_capacity); }
+    iterator begin()
+    {
+        return iterator(m_ctrl, m_entries, m_ctrl + m_capacity);
+    }
 
     iterator end()
     {
-        return iterator(m_entries + m_capacity, m_entries + m_capacity);
+        return iterator(m_ctrl + m_capacity,
+                        m_entries + m_capacity,
+                        m_ctrl + m_capacity);
     }
 
     const_iterator begin() const
     {
-        return const_iterator(m_entries, m_entries + m_capacity);
+        return const_iterator(m_ctrl, m_entries, m_ctrl + m_capacity);
     }
 
     const_iterator end() const
     {
-        return const_iterator(m_entries + m_capacity, m_entries + m_capacity);
+        return const_iterator(m_ctrl + m_capacity,
+                              m_entries + m_capacity,
+                              m_ctrl + m_capacity);
     }
 
-    const_iterator cbegin() const
-    {
-        return const_iterator(m_entries, m_entries + m_capacity);
-    }
-    const_iterator cend() const
-    {
-        return const_iterator(m_entries + m_capacity, m_entries + m_capacity);
-    }
+    const_iterator cbegin() const { return begin(); }
+    const_iterator cend() const { return end(); }
 
     /** @brief Removes all elements from the hash map. */
     void clear()
@@ -198,23 +221,25 @@ public:
         {
             for (size_t i = 0; i < m_capacity; ++i)
             {
-                if (m_entries[i].state == entry_state::occupied)
+                if (detail::ctrl_is_full(m_ctrl[i]))
                 {
                     m_entries[i].key.~Key();
                     m_entries[i].value.~Value();
                 }
             }
         }
-        for (size_t i = 0; i < m_capacity; ++i)
-        {
-            m_entries[i].state = entry_state::empty;
-        }
-        m_size = 0;
+        if (m_ctrl)
+            memset(m_ctrl, detail::ctrl_empty, m_capacity);
+        m_size        = 0;
+        m_growth_left = m_capacity ? detail::max_load(m_capacity) : 0;
     }
 
     /** @return The number of elements in the hash map. */
     size_t size() const { return m_size; }
 
+    /** @return The number of slots allocated, each `sizeof(entry)` + 1. */
+    size_t capacity() const { return m_capacity; }
+
     /**
      * @brief Adds a key-value pair to the map only if the key does not already
      * exist.
@@ -225,28 +250,12 @@ public:
      */
     bool add(const Key &key, const Value &value)
     {
-        if (m_capacity == 0 || m_size + 1 > m_capacity * 3 / 4)
-            resize(m_capacity == 0 ? 8 : (m_capacity * 3) / 2);
-
-        entry *target_entry = find_entry_internal(key);
+        const size_t hash = detail::mix_hash(m_hasher(key));
+        if (find_index(key, hash) != npos)
+            return false; // Key already exists
 
-        if (target_entry->state != entry_state::occupied)
-        {
-            new (&target_entry->key) Key(key);
-            try
-            {
-                new (&target_entry->value) Value(value);
-            }
-            catch (...)
-            {
-                target_entry->key.~Key();
-                throw;
-            }
-            target_entry->state = entry_state::occupied;
-            m_size++;
-            return true;
-        }
-        return false; // Key already exists
+        insert_new(hash, key, value);
+        return true;
     }
 
     /**
@@ -257,29 +266,13 @@ public:
      */
     void add_or_set(const Key &key, const Value &value)
     {
-        if (m_capacity == 0 || m_size + 1 > m_capacity * 3 / 4)
-            resize(m_capacity == 0 ? 8 : (m_capacity * 3) / 2);
-
-        entry *target_entry = find_entry_internal(key);
-
-        if (target_entry->state != entry_state::occupied)
-        {
-            new (&target_entry->key) Key(key);
-            try
-            {
-                new (&target_entry->value) Value(value);
-            }
-            catch (...)
-            {
-                target_entry->key.~Key();
-                throw;
-            }
-            target_entry->state = entry_state::occupied;
-            m_size++;
-        }
-        else
-            target_entry->value =
+        const size_t hash  = detail::mix_hash(m_hasher(key));
+        const size_t index = find_index(key, hash);
+        if (index != npos)
+            m_entries[index].value =
                 value; // Key already exists, just update the value
+        else
+            insert_new(hash, key, value);
     }
 
     /**
@@ -291,112 +284,177 @@ public:
      */
     bool set(const Key &key, const Value &value)
     {
-        if (m_size == 0)
+        Value *target = find(key);
+        if (!target)
             return false;
-        entry *target_entry = find_entry_internal(key);
-        if (target_entry && target_entry->state == entry_state::occupied)
-        {
-            target_entry->value = value;
-            return true;
-        }
-        return false;
+        *target = value;
+        return true;
     }
 
     /**
      * @brief Tries to get the value associated with a specific key.
+     * @tparam K The type of the key to search for (for transparent lookup).
      * @param key The key to search for.
      * @param[out] out_value A reference where the found value will be stored.
      * @return True if the key was found and the value was retrieved, false
      * otherwise.
      */
-    bool try_get_value(const Key &key, Value &out_value) const
+    template <typename K>
+    bool try_get_value(const K &key, Value &out_value) const
     {
-        if (m_size == 0)
+        const Value *target = find(key);
+        if (!target)
             return false;
-        const entry *target = find_entry_internal(key);
-        if (target && target->state == entry_state::occupied)
-        {
-            out_value = target->value;
-            return true;
-        }
-        return false;
+        out_value = *target;
+        return true;
+    }
+
+    /**
+     * @brief Finds the value associated with a specific key, in place.
+     *
+     * The key may be of any type that `Hasher` and `KeyEqual` accept and that
+     * hashes like an equal `Key`, e.g. a `string_view` or C string in a map
+     * keyed by `string`, so lookups do not build a temporary key.
+     *
+     * @tparam K The type of the key to search for (for transparent lookup).
+     * @param key The key to search for.
+     * @return A pointer to the value, or nullptr if the key is not in the map.
+     * The pointer is invalidated by the next insertion.
+     */
+    template <typename K> Value *find(const K &key)
+    {
+        if (m_size == 0)
+            return nullptr;
+        const size_t index = find_index(key, detail::mix_hash(m_hasher(key)));
+        return index != npos ? &m_entries[index].value : nullptr;
+    }
+
+    /** @copydoc find */
+    template <typename K> const Value *find(const K &key) const
+    {
+        return const_cast<hash_map *>(this)->find(key);
     }
 
     /**
      * @brief Checks if the map contains a specific key.
+     * @tparam K The type of the key to search for (for transparent lookup).
      * @param key The key to search for.
      * @return True if the key exists in the map, false otherwise.
      */
-    bool contains_key(const Key &key) const
+    template <typename K> bool contains_key(const K &key) const
     {
-        if (m_size == 0)
-            return false;
-        const entry *target = find_entry_internal(key);
-        return target && target->state == entry_state::occupied;
+        return find(key) != nullptr;
+    }
+
+    /** @copydoc contains_key */
+    template <typename K> bool contains(const K &key) const
+    {
+        return find(key) != nullptr;
     }
 
     /**
      * @brief Removes an element from the map.
+     * @tparam K The type of the key to remove (for transparent lookup).
      * @param key The key of the element to remove.
      * @return True if an element was removed, false otherwise.
      */
-    bool erase(const Key &key)
+    template <typename K> bool erase(const K &key)
     {
         if (m_size == 0)
             return false;
 
-        entry *target_entry = find_entry_internal(key);
-        if (target_entry->state == entry_state::occupied)
-        {
-            target_entry->state = entry_state::tombstone;
-            target_entry->key.~Key();
-            target_entry->value.~Value();
-            m_size--;
-            return true;
-        }
-        return false;
+        const size_t index = find_index(key, detail::mix_hash(m_hasher(key)));
+        if (index == npos)
+            return false;
+
+        m_entries[index].key.~Key();
+        m_entries[index].value.~Value();
+        if (detail::erase_ctrl(m_ctrl, index))
+            m_growth_left++;
+        m_size--;
+        return true;
     }
 
 private:
-    entry *find_entry_internal(const Key &key) const
+    template <typename K> size_t find_index(const K &key, size_t hash) const
     {
-        size_t index     = m_hasher(key) % m_capacity;
-        entry *tombstone = nullptr;
+        if (m_capacity == 0)
+            return npos;
 
-        for (size_t count = 0; count < m_capacity; count++)
+        detail::probe_sequence seq(hash, m_capacity);
+        const int8_t h2 = detail::hash_h2(hash);
+        for (;;)
         {
-            entry *current = &m_entries[index];
-            if (current->state == entry_state::occupied)
+            const detail::group g(m_ctrl + seq.offset());
+            for (detail::group_mask match = g.match(h2); match;
+                 match.clear_lowest())
             {
-                if (m_key_equal(current->key, key))
-                    return current;
+                const size_t index = seq.offset() + match.lowest();
+                if (m_key_equal(m_entries[index].key, key))
+                    return index;
             }
-            else if (current->state == entry_state::empty)
-                return tombstone ? tombstone : current;
-            else if (!tombstone)
-                tombstone = current;
+            if (g.match_empty())
+                return npos;
+            seq.next();
+        }
+    }
+
+    /** @brief Inserts a key known not to be in the map. */
+    void insert_new(size_t hash, const Key &key, const Value &value)
+    {
+        size_t index = m_capacity == 0
+                           ? npos
+                           : detail::find_insert_slot(m_ctrl, m_capacity, hash);
+        if (index == npos ||
+            (m_growth_left == 0 && m_ctrl[index] == detail::ctrl_empty))
+        {
+            rehash_for_insert();
+            index = detail::find_insert_slot(m_ctrl, m_capacity, hash);
+        }
 
-            index = (index + 1) % m_capacity;
+        entry *target_entry = &m_entries[index];
+        new (&target_entry->key) Key(key);
+        try
+        {
+            new (&target_entry->value) Value(value);
+        }
+        catch (...)
+        {
+            target_entry->key.~Key();
+            throw;
         }
 
-        assert(tombstone);
-        return tombstone;
+        if (m_ctrl[index] == detail::ctrl_empty)
+            m_growth_left--;
+        m_ctrl[index] = detail::hash_h2(hash);
+        m_size++;
+    }
+
+    /**
+     * @brief Makes room for one more entry: doubles the table, or rehashes it
+     * in place when deleted slots hold most of its load.
+     */
+    void rehash_for_insert()
+    {
+        if (m_capacity == 0)
+            resize(detail::group_width);
+        else if (m_size < detail::max_load(m_capacity) / 2)
+            resize(m_capacity);
+        else
+            resize(m_capacity * 2);
     }
 
     void resize(size_t new_capacity)
     {
+        int8_t *old_ctrl    = m_ctrl;
         entry *old_entries  = m_entries;
         size_t old_capacity = m_capacity;
 
+        m_ctrl     = m_ctrl_allocator.allocate(new_capacity);
         m_entries  = m_allocator.allocate(new_capacity);
         m_capacity = new_capacity;
-        m_size     = 0;
-
-        // Initialize all new entries to empty
-        for (size_t i = 0; i < m_capacity; ++i)
-        {
-            m_entries[i].state = entry_state::empty;
-        }
+        memset(m_ctrl, detail::ctrl_empty, m_capacity);
+        m_growth_left = detail::max_load(m_capacity) - m_size;
 
         if (!old_entries)
             return;
@@ -404,9 +462,13 @@ private:
         // Re-hash all existing elements into the new table
         for (size_t i = 0; i < old_capacity; ++i)
         {
-            if (old_entries[i].state == entry_state::occupied)
+            if (detail::ctrl_is_full(old_ctrl[i]))
             {
-                entry *dest = find_entry_internal(old_entries[i].key);
+                const size_t hash =
+                    detail::mix_hash(m_hasher(old_entries[i].key));
+                const size_t index =
+                    detail::find_insert_slot(m_ctrl, m_capacity, hash);
+                entry *dest = &m_entries[index];
 
                 // Move construct the key and value
                 new (&dest->key) Key(move(old_entries[i].key));
@@ -419,8 +481,7 @@ private:
                     dest->key.~Key();
                     throw;
                 }
-                dest->state = entry_state::occupied;
-                m_size++;
+                m_ctrl[index] = old_ctrl[i];
 
                 // Destruct the old moved-from objects
                 old_entries[i].key.~Key();
@@ -429,6 +490,7 @@ private:
         }
 
         m_allocator.deallocate(old_entries, old_capacity);
+        m_ctrl_allocator.deallocate(old_ctrl, old_capacity);
     }
 
     void clear_and_free()
@@ -437,17 +499,23 @@ private:
             return;
         clear();
         m_allocator.deallocate(m_entries, m_capacity);
-        m_entries  = nullptr;
-        m_size     = 0;
-        m_capacity = 0;
+        m_ctrl_allocator.deallocate(m_ctrl, m_capacity);
+        m_ctrl        = nullptr;
+        m_entries     = nullptr;
+        m_size        = 0;
+        m_capacity    = 0;
+        m_growth_left = 0;
     }
 
+    int8_t *m_ctrl;
     entry *m_entries;
     size_t m_size;
     size_t m_capacity;
+    size_t m_growth_left; ///< Empty slots left to fill before rehashing
 
     entry_allocator_type m_allocator;
+    ctrl_allocator_type m_ctrl_allocator;
     Hasher m_hasher;
     KeyEqual m_key_equal;
 };
-} // namespace zabato
\ No newline at end of file
+} // namespace zabato
@@ -2,10 +2,16 @@
 
 #include <new>
 #include <zabato/allocator.hpp>
+#include <zabato/hash_group.hpp>
 #include <zabato/utils.hpp>
 
 namespace zabato
 {
+/**
+ * @class hash_set
+ * @brief A set of unique keys, with the same control byte layout as
+ * `hash_map`.
+ */
 template <typename Key,
           typename Hash      = hash<Key>,
           typename Equals    = equal_to<Key>,
@@ -13,17 +19,9 @@ template <typename Key,
 class hash_set
 {
 private:
-    enum class entry_state : uint8_t
-    {
-        empty,
-        tombstone,
-        occupied
-    };
-
     struct entry
     {
         Key key;
-        entry_state state;
     };
 
 public:
@@ -38,8 +36,11 @@ public:
         using pointer         = Key *;
         using reference       = Key &;
 
-        iterator() : m_ptr(nullptr), m_end(nullptr) {}
-        iterator(entry *ptr, entry *end) : m_ptr(ptr), m_end(end) {}
+        iterator() : m_ctrl(nullptr), m_ptr(nullptr), m_end(nullptr) {}
+        iterator(const int8_t *ctrl, entry *ptr, const int8_t *end)
+            : m_ctrl(ctrl), m_ptr(ptr), m_end(end)
+        {
+        }
 
         /** @brief Dereferences the iterator to get the key. */
         reference operator*() const { return m_ptr->key; }
@@ -52,10 +53,12 @@ public:
         iterator &operator++()
         {
             // Move to the next slot
+            ++m_ctrl;
             ++m_ptr;
             // Scan forward to find the next occupied one
-            while (m_ptr < m_end && m_ptr->state != entry_state::occupied)
+            while (m_ctrl < m_end && !detail::ctrl_is_full(*m_ctrl))
             {
+                ++m_ctrl;
                 ++m_ptr;
             }
             return *this;
@@ -82,8 +85,9 @@ public:
         }
 
     private:
+        const int8_t *m_ctrl;
         entry *m_ptr;
-        entry *m_end;
+        const int8_t *m_end;
     };
 
     /**
@@ -97,9 +101,11 @@ public:
         using pointer         = const Key *;
         using reference       = const Key &;
 
-        const_iterator() : m_ptr(nullptr), m_end(nullptr) {}
-        const_iterator(const entry *ptr, const entry *end)
-            : m_ptr(ptr), m_end(end)
+        const_iterator() : m_ctrl(nullptr), m_ptr(nullptr), m_end(nullptr) {}
+        const_iterator(const int8_t *ctrl,
+                       const entry *ptr,
+                       const int8_t *end)
+            : m_ctrl(ctrl), m_ptr(ptr), m_end(end)
         {
         }
 
@@ -113,9 +119,11 @@ public:
          */
         const_iterator &operator++()
         {
+            ++m_ctrl;
             ++m_ptr;
-            while (m_ptr < m_end && m_ptr->state != entry_state::occupied)
+            while (m_ctrl < m_end && !detail::ctrl_is_full(*m_ctrl))
             {
+                ++m_ctrl;
                 ++m_ptr;
             }
             return *this;
@@ -142,17 +150,25 @@ public:
         }
 
     private:
+        const int8_t *m_ctrl;
         const entry *m_ptr;
-        const entry *m_end;
+        const int8_t *m_end;
     };
 
     /** @brief Constructs an empty hash_set. */
     hash_set() : hash_set(0) {}
 
-    /** @brief Constructs an empty hash_set with an initial capacity. */
-    hash_set(size_t capacity) : m_size(0), m_capacity(0), m_entries(nullptr)
+    /**
+     * @brief Constructs an empty hash_set with an initial capacity.
+     * @param capacity The minimum number of slots, rounded up to a power of
+     * two. 0 allocates nothing.
+     */
+    hash_set(size_t capacity)
+        : m_ctrl(nullptr), m_entries(nullptr), m_size(0), m_capacity(0),
+          m_growth_left(0)
     {
-        resize(capacity);
+        if (capacity > 0)
+            resize(detail::normalize_capacity(capacity));
     }
 
     /** @brief Destroys the hash_set and its elements. */
@@ -163,12 +179,13 @@ public:
     {
         if (!is_pod<Key>::value)
             for (size_t i = 0; i < m_capacity; ++i)
-                if (m_entries[i].state == entry_state::occupied)
+                if (detail::ctrl_is_full(m_ctrl[i]))
                     m_entries[i].key.~Key();
 
-        for (size_t i = 0; i < m_capacity; ++i)
-            m_entries[i].state = entry_state::empty;
-        m_size = 0;
+        if (m_ctrl)
+            memset(m_ctrl, detail::ctrl_empty, m_capacity);
+        m_size        = 0;
+        m_growth_left = m_capacity ? detail::max_load(m_capacity) : 0;
     }
 
     /** @return The number of items in the set. */
@@ -184,8 +201,7 @@ public:
     {
         if (m_size == 0)
             return false;
-        const entry *target = find_entry_internal(key);
-        return target && target->state == entry_state::occupied;
+        return find_index(key) != npos;
     }
 
     /**
@@ -197,11 +213,12 @@ public:
     {
         if (m_size == 0)
             return;
-        entry *target = find_entry_internal(key);
-        if (target && target->state == entry_state::occupied)
+        const size_t index = find_index(key);
+        if (index != npos)
         {
-            target->key.~Key();
-            target->state = entry_state::tombstone;
+            m_entries[index].key.~Key();
+            if (detail::erase_ctrl(m_ctrl, index))
+                m_growth_left++;
             m_size--;
         }
     }
@@ -213,19 +230,29 @@ public:
      */
     bool add(const Key &key)
     {
-        if (m_capacity == 0 || m_size + 1 > m_capacity * 3 / 4)
-            resize(m_capacity == 0 ? 8 : (m_capacity * 3) / 2);
-
-        entry *target = find_entry_internal(key);
-        if (target->state == entry_state::occupied)
+        const size_t hash = detail::mix_hash(m_hasher(key));
+        if (find_index(key, hash) != npos)
             return false; // Key already exists
 
+        size_t index = m_capacity == 0
+                           ? npos
+                           : detail::find_insert_slot(m_ctrl, m_capacity, hash);
+        if (index == npos ||
+            (m_growth_left == 0 && m_ctrl[index] == detail::ctrl_empty))
+        {
+            rehash_for_insert();
+            index = detail::find_insert_slot(m_ctrl, m_capacity, hash);
+        }
+
+        entry *target = &m_entries[index];
         if (is_pod<Key>::value)
             target->key = key;
         else
             new (&target->key) Key(key);
 
-        target->state = entry_state::occupied;
+        if (m_ctrl[index] == detail::ctrl_empty)
+            m_growth_left--;
+        m_ctrl[index] = detail::hash_h2(hash);
         m_size++;
         return true;
     }
@@ -241,13 +268,11 @@ public:
     {
         if (m_size == 0)
             return false;
-        const entry *target = find_entry_internal(equalKey);
-        if (target && target->state == entry_state::occupied)
-        {
-            actualKey = target->key;
-            return true;
-        }
-        return false;
+        const size_t index = find_index(equalKey);
+        if (index == npos)
+            return false;
+        actualKey = m_entries[index].key;
+        return true;
     }
 
     /**
@@ -258,13 +283,12 @@ public:
         if (m_size == 0)
             return end();
 
-        entry *ptr     = m_entries;
-        entry *end_ptr = m_entries + m_capacity;
-        while (ptr < end_ptr && ptr->state != entry_state::occupied)
-        {
-            ++ptr;
-        }
-        return iterator(ptr, end_ptr);
+        size_t index = 0;
+        while (!detail::ctrl_is_full(m_ctrl[index]))
+            ++index;
+        return iterator(m_ctrl + index,
+                        m_entries + index,
+                        m_ctrl + m_capacity);
     }
 
     /**
@@ -272,7 +296,9 @@ public:
      */
     iterator end()
     {
-        return iterator(m_entries + m_capacity, m_entries + m_capacity);
+        return iterator(m_ctrl + m_capacity,
+                        m_entries + m_capacity,
+                        m_ctrl + m_capacity);
     }
 
     /**
@@ -283,13 +309,12 @@ public:
         if (m_size == 0)
             return end();
 
-        entry *ptr     = m_entries;
-        entry *end_ptr = m_entries + m_capacity;
-        while (ptr < end_ptr && ptr->state != entry_state::occupied)
-        {
-            ++ptr;
-        }
-        return const_iterator(ptr, end_ptr);
+        size_t index = 0;
+        while (!detail::ctrl_is_full(m_ctrl[index]))
+            ++index;
+        return const_iterator(m_ctrl + index,
+                              m_entries + index,
+                              m_ctrl + m_capacity);
     }
 
     /**
@@ -297,76 +322,79 @@ public:
      */
     const_iterator end() const
     {
-        return const_iterator(m_entries + m_capacity, m_entries + m_capacity);
+        return const_iterator(m_ctrl + m_capacity,
+                              m_entries + m_capacity,
+                              m_ctrl + m_capacity);
     }
 
 private:
     using entry_allocator_type =
         typename Allocator::template rebind<entry>::other;
+    using ctrl_allocator_type =
+        typename Allocator::template rebind<int8_t>::other;
+
+    static constexpr size_t npos = size_t(-1);
+
+    template <typename K> size_t find_index(const K &key) const
+    {
+        return find_index(key, detail::mix_hash(m_hasher(key)));
+    }
 
-    template <typename K> entry *find_entry_internal(const K &key) const
+    template <typename K> size_t find_index(const K &key, size_t hash) const
     {
         if (m_capacity == 0)
-            return nullptr;
-        size_t index     = m_hasher(key) % m_capacity;
-        entry *tombstone = nullptr;
+            return npos;
 
-        for (size_t count = 0; count < m_capacity; count++)
+        detail::probe_sequence seq(hash, m_capacity);
+        const int8_t h2 = detail::hash_h2(hash);
+        for (;;)
         {
-            entry *current = &m_entries[index];
-            if (current->state == entry_state::occupied)
+            const detail::group g(m_ctrl + seq.offset());
+            for (detail::group_mask match = g.match(h2); match;
+                 match.clear_lowest())
             {
-                if (m_key_equal(current->key, key))
-                    return current;
+                const size_t index = seq.offset() + match.lowest();
+                if (m_key_equal(m_entries[index].key, key))
+                    return index;
             }
-            else if (current->state == entry_state::empty)
-                return tombstone ? tombstone : current;
-            else // It's a tombstone
-                if (!tombstone)
-                    tombstone = current;
-            index = (index + 1) % m_capacity;
+            if (g.match_empty())
+                return npos;
+            seq.next();
         }
-        return tombstone;
+    }
+
+    /**
+     * @brief Makes room for one more key: doubles the table, or rehashes it
+     * in place when deleted slots hold most of its load.
+     */
+    void rehash_for_insert()
+    {
+        if (m_capacity == 0)
+            resize(detail::group_width);
+        else if (m_size < detail::max_load(m_capacity) / 2)
+            resize(m_capacity);
+        else
+            resize(m_capacity * 2);
     }
 
     void resize(size_t new_capacity)
     {
+        int8_t *new_ctrl   = m_ctrl_allocator.allocate(new_capacity);
         entry *new_entries = m_allocator.allocate(new_capacity);
-
-        // Initialize new entries
-        for (size_t i = 0; i < new_capacity; ++i)
-            new_entries[i].state = entry_state::empty;
+        memset(new_ctrl, detail::ctrl_empty, new_capacity);
 
         try
         {
             // Re-hash all existing elements into the new table
             for (size_t i = 0; i < m_capacity; ++i)
             {
-                if (m_entries[i].state == entry_state::occupied)
+                if (detail::ctrl_is_full(m_ctrl[i]))
                 {
-                    Key &key = m_entries[i].key;
-                    // Find slot in new buffer manually since we can't use
-                    // member functions easily on raw buffer
-                    size_t index     = m_hasher(key) % new_capacity;
-                    entry *dest      = nullptr;
-                    entry *tombstone = nullptr;
-
-                    // Search for insertion spot
-                    for (size_t c = 0; c < new_capacity; c++)
-                    {
-                        entry *curr = &new_entries[index];
-                        if (curr->state == entry_state::empty)
-                        {
-                            dest = tombstone ? tombstone : curr;
-                            break;
-                        }
-                        else if (curr->state == entry_state::tombstone)
-                        {
-                            if (!tombstone)
-                                tombstone = curr;
-                        }
-                        index = (index + 1) % new_capacity;
-                    }
+                    Key &key          = m_entries[i].key;
+                    const size_t hash = detail::mix_hash(m_hasher(key));
+                    const size_t index =
+                        detail::find_insert_slot(new_ctrl, new_capacity, hash);
+                    entry *dest = &new_entries[index];
 
                     // Perform move/copy
                     if (is_pod<Key>::value)
@@ -374,7 +402,7 @@ private:
                     else
                         new (&dest->key) Key(move(key)); // Move construct
 
-                    dest->state = entry_state::occupied;
+                    new_ctrl[index] = m_ctrl[i];
                 }
             }
         }
@@ -383,11 +411,11 @@ private:
             // Rollback: destroy constructed elements in new_entries and free
             for (size_t i = 0; i < new_capacity; ++i)
             {
-                if (new_entries[i].state == entry_state::occupied &&
-                    !is_pod<Key>::value)
+                if (detail::ctrl_is_full(new_ctrl[i]) && !is_pod<Key>::value)
                     new_entries[i].key.~Key();
             }
             m_allocator.deallocate(new_entries, new_capacity);
+            m_ctrl_allocator.deallocate(new_ctrl, new_capacity);
             throw;
         }
 
@@ -395,15 +423,20 @@ private:
         if (!is_pod<Key>::value)
         {
             for (size_t i = 0; i < m_capacity; ++i)
-                if (m_entries[i].state == entry_state::occupied)
+                if (detail::ctrl_is_full(m_ctrl[i]))
                     m_entries[i].key.~Key();
         }
 
         if (m_entries)
+        {
             m_allocator.deallocate(m_entries, m_capacity);
+            m_ctrl_allocator.deallocate(m_ctrl, m_capacity);
+        }
 
-        m_entries  = new_entries;
-        m_capacity = new_capacity;
+        m_ctrl        = new_ctrl;
+        m_entries     = new_entries;
+        m_capacity    = new_capacity;
+        m_growth_left = detail::max_load(m_capacity) - m_size;
     }
 
     void clear_and_free()
@@ -412,16 +445,22 @@ private:
             return;
         clear();
         m_allocator.deallocate(m_entries, m_capacity);
-        m_entries  = nullptr;
-        m_size     = 0;
-        m_capacity = 0;
+        m_ctrl_allocator.deallocate(m_ctrl, m_capacity);
+        m_ctrl        = nullptr;
+        m_entries     = nullptr;
+        m_size        = 0;
+        m_capacity    = 0;
+        m_growth_left = 0;
     }
 
+    int8_t *m_ctrl;
     entry *m_entries;
     size_t m_size;
     size_t m_capacity;
+    size_t m_growth_left; ///< Empty slots left to fill before rehashing
 
     entry_allocator_type m_allocator;
+    ctrl_allocator_type m_ctrl_allocator;
     Hash m_hasher;
     Equals m_key_equal;
 };
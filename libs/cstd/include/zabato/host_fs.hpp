@@ -1,6 +1,7 @@
 #pragma once
 #include "error.hpp"
 #include "fs.hpp"
+#include "time.hpp"
 
 namespace zabato::fs
 {
@@ -12,6 +13,39 @@ public:
 
     ~host_fs() override;
 
+    /**
+     * @brief Answers `exists`, `is_dir`, `is_file`, `is_read_only` and `ls`
+     * from memory instead of asking the OS every time, for development
+     * builds loading loose files.
+     *
+     * The whole tree under the root is scanned once, now, and again on the
+     * first query after it expires or is invalidated. Writes, `mkdir` and
+     * `remove` through this file system invalidate it. Symbolic links and
+     * the paths below them are still asked of the OS.
+     *
+     * @param ttl How long a scan is trusted. Zero trusts it until
+     * `invalidate_cache`, e.g. when a file watcher reports changes.
+     */
+    void enable_cache(time ttl = time());
+
+    /** @brief Asks the OS for every query again and drops the cache. */
+    void disable_cache();
+
+    /**
+     * @brief Marks the cache stale, so the next query rescans. Call it when
+     * files change behind this file system's back.
+     */
+    void invalidate_cache();
+
+    /**
+     * @brief Watches the tree under the root with inotify on Linux and
+     * `ReadDirectoryChangesW` on Windows; other platforms cannot watch.
+     * Changes seen by `poll_changes` also invalidate the metadata cache.
+     * Watch and poll from one thread.
+     */
+    bool watch() override;
+    size_t poll_changes(vector<string> &paths) override;
+
 private:
     host_fs(string_view root_path);
 
@@ -0,0 +1,111 @@
+#pragma once
+#include "hash_map.hpp"
+#include "ice_fs.hpp"
+#include "string.hpp"
+#include "thread.hpp"
+#include "vector.hpp"
+
+#include <stdint.h>
+
+namespace zabato::fs
+{
+
+/** @brief How `http_ice_fs` fetches and caches. */
+struct http_ice_fs_config
+{
+    uint32_t block_size        = 64 * 1024;
+    uint32_t max_cached_blocks = 256;  ///< The budget of the memory cache.
+    uint32_t max_gap_blocks    = 2;    ///< Cached blocks fetched again.
+    bool persistent            = true; ///< Whether to use IndexedDB.
+    /**
+     * @brief Part of the IndexedDB keys besides the URL and the archive size.
+     * Change it, e.g. to a build id, when a new archive may have the same
+     * size as the old one.
+     */
+    string version;
+};
+
+/**
+ * @class http_ice_fs
+ * @brief An ICE archive on a web server, read with HTTP range requests in
+ * web builds, so a game starts without downloading the whole archive.
+ *
+ * Mounting fetches the start of the archive, holding the PACK, IDEX, HASH
+ * and DICT chunks, and nothing else. Entries are fetched when read, a block
+ * at a time: the blocks a read needs that are not cached are fetched with one
+ * request per run of adjacent blocks, and runs separated by a few cached
+ * blocks are fetched as one. Fetched blocks are kept in memory, up to a
+ * budget, and in IndexedDB, so the next session starts from the blocks the
+ * last one fetched.
+ *
+ * Requests are synchronous, so read from worker threads, as the resource
+ * manager does; the browser main thread may not block on them. The web
+ * build links with `-sFETCH`, and `-sASYNCIFY` for the IndexedDB cache.
+ * Other builds cannot mount.
+ */
+class http_ice_fs : public ice_fs
+{
+public:
+    /**
+     * @brief Mounts an archive.
+     * @param url The URL of the archive. Cross-origin servers must expose
+     * the `Content-Range` header.
+     */
+    http_ice_fs(const char *url, const http_ice_fs_config &config = {});
+    ~http_ice_fs() override;
+
+    bool mount(const char *url, const http_ice_fs_config &config = {});
+    bool unmount();
+
+    /** @return The size of the archive, 0 until the server told it. */
+    uint64_t get_archive_size() const;
+
+    /** @return The number of requests sent since mounting. */
+    uint64_t get_request_count() const;
+
+    /** @return The number of bytes fetched over the network since mounting. */
+    uint64_t get_bytes_fetched() const;
+
+protected:
+    size_t read_archive(uint64_t offset, void *data, size_t size) override;
+
+private:
+    friend class http_archive_stream;
+
+    struct cached_block
+    {
+        uint64_t block = 0;
+        vector<uint8_t> data; ///< Shorter than a block at the archive's end.
+    };
+
+    /**
+     * @brief Copies the part of a cached block within `[at, end)` to `out`
+     * and moves `at` past it.
+     * @return -1 if the block is not in memory, 1 if it is whole and 0 if it
+     * is the short last block of the archive.
+     */
+    int copy_cached(uint64_t block, uint64_t &at, uint64_t end, uint8_t *out);
+
+    /** @brief Moves a block from IndexedDB into memory, if it is there. */
+    bool load_stored(uint64_t block);
+
+    /** @brief Fetches blocks `[first, last]` with one request. */
+    bool fetch(uint64_t first, uint64_t last, vector<uint8_t> &bytes);
+
+    void insert(uint64_t block, const uint8_t *data, size_t size);
+    void store(uint64_t block, const uint8_t *data, size_t size);
+    string store_key(uint64_t block) const;
+
+    string m_url;
+    http_ice_fs_config m_config;
+
+    mutable mutex m_mutex; ///< Guards everything below.
+    vector<cached_block> m_blocks;
+    hash_map<uint64_t, uint32_t> m_slot_of; ///< Index into `m_blocks`.
+    uint32_t m_next_victim   = 0;           ///< Evicted in insertion order.
+    uint64_t m_size          = 0;
+    uint64_t m_request_count = 0;
+    uint64_t m_bytes_fetched = 0;
+};
+
+} // namespace zabato::fs
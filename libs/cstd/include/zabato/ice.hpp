@@ -3,15 +3,18 @@
 #include <zabato/berg.h>
 #include <zabato/error.hpp>
 #include <zabato/fixed_string.hpp>
+#include <zabato/hash_map.hpp>
 #include <zabato/math.hpp>
 #include <zabato/real.hpp>
 #include <zabato/span.hpp>
 #include <zabato/stream.hpp>
 #include <zabato/string.hpp>
+#include <zabato/thread.hpp>
 #include <zabato/vector.hpp>
 
 #include <iostream>
 #include <math.h>
+#include <stdatomic.h>
 #include <stdint.h>
 #include <zabato/be.hpp>
 #include <zabato/le.hpp>
@@ -89,9 +92,14 @@ struct chunk_header
 };
 
 static const chunk_id BERG_CHUNK_ID("BERG");
+static const chunk_id BERG_BLOCK_CHUNK_ID("BRGB");
 static const chunk_id CHUNK_INDEX("IDEX");
 static const chunk_id CHUNK_PACK("PACK");
 static const chunk_id CHUNK_FILE("FILE");
+static const chunk_id CHUNK_HASH("HASH");
+static const chunk_id CHUNK_DICT("DICT");
+static const chunk_id CHUNK_PAD("PAD ");
+static const chunk_id CHUNK_ATLAS("ATLS");
 
 #pragma pack(push, 1)
 
@@ -106,23 +114,723 @@ struct ICE_BERG_HEADER
     ice_uint32_t compressed_size;
 };
 
+/**
+ * @brief Header for a block-compressed Berg chunk in an ICE file.
+ *
+ * The payload is split into blocks of `block_size` bytes (the last one may be
+ * shorter), each compressed on its own. The header is followed by
+ * `block_count + 1` ice_uint32_t offsets, relative to the end of the table,
+ * then the blocks. Block `i` spans `[offset[i], offset[i + 1])`. A block as
+ * long as its uncompressed size is stored as is.
+ */
+struct ICE_BERG_BLOCK_HEADER
+{
+    /** The chunk ID of the original uncompressed data */
+    chunk_id original_chunk_id;
+    /** Size of the original uncompressed data */
+    ice_uint32_t original_size;
+    /** Uncompressed size of every block but the last */
+    ice_uint32_t block_size;
+    /** Number of blocks */
+    ice_uint32_t block_count;
+};
+
 struct ICE_INDEX_ENTRY
 {
     ice_uint64_t path_offset; //< Offset into string block
     ice_uint64_t data_offset; //< Offset of file/dir data
     ice_uint64_t size;        //< Size of data
-    ice_uint64_t flags;       //< Reserved, always 0
+    ice_uint64_t flags;       //< ICE_ENTRY_* bits
+};
+
+/** @brief The entry is a directory. */
+static constexpr uint64_t ICE_ENTRY_DIR = 1 << 0;
+/**
+ * @brief The entry data is an ICE_BERG_BLOCK_HEADER and its blocks, `size` is
+ * the uncompressed size.
+ */
+static constexpr uint64_t ICE_ENTRY_BERG_BLOCKS = 1 << 1;
+/**
+ * @brief The blocks of an ICE_ENTRY_BERG_BLOCKS entry were compressed with
+ * the Berg dictionary of the archive, stored in its DICT chunk.
+ */
+static constexpr uint64_t ICE_ENTRY_BERG_DICTIONARY = 1 << 2;
+/**
+ * @brief The entry has the same content as an earlier entry and points at
+ * its stored copy, with the flags it was stored with. Readers need no special
+ * handling, but must not assume that entries have distinct `data_offset`s.
+ */
+static constexpr uint64_t ICE_ENTRY_SHARED = 1 << 3;
+
+/**
+ * @brief A slot of the path hash table stored in the HASH chunk.
+ *
+ * The chunk follows the index chunk and holds a slot count (a power of two)
+ * then the slots, open-addressed with linear probing on `ice_path_hash`.
+ */
+struct ICE_HASH_SLOT
+{
+    ice_uint32_t hash;  //< Hash of the entry path
+    ice_uint32_t entry; //< Index of the entry plus one, 0 for an empty slot
 };
 
+/**
+ * @brief Payload of the PACK chunk.
+ *
+ * Archives written before `data_alignment` existed have a shorter payload,
+ * and readers take the missing fields as 0.
+ */
 struct ICE_PACK
 {
     ice_uint32_t version;
     ice_uint32_t file_count;
     ice_uint64_t root_dir_offset;
+    ice_uint32_t data_alignment; //< Alignment of FILE payloads, 0 or 1 if none
+};
+
+/**
+ * @brief Header of the ATLS chunk, the lookup table of the texture atlases
+ * `ice_packer::set_texture_atlas` builds.
+ *
+ * The header is followed by `page_count` ICE_ATLAS_PAGE, then
+ * `region_count` ICE_ATLAS_REGION sorted by path, then the NUL-terminated
+ * paths the records point into.
+ */
+struct ICE_ATLAS_HEADER
+{
+    ice_uint32_t version;
+    ice_uint32_t page_count;
+    ice_uint32_t region_count;
+};
+
+/** @brief A page of a texture atlas, a texture file of the archive. */
+struct ICE_ATLAS_PAGE
+{
+    ice_uint32_t path_offset; //< Offset into the paths
+    ice_uint16_t width;       //< Size of the page in pixels
+    ice_uint16_t height;
+};
+
+/** @brief Where a texture packed into an atlas page went. */
+struct ICE_ATLAS_REGION
+{
+    ice_uint32_t path_offset; //< Offset into the paths, of the original path
+    ice_uint32_t page;        //< Index of the page
+    ice_uint16_t x;           //< Pixel rect of the texture in the page
+    ice_uint16_t y;
+    ice_uint16_t width;
+    ice_uint16_t height;
 };
 
 #pragma pack(pop)
 
+/** @brief Version of the ATLS chunk layout. */
+static constexpr uint32_t ICE_ATLAS_VERSION = 1;
+
+/**
+ * @brief Hashes an archive path for the HASH chunk (32-bit FNV-1a).
+ * @param path A normalized path, without leading or trailing slashes.
+ */
+inline uint32_t ice_path_hash(string_view path)
+{
+    uint32_t hash = 2166136261u;
+    for (char c : path)
+    {
+        hash ^= (uint8_t)c;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+/** @brief Default uncompressed block size of block-compressed Berg chunks. */
+static constexpr size_t ICE_BERG_BLOCK_SIZE = 64 * 1024;
+
+/**
+ * @brief The Berg configuration chunks are compressed with.
+ * @param level A Berg compression level (`BERG_LEVEL_FASTEST` to
+ * `BERG_LEVEL_MAX`), or 0 for the archive default. Every level decodes at
+ * the same speed.
+ */
+inline berg_config ice_berg_config(int level = 0)
+{
+    if (level > 0)
+        return berg_get_level_config(level);
+
+    berg_config config    = berg_get_default_config();
+    config.lookahead_size = 16;
+    return config;
+}
+
+/**
+ * @brief One block of a block-compressed Berg chunk, compressed by
+ * `ice_compress_blocks`.
+ */
+struct ice_berg_block
+{
+    const uint8_t *data = nullptr; ///< The uncompressed block.
+    size_t size         = 0;
+    uint8_t *out        = nullptr; ///< The stored block, set when compressed.
+    size_t capacity     = 0;       ///< Size of the slot behind `out`.
+    size_t out_size     = 0;       ///< The bytes stored, compressed or not.
+    berg_error_t error  = BERG_OK;
+};
+
+/**
+ * @brief Splits data into blocks.
+ * @param data The data to split, referenced by the blocks.
+ * @param size The size of the data.
+ * @param block_size The uncompressed size of every block but the last.
+ * @param[out] blocks Receives the blocks, appended.
+ */
+inline void ice_split_blocks(const uint8_t *data,
+                             size_t size,
+                             size_t block_size,
+                             vector<ice_berg_block> &blocks)
+{
+    for (size_t at = 0; at < size; at += block_size)
+    {
+        ice_berg_block block;
+        block.data = data + at;
+        block.size = size - at < block_size ? size - at : block_size;
+        blocks.push_back(block);
+    }
+}
+
+namespace detail
+{
+/**
+ * @brief The Berg context of the calling thread, so compressing many small
+ * chunks does not set up the match tables every time.
+ */
+inline berg_context *ice_berg_context()
+{
+    thread_local vector<uint8_t> memory;
+    thread_local berg_context *context = nullptr;
+    if (!context)
+    {
+        memory.resize(berg_context_size());
+        context = berg_context_init(memory.data(), memory.size());
+    }
+    return context;
+}
+
+/** @brief Work shared by the threads of `ice_compress_blocks`. */
+struct ice_block_batch
+{
+    ice_berg_block *blocks;
+    size_t count;
+    berg_config config;
+    span<const uint8_t> dictionary;
+    atomic_size_t next;
+};
+
+inline void ice_compress_block(ice_berg_block &block,
+                               const berg_config &config,
+                               span<const uint8_t> dictionary)
+{
+    block.error = berg_compress_raw_dict(ice_berg_context(),
+                                         dictionary.data(),
+                                         dictionary.size(),
+                                         block.data,
+                                         block.size,
+                                         block.out,
+                                         block.capacity,
+                                         &block.out_size,
+                                         &config);
+    if (block.error < 0)
+        return;
+
+    // Readers tell stored blocks by their length.
+    if (block.out_size >= block.size)
+    {
+        memcpy(block.out, block.data, block.size);
+        block.out_size = block.size;
+    }
+}
+
+inline void ice_compress_worker(void *arg)
+{
+    ice_block_batch &batch = *static_cast<ice_block_batch *>(arg);
+    for (;;)
+    {
+        const size_t index =
+            atomic_fetch_add_explicit(&batch.next, 1, memory_order_relaxed);
+        if (index >= batch.count)
+            return;
+        ice_compress_block(
+            batch.blocks[index], batch.config, batch.dictionary);
+    }
+}
+} // namespace detail
+
+/**
+ * @brief Compresses blocks in parallel.
+ *
+ * Threads take the next block from a shared counter, so uneven blocks still
+ * spread across every thread. Each block only writes its own slot of
+ * `scratch`, the result does not depend on the thread count or scheduling.
+ *
+ * @param blocks The blocks, e.g. from `ice_split_blocks`.
+ * @param count The number of blocks.
+ * @param[out] scratch Holds the stored blocks, which `out` points into.
+ * @param thread_count Threads to use, including the calling one. 0 uses
+ * every hardware thread.
+ * @param level The compression level, see `ice_berg_config`.
+ * @param dictionary A Berg dictionary every block is compressed with, see
+ * `berg_compress_raw_dict`. Empty for none.
+ * @return The error of the first failed block, or BERG_OK.
+ */
+inline berg_error_t ice_compress_blocks(ice_berg_block *blocks,
+                                        size_t count,
+                                        vector<uint8_t> &scratch,
+                                        uint32_t thread_count,
+                                        int level                      = 0,
+                                        span<const uint8_t> dictionary = {})
+{
+    constexpr uint32_t max_threads = 64;
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        blocks[i].capacity = berg_estimate_max_compressed_size(blocks[i].size);
+        total += blocks[i].capacity;
+    }
+
+    scratch.resize(total);
+    uint8_t *slot = scratch.data();
+    for (size_t i = 0; i < count; ++i)
+    {
+        blocks[i].out = slot;
+        slot += blocks[i].capacity;
+    }
+
+    if (thread_count == 0)
+        thread_count = thread::hardware_concurrency();
+
+    size_t workers = min((size_t)thread_count, count);
+    workers        = min(workers, (size_t)max_threads);
+
+    detail::ice_block_batch batch;
+    batch.blocks = blocks;
+    batch.count  = count;
+    batch.config     = ice_berg_config(level);
+    batch.dictionary = dictionary;
+    atomic_init(&batch.next, 0);
+
+    if (workers > 1)
+    {
+        thread threads[max_threads - 1];
+        for (size_t w = 0; w + 1 < workers; ++w)
+            threads[w].start(detail::ice_compress_worker, &batch);
+
+        detail::ice_compress_worker(&batch);
+
+        for (size_t w = 0; w + 1 < workers; ++w)
+            threads[w].join();
+    }
+    else
+    {
+        detail::ice_compress_worker(&batch);
+    }
+
+    for (size_t i = 0; i < count; ++i)
+        if (blocks[i].error < 0)
+            return blocks[i].error;
+    return BERG_OK;
+}
+
+/**
+ * @class berg_block_reader
+ * @brief Random access into a block-compressed Berg chunk.
+ *
+ * Only the header and the offset table are read when opened. Reads then
+ * decompress the blocks they touch, keeping the last one so that sequential
+ * and nearby reads do not decompress a block twice. Blocks covered whole by a
+ * read are decompressed straight into the destination.
+ */
+class berg_block_reader
+{
+public:
+    /**
+     * @brief Reads raw bytes of the chunk from its source.
+     * @param context The context given to `open`.
+     * @param offset The absolute offset in the source.
+     * @return The number of bytes read.
+     */
+    using read_callback = size_t (*)(void *context,
+                                     uint64_t offset,
+                                     void *data,
+                                     size_t size);
+
+    /**
+     * @brief Opens a chunk.
+     * @param read Reads from the source holding the chunk.
+     * @param context Passed to `read`, must outlive the reader.
+     * @param offset The offset of the ICE_BERG_BLOCK_HEADER in the source.
+     * @param available The bytes of the source past `offset` that belong to
+     * the chunk.
+     * @param dictionary The Berg dictionary the blocks were compressed with,
+     * empty for none. It must outlive the reader.
+     */
+    result<void> open(read_callback read,
+                      void *context,
+                      uint64_t offset,
+                      uint64_t available,
+                      span<const uint8_t> dictionary = {})
+    {
+        close();
+
+        ICE_BERG_BLOCK_HEADER header;
+        if (available < sizeof(header) ||
+            read(context, offset, &header, sizeof(header)) != sizeof(header))
+            return report_error(error_code::unable_to_read);
+
+        const uint32_t size        = header.original_size;
+        const uint32_t block_size  = header.block_size;
+        const uint32_t block_count = header.block_count;
+        const uint64_t table_size =
+            (uint64_t(block_count) + 1) * sizeof(ice_uint32_t);
+        if (block_size == 0 ||
+            uint64_t(block_count) !=
+                (uint64_t(size) + block_size - 1) / block_size ||
+            available - sizeof(header) < table_size)
+            return report_error(error_code::chunk_broken,
+                                BERG_BLOCK_CHUNK_ID.to_string().c_str(),
+                                (uint32_t)BERG_BLOCK_CHUNK_ID);
+
+        vector<ice_uint32_t> table(block_count + 1);
+        if (read(context, offset + sizeof(header), table.data(), table_size) !=
+            table_size)
+            return report_error(error_code::unable_to_read);
+
+        const uint64_t data_size = available - sizeof(header) - table_size;
+        m_offsets.resize(block_count + 1);
+        for (uint32_t i = 0; i <= block_count; ++i)
+        {
+            m_offsets[i] = table[i];
+            if (m_offsets[i] > data_size ||
+                (i > 0 && m_offsets[i] < m_offsets[i - 1]))
+            {
+                m_offsets.clear();
+                return report_error(error_code::chunk_broken,
+                                    BERG_BLOCK_CHUNK_ID.to_string().c_str(),
+                                    (uint32_t)BERG_BLOCK_CHUNK_ID);
+            }
+        }
+
+        m_read        = read;
+        m_context     = context;
+        m_data_offset = offset + sizeof(header) + table_size;
+        m_header      = header;
+        m_dictionary  = dictionary;
+        return result<void>();
+    }
+
+    /** @brief Releases the chunk and the cached block. */
+    void close()
+    {
+        m_read       = nullptr;
+        m_context    = nullptr;
+        m_header     = {};
+        m_dictionary = {};
+        m_offsets.clear();
+        m_block.clear();
+        m_compressed.clear();
+        m_cached = no_block;
+    }
+
+    /** @return True if a chunk is open. */
+    bool is_open() const { return m_read != nullptr; }
+
+    /** @return The chunk ID of the original uncompressed data. */
+    chunk_id original_id() const { return m_header.original_chunk_id; }
+
+    /** @return The uncompressed size. */
+    uint64_t size() const { return (uint32_t)m_header.original_size; }
+
+    /**
+     * @brief Reads uncompressed bytes.
+     * @param offset The uncompressed offset to read from.
+     * @param data The destination buffer.
+     * @param size The number of bytes to read.
+     * @return The number of bytes read, short at the end of the data or if a
+     * block fails to decompress.
+     */
+    size_t read(uint64_t offset, void *data, size_t size)
+    {
+        if (offset >= this->size())
+            return 0;
+        if (size > this->size() - offset)
+            size = (size_t)(this->size() - offset);
+
+        const uint32_t block_size = m_header.block_size;
+        uint8_t *out              = static_cast<uint8_t *>(data);
+        size_t total              = 0;
+        while (total < size)
+        {
+            const uint64_t at    = offset + total;
+            const uint32_t index = (uint32_t)(at / block_size);
+            const size_t skip    = (size_t)(at % block_size);
+            const size_t length  = block_length(index);
+            size_t count         = length - skip;
+            if (count > size - total)
+                count = size - total;
+
+            if (skip == 0 && count == length && index != m_cached)
+            {
+                if (!decode_block(index, out + total))
+                    break;
+            }
+            else
+            {
+                if (index != m_cached)
+                {
+                    m_block.resize(length);
+                    m_cached = no_block;
+                    if (!decode_block(index, m_block.data()))
+                        break;
+                    m_cached = index;
+                }
+                memcpy(out + total, m_block.data() + skip, count);
+            }
+            total += count;
+        }
+        return total;
+    }
+
+    /**
+     * @brief Decompresses the whole chunk.
+     * @param out_data Receives the uncompressed data.
+     */
+    result<void> read_all(vector<uint8_t> &out_data)
+    {
+        out_data.resize(size());
+        if (read(0, out_data.data(), out_data.size()) != out_data.size())
+            return report_error(error_code::fail_to_decompress_berg,
+                                original_id().to_string().c_str(),
+                                (uint32_t)original_id(),
+                                BERG_ERROR_CORRUPT_DATA);
+        return result<void>();
+    }
+
+private:
+    static constexpr uint32_t no_block = 0xFFFFFFFFu;
+
+    /** @return The uncompressed length of a block. */
+    size_t block_length(uint32_t index) const
+    {
+        const uint64_t block_size = (uint32_t)m_header.block_size;
+        const uint64_t left       = size() - uint64_t(index) * block_size;
+        return (size_t)(left < block_size ? left : block_size);
+    }
+
+    /** @brief Decompresses a block into `out`, `block_length` bytes long. */
+    bool decode_block(uint32_t index, uint8_t *out)
+    {
+        const size_t length     = block_length(index);
+        const size_t compressed = m_offsets[index + 1] - m_offsets[index];
+        const uint64_t at       = m_data_offset + m_offsets[index];
+
+        if (compressed == length)
+            return m_read(m_context, at, out, length) == length;
+
+        m_compressed.resize(compressed);
+        if (m_read(m_context, at, m_compressed.data(), compressed) !=
+            compressed)
+            return false;
+
+        size_t decompressed = 0;
+        auto d_err          = berg_decompress_raw_dict(m_dictionary.data(),
+                                              m_dictionary.size(),
+                                              m_compressed.data(),
+                                              compressed,
+                                              out,
+                                              length,
+                                              length,
+                                              &decompressed);
+        return d_err >= 0 && decompressed == length;
+    }
+
+    read_callback m_read   = nullptr;
+    void *m_context        = nullptr;
+    uint64_t m_data_offset = 0; ///< Source offset of the first block.
+    ICE_BERG_BLOCK_HEADER m_header{};
+    span<const uint8_t> m_dictionary;
+    vector<uint64_t> m_offsets;  ///< Block offsets, relative to the data.
+    vector<uint8_t> m_block;     ///< The last partially read block.
+    vector<uint8_t> m_compressed;
+    uint32_t m_cached = no_block; ///< Index of `m_block`, or `no_block`.
+};
+
+/**
+ * @class berg_chunk_reader
+ * @brief Sequential reads from a Berg chunk, decompressed as they go.
+ *
+ * The compressed payload is read from the stream in small pieces and
+ * decompressed straight into the destination of each read, so only the
+ * decoder window and one piece of input are held however large the chunk
+ * is. A whole chunk can land in its final buffer, e.g. a texture upload
+ * buffer, without an intermediate copy.
+ */
+class berg_chunk_reader
+{
+public:
+    /** @brief Compressed bytes read from the stream at a time. */
+    static constexpr size_t input_piece_size = 16 * 1024;
+
+    /**
+     * @brief Opens the chunk at the stream position, its ICE_BERG_HEADER,
+     * as `ice_reader::find_chunk_or_berg` leaves it. Reads move the stream
+     * position, which ends past the chunk once every byte was read.
+     * @param source The stream holding the chunk, must outlive the reader.
+     * @param available The payload size from the chunk header, to check the
+     * Berg header against. The default trusts it.
+     */
+    result<void> open(stream &source, uint64_t available = UINT64_MAX)
+    {
+        close();
+
+        ICE_BERG_HEADER header;
+        auto buf = as_writable_bytes(header);
+        if (available < sizeof(header) || source.read(buf) != sizeof(header))
+            return report_error(error_code::unable_to_read);
+
+        const uint32_t compressed = header.compressed_size;
+        if (compressed > available - sizeof(header))
+            return report_error(error_code::chunk_broken,
+                                BERG_CHUNK_ID.to_string().c_str(),
+                                (uint32_t)BERG_CHUNK_ID);
+
+        m_decoder_memory.resize(berg_decoder_size());
+        m_decoder = berg_decoder_init(m_decoder_memory.data(),
+                                      m_decoder_memory.size(),
+                                      (uint32_t)header.original_size);
+        m_input.resize(min((size_t)compressed, input_piece_size));
+        m_stream          = &source;
+        m_header          = header;
+        m_compressed_left = compressed;
+        return result<void>();
+    }
+
+    /** @brief Releases the chunk. */
+    void close()
+    {
+        m_stream          = nullptr;
+        m_decoder         = nullptr;
+        m_header          = {};
+        m_compressed_left = 0;
+        m_input_pos       = 0;
+        m_input_size      = 0;
+        m_position        = 0;
+        m_failed          = false;
+    }
+
+    /** @return True if a chunk is open. */
+    bool is_open() const { return m_decoder != nullptr; }
+
+    /** @return The chunk ID of the original uncompressed data. */
+    chunk_id original_id() const { return m_header.original_chunk_id; }
+
+    /** @return The uncompressed size. */
+    uint64_t size() const { return (uint32_t)m_header.original_size; }
+
+    /** @return The number of uncompressed bytes read so far. */
+    uint64_t tell() const { return m_position; }
+
+    /** @return True once every byte was read. */
+    bool eof() const { return m_position >= size(); }
+
+    /** @return True if the chunk turned out truncated or corrupt. */
+    bool failed() const { return m_failed; }
+
+    /**
+     * @brief Reads the next uncompressed bytes.
+     * @param data The destination buffer.
+     * @param size The number of bytes to read.
+     * @return The number of bytes read, short at the end of the data or if
+     * the chunk is broken, see `failed`.
+     */
+    size_t read(void *data, size_t size)
+    {
+        uint8_t *out = static_cast<uint8_t *>(data);
+        size_t total = 0;
+        while (total < size && is_open() && !m_failed && !eof())
+        {
+            if (m_input_pos == m_input_size && m_compressed_left > 0)
+            {
+                m_input_pos  = 0;
+                m_input_size = min(m_input.size(), (size_t)m_compressed_left);
+                buffer piece(m_input.data(), m_input_size);
+                if (m_stream->read(piece) != m_input_size)
+                {
+                    m_input_size = 0;
+                    m_failed     = true;
+                    break;
+                }
+                m_compressed_left -= m_input_size;
+            }
+
+            size_t used = 0, written = 0;
+            auto d_err  = berg_decoder_decompress(m_decoder,
+                                                 m_input.data() + m_input_pos,
+                                                 m_input_size - m_input_pos,
+                                                 &used,
+                                                 out + total,
+                                                 size - total,
+                                                 &written);
+            m_input_pos += used;
+            m_position += written;
+            total += written;
+
+            // Out of input with the output unfinished means truncated data.
+            if (d_err < 0 || (d_err == BERG_OK_MORE && written == 0 &&
+                              m_input_pos == m_input_size &&
+                              m_compressed_left == 0))
+                m_failed = true;
+        }
+        return total;
+    }
+
+    /**
+     * @brief Decompresses the rest of the chunk into a caller buffer.
+     * @param data The destination, e.g. the final home of the data.
+     * @param capacity The size of the destination, at least what is left.
+     */
+    result<void> read_all(void *data, size_t capacity)
+    {
+        const uint64_t left = size() - tell();
+        if (capacity < left || read(data, (size_t)left) != left)
+            return report_error(error_code::fail_to_decompress_berg,
+                                original_id().to_string().c_str(),
+                                (uint32_t)original_id(),
+                                capacity < left ? BERG_ERROR_BUFFER_TOO_SMALL
+                                                : BERG_ERROR_CORRUPT_DATA);
+        return result<void>();
+    }
+
+    /**
+     * @brief Decompresses the rest of the chunk.
+     * @param out_data Receives the uncompressed data.
+     */
+    result<void> read_all(vector<uint8_t> &out_data)
+    {
+        out_data.resize((size_t)(size() - tell()));
+        return read_all(out_data.data(), out_data.size());
+    }
+
+private:
+    stream *m_stream        = nullptr;
+    berg_decoder *m_decoder = nullptr;
+    ICE_BERG_HEADER m_header{};
+    vector<uint8_t> m_decoder_memory;
+    vector<uint8_t> m_input;        ///< The last piece of compressed input.
+    uint64_t m_compressed_left = 0; ///< Compressed bytes not read yet.
+    size_t m_input_pos         = 0; ///< Next unused byte of `m_input`.
+    size_t m_input_size        = 0; ///< Bytes of `m_input` holding input.
+    uint64_t m_position        = 0;
+    bool m_failed              = false;
+};
+
 /**
  * @class ice_reader
  * @brief Reads data and chunks from an ICE stream.
@@ -137,17 +845,91 @@ public:
     ice_reader &operator=(const ice_reader &other)
     {
         m_stream = other.m_stream;
+        clear_directory();
         return *this;
     }
     ice_reader &operator=(ice_reader &&other)
     {
         m_stream = other.m_stream;
+        clear_directory();
         return *this;
     }
 
     /** @brief Resets the underlying stream to the beginning. */
     void rewind() { m_stream.rewind(); }
 
+    /**
+     * @brief Indexes the top-level chunks of the stream, so that lookups take
+     * one seek instead of walking the chunk headers.
+     *
+     * `find_chunk_or_berg` builds the directory on its first call, as it scans
+     * from the start anyway. `find_chunk` uses it once built, when called at a
+     * top-level chunk boundary. The stream must not change afterwards. The
+     * stream position is preserved.
+     *
+     * @return False if the stream is not a sequence of chunks, in which case
+     * lookups keep scanning.
+     */
+    bool build_directory()
+    {
+        clear_directory();
+        const size_t start = m_stream.tell();
+        m_stream.rewind();
+
+        bool ok = true;
+        for (;;)
+        {
+            chunk_location location;
+            location.offset = m_stream.tell();
+
+            auto buf   = as_writable_bytes(location.header);
+            size_t got = m_stream.read(buf);
+            if (got == 0)
+                break;
+            if (got != sizeof(location.header))
+            {
+                ok = false;
+                break;
+            }
+
+            location.original_id = location.header.id;
+            size_t payload       = location.header.size;
+            if (is_berg(location.header.id))
+            {
+                // Index compressed chunks by the chunk they hold, the first
+                // field of both Berg headers.
+                auto id_buf = as_writable_bytes(location.original_id);
+                if (payload < sizeof(chunk_id) ||
+                    m_stream.read(id_buf) != sizeof(chunk_id))
+                {
+                    ok = false;
+                    break;
+                }
+                payload -= sizeof(chunk_id);
+            }
+            m_stream.skip(payload);
+
+            // Lookups return the first chunk of an id, as a scan would.
+            m_first.add((uint32_t)location.original_id, m_directory.size());
+            m_directory.push_back(location);
+        }
+
+        m_stream.pos(start);
+        if (!ok)
+            clear_directory();
+        m_directory_state = ok ? directory_state::ready
+                               : directory_state::unavailable;
+        return ok;
+    }
+
+    /** @brief Drops the chunk directory, e.g. after the stream changed. */
+    void clear_directory()
+    {
+        m_directory.clear();
+        m_first.clear();
+        m_directory_state = directory_state::none;
+    }
+
     /**
      * @brief Finds the next chunk with the specified ID.
      * @param id The four-character code of the chunk to find.
@@ -156,6 +938,26 @@ public:
      */
     result<chunk_header> find_chunk(chunk_id id)
     {
+        if (m_directory_state == directory_state::ready)
+        {
+            size_t index = 0;
+            if (find_location(m_stream.tell(), index))
+            {
+                for (; index < m_directory.size(); ++index)
+                {
+                    const chunk_location &location = m_directory[index];
+                    if (location.header.id == id)
+                    {
+                        m_stream.pos(location.offset + sizeof(chunk_header));
+                        return location.header;
+                    }
+                }
+                return report_error(error_code::chunk_not_reached,
+                                    id.to_string().c_str(),
+                                    (uint32_t)id);
+            }
+        }
+
         chunk_header header = {0, 0};
         while (!m_stream.eof())
         {
@@ -178,12 +980,32 @@ public:
      * @brief Finds a chunk, checking for both original and Berg-compressed
      * versions.
      * @param original_chunk_id The ID of the original uncompressed chunk type
-     * @param out_compressed Set to true if a Berg-compressed version was found
+     * @param out_compressed Set to true if a Berg-compressed version was found,
+     * whose header id tells whether it is whole (BERG_CHUNK_ID) or in blocks
+     * (BERG_BLOCK_CHUNK_ID)
      * @return A header with the chunk's ID and size, or error if not found
      */
     result<chunk_header> find_chunk_or_berg(chunk_id original_chunk_id,
                                             bool &out_compressed)
     {
+        if (m_directory_state == directory_state::none)
+            build_directory();
+
+        if (m_directory_state == directory_state::ready)
+        {
+            const size_t *index = m_first.find((uint32_t)original_chunk_id);
+            if (!index)
+                return report_error(error_code::chunk_not_reached,
+                                    original_chunk_id.to_string().c_str(),
+                                    (uint32_t)original_chunk_id);
+
+            // Compressed chunks are left at their Berg header, as below.
+            const chunk_location &location = m_directory[*index];
+            m_stream.pos(location.offset + sizeof(chunk_header));
+            out_compressed = location.header.id != original_chunk_id;
+            return location.header;
+        }
+
         rewind(); // Start from beginning
 
         chunk_header header = {0, 0};
@@ -198,29 +1020,29 @@ public:
                 out_compressed = false;
                 return header; // Found uncompressed version
             }
-            else if (header.id == BERG_CHUNK_ID)
+            else if (is_berg(header.id))
             {
                 // Check if this Berg chunk contains our target chunk
-                ICE_BERG_HEADER berg_header;
-                auto buf = as_writable_bytes(berg_header);
-                if (m_stream.read(buf) != sizeof(berg_header))
+                chunk_id held = 0;
+                auto buf      = as_writable_bytes(held);
+                if (m_stream.read(buf) != sizeof(held))
                 {
                     m_stream.skip(header.size -
-                                  sizeof(berg_header)); // Skip rest of chunk
+                                  sizeof(held)); // Skip rest of chunk
                     continue;
                 }
 
-                if (berg_header.original_chunk_id == original_chunk_id)
+                if (held == original_chunk_id)
                 {
                     // Found compressed version! Rewind to start of Berg chunk
-                    m_stream.skip(-static_cast<int64_t>(sizeof(berg_header)));
+                    m_stream.skip(-static_cast<int64_t>(sizeof(held)));
                     out_compressed = true;
                     return header;
                 }
                 else
                 {
                     // Not our chunk, skip the compressed data
-                    m_stream.skip(header.size - sizeof(berg_header));
+                    m_stream.skip(header.size - sizeof(held));
                 }
             }
             else
@@ -237,6 +1059,10 @@ public:
 
     /**
      * @brief Reads and decompresses a Berg chunk.
+     *
+     * The compressed data is streamed through a `berg_chunk_reader`, so only
+     * the decompressed data is held whole.
+     *
      * @param expected_original_id The expected original chunk ID
      * @param out_data Output vector to store decompressed data
      * @return Result indicating success or failure
@@ -244,55 +1070,90 @@ public:
     result<void> read_berg_chunk(chunk_id expected_original_id,
                                  vector<uint8_t> &out_data)
     {
-        // Read Berg header
-        ICE_BERG_HEADER berg_header;
-        if (read(&berg_header, sizeof(berg_header)) != sizeof(berg_header))
-            return report_error(error_code::unable_to_read);
+        berg_chunk_reader chunk;
+        auto open_result = open_berg_chunk(expected_original_id, chunk);
+        if (open_result.has_error())
+            return open_result.error;
+
+        return chunk.read_all(out_data);
+    }
+
+    /**
+     * @brief Opens the Berg chunk at the stream position for incremental
+     * reads, e.g. straight into the buffer the data ends up in.
+     *
+     * The stream must be positioned at the ICE_BERG_HEADER, as
+     * `find_chunk_or_berg` leaves it. Reads through `out_reader` move the
+     * stream position.
+     *
+     * @param expected_original_id The expected original chunk ID
+     * @param[out] out_reader The reader to open.
+     */
+    result<void> open_berg_chunk(chunk_id expected_original_id,
+                                 berg_chunk_reader &out_reader)
+    {
+        auto open_result = out_reader.open(m_stream);
+        if (open_result.has_error())
+            return open_result.error;
 
         // Verify this is the chunk we expect
-        if (berg_header.original_chunk_id != expected_original_id)
+        if (out_reader.original_id() != expected_original_id)
         {
             std::cout << "Expected chunk ID: "
                       << expected_original_id.to_string().c_str()
-                      << " but got: " << berg_header.original_chunk_id
+                      << " but got: " << out_reader.original_id()
                       << std::endl;
+            out_reader.close();
             return report_error(error_code::chunk_broken, BERG_CHUNK_ID);
         }
 
-        // Read compressed data
-        vector<uint8_t> compressed_data(berg_header.compressed_size);
-        if (read(compressed_data.data(), compressed_data.size()) !=
-            berg_header.compressed_size)
-            return report_error(error_code::unable_to_read);
+        return result<void>();
+    }
 
-        // Decompress data
-        out_data.resize(berg_header.original_size);
-        size_t decompressed_size = 0;
+    /**
+     * @brief Opens the block-compressed Berg chunk at the stream position for
+     * random access, without reading the blocks.
+     *
+     * The stream must be positioned at the ICE_BERG_BLOCK_HEADER, as
+     * `find_chunk_or_berg` leaves it. Reads through `out_reader` move the
+     * stream position.
+     *
+     * @param chunk_size The payload size from the chunk header.
+     * @param[out] out_reader The reader to open.
+     */
+    result<void> open_berg_blocks(size_t chunk_size,
+                                  berg_block_reader &out_reader)
+    {
+        return out_reader.open(
+            read_stream_at, &m_stream, m_stream.tell(), chunk_size);
+    }
 
-        auto d_err = berg_decompress_raw(compressed_data.data(),
-                                         compressed_data.size(),
-                                         out_data.data(),
-                                         out_data.size(),
-                                         berg_header.original_size,
-                                         &decompressed_size);
+    /**
+     * @brief Reads and decompresses a block-compressed Berg chunk.
+     * @param expected_original_id The expected original chunk ID
+     * @param chunk_size The payload size from the chunk header
+     * @param out_data Output vector to store decompressed data
+     * @return Result indicating success or failure
+     */
+    result<void> read_berg_block_chunk(chunk_id expected_original_id,
+                                       size_t chunk_size,
+                                       vector<uint8_t> &out_data)
+    {
+        const size_t end = m_stream.tell() + chunk_size;
 
-        if (d_err < 0)
-            return report_error(error_code::fail_to_decompress_berg,
-                                expected_original_id.to_string().c_str(),
-                                (uint32_t)expected_original_id,
-                                d_err);
+        berg_block_reader blocks;
+        auto open_result = open_berg_blocks(chunk_size, blocks);
+        if (open_result.has_error())
+            return open_result.error;
 
-        out_data.resize(decompressed_size);
-        // Verify decompressed size matches expected
-        if (out_data.size() != berg_header.original_size)
-        {
-            std::cout << "Decompressed size: " << out_data.size()
-                      << " but expected: " << berg_header.original_size
-                      << std::endl;
-            return report_error(error_code::chunk_broken, BERG_CHUNK_ID);
-        }
+        if (blocks.original_id() != expected_original_id)
+            return report_error(error_code::chunk_broken,
+                                BERG_BLOCK_CHUNK_ID.to_string().c_str(),
+                                (uint32_t)BERG_BLOCK_CHUNK_ID);
 
-        return result<void>();
+        auto read_result = blocks.read_all(out_data);
+        m_stream.pos(end);
+        return read_result;
     }
 
     result<void> find_and_read(chunk_id id, vector<uint8_t> &out_data)
@@ -302,6 +1163,8 @@ public:
         if (error)
             return error;
 
+        if (is_compressed && header.id == BERG_BLOCK_CHUNK_ID)
+            return read_berg_block_chunk(id, header.size, out_data);
         if (is_compressed)
             return read_berg_chunk(id, out_data);
 
@@ -332,8 +1195,67 @@ public:
         return read(buf);
     }
 
+    /**
+     * @brief Moves past the next `size` bytes and returns them in place when
+     * the stream holds them in memory, e.g. a prefetched file or an entry of
+     * a mapped archive, so a payload can be decoded without a copy.
+     * @return The bytes, valid until the next read, or null with the position
+     * unchanged, in which case `read` them instead.
+     */
+    const uint8_t *view(size_t size) { return m_stream.view(size); }
+
 private:
+    /** @brief A top-level chunk found by `build_directory`. */
+    struct chunk_location
+    {
+        chunk_header header  = {0, 0};
+        chunk_id original_id = 0; ///< The id held by a Berg chunk.
+        size_t offset        = 0; ///< Offset of the chunk header.
+    };
+
+    enum class directory_state : uint8_t
+    {
+        none,
+        ready,
+        unavailable,
+    };
+
+    static bool is_berg(chunk_id id)
+    {
+        return id == BERG_CHUNK_ID || id == BERG_BLOCK_CHUNK_ID;
+    }
+
+    static size_t
+    read_stream_at(void *context, uint64_t offset, void *data, size_t size)
+    {
+        stream &source = *static_cast<stream *>(context);
+        source.pos((int64_t)offset);
+        buffer buf(static_cast<uint8_t *>(data), size);
+        return source.read(buf);
+    }
+
+    /** @brief Binary searches the chunk whose header starts at `offset`. */
+    bool find_location(size_t offset, size_t &index) const
+    {
+        size_t left  = 0;
+        size_t right = m_directory.size();
+        while (left < right)
+        {
+            size_t mid = left + (right - left) / 2;
+            if (m_directory[mid].offset < offset)
+                left = mid + 1;
+            else
+                right = mid;
+        }
+
+        index = left;
+        return left < m_directory.size() && m_directory[left].offset == offset;
+    }
+
     stream &m_stream;
+    vector<chunk_location> m_directory;
+    hash_map<uint32_t, size_t> m_first; ///< Chunk id to directory index.
+    directory_state m_directory_state = directory_state::none;
 };
 
 /**
@@ -417,19 +1339,19 @@ public:
             berg_estimate_max_compressed_size(size));
         size_t compressed_size = 0;
 
-        berg_config config{
-            .lookahead_size = 16,
-        };
+        const berg_config config = ice_berg_config();
 
         uint32_t original_id = 0;
         memcpy(&original_id, buffer, sizeof(original_id));
 
-        auto c_err = berg_compress_raw(static_cast<const uint8_t *>(buffer),
-                                       size,
-                                       compressed_data.data(),
-                                       compressed_data.size(),
-                                       &compressed_size,
-                                       &config);
+        auto c_err =
+            berg_compress_raw_ctx(detail::ice_berg_context(),
+                                  static_cast<const uint8_t *>(buffer),
+                                  size,
+                                  compressed_data.data(),
+                                  compressed_data.size(),
+                                  &compressed_size,
+                                  &config);
         if (c_err < 0)
             return report_error(error_code::fail_to_compress_berg,
                                 BERG_CHUNK_ID,
@@ -467,6 +1389,127 @@ public:
         return result<void>();
     }
 
+    /**
+     * @brief Writes a block-compressed Berg chunk to the stream, which
+     * `berg_block_reader` can read at random.
+     *
+     * Blocks are compressed on `thread_count` threads, see
+     * `ice_compress_blocks`, and written in order, so the output does not
+     * depend on the thread count. Blocks that do not shrink are stored
+     * uncompressed.
+     *
+     * @param original_chunk_id The ID of the original uncompressed data
+     * @param buffer The source buffer to compress and write
+     * @param size The number of bytes to compress
+     * @param block_size The uncompressed size of each block
+     * @param thread_count Threads to compress with, 0 for every hardware
+     * thread
+     * @param level The compression level, see `ice_berg_config`
+     * @param dictionary A Berg dictionary to compress with, which readers
+     * must pass to `berg_block_reader::open`. Empty for none.
+     * @return Result indicating success or failure
+     */
+    result<void>
+    write_berg_block_chunk(chunk_id original_chunk_id,
+                           const void *buffer,
+                           size_t size,
+                           size_t block_size              = ICE_BERG_BLOCK_SIZE,
+                           uint32_t thread_count          = 1,
+                           int level                      = 0,
+                           span<const uint8_t> dictionary = {})
+    {
+        if (block_size == 0 || size > 0xFFFFFFFFu || block_size > 0xFFFFFFFFu)
+            return report_error(error_code::fail_to_compress_berg,
+                                BERG_BLOCK_CHUNK_ID.to_string().c_str(),
+                                (uint32_t)BERG_BLOCK_CHUNK_ID,
+                                BERG_ERROR_INVALID_PARAM);
+
+        vector<ice_berg_block> blocks;
+        ice_split_blocks(
+            static_cast<const uint8_t *>(buffer), size, block_size, blocks);
+
+        vector<uint8_t> scratch;
+        auto c_err = ice_compress_blocks(blocks.data(),
+                                         blocks.size(),
+                                         scratch,
+                                         thread_count,
+                                         level,
+                                         dictionary);
+        if (c_err < 0)
+            return report_error(error_code::fail_to_compress_berg,
+                                BERG_BLOCK_CHUNK_ID.to_string().c_str(),
+                                (uint32_t)BERG_BLOCK_CHUNK_ID,
+                                c_err);
+
+        return write_berg_blocks(
+            original_chunk_id, size, block_size, blocks.data(), blocks.size());
+    }
+
+    /**
+     * @brief Writes a block-compressed Berg chunk from blocks compressed by
+     * `ice_compress_blocks`.
+     * @param original_chunk_id The ID of the original uncompressed data
+     * @param size The uncompressed size of the data
+     * @param block_size The uncompressed size of each block
+     * @param blocks The compressed blocks, in order
+     * @param block_count The number of blocks
+     * @return Result indicating success or failure
+     */
+    result<void> write_berg_blocks(chunk_id original_chunk_id,
+                                   size_t size,
+                                   size_t block_size,
+                                   const ice_berg_block *blocks,
+                                   size_t block_count)
+    {
+        vector<ice_uint32_t> table(block_count + 1);
+        size_t data_size = 0;
+        table[0]         = 0;
+        for (size_t i = 0; i < block_count; ++i)
+        {
+            data_size += blocks[i].out_size;
+            if (data_size > 0xFFFFFFFFu)
+                break;
+            table[i + 1] = static_cast<uint32_t>(data_size);
+        }
+
+        ICE_BERG_BLOCK_HEADER header = {
+            original_chunk_id,
+            static_cast<uint32_t>(size),
+            static_cast<uint32_t>(block_size),
+            static_cast<uint32_t>(block_count),
+        };
+
+        const size_t table_size = table.size() * sizeof(ice_uint32_t);
+        const size_t total_chunk_size = sizeof(header) + table_size + data_size;
+        if (total_chunk_size > 0xFFFFFFFFu)
+            return report_error(error_code::fail_to_compress_berg,
+                                BERG_BLOCK_CHUNK_ID.to_string().c_str(),
+                                (uint32_t)BERG_BLOCK_CHUNK_ID,
+                                BERG_ERROR_BUFFER_TOO_SMALL);
+
+        auto chunk_result =
+            write_chunk_header(BERG_BLOCK_CHUNK_ID, total_chunk_size);
+        if (chunk_result.has_error())
+            return chunk_result.error;
+
+        auto header_result = write(&header, sizeof(header));
+        if (header_result.has_error())
+            return header_result.error;
+
+        auto table_result = write(table.data(), table_size);
+        if (table_result.has_error())
+            return table_result.error;
+
+        for (size_t i = 0; i < block_count; ++i)
+        {
+            auto data_result = write(blocks[i].out, blocks[i].out_size);
+            if (data_result.has_error())
+                return data_result.error;
+        }
+
+        return result<void>();
+    }
+
 private:
     stream &m_stream;
 };
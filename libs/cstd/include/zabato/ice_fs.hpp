@@ -1,21 +1,67 @@
 #pragma once
 #include "fs.hpp"
 #include "ice.hpp"
+#include "span.hpp"
 #include "stream.hpp"
 #include "string.hpp"
 
+#include <stdio.h>
+
 namespace zabato::fs
 {
 
+/**
+ * @class ice_fs
+ * @brief A read-only file system over an ICE archive.
+ *
+ * Where the platform supports it the archive is mapped into memory once when
+ * mounted. Entries opened then read from the mapping without system calls,
+ * and `view` hands out the bytes of an entry in place, so loaders can parse
+ * straight from the archive. Without a mapping entries are read with
+ * positional reads of the archive file. Either way, different entries can be
+ * read from separate threads at once without locking.
+ *
+ * Block-compressed entries (ICE_ENTRY_BERG_BLOCKS) decompress only the blocks
+ * that reads touch, so seeking in them stays cheap. The Berg dictionary of
+ * the archive, if any, is loaded once when mounted and shared by every entry
+ * compressed with it.
+ */
 class ice_fs : public file_system
 {
 public:
-    ice_fs(const char *ice);
+    /**
+     * @brief Mounts an archive.
+     * @param ice The path of the archive.
+     * @param use_mapping Whether to try mapping the archive into memory.
+     */
+    ice_fs(const char *ice, bool use_mapping = true);
     ~ice_fs() override;
 
-    bool mount(const char *ice);
+    bool mount(const char *ice, bool use_mapping = true);
     bool unmount();
 
+    /** @return True if the archive is mapped into memory. */
+    bool is_mapped() const { return !m_mapping.empty(); }
+
+    /**
+     * @return The alignment of uncompressed entry data in the archive, 1 if
+     * it was packed without `ice_packer::set_alignment`. Views of such entries
+     * are aligned to it when the archive is mapped.
+     */
+    uint32_t get_data_alignment() const { return m_data_alignment; }
+
+    /**
+     * @brief Gets the bytes of an entry in place, without copying.
+     *
+     * The view stays valid until the archive is unmounted. Compressed chunks
+     * inside the entry are returned as stored.
+     *
+     * @param path The path of the entry.
+     * @return The bytes of the entry, or an empty span if it does not exist,
+     * is block-compressed or the archive is not mapped.
+     */
+    span<const uint8_t> view(string_view path);
+
     file *open(string_view path, open_mode mode) override;
     bool exists(string_view path) override;
     vector<file_info> ls(string_view path) override;
@@ -27,17 +73,54 @@ public:
     bool remove(string_view path) override;
     bool mkdir(string_view path) override;
 
+    /** @return The offset of the entry data in the archive. */
+    uint64_t get_storage_offset(string_view path) override;
+
+protected:
+    /** @brief An unmounted archive, for subclasses reading it another way. */
+    ice_fs();
+
+    /**
+     * @brief Reads the PACK and IDEX chunks and the optional HASH and DICT
+     * chunks after them.
+     * @param archive The archive, positioned at its start.
+     */
+    bool read_index(stream &archive);
+
+    /** @brief Drops what `read_index` read. */
+    void clear_index();
+
+    /**
+     * @brief Reads bytes of the archive for the entries that are not read
+     * from the mapping, from any thread. Positional reads of the archive file
+     * by default.
+     * @return The number of bytes read, short at the end of the archive.
+     */
+    virtual size_t read_archive(uint64_t offset, void *data, size_t size);
+
 private:
+    friend class ice_fs_file;
+    friend class ice_fs_block_file;
+
     file_stream m_stream;
-    ice_reader m_reader;
     ice_writer m_writer;
 
     vector<ICE_INDEX_ENTRY> m_entries;
     vector<char> m_strings;
+    vector<ICE_HASH_SLOT> m_hash_slots; ///< Path hash table, may be empty.
+    vector<uint8_t> m_dictionary;       ///< Berg dictionary, may be empty.
+    uint32_t m_data_alignment = 1;      ///< From ICE_PACK.
+
+    span<const uint8_t> m_mapping;
+    void *m_map_handle = nullptr; ///< The file mapping object on Windows.
 
     // Internal helpers
+    void read_hash_index(ice_reader &reader, uint32_t size);
     int64_t find_entry_index(string_view path);
     const char *get_path(const ICE_INDEX_ENTRY &entry);
+    span<const uint8_t> view(const ICE_INDEX_ENTRY &entry) const;
+    bool map(FILE *file);
+    void unmap();
 };
 
 } // namespace zabato::fs
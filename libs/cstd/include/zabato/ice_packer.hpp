@@ -10,10 +10,155 @@ class ice_packer
 public:
     ice_packer(file_stream &stream) : m_stream(stream), m_writer(stream) {}
 
-    result<void> pack(const string &source_path);
+    /**
+     * @brief Packs a directory tree into an archive.
+     * @param source_path The directory to pack.
+     * @param hash_index Whether to emit a HASH chunk for O(1) path lookups.
+     * @param block_size When not 0, files are stored as block-compressed Berg
+     * chunks of this block size, unless that does not make them smaller
+     * (see `set_compression_threshold`).
+     * `ice_fs` reads and seeks in them without inflating whole files.
+     * @param thread_count Threads compressing the blocks of every file, 0 for
+     * every hardware thread. The archive is the same for any count.
+     * @param level Berg compression level of the blocks, 0 for the archive
+     * default. Higher levels pack slower into smaller archives that decode
+     * at the same speed, see `ice_berg_config`.
+     * @param dictionary_size When not 0 and `block_size` is set, a Berg
+     * dictionary of at most this many bytes (up to BERG_MAX_DICTIONARY_SIZE)
+     * is trained from the files that fit in one block and stored once, in a
+     * DICT chunk. Every block is then compressed with it, which mostly helps
+     * small files that share content with others.
+     */
+    result<void> pack(const string &source_path,
+                      bool hash_index        = true,
+                      size_t block_size      = 0,
+                      uint32_t thread_count  = 0,
+                      int level              = 0,
+                      size_t dictionary_size = 0);
+
+    /**
+     * @brief Makes the next packs incremental.
+     *
+     * `pack` then writes a manifest of every file (path, size, modification
+     * time, content hash and where its chunk was stored) to `manifest_path`.
+     * The next pack reads it back and copies the stored chunk of every file
+     * whose size and time, or else content hash, did not change from
+     * `previous_archive` instead of compressing it again. The manifest is
+     * ignored and every file packed anew when the block size, level or
+     * dictionary size differ, or when `previous_archive` is not the archive it
+     * describes. Dictionaries are only trained by such full packs.
+     *
+     * @param previous_archive The archive of the last pack. It must not be the
+     * file being written, e.g. pack to a temporary file and rename it.
+     * @param manifest_path Where the manifest is read from and written to.
+     */
+    void set_incremental(const string &previous_archive,
+                         const string &manifest_path)
+    {
+        m_previous_archive = previous_archive;
+        m_manifest_path    = manifest_path;
+    }
+
+    /**
+     * @brief Sets whether files with identical content are stored once, on by
+     * default. Only files of the same size are hashed, and matches are
+     * compared byte by byte. The duplicates point at the first copy and have
+     * ICE_ENTRY_SHARED set.
+     */
+    void set_deduplicate(bool enabled) { m_deduplicate = enabled; }
+
+    /**
+     * @brief Sets how much block compression must save for a file to be
+     * stored compressed, when `pack` is given a block size.
+     *
+     * Files that barely compress cost a decode on every read for little I/O
+     * saved, through this they are stored raw instead.
+     *
+     * @param percent The largest size of the compressed chunk, in percent of
+     * the raw one, from 1 to 100. The default, 100, keeps any saving, 80 only
+     * compresses files that shrink by at least a fifth.
+     */
+    void set_compression_threshold(uint32_t percent)
+    {
+        m_compression_threshold = percent;
+    }
+
+    /**
+     * @brief Aligns the data of every stored file, 1 by default (none).
+     *
+     * The payload of each FILE chunk starts at an archive offset that is a
+     * multiple of `alignment`, recorded in ICE_PACK, and the gaps are filled
+     * with PAD chunks. As mappings start on a page boundary, `ice_fs::view`
+     * then returns data aligned for SIMD loads (16) or for handing straight to
+     * the GPU (4096).
+     *
+     * @param alignment A power of two, at most 65536.
+     * @param compressed Whether BRGB payloads are aligned too. They are only
+     * read through the decoder, so by default they stay back to back.
+     */
+    void set_alignment(uint32_t alignment, bool compressed = false)
+    {
+        m_alignment        = alignment;
+        m_align_compressed = compressed;
+    }
+
+    /**
+     * @brief Packs small textures into shared atlas pages, off by default.
+     *
+     * Files holding only a TEXD chunk (see `zabato::texture`) of at most
+     * `max_texture_size` pixels a side are grouped by color format and
+     * palette, and each group of two or more is packed by a skyline packer
+     * into pages of at most `page_size` pixels a side, trimmed to the smallest
+     * power of two that fits what they hold. The pages are stored as texture
+     * files `<directory>/page<N>.ice` in place of the textures they hold, and
+     * `<directory>/atlas.ice` holds an ATLS chunk mapping each original path to
+     * its page and pixel rect, which `zabato::texture_atlas` loads.
+     *
+     * Textures are packed edge to edge, for nearest sampling. palette16
+     * textures of odd width are left alone, as their rows do not start on a
+     * byte.
+     *
+     * @param page_size A power of two, 0 to disable.
+     * @param max_texture_size The largest side of a packed texture, at most
+     * `page_size`.
+     * @param directory The archive directory of the pages and the table. No
+     * packed file may already be in it.
+     */
+    void set_texture_atlas(uint16_t page_size,
+                           uint16_t max_texture_size,
+                           const string &directory = "atlas")
+    {
+        m_atlas_page_size    = page_size;
+        m_atlas_texture_size = max_texture_size;
+        m_atlas_directory    = directory;
+    }
+
+    /**
+     * @brief Optimizes meshes for drawing, off by default.
+     *
+     * Files holding only a MESH chunk (see `zabato::mesh`) are stored welded,
+     * every group of vertices with identical stored bytes merged into one,
+     * without the primitives that degenerated, with their triangles or quads
+     * reordered for the post-transform vertex cache and their vertices
+     * renumbered in the order they are drawn (see `mesh_optimizer.hpp`).
+     * Positions and normals are stored quantized, so vertices that only
+     * differed below that precision are welded too, and meshes welded down to
+     * 256 vertices get 8-bit indices.
+     */
+    void set_mesh_optimization(bool enabled) { m_optimize_meshes = enabled; }
 
 private:
     file_stream &m_stream;
     ice_writer m_writer;
+    string m_previous_archive;
+    string m_manifest_path;
+    bool m_deduplicate               = true;
+    uint32_t m_alignment             = 1;
+    bool m_align_compressed          = false;
+    uint32_t m_compression_threshold = 100; ///< Percent of the raw size.
+    uint16_t m_atlas_page_size       = 0; ///< 0 when atlases are off.
+    uint16_t m_atlas_texture_size    = 0;
+    string m_atlas_directory;
+    bool m_optimize_meshes = false;
 };
 } // namespace zabato::fs
\ No newline at end of file
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <zabato/thread.hpp>
+#include <zabato/vector.hpp>
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace zabato
+{
+/** @brief The entry point of a job. */
+using job_function = void (*)(void *data);
+
+/** @brief The body of a `parallel_for`, run over `[begin, end)`. */
+using job_range_function = void (*)(void *data, size_t begin, size_t end);
+
+/**
+ * @class job_counter
+ * @brief Counts the unfinished jobs started with it, as a fence to wait on.
+ *
+ * A counter may be reused once it is done. It must outlive its jobs.
+ */
+class job_counter
+{
+public:
+    job_counter() { atomic_init(&m_pending, 0); }
+
+    job_counter(const job_counter &)            = delete;
+    job_counter &operator=(const job_counter &) = delete;
+
+    /** @return True once every job started with the counter finished. */
+    bool is_done() const
+    {
+        return atomic_load_explicit(&m_pending, memory_order_acquire) == 0;
+    }
+
+private:
+    friend class job_system;
+
+    atomic_size_t m_pending;
+};
+
+/** @brief Where a job may run. */
+enum class job_affinity : uint8_t
+{
+    any,        ///< Any worker, or the main thread while it waits.
+    main_thread ///< Only the main thread, e.g. for GPU calls.
+};
+
+/**
+ * @class job_system
+ * @brief A work-stealing job scheduler.
+ *
+ * The main thread (the one calling `start`) and every worker own a
+ * Chase-Lev deque. Jobs started on one of them go to the bottom of its own
+ * deque, where it takes them back in LIFO order, while idle threads steal
+ * from the top of the others. Jobs started from other threads go through a
+ * shared locked queue. Waiting on a counter runs other jobs meanwhile, so
+ * jobs may start and wait on jobs of their own.
+ *
+ * Before `start`, or with no workers, jobs run immediately on the calling
+ * thread, so code written against the job system also works on targets
+ * without threads.
+ *
+ * A job is a function pointer and a data pointer; the data must stay valid
+ * until the job finishes, which a counter tells. Each participating thread
+ * recycles a ring of `max_jobs_per_thread` job slots, jobs queued past that
+ * are allocated on the heap.
+ */
+class job_system
+{
+public:
+    static constexpr uint32_t max_jobs_per_thread = 4096;
+
+    /** @brief The job system shared by the engine. */
+    static job_system &get();
+
+    job_system();
+    ~job_system();
+
+    job_system(const job_system &)            = delete;
+    job_system &operator=(const job_system &) = delete;
+
+    /**
+     * @brief Starts the workers. The calling thread becomes the main thread.
+     * @param worker_count The number of worker threads, 0 for one less than
+     * the hardware threads.
+     * @return False if already started.
+     */
+    bool start(uint32_t worker_count = 0);
+
+    /** @brief Runs the remaining jobs and joins the workers. Must be called
+     * from the main thread. */
+    void stop();
+
+    /** @return The number of worker threads, not counting the main thread. */
+    uint32_t worker_count() const;
+
+    /** @return True on the thread that called `start`. */
+    bool is_main_thread() const;
+
+    /**
+     * @brief Starts a job.
+     * @param function The entry point.
+     * @param data Passed to `function`, must live until the job finishes.
+     * @param counter Incremented now and decremented once the job finishes,
+     * may be null.
+     * @param affinity `job_affinity::main_thread` defers the job until the
+     * main thread waits or calls `run_main_thread_jobs`.
+     */
+    void run(job_function function,
+             void *data,
+             job_counter *counter  = nullptr,
+             job_affinity affinity = job_affinity::any);
+
+    /** @brief Runs jobs until every job started with `counter` finished. */
+    void wait(job_counter &counter);
+
+    /**
+     * @brief Calls `function(data, begin, end)` over `[0, count)` in ranges of
+     * `grain` indices, spread over the workers, and waits for all of them.
+     * @param grain Indices per call, 0 picks one from the thread count.
+     */
+    void parallel_for(size_t count,
+                      size_t grain,
+                      job_range_function function,
+                      void *data);
+
+    /** @brief `parallel_for` over a callable taking `(begin, end)`. */
+    template <class F>
+    void parallel_for(size_t count, size_t grain, const F &body)
+    {
+        parallel_for(
+            count,
+            grain,
+            [](void *data, size_t begin, size_t end)
+            { (*static_cast<const F *>(data))(begin, end); },
+            const_cast<F *>(&body));
+    }
+
+    /**
+     * @brief Runs the pending `job_affinity::main_thread` jobs, e.g. once per
+     * frame. Must be called from the main thread.
+     * @return The number of jobs run.
+     */
+    size_t run_main_thread_jobs();
+
+private:
+    struct job;
+    struct worker;
+    struct job_queue;
+
+    job *allocate_job();
+    void push(job *j);
+    bool try_run_one(worker *self);
+    void execute(job *j);
+    worker *current_worker() const;
+
+    static void worker_main(void *arg);
+
+    vector<worker *> m_workers; ///< The main thread first, then the workers.
+    job_queue *m_shared;        ///< Jobs from threads without a deque.
+    job_queue *m_main_jobs;     ///< Jobs only the main thread runs.
+
+    atomic_bool m_running;
+    atomic_size_t m_queued;   ///< Jobs in the deques and the shared queue.
+    atomic_size_t m_sleeping; ///< Workers waiting on `m_wake`.
+    mutex m_sleep_lock;
+    condition_variable m_wake;
+};
+} // namespace zabato
@@ -0,0 +1,104 @@
+#pragma once
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+
+namespace zabato
+{
+/** @brief The severity of a log message, most severe first. */
+enum class log_level : uint8_t
+{
+    none,
+    error,
+    warning,
+    info,
+    trace
+};
+
+/**
+ * @brief The least severe level the `LOG_` macros keep, set by the
+ * `log_level` build option. The others compile to nothing, arguments
+ * included.
+ */
+#if !defined(ZABATO_LOG_LEVEL)
+#define ZABATO_LOG_LEVEL 3
+#endif
+static constexpr log_level compiled_log_level = log_level(ZABATO_LOG_LEVEL);
+
+/** @brief The longest message kept, longer ones are cut. */
+static constexpr size_t max_log_message = 255;
+
+/**
+ * @brief Writes the log from a background thread from now on, to `out`.
+ *
+ * Messages are formatted by the caller into a fixed-size slot of a lock-free
+ * ring shared by every thread, and the thread writes them out, so logging
+ * neither allocates nor waits for the output. When the ring is full the
+ * message is dropped and counted, see `get_dropped_log_count`. Before
+ * `start_logging` and after `stop_logging` messages are written right away.
+ *
+ * @return False if already started or the thread could not start.
+ */
+bool start_logging(FILE *out = stderr);
+
+/** @brief Like the above, to a file opened for appending. */
+bool start_logging(const char *path);
+
+/**
+ * @brief Writes what is queued and stops the thread. A file opened by
+ * `start_logging` is closed.
+ */
+void stop_logging();
+
+/** @brief Waits until the messages queued so far were written. */
+void flush_log();
+
+/**
+ * @brief Keeps at most `count` copies of one message within `window`
+ * nanoseconds, so a storm of one error, e.g. from a GL debug callback, does
+ * not fill the ring. The number left out is written once the window ends.
+ * Zero `count` keeps every copy. The default is 10 per second.
+ */
+void set_log_rate_limit(uint32_t count, uint64_t window);
+
+/** @return The number of messages dropped because the ring was full. */
+uint64_t get_dropped_log_count();
+
+/** @brief Logs a printf-style message, whatever `compiled_log_level`. */
+void log_message(log_level level, const char *format, ...)
+#if defined(__GNUC__)
+    __attribute__((format(printf, 2, 3)))
+#endif
+    ;
+
+void log_message_v(log_level level, const char *format, va_list args);
+
+#if ZABATO_LOG_LEVEL >= 1
+#define LOG_ERROR(...)                                                         \
+    ::zabato::log_message(::zabato::log_level::error, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
+
+#if ZABATO_LOG_LEVEL >= 2
+#define LOG_WARNING(...)                                                       \
+    ::zabato::log_message(::zabato::log_level::warning, __VA_ARGS__)
+#else
+#define LOG_WARNING(...) ((void)0)
+#endif
+
+#if ZABATO_LOG_LEVEL >= 3
+#define LOG_INFO(...)                                                          \
+    ::zabato::log_message(::zabato::log_level::info, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if ZABATO_LOG_LEVEL >= 4
+#define LOG_TRACE(...)                                                         \
+    ::zabato::log_message(::zabato::log_level::trace, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) ((void)0)
+#endif
+} // namespace zabato
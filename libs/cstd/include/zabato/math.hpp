@@ -2,6 +2,17 @@
 
 #include <zabato/utils.hpp>
 
+#include <type_traits>
+
+#if defined(__SSE__) || defined(_M_X64) ||                                     \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define ZABATO_MATH_SSE
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define ZABATO_MATH_NEON
+#endif
+
 namespace zabato
 {
 template <typename T> struct vec2;
@@ -12,6 +23,14 @@ template <typename T> struct mat4;
 template <typename T> struct plane3;
 template <typename T> struct mat3;
 
+namespace detail
+{
+/** @brief Selects constructors that leave the elements uninitialized. */
+struct no_init_t
+{
+};
+} // namespace detail
+
 /**
  * @brief A structure representing a 2-dimensional vector.
  *
@@ -943,6 +962,10 @@ template <typename T> struct mat4
             (&m00)[i] = T((&other.m00)[i]);
     }
 
+    /** @brief Leaves the elements uninitialized, for code that writes all
+     * of them. */
+    explicit mat4(detail::no_init_t) {}
+
     /**
      * @brief Creates an identity matrix.
      * @return A 4x4 identity matrix.
@@ -1730,6 +1753,111 @@ template <typename T> constexpr mat3<T> transpose(const mat3<T> &m)
     r.m22 = m.m22;
     return r;
 }
+namespace detail
+{
+/**
+ * @brief True when `T` is a `float`, or a `real` whose policy stores one
+ * (`float_policy`). Matrices of those types have the layout of float arrays
+ * and take the SIMD paths below; any other type, like `fixed_point_policy`
+ * reals, keeps the generic code.
+ */
+template <typename T, typename = void>
+struct is_float_storage : std::is_same<T, float>
+{
+};
+
+template <typename T>
+struct is_float_storage<T, std::void_t<typename T::storage_type>>
+    : std::bool_constant<std::is_same_v<typename T::storage_type, float> &&
+                         sizeof(T) == sizeof(float)>
+{
+};
+
+#if defined(ZABATO_MATH_SSE) || defined(ZABATO_MATH_NEON)
+#define ZABATO_MATH_SIMD
+
+#if defined(ZABATO_MATH_SSE)
+using math_float4 = __m128;
+
+inline math_float4 math_load4(const float *p) { return _mm_loadu_ps(p); }
+inline void math_store4(float *p, math_float4 v) { _mm_storeu_ps(p, v); }
+
+/** @return `c * v[Lane]`, broadcasting the lane in registers. */
+template <int Lane>
+inline math_float4 math_mul_lane4(math_float4 c, math_float4 v)
+{
+    const int mask = _MM_SHUFFLE(Lane, Lane, Lane, Lane);
+    return _mm_mul_ps(c, _mm_shuffle_ps(v, v, mask));
+}
+
+/** @return `acc + c * v[Lane]`. */
+template <int Lane>
+inline math_float4
+math_madd_lane4(math_float4 acc, math_float4 c, math_float4 v)
+{
+    return _mm_add_ps(acc, math_mul_lane4<Lane>(c, v));
+}
+#else
+using math_float4 = float32x4_t;
+
+inline math_float4 math_load4(const float *p) { return vld1q_f32(p); }
+inline void math_store4(float *p, math_float4 v) { vst1q_f32(p, v); }
+
+/** @return `c * v[Lane]`, broadcasting the lane in registers. */
+template <int Lane>
+inline math_float4 math_mul_lane4(math_float4 c, math_float4 v)
+{
+    return vmulq_laneq_f32(c, v, Lane);
+}
+
+/** @return `acc + c * v[Lane]`. */
+template <int Lane>
+inline math_float4
+math_madd_lane4(math_float4 acc, math_float4 c, math_float4 v)
+{
+    return vmlaq_laneq_f32(acc, c, v, Lane);
+}
+#endif
+
+/** @return The column-major matrix `c0..c3` times the vector `v`. */
+inline math_float4 mat4_mul_float4(math_float4 c0,
+                                   math_float4 c1,
+                                   math_float4 c2,
+                                   math_float4 c3,
+                                   math_float4 v)
+{
+    math_float4 acc = math_mul_lane4<0>(c0, v);
+    acc             = math_madd_lane4<1>(acc, c1, v);
+    acc             = math_madd_lane4<2>(acc, c2, v);
+    return math_madd_lane4<3>(acc, c3, v);
+}
+
+/** @brief `r = a * v` for a column-major matrix, `r` may alias `v`. */
+inline void mat4_mul_vec4(const float *a, const float *v, float *r)
+{
+    math_store4(r,
+                mat4_mul_float4(math_load4(a),
+                                math_load4(a + 4),
+                                math_load4(a + 8),
+                                math_load4(a + 12),
+                                math_load4(v)));
+}
+
+/** @brief `r = a * b` for column-major matrices, `r` may alias neither. */
+inline void mat4_mul_mat4(const float *a, const float *b, float *r)
+{
+    const math_float4 c0 = math_load4(a);
+    const math_float4 c1 = math_load4(a + 4);
+    const math_float4 c2 = math_load4(a + 8);
+    const math_float4 c3 = math_load4(a + 12);
+
+    for (int j = 0; j < 4; ++j)
+        math_store4(r + j * 4,
+                    mat4_mul_float4(c0, c1, c2, c3, math_load4(b + j * 4)));
+}
+#endif
+} // namespace detail
+
 /**
  * @brief Multiplies two 4x4 matrices.
  * @param a The first matrix.
@@ -1739,6 +1867,19 @@ template <typename T> constexpr mat3<T> transpose(const mat3<T> &m)
 template <typename T>
 constexpr mat4<T> operator*(const mat4<T> &a, const mat4<T> &b)
 {
+#if defined(ZABATO_MATH_SIMD)
+    if constexpr (detail::is_float_storage<T>::value)
+    {
+        if (!std::is_constant_evaluated())
+        {
+            mat4<T> r{detail::no_init_t()};
+            detail::mat4_mul_mat4(reinterpret_cast<const float *>(&a.m00),
+                                  reinterpret_cast<const float *>(&b.m00),
+                                  reinterpret_cast<float *>(&r.m00));
+            return r;
+        }
+    }
+#endif
     mat4<T> r;
     r.m00 = a.m00 * b.m00 + a.m01 * b.m10 + a.m02 * b.m20 + a.m03 * b.m30;
     r.m10 = a.m10 * b.m00 + a.m11 * b.m10 + a.m12 * b.m20 + a.m13 * b.m30;
@@ -1771,6 +1912,19 @@ constexpr mat4<T> operator*(const mat4<T> &a, const mat4<T> &b)
 template <typename T>
 constexpr vec4<T> operator*(const mat4<T> &m, const vec4<T> &v)
 {
+#if defined(ZABATO_MATH_SIMD)
+    if constexpr (detail::is_float_storage<T>::value)
+    {
+        if (!std::is_constant_evaluated())
+        {
+            vec4<T> r;
+            detail::mat4_mul_vec4(reinterpret_cast<const float *>(&m.m00),
+                                  reinterpret_cast<const float *>(&v.x),
+                                  reinterpret_cast<float *>(&r.x));
+            return r;
+        }
+    }
+#endif
     return vec4<T>(m.m00 * v.x + m.m01 * v.y + m.m02 * v.z + m.m03 * v.w,
                    m.m10 * v.x + m.m11 * v.y + m.m12 * v.z + m.m13 * v.w,
                    m.m20 * v.x + m.m21 * v.y + m.m22 * v.z + m.m23 * v.w,
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace zabato
+{
+/**
+ * @enum memory_category
+ * @brief What heap memory is used for, to break its usage down.
+ */
+enum class memory_category : uint8_t
+{
+    containers, ///< Containers not given a category, the default.
+    resources,  ///< Data of loaded resources, e.g. mesh vertices.
+    scene,      ///< Links of the scene graph and the world.
+    gpu_shadow, ///< CPU copies of GPU buffers and textures.
+    count,
+};
+
+/** @brief Heap counters of one `memory_category`. */
+struct memory_stats
+{
+    size_t live_bytes        = 0; ///< Bytes allocated and not freed.
+    size_t peak_bytes        = 0; ///< Most live bytes at once.
+    size_t live_allocations  = 0; ///< Allocations not freed.
+    size_t frame_allocations = 0; ///< Allocations since the frame started.
+    size_t frame_bytes       = 0; ///< Bytes allocated since then.
+};
+
+/** @return The name of a category, for display. */
+constexpr const char *get_memory_category_name(memory_category category)
+{
+    switch (category)
+    {
+    case memory_category::containers:
+        return "containers";
+    case memory_category::resources:
+        return "resources";
+    case memory_category::scene:
+        return "scene";
+    case memory_category::gpu_shadow:
+        return "gpu shadow";
+    default:
+        return "unknown";
+    }
+}
+
+#if defined(ZABATO_MEMORY_TRACKING)
+/** @brief Whether `zabato::allocator` counts its allocations. */
+static constexpr bool memory_tracking = true;
+
+/** @brief Counts an allocation of `size` bytes. Thread safe. */
+void track_allocation(memory_category category, size_t size);
+
+/** @brief Counts the release of an allocation of `size` bytes. */
+void track_deallocation(memory_category category, size_t size);
+
+/** @return The counters of a category. */
+memory_stats get_memory_stats(memory_category category);
+
+/** @brief Starts a frame, zeroing the per-frame counters. */
+void reset_frame_memory_stats();
+#else
+// Without tracking the calls compile to nothing and the counters stay zero.
+static constexpr bool memory_tracking = false;
+
+inline void track_allocation(memory_category, size_t) {}
+inline void track_deallocation(memory_category, size_t) {}
+inline memory_stats get_memory_stats(memory_category) { return {}; }
+inline void reset_frame_memory_stats() {}
+#endif
+} // namespace zabato
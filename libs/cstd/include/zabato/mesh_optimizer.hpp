@@ -0,0 +1,88 @@
+#pragma once
+
+#include <zabato/span.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace zabato
+{
+/**
+ * @brief The post-transform vertex cache `optimize_vertex_cache` orders for,
+ * in vertices. Smaller hardware caches still gain most of the benefit.
+ */
+constexpr size_t vertex_cache_size = 32;
+
+/**
+ * @brief Merges vertices with identical bytes, e.g. the copies an importer
+ * makes per face.
+ *
+ * The first copy of each vertex is kept, the vertices are compacted in their
+ * original order and the indices remapped to them.
+ *
+ * @param vertices `stride` bytes per vertex, the count being the size over
+ * `stride`.
+ * @param stride The size of a vertex in bytes.
+ * @param indices The indices into `vertices`, remapped in place.
+ * @return The number of vertices left at the start of `vertices`.
+ */
+size_t weld_vertices(span<uint8_t> vertices,
+                     size_t stride,
+                     span<uint16_t> indices);
+
+/**
+ * @brief Drops the primitives that cover no area, e.g. triangles a weld left
+ * with a repeated vertex, keeping the order of the rest.
+ *
+ * Lines and triangles with a repeated index are dropped, as are quads with
+ * fewer than three distinct ones. Points are kept.
+ *
+ * @param indices `primitive_size` indices per primitive, compacted in place.
+ * @param primitive_size 1 for points up to 4 for quads.
+ * @return The number of indices left.
+ */
+size_t remove_degenerate_primitives(span<uint16_t> indices,
+                                    size_t primitive_size);
+
+/**
+ * @brief Reorders primitives so the vertices they share are still in the
+ * post-transform cache, with Forsyth's linear-speed algorithm.
+ *
+ * Each step draws the primitive whose vertices score best, a vertex scoring
+ * higher the more recently it was used and the fewer primitives it still
+ * has, so the order sweeps the mesh in strips and finishes off fans before
+ * they fall out of the cache. The vertices of every primitive keep their
+ * winding.
+ *
+ * @param indices `primitive_size` indices per primitive, reordered in place.
+ * @param primitive_size 3 for triangles or 4 for quads.
+ * @param vertex_count One more than the largest index.
+ */
+void optimize_vertex_cache(span<uint16_t> indices,
+                           size_t primitive_size,
+                           size_t vertex_count);
+
+/**
+ * @brief Renumbers vertices in the order the indices first use them, so the
+ * vertex fetches walk memory forward. Run it after `optimize_vertex_cache`.
+ * Vertices no index uses are dropped.
+ *
+ * @param vertices `stride` bytes per vertex, reordered in place.
+ * @param stride The size of a vertex in bytes.
+ * @param indices The indices into `vertices`, remapped in place.
+ * @return The number of vertices left at the start of `vertices`.
+ */
+size_t optimize_vertex_fetch(span<uint8_t> vertices,
+                             size_t stride,
+                             span<uint16_t> indices);
+
+/**
+ * @brief Simulates a FIFO post-transform cache over the indices.
+ * @return The average number of vertices transformed per primitive, the
+ * ACMR. An ideal triangle order comes close to 0.5, an unordered one to 3.
+ */
+float vertex_cache_miss_ratio(span<const uint16_t> indices,
+                              size_t primitive_size,
+                              size_t vertex_count,
+                              size_t cache_size = vertex_cache_size);
+} // namespace zabato
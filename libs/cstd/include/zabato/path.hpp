@@ -1,5 +1,6 @@
 #pragma once
 
+#include <zabato/fixed_string.hpp>
 #include <zabato/string.hpp>
 
 namespace zabato::fs
@@ -117,21 +118,37 @@ inline string join(string_view a, string_view b)
 }
 
 /**
- * @brief normalizes the path (resolves "." and "..").
+ * @brief normalizes the path (resolves "." and "..") into a buffer, without
+ * allocating.
  * @param path the path to normalize.
- * @return the normalized path string.
+ * @param out receives the normalized path, not null-terminated.
+ * @param capacity the size of `out`.
+ * @param rooted treats a relative path as if it started with a separator.
+ * @return the length of the normalized path, or npos if it does not fit.
  */
-inline string normalize(string_view path)
+inline size_t normalize(string_view path,
+                        char *out,
+                        size_t capacity,
+                        bool rooted = false)
 {
-    if (path.empty())
-        return "";
-
-    string res;
-    res.reserve(path.size());
+    const bool absolute = rooted || is_absolute(path);
+    if (path.empty() && !absolute)
+        return 0;
 
-    bool absolute = is_absolute(path);
-    if (absolute)
-        res += '/';
+    size_t len  = 0;
+    auto append = [&](string_view s)
+    {
+        if (len + s.size() > capacity)
+            return false;
+        memcpy(out + len, s.data(), s.size());
+        len += s.size();
+        return true;
+    };
+    auto last_separator = [&]()
+    { return string_view(out, len).rfind('/'); };
+
+    if (absolute && !append("/"))
+        return string_view::npos;
 
     size_t start = 0;
     while (start < path.size())
@@ -155,44 +172,72 @@ inline string normalize(string_view path)
         {
             if (absolute)
             {
-                if (res.size() > 1)
+                if (len > 1)
                 {
-                    size_t last_sep = res.rfind('/');
-                    res.resize((last_sep == 0) ? 1 : last_sep);
+                    size_t last_sep = last_separator();
+                    len             = (last_sep == 0) ? 1 : last_sep;
                 }
             }
             else
             {
+                string_view res = string_view(out, len);
                 bool top_is_parent =
                     (res == ".." ||
-                     (res.size() >= 3 &&
-                      string_view(res).substr(res.size() - 3) == "/.."));
+                     (len >= 3 && res.substr(len - 3) == "/.."));
 
-                if (res.empty() || top_is_parent)
+                if (len == 0 || top_is_parent)
                 {
-                    if (!res.empty())
-                        res += '/';
-                    res += "..";
+                    if ((len != 0 && !append("/")) || !append(".."))
+                        return string_view::npos;
                 }
                 else
                 {
-                    size_t last_sep = res.rfind('/');
-                    if (last_sep == string::npos)
-                        res.clear();
-                    else
-                        res.resize(last_sep);
+                    size_t last_sep = last_separator();
+                    len = (last_sep == string_view::npos) ? 0 : last_sep;
                 }
             }
         }
         else
         {
-            if ((absolute && res.size() > 1) || (!absolute && !res.empty()))
-                res += '/';
-            res += token;
+            if ((absolute && len > 1) || (!absolute && len != 0))
+                if (!append("/"))
+                    return string_view::npos;
+            if (!append(token))
+                return string_view::npos;
         }
     }
 
-    return (res.empty() && !absolute) ? "." : res;
+    if (len == 0 && !absolute && !append("."))
+        return string_view::npos;
+    return len;
+}
+
+/**
+ * @brief normalizes the path into a fixed string on the stack.
+ * @return false if the normalized path is longer than the string holds.
+ */
+template <size_t N>
+bool normalize(string_view path, fixed_string<N> &out, bool rooted = false)
+{
+    const size_t len = normalize(path, out.data(), out.capacity(), rooted);
+    if (len == string_view::npos)
+        return false;
+    out.resize(len);
+    return true;
+}
+
+/**
+ * @brief normalizes the path (resolves "." and "..").
+ * @param path the path to normalize.
+ * @return the normalized path string.
+ */
+inline string normalize(string_view path)
+{
+    // The result is never longer than the path, but for "." and a separator.
+    string res;
+    res.resize(path.size() + 1);
+    res.resize(normalize(path, res.data(), path.size() + 1));
+    return res;
 }
 
 } // namespace zabato::fs
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <zabato/span.hpp>
+#include <zabato/stream.hpp>
+#include <zabato/symbol.hpp>
+#include <zabato/vector.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace zabato
+{
+/** @brief The `profile_zone::parent` of a zone no other zone encloses. */
+static constexpr uint32_t no_parent_zone = UINT32_MAX;
+
+/**
+ * @struct profile_zone
+ * @brief A zone of code timed in a frame, see `collect_profile_frame`.
+ */
+struct profile_zone
+{
+    symbol *name;      ///< The name given to the zone.
+    uint32_t thread;   ///< The thread, numbered as they first profile.
+    uint32_t depth;    ///< The number of zones enclosing this one.
+    uint32_t parent;   ///< The index of the enclosing zone, if any.
+    uint64_t start;    ///< Nanoseconds of `time::now` at its start.
+    uint64_t duration; ///< Nanoseconds it lasted.
+};
+
+/**
+ * @struct profile_frame
+ * @brief The zones timed between two calls to `collect_profile_frame`.
+ *
+ * The zones of each thread come in the order they started, a parent before
+ * its children, the threads one after another. A zone still open when the
+ * frame was collected is cut at the frame's end, and continues from the
+ * next frame's start in that frame.
+ */
+struct profile_frame
+{
+    uint64_t start    = 0; ///< Nanoseconds of `time::now` at its start.
+    uint64_t duration = 0; ///< Nanoseconds it lasted.
+    vector<profile_zone> zones;
+};
+
+#if defined(ZABATO_PROFILER)
+/** @brief Whether the `PROFILE_` macros record zones. */
+static constexpr bool profiling = true;
+
+/**
+ * @brief Opens a zone on the calling thread, closed by `end_profile_zone`.
+ *
+ * Each thread records into its own ring buffer, which only that thread
+ * writes and only the collector reads, so neither waits for the other. When
+ * the ring is full the zone is left out, along with the zones it encloses.
+ */
+void begin_profile_zone(symbol *name);
+
+/** @brief Closes the innermost zone the calling thread opened. */
+void end_profile_zone();
+
+/**
+ * @brief Gathers the zones every thread recorded since the last call into
+ * `out`, ending the frame there and starting the next one.
+ *
+ * Call once per frame, from one thread at a time.
+ */
+void collect_profile_frame(profile_frame &out);
+#else
+// Without the profiler the macros compile to nothing and frames stay empty.
+static constexpr bool profiling = false;
+
+inline void begin_profile_zone(symbol *) {}
+inline void end_profile_zone() {}
+inline void collect_profile_frame(profile_frame &out) { out = {}; }
+#endif
+
+/**
+ * @brief Writes frames as a Chrome trace, the JSON read by `chrome://tracing`
+ * and Perfetto, with one complete event per zone.
+ */
+void write_chrome_trace(span<const profile_frame> frames, stream &out);
+
+/** @brief Opens a zone for the lifetime of the object. */
+class profile_scope
+{
+public:
+    explicit profile_scope(symbol *name) { begin_profile_zone(name); }
+    ~profile_scope() { end_profile_zone(); }
+
+    profile_scope(const profile_scope &)            = delete;
+    profile_scope &operator=(const profile_scope &) = delete;
+};
+
+#define ZABATO_PROFILE_CONCAT2(a, b) a##b
+#define ZABATO_PROFILE_CONCAT(a, b) ZABATO_PROFILE_CONCAT2(a, b)
+
+#if defined(ZABATO_PROFILER)
+/**
+ * @brief Profiles the rest of the enclosing scope as a zone named `name`, a
+ * string literal interned once.
+ */
+#define PROFILE_SCOPE(name)                                                    \
+    static ::zabato::symbol *const ZABATO_PROFILE_CONCAT(                      \
+        zabato_profile_name_, __LINE__) =                                      \
+        ::zabato::get_permanent_symbol(name);                                  \
+    ::zabato::profile_scope ZABATO_PROFILE_CONCAT(zabato_profile_scope_,       \
+                                                  __LINE__)(                   \
+        ZABATO_PROFILE_CONCAT(zabato_profile_name_, __LINE__))
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#endif
+
+/** @brief Profiles the rest of the enclosing function, named after it. */
+#define PROFILE_FUNCTION PROFILE_SCOPE(__func__)
+} // namespace zabato
@@ -1,10 +1,133 @@
 #pragma once
 
+#include "real.hpp"
 #include "span.hpp"
 #include <stdint.h>
+#include <string.h>
 
 namespace zabato
 {
+/**
+ * @class random_engine
+ * @brief A fast pseudo-random generator (xoshiro256**) for gameplay.
+ *
+ * Not suitable for anything that must be unpredictable, like keys or tokens;
+ * use `random::buf` for those. An engine must not be shared between threads
+ * without locking, `random::local` gives each thread its own.
+ */
+class random_engine
+{
+public:
+    /** @brief Constructs an engine from a seed, equal seeds give equal
+     * sequences. */
+    explicit random_engine(uint64_t seed = 0) { this->seed(seed); }
+
+    /** @brief Restarts the sequence from a seed. */
+    void seed(uint64_t seed)
+    {
+        // splitmix64 spreads the seed, so the state is never all zeros.
+        for (uint64_t &word : m_state)
+        {
+            seed += 0x9e3779b97f4a7c15ull;
+            uint64_t z = seed;
+            z          = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z          = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            word       = z ^ (z >> 31);
+        }
+    }
+
+    /** @return 64 uniformly random bits. */
+    uint64_t next()
+    {
+        const uint64_t result = rotl(m_state[1] * 5, 7) * 9;
+        const uint64_t t      = m_state[1] << 17;
+
+        m_state[2] ^= m_state[0];
+        m_state[3] ^= m_state[1];
+        m_state[1] ^= m_state[2];
+        m_state[0] ^= m_state[3];
+        m_state[2] ^= t;
+        m_state[3] = rotl(m_state[3], 45);
+
+        return result;
+    }
+
+    /** @return 32 uniformly random bits. */
+    uint32_t next_uint() { return (uint32_t)(next() >> 32); }
+
+    /**
+     * @brief Draws an integer in `[0, bound)` without modulo bias.
+     * @param bound The exclusive upper bound, 0 yields 0.
+     */
+    uint32_t next_uint(uint32_t bound)
+    {
+        // Lemire's multiply-shift, rejecting the few biased low products.
+        uint64_t m = (uint64_t)next_uint() * bound;
+        if ((uint32_t)m < bound)
+        {
+            const uint32_t threshold = (0u - bound) % bound;
+            while ((uint32_t)m < threshold)
+                m = (uint64_t)next_uint() * bound;
+        }
+        return (uint32_t)(m >> 32);
+    }
+
+    /** @return An integer in `[min, max]`, both inclusive. */
+    int32_t next_int(int32_t min, int32_t max)
+    {
+        const uint32_t count = (uint32_t)max - (uint32_t)min + 1;
+        if (count == 0) // The whole 32-bit range.
+            return (int32_t)next_uint();
+        return (int32_t)((uint32_t)min + next_uint(count));
+    }
+
+    /** @return True or false with equal odds. */
+    bool next_bool() { return (next() >> 63) != 0; }
+
+    /** @return A float in `[0, 1)`, with 24 random bits. */
+    float next_float() { return (float)(next() >> 40) * 0x1.0p-24f; }
+
+    /** @return A float in `[min, max)`. */
+    float next_float(float min, float max)
+    {
+        return min + (max - min) * next_float();
+    }
+
+    /** @return A real in `[0, 1)`. */
+    real next_real() { return real(next_float()); }
+
+    /** @return A real in `[min, max)`. */
+    real next_real(real min, real max)
+    {
+        return min + (max - min) * next_real();
+    }
+
+    /** @brief Fills a buffer with random bytes. */
+    void fill(void *buf, size_t size)
+    {
+        uint8_t *p = (uint8_t *)buf;
+        for (; size >= sizeof(uint64_t); size -= sizeof(uint64_t))
+        {
+            const uint64_t r = next();
+            memcpy(p, &r, sizeof(r));
+            p += sizeof(r);
+        }
+        if (size > 0)
+        {
+            const uint64_t r = next();
+            memcpy(p, &r, size);
+        }
+    }
+
+private:
+    static uint64_t rotl(uint64_t x, int k)
+    {
+        return (x << k) | (x >> (64 - k));
+    }
+
+    uint64_t m_state[4];
+};
+
 /**
  * @class random
  * @brief Utilities for generating random data.
@@ -13,22 +136,29 @@ class random
 {
 public:
     /**
-     * @brief Generates a random 64-bit integer.
+     * @brief Generates a random 64-bit integer from the OS.
      * @return A random 64-bit integer.
      */
     static uint64_t rand();
 
     /**
-     * @brief Fills a buffer with random bytes.
+     * @brief Fills a buffer with random bytes from the OS. Slow, meant for
+     * seeds and secrets.
      * @param buf Pointer to the buffer.
      * @param size Size of the buffer in bytes.
      */
     static void buf(void *buf, size_t size);
 
     /**
-     * @brief Fills a buffer with random bytes.
+     * @brief Fills a buffer with random bytes from the OS.
      * @param buf The buffer to fill.
      */
     static void buf(buffer &buf);
+
+    /**
+     * @brief The engine of the calling thread, seeded from the OS on its
+     * first use.
+     */
+    static random_engine &local();
 };
-} // namespace zabato
\ No newline at end of file
+} // namespace zabato
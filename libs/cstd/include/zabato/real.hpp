@@ -91,6 +91,10 @@ struct float_policy
     }
     static constexpr storage_type abs(storage_type a) { return fabsf(a); }
     static constexpr storage_type sqrt(storage_type a) { return sqrtf(a); }
+    static constexpr storage_type rsqrt(storage_type a)
+    {
+        return 1.0f / sqrtf(a);
+    }
     static constexpr storage_type exp(storage_type a) { return expf(a); }
     static constexpr storage_type log(storage_type a) { return logf(a); }
     static constexpr storage_type pow(storage_type base, storage_type exp)
@@ -131,6 +135,114 @@ struct float_policy
     }
 };
 
+namespace detail
+{
+/** @brief log2 of the number of segments in `fixed_sin_table`. */
+static constexpr int fixed_sin_table_bits = 8;
+
+/** @brief Number of segments in `fixed_sin_table`. */
+static constexpr int fixed_sin_table_size = 1 << fixed_sin_table_bits;
+
+struct fixed_sin_table_t
+{
+    int32_t values[fixed_sin_table_size + 1];
+};
+
+/** @brief Number of seeds in `fixed_rsqrt_table`, indexed by the top six
+ * bits of a mantissa in `[1/4, 1)`. */
+static constexpr int fixed_rsqrt_table_size = 48;
+
+struct fixed_rsqrt_table_t
+{
+    uint32_t values[fixed_rsqrt_table_size];
+};
+
+/** @brief Taylor series sine, only evaluated while building tables. */
+constexpr double table_sin(double x)
+{
+    double term = x;
+    double sum  = x;
+    for (int n = 1; n < 16; ++n)
+    {
+        term *= -x * x / double((2 * n) * (2 * n + 1));
+        sum += term;
+    }
+    return sum;
+}
+
+/** @brief Newton's method square root, only evaluated while building
+ * tables. */
+constexpr double table_sqrt(double x)
+{
+    double r = x > 1 ? x : 1;
+    for (int i = 0; i < 64; ++i)
+        r = (r + x / r) * 0.5;
+    return r;
+}
+
+constexpr fixed_sin_table_t make_fixed_sin_table()
+{
+    fixed_sin_table_t table{};
+    for (int i = 0; i <= fixed_sin_table_size; ++i)
+    {
+        const double angle = 1.5707963267948966 * i / fixed_sin_table_size;
+        table.values[i] = static_cast<int32_t>(table_sin(angle) * (1 << 30) +
+                                               0.5);
+    }
+    return table;
+}
+
+constexpr fixed_rsqrt_table_t make_fixed_rsqrt_table()
+{
+    fixed_rsqrt_table_t table{};
+    for (int i = 0; i < fixed_rsqrt_table_size; ++i)
+    {
+        const double mantissa = (i + 16 + 0.5) / 64.0;
+        table.values[i]       = static_cast<uint32_t>(
+            (1 << 30) / table_sqrt(mantissa) + 0.5);
+    }
+    return table;
+}
+
+/**
+ * @brief sin over the first quarter turn in Q2.30, at the ends of every
+ * segment. Built at compile time, so the fixed-point policy never touches
+ * the FPU at run time.
+ */
+inline constexpr fixed_sin_table_t fixed_sin_table = make_fixed_sin_table();
+
+/** @brief Q2.30 seeds of `1 / sqrt(m)` for the middle of every mantissa
+ * segment, refined with Newton's method by `fixed_point_policy::rsqrt`. */
+inline constexpr fixed_rsqrt_table_t fixed_rsqrt_table =
+    make_fixed_rsqrt_table();
+
+/**
+ * @brief Sine of an angle given in turns.
+ * @param phase The angle, a full turn is 2^32 so it wraps on overflow.
+ * @return The sine in Q2.30, within 5e-6 of the exact value (linear
+ * interpolation over 256 segments per quarter turn).
+ */
+constexpr int32_t fixed_sin_turns(uint32_t phase)
+{
+    constexpr int shift = 30 - fixed_sin_table_bits;
+
+    const uint32_t quadrant = phase >> 30;
+    uint32_t offset         = phase & 0x3fffffffu;
+    if (quadrant & 1)
+        offset = 0x40000000u - offset;
+
+    const uint32_t index = offset >> shift;
+    int32_t value        = fixed_sin_table.values[index];
+    if (index < fixed_sin_table_size)
+    {
+        const int64_t next = fixed_sin_table.values[index + 1];
+        const int64_t frac = offset & ((1u << shift) - 1);
+        value += static_cast<int32_t>(((next - value) * frac) >> shift);
+    }
+    return (quadrant & 2) ? -value : value;
+}
+} // namespace detail
+
 /**
  * @brief Policy for fixed-point arithmetic.
  *
@@ -266,26 +378,58 @@ template <int FractionalBits> struct fixed_point_policy
 
     static constexpr storage_type abs(storage_type a) { return a > 0 ? a : -a; }
 
-    /** @brief Calculates approximate square root using Newton's method. */
+    /**
+     * @brief Calculates the square root from `rsqrt`'s estimate, corrected to
+     * the exact value rounded down, so it is within one unit of the last
+     * place.
+     */
     static constexpr storage_type sqrt(storage_type a)
     {
-        if (a < 0)
+        if (a <= 0)
             return 0;
 
-        wide_storage_type n = static_cast<wide_storage_type>(a)
-                              << FractionalBits;
-        wide_storage_type res  = n;
-        wide_storage_type last = 0;
+        int exponent     = 0;
+        const uint64_t m = normalize_q30(a, exponent);
 
-        do
-        {
-            last = res;
-            res  = (res + n / res) / 2;
-        } while (last != res);
+        // sqrt(m) = m / sqrt(m), scaled back like `rsqrt`.
+        const uint64_t root = (m * rsqrt_q30(m)) >> 30;
+        const int shift     = 30 - FractionalBits - exponent;
+        uint64_t res        = shift >= 0 ? root >> shift : root << -shift;
+
+        // The estimate is off by a few units at most.
+        const uint64_t n = static_cast<uint64_t>(a) << FractionalBits;
+        while (res * res > n)
+            --res;
+        while ((res + 1) * (res + 1) <= n)
+            ++res;
 
         return static_cast<storage_type>(res);
     }
 
+    /**
+     * @brief Calculates `1 / sqrt(a)` from a table seed and two Newton steps.
+     * The relative error is below 3e-7 before rounding to the last place.
+     * @return `MAX` for values that are not positive, or whose result does not
+     * fit.
+     */
+    static constexpr storage_type rsqrt(storage_type a)
+    {
+        if (a <= 0)
+            return MAX;
+
+        int exponent     = 0;
+        const uint64_t y = rsqrt_q30(normalize_q30(a, exponent));
+
+        // 1 / sqrt(a) = y * 2^-exponent, y in Q2.30.
+        const int shift = 30 - FractionalBits + exponent;
+        if (shift > 0)
+            return static_cast<storage_type>(
+                (y + (static_cast<uint64_t>(1) << (shift - 1))) >> shift);
+        if (shift < -32 || (y << -shift) > static_cast<uint64_t>(MAX))
+            return MAX;
+        return static_cast<storage_type>(y << -shift);
+    }
+
     /** @brief Calculates approximate exponential e^x. */
     static constexpr storage_type exp(storage_type x)
     {
@@ -395,32 +539,40 @@ template <int FractionalBits> struct fixed_point_policy
         return atan2(sqrt(from_int(1) - mul(x, x)), x);
     }
 
+    /**
+     * @brief Calculates the angle of `(x, y)` with a minimax polynomial over
+     * one octant (Abramowitz and Stegun 4.4.49), within 1e-5 radians before
+     * rounding to the last place.
+     */
     static constexpr storage_type atan2(storage_type y, storage_type x)
     {
-        if (x == 0)
-            return y > 0 ? PI >> 1 : -(PI >> 1);
-        if (y == 0)
-            return x > 0 ? 0 : PI;
+        if (x == 0 && y == 0)
+            return 0;
 
-        storage_type angle = 0;
-        for (int i = 0; i < CORDIC_NTAB; ++i)
-        {
-            storage_type x_shifted = x >> i;
-            storage_type y_shifted = y >> i;
-            if (y > 0)
-            {
-                x += y_shifted;
-                y -= x_shifted;
-                angle += cordic_ctab[i];
-            }
-            else
-            {
-                x -= y_shifted;
-                y += x_shifted;
-                angle -= cordic_ctab[i];
-            }
-        }
-        return angle;
+        const int64_t ax   = x < 0 ? -static_cast<int64_t>(x) : x;
+        const int64_t ay   = y < 0 ? -static_cast<int64_t>(y) : y;
+        const bool steep   = ay > ax;
+        const int64_t num  = steep ? ax : ay;
+        const int64_t den  = steep ? ay : ax;
+        const int64_t t    = (num << 30) / den;
+        const int64_t t_sq = (t * t) >> 30;
+
+        // atan(t) for t in [0, 1], all terms in Q2.30.
+        int64_t poly = q30(0.0208351);
+        poly         = q30(-0.0851330) + ((poly * t_sq) >> 30);
+        poly         = q30(0.1801410) + ((poly * t_sq) >> 30);
+        poly         = q30(-0.3302995) + ((poly * t_sq) >> 30);
+        poly         = q30(0.9998660) + ((poly * t_sq) >> 30);
+
+        int64_t angle = (poly * t) >> 30;
+
+        if (steep)
+            angle = q30(1.5707963267948966) - angle;
+        if (x < 0)
+            angle = q30(3.1415926535897932) - angle;
+        if (y < 0)
+            angle = -angle;
+        return from_q30(angle);
     }
 
     static constexpr storage_type tan(storage_type a)
@@ -429,62 +581,21 @@ template <int FractionalBits> struct fixed_point_policy
         return div(sin_val, cos_val);
     }
 
-    /** @brief Calculates sine and cosine using CORDIC algorithm. */
+    /**
+     * @brief Calculates sine and cosine from a quarter-wave table with linear
+     * interpolation, within 5e-6 before rounding to the last place.
+     */
     static constexpr tuple<storage_type, storage_type>
     sincos(storage_type angle)
     {
-#pragma region Range Reduction
-        // Map the input angle to the range [-pi/2, pi/2] and determine the
-        // quadrant.
-        auto quadrant_fixed = static_cast<storage_type>(
-            (static_cast<wide_storage_type>(angle) << FractionalBits) /
-            PI_DIV_2);
-        auto quadrant = quadrant_fixed >> FractionalBits;
+        // Angle in turns, a full turn is 2^32 so any angle wraps into range.
+        constexpr int64_t turns_per_radian = 683565276; // 2^32 / (2 pi)
 
-        // Use floor-like behavior for negative angles. If the angle is negative
-        // and has a fractional part, decrement the quadrant.
-        if (quadrant_fixed < 0 && (quadrant_fixed & fraction_mask) != 0)
-            quadrant--;
+        const int64_t turns  = static_cast<int64_t>(angle) * turns_per_radian;
+        const uint32_t phase = static_cast<uint32_t>(turns >> FractionalBits);
 
-        storage_type quadrant_term = mul(from_int(quadrant), PI_DIV_2);
-        storage_type reduced_angle = sub(angle, quadrant_term);
-#pragma endregion Range Reduction
-
-        storage_type x = CORDIC_K_INV;
-        storage_type y = 0;
-
-        for (int k = 0; k < CORDIC_NTAB; ++k)
-        {
-            storage_type y_shifted = y >> k;
-            storage_type x_shifted = x >> k;
-
-            if (reduced_angle >= 0)
-            {
-                x = x - y_shifted;
-                y = y + x_shifted;
-                reduced_angle -= cordic_ctab[k];
-            }
-            else
-            {
-                x = x + y_shifted;
-                y = y - x_shifted;
-                reduced_angle += cordic_ctab[k];
-            }
-        }
-
-        uint8_t quad_idx = (quadrant % 4 + 4) % 4;
-
-        switch (quad_idx)
-        {
-        case 0:
-            return {y, x};
-        case 1:
-            return {x, -y};
-        case 2:
-            return {-y, -x};
-        case 3:
-            return {-x, y};
-        }
+        return {from_q30(detail::fixed_sin_turns(phase)),
+                from_q30(detail::fixed_sin_turns(phase + 0x40000000u))};
     }
 
     static constexpr bool less_than(storage_type a, storage_type b)
@@ -497,26 +608,56 @@ template <int FractionalBits> struct fixed_point_policy
     }
 
 private:
-    static constexpr int CORDIC_NTAB = 16;
-    static constexpr storage_type CORDIC_K_INV =
-        static_cast<storage_type>(0.6072529350088813 * scale);
-    static constexpr storage_type cordic_ctab[CORDIC_NTAB] = {
-        static_cast<storage_type>(0.7853981633974483 * scale),
-        static_cast<storage_type>(0.4636476090008061 * scale),
-        static_cast<storage_type>(0.2449786631268641 * scale),
-        static_cast<storage_type>(0.1243549945467614 * scale),
-        static_cast<storage_type>(0.0624188099959573 * scale),
-        static_cast<storage_type>(0.0312398334302683 * scale),
-        static_cast<storage_type>(0.0156237286204768 * scale),
-        static_cast<storage_type>(0.0078123410601011 * scale),
-        static_cast<storage_type>(0.0039062301319669 * scale),
-        static_cast<storage_type>(0.0019531225164788 * scale),
-        static_cast<storage_type>(0.0009765621895593 * scale),
-        static_cast<storage_type>(0.0004882812111948 * scale),
-        static_cast<storage_type>(0.0002441406201494 * scale),
-        static_cast<storage_type>(0.0001220703118936 * scale),
-        static_cast<storage_type>(0.0000610351561742 * scale),
-        static_cast<storage_type>(0.0000305175781153 * scale)};
+    /**
+     * @brief Splits a positive value into a mantissa in `[1/4, 1)` and a power
+     * of two, `a = m * 2^(2 * exponent)`, so square roots halve the power
+     * evenly.
+     * @param exponent Receives the exponent.
+     * @return The mantissa in Q2.30.
+     */
+    static constexpr uint64_t normalize_q30(storage_type a, int &exponent)
+    {
+        // Shift the top bit to bit 29 or 28, making the total shift even.
+        const int msb = 31 - __builtin_clz(static_cast<uint32_t>(a));
+        int shift     = 29 - msb;
+        if (((30 - FractionalBits - shift) & 1) != 0)
+            --shift;
+
+        exponent = (30 - FractionalBits - shift) / 2;
+        return shift >= 0 ? static_cast<uint64_t>(a) << shift
+                          : static_cast<uint64_t>(a) >> -shift;
+    }
+
+    /** @brief `1 / sqrt(m)` in Q2.30 for a mantissa from `normalize_q30`. */
+    static constexpr uint64_t rsqrt_q30(uint64_t m)
+    {
+        // y = y * (3 - m * y^2) / 2, squaring the relative error each step.
+        uint64_t y = detail::fixed_rsqrt_table.values[(m >> 24) - 16];
+        for (int i = 0; i < 2; ++i)
+        {
+            const uint64_t y_sq   = (y * y) >> 30;
+            const uint64_t m_y_sq = (m * y_sq) >> 30;
+            y = (y * ((static_cast<uint64_t>(3) << 30) - m_y_sq)) >> 31;
+        }
+        return y;
+    }
+
+    /** @brief Converts a constant to Q2.30, at compile time. */
+    static constexpr int64_t q30(double v)
+    {
+        return static_cast<int64_t>(v * (1 << 30) + (v < 0 ? -0.5 : 0.5));
+    }
+
+    /** @brief Rounds a Q2.30 value to this policy's precision. */
+    static constexpr storage_type from_q30(int64_t v)
+    {
+        if constexpr (FractionalBits >= 30)
+            return static_cast<storage_type>(v << (FractionalBits - 30));
+        else
+            return static_cast<storage_type>(
+                (v + (static_cast<int64_t>(1) << (29 - FractionalBits))) >>
+                (30 - FractionalBits));
+    }
 };
 
 /**
@@ -730,6 +871,8 @@ private:
     template <typename P>
     friend constexpr custom_real<P> sqrt(const custom_real<P> &);
     template <typename P>
+    friend constexpr custom_real<P> rsqrt(const custom_real<P> &);
+    template <typename P>
     friend constexpr custom_real<P> sin(const custom_real<P> &);
     template <typename P>
     friend constexpr custom_real<P> cos(const custom_real<P> &);
@@ -828,6 +971,17 @@ constexpr custom_real<Policy> sqrt(const custom_real<Policy> &val)
     return custom_real<Policy>::from_raw(Policy::sqrt(val.m_value));
 }
 
+/**
+ * @brief Calculates the reciprocal of the square root of a value.
+ * @param val The input value, must be positive.
+ * @return `1 / sqrt(val)`.
+ */
+template <typename Policy>
+constexpr custom_real<Policy> rsqrt(const custom_real<Policy> &val)
+{
+    return custom_real<Policy>::from_raw(Policy::rsqrt(val.m_value));
+}
+
 /**
  * @brief Calculates the power of a base to an exponent.
  * @param base The base value.
@@ -9,26 +9,108 @@
 
 namespace zabato
 {
-template <typename T> class shared_ptr;
-template <typename T> class weak_ptr;
+/**
+ * @brief Reference count policy that is safe to share between threads.
+ *
+ * The default of `shared_ptr`. Counts are updated with atomic operations.
+ */
+struct atomic_ref_count
+{
+    using count_type = atomic_uint;
+
+    static void init(count_type &count, unsigned int value)
+    {
+        atomic_init(&count, value);
+    }
+
+    static unsigned int load(const count_type &count)
+    {
+        return atomic_load_explicit(&count, memory_order_relaxed);
+    }
+
+    static void increment(count_type &count)
+    {
+        atomic_fetch_add_explicit(&count, 1, memory_order_relaxed);
+    }
+
+    /** @return True if the count dropped to zero. */
+    static bool decrement(count_type &count)
+    {
+        return atomic_fetch_sub_explicit(&count, 1, memory_order_acq_rel) == 1;
+    }
+
+    /** @return False if the count was zero, leaving it there. */
+    static bool try_increment(count_type &count)
+    {
+        unsigned int value = load(count);
+        do
+        {
+            if (value == 0)
+                return false;
+        } while (!atomic_compare_exchange_weak_explicit(&count,
+                                                        &value,
+                                                        value + 1,
+                                                        memory_order_acquire,
+                                                        memory_order_relaxed));
+        return true;
+    }
+};
+
+/**
+ * @brief Reference count policy for objects that stay on one thread.
+ *
+ * Counts are plain integers, so copies cost no locked instructions. Every
+ * pointer to the object, shared or weak, must be used by the same thread.
+ */
+struct local_ref_count
+{
+    using count_type = unsigned int;
+
+    static void init(count_type &count, unsigned int value) { count = value; }
+    static unsigned int load(const count_type &count) { return count; }
+    static void increment(count_type &count) { ++count; }
+
+    /** @return True if the count dropped to zero. */
+    static bool decrement(count_type &count) { return --count == 0; }
+
+    /** @return False if the count was zero, leaving it there. */
+    static bool try_increment(count_type &count)
+    {
+        if (count == 0)
+            return false;
+        ++count;
+        return true;
+    }
+};
+
+template <typename T, typename Policy = atomic_ref_count> class shared_ptr;
+template <typename T, typename Policy = atomic_ref_count> class weak_ptr;
+
+/** @brief A `shared_ptr` confined to one thread, see `local_ref_count`. */
+template <typename T> using local_shared_ptr = shared_ptr<T, local_ref_count>;
+
+/** @brief A `weak_ptr` confined to one thread, see `local_ref_count`. */
+template <typename T> using local_weak_ptr = weak_ptr<T, local_ref_count>;
 
 /**
  * @brief Base class for reference counting control blocks.
  *
- * Handles thread-safe reference counting for both strong and weak references.
+ * Counts strong and weak references as `Policy` dictates.
+ *
+ * @tparam Policy `atomic_ref_count` or `local_ref_count`.
  */
-struct control_block_base
+template <typename Policy> struct control_block_base
 {
     /** @brief Strong reference count. */
-    atomic_uint ref_count;
+    typename Policy::count_type ref_count;
     /** @brief Weak reference count. */
-    atomic_uint weak_count;
+    typename Policy::count_type weak_count;
 
     /** @brief Initializes reference counts to 1 (strong) and 1 (weak). */
     control_block_base()
     {
-        atomic_init(&ref_count, 1);
-        atomic_init(&weak_count, 1); // 1 for the strong ref holders
+        Policy::init(ref_count, 1);
+        Policy::init(weak_count, 1); // 1 for the strong ref holders
     }
 
     /** @brief Virtual destructor. */
@@ -39,69 +121,48 @@ struct control_block_base
     /** @brief Destroys the control block itself. */
     virtual void destroy_self() = 0;
 
-    /** @brief Atomically increments the strong reference count. */
-    void add_ref()
-    {
-        atomic_fetch_add_explicit(&ref_count, 1, memory_order_relaxed);
-    }
+    /** @brief Increments the strong reference count. */
+    void add_ref() { Policy::increment(ref_count); }
 
     /**
-     * @brief Atomically decrements the strong reference count.
+     * @brief Decrements the strong reference count.
      *
      * If the count reaches zero, the managed object is destroyed and the weak
      * reference count is decremented.
      */
     void release_ref()
     {
-        if (atomic_fetch_sub_explicit(&ref_count, 1, memory_order_acq_rel) == 1)
+        if (Policy::decrement(ref_count))
         {
             destroy_object();
             release_weak();
         }
     }
 
-    /** @brief Atomically increments the weak reference count. */
-    void add_weak()
-    {
-        atomic_fetch_add_explicit(&weak_count, 1, memory_order_relaxed);
-    }
+    /** @brief Increments the weak reference count. */
+    void add_weak() { Policy::increment(weak_count); }
 
     /**
-     * @brief Atomically decrements the weak reference count.
+     * @brief Decrements the weak reference count.
      *
      * If the count reaches zero, the control block itself is destroyed.
      */
     void release_weak()
     {
-        if (atomic_fetch_sub_explicit(&weak_count, 1, memory_order_acq_rel) ==
-            1)
-        {
+        if (Policy::decrement(weak_count))
             destroy_self();
-        }
     }
 
     /**
-     * @brief Tries to atomically increment the strong reference count if it is
-     * not zero.
+     * @brief Tries to increment the strong reference count if it is not zero.
      *
      * @return true providing the reference count was incremented, false if the
      * object is already destroyed.
      */
-    bool try_add_ref()
-    {
-        unsigned int count =
-            atomic_load_explicit(&ref_count, memory_order_relaxed);
-        do
-        {
-            if (count == 0)
-                return false;
-        } while (!atomic_compare_exchange_weak_explicit(&ref_count,
-                                                        &count,
-                                                        count + 1,
-                                                        memory_order_acquire,
-                                                        memory_order_relaxed));
-        return true;
-    }
+    bool try_add_ref() { return Policy::try_increment(ref_count); }
+
+    /** @return The strong reference count. */
+    unsigned int use_count() const { return Policy::load(ref_count); }
 };
 
 /**
@@ -109,7 +170,8 @@ struct control_block_base
  *
  * Manages a pointer that was allocated separately from the control block.
  */
-template <typename T> struct control_block_ptr : public control_block_base
+template <typename T, typename Policy>
+struct control_block_ptr : public control_block_base<Policy>
 {
     /** @brief Pointer to the managed object. */
     T *ptr;
@@ -127,10 +189,12 @@ template <typename T> struct control_block_ptr : public control_block_base
 /**
  * @brief Control block for objects allocated inplace.
  *
- * Uses a single allocation for both the control block and the object.
- * Used by make_shared.
+ * Uses a single allocation for both the control block and the object. The
+ * storage is aligned for `T`, and `new` honors over-aligned types. Used by
+ * make_shared.
  */
-template <typename T> struct control_block_inplace : public control_block_base
+template <typename T, typename Policy>
+struct control_block_inplace : public control_block_base<Policy>
 {
     /** @brief Storage for the object, properly aligned. */
     alignas(T) unsigned char storage[sizeof(T)];
@@ -153,8 +217,10 @@ template <typename T> struct control_block_inplace : public control_block_base
  * through reference counting.
  *
  * @tparam T The type of the managed object.
+ * @tparam Policy How references are counted, `atomic_ref_count` (the default)
+ * or `local_ref_count`.
  */
-template <typename T> class shared_ptr
+template <typename T, typename Policy> class shared_ptr
 {
 public:
     /** @brief The type of the managed object. */
@@ -177,7 +243,7 @@ public:
         {
             try
             {
-                m_cb = new control_block_ptr<T>(ptr);
+                m_cb = new control_block_ptr<T, Policy>(ptr);
             }
             catch (...)
             {
@@ -200,7 +266,7 @@ public:
 
     /** @brief Copy constructor from a shared_ptr of a compatible type. */
     template <typename Y>
-    shared_ptr(const shared_ptr<Y> &other)
+    shared_ptr(const shared_ptr<Y, Policy> &other)
         : m_ptr(other.get()), m_cb(other.m_cb)
     {
         if (m_cb)
@@ -217,7 +283,7 @@ public:
 
     /** @brief Move constructor from a shared_ptr of a compatible type. */
     template <typename Y>
-    shared_ptr(shared_ptr<Y> &&other) noexcept
+    shared_ptr(shared_ptr<Y, Policy> &&other) noexcept
         : m_ptr(other.get()), m_cb(other.m_cb)
     {
         other.m_ptr = nullptr;
@@ -246,14 +312,16 @@ public:
     }
 
     /** @brief Copy assignment from a compatible shared_ptr. */
-    template <typename Y> shared_ptr &operator=(const shared_ptr<Y> &other)
+    template <typename Y>
+    shared_ptr &operator=(const shared_ptr<Y, Policy> &other)
     {
         shared_ptr(other).swap(*this);
         return *this;
     }
 
     /** @brief Move assignment from a compatible shared_ptr. */
-    template <typename Y> shared_ptr &operator=(shared_ptr<Y> &&other) noexcept
+    template <typename Y>
+    shared_ptr &operator=(shared_ptr<Y, Policy> &&other) noexcept
     {
         shared_ptr(zabato::move(other)).swap(*this);
         return *this;
@@ -282,36 +350,33 @@ public:
     explicit operator bool() const { return m_ptr != nullptr; }
 
     /** @brief Returns the current reference count. */
-    unsigned int use_count() const
-    {
-        return m_cb ? atomic_load_explicit(&m_cb->ref_count,
-                                           memory_order_relaxed)
-                    : 0;
-    }
+    unsigned int use_count() const { return m_cb ? m_cb->use_count() : 0; }
 
 private:
     T *m_ptr;
-    control_block_base *m_cb;
+    control_block_base<Policy> *m_cb;
 
     // For make_shared
-    shared_ptr(control_block_base *cb, T *ptr) : m_ptr(ptr), m_cb(cb) {}
+    shared_ptr(control_block_base<Policy> *cb, T *ptr) : m_ptr(ptr), m_cb(cb)
+    {
+    }
 
-    template <typename U> friend class shared_ptr;
-    template <typename U> friend class weak_ptr;
-    template <typename U, typename... Args>
-    friend shared_ptr<U> make_shared(Args &&...args);
+    template <typename U, typename P> friend class shared_ptr;
+    template <typename U, typename P> friend class weak_ptr;
+    template <typename U, typename P, typename... Args>
+    friend shared_ptr<U, P> make_shared(Args &&...args);
 
-    template <typename T2, typename U>
-    friend shared_ptr<T2> static_pointer_cast(const shared_ptr<U> &r);
+    template <typename T2, typename U, typename P>
+    friend shared_ptr<T2, P> static_pointer_cast(const shared_ptr<U, P> &r);
 };
 
-template <typename T, typename U>
-shared_ptr<T> static_pointer_cast(const shared_ptr<U> &r)
+template <typename T, typename U, typename Policy>
+shared_ptr<T, Policy> static_pointer_cast(const shared_ptr<U, Policy> &r)
 {
-    auto p = static_cast<typename shared_ptr<T>::element_type *>(r.get());
+    auto p = static_cast<T *>(r.get());
     if (r.m_cb)
         r.m_cb->add_ref();
-    return shared_ptr<T>(r.m_cb, p);
+    return shared_ptr<T, Policy>(r.m_cb, p);
 }
 
 /**
@@ -319,8 +384,9 @@ shared_ptr<T> static_pointer_cast(const shared_ptr<U> &r)
  * object managed by shared_ptr.
  *
  * @tparam T The type of the managed object.
+ * @tparam Policy How references are counted, as in the `shared_ptr`.
  */
-template <typename T> class weak_ptr
+template <typename T, typename Policy> class weak_ptr
 {
 public:
     /** @brief Constructs an empty weak_ptr. */
@@ -335,7 +401,8 @@ public:
 
     /** @brief Constructs from a shared_ptr. */
     template <typename Y>
-    weak_ptr(const shared_ptr<Y> &other) : m_ptr(other.get()), m_cb(other.m_cb)
+    weak_ptr(const shared_ptr<Y, Policy> &other)
+        : m_ptr(other.get()), m_cb(other.m_cb)
     {
         if (m_cb)
             m_cb->add_weak();
@@ -343,7 +410,8 @@ public:
 
     /** @brief Copy constructor from a compatible weak_ptr. */
     template <typename Y>
-    weak_ptr(const weak_ptr<Y> &other) : m_ptr(other.m_ptr), m_cb(other.m_cb)
+    weak_ptr(const weak_ptr<Y, Policy> &other)
+        : m_ptr(other.m_ptr), m_cb(other.m_cb)
     {
         if (m_cb)
             m_cb->add_weak();
@@ -358,7 +426,7 @@ public:
 
     /** @brief Move constructor from a compatible weak_ptr. */
     template <typename Y>
-    weak_ptr(weak_ptr<Y> &&other) noexcept
+    weak_ptr(weak_ptr<Y, Policy> &&other) noexcept
         : m_ptr(other.m_ptr), m_cb(other.m_cb)
     {
         other.m_ptr = nullptr;
@@ -380,7 +448,8 @@ public:
     }
 
     /** @brief Copy assignment from compatible weak_ptr. */
-    template <typename Y> weak_ptr &operator=(const weak_ptr<Y> &other)
+    template <typename Y>
+    weak_ptr &operator=(const weak_ptr<Y, Policy> &other)
     {
         weak_ptr(other).swap(*this);
         return *this;
@@ -394,14 +463,16 @@ public:
     }
 
     /** @brief Move assignment from compatible weak_ptr. */
-    template <typename Y> weak_ptr &operator=(weak_ptr<Y> &&other) noexcept
+    template <typename Y>
+    weak_ptr &operator=(weak_ptr<Y, Policy> &&other) noexcept
     {
         weak_ptr(zabato::move(other)).swap(*this);
         return *this;
     }
 
     /** @brief Assignment from compatible shared_ptr. */
-    template <typename Y> weak_ptr &operator=(const shared_ptr<Y> &other)
+    template <typename Y>
+    weak_ptr &operator=(const shared_ptr<Y, Policy> &other)
     {
         weak_ptr(other).swap(*this);
         return *this;
@@ -418,12 +489,7 @@ public:
     void reset() { weak_ptr().swap(*this); }
 
     /** @brief Returns current use count of the managed object. */
-    long use_count() const
-    {
-        return m_cb ? atomic_load_explicit(&m_cb->ref_count,
-                                           memory_order_relaxed)
-                    : 0;
-    }
+    long use_count() const { return m_cb ? m_cb->use_count() : 0; }
 
     /** @brief Checks if the managed object has been deleted. */
     bool expired() const { return use_count() == 0; }
@@ -433,21 +499,21 @@ public:
      * @return shared_ptr<T> containing the object if it exists, otherwise
      * empty.
      */
-    shared_ptr<T> lock() const
+    shared_ptr<T, Policy> lock() const
     {
         if (m_cb && m_cb->try_add_ref())
         {
-            return shared_ptr<T>(m_cb, m_ptr);
+            return shared_ptr<T, Policy>(m_cb, m_ptr);
         }
-        return shared_ptr<T>();
+        return shared_ptr<T, Policy>();
     }
 
 private:
     T *m_ptr;
-    control_block_base *m_cb;
+    control_block_base<Policy> *m_cb;
 
-    template <typename U> friend class weak_ptr;
-    template <typename U> friend class shared_ptr;
+    template <typename U, typename P> friend class weak_ptr;
+    template <typename U, typename P> friend class shared_ptr;
 };
 
 /**
@@ -455,47 +521,63 @@ private:
  * single allocation.
  *
  * @tparam T Type of object to create.
+ * @tparam Policy How references are counted, see `shared_ptr`.
  * @tparam Args Argument types for T's constructor.
  * @param args Arguments to pass to T's constructor.
  * @return shared_ptr<T> owning the new object.
  */
+template <typename T, typename Policy = atomic_ref_count, typename... Args>
+shared_ptr<T, Policy> make_shared(Args &&...args)
+{
+    auto *cb = new control_block_inplace<T, Policy>(
+        zabato::forward<Args>(args)...);
+    return shared_ptr<T, Policy>(cb, reinterpret_cast<T *>(cb->storage));
+}
+
+/**
+ * @brief Like `make_shared`, for an object that stays on one thread.
+ * @return local_shared_ptr<T> owning the new object.
+ */
 template <typename T, typename... Args>
-shared_ptr<T> make_shared(Args &&...args)
+local_shared_ptr<T> make_local_shared(Args &&...args)
 {
-    auto *cb = new control_block_inplace<T>(zabato::forward<Args>(args)...);
-    return shared_ptr<T>(cb, reinterpret_cast<T *>(cb->storage));
+    return make_shared<T, local_ref_count>(zabato::forward<Args>(args)...);
 }
 
 /** @name Comparison Operators */
 ///@{
-template <typename T, typename U>
-bool operator==(const shared_ptr<T> &lhs, const shared_ptr<U> &rhs)
+template <typename T, typename U, typename P>
+bool operator==(const shared_ptr<T, P> &lhs, const shared_ptr<U, P> &rhs)
 {
     return lhs.get() == rhs.get();
 }
 
-template <typename T> bool operator==(const shared_ptr<T> &lhs, std::nullptr_t)
+template <typename T, typename P>
+bool operator==(const shared_ptr<T, P> &lhs, std::nullptr_t)
 {
     return !lhs;
 }
 
-template <typename T> bool operator==(std::nullptr_t, const shared_ptr<T> &rhs)
+template <typename T, typename P>
+bool operator==(std::nullptr_t, const shared_ptr<T, P> &rhs)
 {
     return !rhs;
 }
 
-template <typename T, typename U>
-bool operator!=(const shared_ptr<T> &lhs, const shared_ptr<U> &rhs)
+template <typename T, typename U, typename P>
+bool operator!=(const shared_ptr<T, P> &lhs, const shared_ptr<U, P> &rhs)
 {
     return lhs.get() != rhs.get();
 }
 
-template <typename T> bool operator!=(const shared_ptr<T> &lhs, std::nullptr_t)
+template <typename T, typename P>
+bool operator!=(const shared_ptr<T, P> &lhs, std::nullptr_t)
 {
     return (bool)lhs;
 }
 
-template <typename T> bool operator!=(std::nullptr_t, const shared_ptr<T> &rhs)
+template <typename T, typename P>
+bool operator!=(std::nullptr_t, const shared_ptr<T, P> &rhs)
 {
     return (bool)rhs;
 }
@@ -0,0 +1,430 @@
+#pragma once
+
+#include <zabato/allocator.hpp>
+#include <zabato/utils.hpp>
+#include <zabato/vector.hpp>
+
+#include <assert.h>
+#include <initializer_list>
+#include <new>
+
+namespace zabato
+{
+/**
+ * @class small_vector
+ * @brief A vector that keeps its first `N` elements inside the object.
+ *
+ * Up to `N` elements live in inline storage and never touch the allocator.
+ * Past that the elements move to the heap, like `vector`, and stay there
+ * until `shrink_to_fit` brings them back. The interface matches `vector`,
+ * so it replaces one for collections that are usually tiny.
+ *
+ * Elements are moved when the storage changes, so pointers and iterators
+ * are invalidated by growth, and by moving an inline `small_vector`.
+ *
+ * @tparam T The type of elements stored in the vector.
+ * @tparam N The number of elements stored inline.
+ * @tparam Allocator The allocator used once the elements spill.
+ */
+template <class T, size_t N, class Allocator = allocator<T>> class small_vector
+{
+    static_assert(N > 0, "small_vector needs inline room for one element");
+
+public:
+    using allocator_type = Allocator;
+    using iterator       = vector_iterator<T>;
+    using const_iterator = const_vector_iterator<T>;
+
+    /** @brief The number of elements stored without allocating. */
+    static constexpr size_t inline_capacity = N;
+
+    /** @brief Constructs an empty vector using the inline storage. */
+    small_vector() noexcept
+        : m_data(inline_data()), m_size(0), m_capacity(N), m_allocator()
+    {
+    }
+
+    /** @brief Constructs a vector of `size` default constructed elements. */
+    explicit small_vector(size_t size) : small_vector() { resize(size); }
+
+    /** @brief Iterator range constructor */
+    template <typename InputIterator>
+    small_vector(InputIterator first, InputIterator last) : small_vector()
+    {
+        for (auto it = first; it != last; ++it)
+            push_back(*it);
+    }
+
+    small_vector(std::initializer_list<T> init) : small_vector()
+    {
+        reserve(init.size());
+        for (const auto &item : init)
+            push_back(item);
+    }
+
+    /** @brief Copy constructor */
+    small_vector(const small_vector &other) : small_vector()
+    {
+        copy_from(other.m_data, other.m_size);
+    }
+
+    /** @brief Move constructor. Steals a heap buffer, moves inline elements. */
+    small_vector(small_vector &&other) noexcept : small_vector()
+    {
+        take(other);
+    }
+
+    /** @brief Copy assignment operator */
+    small_vector &operator=(const small_vector &other)
+    {
+        if (this != &other)
+        {
+            clear();
+            copy_from(other.m_data, other.m_size);
+        }
+        return *this;
+    }
+
+    /** @brief Move assignment operator */
+    small_vector &operator=(small_vector &&other) noexcept
+    {
+        if (this != &other)
+        {
+            clear();
+            release();
+            take(other);
+        }
+        return *this;
+    }
+
+    /** @brief Destroys the elements and frees the heap buffer, if any. */
+    ~small_vector() noexcept
+    {
+        clear();
+        release();
+    }
+
+    constexpr bool empty() const { return m_size == 0; }
+
+    /** @return True while the elements live in the inline storage. */
+    bool is_inline() const { return m_data == inline_data(); }
+
+    /** @brief Removes all elements, leaving the capacity unchanged. */
+    void clear()
+    {
+        destroy(m_data, m_size);
+        m_size = 0;
+    }
+
+    /**
+     * @brief Changes the number of elements stored.
+     * @param new_size The new size of the vector.
+     * @param val The value new elements are copied from.
+     */
+    void resize(size_t new_size, T val = T())
+    {
+        if (new_size > m_size)
+        {
+            reserve(new_size);
+            for (size_t i = m_size; i < new_size; ++i)
+                new (&m_data[i]) T(val);
+        }
+        else
+        {
+            destroy(m_data + new_size, m_size - new_size);
+        }
+        m_size = new_size;
+    }
+
+    /**
+     * @brief Replaces the contents of the vector with a range of elements.
+     * @param first Pointer to the first element to copy.
+     * @param last Pointer one past the last element to copy.
+     */
+    void assign(const T *first, const T *last)
+    {
+        clear();
+        copy_from(first, size_t(last - first));
+    }
+
+    /** @brief Adds an element to the end of the vector by copying. */
+    void push_back(const T &value)
+    {
+        if (m_size == m_capacity)
+        {
+            // `value` may live in this vector, copy it before growing.
+            T copy(value);
+            grow();
+            new (&m_data[m_size]) T(zabato::move(copy));
+        }
+        else
+        {
+            new (&m_data[m_size]) T(value);
+        }
+        ++m_size;
+    }
+
+    /** @brief Adds an element to the end of the vector by moving. */
+    void push_back(T &&value)
+    {
+        if (m_size == m_capacity)
+        {
+            T moved(zabato::move(value));
+            grow();
+            new (&m_data[m_size]) T(zabato::move(moved));
+        }
+        else
+        {
+            new (&m_data[m_size]) T(zabato::move(value));
+        }
+        ++m_size;
+    }
+
+    /** @brief Constructs an element in-place at the end of the vector. */
+    template <typename... Args> void emplace_back(Args &&...args)
+    {
+        if (m_size == m_capacity)
+        {
+            T value(static_cast<Args &&>(args)...);
+            grow();
+            new (&m_data[m_size]) T(zabato::move(value));
+        }
+        else
+        {
+            new (&m_data[m_size]) T(static_cast<Args &&>(args)...);
+        }
+        ++m_size;
+    }
+
+    /** @brief Removes the last element from the vector. */
+    void pop_back()
+    {
+        assert(m_size > 0);
+        --m_size;
+        destroy(m_data + m_size, 1);
+    }
+
+    /**
+     * @brief Removes the element at the specified index.
+     * @param index The index of the element to remove.
+     */
+    void remove_at(size_t index)
+    {
+        assert(index < m_size);
+
+        if (is_pod<T>::value)
+        {
+            memmove(m_data + index,
+                    m_data + index + 1,
+                    (m_size - index - 1) * sizeof(T));
+        }
+        else
+        {
+            for (size_t i = index; i < m_size - 1; ++i)
+                m_data[i] = zabato::move(m_data[i + 1]);
+            m_data[m_size - 1].~T();
+        }
+
+        --m_size;
+    }
+
+    /**
+     * @brief Removes the first occurrence of the specified value.
+     * @param val The value to remove.
+     * @return True if the value was found and removed, false otherwise.
+     */
+    bool remove(const T &val)
+    {
+        for (size_t i = 0; i < m_size; ++i)
+        {
+            if (m_data[i] == val)
+            {
+                remove_at(i);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /** @brief Accesses an element by index with bounds checking (in debug). */
+    T &operator[](size_t index)
+    {
+        assert(index < m_size);
+        return m_data[index];
+    }
+
+    /** @brief Accesses an element by index with bounds checking (in debug),
+     * const version. */
+    const T &operator[](size_t index) const
+    {
+        assert(index < m_size);
+        return m_data[index];
+    }
+
+    /** @return The number of elements in the vector. */
+    size_t size() const { return m_size; }
+
+    /** @return The number of elements the vector can hold before reallocating.
+     */
+    size_t capacity() const { return m_capacity; }
+
+    /** @brief Requests a change in capacity, moving the elements to the heap
+     * when it exceeds the inline storage. */
+    void reserve(size_t new_capacity)
+    {
+        if (new_capacity <= m_capacity)
+            return;
+
+        T *new_data = m_allocator.allocate(new_capacity);
+        assert(new_data != nullptr);
+
+        relocate(new_data);
+        m_capacity = new_capacity;
+    }
+
+    /** @brief Shrinks the capacity to fit the size, returning to the inline
+     * storage when the elements fit in it. */
+    void shrink_to_fit()
+    {
+        if (is_inline() || m_size == m_capacity)
+            return;
+
+        if (m_size <= N)
+        {
+            relocate(inline_data());
+            m_capacity = N;
+            return;
+        }
+
+        T *new_data = m_allocator.allocate(m_size);
+        assert(new_data != nullptr);
+
+        relocate(new_data);
+        m_capacity = m_size;
+    }
+
+    /** @return An iterator to the beginning of the vector. */
+    iterator begin() { return iterator(m_data); }
+    /** @return A const_iterator to the beginning of the vector. */
+    const_iterator begin() const { return const_iterator(m_data); }
+    /** @return A const_iterator to the beginning of the vector. */
+    const_iterator cbegin() const { return const_iterator(m_data); }
+
+    /** @return An iterator to one past the end of the vector. */
+    iterator end() { return iterator(m_data + m_size); }
+    /** @return A const_iterator to one past the end of the vector. */
+    const_iterator end() const { return const_iterator(m_data + m_size); }
+    /** @return A const_iterator to one past the end of the vector. */
+    const_iterator cend() const { return const_iterator(m_data + m_size); }
+
+    T *data() { return m_data; }
+    const T *data() const { return m_data; }
+
+    T &back() { return m_data[m_size - 1]; }
+    const T &back() const { return m_data[m_size - 1]; }
+
+private:
+    T *inline_data() { return reinterpret_cast<T *>(m_inline); }
+    const T *inline_data() const
+    {
+        return reinterpret_cast<const T *>(m_inline);
+    }
+
+    void grow() { reserve(m_capacity * 2); }
+
+    static void destroy(T *first, size_t count)
+    {
+        if (!is_pod<T>::value)
+            for (size_t i = 0; i < count; ++i)
+                first[i].~T();
+    }
+
+    /** @brief Moves the elements to `new_data` and frees the old buffer. */
+    void relocate(T *new_data)
+    {
+        if (is_pod<T>::value)
+        {
+            memcpy(new_data, m_data, m_size * sizeof(T));
+        }
+        else
+        {
+            for (size_t i = 0; i < m_size; ++i)
+            {
+                new (&new_data[i]) T(zabato::move(m_data[i]));
+                m_data[i].~T();
+            }
+        }
+
+        release();
+        m_data = new_data;
+    }
+
+    /** @brief Frees the heap buffer, if any. The elements must be gone. */
+    void release()
+    {
+        if (!is_inline())
+            m_allocator.deallocate(m_data, m_capacity);
+        m_data     = inline_data();
+        m_capacity = N;
+    }
+
+    /** @brief Copies `count` elements into an empty vector. */
+    void copy_from(const T *source, size_t count)
+    {
+        reserve(count);
+        if (is_pod<T>::value)
+        {
+            memcpy(m_data, source, count * sizeof(T));
+        }
+        else
+        {
+            for (size_t i = 0; i < count; ++i)
+                new (&m_data[i]) T(source[i]);
+        }
+        m_size = count;
+    }
+
+    /** @brief Takes the elements of `other`, leaving it empty and inline.
+     * This vector must be empty and inline. */
+    void take(small_vector &other)
+    {
+        if (other.is_inline())
+        {
+            relocate_from(other);
+            return;
+        }
+
+        m_data           = other.m_data;
+        m_size           = other.m_size;
+        m_capacity       = other.m_capacity;
+        other.m_data     = other.inline_data();
+        other.m_size     = 0;
+        other.m_capacity = N;
+    }
+
+    void relocate_from(small_vector &other)
+    {
+        const size_t count = other.m_size;
+        other.m_size       = 0;
+        if (is_pod<T>::value)
+        {
+            memcpy(m_data, other.m_data, count * sizeof(T));
+        }
+        else
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                new (&m_data[i]) T(zabato::move(other.m_data[i]));
+                other.m_data[i].~T();
+            }
+        }
+        m_size = count;
+    }
+
+    T *m_data;             ///< The inline storage or a heap buffer.
+    size_t m_size;         ///< Number of elements currently in the vector.
+    size_t m_capacity;     ///< N while inline, else the heap capacity.
+    Allocator m_allocator; ///< The allocator instance.
+    alignas(T) unsigned char m_inline[N * sizeof(T)]; ///< Inline elements.
+};
+} // namespace zabato
@@ -6,6 +6,7 @@
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 namespace zabato
 {
@@ -53,6 +54,14 @@ public:
 
     /** @brief Sets position of stream. */
     virtual void pos(int64_t offset) = 0;
+
+    /**
+     * @brief Moves past the next `size` bytes and returns them in place,
+     * without a copy, when the stream holds them in memory.
+     * @return The bytes, valid until the next call on the stream, or null
+     * with the position unchanged when the stream cannot lend them.
+     */
+    virtual const uint8_t *view(size_t size) { return nullptr; }
 };
 
 /**
@@ -96,6 +105,163 @@ private:
     FILE *m_file;
 };
 
+/**
+ * @class buffered_stream
+ * @brief A read-ahead window over another stream.
+ *
+ * Reads are served from a window refilled from the source one `window` bytes
+ * at a time, so the many header-sized reads of a chunk walk or of object
+ * deserialization cost a copy each instead of a call into the source. `skip`
+ * and `pos` inside the window only move the cursor, where a `file_stream`
+ * would seek and drop the stdio buffer. Reads of at least a window go
+ * straight to the source, and writes drop the window first.
+ *
+ * The source must not be used directly while the buffer is in use. `sync` and
+ * the destructor move it back to the position of this stream.
+ */
+class buffered_stream : public stream
+{
+public:
+    static constexpr size_t default_window = 16 * 1024;
+
+    /**
+     * @param source The stream to read from, must outlive this one.
+     * @param window The read-ahead size in bytes.
+     */
+    explicit buffered_stream(stream &source, size_t window = default_window)
+        : m_source(source), m_window(window > 0 ? window : 1),
+          m_base(source.tell())
+    {
+    }
+    ~buffered_stream() override { sync(); }
+
+    buffered_stream(const buffered_stream &)            = delete;
+    buffered_stream &operator=(const buffered_stream &) = delete;
+
+    size_t read(buffer &out) override final
+    {
+        uint8_t *data = out.data();
+        size_t left   = out.size();
+        size_t total  = 0;
+        while (left > 0)
+        {
+            if (m_cursor == m_size)
+            {
+                if (left >= m_window)
+                {
+                    sync();
+                    buffer direct(data, left);
+                    const size_t readed = m_source.read(direct);
+                    m_base += readed;
+                    return total + readed;
+                }
+                if (!fill())
+                    break;
+            }
+
+            const size_t count = min(left, m_size - m_cursor);
+            memcpy(data, m_data.data() + m_cursor, count);
+            m_cursor += count;
+            data += count;
+            left -= count;
+            total += count;
+        }
+        return total;
+    }
+
+    size_t write(const buffer &in) override final
+    {
+        sync();
+        const size_t written = m_source.write(in);
+        m_base += written;
+        return written;
+    }
+
+    void skip(int64_t offset) override final { pos(tell() + offset); }
+
+    /**
+     * @brief Lends the bytes from the window, refilled when they fit in one,
+     * or from the source when it holds them in memory.
+     */
+    const uint8_t *view(size_t size) override final
+    {
+        if (m_size - m_cursor < size)
+        {
+            sync();
+            if (const uint8_t *data = m_source.view(size))
+            {
+                m_base += size;
+                return data;
+            }
+            if (size > m_window || !fill() || m_size < size)
+                return nullptr;
+        }
+
+        const uint8_t *data = m_data.data() + m_cursor;
+        m_cursor += size;
+        return data;
+    }
+
+    /**
+     * @return True once the window was consumed and the source was read to
+     * its end, which may be before a read came short as with stdio.
+     */
+    bool eof() const override final
+    {
+        return m_cursor == m_size && m_source.eof();
+    }
+
+    void rewind() override final { pos(0); }
+
+    size_t tell() const override final { return m_base + m_cursor; }
+
+    void pos(int64_t offset) override final
+    {
+        if (offset >= (int64_t)m_base && offset <= (int64_t)(m_base + m_size))
+        {
+            m_cursor = (size_t)(offset - m_base);
+            return;
+        }
+
+        m_source.pos(offset);
+        m_base   = m_source.tell();
+        m_size   = 0;
+        m_cursor = 0;
+    }
+
+    /** @brief Drops the window and moves the source to `tell()`. */
+    void sync()
+    {
+        if (m_cursor != m_size)
+            m_source.pos(m_base + m_cursor);
+        m_base += m_cursor;
+        m_size   = 0;
+        m_cursor = 0;
+    }
+
+private:
+    /** @brief Replaces the consumed window with the next one. */
+    bool fill()
+    {
+        m_base += m_size;
+        m_size   = 0;
+        m_cursor = 0;
+        if (m_data.size() < m_window)
+            m_data.resize(m_window);
+
+        buffer window(m_data.data(), m_window);
+        m_size = m_source.read(window);
+        return m_size > 0;
+    }
+
+    stream &m_source;
+    vector<uint8_t> m_data;
+    size_t m_window;
+    size_t m_base;       ///< Source position of the window start.
+    size_t m_size   = 0; ///< Bytes in the window.
+    size_t m_cursor = 0; ///< Read position in the window.
+};
+
 /**
  * @class memory_stream
  * @brief An implementation of stream for an in-memory vector.
@@ -157,6 +323,15 @@ public:
 
     size_t tell() const override final { return m_cursor; }
 
+    const uint8_t *view(size_t size) override final
+    {
+        if (m_buffer.size() - m_cursor < size)
+            return nullptr;
+        const uint8_t *data = m_buffer.data() + m_cursor;
+        m_cursor += size;
+        return data;
+    }
+
     bool eof() const override final { return m_cursor >= m_buffer.size(); }
     void rewind() override final { m_cursor = 0; }
     size_t cursor() const { return m_cursor; }
@@ -250,12 +250,6 @@ public:
             allocate_large(len);
             memcpy(large.data, s, len);
             large.data[len] = '\0';
-
-            large.data = static_cast<char *>(m_allocator.allocate(len + 1));
-            memcpy(large.data, s, len);
-            large.data[len] = '\0';
-            large.size      = len;
-            large.capacity  = len << 1;
         }
     }
 
@@ -838,16 +832,8 @@ private:
 
     void set_small(size_t s)
     {
-        if constexpr (is_little_endian)
-        {
-            // Set high bit to mark as small. Store size in lower bits.
-            small[LAST_BYTE_IDX] = static_cast<char>(LE_SMALL_FLAG | s);
-        }
-        else
-        {
-            // Set low bit to mark as small. Store size in higher bits.
-            small[LAST_BYTE_IDX] = static_cast<char>((s << 1) | BE_SMALL_FLAG);
-        }
+        // Same encoding as `set_small_size`, which `get_small_size` decodes.
+        set_small_size(s);
         small[0] = '\0'; // Safety null for empty strings
     }
 
@@ -1048,6 +1034,32 @@ constexpr auto begin(string_view sv) -> string_view::iterator
 
 constexpr auto end(string_view sv) -> string_view::iterator { return sv.end(); }
 
+/** @brief Hashes the characters of a view. */
+template <> struct hash<string_view>
+{
+    size_t operator()(string_view str) const
+    {
+        return hash_bytes(str.data(), str.size());
+    }
+};
+
+/**
+ * @brief Hashes the characters of a string, not the string object.
+ *
+ * Views and C strings hash the same as a string of their characters, so maps
+ * keyed by strings look them up without building a string.
+ */
+template <typename Allocator>
+struct hash<basic_string<Allocator>> : hash<string_view>
+{
+};
+
+/** @brief Compares strings with strings, views or C strings alike. */
+template <typename Allocator> struct equal_to<basic_string<Allocator>>
+{
+    bool operator()(string_view a, string_view b) const { return a == b; }
+};
+
 using string = basic_string<allocator<char>>;
 
 } // namespace zabato
\ No newline at end of file
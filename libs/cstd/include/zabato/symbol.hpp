@@ -11,7 +11,8 @@ namespace zabato
  * @brief An opaque handle to an interned string.
  *
  * Symbols provide a fast way to compare strings by comparing their pointers
- * and are managed by a global, reference-counted symbol table.
+ * and are managed by a global, reference-counted symbol table. The table may
+ * be used from any thread.
  */
 struct symbol;
 
@@ -24,6 +25,24 @@ struct symbol;
  */
 symbol *get_symbol(const char *name);
 
+/**
+ * @brief Gets a unique, interned symbol that is never freed.
+ * Meant for names that live as long as the program, like RTTI types. Taking
+ * or releasing references to a permanent symbol does nothing, and an existing
+ * symbol for the same string becomes permanent.
+ * @param name The null-terminated string to get a symbol for.
+ * @return A pointer to the unique symbol.
+ */
+symbol *get_permanent_symbol(const char *name);
+
+/**
+ * @brief Looks up the interned symbol for a string without creating it.
+ * The reference count is left untouched.
+ * @param name The null-terminated string to look up.
+ * @return The symbol, or nullptr if the string has not been interned.
+ */
+symbol *find_symbol(const char *name);
+
 /**
  * @brief Increments the reference count of a symbol.
  * @param s The symbol to reference.
@@ -52,4 +71,10 @@ const char *get_symbol_name(const symbol *s);
  */
 uint32_t get_symbol_hash(const symbol *s);
 
+/** @brief Hashes symbol keys of a `hash_map` by their pre-calculated hash. */
+struct symbol_ptr_hasher
+{
+    size_t operator()(const symbol *s) const { return get_symbol_hash(s); }
+};
+
 } // namespace zabato
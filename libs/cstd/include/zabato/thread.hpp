@@ -0,0 +1,142 @@
+#pragma once
+
+#include <stdint.h>
+
+#ifndef _WIN32
+#include <pthread.h>
+#endif
+
+namespace zabato
+{
+/**
+ * @class thread
+ * @brief A minimal native thread, running one entry point to completion.
+ *
+ * The thread is joined on destruction and cannot be copied or moved while it
+ * runs, since the native thread refers back to this object.
+ */
+class thread
+{
+public:
+    using entry_point = void (*)(void *);
+
+    thread() = default;
+    ~thread() { join(); }
+
+    thread(const thread &)            = delete;
+    thread &operator=(const thread &) = delete;
+
+    /**
+     * @brief Starts running `entry(arg)` on a new native thread.
+     * @return False if the thread is already running or could not be
+     * created, e.g. on targets built without thread support.
+     */
+    bool start(entry_point entry, void *arg);
+
+    /** @brief Waits for the entry point to return. */
+    void join();
+
+    /** @return Whether the thread was started and not joined yet. */
+    bool joinable() const { return m_running; }
+
+    /** @return The number of hardware threads, at least 1. */
+    static uint32_t hardware_concurrency();
+
+    /** @brief Lets other threads run before the calling one continues. */
+    static void yield();
+
+    /** @brief Suspends the calling thread for at least a duration. */
+    static void sleep_for(uint64_t nanoseconds);
+
+private:
+    entry_point m_entry = nullptr;
+    void *m_arg         = nullptr;
+    bool m_running      = false;
+#ifdef _WIN32
+    void *m_handle = nullptr;
+#else
+    pthread_t m_handle = {};
+#endif
+
+    static void run(thread *self) { self->m_entry(self->m_arg); }
+
+#ifdef _WIN32
+    static unsigned long __stdcall trampoline(void *self);
+#else
+    static void *trampoline(void *self);
+#endif
+};
+
+/**
+ * @class mutex
+ * @brief A minimal native mutex, not recursive.
+ */
+class mutex
+{
+public:
+    mutex();
+    ~mutex();
+
+    mutex(const mutex &)            = delete;
+    mutex &operator=(const mutex &) = delete;
+
+    void lock();
+    void unlock();
+
+private:
+    friend class condition_variable;
+
+#ifdef _WIN32
+    void *m_handle = nullptr; ///< An SRWLOCK, which is pointer sized.
+#else
+    pthread_mutex_t m_handle;
+#endif
+};
+
+/** @brief Holds a mutex locked for its lifetime. */
+class lock_guard
+{
+public:
+    explicit lock_guard(mutex &mutex) : m_mutex(mutex) { m_mutex.lock(); }
+    ~lock_guard() { m_mutex.unlock(); }
+
+    lock_guard(const lock_guard &)            = delete;
+    lock_guard &operator=(const lock_guard &) = delete;
+
+private:
+    mutex &m_mutex;
+};
+
+/**
+ * @class condition_variable
+ * @brief Lets threads sleep until another thread signals them.
+ *
+ * Waits may wake without a signal, so they belong in a loop that checks the
+ * condition under the mutex.
+ */
+class condition_variable
+{
+public:
+    condition_variable();
+    ~condition_variable();
+
+    condition_variable(const condition_variable &)            = delete;
+    condition_variable &operator=(const condition_variable &) = delete;
+
+    /** @brief Unlocks `mutex`, sleeps until signaled, then locks it again. */
+    void wait(mutex &mutex);
+
+    /** @brief Wakes one waiting thread, if any. */
+    void notify_one();
+
+    /** @brief Wakes every waiting thread. */
+    void notify_all();
+
+private:
+#ifdef _WIN32
+    void *m_handle = nullptr; ///< A CONDITION_VARIABLE, pointer sized.
+#else
+    pthread_cond_t m_handle;
+#endif
+};
+} // namespace zabato
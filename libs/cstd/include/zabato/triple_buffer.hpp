@@ -0,0 +1,74 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+namespace zabato
+{
+/**
+ * @class triple_buffer
+ * @brief Hands the latest value from one thread to another without locks.
+ *
+ * The writer fills its buffer and publishes it; the reader picks up the most
+ * recently published one. Each side owns one of the three buffers and they
+ * swap the third through one atomic exchange, so neither ever waits for the
+ * other, and values published faster than they are read are skipped.
+ *
+ * The buffer returned by `write_buffer` holds an older value, not the last
+ * one published, so writers overwrite it whole.
+ *
+ * One thread writes and one thread reads.
+ *
+ * @tparam T The type of the values.
+ */
+template <typename T> class triple_buffer
+{
+public:
+    triple_buffer() { atomic_init(&m_middle, 1u); }
+
+    triple_buffer(const triple_buffer &)            = delete;
+    triple_buffer &operator=(const triple_buffer &) = delete;
+
+    /** @return The writer's buffer, to fill before `publish`. */
+    T &write_buffer() { return m_buffers[m_back]; }
+
+    /** @brief Makes the writer's buffer the latest value. */
+    void publish()
+    {
+        const uint32_t old = atomic_exchange_explicit(
+            &m_middle, m_back | fresh_bit, memory_order_acq_rel);
+        m_back = old & index_mask;
+    }
+
+    /**
+     * @brief Takes the latest published value, if one arrived since the last
+     * call.
+     * @return True if `read_buffer` changed.
+     */
+    bool update()
+    {
+        if (!(atomic_load_explicit(&m_middle, memory_order_relaxed) &
+              fresh_bit))
+            return false;
+
+        const uint32_t old = atomic_exchange_explicit(
+            &m_middle, m_front, memory_order_acq_rel);
+        m_front = old & index_mask;
+        return true;
+    }
+
+    /** @return The reader's buffer, the value taken by the last `update`. */
+    const T &read_buffer() const { return m_buffers[m_front]; }
+
+private:
+    static constexpr uint32_t index_mask = 3;
+    static constexpr uint32_t fresh_bit  = 4;
+
+    T m_buffers[3] = {};
+
+    // Each side's index on its own cache line, so they do not share one.
+    alignas(64) uint32_t m_back = 0;
+    alignas(64) atomic_uint m_middle;
+    alignas(64) uint32_t m_front = 2;
+};
+} // namespace zabato
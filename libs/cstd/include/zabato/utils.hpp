@@ -124,45 +124,145 @@ template <typename T> struct is_pod<T *>
     static const bool value = true;
 };
 
-template <typename T> struct hash
+namespace internal
+{
+/** @brief Multiplies two words, leaving the low half in `a`, high in `b`. */
+inline void hash_multiply(uint64_t &a, uint64_t &b)
+{
+#if defined(__SIZEOF_INT128__)
+    const __uint128_t r = __uint128_t(a) * b;
+    a                   = uint64_t(r);
+    b                   = uint64_t(r >> 64);
+#else
+    const uint64_t ha   = a >> 32, la = uint32_t(a);
+    const uint64_t hb   = b >> 32, lb = uint32_t(b);
+    const uint64_t high = ha * hb, mid0 = ha * lb, mid1 = hb * la;
+    const uint64_t low  = la * lb;
+    const uint64_t t    = low + (mid0 << 32);
+
+    a = t + (mid1 << 32);
+    b = high + (mid0 >> 32) + (mid1 >> 32) + (t < low) + (a < t);
+#endif
+}
+
+/** @return The two halves of `a * b`, folded into one word. */
+inline uint64_t hash_mix(uint64_t a, uint64_t b)
+{
+    hash_multiply(a, b);
+    return a ^ b;
+}
+
+inline uint64_t hash_read64(const uint8_t *p)
 {
-    size_t operator()(const T &op) const
+    uint64_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+inline uint64_t hash_read32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+} // namespace internal
+
+/**
+ * @brief Hashes a block of bytes, eight or more at a time (wyhash).
+ *
+ * Reads in native byte order, so the hashes are only meant for tables in
+ * memory, not for files shared between platforms.
+ *
+ * @param data The bytes to hash.
+ * @param size The number of bytes.
+ * @param seed Selects an independent hash function.
+ * @return The hash of the bytes.
+ */
+inline size_t hash_bytes(const void *data, size_t size, uint64_t seed = 0)
+{
+    static constexpr uint64_t secret[4] = {0xa0761d6478bd642full,
+                                           0xe7037ed1a0b428dbull,
+                                           0x8ebc6af09c88c6e3ull,
+                                           0x589965cc75374cc3ull};
+
+    const uint8_t *p = static_cast<const uint8_t *>(data);
+    seed ^= internal::hash_mix(seed ^ secret[0], secret[1]);
+
+    uint64_t a = 0, b = 0;
+    if (size <= 16)
+    {
+        if (size >= 4)
+        {
+            // Two overlapping pairs of words cover 4 to 16 bytes.
+            const size_t step = (size >> 3) << 2;
+
+            a = (internal::hash_read32(p) << 32) |
+                internal::hash_read32(p + step);
+            b = (internal::hash_read32(p + size - 4) << 32) |
+                internal::hash_read32(p + size - 4 - step);
+        }
+        else if (size > 0)
+        {
+            a = (uint64_t(p[0]) << 16) | (uint64_t(p[size >> 1]) << 8) |
+                p[size - 1];
+        }
+    }
+    else
     {
-        const size_t size  = sizeof(T);
-        const uint8_t *str = reinterpret_cast<const uint8_t *>(&op);
-        uint32_t hash      = 2166136261u;
-        for (size_t i = 0; i < size; i++)
+        size_t left = size;
+        if (left > 48)
+        {
+            uint64_t seed1 = seed, seed2 = seed;
+            do
+            {
+                seed  = internal::hash_mix(
+                    internal::hash_read64(p) ^ secret[1],
+                    internal::hash_read64(p + 8) ^ seed);
+                seed1 = internal::hash_mix(
+                    internal::hash_read64(p + 16) ^ secret[2],
+                    internal::hash_read64(p + 24) ^ seed1);
+                seed2 = internal::hash_mix(
+                    internal::hash_read64(p + 32) ^ secret[3],
+                    internal::hash_read64(p + 40) ^ seed2);
+                p += 48;
+                left -= 48;
+            } while (left > 48);
+            seed ^= seed1 ^ seed2;
+        }
+        while (left > 16)
         {
-            hash ^= str[i];
-            hash *= 16777619;
+            seed = internal::hash_mix(internal::hash_read64(p) ^ secret[1],
+                                      internal::hash_read64(p + 8) ^ seed);
+            p += 16;
+            left -= 16;
         }
-        return hash;
+        a = internal::hash_read64(p + left - 16);
+        b = internal::hash_read64(p + left - 8);
     }
+
+    a ^= secret[1];
+    b ^= seed;
+    internal::hash_multiply(a, b);
+    return size_t(internal::hash_mix(a ^ secret[0] ^ size, b ^ secret[1]));
+}
+
+/** @brief Hashes the bytes of a value, padding included. */
+template <typename T> struct hash
+{
+    size_t operator()(const T &op) const { return hash_bytes(&op, sizeof(T)); }
 };
 
+/** @brief Hashes the characters of a C string, not the pointer. */
 template <> struct hash<const char *>
 {
     size_t operator()(const char *str) const
     {
-        size_t length = strlen(str);
-        uint32_t hash = 2166136261u;
-        for (size_t i = 0; i < length; i++)
-        {
-            hash ^= str[i];
-            hash *= 16777619;
-        }
-        return hash;
+        return hash_bytes(str, strlen(str));
     }
 
     size_t operator()(const char *str, size_t len) const
     {
-        uint32_t hash = 2166136261u;
-        for (size_t i = 0; i < len; i++)
-        {
-            hash ^= str[i];
-            hash *= 16777619;
-        }
-        return hash;
+        return hash_bytes(str, len);
     }
 };
 
@@ -86,14 +86,7 @@ template <> struct hash<uuid>
 {
     size_t operator()(const uuid &u) const
     {
-        const uint8_t *p = u.data();
-        uint32_t cv      = 2166136261u;
-        for (int i = 0; i < 16; ++i)
-        {
-            cv ^= p[i];
-            cv *= 16777619;
-        }
-        return cv;
+        return hash_bytes(u.data(), 16);
     }
 };
 
@@ -410,27 +410,23 @@ public:
     }
 
     /**
-     * @brief Changes the number of elements stored.
+     * @brief Changes the number of elements stored. New arithmetic elements
+     * are left uninitialized, the others are default constructed.
      * @param new_size The new size of the vector.
      */
-    void resize(size_t new_size, T val = T())
+    void resize(size_t new_size)
     {
-        if (new_size > m_size)
-        {
-            if (new_size > m_capacity)
-                reserve(new_size);
+        resize_to(new_size, T(), !is_pod<T>::value);
+    }
 
-            if (!is_pod<T>::value)
-                for (size_t i = m_size; i < new_size; ++i)
-                    m_data[i] = val;
-        }
-        else if (new_size < m_size)
-        {
-            if (!is_pod<T>::value)
-                for (size_t i = new_size; i < m_size; ++i)
-                    m_data[i].~T();
-        }
-        m_size = new_size;
+    /**
+     * @brief Changes the number of elements stored.
+     * @param new_size The new size of the vector.
+     * @param val The value new elements are copied from.
+     */
+    void resize(size_t new_size, const T &val)
+    {
+        resize_to(new_size, val, true);
     }
 
     /**
@@ -461,7 +457,7 @@ public:
         if (m_size >= m_capacity)
             reserve(m_capacity == 0 ? 8 : (m_capacity * 3) / 2);
 
-        m_data[m_size] = value;
+        new (&m_data[m_size]) T(value);
         ++m_size;
     }
 
@@ -471,7 +467,7 @@ public:
         if (m_size >= m_capacity)
             reserve(m_capacity == 0 ? 8 : m_capacity * 2);
 
-        m_data[m_size] = zabato::move(value);
+        new (&m_data[m_size]) T(zabato::move(value));
         ++m_size;
     }
 
@@ -611,6 +607,27 @@ public:
     T &back() { return m_data[m_size - 1]; }
 
 private:
+    /** @brief Resizes, copying `val` into the new elements if `fill`. */
+    void resize_to(size_t new_size, const T &val, bool fill)
+    {
+        if (new_size > m_size)
+        {
+            if (new_size > m_capacity)
+                reserve(new_size);
+
+            if (fill)
+                for (size_t i = m_size; i < new_size; ++i)
+                    m_data[i] = val;
+        }
+        else if (new_size < m_size)
+        {
+            if (!is_pod<T>::value)
+                for (size_t i = new_size; i < m_size; ++i)
+                    m_data[i].~T();
+        }
+        m_size = new_size;
+    }
+
     T *m_data;             ///< Pointer to the dynamically allocated array.
     size_t m_size;         ///< Number of elements currently in the vector.
     size_t m_capacity;     ///< Total allocated capacity of the array.
@@ -0,0 +1,355 @@
+#include <zabato/color.hpp>
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ZABATO_COLOR_SSE2
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define ZABATO_COLOR_NEON
+#endif
+
+namespace zabato
+{
+namespace
+{
+static_assert(sizeof(color8888) == 4 && sizeof(color5551) == 2 &&
+              sizeof(color4444) == 2);
+
+/** @brief 4x4 Bayer matrix, thresholds 0 to 15. */
+constexpr uint8_t bayer4[4][4] = {
+    {0, 8, 2, 10},
+    {12, 4, 14, 6},
+    {3, 11, 1, 9},
+    {15, 7, 13, 5},
+};
+
+#pragma region Scalar kernels
+
+/** @brief Rounds `c * 255 / 31` like `color8888(color)` does. */
+inline uint32_t widen5(uint32_t c) { return (c * 527 + 23) >> 6; }
+
+inline uint32_t expand_5551(uint16_t v)
+{
+    const uint32_t r = v & 0x1F, g = (v >> 5) & 0x1F, b = (v >> 10) & 0x1F;
+    const uint32_t a = (v >> 15) ? 0xFFu : 0u;
+    return widen5(r) | (widen5(g) << 8) | (widen5(b) << 16) | (a << 24);
+}
+
+inline uint32_t expand_4444(uint16_t v)
+{
+    const uint32_t r = v & 0xF, g = (v >> 4) & 0xF, b = (v >> 8) & 0xF;
+    const uint32_t a = (v >> 12) & 0xF;
+    return (r * 17) | ((g * 17) << 8) | ((b * 17) << 16) | ((a * 17) << 24);
+}
+
+/** @param bias Added to the color channels, 0 to 7, before truncating. */
+inline uint16_t narrow_5551(uint32_t v, uint32_t bias)
+{
+    const uint32_t r = min(255u, (v & 0xFF) + bias) >> 3;
+    const uint32_t g = min(255u, ((v >> 8) & 0xFF) + bias) >> 3;
+    const uint32_t b = min(255u, ((v >> 16) & 0xFF) + bias) >> 3;
+    const uint32_t a = (v >> 31) & 1;
+    return uint16_t(r | (g << 5) | (b << 10) | (a << 15));
+}
+
+/** @param bias Added to the color channels, 0 to 15, before truncating. */
+inline uint16_t narrow_4444(uint32_t v, uint32_t bias)
+{
+    const uint32_t r = min(15u, ((v & 0xFF) + bias) >> 4);
+    const uint32_t g = min(15u, (((v >> 8) & 0xFF) + bias) >> 4);
+    const uint32_t b = min(15u, (((v >> 16) & 0xFF) + bias) >> 4);
+    const uint32_t a = min(15u, (((v >> 24) & 0xFF) + 8) >> 4);
+    return uint16_t(r | (g << 4) | (b << 8) | (a << 12));
+}
+
+#pragma endregion
+
+#pragma region SIMD kernels
+
+// Each kernel converts the first multiple of 8 pixels and returns how many it
+// did, the scalar kernels finish the rest.
+
+#if defined(ZABATO_COLOR_SSE2)
+using u32x4 = __m128i;
+
+inline u32x4 mask4(uint32_t m) { return _mm_set1_epi32(int(m)); }
+inline u32x4 and4(u32x4 a, u32x4 b) { return _mm_and_si128(a, b); }
+inline u32x4 or4(u32x4 a, u32x4 b) { return _mm_or_si128(a, b); }
+template <int N> inline u32x4 shl4(u32x4 v) { return _mm_slli_epi32(v, N); }
+template <int N> inline u32x4 shr4(u32x4 v) { return _mm_srli_epi32(v, N); }
+inline u32x4 add4(u32x4 a, u32x4 b) { return _mm_add_epi32(a, b); }
+inline u32x4 sub4(u32x4 a, u32x4 b) { return _mm_sub_epi32(a, b); }
+inline u32x4 neg4(u32x4 v) { return _mm_sub_epi32(_mm_setzero_si128(), v); }
+
+/** @brief Adds `b` to every byte, saturating at 255. */
+inline u32x4 adds8(u32x4 v, uint8_t b)
+{
+    return _mm_adds_epu8(v, _mm_set1_epi8(char(b)));
+}
+
+/** @brief Widens 8 16-bit values into two vectors of 4. */
+inline void load8(const uint16_t *p, u32x4 &lo, u32x4 &hi)
+{
+    const __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+    lo              = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+    hi              = _mm_unpackhi_epi16(v, _mm_setzero_si128());
+}
+
+inline void store4(uint32_t *p, u32x4 v)
+{
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), v);
+}
+
+inline u32x4 load4(const uint32_t *p)
+{
+    return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+}
+
+/** @brief Narrows two vectors of 4 values below 65536 to 8 16-bit ones. */
+inline void store8(uint16_t *p, u32x4 lo, u32x4 hi)
+{
+    // SSE2 only packs with signed saturation, so sign-extend the low halves.
+    lo = _mm_srai_epi32(_mm_slli_epi32(lo, 16), 16);
+    hi = _mm_srai_epi32(_mm_slli_epi32(hi, 16), 16);
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(p), _mm_packs_epi32(lo, hi));
+}
+#elif defined(ZABATO_COLOR_NEON)
+using u32x4 = uint32x4_t;
+
+inline u32x4 mask4(uint32_t m) { return vdupq_n_u32(m); }
+inline u32x4 and4(u32x4 a, u32x4 b) { return vandq_u32(a, b); }
+inline u32x4 or4(u32x4 a, u32x4 b) { return vorrq_u32(a, b); }
+template <int N> inline u32x4 shl4(u32x4 v) { return vshlq_n_u32(v, N); }
+template <int N> inline u32x4 shr4(u32x4 v) { return vshrq_n_u32(v, N); }
+inline u32x4 add4(u32x4 a, u32x4 b) { return vaddq_u32(a, b); }
+inline u32x4 sub4(u32x4 a, u32x4 b) { return vsubq_u32(a, b); }
+inline u32x4 neg4(u32x4 v) { return vsubq_u32(vdupq_n_u32(0), v); }
+
+inline u32x4 adds8(u32x4 v, uint8_t b)
+{
+    const uint8x16_t bytes = vreinterpretq_u8_u32(v);
+    return vreinterpretq_u32_u8(vqaddq_u8(bytes, vdupq_n_u8(b)));
+}
+
+inline void load8(const uint16_t *p, u32x4 &lo, u32x4 &hi)
+{
+    const uint16x8_t v = vld1q_u16(p);
+    lo                 = vmovl_u16(vget_low_u16(v));
+    hi                 = vmovl_u16(vget_high_u16(v));
+}
+
+inline void store4(uint32_t *p, u32x4 v) { vst1q_u32(p, v); }
+
+inline u32x4 load4(const uint32_t *p) { return vld1q_u32(p); }
+
+inline void store8(uint16_t *p, u32x4 lo, u32x4 hi)
+{
+    vst1q_u16(p, vcombine_u16(vmovn_u32(lo), vmovn_u32(hi)));
+}
+#endif
+
+#if defined(ZABATO_COLOR_SSE2) || defined(ZABATO_COLOR_NEON)
+/** @brief Widens a 5-bit channel at bit `Shift` to 8 bits at bit 0. */
+template <int Shift> inline u32x4 widen5(u32x4 v)
+{
+    // c * 527 as shifts, SSE2 has no 32-bit multiply.
+    const u32x4 c = and4(shr4<Shift>(v), mask4(0x1F));
+    const u32x4 t = sub4(add4(shl4<9>(c), shl4<4>(c)), c);
+    return shr4<6>(add4(t, mask4(23)));
+}
+
+inline u32x4 expand_5551_4(u32x4 v)
+{
+    const u32x4 alpha = shl4<24>(neg4(shr4<15>(v)));
+    return or4(or4(widen5<0>(v), shl4<8>(widen5<5>(v))),
+               or4(shl4<16>(widen5<10>(v)), alpha));
+}
+
+inline u32x4 expand_4444_4(u32x4 v)
+{
+    // Spread the nibbles to one per byte, then copy each into its high half.
+    const u32x4 rg = or4(and4(v, mask4(0xF)), and4(shl4<4>(v), mask4(0xF00)));
+    const u32x4 ba = or4(and4(shl4<8>(v), mask4(0xF0000)),
+                         and4(shl4<12>(v), mask4(0xF000000)));
+    const u32x4 n  = or4(rg, ba);
+    return or4(n, shl4<4>(n));
+}
+
+inline u32x4 narrow_5551_4(u32x4 v)
+{
+    const u32x4 r = and4(shr4<3>(v), mask4(0x1F));
+    const u32x4 g = and4(shr4<6>(v), mask4(0x1F << 5));
+    const u32x4 b = and4(shr4<9>(v), mask4(0x1F << 10));
+    const u32x4 a = shl4<15>(shr4<31>(v));
+    return or4(or4(r, g), or4(b, a));
+}
+
+inline u32x4 narrow_4444_4(u32x4 v)
+{
+    // Round every byte to its high nibble, then pack the nibbles.
+    const u32x4 n = and4(shr4<4>(adds8(v, 8)), mask4(0x0F0F0F0F));
+    return or4(or4(and4(n, mask4(0xF)), and4(shr4<4>(n), mask4(0xF0))),
+               or4(and4(shr4<8>(n), mask4(0xF00)),
+                   and4(shr4<12>(n), mask4(0xF000))));
+}
+
+size_t expand_5551_simd(const uint16_t *src, uint32_t *dst, size_t count)
+{
+    const size_t n = count & ~size_t(7);
+    for (size_t i = 0; i < n; i += 8)
+    {
+        u32x4 lo, hi;
+        load8(src + i, lo, hi);
+        store4(dst + i, expand_5551_4(lo));
+        store4(dst + i + 4, expand_5551_4(hi));
+    }
+    return n;
+}
+
+size_t expand_4444_simd(const uint16_t *src, uint32_t *dst, size_t count)
+{
+    const size_t n = count & ~size_t(7);
+    for (size_t i = 0; i < n; i += 8)
+    {
+        u32x4 lo, hi;
+        load8(src + i, lo, hi);
+        store4(dst + i, expand_4444_4(lo));
+        store4(dst + i + 4, expand_4444_4(hi));
+    }
+    return n;
+}
+
+size_t narrow_5551_simd(const uint32_t *src, uint16_t *dst, size_t count)
+{
+    const size_t n = count & ~size_t(7);
+    for (size_t i = 0; i < n; i += 8)
+        store8(dst + i,
+               narrow_5551_4(load4(src + i)),
+               narrow_5551_4(load4(src + i + 4)));
+    return n;
+}
+
+size_t narrow_4444_simd(const uint32_t *src, uint16_t *dst, size_t count)
+{
+    const size_t n = count & ~size_t(7);
+    for (size_t i = 0; i < n; i += 8)
+        store8(dst + i,
+               narrow_4444_4(load4(src + i)),
+               narrow_4444_4(load4(src + i + 4)));
+    return n;
+}
+#else
+size_t expand_5551_simd(const uint16_t *, uint32_t *, size_t) { return 0; }
+size_t expand_4444_simd(const uint16_t *, uint32_t *, size_t) { return 0; }
+size_t narrow_5551_simd(const uint32_t *, uint16_t *, size_t) { return 0; }
+size_t narrow_4444_simd(const uint32_t *, uint16_t *, size_t) { return 0; }
+#endif
+
+#pragma endregion
+} // namespace
+
+void convert_colors(span<const color5551> src, span<color8888> dst)
+{
+    assert(dst.size() >= src.size());
+    const uint16_t *in = &src.data()->value;
+    uint32_t *out      = &dst.data()->value;
+    for (size_t i = expand_5551_simd(in, out, src.size()); i < src.size(); ++i)
+        out[i] = expand_5551(in[i]);
+}
+
+void convert_colors(span<const color4444> src, span<color8888> dst)
+{
+    assert(dst.size() >= src.size());
+    const uint16_t *in = &src.data()->value;
+    uint32_t *out      = &dst.data()->value;
+    for (size_t i = expand_4444_simd(in, out, src.size()); i < src.size(); ++i)
+        out[i] = expand_4444(in[i]);
+}
+
+void convert_colors(span<const color8888> src,
+                    span<color5551> dst,
+                    uint32_t dither_width)
+{
+    assert(dst.size() >= src.size());
+    const uint32_t *in = &src.data()->value;
+    uint16_t *out      = &dst.data()->value;
+    if (dither_width == 0)
+    {
+        for (size_t i = narrow_5551_simd(in, out, src.size()); i < src.size();
+             ++i)
+            out[i] = narrow_5551(in[i], 0);
+        return;
+    }
+
+    for (size_t row = 0, y = 0; row < src.size(); row += dither_width, ++y)
+    {
+        const uint8_t *bias = bayer4[y & 3];
+        const size_t end    = min(src.size(), row + dither_width);
+        for (size_t i = row, x = 0; i < end; ++i, ++x)
+            out[i] = narrow_5551(in[i], bias[x & 3] >> 1);
+    }
+}
+
+void convert_colors(span<const color8888> src,
+                    span<color4444> dst,
+                    uint32_t dither_width)
+{
+    assert(dst.size() >= src.size());
+    const uint32_t *in = &src.data()->value;
+    uint16_t *out      = &dst.data()->value;
+    if (dither_width == 0)
+    {
+        for (size_t i = narrow_4444_simd(in, out, src.size()); i < src.size();
+             ++i)
+            out[i] = narrow_4444(in[i], 8);
+        return;
+    }
+
+    for (size_t row = 0, y = 0; row < src.size(); row += dither_width, ++y)
+    {
+        const uint8_t *bias = bayer4[y & 3];
+        const size_t end    = min(src.size(), row + dither_width);
+        for (size_t i = row, x = 0; i < end; ++i, ++x)
+            out[i] = narrow_4444(in[i], bias[x & 3]);
+    }
+}
+
+void expand_palette(span<const uint8_t> indices,
+                    uint32_t index_bits,
+                    span<const color8888> palette,
+                    span<color8888> dst)
+{
+    assert(index_bits == 4 || index_bits == 8);
+
+    // Colors past the palette are transparent black, so every index is one
+    // table lookup.
+    uint32_t table[256] = {};
+    const size_t colors = min(palette.size(), size_t(256));
+    for (size_t i = 0; i < colors; ++i)
+        table[i] = palette[i].value;
+
+    uint32_t *out = &dst.data()->value;
+    if (index_bits == 8)
+    {
+        const size_t count = min(indices.size(), dst.size());
+        for (size_t i = 0; i < count; ++i)
+            out[i] = table[indices[i]];
+        return;
+    }
+
+    const size_t count = min(indices.size() * 2, dst.size());
+    size_t i           = 0;
+    for (; i + 1 < count; i += 2)
+    {
+        const uint8_t pair = indices[i / 2];
+        out[i]             = table[pair >> 4];
+        out[i + 1]         = table[pair & 0xF];
+    }
+    if (i < count)
+        out[i] = table[indices[i / 2] >> 4];
+}
+} // namespace zabato
@@ -1,8 +1,17 @@
+#include <zabato/hash_map.hpp>
 #include <zabato/host_fs.hpp>
+#include <zabato/thread.hpp>
 
 #include <filesystem>
 #include <stdio.h>
 
+#if defined(_WIN32)
+#include <windows.h>
+#elif defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
 namespace std_fs = std::filesystem;
 
 namespace zabato::fs
@@ -75,14 +84,388 @@ private:
     FILE *m_file;
 };
 
+static std_fs::path to_path(const string_view &sv)
+{
+    return std_fs::path(std::string(sv.data(), sv.length()));
+}
+
+#if defined(_WIN32)
+/** @brief Watches a tree with one recursive `ReadDirectoryChangesW`. */
+class host_watcher
+{
+public:
+    ~host_watcher()
+    {
+        if (m_dir == INVALID_HANDLE_VALUE)
+            return;
+        CancelIo(m_dir);
+        DWORD ignored = 0;
+        GetOverlappedResult(m_dir, &m_overlapped, &ignored, TRUE);
+        CloseHandle(m_overlapped.hEvent);
+        CloseHandle(m_dir);
+    }
+
+    bool start(const std_fs::path &root)
+    {
+        if (m_dir != INVALID_HANDLE_VALUE)
+            return true;
+
+        m_dir = CreateFileW(root.c_str(),
+                            FILE_LIST_DIRECTORY,
+                            FILE_SHARE_READ | FILE_SHARE_WRITE |
+                                FILE_SHARE_DELETE,
+                            nullptr,
+                            OPEN_EXISTING,
+                            FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED,
+                            nullptr);
+        if (m_dir == INVALID_HANDLE_VALUE)
+            return false;
+
+        m_overlapped.hEvent = CreateEventW(nullptr, TRUE, FALSE, nullptr);
+        if (m_overlapped.hEvent && issue())
+            return true;
+
+        if (m_overlapped.hEvent)
+            CloseHandle(m_overlapped.hEvent);
+        CloseHandle(m_dir);
+        m_dir = INVALID_HANDLE_VALUE;
+        return false;
+    }
+
+    void poll(vector<string> &paths)
+    {
+        DWORD size = 0;
+        while (m_dir != INVALID_HANDLE_VALUE &&
+               GetOverlappedResult(m_dir, &m_overlapped, &size, FALSE))
+        {
+            // A size of 0 means the buffer overflowed and the changes are
+            // lost; they are not guessed.
+            for (DWORD at = 0; size > 0;)
+            {
+                const FILE_NOTIFY_INFORMATION *info =
+                    reinterpret_cast<const FILE_NOTIFY_INFORMATION *>(
+                        m_buffer + at);
+
+                char name[MAX_PATH * 3];
+                const int length = WideCharToMultiByte(
+                    CP_UTF8,
+                    0,
+                    info->FileName,
+                    int(info->FileNameLength / sizeof(WCHAR)),
+                    name,
+                    sizeof(name),
+                    nullptr,
+                    nullptr);
+
+                string path = "/";
+                path += string_view(name, size_t(length));
+                for (char &c : path)
+                    if (c == '\\')
+                        c = '/';
+                paths.push_back(move(path));
+
+                if (info->NextEntryOffset == 0)
+                    break;
+                at += info->NextEntryOffset;
+            }
+
+            if (!issue())
+                break;
+        }
+    }
+
+private:
+    bool issue()
+    {
+        ResetEvent(m_overlapped.hEvent);
+        return ReadDirectoryChangesW(m_dir,
+                                     m_buffer,
+                                     sizeof(m_buffer),
+                                     TRUE,
+                                     FILE_NOTIFY_CHANGE_FILE_NAME |
+                                         FILE_NOTIFY_CHANGE_DIR_NAME |
+                                         FILE_NOTIFY_CHANGE_LAST_WRITE |
+                                         FILE_NOTIFY_CHANGE_SIZE,
+                                     nullptr,
+                                     &m_overlapped,
+                                     nullptr) != FALSE;
+    }
+
+    HANDLE m_dir            = INVALID_HANDLE_VALUE;
+    OVERLAPPED m_overlapped = {};
+    alignas(DWORD) uint8_t m_buffer[64 * 1024];
+};
+#elif defined(__linux__)
+/** @brief Watches a tree with inotify, one watch per directory. */
+class host_watcher
+{
+public:
+    ~host_watcher()
+    {
+        if (m_fd >= 0)
+            close(m_fd);
+    }
+
+    bool start(const std_fs::path &root)
+    {
+        if (m_fd >= 0)
+            return true;
+
+        m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_fd < 0)
+            return false;
+        m_root = root;
+        add_tree(string());
+        return true;
+    }
+
+    void poll(vector<string> &paths)
+    {
+        if (m_fd < 0)
+            return;
+
+        alignas(inotify_event) char buffer[4096];
+        for (;;)
+        {
+            const ssize_t size = read(m_fd, buffer, sizeof(buffer));
+            if (size <= 0)
+                break;
+
+            for (ssize_t at = 0; at < size;)
+            {
+                const inotify_event *event =
+                    reinterpret_cast<const inotify_event *>(buffer + at);
+                at += sizeof(inotify_event) + event->len;
+
+                if (event->mask & IN_IGNORED)
+                {
+                    m_dirs.erase(event->wd);
+                    continue;
+                }
+
+                const string *dir = m_dirs.find(event->wd);
+                if (!dir || event->len == 0)
+                    continue;
+
+                string path = *dir;
+                path += '/';
+                path += event->name;
+
+                // New directories are watched too, with what is in them.
+                if ((event->mask & IN_ISDIR) &&
+                    (event->mask & (IN_CREATE | IN_MOVED_TO)))
+                    add_tree(path);
+                paths.push_back(move(path));
+            }
+        }
+    }
+
+private:
+    /** @param dir Relative to the root with a leading separator, or empty. */
+    void add_tree(const string &dir)
+    {
+        const std_fs::path top = m_root.string() + dir.c_str();
+        add(dir, top);
+
+        std::error_code ec;
+        std_fs::recursive_directory_iterator it(top, ec);
+        for (; !ec && it != std_fs::recursive_directory_iterator();
+             it.increment(ec))
+        {
+            std::error_code entry_ec;
+            if (!it->is_directory(entry_ec) || it->is_symlink(entry_ec))
+                continue;
+
+            const std::string relative =
+                it->path().lexically_relative(m_root).generic_string();
+            string path = "/";
+            path += relative.c_str();
+            add(path, it->path());
+        }
+    }
+
+    void add(const string &dir, const std_fs::path &path)
+    {
+        const int wd = inotify_add_watch(m_fd,
+                                         path.c_str(),
+                                         IN_CLOSE_WRITE | IN_MOVED_TO |
+                                             IN_MOVED_FROM | IN_CREATE |
+                                             IN_DELETE | IN_ONLYDIR);
+        if (wd >= 0)
+            m_dirs.add_or_set(wd, dir);
+    }
+
+    int m_fd = -1;
+    std_fs::path m_root;
+    hash_map<int, string> m_dirs; ///< The directory of each watch.
+};
+#else
+/** @brief Nothing to watch with on this platform. */
+class host_watcher
+{
+public:
+    bool start(const std_fs::path &) { return false; }
+    void poll(vector<string> &) {}
+};
+#endif
+
+static constexpr uint32_t no_entry = 0xFFFFFFFF;
+
+/** @brief A file or directory seen by the last scan. */
+struct cache_entry
+{
+    file_info info;
+    bool is_file          = false; ///< A regular file.
+    bool is_link          = false; ///< Left to the OS, it may leave the root.
+    bool listed           = false; ///< A directory with every child cached.
+    uint32_t first_child  = no_entry;
+    uint32_t next_sibling = no_entry;
+};
+
 struct host_fs_internal
 {
     std_fs::path root;
+    host_watcher watcher;
+
+    mutex cache_mutex;
+    bool cache_enabled  = false;
+    bool cache_valid    = false;
+    uint64_t cache_ttl  = 0; ///< In nanoseconds, zero for no expiry.
+    uint64_t scanned_at = 0;
+    vector<cache_entry> entries; ///< The root first.
+    /** Paths relative to the root, without a leading separator. */
+    hash_map<string, uint32_t> by_path;
+
+    void scan();
+
+    /**
+     * @brief Looks a path up in the cache, rescanning it first if stale.
+     * @param answer Called with the entry, or null if the path does not
+     * exist, while the cache is locked.
+     * @return False if the cache cannot tell and the OS must be asked.
+     */
+    template <typename F> bool query(string_view path, F &&answer);
+
+    void invalidate()
+    {
+        lock_guard lock(cache_mutex);
+        cache_valid = false;
+    }
 };
 
-static std_fs::path to_path(const string_view &sv)
+void host_fs_internal::scan()
 {
-    return std_fs::path(std::string(sv.data(), sv.length()));
+    entries.clear();
+    by_path.clear();
+
+    entries.emplace_back();
+    entries[0].info.is_dir = true;
+    by_path.add(string(), 0);
+
+    struct pending
+    {
+        uint32_t index;
+        string path;
+    };
+    vector<pending> stack;
+    stack.push_back({0, string()});
+
+    while (!stack.empty())
+    {
+        pending dir = stack.back();
+        stack.pop_back();
+
+        std::error_code ec;
+        std_fs::directory_iterator it(root / to_path(dir.path), ec);
+        for (; !ec && it != std_fs::directory_iterator(); it.increment(ec))
+        {
+            const std_fs::directory_entry &entry = *it;
+            std::error_code entry_ec;
+
+            cache_entry child;
+            child.info.name   = entry.path().filename().string().c_str();
+            child.info.is_dir = entry.is_directory(entry_ec);
+            child.is_file     = entry.is_regular_file(entry_ec);
+            child.info.size =
+                child.info.is_dir ? 0 : entry.file_size(entry_ec);
+            child.info.is_read_only =
+                (entry.status(entry_ec).permissions() &
+                 std_fs::perms::owner_write) == std_fs::perms::none;
+
+            string path = dir.path;
+            if (!path.empty())
+                path += '/';
+            path += child.info.name;
+
+            const uint32_t index           = (uint32_t)entries.size();
+            child.next_sibling             = entries[dir.index].first_child;
+            entries[dir.index].first_child = index;
+
+            child.is_link = entry.is_symlink(entry_ec);
+
+            const bool descend = child.info.is_dir && !child.is_link;
+            entries.push_back(child);
+            by_path.add(path, index);
+            if (descend)
+                stack.push_back({index, path});
+        }
+        entries[dir.index].listed = !ec;
+    }
+
+    scanned_at  = time::now().as_nanoseconds();
+    cache_valid = true;
+}
+
+template <typename F>
+bool host_fs_internal::query(string_view path, F &&answer)
+{
+    while (!path.empty() && is_separator(path.front()))
+        path.remove_prefix(1);
+    const bool wants_dir = !path.empty() && is_separator(path.back());
+
+    virtual_fs::path_buffer buffer;
+    if (!normalize(path, buffer))
+        return false;
+
+    string_view key = buffer;
+    if (key == ".")
+        key = string_view();
+    else if (key == ".." || key.starts_with("../"))
+        return false;
+
+    lock_guard lock(cache_mutex);
+    if (!cache_enabled)
+        return false;
+
+    const uint64_t now = time::now().as_nanoseconds();
+    if (!cache_valid || (cache_ttl && now - scanned_at >= cache_ttl))
+        scan();
+
+    uint32_t index = no_entry;
+    if (by_path.try_get_value(key, index))
+    {
+        const cache_entry &entry = entries[index];
+        if (entry.is_link)
+            return false;
+        answer(wants_dir && !entry.info.is_dir ? nullptr : &entry);
+        return true;
+    }
+
+    // Absent if the closest cached ancestor is a file or a listed directory.
+    for (;;)
+    {
+        const size_t slash = key.rfind('/');
+        key = slash == string_view::npos ? string_view() : key.substr(0, slash);
+        if (by_path.try_get_value(key, index))
+            break;
+    }
+
+    const cache_entry &ancestor = entries[index];
+    if (ancestor.info.is_dir && !ancestor.listed)
+        return false;
+
+    answer(nullptr);
+    return true;
 }
 
 result<host_fs *> host_fs::create(string_view root_path)
@@ -106,6 +489,46 @@ host_fs::host_fs(string_view root_path) : m_data(new host_fs_internal())
 
 host_fs::~host_fs() { delete static_cast<host_fs_internal *>(m_data); }
 
+void host_fs::enable_cache(time ttl)
+{
+    auto impl = static_cast<host_fs_internal *>(m_data);
+    lock_guard lock(impl->cache_mutex);
+    impl->cache_enabled = true;
+    impl->cache_ttl     = ttl.as_nanoseconds();
+    impl->scan();
+}
+
+void host_fs::disable_cache()
+{
+    auto impl = static_cast<host_fs_internal *>(m_data);
+    lock_guard lock(impl->cache_mutex);
+    impl->cache_enabled = false;
+    impl->cache_valid   = false;
+    impl->entries       = vector<cache_entry>();
+    impl->by_path.clear();
+}
+
+void host_fs::invalidate_cache()
+{
+    static_cast<host_fs_internal *>(m_data)->invalidate();
+}
+
+bool host_fs::watch()
+{
+    auto impl = static_cast<host_fs_internal *>(m_data);
+    return impl->watcher.start(impl->root);
+}
+
+size_t host_fs::poll_changes(vector<string> &paths)
+{
+    auto impl          = static_cast<host_fs_internal *>(m_data);
+    const size_t first = paths.size();
+    impl->watcher.poll(paths);
+    if (paths.size() != first)
+        impl->invalidate();
+    return paths.size() - first;
+}
+
 static std::pair<bool, std_fs::path> resolve_safe(const std_fs::path &root,
                                                   const string_view &path)
 {
@@ -137,6 +560,20 @@ vector<file_info> host_fs::ls(string_view path)
     auto impl = static_cast<host_fs_internal *>(m_data);
     vector<file_info> results;
 
+    // Cleared for a directory the scan could not list.
+    bool listed = true;
+    auto list   = [&](const cache_entry *dir)
+    {
+        if (!dir || !dir->info.is_dir)
+            return;
+        listed     = dir->listed;
+        uint32_t i = listed ? dir->first_child : no_entry;
+        for (; i != no_entry; i = impl->entries[i].next_sibling)
+            results.push_back(impl->entries[i].info);
+    };
+    if (impl->query(path, list) && listed)
+        return results;
+
     auto [safe, target] = resolve_safe(impl->root, path);
     if (!safe || !std_fs::exists(target) || !std_fs::is_directory(target))
         return results;
@@ -174,6 +611,7 @@ bool host_fs::remove(string_view path)
     if (!safe)
         return false;
 
+    impl->invalidate();
     std::error_code ec;
     return std_fs::remove_all(target, ec) > 0;
 }
@@ -185,13 +623,20 @@ bool host_fs::mkdir(string_view path)
     if (!safe)
         return false;
 
+    impl->invalidate();
     std::error_code ec;
     return std_fs::create_directories(target, ec);
 }
 
 bool host_fs::exists(string_view path)
 {
-    auto impl           = static_cast<host_fs_internal *>(m_data);
+    auto impl     = static_cast<host_fs_internal *>(m_data);
+    bool answered = false;
+    auto answer   = [&](const cache_entry *e)
+    { answered = e != nullptr; };
+    if (impl->query(path, answer))
+        return answered;
+
     auto [safe, target] = resolve_safe(impl->root, path);
     if (!safe)
         return false;
@@ -200,7 +645,13 @@ bool host_fs::exists(string_view path)
 
 bool host_fs::is_dir(string_view path)
 {
-    auto impl           = static_cast<host_fs_internal *>(m_data);
+    auto impl     = static_cast<host_fs_internal *>(m_data);
+    bool answered = false;
+    auto answer   = [&](const cache_entry *e)
+    { answered = e && e->info.is_dir; };
+    if (impl->query(path, answer))
+        return answered;
+
     auto [safe, target] = resolve_safe(impl->root, path);
     if (!safe)
         return false;
@@ -209,7 +660,13 @@ bool host_fs::is_dir(string_view path)
 
 bool host_fs::is_file(string_view path)
 {
-    auto impl           = static_cast<host_fs_internal *>(m_data);
+    auto impl     = static_cast<host_fs_internal *>(m_data);
+    bool answered = false;
+    auto answer   = [&](const cache_entry *e)
+    { answered = e && e->is_file; };
+    if (impl->query(path, answer))
+        return answered;
+
     auto [safe, target] = resolve_safe(impl->root, path);
     if (!safe)
         return false;
@@ -218,7 +675,13 @@ bool host_fs::is_file(string_view path)
 
 bool host_fs::is_read_only(string_view path)
 {
-    auto impl           = static_cast<host_fs_internal *>(m_data);
+    auto impl     = static_cast<host_fs_internal *>(m_data);
+    bool answered = false;
+    auto answer   = [&](const cache_entry *e)
+    { answered = e && e->info.is_read_only; };
+    if (impl->query(path, answer))
+        return answered;
+
     auto [safe, target] = resolve_safe(impl->root, path);
     if (!safe)
         return true;
@@ -265,6 +728,10 @@ file *host_fs::open(string_view path, open_mode mode)
     if (!f)
         return nullptr;
 
+    // Sizes of files written stay stale until the next scan after this.
+    if ((mode & open_mode::write) == open_mode::write)
+        impl->invalidate();
+
     return new host_file(f);
 }
 
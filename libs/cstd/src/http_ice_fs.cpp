@@ -0,0 +1,445 @@
+#include <zabato/error.hpp>
+#include <zabato/http_ice_fs.hpp>
+#include <zabato/stream.hpp>
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__EMSCRIPTEN__)
+#include <emscripten/emscripten.h>
+#include <emscripten/fetch.h>
+#endif
+
+namespace zabato::fs
+{
+
+namespace
+{
+#if defined(__EMSCRIPTEN__)
+constexpr const char *store_name = "zabato_ice";
+
+/** @return The total size from a `Content-Range` header, or 0. */
+uint64_t parse_content_range(const char *headers)
+{
+    static constexpr char name[] = "content-range:";
+    for (const char *line = headers; *line;)
+    {
+        size_t i = 0;
+        while (name[i] && tolower((unsigned char)line[i]) == name[i])
+            ++i;
+        const char *end = strchr(line, '\n');
+        if (!name[i])
+        {
+            const char *slash = strchr(line, '/');
+            if (slash && (!end || slash < end) && isdigit(slash[1]))
+                return strtoull(slash + 1, nullptr, 10);
+            return 0;
+        }
+        if (!end)
+            break;
+        line = end + 1;
+    }
+    return 0;
+}
+#endif
+
+/**
+ * @brief Fetches bytes `[from, to]` of a URL. Servers ignoring the range
+ * send the whole body, which is cut to the range.
+ * @param total Set to the size of the whole resource, if the server told.
+ * @param transferred Set to the size of the body received.
+ * @return False if the request failed. A range past the end succeeds with
+ * no bytes.
+ */
+bool fetch_range(const string &url,
+                 [[maybe_unused]] uint64_t from,
+                 [[maybe_unused]] uint64_t to,
+                 vector<uint8_t> &bytes,
+                 uint64_t &total,
+                 uint64_t &transferred)
+{
+    bytes.clear();
+    total       = 0;
+    transferred = 0;
+
+#if defined(__EMSCRIPTEN__)
+    char range[64];
+    snprintf(range,
+             sizeof(range),
+             "bytes=%llu-%llu",
+             (unsigned long long)from,
+             (unsigned long long)to);
+    const char *headers[] = {"Range", range, nullptr};
+
+    emscripten_fetch_attr_t attr;
+    emscripten_fetch_attr_init(&attr);
+    strcpy(attr.requestMethod, "GET");
+    attr.attributes =
+        EMSCRIPTEN_FETCH_LOAD_TO_MEMORY | EMSCRIPTEN_FETCH_SYNCHRONOUS;
+    attr.requestHeaders = headers;
+
+    emscripten_fetch_t *fetch = emscripten_fetch(&attr, url.c_str());
+    if (!fetch)
+        return false;
+
+    const uint8_t *body = reinterpret_cast<const uint8_t *>(fetch->data);
+    const uint64_t size = fetch->numBytes;
+    transferred         = size;
+
+    bool ok = true;
+    if (fetch->status == 206)
+    {
+        vector<char> response(
+            emscripten_fetch_get_response_headers_length(fetch) + 1);
+        emscripten_fetch_get_response_headers(
+            fetch, response.data(), response.size());
+        total = parse_content_range(response.data());
+        bytes.assign(body, body + size);
+    }
+    else if (fetch->status == 200)
+    {
+        total = size;
+        if (from < size)
+            bytes.assign(body + from, body + min(to + 1, size));
+    }
+    else if (fetch->status != 416)
+    {
+        report(report_type::warning,
+               "http_ice_fs: %s answered %d",
+               url.c_str(),
+               (int)fetch->status);
+        ok = false;
+    }
+
+    emscripten_fetch_close(fetch);
+    return ok;
+#else
+    report(report_type::warning,
+           "http_ice_fs: range requests need a web build, cannot fetch %s",
+           url.c_str());
+    return false;
+#endif
+}
+} // namespace
+
+/**
+ * @brief The archive as a stream, for `ice_fs::read_index`. Reads go through
+ * the block cache like those of entries.
+ */
+class http_archive_stream : public stream
+{
+public:
+    explicit http_archive_stream(http_ice_fs &archive) : m_archive(archive) {}
+
+    size_t read(buffer &buffer) override
+    {
+        const size_t readed =
+            m_archive.read_archive(m_pos, buffer.data(), buffer.size());
+        m_pos += readed;
+        return readed;
+    }
+
+    size_t write(const buffer &) override { return 0; }
+    void skip(int64_t offset) override { m_pos += offset; }
+
+    bool eof() const override
+    {
+        const uint64_t size = m_archive.get_archive_size();
+        return size > 0 && m_pos >= size;
+    }
+
+    void rewind() override { m_pos = 0; }
+    size_t tell() const override { return (size_t)m_pos; }
+    void pos(int64_t offset) override { m_pos = (uint64_t)offset; }
+
+private:
+    http_ice_fs &m_archive;
+    uint64_t m_pos = 0;
+};
+
+http_ice_fs::http_ice_fs(const char *url, const http_ice_fs_config &config)
+{
+    mount(url, config);
+}
+
+http_ice_fs::~http_ice_fs() { unmount(); }
+
+bool http_ice_fs::mount(const char *url, const http_ice_fs_config &config)
+{
+    unmount();
+
+    m_url    = url;
+    m_config = config;
+    if (m_config.block_size == 0)
+        m_config.block_size = http_ice_fs_config().block_size;
+    if (m_config.max_cached_blocks == 0)
+        m_config.max_cached_blocks = 1;
+
+    // The index is read through a window of one block, so the chunk headers
+    // cost one request and the index payload another at most.
+    http_archive_stream source(*this);
+    buffered_stream buffered(source, m_config.block_size);
+    if (!read_index(buffered))
+    {
+        unmount();
+        return false;
+    }
+    return true;
+}
+
+bool http_ice_fs::unmount()
+{
+    if (m_url.empty())
+        return false;
+
+    clear_index();
+    lock_guard lock(m_mutex);
+    m_url = string();
+    m_blocks.clear();
+    m_slot_of.clear();
+    m_next_victim   = 0;
+    m_size          = 0;
+    m_request_count = 0;
+    m_bytes_fetched = 0;
+    return true;
+}
+
+uint64_t http_ice_fs::get_archive_size() const
+{
+    lock_guard lock(m_mutex);
+    return m_size;
+}
+
+uint64_t http_ice_fs::get_request_count() const
+{
+    lock_guard lock(m_mutex);
+    return m_request_count;
+}
+
+uint64_t http_ice_fs::get_bytes_fetched() const
+{
+    lock_guard lock(m_mutex);
+    return m_bytes_fetched;
+}
+
+size_t http_ice_fs::read_archive(uint64_t offset, void *data, size_t size)
+{
+    if (size == 0 || m_url.empty())
+        return 0;
+
+    uint8_t *out              = static_cast<uint8_t *>(data);
+    const uint64_t block_size = m_config.block_size;
+    const uint64_t end        = offset + size;
+    const uint64_t last       = (end - 1) / block_size;
+
+    uint64_t at    = offset;
+    uint64_t block = offset / block_size;
+    vector<uint8_t> bytes;
+    while (at < end)
+    {
+        int cached = copy_cached(block, at, end, out + (at - offset));
+        if (cached < 0 && load_stored(block))
+            cached = copy_cached(block, at, end, out + (at - offset));
+        if (cached == 0)
+            break;
+        if (cached > 0)
+        {
+            ++block;
+            continue;
+        }
+
+        // Fetch the run of missing blocks starting here with one request,
+        // through gaps of a few cached blocks rather than around them.
+        uint64_t run_last = block;
+        uint64_t gap      = 0;
+        for (uint64_t next = block + 1;
+             next <= last && gap <= m_config.max_gap_blocks;
+             ++next)
+        {
+            bool present = false;
+            {
+                lock_guard lock(m_mutex);
+                present = m_slot_of.contains_key(next);
+            }
+            if (present || load_stored(next))
+                ++gap;
+            else
+            {
+                run_last = next;
+                gap      = 0;
+            }
+        }
+
+        if (!fetch(block, run_last, bytes))
+            break;
+
+        const uint64_t run_first = block;
+        for (; block <= run_last; ++block)
+        {
+            const uint64_t start = (block - run_first) * block_size;
+            if (start >= bytes.size())
+                return (size_t)(at - offset);
+
+            const size_t piece =
+                (size_t)min(block_size, (uint64_t)bytes.size() - start);
+            insert(block, bytes.data() + start, piece);
+            store(block, bytes.data() + start, piece);
+
+            const uint64_t from  = block * block_size;
+            const uint64_t until = min(from + piece, end);
+            if (until > at)
+            {
+                memcpy(out + (at - offset),
+                       bytes.data() + start + (at - from),
+                       (size_t)(until - at));
+                at = until;
+            }
+            if (piece < block_size)
+                return (size_t)(at - offset);
+        }
+    }
+    return (size_t)(at - offset);
+}
+
+int http_ice_fs::copy_cached(uint64_t block,
+                             uint64_t &at,
+                             uint64_t end,
+                             uint8_t *out)
+{
+    lock_guard lock(m_mutex);
+    uint32_t slot = 0;
+    if (!m_slot_of.try_get_value(block, slot))
+        return -1;
+
+    const vector<uint8_t> &data = m_blocks[slot].data;
+    const uint64_t from         = block * m_config.block_size;
+    const uint64_t until        = min(from + data.size(), end);
+    if (until > at)
+    {
+        memcpy(out, data.data() + (at - from), (size_t)(until - at));
+        at = until;
+    }
+    return data.size() == m_config.block_size ? 1 : 0;
+}
+
+bool http_ice_fs::fetch(uint64_t first, uint64_t last, vector<uint8_t> &bytes)
+{
+    const uint64_t block_size = m_config.block_size;
+    uint64_t total            = 0;
+    uint64_t transferred      = 0;
+    const bool ok             = fetch_range(m_url,
+                                first * block_size,
+                                (last + 1) * block_size - 1,
+                                bytes,
+                                total,
+                                transferred);
+
+    lock_guard lock(m_mutex);
+    ++m_request_count;
+    m_bytes_fetched += transferred;
+    if (total > 0)
+        m_size = total;
+    return ok;
+}
+
+void http_ice_fs::insert(uint64_t block, const uint8_t *data, size_t size)
+{
+    lock_guard lock(m_mutex);
+    if (m_slot_of.contains_key(block))
+        return;
+
+    uint32_t slot = (uint32_t)m_blocks.size();
+    if (slot < m_config.max_cached_blocks)
+        m_blocks.emplace_back();
+    else
+    {
+        slot          = m_next_victim;
+        m_next_victim = (m_next_victim + 1) % m_config.max_cached_blocks;
+        m_slot_of.erase(m_blocks[slot].block);
+    }
+
+    cached_block &cached = m_blocks[slot];
+    cached.block         = block;
+    cached.data.assign(data, data + size);
+    m_slot_of.add(block, slot);
+}
+
+string http_ice_fs::store_key(uint64_t block) const
+{
+    // Keyed by the archive size as well, so a replaced archive does not read
+    // the blocks of the old one. Unknown until the first response.
+    // The block size is part of the key, as it sets what a block holds.
+    uint64_t size = 0;
+    {
+        lock_guard lock(m_mutex);
+        size = m_size;
+    }
+    if (size == 0)
+        return string();
+
+    char suffix[64];
+    snprintf(suffix,
+             sizeof(suffix),
+             "|%llu|%u|%llu",
+             (unsigned long long)size,
+             m_config.block_size,
+             (unsigned long long)block);
+
+    string key = m_config.version;
+    key += '|';
+    key += m_url;
+    key += suffix;
+    return key;
+}
+
+bool http_ice_fs::load_stored([[maybe_unused]] uint64_t block)
+{
+#if defined(__EMSCRIPTEN__)
+    if (!m_config.persistent)
+        return false;
+
+    const string key = store_key(block);
+    if (key.empty())
+        return false;
+
+    void *data = nullptr;
+    int size   = 0;
+    int error  = 0;
+    emscripten_idb_load(store_name, key.c_str(), &data, &size, &error);
+    if (error || !data)
+        return false;
+
+    const bool ok = size > 0 && (uint32_t)size <= m_config.block_size;
+    if (ok)
+        insert(block, static_cast<const uint8_t *>(data), (size_t)size);
+    free(data);
+    return ok;
+#else
+    return false;
+#endif
+}
+
+void http_ice_fs::store([[maybe_unused]] uint64_t block,
+                        [[maybe_unused]] const uint8_t *data,
+                        [[maybe_unused]] size_t size)
+{
+#if defined(__EMSCRIPTEN__)
+    if (!m_config.persistent)
+        return;
+
+    const string key = store_key(block);
+    if (key.empty())
+        return;
+
+    int error = 0;
+    emscripten_idb_store(store_name,
+                         key.c_str(),
+                         const_cast<uint8_t *>(data),
+                         (int)size,
+                         &error);
+#endif
+}
+
+} // namespace zabato::fs
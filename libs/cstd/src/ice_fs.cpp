@@ -8,14 +8,115 @@
 #include <stdio.h>
 #include <string.h>
 
+#if defined(_WIN32)
+#include <io.h>
+#include <windows.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define ZABATO_ICE_FS_MMAP 1
+#endif
+
 namespace zabato::fs
 {
 
+namespace
+{
+/**
+ * @brief Reads from an absolute offset without moving the file position, so
+ * threads can read different entries of one archive at the same time.
+ * Platforms without positional reads fall back to seeking, which is not
+ * thread-safe.
+ * @return The number of bytes read.
+ */
+size_t read_at(FILE *file, uint64_t offset, uint8_t *data, size_t size)
+{
+    size_t total = 0;
+
+#if defined(_WIN32)
+    HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+    while (total < size)
+    {
+        const uint64_t at = offset + total;
+        OVERLAPPED overlapped{};
+        overlapped.Offset     = (DWORD)(at & 0xFFFFFFFFu);
+        overlapped.OffsetHigh = (DWORD)(at >> 32);
+
+        const size_t left = size - total;
+        DWORD chunk       = left > 0x40000000u ? 0x40000000u : (DWORD)left;
+        DWORD readed      = 0;
+        if (!ReadFile(handle, data + total, chunk, &readed, &overlapped) ||
+            readed == 0)
+            break;
+        total += readed;
+    }
+#elif defined(ZABATO_ICE_FS_MMAP)
+    const int fd = fileno(file);
+    while (total < size)
+    {
+        ssize_t readed =
+            pread(fd, data + total, size - total, (off_t)(offset + total));
+        if (readed < 0 && errno == EINTR)
+            continue;
+        if (readed <= 0)
+            break;
+        total += (size_t)readed;
+    }
+#else
+    file_stream stream(file);
+    stream.pos(offset);
+    buffer sub(data, size);
+    total = stream.read(sub);
+#endif
+
+    return total;
+}
+
+/** @brief Resolves a seek request, the same way for every entry kind. */
+bool seek_position(
+    int64_t offset, origin origin, uint64_t pos, uint64_t size, uint64_t &out)
+{
+    int64_t target_pos = 0;
+    switch (origin)
+    {
+    case origin::begin:
+        target_pos = offset;
+        break;
+    case origin::current:
+        target_pos = pos + offset;
+        break;
+    case origin::end:
+        target_pos = size + offset;
+        break;
+    }
+
+    if (target_pos < 0 || target_pos > (int64_t)size)
+        return false;
+
+    out = target_pos;
+    return true;
+}
+} // namespace
+
+/**
+ * @brief An entry of the archive. Reads copy from the mapping when the
+ * archive is mapped, and go through `ice_fs::read_archive` otherwise.
+ * Neither touches state shared with other entries.
+ */
 class ice_fs_file : public file
 {
 public:
-    ice_fs_file(file_stream &stream, uint64_t offset, uint64_t size)
-        : m_stream(stream), m_start(offset), m_size(size), m_pos(0)
+    ice_fs_file(ice_fs *archive, uint64_t offset, uint64_t size)
+        : m_archive(archive), m_data(nullptr), m_start(offset), m_size(size),
+          m_pos(0)
+    {
+    }
+
+    ice_fs_file(span<const uint8_t> data)
+        : m_archive(nullptr), m_data(data.data()), m_start(0),
+          m_size(data.size()), m_pos(0)
     {
     }
 
@@ -25,10 +126,15 @@ public:
             return 0;
 
         size_t to_read = min(buffer.size(), m_size - m_pos);
-        m_stream.pos(m_start + m_pos);
+        if (m_data)
+        {
+            memcpy(buffer.data(), m_data + m_pos, to_read);
+            m_pos += to_read;
+            return to_read;
+        }
 
-        auto sub      = buffer.subspan(0, to_read);
-        size_t readed = m_stream.read(sub);
+        size_t readed =
+            m_archive->read_archive(m_start + m_pos, buffer.data(), to_read);
 
         m_pos += readed;
         return readed;
@@ -40,71 +146,213 @@ public:
 
     bool seek(int64_t offset, origin origin) override
     {
-        int64_t target_pos = 0;
-        switch (origin)
-        {
-        case origin::begin:
-            target_pos = offset;
-            break;
-        case origin::current:
-            target_pos = m_pos + offset;
-            break;
-        case origin::end:
-            target_pos = m_size + offset;
-            break;
-        }
-
-        if (target_pos < 0 || target_pos > (int64_t)m_size)
-            return false;
-
-        m_pos = target_pos;
-        return true;
+        return seek_position(offset, origin, m_pos, m_size, m_pos);
     }
 
     bool eof() const override { return m_pos >= m_size; }
 
     uint64_t tell() const override { return m_pos; }
 
+    const uint8_t *view(size_t size) override
+    {
+        if (!m_data || m_pos > m_size || m_size - m_pos < size)
+            return nullptr;
+        const uint8_t *data = m_data + m_pos;
+        m_pos += size;
+        return data;
+    }
+
 private:
-    file_stream m_stream;
+    ice_fs *m_archive;
+    const uint8_t *m_data;
     uint64_t m_start;
     uint64_t m_size;
     uint64_t m_pos;
 };
 
-ice_fs::ice_fs(const char *ice)
-    : m_stream(nullptr), m_writer(m_stream), m_reader(m_stream)
+/**
+ * @brief A block-compressed entry of the archive. Seeking only moves the
+ * position, reads decompress the blocks they touch, from the mapping or
+ * through `ice_fs::read_archive` like `ice_fs_file`.
+ */
+class ice_fs_block_file : public file
+{
+public:
+    ice_fs_block_file(ice_fs *archive, span<const uint8_t> mapping)
+        : m_archive(archive), m_mapping(mapping), m_pos(0)
+    {
+    }
+
+    /**
+     * @brief Opens the chunk of an entry.
+     * @param offset The offset of the ICE_BERG_BLOCK_HEADER in the archive.
+     * @param dictionary The dictionary of the archive if the entry uses it.
+     */
+    bool open(uint64_t offset, span<const uint8_t> dictionary)
+    {
+        chunk_header header;
+        if (offset < sizeof(header))
+            return false;
+
+        const uint64_t at = offset - sizeof(header);
+        if (read_source(this, at, &header, sizeof(header)) != sizeof(header) ||
+            header.id != BERG_BLOCK_CHUNK_ID)
+            return false;
+
+        return !m_blocks
+                    .open(read_source, this, offset, header.size, dictionary)
+                    .has_error();
+    }
+
+    size_t read(buffer buffer) override
+    {
+        size_t readed = m_blocks.read(m_pos, buffer.data(), buffer.size());
+        m_pos += readed;
+        return readed;
+    }
+
+    size_t write(const_buffer buffer) override { return 0; }
+
+    void close() override {}
+
+    bool seek(int64_t offset, origin origin) override
+    {
+        return seek_position(offset, origin, m_pos, m_blocks.size(), m_pos);
+    }
+
+    bool eof() const override { return m_pos >= m_blocks.size(); }
+
+    uint64_t tell() const override { return m_pos; }
+
+private:
+    static size_t
+    read_source(void *context, uint64_t offset, void *data, size_t size)
+    {
+        ice_fs_block_file &self = *static_cast<ice_fs_block_file *>(context);
+        if (self.m_mapping.empty())
+            return self.m_archive->read_archive(offset, data, size);
+
+        if (offset >= self.m_mapping.size())
+            return 0;
+        if (size > self.m_mapping.size() - offset)
+            size = (size_t)(self.m_mapping.size() - offset);
+        memcpy(data, self.m_mapping.data() + offset, size);
+        return size;
+    }
+
+    ice_fs *m_archive;
+    span<const uint8_t> m_mapping;
+    berg_block_reader m_blocks;
+    uint64_t m_pos;
+};
+
+ice_fs::ice_fs(const char *ice, bool use_mapping)
+    : m_stream(nullptr), m_writer(m_stream)
 {
-    mount(ice);
+    mount(ice, use_mapping);
 }
 
+ice_fs::ice_fs() : m_stream(nullptr), m_writer(m_stream) {}
+
 ice_fs::~ice_fs() { unmount(); }
 
-bool ice_fs::mount(const char *ice)
+bool ice_fs::map(FILE *file)
+{
+#if defined(_WIN32)
+    HANDLE handle = (HANDLE)_get_osfhandle(_fileno(file));
+    LARGE_INTEGER size;
+    if (handle == INVALID_HANDLE_VALUE || !GetFileSizeEx(handle, &size) ||
+        size.QuadPart <= 0 || (uint64_t)size.QuadPart > SIZE_MAX)
+        return false;
+
+    HANDLE mapping =
+        CreateFileMappingA(handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping)
+        return false;
+
+    void *view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view)
+    {
+        CloseHandle(mapping);
+        return false;
+    }
+
+    m_map_handle = mapping;
+    m_mapping    = {static_cast<const uint8_t *>(view), (size_t)size.QuadPart};
+    return true;
+#elif defined(ZABATO_ICE_FS_MMAP)
+    struct stat info;
+    int fd = fileno(file);
+    if (fstat(fd, &info) != 0 || info.st_size <= 0)
+        return false;
+
+    void *view =
+        mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (view == MAP_FAILED)
+        return false;
+
+    m_mapping = {static_cast<const uint8_t *>(view), (size_t)info.st_size};
+    return true;
+#else
+    return false;
+#endif
+}
+
+void ice_fs::unmap()
+{
+    if (m_mapping.empty())
+        return;
+
+#if defined(_WIN32)
+    UnmapViewOfFile(m_mapping.data());
+    CloseHandle(m_map_handle);
+    m_map_handle = nullptr;
+#elif defined(ZABATO_ICE_FS_MMAP)
+    munmap(const_cast<uint8_t *>(m_mapping.data()), m_mapping.size());
+#endif
+    m_mapping = {};
+}
+
+bool ice_fs::mount(const char *ice, bool use_mapping)
 {
     FILE *file = fopen(ice, "rb");
     if (!file)
         return false;
 
+    if (use_mapping)
+        map(file);
+
     m_stream = file_stream(file);
     m_writer = ice_writer(m_stream); // Needed? Only if writing supported later
-    m_reader = ice_reader(m_stream);
+
+    // The index is read with small reads, served from a read-ahead window.
+    buffered_stream buffered(m_stream);
+    return read_index(buffered);
+}
+
+bool ice_fs::read_index(stream &archive)
+{
+    ice_reader reader(archive);
 
     // Read Pack Header
-    auto result = m_reader.find_chunk(CHUNK_PACK);
+    auto result = reader.find_chunk(CHUNK_PACK);
     if (result.has_error())
         return false;
 
-    ICE_PACK pack;
-    if (m_reader.read(pack) != sizeof(pack))
+    // Older archives have a shorter PACK payload, without the last fields.
+    ICE_PACK pack          = {};
+    const size_t pack_size = min((size_t)result.value.size, sizeof(pack));
+    if (reader.read(&pack, pack_size) != pack_size)
         return false;
+    const uint32_t data_alignment = pack.data_alignment;
+    m_data_alignment              = data_alignment > 1 ? data_alignment : 1;
 
     // Read Index Chunk
     // Pack header now points to start of Index Chunk HEADER
-    m_stream.pos(pack.root_dir_offset);
+    archive.pos(pack.root_dir_offset);
 
     chunk_header chunk_h;
-    if (m_reader.read(chunk_h) != sizeof(chunk_h))
+    if (reader.read(chunk_h) != sizeof(chunk_h))
         return false;
 
     if (chunk_h.id != CHUNK_INDEX)
@@ -113,12 +361,12 @@ bool ice_fs::mount(const char *ice)
     // Read Index Payload
     // Count
     uint64_t count = 0;
-    if (m_reader.read(count) != sizeof(count))
+    if (reader.read(count) != sizeof(count))
         return false;
 
     m_entries.resize(count);
     size_t entries_size = count * sizeof(ICE_INDEX_ENTRY);
-    if (m_reader.read(m_entries.data(), entries_size) != entries_size)
+    if (reader.read(m_entries.data(), entries_size) != entries_size)
         return false;
 
     // Remaining is string block
@@ -128,23 +376,77 @@ bool ice_fs::mount(const char *ice)
     size_t string_block_size = chunk_h.size - sizeof(uint64_t) - entries_size;
 
     m_strings.resize(string_block_size);
-    if (m_reader.read(m_strings.data(), string_block_size) != string_block_size)
+    if (reader.read(m_strings.data(), string_block_size) != string_block_size)
         return false;
 
+    // Optional hash index right after the index chunk. Archives without one
+    // fall back to binary searching the entries.
+    bool has_chunk = reader.read(chunk_h) == sizeof(chunk_h);
+    if (has_chunk && chunk_h.id == CHUNK_HASH)
+    {
+        const size_t next = archive.tell() + chunk_h.size;
+        read_hash_index(reader, chunk_h.size);
+        archive.pos(next);
+        has_chunk = reader.read(chunk_h) == sizeof(chunk_h);
+    }
+
+    // Optional Berg dictionary of the entries flagged with
+    // ICE_ENTRY_BERG_DICTIONARY, which cannot be opened without it.
+    if (has_chunk && chunk_h.id == CHUNK_DICT)
+    {
+        m_dictionary.resize(chunk_h.size);
+        if (reader.read(m_dictionary.data(), chunk_h.size) != chunk_h.size)
+            m_dictionary.clear();
+    }
+
     return true;
 }
 
+void ice_fs::read_hash_index(ice_reader &reader, uint32_t size)
+{
+    ice_uint32_t slot_count = 0;
+    if (reader.read(slot_count) != sizeof(slot_count))
+        return;
+
+    const uint32_t slots    = slot_count;
+    const size_t slots_size = slots * sizeof(ICE_HASH_SLOT);
+    if (slots == 0 || (slots & (slots - 1)) != 0 ||
+        size != sizeof(slot_count) + slots_size)
+        return;
+
+    m_hash_slots.resize(slots);
+    if (reader.read(m_hash_slots.data(), slots_size) != slots_size)
+        m_hash_slots.clear();
+}
+
 bool ice_fs::unmount()
 {
     FILE *file = m_stream.get_file();
     if (!file)
         return false;
 
+    unmap();
     fclose(file);
     m_stream = file_stream(nullptr);
+    clear_index();
+    return true;
+}
+
+void ice_fs::clear_index()
+{
     m_entries.clear();
     m_strings.clear();
-    return true;
+    m_hash_slots.clear();
+    m_dictionary.clear();
+    m_data_alignment = 1;
+}
+
+size_t ice_fs::read_archive(uint64_t offset, void *data, size_t size)
+{
+    FILE *file = m_stream.get_file();
+    if (!file)
+        return 0;
+    return read_at(file, offset, static_cast<uint8_t *>(data), size);
 }
 
 const char *ice_fs::get_path(const ICE_INDEX_ENTRY &entry)
@@ -168,6 +470,24 @@ int64_t ice_fs::find_entry_index(string_view path)
     if (p.ends_with('/'))
         p.remove_suffix(1); // Standardize: no trailing slash for index lookups
 
+    if (!m_hash_slots.empty())
+    {
+        const uint32_t mask = (uint32_t)m_hash_slots.size() - 1;
+        const uint32_t hash = ice_path_hash(p);
+        for (uint32_t probe = 0; probe <= mask; ++probe)
+        {
+            const ICE_HASH_SLOT &slot = m_hash_slots[(hash + probe) & mask];
+            const uint32_t index      = slot.entry;
+            if (index == 0 || index > m_entries.size())
+                return -1;
+
+            if ((uint32_t)slot.hash == hash &&
+                string_view(get_path(m_entries[index - 1])) == p)
+                return index - 1;
+        }
+        return -1;
+    }
+
     int64_t left  = 0;
     int64_t right = m_entries.size() - 1;
 
@@ -215,7 +535,59 @@ file *ice_fs::open(string_view path, open_mode mode)
         return nullptr;
 
     const auto &entry = m_entries[idx];
-    return new ice_fs_file(m_stream, entry.data_offset, entry.size);
+    if (entry.flags & ICE_ENTRY_BERG_BLOCKS)
+    {
+        span<const uint8_t> dictionary;
+        if (entry.flags & ICE_ENTRY_BERG_DICTIONARY)
+        {
+            if (m_dictionary.empty())
+                return nullptr;
+            dictionary = m_dictionary;
+        }
+
+        ice_fs_block_file *file = new ice_fs_block_file(this, m_mapping);
+        if (!file->open(entry.data_offset, dictionary))
+        {
+            delete file;
+            return nullptr;
+        }
+        return file;
+    }
+
+    if (is_mapped())
+        return new ice_fs_file(view(entry));
+
+    return new ice_fs_file(this, entry.data_offset, entry.size);
+}
+
+span<const uint8_t> ice_fs::view(const ICE_INDEX_ENTRY &entry) const
+{
+    if (entry.flags & ICE_ENTRY_BERG_BLOCKS)
+        return {};
+    if (entry.data_offset > m_mapping.size() ||
+        entry.size > m_mapping.size() - entry.data_offset)
+        return {};
+    return m_mapping.subspan(entry.data_offset, entry.size);
+}
+
+span<const uint8_t> ice_fs::view(string_view path)
+{
+    if (!is_mapped())
+        return {};
+
+    int64_t idx = find_entry_index(path);
+    if (idx == -1)
+        return {};
+
+    return view(m_entries[idx]);
+}
+
+uint64_t ice_fs::get_storage_offset(string_view path)
+{
+    int64_t idx = find_entry_index(path);
+    if (idx == -1)
+        return 0;
+    return m_entries[idx].data_offset;
 }
 
 bool ice_fs::exists(string_view path)
@@ -346,7 +718,7 @@ vector<file_info> ice_fs::ls(string_view path)
             // Immediate file
             results.push_back({string(relative),
                                m_entries[i].size,
-                               (bool)(m_entries[i].flags & 1),
+                               (bool)(m_entries[i].flags & ICE_ENTRY_DIR),
                                true});
         }
     }
@@ -1,5 +1,7 @@
+#include <zabato/hash.hpp>
 #include <zabato/ice_fs.hpp>
 #include <zabato/ice_packer.hpp>
+#include <zabato/mesh_optimizer.hpp>
 #include <zabato/span.hpp>
 #include <zabato/string.hpp>
 #include <zabato/vector.hpp>
@@ -17,13 +19,392 @@ namespace
 
 struct Entry
 {
-    string full_path; // Source file path on disk
-    string ice_path;  // Relative path in archive (e.g. "subdir/file.txt")
-    bool is_dir;
+    string full_path       = {}; // Source file path on disk
+    string ice_path        = {}; // Path in the archive, e.g. "dir/a.txt"
+    bool is_dir            = false;
+    uint64_t size          = 0;
+    uint64_t data_offset   = 0;
+    vector<uint8_t> packed = {}; // Block-compressed chunk, empty to store as is
+
+    uint64_t mtime        = 0;     // Modification time, in file clock ticks
+    uint64_t hash         = 0;     // Content hash, see `content_hash`
+    bool reused           = false; // Chunk copied from the previous archive
+    uint64_t reuse_offset = 0;     // Chunk offset in the previous archive
+    uint64_t stored_size  = 0;     // Chunk size in the archive, header included
+    uint64_t flags        = 0;     // ICE_ENTRY_* bits of the stored chunk
+    uint64_t padding      = 0;     // PAD chunk before the stored chunk
+
+    bool hashed  = false; // `hash` is known before packing
+    bool shared  = false; // Same content as `entries[owner]`, stored there
+    size_t owner = 0;
+
+    // Whether the entry still has to be read and stored.
+    bool pending() const { return !reused && !shared; }
+};
+
+// Sidecar manifest of incremental packs: a MANI chunk, then the DICT chunk
+// of the archive if it has one. MANI holds the header, one record per file
+// sorted by path, then the NUL-terminated paths.
+static const chunk_id CHUNK_MANIFEST("MANI");
+constexpr uint32_t manifest_version = 2;
+
+#pragma pack(push, 1)
+struct ICE_PACK_MANIFEST
+{
+    ice_uint32_t version;
+    ice_uint32_t level;                 //< `pack` level
+    ice_uint64_t block_size;            //< `pack` block size
+    ice_uint64_t dictionary_size;       //< `pack` dictionary size
+    ice_uint64_t archive_size;          //< Size of the archive described
+    ice_uint64_t entry_count;           //< Number of records
+    ice_uint32_t compression_threshold; //< Percent, see the packer setter
+};
+
+struct ICE_MANIFEST_ENTRY
+{
+    ice_uint64_t path_offset;  //< Offset into the paths
+    ice_uint64_t size;         //< Size of the file
+    ice_uint64_t mtime;        //< Modification time, in file clock ticks
+    ice_uint64_t hash;         //< Content hash
+    ice_uint64_t chunk_offset; //< Offset of the chunk header in the archive
+    ice_uint64_t chunk_size;   //< Size of the chunk, header included
+    ice_uint64_t flags;        //< ICE_ENTRY_* bits of the index entry
+};
+#pragma pack(pop)
+
+struct Manifest
+{
+    ICE_PACK_MANIFEST header{};
+    vector<ICE_MANIFEST_ENTRY> records;
+    vector<uint8_t> paths;
+    vector<uint8_t> dictionary;
+};
+
+// Content hash of the manifest, 64-bit FNV-1a as `ice_path_hash` uses.
+constexpr uint64_t content_hash_seed = 14695981039346656037ull;
+
+uint64_t content_hash(uint64_t hash, const uint8_t *data, size_t size)
+{
+    for (size_t i = 0; i < size; ++i)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+result<void> hash_file(const Entry &e, uint64_t &hash)
+{
+    FILE *f = fopen(e.full_path.c_str(), "rb");
+    if (!f)
+        return report_error(error_code::unable_to_read);
+
+    uint8_t buffer[64 * 1024];
+    uint64_t remaining = e.size;
+    hash               = content_hash_seed;
+    while (remaining > 0)
+    {
+        const size_t to_read = (size_t)min(remaining, (uint64_t)sizeof(buffer));
+        if (fread(buffer, 1, to_read, f) != to_read)
+            break;
+        hash = content_hash(hash, buffer, to_read);
+        remaining -= to_read;
+    }
+    fclose(f);
+    if (remaining > 0)
+        return report_error(error_code::unable_to_read);
+    return {};
+}
+
+// Reads a manifest, false if there is none or it is broken. A manifest is
+// only a cache, so a broken one means packing everything again.
+bool read_manifest(const string &path, Manifest &out)
+{
+    FILE *f = fopen(path.c_str(), "rb");
+    if (!f)
+        return false;
+
+    file_stream stream(f);
+    ice_reader reader(stream);
+    chunk_header header;
+    bool ok = reader.read(header) == sizeof(header) &&
+              header.id == CHUNK_MANIFEST &&
+              header.size >= sizeof(ICE_PACK_MANIFEST) &&
+              reader.read(out.header) == sizeof(out.header) &&
+              out.header.version == manifest_version;
+
+    const uint64_t count = ok ? (uint64_t)out.header.entry_count : 0;
+    const uint64_t table = count * sizeof(ICE_MANIFEST_ENTRY);
+    ok = ok && count <= header.size / sizeof(ICE_MANIFEST_ENTRY) &&
+         sizeof(ICE_PACK_MANIFEST) + table <= header.size;
+    if (ok)
+    {
+        out.records.resize((size_t)count);
+        out.paths.resize(
+            (size_t)(header.size - sizeof(ICE_PACK_MANIFEST) - table));
+        ok = reader.read(out.records.data(), (size_t)table) == table &&
+             reader.read(out.paths.data(), out.paths.size()) ==
+                 out.paths.size() &&
+             (out.paths.empty() || out.paths.back() == 0);
+    }
+    for (size_t i = 0; ok && i < out.records.size(); ++i)
+        ok = out.records[i].path_offset < out.paths.size();
+
+    if (ok && reader.read(header) == sizeof(header) && header.id == CHUNK_DICT)
+    {
+        out.dictionary.resize(header.size);
+        ok = header.size <= BERG_MAX_DICTIONARY_SIZE &&
+             reader.read(out.dictionary.data(), header.size) == header.size;
+    }
+    fclose(f);
+    return ok;
+}
+
+// Marks the entries the previous archive already holds, from the manifest
+// records of the same path. A record whose size matches but whose time does
+// not is reused only if the content hash still matches. The chunk header of
+// every reused entry is checked in the previous archive.
+result<void>
+match_manifest(vector<Entry> &entries, const Manifest &manifest, FILE *previous)
+{
+    size_t r = 0;
+    for (Entry &e : entries)
+    {
+        int order = 1;
+        while (r < manifest.records.size())
+        {
+            const ICE_MANIFEST_ENTRY &record = manifest.records[r];
+            const char *path =
+                (const char *)manifest.paths.data() + record.path_offset;
+            order = strcmp(path, e.ice_path.c_str());
+            if (order >= 0)
+                break;
+            r++;
+        }
+        if (order != 0)
+            continue;
+
+        const ICE_MANIFEST_ENTRY &record = manifest.records[r++];
+        if (record.size != e.size)
+            continue;
+
+        uint64_t hash = record.hash;
+        if (record.mtime != e.mtime)
+        {
+            auto hash_result = hash_file(e, hash);
+            if (hash_result.has_error())
+                return hash_result.error;
+            if (hash != record.hash)
+                continue;
+        }
+
+        chunk_header header;
+        if (fseek(previous, (long)record.chunk_offset, SEEK_SET) != 0 ||
+            fread(&header, 1, sizeof(header), previous) != sizeof(header) ||
+            header.size + sizeof(header) != record.chunk_size ||
+            header.id != (record.flags & ICE_ENTRY_BERG_BLOCKS
+                              ? BERG_BLOCK_CHUNK_ID
+                              : CHUNK_FILE))
+            continue;
+
+        e.reused       = true;
+        e.hashed       = true;
+        e.hash         = hash;
+        e.reuse_offset = record.chunk_offset;
+        e.stored_size  = record.chunk_size;
+        e.flags        = record.flags & ~ICE_ENTRY_SHARED;
+    }
+    return {};
+}
+
+// Largest `set_alignment` value, well past the page size.
+constexpr uint32_t max_data_alignment = 64 * 1024;
+
+// Size of the PAD chunk that moves the payload of a chunk starting at
+// `offset` to a multiple of `alignment`. A gap too small for the PAD header
+// grows by whole alignments.
+uint64_t padding_size(uint64_t offset, uint32_t alignment)
+{
+    const uint64_t payload = offset + sizeof(chunk_header);
+    uint64_t gap           = (alignment - payload % alignment) % alignment;
+    while (gap != 0 && gap < sizeof(chunk_header))
+        gap += alignment;
+    return gap;
+}
+
+// Writes a PAD chunk of `size` bytes, header included.
+void write_padding(ice_writer &writer, uint64_t size)
+{
+    static const uint8_t zeros[4096] = {};
+    writer.write_chunk_header(CHUNK_PAD, size - sizeof(chunk_header));
+    for (uint64_t left = size - sizeof(chunk_header); left > 0;)
+    {
+        const size_t to_write = (size_t)min(left, (uint64_t)sizeof(zeros));
+        writer.write(zeros, to_write);
+        left -= to_write;
+    }
+}
+
+result<bool> same_content(const Entry &a, const Entry &b)
+{
+    FILE *fa = fopen(a.full_path.c_str(), "rb");
+    FILE *fb = fa ? fopen(b.full_path.c_str(), "rb") : nullptr;
+    if (!fb)
+    {
+        if (fa)
+            fclose(fa);
+        return report_error(error_code::unable_to_read);
+    }
+
+    uint8_t buffer_a[16 * 1024], buffer_b[16 * 1024];
+    uint64_t remaining = a.size;
+    bool same          = true;
+    while (same && remaining > 0)
+    {
+        const size_t to_read =
+            (size_t)min(remaining, (uint64_t)sizeof(buffer_a));
+        same = fread(buffer_a, 1, to_read, fa) == to_read &&
+               fread(buffer_b, 1, to_read, fb) == to_read &&
+               memcmp(buffer_a, buffer_b, to_read) == 0;
+        remaining -= to_read;
+    }
+    fclose(fa);
+    fclose(fb);
+    return same;
+}
+
+struct DuplicateKey
+{
     uint64_t size;
-    uint64_t data_offset;
+    uint64_t hash;
+    size_t index;
 };
 
+int compare_duplicate_keys(const void *a, const void *b)
+{
+    const DuplicateKey *ka = (const DuplicateKey *)a;
+    const DuplicateKey *kb = (const DuplicateKey *)b;
+    if (ka->size != kb->size)
+        return ka->size < kb->size ? -1 : 1;
+    if (ka->hash != kb->hash)
+        return ka->hash < kb->hash ? -1 : 1;
+    return ka->index < kb->index ? -1 : ka->index > kb->index;
+}
+
+// Marks every entry whose content matches an earlier one as shared with it.
+// Only entries whose size another entry has are hashed, then entries of the
+// same size and hash are compared with the first of them.
+result<void> deduplicate_entries(vector<Entry> &entries)
+{
+    vector<DuplicateKey> keys;
+    keys.reserve(entries.size());
+    for (size_t i = 0; i < entries.size(); ++i)
+        keys.push_back({entries[i].size, 0, i});
+    if (keys.size() < 2)
+        return {};
+
+    qsort(keys.data(),
+          keys.size(),
+          sizeof(DuplicateKey),
+          compare_duplicate_keys);
+    for (size_t i = 0; i < keys.size(); ++i)
+    {
+        const bool alone = (i == 0 || keys[i - 1].size != keys[i].size) &&
+                           (i + 1 == keys.size() ||
+                            keys[i + 1].size != keys[i].size);
+        Entry &e = entries[keys[i].index];
+        if (alone)
+            continue;
+        if (!e.hashed)
+        {
+            auto hash_result = hash_file(e, e.hash);
+            if (hash_result.has_error())
+                return hash_result.error;
+            e.hashed = true;
+        }
+        keys[i].hash = e.hash;
+    }
+
+    qsort(keys.data(),
+          keys.size(),
+          sizeof(DuplicateKey),
+          compare_duplicate_keys);
+    size_t first = 0;
+    for (size_t i = 1; i < keys.size(); ++i)
+    {
+        if (keys[i].size != keys[first].size ||
+            keys[i].hash != keys[first].hash)
+        {
+            first = i;
+            continue;
+        }
+
+        const Entry &original = entries[keys[first].index];
+        Entry &e              = entries[keys[i].index];
+        auto same             = same_content(original, e);
+        if (same.has_error())
+            return same.error;
+        if (!same.value)
+            continue;
+
+        e.shared = true;
+        e.owner  = keys[first].index;
+        e.reused = false;
+    }
+    return {};
+}
+
+result<void> write_manifest(const string &path,
+                            const vector<Entry> &entries,
+                            const ICE_PACK_MANIFEST &header,
+                            span<const uint8_t> dictionary)
+{
+    FILE *f = fopen(path.c_str(), "wb");
+    if (!f)
+        return report_error(error_code::unable_to_write);
+
+    uint64_t paths_size = 0;
+    for (const Entry &e : entries)
+        paths_size += e.ice_path.length() + 1;
+
+    file_stream stream(f);
+    ice_writer writer(stream);
+    writer.write_chunk_header(CHUNK_MANIFEST,
+                              sizeof(header) +
+                                  entries.size() * sizeof(ICE_MANIFEST_ENTRY) +
+                                  paths_size);
+    writer.write(&header, sizeof(header));
+
+    uint64_t path_offset = 0;
+    for (const Entry &e : entries)
+    {
+        ICE_MANIFEST_ENTRY record = {
+            .path_offset  = path_offset,
+            .size         = e.size,
+            .mtime        = e.mtime,
+            .hash         = e.hash,
+            .chunk_offset = e.data_offset - sizeof(chunk_header),
+            .chunk_size   = e.stored_size,
+            .flags        = e.flags,
+        };
+        writer.write(&record, sizeof(record));
+        path_offset += e.ice_path.length() + 1;
+    }
+    for (const Entry &e : entries)
+        writer.write(e.ice_path.c_str(), e.ice_path.length() + 1);
+
+    if (!dictionary.empty())
+    {
+        writer.write_chunk_header(CHUNK_DICT, dictionary.size());
+        writer.write(dictionary.data(), dictionary.size());
+    }
+
+    const bool failed = ferror(f) != 0;
+    if (fclose(f) != 0 || failed)
+        return report_error(error_code::unable_to_write);
+    return {};
+}
+
 // Helper for sorting by ice_path
 int compare_entries(const void *a, const void *b)
 {
@@ -32,11 +413,1014 @@ int compare_entries(const void *a, const void *b)
     return strcmp(ea->ice_path.c_str(), eb->ice_path.c_str());
 }
 
+// Input read per compression batch, bounding memory use on large trees.
+constexpr size_t batch_budget = 64 * 1024 * 1024;
+
+// Dictionary training, a simplified COVER: d-mers (short byte sequences) are
+// counted once per sample holding them, and the dictionary is made of the
+// segments whose d-mers are shared by the most samples.
+constexpr size_t dictionary_dmer          = 6;
+constexpr size_t dictionary_segment       = 64;
+constexpr uint32_t dictionary_hash_bits   = 18;
+constexpr size_t dictionary_sample_factor = 128; // Sample bytes per byte
+constexpr size_t dictionary_min_samples   = 8;
+
+uint32_t dmer_hash(const uint8_t *data)
+{
+    uint64_t value = 0;
+    for (size_t i = 0; i < dictionary_dmer; ++i)
+        value = value << 8 | data[i];
+    return (uint32_t)((value * 0x9E3779B97F4A7C15ull) >>
+                      (64 - dictionary_hash_bits));
+}
+
+struct Segment
+{
+    size_t begin;
+    uint64_t score;
+};
+
+// Weakest segment first, the best end up closest to the data.
+int compare_segments(const void *a, const void *b)
+{
+    const Segment *sa = (const Segment *)a;
+    const Segment *sb = (const Segment *)b;
+    if (sa->score != sb->score)
+        return sa->score < sb->score ? -1 : 1;
+    return sa->begin < sb->begin ? -1 : sa->begin > sb->begin;
+}
+
+// Trains a dictionary of at most `capacity` bytes from samples laid back to
+// back, sample `i` ending at `sample_ends[i]`. The samples are split into one
+// epoch per segment that fits, and the best segment of every epoch is kept.
+// The d-mers of a kept segment stop counting, so later ones add new content.
+void train_dictionary(const vector<uint8_t> &samples,
+                      const vector<size_t> &sample_ends,
+                      size_t capacity,
+                      vector<uint8_t> &dictionary)
+{
+    dictionary.clear();
+    const size_t epochs = min(capacity, samples.size()) / dictionary_segment;
+    if (epochs == 0)
+        return;
+
+    vector<uint32_t> frequency, last_sample;
+    frequency.resize(size_t(1) << dictionary_hash_bits, 0);
+    last_sample.resize(size_t(1) << dictionary_hash_bits, 0);
+    size_t start = 0;
+    for (size_t s = 0; s < sample_ends.size(); ++s)
+    {
+        for (size_t i = start; i + dictionary_dmer <= sample_ends[s]; ++i)
+        {
+            const uint32_t hash = dmer_hash(samples.data() + i);
+            if (last_sample[hash] != s + 1)
+            {
+                last_sample[hash] = (uint32_t)(s + 1);
+                frequency[hash]++;
+            }
+        }
+        start = sample_ends[s];
+    }
+
+    // A d-mer of a single sample does not help any other.
+    auto useful = [&](size_t at) -> uint64_t
+    {
+        const uint32_t count = frequency[dmer_hash(samples.data() + at)];
+        return count > 1 ? count : 0;
+    };
+
+    const size_t window     = dictionary_segment - dictionary_dmer + 1;
+    const size_t epoch_size = samples.size() / epochs;
+    vector<Segment> segments;
+    for (size_t e = 0; e < epochs; ++e)
+    {
+        const size_t begin = e * epoch_size;
+        const size_t end =
+            e + 1 == epochs ? samples.size() : begin + epoch_size;
+
+        Segment best   = {begin, 0};
+        uint64_t score = 0;
+        for (size_t i = begin; i + dictionary_dmer <= end; ++i)
+        {
+            score += useful(i);
+            if (i >= begin + window)
+                score -= useful(i - window);
+            if (i + 1 >= begin + window && score > best.score)
+                best = {i + 1 - window, score};
+        }
+
+        if (best.score == 0)
+            continue;
+        segments.push_back(best);
+        for (size_t i = best.begin; i < best.begin + window; ++i)
+            frequency[dmer_hash(samples.data() + i)] = 0;
+    }
+
+    if (!segments.empty())
+        qsort(segments.data(),
+              segments.size(),
+              sizeof(Segment),
+              compare_segments);
+    for (const Segment &segment : segments)
+        for (size_t i = 0; i < dictionary_segment; ++i)
+            dictionary.push_back(samples[segment.begin + i]);
+}
+
+// Trains the archive dictionary from the files that fit in one block, the
+// ones that cannot build up matches of their own. Every n-th such file is
+// sampled so the samples spread across the whole tree. No dictionary is made
+// from too few samples.
+result<void> train_archive_dictionary(const vector<Entry> &entries,
+                                      size_t block_size,
+                                      size_t capacity,
+                                      vector<uint8_t> &dictionary)
+{
+    const size_t budget = capacity * dictionary_sample_factor;
+    size_t small_count = 0, small_total = 0;
+    for (const Entry &e : entries)
+        if (!e.shared && e.size >= dictionary_dmer && e.size <= block_size)
+        {
+            small_count++;
+            small_total += e.size;
+        }
+
+    dictionary.clear();
+    if (small_count < dictionary_min_samples)
+        return {};
+
+    const size_t stride =
+        small_total > budget ? (small_total + budget - 1) / budget : 1;
+    vector<uint8_t> samples;
+    vector<size_t> sample_ends;
+    size_t small_index = 0;
+    for (const Entry &e : entries)
+    {
+        if (e.shared || e.size < dictionary_dmer || e.size > block_size)
+            continue;
+        if (small_index++ % stride != 0)
+            continue;
+
+        const size_t at = samples.size();
+        samples.resize(at + e.size);
+        FILE *f = fopen(e.full_path.c_str(), "rb");
+        if (!f)
+            return report_error(error_code::unable_to_read);
+        const size_t readed = fread(samples.data() + at, 1, e.size, f);
+        fclose(f);
+        if (readed != e.size)
+            return report_error(error_code::unable_to_read);
+        sample_ends.push_back(samples.size());
+    }
+
+    if (sample_ends.size() >= dictionary_min_samples)
+        train_dictionary(samples, sample_ends, capacity, dictionary);
+    return {};
+}
+
+// Compresses entries [first, last) into block-compressed Berg chunks, every
+// block of the batch at once on `thread_count` threads started for it, so a
+// single large file spreads across threads as well as many small ones. A
+// chunk is kept only if it is at most `threshold` percent of the raw FILE
+// chunk. Reused and shared entries are skipped.
+result<void> compress_batch(vector<Entry> &entries,
+                            size_t first,
+                            size_t last,
+                            size_t block_size,
+                            uint32_t thread_count,
+                            int level,
+                            span<const uint8_t> dictionary,
+                            uint32_t threshold)
+{
+    size_t total = 0;
+    for (size_t i = first; i < last; ++i)
+        if (entries[i].pending())
+            total += entries[i].size;
+
+    vector<uint8_t> data(total);
+    vector<size_t> first_block(last - first + 1);
+    vector<ice_berg_block> blocks;
+
+    size_t at = 0;
+    for (size_t i = first; i < last; ++i)
+    {
+        Entry &e               = entries[i];
+        first_block[i - first] = blocks.size();
+        if (!e.pending())
+            continue;
+
+        FILE *f = fopen(e.full_path.c_str(), "rb");
+        if (!f)
+            return report_error(error_code::unable_to_read);
+        const size_t readed = fread(data.data() + at, 1, e.size, f);
+        fclose(f);
+        if (readed != e.size)
+            return report_error(error_code::unable_to_read);
+
+        e.hash = content_hash(content_hash_seed, data.data() + at, e.size);
+        ice_split_blocks(data.data() + at, e.size, block_size, blocks);
+        at += e.size;
+    }
+    first_block[last - first] = blocks.size();
+
+    vector<uint8_t> scratch;
+    auto c_err = ice_compress_blocks(blocks.data(),
+                                     blocks.size(),
+                                     scratch,
+                                     thread_count,
+                                     level,
+                                     dictionary);
+    if (c_err < 0)
+        return report_error(error_code::fail_to_compress_berg,
+                            BERG_BLOCK_CHUNK_ID.to_string().c_str(),
+                            (uint32_t)BERG_BLOCK_CHUNK_ID,
+                            c_err);
+
+    // Chunks are assembled in entry order, independent of scheduling.
+    for (size_t i = first; i < last; ++i)
+    {
+        Entry &e          = entries[i];
+        const size_t from = first_block[i - first];
+        const size_t to   = first_block[i - first + 1];
+        if (!e.pending())
+            continue;
+
+        memory_stream stream(e.packed);
+        ice_writer writer(stream);
+        auto write_result = writer.write_berg_blocks(
+            CHUNK_FILE, e.size, block_size, blocks.data() + from, to - from);
+        if (write_result.has_error())
+            return write_result.error;
+
+        const uint64_t raw_size = sizeof(chunk_header) + e.size;
+        if (e.packed.size() >= raw_size ||
+            e.packed.size() * 100 > raw_size * threshold)
+            e.packed.clear();
+    }
+    return {};
+}
+
+#pragma region Texture Atlas
+// The TEXD chunk of `zabato::texture`, mirrored as cstd cannot include it
+// (see ICE_TEXTURE_HEADER in gpu_resource.hpp). The header is followed, for
+// palette formats, by the palette as 32-bit colors and the indices, else by
+// 16-bit pixels, in rows padded to a byte.
+static const chunk_id CHUNK_TEXTURE("TEXD");
+
+#pragma pack(push, 1)
+struct ICE_ATLAS_TEXTURE_HEADER
+{
+    ice_uint8_t pearson_hash; //< Pearson hash of the pixel data
+    ice_uint8_t color_format_raw;
+    ice_uint16_t width;
+    ice_uint16_t height;
+};
+#pragma pack(pop)
+
+// Values of `zabato::color_format`.
+constexpr uint8_t format_rgba5551   = 1;
+constexpr uint8_t format_rgba4444   = 2;
+constexpr uint8_t format_palette16  = 3;
+constexpr uint8_t format_palette64  = 4;
+constexpr uint8_t format_palette128 = 5;
+constexpr uint8_t format_palette256 = 6;
+
+uint32_t texture_palette_count(uint8_t format)
+{
+    switch (format)
+    {
+    case format_palette16:
+        return 16;
+    case format_palette64:
+        return 64;
+    case format_palette128:
+        return 128;
+    case format_palette256:
+        return 256;
+    default:
+        return 0;
+    }
+}
+
+uint32_t texture_pixel_bits(uint8_t format)
+{
+    switch (format)
+    {
+    case format_rgba5551:
+    case format_rgba4444:
+        return 16;
+    case format_palette16:
+        return 4;
+    case format_palette64:
+    case format_palette128:
+    case format_palette256:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+size_t texture_palette_size(uint8_t format)
+{
+    return texture_palette_count(format) * sizeof(uint32_t);
+}
+
+size_t texture_row_size(uint8_t format, uint32_t width)
+{
+    return ((size_t)width * texture_pixel_bits(format) + 7) / 8;
+}
+
+uint32_t next_power_of_two(uint32_t value)
+{
+    uint32_t result = 1;
+    while (result < value)
+        result <<= 1;
+    return result;
+}
+
+struct AtlasTexture
+{
+    size_t entry         = 0;  // Index in the entries
+    uint8_t format       = 0;
+    uint16_t width       = 0;
+    uint16_t height      = 0;
+    vector<uint8_t> data = {}; // Palette, then pixels
+    size_t page          = SIZE_MAX;
+    uint32_t x           = 0;
+    uint32_t y           = 0;
+};
+
+// Reads `e` as a texture to pack, false if it holds anything else, is too
+// large or is broken, in which case it is stored as is.
+result<bool> read_atlas_texture(const Entry &e,
+                                uint32_t max_size,
+                                AtlasTexture &out)
+{
+    chunk_header chunk;
+    ICE_ATLAS_TEXTURE_HEADER header;
+    if (e.size < sizeof(chunk) + sizeof(header))
+        return false;
+
+    FILE *f = fopen(e.full_path.c_str(), "rb");
+    if (!f)
+        return report_error(error_code::unable_to_read);
+
+    bool ok = fread(&chunk, sizeof(chunk), 1, f) == 1 &&
+              fread(&header, sizeof(header), 1, f) == 1;
+
+    const uint8_t format  = header.color_format_raw;
+    const uint32_t width  = header.width;
+    const uint32_t height = header.height;
+    const size_t size =
+        texture_palette_size(format) + texture_row_size(format, width) * height;
+    ok = ok && chunk.id == CHUNK_TEXTURE &&
+         sizeof(chunk) + (uint64_t)chunk.size == e.size &&
+         chunk.size == sizeof(header) + size && texture_pixel_bits(format) &&
+         width > 0 && height > 0 && width <= max_size && height <= max_size &&
+         (format != format_palette16 || width % 2 == 0);
+    if (ok)
+    {
+        out.data.resize(size);
+        ok = fread(out.data.data(), 1, size, f) == size &&
+             pearson_hash_array(0, out.data.data(), size) ==
+                 header.pearson_hash;
+    }
+    fclose(f);
+    if (!ok)
+        return false;
+
+    out.format = format;
+    out.width  = (uint16_t)width;
+    out.height = (uint16_t)height;
+    return true;
+}
+
+// Orders textures by format and palette, so groups that can share a page
+// are contiguous, then tallest first, which suits the skyline.
+int compare_atlas_textures(const void *a, const void *b)
+{
+    const AtlasTexture *ta = *(const AtlasTexture *const *)a;
+    const AtlasTexture *tb = *(const AtlasTexture *const *)b;
+    if (ta->format != tb->format)
+        return ta->format < tb->format ? -1 : 1;
+    if (const int palette = memcmp(ta->data.data(),
+                                   tb->data.data(),
+                                   texture_palette_size(ta->format)))
+        return palette;
+    if (ta->height != tb->height)
+        return ta->height > tb->height ? -1 : 1;
+    if (ta->width != tb->width)
+        return ta->width > tb->width ? -1 : 1;
+    return ta->entry < tb->entry ? -1 : ta->entry > tb->entry;
+}
+
+bool same_atlas_group(const AtlasTexture &a, const AtlasTexture &b)
+{
+    return a.format == b.format &&
+           memcmp(a.data.data(),
+                  b.data.data(),
+                  texture_palette_size(a.format)) == 0;
+}
+
+// Bottom-left skyline packer. The skyline is the top edge of the packed
+// rects, as segments from left to right covering the page width.
+class Skyline
+{
+public:
+    Skyline(uint32_t width, uint32_t height) : m_width(width), m_height(height)
+    {
+        m_nodes.push_back({0, 0, width});
+    }
+
+    // Places a rect at the lowest spot, the leftmost of equal ones, false if
+    // none is left.
+    bool insert(uint32_t width, uint32_t height, uint32_t &x, uint32_t &y)
+    {
+        size_t best     = SIZE_MAX;
+        uint32_t best_y = UINT32_MAX;
+        for (size_t i = 0; i < m_nodes.size(); ++i)
+        {
+            uint32_t top;
+            if (fit(i, width, height, top) && top < best_y)
+            {
+                best   = i;
+                best_y = top;
+            }
+        }
+        if (best == SIZE_MAX)
+            return false;
+
+        x = m_nodes[best].x;
+        y = best_y;
+        raise(best, {x, y + height, width});
+        m_used_width  = max(m_used_width, x + width);
+        m_used_height = max(m_used_height, y + height);
+        return true;
+    }
+
+    uint32_t get_used_width() const { return m_used_width; }
+    uint32_t get_used_height() const { return m_used_height; }
+
+private:
+    struct Node
+    {
+        uint32_t x;
+        uint32_t y;
+        uint32_t width;
+    };
+
+    // Whether a rect fits with its left edge at node `i`, resting at `y`.
+    bool fit(size_t i, uint32_t width, uint32_t height, uint32_t &y) const
+    {
+        if (m_nodes[i].x + width > m_width)
+            return false;
+        y             = 0;
+        uint32_t left = width;
+        for (size_t j = i; left > 0; ++j)
+        {
+            y = max(y, m_nodes[j].y);
+            if (y + height > m_height)
+                return false;
+            left -= min(left, m_nodes[j].width);
+        }
+        return true;
+    }
+
+    // Puts `top` over the skyline from node `i` on.
+    void raise(size_t i, Node top)
+    {
+        const uint32_t end = top.x + top.width;
+        vector<Node> nodes;
+        nodes.reserve(m_nodes.size() + 1);
+        for (size_t j = 0; j < i; ++j)
+            nodes.push_back(m_nodes[j]);
+        if (!nodes.empty() && nodes.back().y == top.y)
+            nodes.back().width += top.width;
+        else
+            nodes.push_back(top);
+        for (size_t j = i; j < m_nodes.size(); ++j)
+        {
+            Node node = m_nodes[j];
+            if (node.x + node.width <= end)
+                continue;
+            if (node.x < end)
+            {
+                node.width -= end - node.x;
+                node.x = end;
+            }
+            if (nodes.back().y == node.y)
+                nodes.back().width += node.width;
+            else
+                nodes.push_back(node);
+        }
+        m_nodes = move(nodes);
+    }
+
+    uint32_t m_width;
+    uint32_t m_height;
+    uint32_t m_used_width  = 0;
+    uint32_t m_used_height = 0;
+    vector<Node> m_nodes;
+};
+
+struct AtlasPage
+{
+    const AtlasTexture *first; // Gives the format and palette of the page
+    Skyline skyline;
+    size_t texture_count = 0;
+    uint32_t index       = 0; // Number of the page as written
+};
+
+// The temporary directory of the files the packer generates, atlas pages
+// and optimized meshes, removed once the archive is written.
+struct TempFiles
+{
+    std::filesystem::path directory;
+
+    ~TempFiles()
+    {
+        if (!directory.empty())
+        {
+            std::error_code ignored;
+            std::filesystem::remove_all(directory, ignored);
+        }
+    }
+
+    result<void> create()
+    {
+        if (!directory.empty())
+            return {};
+
+        const std::filesystem::path temp =
+            std::filesystem::temp_directory_path();
+        for (uint32_t i = 0; i < 1000; ++i)
+        {
+            std::error_code error;
+            const std::filesystem::path path =
+                temp / ("zabato_pack_" + std::to_string(i));
+            if (std::filesystem::create_directory(path, error))
+            {
+                directory = path;
+                return {};
+            }
+            if (error)
+                break;
+        }
+        return report_error(error_code::unable_to_write);
+    }
+
+    // Writes `data` to `name` in the directory and points `e` at it.
+    result<void> write(const char *name, span<const uint8_t> data, Entry &e)
+    {
+        const std::filesystem::path path = directory / name;
+        const std::string full_path      = path.generic_string();
+        FILE *f                          = fopen(full_path.c_str(), "wb");
+        if (!f)
+            return report_error(error_code::unable_to_write);
+        const bool written = fwrite(data.data(), 1, data.size(), f) ==
+                             data.size();
+        if (fclose(f) != 0 || !written)
+            return report_error(error_code::unable_to_write);
+
+        // The real time, so incremental packs compare the content of files
+        // that keep their size.
+        e.full_path = string(full_path.c_str());
+        e.size      = data.size();
+        e.mtime     = (uint64_t)std::filesystem::last_write_time(path)
+                      .time_since_epoch()
+                      .count();
+        return {};
+    }
+
+    // Writes `data` to `name` in the directory and adds it to the entries.
+    result<void> add(vector<Entry> &entries,
+                     const char *name,
+                     const string &ice_path,
+                     span<const uint8_t> data)
+    {
+        Entry e{
+            .ice_path    = ice_path,
+            .is_dir      = false,
+            .data_offset = 0,
+        };
+        auto write_result = write(name, data, e);
+        if (write_result.has_error())
+            return write_result;
+        entries.emplace_back(move(e));
+        return {};
+    }
+};
+
+template <class T> void append_bytes(vector<uint8_t> &out, const T &value)
+{
+    const uint8_t *bytes = (const uint8_t *)&value;
+    for (size_t i = 0; i < sizeof(T); ++i)
+        out.push_back(bytes[i]);
+}
+
+// Replaces the small textures of `entries` by atlas pages holding them and
+// an ATLS table, written to `files`. Entries stay sorted by path.
+result<void> build_texture_atlas(vector<Entry> &entries,
+                                 uint32_t page_size,
+                                 uint32_t max_texture_size,
+                                 const string &directory,
+                                 TempFiles &files)
+{
+    string prefix = directory;
+    prefix += '/';
+    vector<AtlasTexture> textures;
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        const Entry &e = entries[i];
+        if (strncmp(e.ice_path.c_str(), prefix.c_str(), prefix.length()) == 0)
+            return report_error(error_code::value, "atlas directory");
+
+        AtlasTexture texture{.entry = i};
+        auto read_result = read_atlas_texture(e, max_texture_size, texture);
+        if (read_result.has_error())
+            return read_result.error;
+        if (read_result.value)
+            textures.emplace_back(move(texture));
+    }
+
+    vector<AtlasTexture *> order;
+    order.reserve(textures.size());
+    for (AtlasTexture &t : textures)
+        order.push_back(&t);
+    if (!order.empty())
+        qsort(order.data(),
+              order.size(),
+              sizeof(AtlasTexture *),
+              compare_atlas_textures);
+
+    vector<AtlasPage> pages;
+    for (size_t first = 0, last = 0; first < order.size(); first = last)
+    {
+        last = first + 1;
+        while (last < order.size() &&
+               same_atlas_group(*order[first], *order[last]))
+            ++last;
+        if (last - first < 2)
+            continue;
+
+        const size_t group_pages = pages.size();
+        for (size_t i = first; i < last; ++i)
+        {
+            AtlasTexture &t = *order[i];
+            for (size_t p = group_pages; p < pages.size(); ++p)
+            {
+                if (pages[p].skyline.insert(t.width, t.height, t.x, t.y))
+                {
+                    t.page = p;
+                    break;
+                }
+            }
+            if (t.page == SIZE_MAX)
+            {
+                pages.emplace_back(
+                    AtlasPage{order[first], Skyline(page_size, page_size)});
+                pages.back().skyline.insert(t.width, t.height, t.x, t.y);
+                t.page = pages.size() - 1;
+            }
+            ++pages[t.page].texture_count;
+        }
+    }
+
+    // A page of one texture saves nothing, that texture stays on its own.
+    uint32_t page_count = 0;
+    for (AtlasPage &page : pages)
+        if (page.texture_count > 1)
+            page.index = page_count++;
+    for (AtlasTexture &t : textures)
+        if (t.page != SIZE_MAX && pages[t.page].texture_count < 2)
+            t.page = SIZE_MAX;
+    if (page_count == 0)
+        return {};
+
+    auto create_result = files.create();
+    if (create_result.has_error())
+        return create_result;
+
+    vector<Entry> packed;
+    for (size_t i = 0, t = 0; i < entries.size(); ++i)
+    {
+        while (t < textures.size() && textures[t].entry < i)
+            ++t;
+        if (t < textures.size() && textures[t].entry == i &&
+            textures[t].page != SIZE_MAX)
+            continue;
+        packed.emplace_back(move(entries[i]));
+    }
+
+    // The table: header, pages, regions in path order, then the paths.
+    vector<uint8_t> table_pages;
+    vector<uint8_t> table_regions;
+    vector<uint8_t> paths;
+    uint32_t region_count = 0;
+
+    char name[32];
+    for (const AtlasPage &page : pages)
+    {
+        if (page.texture_count < 2)
+            continue;
+
+        const Skyline &sky        = page.skyline;
+        const uint8_t format      = page.first->format;
+        const uint32_t width      = next_power_of_two(sky.get_used_width());
+        const uint32_t height     = next_power_of_two(sky.get_used_height());
+        const size_t palette_size = texture_palette_size(format);
+        const size_t row_size     = texture_row_size(format, width);
+        const uint32_t bits       = texture_pixel_bits(format);
+
+        vector<uint8_t> pixels(palette_size + row_size * height);
+        memset(pixels.data(), 0, pixels.size());
+        memcpy(pixels.data(), page.first->data.data(), palette_size);
+        for (const AtlasTexture &t : textures)
+        {
+            if (t.page == SIZE_MAX || &pages[t.page] != &page)
+                continue;
+            const size_t src_row = texture_row_size(format, t.width);
+            for (uint32_t row = 0; row < t.height; ++row)
+                memcpy(pixels.data() + palette_size +
+                           (t.y + row) * row_size + t.x * bits / 8,
+                       t.data.data() + palette_size + row * src_row,
+                       src_row);
+        }
+
+        ICE_ATLAS_TEXTURE_HEADER header = {
+            .pearson_hash = pearson_hash_array(0, pixels.data(), pixels.size()),
+            .color_format_raw = format,
+            .width            = (uint16_t)width,
+            .height           = (uint16_t)height,
+        };
+        vector<uint8_t> file;
+        file.reserve(sizeof(chunk_header) + sizeof(header) + pixels.size());
+        append_bytes(
+            file,
+            chunk_header{CHUNK_TEXTURE,
+                         (uint32_t)(sizeof(header) + pixels.size())});
+        append_bytes(file, header);
+        for (uint8_t byte : pixels)
+            file.push_back(byte);
+
+        snprintf(name, sizeof(name), "page%u.ice", page.index);
+        string ice_path = prefix;
+        ice_path += name;
+        auto add_result = files.add(packed, name, ice_path, file);
+        if (add_result.has_error())
+            return add_result;
+
+        append_bytes(table_pages,
+                     ICE_ATLAS_PAGE{
+                         .path_offset = (uint32_t)paths.size(),
+                         .width       = (uint16_t)width,
+                         .height      = (uint16_t)height,
+                     });
+        for (const char *c = ice_path.c_str(); *c; ++c)
+            paths.push_back((uint8_t)*c);
+        paths.push_back(0);
+    }
+
+    // `textures` is in entry order, so in path order.
+    for (const AtlasTexture &t : textures)
+    {
+        if (t.page == SIZE_MAX)
+            continue;
+        append_bytes(table_regions,
+                     ICE_ATLAS_REGION{
+                         .path_offset = (uint32_t)paths.size(),
+                         .page        = pages[t.page].index,
+                         .x           = (uint16_t)t.x,
+                         .y           = (uint16_t)t.y,
+                         .width       = t.width,
+                         .height      = t.height,
+                     });
+        const string &path = entries[t.entry].ice_path;
+        for (const char *c = path.c_str(); *c; ++c)
+            paths.push_back((uint8_t)*c);
+        paths.push_back(0);
+        ++region_count;
+    }
+
+    const ICE_ATLAS_HEADER table_header = {
+        .version      = ICE_ATLAS_VERSION,
+        .page_count   = page_count,
+        .region_count = region_count,
+    };
+    const size_t table_size = sizeof(table_header) + table_pages.size() +
+                              table_regions.size() + paths.size();
+    vector<uint8_t> table;
+    table.reserve(sizeof(chunk_header) + table_size);
+    append_bytes(table, chunk_header{CHUNK_ATLAS, (uint32_t)table_size});
+    append_bytes(table, table_header);
+    for (const vector<uint8_t> *part : {&table_pages, &table_regions, &paths})
+        for (uint8_t byte : *part)
+            table.push_back(byte);
+
+    string table_path = prefix;
+    table_path += "atlas.ice";
+    auto add_result = files.add(packed, "atlas.ice", table_path, table);
+    if (add_result.has_error())
+        return add_result;
+
+    entries = move(packed);
+    qsort(entries.data(), entries.size(), sizeof(Entry), compare_entries);
+    return {};
+}
+#pragma endregion Texture Atlas
+
+#pragma region Mesh Optimization
+// The MESH chunk of `zabato::mesh`, mirrored as cstd cannot include it (see
+// ICE_MESH_HEADER in mesh.hpp). The header is followed by the bones, each an
+// offset matrix, a name length and the name, then the vertices and the
+// indices, one byte each when there are at most 256 vertices.
+static const chunk_id CHUNK_MESH("MESH");
+
+#pragma pack(push, 1)
+struct ICE_PACKED_MESH_HEADER
+{
+    ice_uint8_t flags_and_type;
+    ice_uint16_t bone_count;
+    ice_uint16_t vertex_count;
+    ice_uint16_t primitive_count;
+};
+#pragma pack(pop)
+
+// Bits of `flags_and_type`: the `zabato::mesh_flags` in the low nibble, then
+// the index size, and the `zabato::primitive_type` in the top two.
+constexpr uint8_t mesh_flag_normal = 1 << 0;
+constexpr uint8_t mesh_flag_color  = 1 << 1;
+constexpr uint8_t mesh_flag_tex    = 1 << 2;
+constexpr uint8_t mesh_flag_bone   = 1 << 3;
+constexpr uint8_t mesh_index_8bit  = 1 << 4;
+
+// Indices per primitive, by `zabato::primitive_type`: quads, triangles,
+// points and lines.
+constexpr size_t mesh_primitive_size[4] = {4, 3, 1, 2};
+
+constexpr size_t mesh_bone_header_size = sizeof(ICE_MAT4X4_R16) + 1;
+
+// Position, then normal, color, texture coordinate and bone weights when
+// present, as `serialize(ice_writer &, const mesh &)` writes them.
+size_t mesh_vertex_size(uint8_t flags)
+{
+    return sizeof(ICE_VEC3_R16) +
+           (flags & mesh_flag_normal ? sizeof(ICE_NORM3) : 0) +
+           (flags & mesh_flag_color ? sizeof(uint16_t) : 0) +
+           (flags & mesh_flag_tex ? sizeof(ICE_VEC2_U16) : 0) +
+           (flags & mesh_flag_bone ? 4 * sizeof(ICE_VEC2<int16_t, ICE_R16>)
+                                   : 0);
+}
+
+// Welds, reorders and renumbers the mesh `e` holds, pointing it at the result
+// written to `files`. It is stored as is if it holds anything else, is broken
+// or is already optimal.
+result<void> optimize_mesh(Entry &e, size_t number, TempFiles &files)
+{
+    chunk_header chunk;
+    ICE_PACKED_MESH_HEADER header;
+    if (e.size < sizeof(chunk) + sizeof(header))
+        return {};
+
+    FILE *f = fopen(e.full_path.c_str(), "rb");
+    if (!f)
+        return report_error(error_code::unable_to_read);
+
+    bool ok = fread(&chunk, sizeof(chunk), 1, f) == 1 &&
+              chunk.id == CHUNK_MESH &&
+              sizeof(chunk) + (uint64_t)chunk.size == e.size;
+    vector<uint8_t> payload;
+    if (ok)
+    {
+        payload.resize(chunk.size);
+        ok = fread(payload.data(), 1, payload.size(), f) == payload.size();
+    }
+    fclose(f);
+    if (!ok)
+        return {};
+
+    memcpy(&header, payload.data(), sizeof(header));
+    const uint8_t flags            = header.flags_and_type & 0x0F;
+    const bool index_8bit          = header.flags_and_type & mesh_index_8bit;
+    const uint8_t type             = header.flags_and_type >> 6;
+    const size_t primitive_size    = mesh_primitive_size[type];
+    const size_t vertex_count      = header.vertex_count;
+    const size_t vertex_size       = mesh_vertex_size(flags);
+    const size_t index_count       = header.primitive_count * primitive_size;
+    const size_t stored_index_size = index_8bit ? 1 : sizeof(uint16_t);
+
+    size_t offset = sizeof(header);
+    for (uint32_t i = 0; i < header.bone_count; ++i)
+    {
+        if (offset + mesh_bone_header_size > payload.size())
+            return {};
+        const uint8_t name_length = payload[offset + mesh_bone_header_size - 1];
+        offset += mesh_bone_header_size + name_length;
+    }
+    const size_t bones_end    = offset;
+    const size_t vertices_end = bones_end + vertex_count * vertex_size;
+    if (vertex_count == 0 || index_count == 0 ||
+        vertices_end + index_count * stored_index_size != payload.size())
+        return {};
+
+    vector<uint16_t> indices;
+    indices.resize(index_count);
+    const uint8_t *stored = payload.data() + vertices_end;
+    for (size_t i = 0; i < index_count; ++i)
+    {
+        uint16_t index = stored[i];
+        if (!index_8bit)
+            memcpy(&index, stored + i * sizeof(uint16_t), sizeof(uint16_t));
+        if (index >= vertex_count)
+            return {};
+        indices[i] = index;
+    }
+
+    vector<uint8_t> vertices;
+    vertices.assign(payload.data() + bones_end, payload.data() + vertices_end);
+
+    // Identical stored vertices include those the quantization made so.
+    size_t count = weld_vertices(vertices, vertex_size, indices);
+    const size_t kept =
+        remove_degenerate_primitives(indices, primitive_size);
+    if (kept == 0)
+        return {};
+    const span<uint16_t> live(indices.data(), kept);
+    if (primitive_size >= 3)
+        optimize_vertex_cache(live, primitive_size, count);
+    count = optimize_vertex_fetch(
+        span<uint8_t>(vertices.data(), count * vertex_size), vertex_size, live);
+
+    const bool out_8bit = count <= 256;
+    const uint8_t kept_bits = header.flags_and_type & ~mesh_index_8bit;
+    const ICE_PACKED_MESH_HEADER out_header = {
+        .flags_and_type =
+            (uint8_t)(kept_bits | (out_8bit ? mesh_index_8bit : 0)),
+        .bone_count      = header.bone_count,
+        .vertex_count    = (uint16_t)count,
+        .primitive_count = (uint16_t)(kept / primitive_size),
+    };
+    const size_t size = bones_end + count * vertex_size +
+                        kept * (out_8bit ? 1 : sizeof(uint16_t));
+
+    vector<uint8_t> file;
+    file.reserve(sizeof(chunk_header) + size);
+    append_bytes(file, chunk_header{CHUNK_MESH, (uint32_t)size});
+    append_bytes(file, out_header);
+    for (size_t i = sizeof(header); i < bones_end; ++i)
+        file.push_back(payload[i]);
+    for (size_t i = 0; i < count * vertex_size; ++i)
+        file.push_back(vertices[i]);
+    for (uint16_t index : live)
+    {
+        if (out_8bit)
+            file.push_back((uint8_t)index);
+        else
+            append_bytes(file, index);
+    }
+
+    if (file.size() == e.size &&
+        memcmp(file.data() + sizeof(chunk), payload.data(), payload.size()) ==
+            0)
+        return {};
+
+    auto create_result = files.create();
+    if (create_result.has_error())
+        return create_result;
+
+    char name[32];
+    snprintf(name, sizeof(name), "mesh%zu.ice", number);
+    return files.write(name, file, e);
+}
+
+result<void> optimize_meshes(vector<Entry> &entries, TempFiles &files)
+{
+    for (size_t i = 0; i < entries.size(); ++i)
+    {
+        auto mesh_result = optimize_mesh(entries[i], i, files);
+        if (mesh_result.has_error())
+            return mesh_result;
+    }
+    return {};
+}
+#pragma endregion Mesh Optimization
+
 } // namespace
 
-result<void> ice_packer::pack(const string &source_path)
+result<void> ice_packer::pack(const string &source_path,
+                              bool hash_index,
+                              size_t block_size,
+                              uint32_t thread_count,
+                              int level,
+                              size_t dictionary_size)
 {
     vector<Entry> entries;
+    vector<uint8_t> dictionary;
+
+    const uint32_t alignment = m_alignment > 1 ? m_alignment : 1;
+    if ((alignment & (alignment - 1)) != 0 || alignment > max_data_alignment)
+        return report_error(error_code::value, "alignment");
+    if (m_compression_threshold == 0 || m_compression_threshold > 100)
+        return report_error(error_code::value, "compression threshold");
 
 #pragma region Scan entries
     std::filesystem::path base(source_path.c_str());
@@ -54,13 +1438,16 @@ result<void> ice_packer::pack(const string &source_path)
             const std::string rel_str  = rel.generic_string();
             const std::string full_str = entry.path().generic_string();
             const uint64_t file_size   = entry.file_size();
+            const uint64_t mtime =
+                (uint64_t)entry.last_write_time().time_since_epoch().count();
 
-            entries.push_back({
+            entries.emplace_back(Entry{
                 .full_path   = string(full_str.c_str()),
                 .ice_path    = string(rel_str.c_str()),
                 .is_dir      = false,
                 .size        = file_size,
                 .data_offset = 0,
+                .mtime       = mtime,
             });
         }
     }
@@ -68,6 +1455,129 @@ result<void> ice_packer::pack(const string &source_path)
     if (!entries.empty())
         qsort(entries.data(), entries.size(), sizeof(Entry), compare_entries);
 
+    // Outlives the write, which reads the generated files back.
+    TempFiles temp_files;
+    if (m_atlas_page_size > 0)
+    {
+        const uint32_t page_size = m_atlas_page_size;
+        if ((page_size & (page_size - 1)) != 0 ||
+            m_atlas_texture_size > page_size)
+            return report_error(error_code::value, "atlas size");
+
+        auto atlas_result = build_texture_atlas(entries,
+                                                page_size,
+                                                m_atlas_texture_size,
+                                                m_atlas_directory,
+                                                temp_files);
+        if (atlas_result.has_error())
+            return atlas_result.error;
+    }
+
+    if (m_optimize_meshes)
+    {
+        auto mesh_result = optimize_meshes(entries, temp_files);
+        if (mesh_result.has_error())
+            return mesh_result.error;
+    }
+
+#pragma region Incremental
+    const bool incremental = !m_manifest_path.empty();
+
+    ICE_PACK_MANIFEST settings = {
+        .version               = manifest_version,
+        .level                 = (uint32_t)level,
+        .block_size            = block_size,
+        .dictionary_size       = dictionary_size,
+        .archive_size          = 0,
+        .entry_count           = 0,
+        .compression_threshold = m_compression_threshold,
+    };
+
+    Manifest manifest;
+    FILE *previous = nullptr;
+    if (incremental && read_manifest(m_manifest_path, manifest) &&
+        manifest.header.level == settings.level &&
+        manifest.header.block_size == settings.block_size &&
+        manifest.header.dictionary_size == settings.dictionary_size &&
+        manifest.header.compression_threshold ==
+            settings.compression_threshold)
+        previous = fopen(m_previous_archive.c_str(), "rb");
+    if (previous && (fseek(previous, 0, SEEK_END) != 0 ||
+                     (uint64_t)ftell(previous) != manifest.header.archive_size))
+    {
+        fclose(previous);
+        previous = nullptr;
+    }
+
+    // The previous archive stays open for writing the reused chunks.
+    struct previous_closer
+    {
+        FILE *&file;
+        ~previous_closer()
+        {
+            if (file)
+                fclose(file);
+        }
+    } close_previous{previous};
+
+    if (previous)
+    {
+        auto match_result = match_manifest(entries, manifest, previous);
+        if (match_result.has_error())
+            return match_result.error;
+        dictionary = manifest.dictionary;
+    }
+#pragma endregion Incremental
+
+    if (m_deduplicate)
+    {
+        auto dedup_result = deduplicate_entries(entries);
+        if (dedup_result.has_error())
+            return dedup_result.error;
+    }
+
+    if (block_size > 0 && dictionary_size > 0 && !previous)
+    {
+        auto train_result = train_archive_dictionary(
+            entries,
+            block_size,
+            min(dictionary_size, BERG_MAX_DICTIONARY_SIZE),
+            dictionary);
+        if (train_result.has_error())
+            return train_result.error;
+    }
+
+    if (block_size > 0)
+    {
+        auto pending_size = [](const Entry &e) -> uint64_t
+        {
+            return e.pending() ? e.size : 0;
+        };
+
+        size_t first = 0;
+        while (first < entries.size())
+        {
+            // At least one entry per batch, however large.
+            size_t last   = first + 1;
+            size_t budget = pending_size(entries[first]);
+            while (last < entries.size() &&
+                   budget + pending_size(entries[last]) <= batch_budget)
+                budget += pending_size(entries[last++]);
+
+            auto compress_result = compress_batch(entries,
+                                                  first,
+                                                  last,
+                                                  block_size,
+                                                  thread_count,
+                                                  level,
+                                                  dictionary,
+                                                  m_compression_threshold);
+            if (compress_result.has_error())
+                return compress_result.error;
+            first = last;
+        }
+    }
+
 #pragma region Index Layout
     // Calculate size of Index Chunk
     // [Count U64] [EntryTable] [StringBlock]
@@ -94,12 +1604,77 @@ result<void> ice_packer::pack(const string &source_path)
 
 #pragma endregion Index Layout
 
+#pragma region Hash Layout
+    // Open addressing at a load factor of at most one half.
+    uint32_t slot_count = 0;
+    vector<ICE_HASH_SLOT> slots;
+    if (hash_index && !entries.empty())
+    {
+        slot_count = 2;
+        while (slot_count < entries.size() * 2)
+            slot_count *= 2;
+
+        slots.resize(slot_count, ICE_HASH_SLOT{0, 0});
+        for (size_t i = 0; i < entries.size(); ++i)
+        {
+            const uint32_t hash = ice_path_hash(entries[i].ice_path);
+            uint32_t slot       = hash & (slot_count - 1);
+            while (slots[slot].entry != 0)
+                slot = (slot + 1) & (slot_count - 1);
+            slots[slot] = {hash, (uint32_t)(i + 1)};
+        }
+    }
+
+    const uint64_t hash_payload_size =
+        sizeof(ice_uint32_t) + slots.size() * sizeof(ICE_HASH_SLOT);
+    uint64_t hash_chunk_end = index_chunk_end;
+    if (!slots.empty())
+        hash_chunk_end += sizeof(chunk_header) + hash_payload_size;
+
+    uint64_t dictionary_chunk_end = hash_chunk_end;
+    if (!dictionary.empty())
+        dictionary_chunk_end += sizeof(chunk_header) + dictionary.size();
+
+#pragma endregion Hash Layout
+
 #pragma region Data Layout
-    uint64_t current_data_offset = index_chunk_end;
+    uint64_t current_data_offset = dictionary_chunk_end;
     for (auto &e : entries)
     {
+        if (e.shared)
+            continue;
+        if (!e.reused && e.packed.empty())
+        {
+            e.stored_size = sizeof(chunk_header) + e.size;
+            e.flags       = 0;
+        }
+        else if (!e.reused)
+        {
+            e.stored_size = e.packed.size();
+            e.flags       = ICE_ENTRY_BERG_BLOCKS;
+            if (!dictionary.empty())
+                e.flags |= ICE_ENTRY_BERG_DICTIONARY;
+        }
+
+        e.padding = 0;
+        if (alignment > 1 &&
+            (m_align_compressed || !(e.flags & ICE_ENTRY_BERG_BLOCKS)))
+            e.padding = padding_size(current_data_offset, alignment);
+
+        current_data_offset += e.padding;
         e.data_offset = current_data_offset + sizeof(chunk_header);
-        current_data_offset += sizeof(chunk_header) + e.size;
+        current_data_offset += e.stored_size;
+    }
+
+    // Shared entries point at the chunk of their owner.
+    for (auto &e : entries)
+    {
+        if (!e.shared)
+            continue;
+        const Entry &owner = entries[e.owner];
+        e.data_offset      = owner.data_offset;
+        e.stored_size      = owner.stored_size;
+        e.flags            = owner.flags | ICE_ENTRY_SHARED;
     }
 
 #pragma endregion Data Layout
@@ -110,6 +1685,7 @@ result<void> ice_packer::pack(const string &source_path)
         .version         = 1,
         .file_count      = (uint32_t)entries.size(),
         .root_dir_offset = index_chunk_start,
+        .data_alignment  = alignment,
     };
     m_writer.write(&pack, sizeof(pack));
 
@@ -124,7 +1700,7 @@ result<void> ice_packer::pack(const string &source_path)
             .path_offset = name_offsets[i],
             .data_offset = entries[i].data_offset,
             .size        = entries[i].size,
-            .flags       = 0,
+            .flags       = entries[i].flags,
         };
         m_writer.write(&ie, sizeof(ie));
     }
@@ -133,11 +1709,53 @@ result<void> ice_packer::pack(const string &source_path)
     for (const auto &e : entries)
         m_writer.write(e.ice_path.c_str(), e.ice_path.length() + 1);
 
+    // Write Hash Index
+    if (!slots.empty())
+    {
+        m_writer.write_chunk_header(CHUNK_HASH, hash_payload_size);
+        ice_uint32_t count32 = slot_count;
+        m_writer.write(&count32, sizeof(count32));
+        m_writer.write(slots.data(), slots.size() * sizeof(ICE_HASH_SLOT));
+    }
+
+    // Write Dictionary
+    if (!dictionary.empty())
+    {
+        m_writer.write_chunk_header(CHUNK_DICT, dictionary.size());
+        m_writer.write(dictionary.data(), dictionary.size());
+    }
+
     // Write File Data
     uint8_t copy_buffer[4096];
-    for (const auto &e : entries)
+    for (auto &e : entries)
     {
+        if (e.shared)
+            continue;
+        if (e.padding > 0)
+            write_padding(m_writer, e.padding);
+        if (e.reused)
+        {
+            fseek(previous, (long)e.reuse_offset, SEEK_SET);
+            uint64_t remaining = e.stored_size;
+            while (remaining > 0)
+            {
+                const size_t to_read =
+                    (size_t)min(remaining, (uint64_t)sizeof(copy_buffer));
+                if (fread(copy_buffer, 1, to_read, previous) != to_read)
+                    return report_error(error_code::unable_to_read);
+                m_writer.write(copy_buffer, to_read);
+                remaining -= to_read;
+            }
+            continue;
+        }
+        if (!e.packed.empty())
+        {
+            m_writer.write(e.packed.data(), e.packed.size());
+            continue;
+        }
+
         m_writer.write_chunk_header(CHUNK_FILE, e.size);
+        e.hash = content_hash_seed;
         if (e.size > 0)
         {
             FILE *f = fopen(e.full_path.c_str(), "rb");
@@ -152,6 +1770,7 @@ result<void> ice_packer::pack(const string &source_path)
                     if (fread(copy_buffer, 1, to_read, f) != to_read)
                         break;
                     m_writer.write(copy_buffer, to_read);
+                    e.hash = content_hash(e.hash, copy_buffer, to_read);
                     remaining -= to_read;
                 }
                 fclose(f);
@@ -163,6 +1782,12 @@ result<void> ice_packer::pack(const string &source_path)
         }
     }
 
+    if (incremental)
+    {
+        settings.archive_size = current_data_offset;
+        settings.entry_count  = entries.size();
+        return write_manifest(m_manifest_path, entries, settings, dictionary);
+    }
     return {};
 }
 
@@ -0,0 +1,505 @@
+#include <zabato/job_system.hpp>
+#include <zabato/utils.hpp>
+
+#include <assert.h>
+
+namespace zabato
+{
+struct job_system::job
+{
+    job_function function = nullptr;
+    void *data            = nullptr;
+    job_counter *counter  = nullptr;
+    bool owned            = false; ///< Allocated with `new`, not a ring slot.
+    atomic_bool in_use;            ///< A ring slot holding a queued job.
+
+    job() { atomic_init(&in_use, false); }
+};
+
+namespace
+{
+/**
+ * @class job_deque
+ * @brief A fixed capacity Chase-Lev deque (Lê et al., "Correct and
+ * Efficient Work-Stealing for Weak Memory Models").
+ *
+ * Only the owner pushes and pops, at the bottom; any thread steals from the
+ * top.
+ */
+template <class T, size_t Capacity> class job_deque
+{
+    static_assert((Capacity & (Capacity - 1)) == 0,
+                  "job_deque capacity must be a power of two");
+
+public:
+    job_deque()
+    {
+        atomic_init(&m_top, 0);
+        atomic_init(&m_bottom, 0);
+        for (atomic_uintptr_t &entry : m_entries)
+            atomic_init(&entry, 0);
+    }
+
+    /** @return False if the deque is full. Owner only. */
+    bool push(T *item)
+    {
+        const ptrdiff_t b =
+            atomic_load_explicit(&m_bottom, memory_order_relaxed);
+        const ptrdiff_t t = atomic_load_explicit(&m_top, memory_order_acquire);
+        if (b - t >= ptrdiff_t(Capacity))
+            return false;
+
+        atomic_store_explicit(
+            &m_entries[b & mask], (uintptr_t)item, memory_order_relaxed);
+        atomic_store_explicit(&m_bottom, b + 1, memory_order_release);
+        return true;
+    }
+
+    /** @return The newest item, or null. Owner only. */
+    T *pop()
+    {
+        const ptrdiff_t b =
+            atomic_load_explicit(&m_bottom, memory_order_relaxed) - 1;
+        atomic_store_explicit(&m_bottom, b, memory_order_relaxed);
+        atomic_thread_fence(memory_order_seq_cst);
+        ptrdiff_t t = atomic_load_explicit(&m_top, memory_order_relaxed);
+
+        if (t > b)
+        {
+            atomic_store_explicit(&m_bottom, b + 1, memory_order_relaxed);
+            return nullptr;
+        }
+
+        T *item = (T *)atomic_load_explicit(&m_entries[b & mask],
+                                             memory_order_relaxed);
+        if (t == b)
+        {
+            // The last item, race the thieves for it.
+            if (!atomic_compare_exchange_strong_explicit(&m_top,
+                                                         &t,
+                                                         t + 1,
+                                                         memory_order_seq_cst,
+                                                         memory_order_relaxed))
+                item = nullptr;
+            atomic_store_explicit(&m_bottom, b + 1, memory_order_relaxed);
+        }
+        return item;
+    }
+
+    /** @return The oldest item, or null if empty or lost to another thief. */
+    T *steal()
+    {
+        ptrdiff_t t = atomic_load_explicit(&m_top, memory_order_acquire);
+        atomic_thread_fence(memory_order_seq_cst);
+        const ptrdiff_t b =
+            atomic_load_explicit(&m_bottom, memory_order_acquire);
+        if (t >= b)
+            return nullptr;
+
+        T *item = (T *)atomic_load_explicit(&m_entries[t & mask],
+                                             memory_order_relaxed);
+        if (!atomic_compare_exchange_strong_explicit(&m_top,
+                                                     &t,
+                                                     t + 1,
+                                                     memory_order_seq_cst,
+                                                     memory_order_relaxed))
+            return nullptr;
+        return item;
+    }
+
+private:
+    static constexpr size_t mask = Capacity - 1;
+
+    atomic_ptrdiff_t m_top;
+    atomic_ptrdiff_t m_bottom;
+    atomic_uintptr_t m_entries[Capacity];
+};
+
+/** @brief The worker of the calling thread, and the system it belongs to. */
+thread_local void *t_system = nullptr;
+thread_local void *t_worker = nullptr;
+
+/** @brief A `parallel_for` in flight, shared by the jobs running it. */
+struct parallel_for_context
+{
+    job_range_function function;
+    void *data;
+    size_t count;
+    size_t grain;
+    atomic_size_t next;
+};
+
+void parallel_for_job(void *data)
+{
+    parallel_for_context *context = static_cast<parallel_for_context *>(data);
+    for (;;)
+    {
+        const size_t begin = atomic_fetch_add_explicit(
+            &context->next, context->grain, memory_order_relaxed);
+        if (begin >= context->count)
+            return;
+        context->function(context->data,
+                          begin,
+                          min(begin + context->grain, context->count));
+    }
+}
+} // namespace
+
+struct job_system::worker
+{
+    job_system *system = nullptr;
+    uint32_t index     = 0;
+    uint32_t next_job  = 0;
+    uint32_t seed      = 0;
+    thread native;
+    job_deque<job, max_jobs_per_thread> deque;
+    job jobs[max_jobs_per_thread];
+};
+
+/** @brief A locked FIFO queue, for jobs that have no deque to go to. */
+struct job_system::job_queue
+{
+    mutex lock;
+    vector<job *> items;
+    size_t head = 0;
+
+    void push(job *j)
+    {
+        lock_guard guard(lock);
+        items.push_back(j);
+    }
+
+    job *try_pop()
+    {
+        lock_guard guard(lock);
+        if (head == items.size())
+            return nullptr;
+
+        job *j = items[head++];
+        if (head == items.size())
+        {
+            items.clear();
+            head = 0;
+        }
+        return j;
+    }
+};
+
+job_system &job_system::get()
+{
+    static job_system system;
+    return system;
+}
+
+job_system::job_system()
+    : m_shared(new job_queue()), m_main_jobs(new job_queue())
+{
+    atomic_init(&m_running, false);
+    atomic_init(&m_queued, 0);
+    atomic_init(&m_sleeping, 0);
+}
+
+job_system::~job_system()
+{
+    stop();
+    delete m_shared;
+    delete m_main_jobs;
+}
+
+bool job_system::start(uint32_t worker_count)
+{
+    if (!m_workers.empty())
+        return false;
+
+    if (worker_count == 0)
+        worker_count = thread::hardware_concurrency() - 1;
+
+    atomic_store_explicit(&m_running, true, memory_order_relaxed);
+
+    for (uint32_t i = 0; i <= worker_count; ++i)
+    {
+        worker *w = new worker();
+        w->system = this;
+        w->index  = i;
+        w->seed   = i * 2654435761u + 1;
+        m_workers.push_back(w);
+    }
+
+    t_system = this;
+    t_worker = m_workers[0];
+
+    // Workers that fail to start leave their share to the others.
+    for (uint32_t i = 1; i <= worker_count; ++i)
+        m_workers[i]->native.start(worker_main, m_workers[i]);
+    return true;
+}
+
+void job_system::stop()
+{
+    if (m_workers.empty())
+        return;
+
+    assert(is_main_thread() && "job_system::stop must run on the main thread");
+
+    // Finish what is queued, so no counter is left waiting.
+    while (try_run_one(m_workers[0]) || run_main_thread_jobs() > 0)
+    {
+    }
+
+    {
+        lock_guard guard(m_sleep_lock);
+        atomic_store_explicit(&m_running, false, memory_order_seq_cst);
+        m_wake.notify_all();
+    }
+
+    for (size_t i = 1; i < m_workers.size(); ++i)
+        m_workers[i]->native.join();
+    for (worker *w : m_workers)
+        delete w;
+    m_workers.clear();
+
+    t_system = nullptr;
+    t_worker = nullptr;
+}
+
+uint32_t job_system::worker_count() const
+{
+    return m_workers.empty() ? 0 : uint32_t(m_workers.size() - 1);
+}
+
+bool job_system::is_main_thread() const
+{
+    return !m_workers.empty() && current_worker() == m_workers[0];
+}
+
+void job_system::run(job_function function,
+                     void *data,
+                     job_counter *counter,
+                     job_affinity affinity)
+{
+    if (counter)
+        atomic_fetch_add_explicit(&counter->m_pending, 1, memory_order_relaxed);
+
+    // Without workers there is nobody to hand the job to.
+    if (m_workers.empty())
+    {
+        function(data);
+        if (counter)
+            atomic_fetch_sub_explicit(
+                &counter->m_pending, 1, memory_order_release);
+        return;
+    }
+
+    job *j      = allocate_job();
+    j->function = function;
+    j->data     = data;
+    j->counter  = counter;
+
+    if (affinity == job_affinity::main_thread)
+    {
+        m_main_jobs->push(j);
+        return;
+    }
+
+    push(j);
+}
+
+void job_system::wait(job_counter &counter)
+{
+    worker *self = current_worker();
+    while (!counter.is_done())
+        if (!try_run_one(self))
+            thread::yield();
+}
+
+void job_system::parallel_for(size_t count,
+                              size_t grain,
+                              job_range_function function,
+                              void *data)
+{
+    if (count == 0)
+        return;
+
+    const size_t threads = size_t(worker_count()) + 1;
+    if (grain == 0)
+        grain = max((size_t)1, count / (threads * 4));
+
+    const size_t ranges = (count + grain - 1) / grain;
+    if (threads == 1 || ranges == 1)
+    {
+        function(data, 0, count);
+        return;
+    }
+
+    // Every job pulls ranges until none are left, the caller included.
+    parallel_for_context context;
+    context.function = function;
+    context.data     = data;
+    context.count    = count;
+    context.grain    = grain;
+    atomic_init(&context.next, 0);
+
+    job_counter counter;
+    const size_t helpers = min(threads - 1, ranges - 1);
+    for (size_t i = 0; i < helpers; ++i)
+        run(parallel_for_job, &context, &counter);
+
+    parallel_for_job(&context);
+    wait(counter);
+}
+
+size_t job_system::run_main_thread_jobs()
+{
+    assert(is_main_thread() || m_workers.empty());
+
+    size_t count = 0;
+    while (job *j = m_main_jobs->try_pop())
+    {
+        execute(j);
+        ++count;
+    }
+    return count;
+}
+
+job_system::job *job_system::allocate_job()
+{
+    // Slots are freed as their jobs are taken, in any order, so skip the
+    // ones still queued. Every slot is taken only when the deque is full.
+    if (worker *self = current_worker())
+    {
+        for (uint32_t i = 0; i < max_jobs_per_thread; ++i)
+        {
+            job *j = &self->jobs[self->next_job++ & (max_jobs_per_thread - 1)];
+            if (!atomic_load_explicit(&j->in_use, memory_order_acquire))
+            {
+                atomic_store_explicit(&j->in_use, true, memory_order_relaxed);
+                j->owned = false;
+                return j;
+            }
+        }
+    }
+
+    job *j   = new job();
+    j->owned = true;
+    return j;
+}
+
+void job_system::push(job *j)
+{
+    worker *self = current_worker();
+    if (!self || !self->deque.push(j))
+    {
+        // Ring slots stay with the deque, overflow goes to the heap.
+        if (!j->owned)
+        {
+            job *copy      = new job();
+            copy->function = j->function;
+            copy->data     = j->data;
+            copy->counter  = j->counter;
+            copy->owned    = true;
+            atomic_store_explicit(&j->in_use, false, memory_order_release);
+            j = copy;
+        }
+        m_shared->push(j);
+    }
+
+    // Pairs with the sleeping count and the queue check in `worker_main`:
+    // either the worker sees the job or this sees the worker.
+    atomic_fetch_add_explicit(&m_queued, 1, memory_order_seq_cst);
+    if (atomic_load_explicit(&m_sleeping, memory_order_seq_cst) > 0)
+    {
+        lock_guard guard(m_sleep_lock);
+        m_wake.notify_one();
+    }
+}
+
+bool job_system::try_run_one(worker *self)
+{
+    job *j = self ? self->deque.pop() : nullptr;
+
+    if (!j && self && self->index == 0)
+    {
+        j = m_main_jobs->try_pop();
+        if (j)
+        {
+            execute(j);
+            return true;
+        }
+    }
+
+    if (!j)
+        j = m_shared->try_pop();
+
+    if (!j)
+    {
+        const size_t count = m_workers.size();
+        uint32_t start     = 0;
+        if (self)
+        {
+            self->seed = self->seed * 1664525u + 1013904223u;
+            start      = self->seed >> 8;
+        }
+        for (size_t i = 0; i < count && !j; ++i)
+        {
+            worker *victim = m_workers[(start + i) % count];
+            if (victim != self)
+                j = victim->deque.steal();
+        }
+    }
+
+    if (!j)
+        return false;
+
+    atomic_fetch_sub_explicit(&m_queued, 1, memory_order_relaxed);
+    execute(j);
+    return true;
+}
+
+void job_system::execute(job *j)
+{
+    // Free the job before running it, since it may start many more.
+    const job_function function = j->function;
+    void *data                  = j->data;
+    job_counter *counter        = j->counter;
+    if (j->owned)
+        delete j;
+    else
+        atomic_store_explicit(&j->in_use, false, memory_order_release);
+
+    function(data);
+
+    if (counter)
+        atomic_fetch_sub_explicit(
+            &counter->m_pending, 1, memory_order_release);
+}
+
+job_system::worker *job_system::current_worker() const
+{
+    return t_system == this ? static_cast<worker *>(t_worker) : nullptr;
+}
+
+void job_system::worker_main(void *arg)
+{
+    worker *self       = static_cast<worker *>(arg);
+    job_system &system = *self->system;
+    t_system           = &system;
+    t_worker           = self;
+
+    for (;;)
+    {
+        if (system.try_run_one(self))
+            continue;
+
+        lock_guard guard(system.m_sleep_lock);
+        atomic_fetch_add_explicit(&system.m_sleeping, 1, memory_order_seq_cst);
+        while (atomic_load_explicit(&system.m_queued, memory_order_seq_cst) ==
+                   0 &&
+               atomic_load_explicit(&system.m_running, memory_order_relaxed))
+            system.m_wake.wait(system.m_sleep_lock);
+        atomic_fetch_sub_explicit(&system.m_sleeping, 1, memory_order_relaxed);
+
+        if (!atomic_load_explicit(&system.m_running, memory_order_relaxed))
+            return;
+    }
+}
+} // namespace zabato
@@ -0,0 +1,392 @@
+#include <zabato/fixed_string.hpp>
+#include <zabato/log.hpp>
+#include <zabato/thread.hpp>
+#include <zabato/time.hpp>
+#include <zabato/utils.hpp>
+
+#include <stdatomic.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace zabato
+{
+namespace
+{
+using log_text = fixed_string<max_log_message + 1>;
+
+/** @brief The messages in flight, a power of two. */
+constexpr size_t slot_count = 1024;
+
+/** @brief The messages rate-limited at once, a power of two. */
+constexpr size_t repeat_count = 64;
+
+/** @brief How long the writer sleeps when the ring is empty. */
+constexpr uint64_t idle_sleep = 2000000;
+
+/**
+ * @brief A message in the ring. `sequence` says whose turn the slot is: a
+ * producer may claim it when it equals the claimed position, and the writer
+ * may read it once it is one past.
+ */
+struct log_slot
+{
+    atomic_size_t sequence;
+    log_level level;
+    uint64_t time;
+    log_text text;
+};
+
+/** @brief How often one message was logged in the current window. */
+struct repeat_entry
+{
+    atomic_uint_least64_t hash; ///< Of level and text, 0 when unused.
+    atomic_uint_least64_t window_start;
+    atomic_uint count;
+    atomic_uint suppressed; ///< Copies left out, not reported yet.
+};
+
+/**
+ * @brief The ring, a bounded multi-producer queue after Dmitry Vyukov's,
+ * with the writer thread as its only consumer.
+ */
+struct log_state
+{
+    log_slot slots[slot_count];
+    atomic_size_t head;    ///< The next position producers claim.
+    atomic_size_t tail;    ///< The next position the writer reads.
+    atomic_size_t dropped; ///< Messages the ring had no room for.
+
+    repeat_entry repeats[repeat_count];
+    atomic_uint repeat_limit;
+    atomic_uint_least64_t repeat_window;
+
+    atomic_bool running;
+    atomic_uint producers; ///< Between reading `running` and publishing.
+    mutex control;         ///< Serializes `start_logging` and `stop_logging`.
+    thread writer;
+    FILE *out           = stderr;
+    bool owns_out       = false;
+    uint64_t start_time = time::now().as_nanoseconds();
+
+    log_state()
+    {
+        for (size_t i = 0; i < slot_count; ++i)
+            atomic_init(&slots[i].sequence, i);
+        for (repeat_entry &entry : repeats)
+        {
+            atomic_init(&entry.hash, 0);
+            atomic_init(&entry.window_start, 0);
+            atomic_init(&entry.count, 0);
+            atomic_init(&entry.suppressed, 0);
+        }
+        atomic_init(&head, 0);
+        atomic_init(&tail, 0);
+        atomic_init(&dropped, 0);
+        atomic_init(&repeat_limit, 10);
+        atomic_init(&repeat_window, 1000000000);
+        atomic_init(&running, false);
+        atomic_init(&producers, 0);
+    }
+
+    ~log_state() { stop(); }
+
+    void stop();
+};
+
+log_state &state()
+{
+    static log_state s;
+    return s;
+}
+
+const char *level_name(log_level level)
+{
+    switch (level)
+    {
+    case log_level::error:
+        return "ERR";
+    case log_level::warning:
+        return "WAR";
+    case log_level::info:
+        return "INF";
+    case log_level::trace:
+        return "TRA";
+    default:
+        return "UNK";
+    }
+}
+
+void write_line(log_state &s,
+                FILE *out,
+                log_level level,
+                uint64_t time,
+                const char *text)
+{
+    const uint64_t since = time > s.start_time ? time - s.start_time : 0;
+    fprintf(out,
+            "[%6llu.%03llu] %s: %s\n",
+            (unsigned long long)(since / 1000000000),
+            (unsigned long long)(since / 1000000 % 1000),
+            level_name(level),
+            text);
+}
+
+/** @return False if the message is a copy over the limit of its window. */
+bool pass_rate_limit(log_state &s,
+                     log_level level,
+                     const log_text &text,
+                     uint64_t now)
+{
+    const uint32_t limit =
+        atomic_load_explicit(&s.repeat_limit, memory_order_relaxed);
+    if (limit == 0)
+        return true;
+
+    // Racing threads may count a copy more or less, which is harmless.
+    const uint64_t hash =
+        hash_bytes(text.data(), text.size(), (uint64_t)level) | 1;
+    repeat_entry &entry = s.repeats[hash & (repeat_count - 1)];
+    const uint64_t window =
+        atomic_load_explicit(&s.repeat_window, memory_order_relaxed);
+
+    const bool current =
+        now - atomic_load_explicit(&entry.window_start, memory_order_relaxed) <
+        window;
+    if (current && atomic_load_explicit(&entry.hash, memory_order_relaxed) ==
+                       hash)
+    {
+        if (atomic_fetch_add_explicit(
+                &entry.count, 1, memory_order_relaxed) < limit)
+            return true;
+        atomic_fetch_add_explicit(&entry.suppressed, 1, memory_order_relaxed);
+        return false;
+    }
+
+    // Another message holds the entry for its window, this one goes through
+    // uncounted rather than resetting the count of a storm.
+    if (current)
+        return true;
+
+    atomic_store_explicit(&entry.window_start, now, memory_order_relaxed);
+    atomic_store_explicit(&entry.count, 1, memory_order_relaxed);
+    atomic_store_explicit(&entry.hash, hash, memory_order_relaxed);
+    return true;
+}
+
+/**
+ * @brief Writes how many copies were left out by the windows that ended, or
+ * by every window if `all`.
+ */
+void report_suppressed(log_state &s, FILE *out, uint64_t now, bool all)
+{
+    const uint64_t window =
+        atomic_load_explicit(&s.repeat_window, memory_order_relaxed);
+    for (repeat_entry &entry : s.repeats)
+    {
+        if (atomic_load_explicit(&entry.suppressed, memory_order_relaxed) ==
+                0 ||
+            (!all && now - atomic_load_explicit(&entry.window_start,
+                                                memory_order_relaxed) <
+                         window))
+            continue;
+
+        const uint32_t count = atomic_exchange_explicit(
+            &entry.suppressed, 0, memory_order_relaxed);
+        if (count == 0)
+            continue;
+
+        char text[64];
+        snprintf(text, sizeof(text), "%u repeated messages left out", count);
+        write_line(s, out, log_level::warning, now, text);
+    }
+}
+
+bool push(log_state &s, log_level level, uint64_t time, const log_text &text)
+{
+    size_t pos = atomic_load_explicit(&s.head, memory_order_relaxed);
+    log_slot *slot;
+    for (;;)
+    {
+        slot = &s.slots[pos & (slot_count - 1)];
+        const size_t sequence =
+            atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        const intptr_t turn = (intptr_t)sequence - (intptr_t)pos;
+        if (turn == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&s.head,
+                                                      &pos,
+                                                      pos + 1,
+                                                      memory_order_relaxed,
+                                                      memory_order_relaxed))
+                break;
+        }
+        else if (turn < 0)
+            return false; // Full, the writer has not freed the slot yet.
+        else
+            pos = atomic_load_explicit(&s.head, memory_order_relaxed);
+    }
+
+    slot->level = level;
+    slot->time  = time;
+    slot->text  = text;
+    atomic_store_explicit(&slot->sequence, pos + 1, memory_order_release);
+    return true;
+}
+
+/** @return The number of messages written. Called by one thread at a time. */
+size_t drain(log_state &s)
+{
+    size_t pos   = atomic_load_explicit(&s.tail, memory_order_relaxed);
+    size_t count = 0;
+    for (;; ++pos, ++count)
+    {
+        log_slot &slot = s.slots[pos & (slot_count - 1)];
+        if (atomic_load_explicit(&slot.sequence, memory_order_acquire) !=
+            pos + 1)
+            break;
+
+        write_line(s, s.out, slot.level, slot.time, slot.text.c_str());
+        atomic_store_explicit(
+            &slot.sequence, pos + slot_count, memory_order_release);
+        atomic_store_explicit(&s.tail, pos + 1, memory_order_release);
+    }
+    return count;
+}
+
+void run_writer(void *)
+{
+    log_state &s = state();
+    while (atomic_load_explicit(&s.running, memory_order_acquire))
+    {
+        const size_t written = drain(s);
+        report_suppressed(s, s.out, time::now().as_nanoseconds(), false);
+        if (written > 0)
+            fflush(s.out);
+        else
+            thread::sleep_for(idle_sleep);
+    }
+}
+
+void log_state::stop()
+{
+    lock_guard lock(control);
+    if (!atomic_load_explicit(&running, memory_order_acquire))
+        return;
+
+    atomic_store_explicit(&running, false, memory_order_seq_cst);
+    writer.join();
+
+    // Producers that saw `running` still set may not have published yet, and
+    // `drain` stops at the first slot that is not, stranding it and the rest.
+    while (atomic_load_explicit(&producers, memory_order_seq_cst) > 0)
+        thread::yield();
+    drain(*this);
+    report_suppressed(*this, out, time::now().as_nanoseconds(), true);
+    fflush(out);
+    if (owns_out)
+        fclose(out);
+    out      = stderr;
+    owns_out = false;
+}
+} // namespace
+
+bool start_logging(FILE *out)
+{
+    log_state &s = state();
+    lock_guard lock(s.control);
+    if (!out || atomic_load_explicit(&s.running, memory_order_acquire))
+        return false;
+
+    s.out      = out;
+    s.owns_out = false;
+    atomic_store_explicit(&s.running, true, memory_order_release);
+    if (!s.writer.start(run_writer, nullptr))
+    {
+        atomic_store_explicit(&s.running, false, memory_order_release);
+        s.out = stderr;
+        return false;
+    }
+    return true;
+}
+
+bool start_logging(const char *path)
+{
+    FILE *file = fopen(path, "ab");
+    if (!file)
+        return false;
+    if (!start_logging(file))
+    {
+        fclose(file);
+        return false;
+    }
+
+    log_state &s = state();
+    lock_guard lock(s.control);
+    s.owns_out = true;
+    return true;
+}
+
+void stop_logging() { state().stop(); }
+
+void flush_log()
+{
+    log_state &s       = state();
+    const size_t until = atomic_load_explicit(&s.head, memory_order_acquire);
+    while (atomic_load_explicit(&s.running, memory_order_acquire) &&
+           (intptr_t)(atomic_load_explicit(&s.tail, memory_order_acquire) -
+                      until) < 0)
+        thread::yield();
+    fflush(s.out);
+}
+
+void set_log_rate_limit(uint32_t count, uint64_t window)
+{
+    log_state &s = state();
+    atomic_store_explicit(&s.repeat_limit, count, memory_order_relaxed);
+    atomic_store_explicit(&s.repeat_window, window, memory_order_relaxed);
+}
+
+uint64_t get_dropped_log_count()
+{
+    return atomic_load_explicit(&state().dropped, memory_order_relaxed);
+}
+
+void log_message(log_level level, const char *format, ...)
+{
+    va_list args;
+    va_start(args, format);
+    log_message_v(level, format, args);
+    va_end(args);
+}
+
+void log_message_v(log_level level, const char *format, va_list args)
+{
+    if (level == log_level::none)
+        return;
+
+    log_text text;
+    const int size =
+        vsnprintf(text.data(), log_text::capacity() + 1, format, args);
+    text.resize(size > 0 ? (size_t)size : 0);
+
+    log_state &s       = state();
+    const uint64_t now = time::now().as_nanoseconds();
+    if (!pass_rate_limit(s, level, text, now))
+        return;
+
+    // Counted until the message is published, so `stop` waits for it. A
+    // producer that sees `running` cleared writes right away instead.
+    atomic_fetch_add_explicit(&s.producers, 1, memory_order_seq_cst);
+    if (!atomic_load_explicit(&s.running, memory_order_seq_cst))
+    {
+        atomic_fetch_sub_explicit(&s.producers, 1, memory_order_release);
+        report_suppressed(s, stderr, now, false);
+        write_line(s, stderr, level, now, text.c_str());
+        return;
+    }
+
+    if (!push(s, level, now, text))
+        atomic_fetch_add_explicit(&s.dropped, 1, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&s.producers, 1, memory_order_release);
+}
+} // namespace zabato
@@ -0,0 +1,85 @@
+#include <zabato/memory_tracking.hpp>
+
+#if defined(ZABATO_MEMORY_TRACKING)
+#include <stdatomic.h>
+
+namespace zabato
+{
+namespace
+{
+struct category_counters
+{
+    atomic_size_t live_bytes;
+    atomic_size_t peak_bytes;
+    atomic_size_t live_allocations;
+    atomic_size_t frame_allocations;
+    atomic_size_t frame_bytes;
+};
+
+// Zero-initialized before any allocator runs, as static storage.
+category_counters g_counters[(size_t)memory_category::count];
+
+category_counters &counters_of(memory_category category)
+{
+    size_t index = (size_t)category;
+    if (index >= (size_t)memory_category::count)
+        index = (size_t)memory_category::containers;
+    return g_counters[index];
+}
+} // namespace
+
+void track_allocation(memory_category category, size_t size)
+{
+    category_counters &c = counters_of(category);
+    const size_t live =
+        atomic_fetch_add_explicit(&c.live_bytes, size, memory_order_relaxed) +
+        size;
+    atomic_fetch_add_explicit(&c.live_allocations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c.frame_allocations, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&c.frame_bytes, size, memory_order_relaxed);
+
+    // Raises the peak, unless another thread raised it further meanwhile.
+    size_t peak = atomic_load_explicit(&c.peak_bytes, memory_order_relaxed);
+    while (peak < live)
+        if (atomic_compare_exchange_weak_explicit(&c.peak_bytes,
+                                                  &peak,
+                                                  live,
+                                                  memory_order_relaxed,
+                                                  memory_order_relaxed))
+            break;
+}
+
+void track_deallocation(memory_category category, size_t size)
+{
+    category_counters &c = counters_of(category);
+    atomic_fetch_sub_explicit(&c.live_bytes, size, memory_order_relaxed);
+    atomic_fetch_sub_explicit(&c.live_allocations, 1, memory_order_relaxed);
+}
+
+memory_stats get_memory_stats(memory_category category)
+{
+    category_counters &c = counters_of(category);
+    memory_stats stats;
+    stats.live_bytes =
+        atomic_load_explicit(&c.live_bytes, memory_order_relaxed);
+    stats.peak_bytes =
+        atomic_load_explicit(&c.peak_bytes, memory_order_relaxed);
+    stats.live_allocations =
+        atomic_load_explicit(&c.live_allocations, memory_order_relaxed);
+    stats.frame_allocations =
+        atomic_load_explicit(&c.frame_allocations, memory_order_relaxed);
+    stats.frame_bytes =
+        atomic_load_explicit(&c.frame_bytes, memory_order_relaxed);
+    return stats;
+}
+
+void reset_frame_memory_stats()
+{
+    for (category_counters &c : g_counters)
+    {
+        atomic_store_explicit(&c.frame_allocations, 0, memory_order_relaxed);
+        atomic_store_explicit(&c.frame_bytes, 0, memory_order_relaxed);
+    }
+}
+} // namespace zabato
+#endif
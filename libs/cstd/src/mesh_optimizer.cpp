@@ -0,0 +1,361 @@
+#include <zabato/mesh_optimizer.hpp>
+#include <zabato/utils.hpp>
+#include <zabato/vector.hpp>
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+
+namespace zabato
+{
+namespace
+{
+constexpr uint16_t no_vertex = UINT16_MAX;
+
+#pragma region Vertex scores
+// The tuning of "Linear-Speed Vertex Cache Optimisation", Tom Forsyth 2006.
+constexpr float cache_decay_power    = 1.5f;
+constexpr float last_primitive_score = 0.75f;
+constexpr float valence_boost_scale  = 2.0f;
+constexpr float valence_boost_power  = 0.5f;
+
+/** @brief Valences past this one score as it does. */
+constexpr size_t max_scored_valence = 32;
+
+struct vertex_scores
+{
+    float cache[vertex_cache_size];
+    float valence[max_scored_valence + 1];
+
+    explicit vertex_scores(size_t primitive_size)
+    {
+        // The vertices of the last primitive get one fixed score, whichever
+        // of them the next primitive shares.
+        for (size_t i = 0; i < vertex_cache_size; ++i)
+        {
+            const float scale = float(vertex_cache_size - primitive_size);
+            cache[i] =
+                i < primitive_size
+                    ? last_primitive_score
+                    : powf(1.0f - float(i - primitive_size) / scale,
+                           cache_decay_power);
+        }
+
+        // Vertices with few primitives left are worth finishing first.
+        valence[0] = 0.0f;
+        for (size_t i = 1; i <= max_scored_valence; ++i)
+            valence[i] =
+                valence_boost_scale * powf(float(i), -valence_boost_power);
+    }
+
+    /**
+     * @param position The position in the cache, -1 if not in it.
+     * @param live The primitives still to draw using the vertex.
+     */
+    float score(int position, size_t live) const
+    {
+        if (live == 0)
+            return -1.0f;
+        const float in_cache = position >= 0 ? cache[position] : 0.0f;
+        return in_cache + valence[min(live, max_scored_valence)];
+    }
+};
+#pragma endregion
+} // namespace
+
+size_t weld_vertices(span<uint8_t> vertices,
+                     size_t stride,
+                     span<uint16_t> indices)
+{
+    assert(stride > 0 && vertices.size() % stride == 0);
+    const size_t count = vertices.size() / stride;
+    if (count == 0)
+        return 0;
+
+    // Sorting by content groups the copies, the first of each group is kept.
+    vector<uint16_t> order;
+    order.resize(count);
+    for (size_t i = 0; i < count; ++i)
+        order[i] = uint16_t(i);
+
+    const uint8_t *data = vertices.data();
+    sort(order.begin(),
+         order.end(),
+         [&](uint16_t a, uint16_t b)
+         {
+             const int c = memcmp(data + a * stride, data + b * stride, stride);
+             return c != 0 ? c < 0 : a < b;
+         });
+
+    vector<uint16_t> kept;
+    kept.resize(count);
+    for (size_t i = 0, first = 0; i < count; ++i)
+    {
+        if (memcmp(data + order[first] * stride,
+                   data + order[i] * stride,
+                   stride) != 0)
+            first = i;
+        kept[order[i]] = order[first];
+    }
+
+    // The kept vertices move down in order, never over one still to move.
+    vector<uint16_t> remap;
+    remap.resize(count);
+    size_t welded = 0;
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (kept[i] != i)
+            continue;
+        if (welded != i)
+            memcpy(vertices.data() + welded * stride,
+                   vertices.data() + i * stride,
+                   stride);
+        remap[i] = uint16_t(welded++);
+    }
+
+    for (uint16_t &index : indices)
+    {
+        assert(index < count);
+        index = remap[kept[index]];
+    }
+    return welded;
+}
+
+size_t remove_degenerate_primitives(span<uint16_t> indices,
+                                    size_t primitive_size)
+{
+    assert(primitive_size >= 1 && primitive_size <= 4);
+    assert(indices.size() % primitive_size == 0);
+
+    const size_t needed = min(primitive_size, size_t(3));
+    size_t kept         = 0;
+    for (size_t i = 0; i < indices.size(); i += primitive_size)
+    {
+        size_t distinct = 0;
+        for (size_t j = 0; j < primitive_size; ++j)
+        {
+            bool repeated = false;
+            for (size_t k = 0; k < j; ++k)
+                repeated |= indices[i + j] == indices[i + k];
+            distinct += !repeated;
+        }
+        if (distinct < needed)
+            continue;
+
+        if (kept != i)
+            memmove(&indices[kept],
+                    &indices[i],
+                    primitive_size * sizeof(uint16_t));
+        kept += primitive_size;
+    }
+    return kept;
+}
+
+void optimize_vertex_cache(span<uint16_t> indices,
+                           size_t primitive_size,
+                           size_t vertex_count)
+{
+    assert(primitive_size >= 3 && primitive_size <= 4);
+    assert(indices.size() % primitive_size == 0);
+    const size_t primitive_count = indices.size() / primitive_size;
+    if (primitive_count < 2)
+        return;
+
+    const vertex_scores scores(primitive_size);
+
+    // The primitives of every vertex, the live ones first.
+    vector<uint32_t> live;
+    live.resize(vertex_count, 0);
+    for (uint16_t index : indices)
+    {
+        assert(index < vertex_count);
+        ++live[index];
+    }
+
+    vector<uint32_t> first_primitive;
+    first_primitive.resize(vertex_count);
+    for (size_t v = 0, offset = 0; v < vertex_count; ++v)
+    {
+        first_primitive[v] = uint32_t(offset);
+        offset += live[v];
+        live[v] = 0;
+    }
+
+    vector<uint32_t> primitives;
+    primitives.resize(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i)
+    {
+        const uint16_t v = indices[i];
+        const uint32_t p = uint32_t(i / primitive_size);
+        primitives[first_primitive[v] + live[v]++] = p;
+    }
+
+    vector<int8_t> position;
+    position.resize(vertex_count, -1);
+    vector<float> vertex_score;
+    vertex_score.resize(vertex_count);
+    for (size_t v = 0; v < vertex_count; ++v)
+        vertex_score[v] = scores.score(-1, live[v]);
+
+    auto primitive_score = [&](size_t p)
+    {
+        float score = 0.0f;
+        for (size_t j = 0; j < primitive_size; ++j)
+            score += vertex_score[indices[p * primitive_size + j]];
+        return score;
+    };
+
+    vector<float> score;
+    score.resize(primitive_count);
+    vector<uint8_t> drawn;
+    drawn.resize(primitive_count, 0);
+    size_t best = 0;
+    for (size_t p = 0; p < primitive_count; ++p)
+    {
+        score[p] = primitive_score(p);
+        if (score[p] > score[best])
+            best = p;
+    }
+
+    vector<uint16_t> output;
+    output.resize(indices.size());
+
+    // The cache, most recent first, with room for the vertices it evicts.
+    uint16_t cache[vertex_cache_size + 4];
+    uint16_t next_cache[vertex_cache_size + 4];
+    size_t cache_count = 0;
+    size_t cursor      = 0;
+
+    for (size_t n = 0; n < primitive_count; ++n)
+    {
+        // Past a dead end, restart from the first primitive left.
+        if (best == SIZE_MAX)
+        {
+            while (drawn[cursor])
+                ++cursor;
+            best = cursor;
+        }
+
+        const uint16_t *vertices = &indices[best * primitive_size];
+        memcpy(&output[n * primitive_size],
+               vertices,
+               primitive_size * sizeof(uint16_t));
+        drawn[best] = 1;
+
+        size_t next_count = 0;
+        for (size_t j = 0; j < primitive_size; ++j)
+        {
+            const uint16_t v = vertices[j];
+            bool repeated    = false;
+            for (size_t k = 0; k < next_count; ++k)
+                repeated |= next_cache[k] == v;
+            if (repeated)
+                continue;
+            next_cache[next_count++] = v;
+
+            // Swap the primitive past the live ones of the vertex.
+            uint32_t *list = primitives.data() + first_primitive[v];
+            for (size_t k = 0; k < live[v]; ++k)
+            {
+                if (list[k] == best)
+                {
+                    swap(list[k], list[live[v] - 1]);
+                    break;
+                }
+            }
+            --live[v];
+        }
+
+        for (size_t i = 0; i < cache_count; ++i)
+        {
+            bool in_primitive = false;
+            for (size_t j = 0; j < primitive_size; ++j)
+                in_primitive |= cache[i] == vertices[j];
+            if (!in_primitive)
+                next_cache[next_count++] = cache[i];
+        }
+
+        for (size_t i = 0; i < next_count; ++i)
+        {
+            const uint16_t v = next_cache[i];
+            position[v]      = i < vertex_cache_size ? int8_t(i) : -1;
+            vertex_score[v]  = scores.score(position[v], live[v]);
+        }
+
+        // Rescore the primitives of the vertices whose score changed, the
+        // best of them is drawn next.
+        best             = SIZE_MAX;
+        float best_score = -1.0f;
+        for (size_t i = 0; i < next_count; ++i)
+        {
+            const uint16_t v     = next_cache[i];
+            const uint32_t *list = primitives.data() + first_primitive[v];
+            for (size_t k = 0; k < live[v]; ++k)
+            {
+                const uint32_t p = list[k];
+                score[p]         = primitive_score(p);
+                if (score[p] > best_score)
+                {
+                    best       = p;
+                    best_score = score[p];
+                }
+            }
+        }
+
+        cache_count = min(next_count, vertex_cache_size);
+        memcpy(cache, next_cache, cache_count * sizeof(uint16_t));
+    }
+
+    memcpy(indices.data(), output.data(), indices.size() * sizeof(uint16_t));
+}
+
+size_t optimize_vertex_fetch(span<uint8_t> vertices,
+                             size_t stride,
+                             span<uint16_t> indices)
+{
+    assert(stride > 0 && vertices.size() % stride == 0);
+    const size_t count = vertices.size() / stride;
+
+    vector<uint16_t> remap;
+    remap.resize(count, no_vertex);
+    size_t used = 0;
+    for (uint16_t &index : indices)
+    {
+        assert(index < count);
+        if (remap[index] == no_vertex)
+            remap[index] = uint16_t(used++);
+        index = remap[index];
+    }
+
+    vector<uint8_t> source;
+    source.assign(vertices.data(), vertices.data() + vertices.size());
+    for (size_t v = 0; v < count; ++v)
+        if (remap[v] != no_vertex)
+            memcpy(vertices.data() + remap[v] * stride,
+                   source.data() + v * stride,
+                   stride);
+    return used;
+}
+
+float vertex_cache_miss_ratio(span<const uint16_t> indices,
+                              size_t primitive_size,
+                              size_t vertex_count,
+                              size_t cache_size)
+{
+    if (indices.size() < primitive_size)
+        return 0.0f;
+
+    // A vertex is cached while fewer than `cache_size` misses followed its
+    // own, which is a FIFO without storing one.
+    vector<size_t> missed_at;
+    missed_at.resize(vertex_count, 0);
+    size_t misses = 0;
+    for (uint16_t index : indices)
+    {
+        assert(index < vertex_count);
+        if (missed_at[index] == 0 || misses + 1 - missed_at[index] > cache_size)
+            missed_at[index] = ++misses;
+    }
+    return float(misses) / float(indices.size() / primitive_size);
+}
+} // namespace zabato
@@ -0,0 +1,248 @@
+#include <zabato/profiler.hpp>
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(ZABATO_PROFILER)
+#include <zabato/thread.hpp>
+#include <zabato/time.hpp>
+
+#include <stdatomic.h>
+
+namespace zabato
+{
+namespace
+{
+/** @brief A zone opening, or closing when `name` is null. */
+struct zone_event
+{
+    symbol *name;
+    uint64_t time;
+};
+
+/** @brief The events a thread may have in flight, a power of two. */
+constexpr size_t ring_size = 16384;
+
+/**
+ * @brief The events of one thread. Only the thread writes `head` and only
+ * the collector writes `tail`, so the ring needs no lock.
+ */
+struct thread_ring
+{
+    zone_event events[ring_size];
+    atomic_size_t head; ///< The next event the thread writes.
+    atomic_size_t tail; ///< The next event the collector reads.
+    uint32_t thread;
+    thread_ring *next;
+
+    // Touched by the thread only.
+    size_t open    = 0; ///< Zones recorded and not closed yet.
+    size_t dropped = 0; ///< Zones left out and not closed yet.
+
+    // Touched by the collector only.
+    size_t collect_head = 0;     ///< `head` when the collect started.
+    vector<symbol *> open_names; ///< Zones open at the last collect.
+};
+
+/** @brief Guards the list of rings, which are never freed. */
+mutex &rings_mutex()
+{
+    static mutex m;
+    return m;
+}
+
+thread_ring *g_rings             = nullptr;
+uint32_t g_ring_count            = 0;
+uint64_t g_frame_start           = time::now().as_nanoseconds();
+thread_local thread_ring *t_ring = nullptr;
+
+thread_ring &current_ring()
+{
+    if (t_ring)
+        return *t_ring;
+
+    thread_ring *ring = new thread_ring();
+    atomic_init(&ring->head, 0);
+    atomic_init(&ring->tail, 0);
+
+    lock_guard lock(rings_mutex());
+    ring->thread = g_ring_count++;
+    ring->next   = g_rings;
+    g_rings      = ring;
+    t_ring       = ring;
+    return *ring;
+}
+
+void push_event(thread_ring &ring, symbol *name)
+{
+    const size_t head = atomic_load_explicit(&ring.head, memory_order_relaxed);
+    ring.events[head % ring_size] = {name, time::now().as_nanoseconds()};
+    atomic_store_explicit(&ring.head, head + 1, memory_order_release);
+}
+
+/** @brief Appends the zones of one ring to the frame. */
+void collect_ring(thread_ring &ring, profile_frame &out, uint64_t end)
+{
+    vector<uint32_t> open;
+    auto open_zone = [&](symbol *name, uint64_t start)
+    {
+        const uint32_t parent = open.empty() ? no_parent_zone : open.back();
+        open.push_back(uint32_t(out.zones.size()));
+        out.zones.push_back(
+            {name, ring.thread, uint32_t(open.size() - 1), parent, start, 0});
+    };
+
+    // Zones open since an earlier frame continue from this one's start.
+    for (symbol *name : ring.open_names)
+        open_zone(name, out.start);
+
+    size_t tail = atomic_load_explicit(&ring.tail, memory_order_relaxed);
+    for (; tail != ring.collect_head; ++tail)
+    {
+        const zone_event &event = ring.events[tail % ring_size];
+        if (event.name)
+        {
+            open_zone(event.name, event.time);
+            ring.open_names.push_back(event.name);
+        }
+        else if (!open.empty())
+        {
+            profile_zone &zone = out.zones[open.back()];
+            zone.duration      = event.time - zone.start;
+            open.pop_back();
+            ring.open_names.pop_back();
+        }
+    }
+    atomic_store_explicit(&ring.tail, tail, memory_order_release);
+
+    for (uint32_t index : open)
+        out.zones[index].duration = end - out.zones[index].start;
+}
+} // namespace
+
+void begin_profile_zone(symbol *name)
+{
+    thread_ring &ring = current_ring();
+
+    // Leave room for the end of this zone and of every zone still open, so
+    // closing a zone always finds room.
+    const size_t head = atomic_load_explicit(&ring.head, memory_order_relaxed);
+    const size_t tail = atomic_load_explicit(&ring.tail, memory_order_acquire);
+    if (ring.dropped > 0 || ring_size - (head - tail) < ring.open + 2)
+    {
+        ++ring.dropped;
+        return;
+    }
+
+    push_event(ring, name);
+    ++ring.open;
+}
+
+void end_profile_zone()
+{
+    thread_ring &ring = current_ring();
+    if (ring.dropped > 0)
+    {
+        --ring.dropped;
+        return;
+    }
+    if (ring.open == 0)
+        return;
+
+    push_event(ring, nullptr);
+    --ring.open;
+}
+
+void collect_profile_frame(profile_frame &out)
+{
+    lock_guard lock(rings_mutex());
+
+    // The events up to these heads were written before `end`.
+    for (thread_ring *ring = g_rings; ring; ring = ring->next)
+        ring->collect_head =
+            atomic_load_explicit(&ring->head, memory_order_acquire);
+    const uint64_t end = time::now().as_nanoseconds();
+
+    out.start    = g_frame_start;
+    out.duration = end - g_frame_start;
+    out.zones.clear();
+    for (thread_ring *ring = g_rings; ring; ring = ring->next)
+        collect_ring(*ring, out, end);
+
+    g_frame_start = end;
+}
+} // namespace zabato
+#endif
+
+namespace zabato
+{
+namespace
+{
+void write_text(stream &out, const char *text, size_t length)
+{
+    buffer data((uint8_t *)text, length);
+    out.write(data);
+}
+
+/** @brief Writes `text` as the contents of a JSON string. */
+void write_json_string(stream &out, const char *text)
+{
+    const char *run = text;
+    for (const char *at = text; *at; ++at)
+    {
+        if (*at != '"' && *at != '\\' && (unsigned char)*at >= 0x20)
+            continue;
+
+        char escape[8];
+        const int length = snprintf(escape,
+                                    sizeof(escape),
+                                    *at == '"' || *at == '\\' ? "\\%c"
+                                                              : "\\u%04x",
+                                    *at == '"' || *at == '\\'
+                                        ? *at
+                                        : (unsigned char)*at);
+        write_text(out, run, size_t(at - run));
+        write_text(out, escape, size_t(length));
+        run = at + 1;
+    }
+    write_text(out, run, strlen(run));
+}
+} // namespace
+
+void write_chrome_trace(span<const profile_frame> frames, stream &out)
+{
+    const uint64_t origin = frames.empty() ? 0 : frames[0].start;
+    auto micros = [origin](uint64_t ns) { return double(ns - origin) / 1e3; };
+
+    char line[160];
+    const char *separator = "\n";
+    write_text(out, "{\"traceEvents\":[", 16);
+    for (const profile_frame &frame : frames)
+    {
+        // Frame boundaries as global instant events.
+        int length = snprintf(line,
+                              sizeof(line),
+                              "%s{\"name\":\"frame\",\"ph\":\"i\",\"s\":\"g\","
+                              "\"ts\":%.3f,\"pid\":0,\"tid\":0}",
+                              separator,
+                              micros(frame.start));
+        write_text(out, line, size_t(length));
+        separator = ",\n";
+
+        for (const profile_zone &zone : frame.zones)
+        {
+            write_text(out, ",\n{\"name\":\"", 11);
+            write_json_string(out, get_symbol_name(zone.name));
+            length = snprintf(line,
+                              sizeof(line),
+                              "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                              "\"pid\":0,\"tid\":%u}",
+                              micros(zone.start),
+                              double(zone.duration) / 1e3,
+                              zone.thread);
+            write_text(out, line, size_t(length));
+        }
+    }
+    write_text(out, "\n]}\n", 4);
+}
+} // namespace zabato
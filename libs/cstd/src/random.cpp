@@ -29,7 +29,7 @@ void random::buf(void *buf, size_t size)
         if (rand_s(&r) == 0)
             p[i] = (uint8_t)r;
         else
-            p[i] = (uint8_t)(rand() & 0xFF);
+            p[i] = (uint8_t)(::rand() & 0xFF);
     }
 #else
     static FILE *f = fopen("/dev/urandom", "rb");
@@ -43,10 +43,16 @@ void random::buf(void *buf, size_t size)
     if (!seeded)
     {
         for (size_t i = 0; i < size; i++)
-            p[i] = (uint8_t)rand();
+            p[i] = (uint8_t)::rand();
     }
 #endif
 }
 
 void random::buf(buffer &b) { buf(b.data(), b.size()); }
+
+random_engine &random::local()
+{
+    thread_local random_engine engine(rand());
+    return engine;
+}
 } // namespace zabato
\ No newline at end of file
@@ -1,22 +1,32 @@
 #include <assert.h>
+#include <stdatomic.h>
 #include <string.h>
 #include <zabato/hash_set.hpp>
 #include <zabato/string.hpp>
 #include <zabato/symbol.hpp>
+#include <zabato/thread.hpp>
 
 namespace zabato
 {
+/**
+ * Reference count of permanent symbols. Counts at or above it are never
+ * changed again, so references taken before a symbol became permanent can
+ * still be released.
+ */
+static const size_t permanent_ref_count = ((size_t)-1) >> 1;
+
 struct symbol
 {
     uint32_t hash;
     size_t length;
-    size_t ref_count;
+    atomic_size_t ref_count;
     char chars[];
 };
 
 struct symbol_lookup_key
 {
     const char *str;
+    size_t length;
     uint32_t hash;
 };
 
@@ -40,53 +50,118 @@ struct symbol_key_equal
 
     bool operator()(const symbol *a, const symbol_lookup_key &lookup) const
     {
-        if (a->hash != lookup.hash || a->length != strlen(lookup.str))
+        if (a->hash != lookup.hash || a->length != lookup.length)
             return false;
         return memcmp(a->chars, lookup.str, a->length) == 0;
     }
 };
 
-static hash_set<symbol *, symbol_hasher, symbol_key_equal> g_symbol_table;
+/**
+ * One lock and table per slice of the hash range, so threads interning
+ * different names rarely wait on each other.
+ */
+struct symbol_shard
+{
+    mutex lock;
+    hash_set<symbol *, symbol_hasher, symbol_key_equal> table;
+};
 
-symbol *get_symbol(const char *name)
+static const uint32_t symbol_shard_bits  = 4;
+static const uint32_t symbol_shard_count = 1u << symbol_shard_bits;
+
+/**
+ * The shards are built on first use, since RTTI objects intern their names
+ * during static initialization of other translation units.
+ */
+static symbol_shard &shard_of(uint32_t hash)
+{
+    static symbol_shard shards[symbol_shard_count];
+    return shards[hash >> (32 - symbol_shard_bits)];
+}
+
+static symbol_lookup_key make_key(const char *name)
 {
     if (name == nullptr)
         name = "";
 
-    size_t length = strlen(name);
-
+    const size_t length = strlen(name);
     hash<const char *> hasher;
-    uint32_t hash = hasher(name, length);
+    return {name, length, (uint32_t)hasher(name, length)};
+}
 
-    symbol_lookup_key lookup{name, hash};
-    symbol *existing_symbol = nullptr;
+static bool is_permanent(size_t ref_count)
+{
+    return ref_count >= permanent_ref_count;
+}
 
-    if (g_symbol_table.try_get(lookup, existing_symbol))
+/** @brief Finds or creates a symbol, with the shard locked. */
+static symbol *intern(symbol_shard &shard,
+                      const symbol_lookup_key &lookup,
+                      size_t ref_count)
+{
+    symbol *existing_symbol = nullptr;
+    if (shard.table.try_get(lookup, existing_symbol))
     {
-        existing_symbol->ref_count++;
+        // Only released under this lock, so it cannot reach zero meanwhile.
+        if (ref_count == permanent_ref_count)
+            atomic_store_explicit(&existing_symbol->ref_count,
+                                  permanent_ref_count,
+                                  memory_order_relaxed);
+        else
+            ref_symbol(existing_symbol);
         return existing_symbol;
     }
 
-    size_t alloc_size = sizeof(symbol) + length + 1;
+    size_t alloc_size = sizeof(symbol) + lookup.length + 1;
     symbol *new_sym   = static_cast<symbol *>(malloc(alloc_size));
     if (!new_sym)
         return nullptr;
 
-    new_sym->hash      = hash;
-    new_sym->length    = length;
-    new_sym->ref_count = 1;
-    memcpy(new_sym->chars, name, length + 1);
+    new_sym->hash   = lookup.hash;
+    new_sym->length = lookup.length;
+    atomic_init(&new_sym->ref_count, ref_count);
+    memcpy(new_sym->chars, lookup.str, lookup.length);
+    new_sym->chars[lookup.length] = '\0';
 
-    g_symbol_table.add(new_sym);
+    shard.table.add(new_sym);
     return new_sym;
 }
 
+symbol *get_symbol(const char *name)
+{
+    const symbol_lookup_key lookup = make_key(name);
+    symbol_shard &shard            = shard_of(lookup.hash);
+
+    lock_guard lock(shard.lock);
+    return intern(shard, lookup, 1);
+}
+
+symbol *get_permanent_symbol(const char *name)
+{
+    const symbol_lookup_key lookup = make_key(name);
+    symbol_shard &shard            = shard_of(lookup.hash);
+
+    lock_guard lock(shard.lock);
+    return intern(shard, lookup, permanent_ref_count);
+}
+
+symbol *find_symbol(const char *name)
+{
+    const symbol_lookup_key lookup = make_key(name);
+    symbol_shard &shard            = shard_of(lookup.hash);
+    symbol *existing_symbol        = nullptr;
+
+    lock_guard lock(shard.lock);
+    if (shard.table.try_get(lookup, existing_symbol))
+        return existing_symbol;
+    return nullptr;
+}
+
 symbol *ref_symbol(symbol *s)
 {
-    if (s)
-    {
-        s->ref_count++;
-    }
+    if (s && !is_permanent(atomic_load_explicit(&s->ref_count,
+                                                memory_order_relaxed)))
+        atomic_fetch_add_explicit(&s->ref_count, 1, memory_order_relaxed);
     return s;
 }
 
@@ -95,10 +170,35 @@ void release_symbol(symbol *s)
     if (!s)
         return;
 
-    s->ref_count--;
-    if (s->ref_count == 0)
+    // Drop references that cannot be the last one without locking.
+    size_t count = atomic_load_explicit(&s->ref_count, memory_order_relaxed);
+    while (count > 1)
+    {
+        if (is_permanent(count))
+            return;
+        if (atomic_compare_exchange_weak_explicit(&s->ref_count,
+                                                  &count,
+                                                  count - 1,
+                                                  memory_order_release,
+                                                  memory_order_relaxed))
+            return;
+    }
+
+    // The last reference is dropped under the lock, so `get_symbol` cannot
+    // hand the symbol out again while it is being freed.
+    symbol_shard &shard = shard_of(s->hash);
+    lock_guard lock(shard.lock);
+
+    // Symbols only become permanent under this lock.
+    if (is_permanent(
+            atomic_load_explicit(&s->ref_count, memory_order_relaxed)))
+        return;
+
+    count = atomic_fetch_sub_explicit(&s->ref_count, 1, memory_order_acq_rel);
+    assert(count > 0);
+    if (count == 1)
     {
-        g_symbol_table.remove(s);
+        shard.table.remove(s);
         free(s);
     }
 }
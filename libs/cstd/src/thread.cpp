@@ -0,0 +1,141 @@
+#include <zabato/thread.hpp>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <errno.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+namespace zabato
+{
+#ifdef _WIN32
+unsigned long __stdcall thread::trampoline(void *self)
+{
+    run(static_cast<thread *>(self));
+    return 0;
+}
+#else
+void *thread::trampoline(void *self)
+{
+    run(static_cast<thread *>(self));
+    return nullptr;
+}
+#endif
+
+bool thread::start(entry_point entry, void *arg)
+{
+    if (m_running || !entry)
+        return false;
+
+    m_entry = entry;
+    m_arg   = arg;
+
+#ifdef _WIN32
+    m_handle  = CreateThread(nullptr, 0, trampoline, this, 0, nullptr);
+    m_running = m_handle != nullptr;
+#else
+    m_running = pthread_create(&m_handle, nullptr, trampoline, this) == 0;
+#endif
+    return m_running;
+}
+
+void thread::join()
+{
+    if (!m_running)
+        return;
+
+#ifdef _WIN32
+    WaitForSingleObject(m_handle, INFINITE);
+    CloseHandle(m_handle);
+    m_handle = nullptr;
+#else
+    pthread_join(m_handle, nullptr);
+#endif
+    m_running = false;
+}
+
+uint32_t thread::hardware_concurrency()
+{
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (uint32_t)count : 1;
+#endif
+}
+
+void thread::yield()
+{
+#ifdef _WIN32
+    SwitchToThread();
+#else
+    sched_yield();
+#endif
+}
+
+void thread::sleep_for(uint64_t nanoseconds)
+{
+#ifdef _WIN32
+    Sleep((DWORD)((nanoseconds + 999999) / 1000000));
+#else
+    timespec duration;
+    duration.tv_sec  = (time_t)(nanoseconds / 1000000000);
+    duration.tv_nsec = (long)(nanoseconds % 1000000000);
+    // Signals cut the sleep short, leaving the rest in `duration`.
+    while (nanosleep(&duration, &duration) != 0 && errno == EINTR)
+    {
+    }
+#endif
+}
+
+#ifdef _WIN32
+mutex::mutex() {}
+mutex::~mutex() {}
+void mutex::lock() { AcquireSRWLockExclusive((PSRWLOCK)&m_handle); }
+void mutex::unlock() { ReleaseSRWLockExclusive((PSRWLOCK)&m_handle); }
+
+condition_variable::condition_variable() {}
+condition_variable::~condition_variable() {}
+
+void condition_variable::wait(mutex &mutex)
+{
+    SleepConditionVariableSRW(
+        (PCONDITION_VARIABLE)&m_handle, (PSRWLOCK)&mutex.m_handle, INFINITE, 0);
+}
+
+void condition_variable::notify_one()
+{
+    WakeConditionVariable((PCONDITION_VARIABLE)&m_handle);
+}
+
+void condition_variable::notify_all()
+{
+    WakeAllConditionVariable((PCONDITION_VARIABLE)&m_handle);
+}
+#else
+mutex::mutex() { pthread_mutex_init(&m_handle, nullptr); }
+mutex::~mutex() { pthread_mutex_destroy(&m_handle); }
+void mutex::lock() { pthread_mutex_lock(&m_handle); }
+void mutex::unlock() { pthread_mutex_unlock(&m_handle); }
+
+condition_variable::condition_variable()
+{
+    pthread_cond_init(&m_handle, nullptr);
+}
+
+condition_variable::~condition_variable() { pthread_cond_destroy(&m_handle); }
+
+void condition_variable::wait(mutex &mutex)
+{
+    pthread_cond_wait(&m_handle, &mutex.m_handle);
+}
+
+void condition_variable::notify_one() { pthread_cond_signal(&m_handle); }
+void condition_variable::notify_all() { pthread_cond_broadcast(&m_handle); }
+#endif
+} // namespace zabato
@@ -20,8 +20,9 @@ uuid uuid::generate()
     p[4]       = (ms >> 8) & 0xFF;
     p[5]       = ms & 0xFF;
 
-    // Randomness (10 bytes: 6-15)
-    random::buf(p + 6, 10);
+    // Randomness (10 bytes: 6-15), from the thread's engine rather than the
+    // OS, since every object gets a UUID.
+    random::local().fill(p + 6, 10);
 
     // Set Version (0111 = 7) in byte 6 high nibble
     p[6] = (p[6] & 0x0F) | 0x70;
@@ -4,4 +4,25 @@ target("cstd")
     set_languages("c++23")
     add_includedirs("include", {public = true})
     add_files("src/*.cpp")
-    add_deps("berg")
\ No newline at end of file
+    add_deps("berg")
+
+    if has_config("memory_tracking") then
+        add_defines("ZABATO_MEMORY_TRACKING", {public = true})
+    end
+
+    if has_config("profiler") then
+        add_defines("ZABATO_PROFILER", {public = true})
+    end
+
+    local log_levels = {none = 0, error = 1, warning = 2, info = 3, trace = 4}
+    local log_level = log_levels[get_config("log_level") or "info"] or 3
+    add_defines("ZABATO_LOG_LEVEL=" .. log_level, {public = true})
+
+    if not is_plat("windows") then
+        add_syslinks("pthread", {public = true})
+    end
+
+    -- http_ice_fs fetches with the Fetch API and caches in IndexedDB.
+    if is_plat("wasm") then
+        add_ldflags("-sFETCH=1", "-sASYNCIFY=1", {public = true})
+    end
@@ -0,0 +1,46 @@
+#include <zabato/scene_file.hpp>
+#include <zabato/stream.hpp>
+
+#include <stdio.h>
+#include <tinyxml2.h>
+
+using namespace zabato;
+
+// Compiles an XML scene, as `xml_serializer` saves it, into a SCEN chunk
+// `resource_manager` loads as a `scene_file`:
+//
+//   zabato_scene input.xml output.ice
+
+int main(int argc, char **argv)
+{
+    if (argc != 3)
+    {
+        fprintf(stderr, "usage: %s input.xml output.ice\n", argv[0]);
+        return 2;
+    }
+
+    tinyxml2::XMLDocument doc;
+    if (doc.LoadFile(argv[1]) != tinyxml2::XML_SUCCESS || !doc.RootElement())
+    {
+        fprintf(stderr, "%s: not an XML scene\n", argv[1]);
+        return 1;
+    }
+
+    FILE *file = fopen(argv[2], "wb");
+    if (!file)
+    {
+        fprintf(stderr, "%s: cannot open for writing\n", argv[2]);
+        return 1;
+    }
+
+    file_stream out(file);
+    ice_writer writer(out);
+    const result<void> compiled = compile_scene(*doc.RootElement(), writer);
+    fclose(file);
+    if (compiled.has_error())
+    {
+        remove(argv[2]);
+        return 1;
+    }
+    return 0;
+}
@@ -2,9 +2,14 @@
 
 #include <stddef.h>
 #include <zabato/error.hpp>
+#include <zabato/hash_map.hpp>
 #include <zabato/ice.hpp>
 #include <zabato/math.hpp>
 #include <zabato/mesh.hpp>
+#include <zabato/resource.hpp>
+#include <zabato/shared_ptr.hpp>
+#include <zabato/symbol.hpp>
+#include <zabato/thread.hpp>
 
 namespace zabato
 {
@@ -38,6 +43,32 @@ struct animation_node
     const bone_info *bone;
 };
 
+/**
+ * @struct track_cursor
+ * @brief Remembers the last keyframe segment sampled on each curve of a track.
+ *
+ * Owned by whoever plays the track (one per animator and channel), so that
+ * monotonic playback resolves keys in amortized O(1). Seeking backwards or
+ * jumping ahead falls back to a binary search.
+ */
+struct track_cursor
+{
+    size_t position = 0;
+    size_t rotation = 0;
+    size_t scale    = 0;
+};
+
+/**
+ * @struct key_tolerance
+ * @brief The largest error keyframe reduction may introduce, per curve.
+ */
+struct key_tolerance
+{
+    real position = real(1) / ICE_SCALE; ///< Distance, in model units.
+    real rotation = real(0.005);         ///< Angle, in radians.
+    real scale    = real(1) / ICE_SCALE; ///< Per-axis scale difference.
+};
+
 struct animation_track
 {
     vector<key_position> positions;
@@ -51,83 +82,146 @@ struct animation_track
     {
         real midway_length = animation_time - last_timestamp;
         real frames_diff   = next_timestamp - last_timestamp;
-        return frames_diff == real(0) ? real(0) : midway_length / frames_diff;
+        return frames_diff == real(0)
+                   ? real(0)
+                   : clamp(midway_length / frames_diff, real(0), real(1));
     }
 
-    mat4<real> interpolate_position(real animation_time)
+    /**
+     * @brief Finds the segment `[i, i + 1]` of `keys` that brackets `time`.
+     *
+     * Checks the cursor's segment and the one after it first, then falls back
+     * to a binary search. Times before the first key resolve to segment 0 and
+     * times after the last key to the final segment.
+     *
+     * @param keys The keys to search, at least two, sorted by timestamp.
+     * @param time The animation time to look up.
+     * @param[in,out] cursor The segment found by the previous lookup.
+     * @return The index of the first key of the segment.
+     */
+    template <typename Key>
+    static size_t find_key(const vector<Key> &keys, real time, size_t &cursor)
     {
-        if (positions.size() <= 1)
-            return mat4_translation(positions.empty()
-                                        ? vec3<real>(0)
-                                        : (vec3<real>)positions[0].position);
+        const size_t last = keys.size() - 2;
+        size_t i          = min(cursor, last);
+
+        if (time >= real(keys[i].timestamp))
+        {
+            if (i == last || time < real(keys[i + 1].timestamp))
+                return cursor = i;
+            if (i + 1 == last || time < real(keys[i + 2].timestamp))
+                return cursor = i + 1;
+        }
 
-        size_t p0_index = 0;
-        for (size_t i = 0; i < positions.size() - 1; ++i)
+        // First key strictly after `time`, searched in [1, last + 1].
+        size_t lo = 1, hi = last + 1;
+        while (lo < hi)
         {
-            if (animation_time < positions[i + 1].timestamp)
-            {
-                p0_index = i;
-                break;
-            }
+            size_t mid = lo + (hi - lo) / 2;
+            if (time < real(keys[mid].timestamp))
+                hi = mid;
+            else
+                lo = mid + 1;
         }
+        return cursor = min(lo - 1, last);
+    }
+
+    mat4<real> interpolate_position(real animation_time)
+    {
+        size_t cursor = 0;
+        return interpolate_position(animation_time, cursor);
+    }
 
-        size_t p1_index      = p0_index + 1;
-        real factor          = get_scale_factor(positions[p0_index].timestamp,
+    mat4<real> interpolate_position(real animation_time, size_t &cursor)
+    {
+        return mat4_translation(sample_position(animation_time, cursor));
+    }
+
+    mat4<real> interpolate_rotation(real animation_time)
+    {
+        size_t cursor = 0;
+        return interpolate_rotation(animation_time, cursor);
+    }
+
+    mat4<real> interpolate_rotation(real animation_time, size_t &cursor)
+    {
+        return mat4_from_quat(sample_rotation(animation_time, cursor));
+    }
+
+    mat4<real> interpolate_scaling(real animation_time)
+    {
+        size_t cursor = 0;
+        return interpolate_scaling(animation_time, cursor);
+    }
+
+    mat4<real> interpolate_scaling(real animation_time, size_t &cursor)
+    {
+        return mat4_scaling(sample_scale(animation_time, cursor));
+    }
+
+    /** @return The interpolated position at `animation_time`. */
+    vec3<real> sample_position(real animation_time, size_t &cursor) const
+    {
+        if (positions.size() <= 1)
+            return positions.empty() ? vec3<real>(0)
+                                     : (vec3<real>)positions[0].position;
+
+        size_t p0_index = find_key(positions, animation_time, cursor);
+        size_t p1_index = p0_index + 1;
+        real factor     = get_scale_factor(positions[p0_index].timestamp,
                                        positions[p1_index].timestamp,
                                        animation_time);
-        vec3<real> final_pos = lerp<vec3<real>>(
+        return lerp<vec3<real>>(
             positions[p0_index].position, positions[p1_index].position, factor);
-        return mat4_translation(final_pos);
     }
 
-    mat4<real> interpolate_rotation(real animation_time)
+    /** @return The interpolated rotation at `animation_time`. */
+    quat<real> sample_rotation(real animation_time, size_t &cursor) const
     {
         if (rotations.size() <= 1)
-            return mat4_from_quat(normalize(
-                rotations.empty() ? quat<real>()
-                                  : (quat<real>)rotations[0].rotation));
+            return normalize(rotations.empty()
+                                 ? quat<real>()
+                                 : (quat<real>)rotations[0].rotation);
 
-        size_t r0_index = 0;
-        for (size_t i = 0; i < rotations.size() - 1; ++i)
-        {
-            if (animation_time < rotations[i + 1].timestamp)
-            {
-                r0_index = i;
-                break;
-            }
-        }
-
-        size_t r1_index      = r0_index + 1;
-        real factor          = get_scale_factor(rotations[r0_index].timestamp,
+        size_t r0_index = find_key(rotations, animation_time, cursor);
+        size_t r1_index = r0_index + 1;
+        real factor     = get_scale_factor(rotations[r0_index].timestamp,
                                        rotations[r1_index].timestamp,
                                        animation_time);
-        quat<real> final_rot = slerp<real>(
+        return slerp<real>(
             rotations[r0_index].rotation, rotations[r1_index].rotation, factor);
-        return mat4_from_quat(final_rot);
     }
 
-    mat4<real> interpolate_scaling(real animation_time)
+    /** @return The interpolated scale at `animation_time`. */
+    vec3<real> sample_scale(real animation_time, size_t &cursor) const
     {
         if (scales.size() <= 1)
-            return mat4_scaling(scales.empty() ? vec3<real>(1)
-                                               : (vec3<real>)scales[0].scale);
+            return scales.empty() ? vec3<real>(1) : (vec3<real>)scales[0].scale;
 
-        size_t s0_index = 0;
-        for (size_t i = 0; i < scales.size() - 1; ++i)
-        {
-            if (animation_time < scales[i + 1].timestamp)
-            {
-                s0_index = i;
-                break;
-            }
-        }
-        size_t s1_index        = s0_index + 1;
-        real factor            = get_scale_factor(scales[s0_index].timestamp,
+        size_t s0_index = find_key(scales, animation_time, cursor);
+        size_t s1_index = s0_index + 1;
+        real factor     = get_scale_factor(scales[s0_index].timestamp,
                                        scales[s1_index].timestamp,
                                        animation_time);
-        vec3<real> final_scale = lerp<vec3<real>>(
+        return lerp<vec3<real>>(
             scales[s0_index].scale, scales[s1_index].scale, factor);
-        return mat4_scaling(final_scale);
+    }
+
+    /**
+     * @brief Drops the keys that interpolating their neighbours reproduces
+     * within `tolerance`, and collapses constant curves to a single key.
+     *
+     * Errors are measured on the decoded 16-bit values, so the result plays
+     * back exactly as the reduced keys will after serialization.
+     */
+    void reduce(const key_tolerance &tolerance);
+
+    /** @return The bytes used by the keys of this track. */
+    size_t get_key_bytes() const
+    {
+        return positions.size() * sizeof(key_position) +
+               rotations.size() * sizeof(key_rotation) +
+               scales.size() * sizeof(key_scale);
     }
 };
 
@@ -140,13 +234,62 @@ struct anim_bone
 
     void update(real animation_time)
     {
-        mat4<real> translation = track.interpolate_position(animation_time);
-        mat4<real> rotation    = track.interpolate_rotation(animation_time);
-        mat4<real> scale       = track.interpolate_scaling(animation_time);
-        local_transform        = translation * rotation * scale;
+        track_cursor cursor;
+        update(animation_time, cursor);
+    }
+
+    void update(real animation_time, track_cursor &cursor)
+    {
+        mat4<real> translation =
+            track.interpolate_position(animation_time, cursor.position);
+        mat4<real> rotation =
+            track.interpolate_rotation(animation_time, cursor.rotation);
+        mat4<real> scale =
+            track.interpolate_scaling(animation_time, cursor.scale);
+        local_transform = translation * rotation * scale;
     }
 };
 
+/**
+ * @struct bone_pose
+ * @brief The local transform of one bone, kept decomposed for blending.
+ */
+struct bone_pose
+{
+    vec3<real> position = vec3<real>(0);
+    quat<real> rotation = quat<real>();
+    vec3<real> scale    = vec3<real>(1);
+    bool animated       = false; ///< Whether any blended clip drives it.
+};
+
+/**
+ * @struct animation_binding
+ * @brief The result of matching an animation against a mesh skeleton.
+ *
+ * Built once per (mesh skeleton, animation) pair and shared by every animator
+ * playing that pair.
+ */
+struct animation_binding
+{
+    /** @brief Channel index per mesh bone id, or -1 for unanimated bones. */
+    vector<int32_t> remap;
+    /** @brief The node hierarchy with `bone` resolved against the mesh. */
+    animation_node root;
+    /** @brief The `mesh::get_skeleton_id()` this binding was built for. */
+    uint32_t skeleton_id = 0;
+    /** @brief The node transform of each mesh bone id, decomposed. */
+    vector<bone_pose> rest;
+};
+
+/**
+ * @struct animation_pose
+ * @brief An evaluated bone palette, shared by instanced animators.
+ */
+struct animation_pose
+{
+    vector<mat4<real>> matrices;
+};
+
 /**
  * @class animation
  * @brief An animation clip resource, containing keyframe data for a skeleton.
@@ -159,7 +302,10 @@ public:
     /** @brief Constructs a new, empty animation object. */
     animation() {}
     /** @brief Destroys the animation and releases all its keyframe data. */
-    ~animation() {}
+    ~animation() { clear_bone_index(); }
+
+    animation(const animation &)            = delete;
+    animation &operator=(const animation &) = delete;
 
     /** @return The total duration of the animation in ticks. */
     real get_duration() const { return m_duration; }
@@ -178,6 +324,7 @@ public:
             auto &track = tracks[i];
             bone.track  = track;
         }
+        rebuild_bone_index();
     }
 
     void set_global_inverse_transform(const mat4<real> &transform)
@@ -193,15 +340,41 @@ public:
         return m_global_inverse_transform;
     }
 
+    /** @return The root of the node hierarchy the tracks are applied to. */
+    const animation_node &get_root_node() const { return m_root_node; }
+
+    /**
+     * @brief Runs keyframe reduction on every channel, usually at pack time.
+     * @see animation_track::reduce
+     */
+    void reduce_keys(const key_tolerance &tolerance)
+    {
+        for (auto &channel : m_channels)
+            channel.track.reduce(tolerance);
+    }
+
+    /** @return The bytes used by the keys of every channel. */
+    size_t get_key_bytes() const
+    {
+        size_t bytes = 0;
+        for (const auto &channel : m_channels)
+            bytes += channel.track.get_key_bytes();
+        return bytes;
+    }
+
+    /**
+     * @return The memory held by the clip in bytes: the keys, the node
+     * hierarchy and the bindings and poses cached for its animators.
+     */
+    size_t get_memory_used() const;
+
+    /** @brief Adds the memory of the clip to the cost of its owner. */
+    void add_cost(scene_cost &cost) const { cost.memory += get_memory_used(); }
+
     anim_bone *find_bone(const char *name)
     {
-        for (size_t i = 0; i < m_channels.size(); ++i)
-        {
-            auto &b = m_channels[i];
-            if (b.track.bone_name == name)
-                return &b;
-        }
-        return nullptr;
+        ptrdiff_t index = find_bone_index(name);
+        return index < 0 ? nullptr : &m_channels[index];
     }
 
     anim_bone *find_bone_by_id(int16_t id)
@@ -212,17 +385,55 @@ public:
         return nullptr;
     }
 
-    ptrdiff_t find_bone_index(const char *name)
+    /**
+     * @brief Finds the channel animating a bone, through the hashed index.
+     * @param name The bone name.
+     * @return The channel index, or -1 if no channel animates the bone.
+     */
+    ptrdiff_t find_bone_index(const char *name) const
     {
-        for (size_t i = 0; i < m_channels.size(); ++i)
-        {
-            auto &b = m_channels[i];
-            if (b.track.bone_name == name)
-                return i;
-        }
-        return -1;
+        // A name that was never interned cannot be in the index.
+        const symbol *s = find_symbol(name);
+        return s ? find_bone_index(s) : -1;
     }
 
+    /** @copydoc find_bone_index(const char *) const */
+    ptrdiff_t find_bone_index(const symbol *name) const
+    {
+        uint16_t index = 0;
+        if (!m_bone_index.try_get_value(name, index))
+            return -1;
+        return index;
+    }
+
+    /**
+     * @brief Matches this animation against a mesh skeleton.
+     *
+     * The result is cached per skeleton, so repeated calls for the same mesh
+     * only cost a hash lookup. The cache is dropped when the tracks change,
+     * and bindings no animator references are swept as it grows. Safe to
+     * call from several threads at once.
+     *
+     * @param mesh_ref The mesh whose bones will be animated.
+     * @return The shared binding, never null.
+     */
+    shared_ptr<const animation_binding> bind(const mesh &mesh_ref) const;
+
+    /**
+     * @brief Looks up a pose evaluated by an instanced animator.
+     * @param key The pose key, see `animator::set_instancing`.
+     * @return The shared pose, or null if nobody evaluated it yet.
+     */
+    shared_ptr<const animation_pose> find_pose(uint64_t key) const;
+
+    /**
+     * @brief Publishes an evaluated pose for other instanced animators.
+     *
+     * Poses only live while an animator references them, unreferenced ones
+     * are swept as the cache grows.
+     */
+    void add_pose(uint64_t key, const shared_ptr<const animation_pose> &pose);
+
 private:
     template <typename T>
     friend result<void> serialize(ice_writer &writer, const T &a);
@@ -230,11 +441,86 @@ private:
     template <typename T>
     friend result<void> deserialize(ice_reader &reader, T &m);
 
+    /** @brief Re-interns the channel bone names and drops cached bindings. */
+    void rebuild_bone_index()
+    {
+        clear_bone_index();
+        for (size_t i = 0; i < m_channels.size(); ++i)
+        {
+            symbol *name = get_symbol(m_channels[i].track.bone_name.c_str());
+            if (!m_bone_index.add(name, (uint16_t)i))
+                release_symbol(name); // Duplicate name, first channel wins.
+        }
+    }
+
+    void clear_bone_index()
+    {
+        for (auto &entry : m_bone_index)
+            release_symbol(const_cast<symbol *>(entry.key));
+        m_bone_index.clear();
+
+        lock_guard lock(m_cache_lock);
+        m_bindings.clear();
+        m_poses.clear();
+    }
+
     real m_duration         = real(0);
     real m_ticks_per_second = real(25);
     animation_node m_root_node;
     vector<anim_bone> m_channels;
     mat4<real> m_global_inverse_transform = mat4<real>::identity();
+
+    // Interned bone name to channel index, each key holds a symbol reference.
+    hash_map<const symbol *, uint16_t, symbol_ptr_hasher> m_bone_index;
+    // Guards the binding and pose caches, which animators on parallel
+    // controller groups fill concurrently.
+    mutable mutex m_cache_lock;
+    // Bindings keyed by mesh::get_skeleton_id(). Skeleton ids are never
+    // reused, so the binding of a destroyed mesh is never looked up again and
+    // only waits for a sweep.
+    mutable hash_map<uint32_t, shared_ptr<const animation_binding>>
+        m_bindings;
+    mutable size_t m_binding_sweep_size = 16;
+    // Shared poses keyed by skeleton id and quantized frame.
+    hash_map<uint64_t, shared_ptr<const animation_pose>> m_poses;
+    size_t m_pose_sweep_size = 16;
+};
+
+/**
+ * @struct animator_update_policy
+ * @brief Controls how often an animator re-evaluates its pose.
+ *
+ * The default policy evaluates every update. Distant animators can evaluate
+ * every Nth update and blend between the evaluated poses in between, offscreen
+ * ones can stop evaluating entirely. Distance and visibility come from
+ * `animator::set_visibility_hint`.
+ */
+struct animator_update_policy
+{
+    /** @brief Animators closer than this always evaluate every update. */
+    real full_rate_distance = real(32);
+    /** @brief Evaluate every Nth update beyond `full_rate_distance`. */
+    uint8_t reduced_interval = 1;
+    /** @brief Skip evaluation while the animator is hinted offscreen. */
+    bool pause_offscreen = false;
+    /** @brief Blend between the last two evaluated poses on skipped updates,
+     * at the cost of lagging one interval behind. */
+    bool interpolate = true;
+};
+
+/**
+ * @struct animation_layer
+ * @brief A clip blended over the base animation of an animator.
+ */
+struct animation_layer
+{
+    animation *clip = nullptr;
+    shared_ptr<const animation_binding> binding;
+    vector<track_cursor> cursors;
+    real time     = real(0); ///< Playback time, in ticks.
+    real weight   = real(1); ///< Blend weight in [0, 1].
+    bool loop     = true;
+    bool additive = false; ///< Adds the clip's offset from its rest pose.
 };
 
 /**
@@ -259,27 +545,99 @@ public:
      */
     void play_animation(animation *anim, const mesh &mesh_ref, bool loop);
 
+    /**
+     * @brief Transitions to a clip by blending out of the current one.
+     *
+     * The outgoing clip keeps playing while its weight falls to zero over
+     * `duration`. Without a current clip this is `play_animation`.
+     *
+     * @param anim The animation clip to play.
+     * @param mesh_ref The model whose skeleton will be animated.
+     * @param duration The length of the transition, in seconds.
+     * @param loop If true, the new animation will loop.
+     */
+    void cross_fade(animation *anim,
+                    const mesh &mesh_ref,
+                    real duration,
+                    bool loop);
+
+    /**
+     * @brief Adds a clip blended over the base animation.
+     *
+     * Override layers blend toward the clip's pose by `weight`, additive
+     * layers add its offset from the rest pose scaled by `weight`. Layers
+     * are applied in insertion order.
+     *
+     * @return The index of the new layer.
+     */
+    size_t add_layer(animation *anim,
+                     const mesh &mesh_ref,
+                     real weight,
+                     bool additive,
+                     bool loop = true);
+
+    /** @brief Changes the weight of a layer added by `add_layer`. */
+    void set_layer_weight(size_t index, real weight)
+    {
+        if (index < m_layers.size())
+            m_layers[index].weight = clamp(weight, real(0), real(1));
+    }
+
+    /** @brief Removes every layer added by `add_layer`. */
+    void clear_layers() { m_layers.clear(); }
+
+    /** @return Whether a cross-fade is in progress. */
+    bool is_fading() const { return m_fade.clip != nullptr; }
+
     /**
      * @brief Advances the animation time and recalculates the bone matrices.
      * @param delta_time The time elapsed, in seconds, since the last update.
      */
-    void update(real delta_time)
+    void update(real delta_time);
+
+    /** @brief Sets how often the pose is re-evaluated. */
+    void set_update_policy(const animator_update_policy &policy)
     {
-        if (!m_current_animation)
-            return;
+        m_policy = policy;
+        m_stale  = true;
+    }
 
-        m_current_time +=
-            m_current_animation->get_ticks_per_second() * delta_time;
+    const animator_update_policy &get_update_policy() const
+    {
+        return m_policy;
+    }
 
-        if (m_loop)
-        {
-            m_current_time =
-                mod(m_current_time, m_current_animation->get_duration());
-        }
+    /**
+     * @brief Tells the animator how relevant its character is this frame.
+     * @param distance The distance from the viewer, in world units.
+     * @param visible Whether the character is inside the view.
+     */
+    void set_visibility_hint(real distance, bool visible)
+    {
+        m_hint_distance = distance;
+        m_hint_visible  = visible;
+    }
 
-        calculate_bone_transform(&m_root_node, mat4<real>::identity());
+    /**
+     * @brief Enables animation instancing.
+     *
+     * Instanced animators playing the same clip on the same skeleton snap
+     * their time to multiples of `time_step` ticks and share the pose
+     * evaluated for that frame, so a crowd in lockstep costs one evaluation
+     * per distinct pose instead of one per character.
+     *
+     * @param enabled Whether to share poses with other animators.
+     * @param time_step The quantization step, in ticks.
+     */
+    void set_instancing(bool enabled, real time_step = real(1))
+    {
+        m_instanced          = enabled;
+        m_instance_time_step = time_step > real(0) ? time_step : real(1);
+        m_shared_pose.reset();
     }
 
+    bool get_instancing() const { return m_instanced; }
+
     /**
      * @brief Gets the final bone transformation matrices for the current
      * animation pose. These matrices are ready to be sent to a shader for
@@ -289,19 +647,75 @@ public:
      */
     const vector<mat4<real>> &get_final_bone_matrices() const
     {
-        return m_final_bone_matrices;
+        return m_shared_pose ? m_shared_pose->matrices : m_final_bone_matrices;
+    }
+
+    /**
+     * @return The memory held by the animator in bytes, without the clips it
+     * plays and the poses it shares.
+     */
+    size_t get_memory_used() const;
+
+    /**
+     * @return The estimated work of an update, as the bones sampled and
+     * composed by every blended clip, spread over the updates one evaluation
+     * covers under the policy. See `controller::get_update_cost`.
+     */
+    uint32_t get_update_cost() const;
+
+    /** @brief Adds the memory and update cost to those of its owner. */
+    void add_cost(scene_cost &cost) const
+    {
+        cost.memory += get_memory_used();
+        cost.update_cost += get_update_cost();
     }
 
 private:
-    vector<mat4<real>> m_final_bone_matrices     = {};
-    animation *m_current_animation               = nullptr;
-    real m_current_time                          = real(0);
-    bool m_loop                                  = false;
-    vector<int32_t> m_bone_id_to_anim_bone_index = {};
-    animation_node m_root_node;
+    vector<mat4<real>> m_final_bone_matrices = {};
+    animation *m_current_animation           = nullptr;
+    real m_current_time                      = real(0);
+    bool m_loop                              = false;
+    vector<track_cursor> m_cursors           = {};
+    shared_ptr<const animation_binding> m_binding;
+
+    bool m_instanced          = false;
+    real m_instance_time_step = real(1);
+    uint64_t m_shared_key     = 0;
+    shared_ptr<const animation_pose> m_shared_pose;
+
+    animator_update_policy m_policy = {};
+    real m_hint_distance            = real(0);
+    bool m_hint_visible             = true;
+    bool m_stale                    = true;
+    uint8_t m_skipped_updates       = 0;
+    vector<mat4<real>> m_pose_from  = {};
+    vector<mat4<real>> m_pose_to    = {};
+
+    animation_layer m_fade    = {};
+    real m_fade_duration      = real(0);
+    real m_fade_elapsed       = real(0);
+    vector<animation_layer> m_layers;
+
+    void start_clip(animation *anim, const mesh &mesh_ref, bool loop);
+
+    /** @brief Samples, blends and composes the fade and layer poses. */
+    void evaluate_layered(vector<mat4<real>> &palette);
+
+    void compose_pose(const animation_node *node,
+                      const mat4<real> &parent_transform,
+                      const vector<bone_pose> &pose,
+                      vector<mat4<real>> &palette) const;
+
+    /** @return How many updates each evaluation covers under the policy. */
+    uint8_t get_update_interval() const;
+
+    /** @brief Evaluates the pose at the current time, or shares one. */
+    void evaluate(vector<mat4<real>> &palette);
 
     void calculate_bone_transform(const animation_node *node,
-                                  const mat4<real> &parent_transform);
+                                  const mat4<real> &parent_transform,
+                                  real time,
+                                  vector<mat4<real>> &palette);
 };
 
 #pragma pack(push, 1)
@@ -479,6 +893,18 @@ inline result<void> serialize(ice_writer &writer, const animation &a)
     return error_code::ok;
 }
 
+/**
+ * @brief Lists the nodes of a hierarchy in preorder, the order they are
+ * serialized in and the index space of `ICE_ANIMATION_CHANNEL::node_id`.
+ */
+static inline void collect_nodes_recursive(const animation_node &node,
+                                           vector<const animation_node *> &out)
+{
+    out.push_back(&node);
+    for (const auto &child : node.children)
+        collect_nodes_recursive(child, out);
+}
+
 static inline void import_nodes_recursive(ice_reader &reader,
                                           animation_node &parent_node,
                                           size_t &nodes_left)
@@ -525,6 +951,9 @@ template <> inline result<void> deserialize(ice_reader &reader, animation &a)
     size_t nodes_to_process = header.node_count;
     import_nodes_recursive(reader, a.m_root_node, nodes_to_process);
 
+    vector<const animation_node *> nodes;
+    collect_nodes_recursive(a.m_root_node, nodes);
+
     // Import channels
     a.m_channels.resize(header.channel_count);
     for (size_t i = 0; i < header.channel_count; ++i)
@@ -533,6 +962,9 @@ template <> inline result<void> deserialize(ice_reader &reader, animation &a)
         reader.read(&chdr, sizeof(chdr));
 
         anim_bone &b = a.m_channels[i];
+        b.bone_id    = chdr.node_id;
+        if (chdr.node_id >= 0 && size_t(chdr.node_id) < nodes.size())
+            b.track.bone_name = nodes[chdr.node_id]->name;
 
         b.track.positions.resize(chdr.position_count);
         reader.read(b.track.positions.data(),
@@ -547,6 +979,7 @@ template <> inline result<void> deserialize(ice_reader &reader, animation &a)
                     chdr.scale_count * sizeof(key_scale));
     }
 
+    a.rebuild_bone_index();
     return error_code::ok;
 }
 } // namespace zabato
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+
+#include <zabato/math.hpp>
+#include <zabato/real.hpp>
+#include <zabato/transformation.hpp>
+
+#include <stdint.h>
+
+namespace zabato
+{
+/**
+ * @struct aabb
+ * @brief An axis aligned box. Starts empty, with `min` above `max`.
+ */
+struct aabb
+{
+    vec3<real> min = vec3<real>(real::max_val());
+    vec3<real> max = vec3<real>(-real::max_val());
+
+    bool is_empty() const { return min.x > max.x; }
+
+    vec3<real> center() const { return (min + max) * real(0.5); }
+    vec3<real> extents() const { return (max - min) * real(0.5); }
+
+    /** @brief Grows the box to hold a point. */
+    void extend(const vec3<real> &point);
+
+    /** @brief Grows the box to hold another box. */
+    void extend(const aabb &other);
+};
+
+/**
+ * @struct bounding_sphere
+ * @brief A sphere holding some geometry. A negative radius marks it empty.
+ */
+struct bounding_sphere
+{
+    vec3<real> center = vec3<real>(real(0));
+    real radius       = real(-1);
+
+    bool is_empty() const { return radius < real(0); }
+
+    /** @return The sphere around a box. */
+    static bounding_sphere from_aabb(const aabb &box);
+
+    /** @brief Grows the sphere to hold another sphere. */
+    void merge(const bounding_sphere &other);
+
+    /** @return The sphere holding this one once `t` is applied. */
+    bounding_sphere transformed(const transformation &t) const;
+};
+
+/** @brief How a volume relates to a frustum. */
+enum class cull_result : uint8_t
+{
+    outside,      ///< Entirely outside, skip it and everything in it.
+    intersecting, ///< Partly inside, test what it contains.
+    inside        ///< Entirely inside, draw everything in it untested.
+};
+
+/**
+ * @struct frustum
+ * @brief The six planes of a view volume, with normals pointing inwards.
+ *
+ * Tests take a mask of the planes left to check. A volume entirely inside a
+ * plane clears its bit, so the volumes it contains skip that plane.
+ */
+struct frustum
+{
+    enum plane_index : uint8_t
+    {
+        left_plane,
+        right_plane,
+        bottom_plane,
+        top_plane,
+        near_plane,
+        far_plane,
+        plane_count
+    };
+
+    /** @brief The mask that tests every plane. */
+    static constexpr uint32_t all_planes = (1u << plane_count) - 1;
+
+    plane3<real> planes[plane_count];
+
+    /**
+     * @brief Extracts the planes of a view-projection matrix (Gribb and
+     * Hartmann), for clip space depth in [-w, w].
+     */
+    static frustum from_matrix(const mat4<real> &view_projection);
+
+    /** @brief Tests a sphere against the planes in `mask`, clearing the bits
+     * of the planes it is entirely inside. */
+    cull_result test(const bounding_sphere &sphere, uint32_t &mask) const;
+
+    /** @brief Tests a box against the planes in `mask`, clearing the bits of
+     * the planes it is entirely inside. */
+    cull_result test(const aabb &box, uint32_t &mask) const;
+};
+} // namespace zabato
@@ -1,10 +1,13 @@
 #pragma once
 
+#include <zabato/debug_draw.hpp>
 #include <zabato/gpu.hpp>
 #include <zabato/list.hpp>
 #include <zabato/math.hpp>
 #include <zabato/real.hpp>
+#include <zabato/small_vector.hpp>
 #include <zabato/vector.hpp>
+#include <assert.h>
 #include <stdint.h>
 
 namespace zabato
@@ -71,6 +74,17 @@ struct raycast_result
     const class collision_shape *object = nullptr; ///< Object that was hit
 };
 
+/** @brief Contains the first contact of a shape moving along a segment. */
+struct sweep_result
+{
+    bool hit  = false;   ///< Whether the moving shape touched anything
+    real time = real(1); ///< Fraction of the motion done at first contact
+    vec2<real> point{};  ///< Contact point on the obstacle surface
+    vec2<real> normal{}; ///< Obstacle normal, facing the moving shape
+
+    const class collision_shape *object = nullptr; ///< Object that was hit
+};
+
 /** @brief Defines a vision cone for field-of-view calculations. */
 struct vision_cone
 {
@@ -81,6 +95,20 @@ struct vision_cone
     real far_dist;        ///< Maximum vision distance
 };
 
+/**
+ * @brief A vision cone with the terms every point test needs computed once.
+ * @see prepare_vision_cone
+ */
+struct prepared_vision_cone
+{
+    vision_cone cone;     ///< The source cone
+    vec2<real> direction; ///< Normalized forward direction
+    real cos_angle;       ///< Cosine of the half angle
+    real sin_angle;       ///< Sine of the half angle
+    real near_sq;         ///< Squared minimum vision distance
+    real far_sq;          ///< Squared maximum vision distance
+};
+
 /** @brief Contains information about the visibility of an object. */
 struct visibility_result
 {
@@ -144,14 +172,76 @@ public:
     collision_type get_type() const override { return collision_type::circle; }
 };
 
-/** @brief A convex polygon collision shape. */
+/**
+ * @brief A convex polygon collision shape.
+ *
+ * Edge normals, the projection of the polygon onto each of them, its bounds
+ * and a bounding circle are cached when the vertices are set, so the SAT
+ * tests only project the other shape. The cache is rebuilt eagerly by every
+ * mutator, keeping const access safe from multiple threads.
+ */
 class polygon_shape : public collision_shape
 {
 public:
     vec2<real> position;
-    vector<vec2<real>> vertices;
     collision_type get_type() const override { return collision_type::polygon; }
+
+    /** @brief Per-vertex data, inline for polygons of up to 8 vertices. */
+    using vertex_list = small_vector<vec2<real>, 8>;
+
+    const vertex_list &get_vertices() const { return m_vertices; }
+
+    void set_vertices(const vec2<real> *vertices, size_t count)
+    {
+        m_vertices.assign(vertices, vertices + count);
+        update_cache();
+    }
+
+    void set_vertices(const vector<vec2<real>> &vertices)
+    {
+        set_vertices(vertices.data(), vertices.size());
+    }
+
+    void set_vertex(size_t index, vec2<real> vertex)
+    {
+        assert(index < m_vertices.size());
+        if (index >= m_vertices.size())
+            return;
+        m_vertices[index] = vertex;
+        update_cache();
+    }
+
+    /** @return The unit normals of the edges, edge `i` rotated a quarter
+     * turn counter-clockwise, from vertex i to i + 1. */
+    const vertex_list &get_normals() const { return m_normals; }
+
+    /** @return The `{min, max}` projection of the polygon on normal `i`. */
+    const vertex_list &get_extents() const { return m_extents; }
+
+    const vec2<real> &get_bounds_min() const { return m_bounds_min; }
+    const vec2<real> &get_bounds_max() const { return m_bounds_max; }
+
+    /** @return The vertex average, the center of the bounding circle. */
+    const vec2<real> &get_center() const { return m_center; }
+    real get_radius() const { return m_radius; }
+
+    /** @return A value that changes whenever the vertices change, unique
+     * across every polygon. */
+    uint32_t get_revision() const { return m_revision; }
+
+private:
+    vertex_list m_vertices;
+    vertex_list m_normals;
+    vertex_list m_extents;
+    vec2<real> m_bounds_min = {};
+    vec2<real> m_bounds_max = {};
+    vec2<real> m_center     = {};
+    real m_radius           = real(0);
+    uint32_t m_revision     = 0;
+
+    void update_cache();
 };
+
 /**
  * @brief Checks if a point is inside a collision shape.
  * @param shape The collision shape to test against.
@@ -170,6 +260,73 @@ bool check_collision(const collision_shape &shape, vec2<real> position);
 collision_result test_collision(const collision_shape &first,
                                 const collision_shape &second);
 
+/**
+ * @brief What the narrowphase learned about a pair of shapes on its last test,
+ * kept between frames by a `contact_cache`.
+ */
+struct contact_state
+{
+    collision_result contact;     ///< Result of the last test
+    vec2<real> separating_axis{}; ///< Last axis found to separate the pair
+    bool has_axis = false;        ///< Whether `separating_axis` is set
+};
+
+/**
+ * @brief Tests for collision between two shapes, trying the last separating
+ * axis of the pair first. Pairs that stay apart usually stay apart along the
+ * same axis, which then skips the full test.
+ * @param first The first collision shape.
+ * @param second The second collision shape.
+ * @param state The cached state of the pair, updated with the new result.
+ * @return The same result as `test_collision(first, second)`.
+ */
+collision_result test_collision(const collision_shape &first,
+                                const collision_shape &second,
+                                contact_state &state);
+
+/**
+ * @brief Computes the axis-aligned bounding box of a collision shape.
+ * @param shape The collision shape to bound.
+ * @param[out] min_out The minimum corner of the box.
+ * @param[out] max_out The maximum corner of the box.
+ */
+void get_collision_bounds(const collision_shape &shape,
+                          vec2<real> &min_out,
+                          vec2<real> &max_out);
+
+/**
+ * @brief Casts a ray against a single collision shape.
+ * @param origin The starting point of the ray.
+ * @param direction The normalized direction of the ray.
+ * @param shape The collision shape to test against.
+ * @param[out] result The intersection, filled only on a hit.
+ * @return True if the ray hits the shape, false otherwise.
+ */
+bool raycast_shape(vec2<real> origin,
+                   vec2<real> direction,
+                   const collision_shape &shape,
+                   raycast_result &result);
+
+/**
+ * @brief Sweeps a moving shape along a segment against a single obstacle.
+ *
+ * The sweep is a raycast of the moving shape's center against the Minkowski
+ * sum of both shapes, so a fast mover cannot tunnel through thin obstacles and
+ * needs one query per step instead of several sub-steps. Shapes that already
+ * overlap hit at time 0 with a normal opposing the motion.
+ *
+ * @param moving The moving shape at its start position, a circle or a rect.
+ * @param motion The displacement of the moving shape over the step.
+ * @param obstacle The static shape to test against.
+ * @param[out] result The first contact, filled only on a hit.
+ * @return True if the shapes touch during the motion. Always false for a
+ * moving polygon.
+ */
+bool sweep_shape(const collision_shape &moving,
+                 vec2<real> motion,
+                 const collision_shape &obstacle,
+                 sweep_result &result);
+
 /**
  * @brief Casts a ray and checks for the closest intersection with a set of
  * collision objects.
@@ -194,6 +351,22 @@ raycast_result raycast(vec2<real> origin,
  */
 bool is_point_in_vision_cone(const vision_cone &cone, vec2<real> point);
 
+/**
+ * @brief Normalizes the direction of a cone and computes its trigonometry,
+ * so it can be tested against many points.
+ * @param cone The vision cone to prepare.
+ * @return The prepared cone.
+ */
+prepared_vision_cone prepare_vision_cone(const vision_cone &cone);
+
+/**
+ * @brief Checks if a point is within a prepared vision cone. Needs no square
+ * root or trigonometry.
+ * @see is_point_in_vision_cone(const vision_cone &, vec2<real>)
+ */
+bool is_point_in_vision_cone(const prepared_vision_cone &cone,
+                             vec2<real> point);
+
 /**
  * @brief Determines the visibility of an object from a vision cone, considering
  * potential obstacles.
@@ -210,15 +383,97 @@ check_visibility(const vision_cone &cone,
                  const vector<const collision_shape *> &obstacles);
 
 /**
- * @brief Creates a convex hull from a set of 2D points using the Graham scan
- * algorithm.
+ * @brief Creates a convex hull from a set of 2D points using Andrew's
+ * monotone chain algorithm.
  * @param points A vector of input points.
  * @return A vector containing the vertices of the resulting convex hull.
  */
 vector<vec2<real>> create_convex_hull(const vector<vec2<real>> &points);
 
+/**
+ * @brief Creates a convex hull into caller-provided buffers, so repeated
+ * builds allocate nothing once the buffers have grown.
+ * @param points The input points.
+ * @param point_count The number of input points.
+ * @param[out] out_vertices Receives the hull, counter-clockwise and without
+ * collinear vertices.
+ * @param scratch Holds the sorted copy of the input. Unused when `sorted`.
+ * @param sorted True if the points are already sorted by x, then y, which
+ * skips the sort.
+ * @return True if the hull has at least three vertices.
+ */
+bool create_convex_hull(const vec2<real> *points,
+                        size_t point_count,
+                        vector<vec2<real>> &out_vertices,
+                        vector<vec2<real>> &scratch,
+                        bool sorted = false);
+
+/**
+ * @class convex_hull_builder
+ * @brief Grows a convex hull one point at a time, e.g. for editor tools.
+ *
+ * Each added point costs time linear in the hull size. Points inside the
+ * hull are dropped, points outside replace the edges they can see.
+ */
+class convex_hull_builder
+{
+public:
+    /** @brief Removes every point. */
+    void clear() { m_hull.clear(); }
+
+    /**
+     * @brief Adds a point to the hull.
+     * @return True if the hull changed.
+     */
+    bool add_point(vec2<real> point);
+
+    /** @return The hull, counter-clockwise. Holds fewer than three vertices
+     * while every point added so far is collinear. */
+    const vector<vec2<real>> &get_vertices() const { return m_hull; }
+
+    /** @return True once the hull encloses an area. */
+    bool is_valid() const { return m_hull.size() >= 3; }
+
+private:
+    vector<vec2<real>> m_hull;
+    vector<vec2<real>> m_scratch;
+};
+
+/**
+ * @brief Appends the debug primitives of a collision shape to a batch.
+ * @param batch The batch receiving the primitives, flushed by the caller.
+ * @param shape The collision shape to draw.
+ * @param z The Z-depth to draw the 2D shape at.
+ * @param c The color to use for drawing.
+ * @param flags A bitmask of flags to control the drawing style (e.g., filled,
+ * wireframe).
+ */
+void draw_collision(debug_draw_batch &batch,
+                    const collision_shape &shape,
+                    real z,
+                    color c,
+                    collision_debug_flags flags);
+
+/**
+ * @brief Appends the outline of a vision cone to a batch.
+ * @param batch The batch receiving the primitives, flushed by the caller.
+ * @param cone The cone to draw.
+ * @param z The Z-depth to draw the cone at.
+ * @param c The color to use for drawing.
+ * @param segments The number of line segments of the far arc.
+ */
+void draw_vision_cone(debug_draw_batch &batch,
+                      const vision_cone &cone,
+                      real z,
+                      color c,
+                      uint32_t segments);
+
 /**
  * @brief Debug draws a collision shape using the provided GPU context.
+ *
+ * Draws through a batch flushed right away. When drawing many shapes, append
+ * them all to one `debug_draw_batch` and flush it once instead.
+ *
  * @param gpu The GPU interface to use for drawing.
  * @param shape The collision shape to draw.
  * @param z The Z-depth to draw the 2D shape at.
@@ -232,6 +487,7 @@ void draw_collision(gpu &gpu,
                     color c,
                     collision_debug_flags flags);
 
+/** @brief Debug draws a vision cone using the provided GPU context. */
 void draw_vision_cone(gpu &gpu,
                       const vision_cone &cone,
                       real z,
@@ -0,0 +1,321 @@
+#pragma once
+
+#include <zabato/collision.hpp>
+#include <zabato/hash_map.hpp>
+#include <zabato/math.hpp>
+#include <zabato/real.hpp>
+#include <zabato/vector.hpp>
+#include <stdint.h>
+
+namespace zabato
+{
+/** @brief An axis-aligned bounding box in the collision plane. */
+struct collision_bounds
+{
+    vec2<real> min{};
+    vec2<real> max{};
+
+    bool overlaps(const collision_bounds &other) const
+    {
+        return min.x <= other.max.x && max.x >= other.min.x &&
+               min.y <= other.max.y && max.y >= other.min.y;
+    }
+
+    bool contains(const collision_bounds &other) const
+    {
+        return min.x <= other.min.x && min.y <= other.min.y &&
+               max.x >= other.max.x && max.y >= other.max.y;
+    }
+
+    bool contains(vec2<real> point) const
+    {
+        return point.x >= min.x && point.x <= max.x && point.y >= min.y &&
+               point.y <= max.y;
+    }
+
+    bool operator==(const collision_bounds &other) const
+    {
+        return min == other.min && max == other.max;
+    }
+
+    /** @return Half the perimeter, the cost metric of the tree. */
+    real get_perimeter() const { return (max.x - min.x) + (max.y - min.y); }
+
+    static collision_bounds merge(const collision_bounds &a,
+                                  const collision_bounds &b)
+    {
+        return {{zabato::min(a.min.x, b.min.x), zabato::min(a.min.y, b.min.y)},
+                {zabato::max(a.max.x, b.max.x), zabato::max(a.max.y, b.max.y)}};
+    }
+};
+
+/** @brief Two shapes whose broadphase bounds overlap. */
+struct collision_pair
+{
+    const collision_shape *first  = nullptr;
+    const collision_shape *second = nullptr;
+
+    bool operator==(const collision_pair &other) const
+    {
+        return first == other.first && second == other.second;
+    }
+};
+
+/** @brief An observer and a target inside its cone, from a bulk query. */
+struct visibility_pair
+{
+    size_t observer               = 0;       ///< Index of the observer cone
+    const collision_shape *target = nullptr; ///< Shape inside the cone
+    visibility_result visibility;            ///< Visibility of the target
+};
+
+/**
+ * @brief Runs the narrowphase over a list of candidate pairs, in parallel.
+ *
+ * `results[i]` receives `test_collision(*pairs[i].first, *pairs[i].second)`.
+ * The pairs are split into contiguous chunks, one per thread, run through
+ * `job_system::parallel_for` on its workers and the calling thread. Small
+ * batches run on the calling thread only, as scheduling would cost more than
+ * it saves.
+ *
+ * @param pairs The candidate pairs, e.g. from `collision_world::query_pairs`.
+ * @param count The number of pairs.
+ * @param[out] results Preallocated output, at least `count` entries.
+ * @param thread_count The most threads to use, including the calling one.
+ * 0 uses every `job_system` worker.
+ */
+void test_collisions(const collision_pair *pairs,
+                     size_t count,
+                     collision_result *results,
+                     uint32_t thread_count = 0);
+
+/**
+ * @class contact_cache
+ * @brief Persistent narrowphase state for pairs of shapes, kept between
+ * frames.
+ *
+ * A pair whose shapes still have the bounds (and polygon revision) of its
+ * last test reuses the stored result without testing. Other pairs try their
+ * last separating axis first, which usually still separates a pair that
+ * stays apart. Pairs are keyed by their ordered shape pointers, so a pair
+ * should be passed in the same order every frame, as `query_pairs` does.
+ */
+class contact_cache
+{
+public:
+    /** @brief Tests a pair, reusing what the cache knows about it. */
+    collision_result test(const collision_shape &first,
+                          const collision_shape &second);
+
+    /**
+     * @brief Tests a batch of pairs through the cache, in parallel. Each pair
+     * may appear only once per batch.
+     * @see zabato::test_collisions
+     */
+    void test(const collision_pair *pairs,
+              size_t count,
+              collision_result *results,
+              uint32_t thread_count = 0);
+
+    /**
+     * @brief Ends a frame, dropping pairs that were not tested recently.
+     * @param max_age Frames a pair may go untested before it is dropped.
+     */
+    void end_frame(uint32_t max_age = 1);
+
+    /** @brief Forgets every pair involving a shape, e.g. before deleting it. */
+    void remove(const collision_shape *shape);
+
+    /** @brief Forgets every pair. */
+    void clear() { m_pairs.clear(); }
+
+    /** @return The number of cached pairs. */
+    size_t size() const { return m_pairs.size(); }
+
+private:
+    struct pair_entry
+    {
+        contact_state state;
+        collision_bounds first_bounds;
+        collision_bounds second_bounds;
+        uint32_t first_revision  = 0;
+        uint32_t second_revision = 0;
+        uint32_t last_frame      = 0;
+        bool tested              = false;
+    };
+
+    struct batch_context;
+
+    pair_entry &get_entry(const collision_pair &pair);
+
+    static collision_result test_entry(const collision_pair &pair,
+                                       pair_entry &entry,
+                                       uint32_t frame);
+
+    static void run_batch(void *context, size_t begin, size_t end);
+
+    hash_map<collision_pair, pair_entry> m_pairs;
+    vector<pair_entry *> m_batch;
+    vector<collision_pair> m_stale;
+    uint32_t m_frame = 0;
+};
+
+/**
+ * @class collision_world
+ * @brief A broadphase over collision shapes, backed by a dynamic AABB tree.
+ *
+ * Each shape is tracked by a fattened copy of its `get_collision_bounds` box,
+ * so small motions do not touch the tree. Queries walk the tree and only run
+ * the narrowphase functions of collision.hpp on shapes whose boxes overlap.
+ * Shapes are not owned and must outlive their proxy.
+ */
+class collision_world
+{
+public:
+    /** @brief Handle to a shape tracked by the world. */
+    using proxy_id = int32_t;
+
+    static constexpr proxy_id null_proxy = -1;
+
+    /**
+     * @brief Constructs an empty world.
+     * @param margin How far each tracked box is grown past the shape bounds.
+     */
+    explicit collision_world(real margin = real(0.1)) : m_margin(margin) {}
+
+    /**
+     * @brief Starts tracking a shape.
+     * @param shape The shape to track.
+     * @return The proxy of the shape.
+     */
+    proxy_id insert(const collision_shape *shape);
+
+    /** @brief Stops tracking the shape behind a proxy. */
+    void remove(proxy_id proxy);
+
+    /**
+     * @brief Refreshes a proxy after its shape moved or changed.
+     * @return True if the proxy left its fat box and was reinserted.
+     */
+    bool move(proxy_id proxy);
+
+    /** @brief Removes every proxy. */
+    void clear();
+
+    /** @return The shape behind a proxy. */
+    const collision_shape *get_shape(proxy_id proxy) const
+    {
+        return m_nodes[proxy].shape;
+    }
+
+    /** @return The fat box of a proxy. */
+    const collision_bounds &get_bounds(proxy_id proxy) const
+    {
+        return m_nodes[proxy].bounds;
+    }
+
+    /** @return The number of tracked shapes. */
+    size_t size() const { return m_proxy_count; }
+
+    /**
+     * @brief Collects the shapes that contain a point.
+     * @param point The point to test.
+     * @param[out] out Receives the shapes, appended.
+     */
+    void query_point(vec2<real> point,
+                     vector<const collision_shape *> &out) const;
+
+    /**
+     * @brief Collects the shapes whose tracked boxes overlap a box.
+     * @param bounds The box to test.
+     * @param[out] out Receives the shapes, appended.
+     */
+    void query_bounds(const collision_bounds &bounds,
+                      vector<const collision_shape *> &out) const;
+
+    /**
+     * @brief Collects every pair of shapes whose tracked boxes overlap.
+     *
+     * Each pair is reported once. These are candidates only, the narrowphase
+     * (`test_collision`) decides whether they actually touch.
+     *
+     * @param[out] out Receives the pairs, appended.
+     */
+    void query_pairs(vector<collision_pair> &out) const;
+
+    /**
+     * @brief Casts a ray and finds the closest shape it hits.
+     * @see zabato::raycast
+     */
+    raycast_result
+    raycast(vec2<real> origin, vec2<real> direction, real max_distance) const;
+
+    /**
+     * @brief Sweeps a moving shape and finds the first tracked shape it
+     * touches.
+     *
+     * Walks the tree along the motion with the boxes grown by the moving
+     * shape's half extents, then sweeps against the shapes found. The moving
+     * shape itself may be tracked, it never hits itself.
+     *
+     * @see zabato::sweep_shape
+     */
+    sweep_result sweep(const collision_shape &moving, vec2<real> motion) const;
+
+    /**
+     * @brief Determines the visibility of an object, using every tracked
+     * shape near the line of sight as an obstacle.
+     * @see zabato::check_visibility
+     */
+    visibility_result check_visibility(const vision_cone &cone,
+                                       const collision_shape &object) const;
+
+    /**
+     * @brief Determines what each of many observers can see.
+     *
+     * Each cone is prepared once and gathers its candidate targets from the
+     * broadphase of `targets`, using the bounds of its sector. The shapes of
+     * this world that can block any of those targets are collected once per
+     * cone, then every target whose center lies inside the cone is raycast
+     * against them.
+     *
+     * @param cones The vision cones of the observers.
+     * @param cone_count The number of cones.
+     * @param targets The world holding the shapes to look for, may be this
+     * one.
+     * @param[out] out Receives one pair per target inside a cone, appended.
+     */
+    void check_visibility(const vision_cone *cones,
+                          size_t cone_count,
+                          const collision_world &targets,
+                          vector<visibility_pair> &out) const;
+
+private:
+    struct node
+    {
+        collision_bounds bounds;
+        const collision_shape *shape = nullptr;
+        int32_t parent               = -1; ///< Also the free list link.
+        int32_t child1               = -1;
+        int32_t child2               = -1;
+        int32_t height               = -1; ///< 0 for leaves, -1 when free.
+
+        bool is_leaf() const { return child1 == -1; }
+    };
+
+    int32_t allocate_node();
+    void free_node(int32_t index);
+
+    void insert_leaf(int32_t leaf);
+    void remove_leaf(int32_t leaf);
+    int32_t balance(int32_t index);
+
+    collision_bounds get_fat_bounds(const collision_shape &shape) const;
+
+    vector<node> m_nodes;
+    int32_t m_root       = -1;
+    int32_t m_free_list  = -1;
+    size_t m_proxy_count = 0;
+    real m_margin;
+};
+} // namespace zabato
@@ -0,0 +1,166 @@
+#pragma once
+
+#include <zabato/gpu.hpp>
+#include <zabato/vector.hpp>
+
+#include <stddef.h>
+#include <stdint.h>
+
+namespace zabato
+{
+/**
+ * @class command_buffer
+ * @brief A `gpu` that records the calls made on it into a linear byte buffer,
+ * to replay them later on the device in one pass.
+ *
+ * Recording touches no GPU state, so any thread may record into its own
+ * buffer, e.g. scene traversal and culling on the workers while the render
+ * thread still replays the previous frame. Only `execute` must come from the
+ * thread owning the device.
+ *
+ * Materials, lights and instance matrices are copied into the buffer.
+ * Textures, display lists and vertex and index buffers are recorded by
+ * pointer, so they must stay alive and unchanged until replayed.
+ *
+ * Textures and display lists cannot be created while recording, so
+ * `create_texture` and `create_display_list` return null. Vertex and index
+ * buffers are created by the device, which must allow it from the recording
+ * thread. `draw_skinned` returns false, so skinned meshes are skinned on the
+ * CPU and recorded as plain draws.
+ *
+ * Timing scopes are recorded, so they time the replay. The timings and frame
+ * statistics are the device's.
+ */
+class command_buffer : public gpu
+{
+public:
+    /** @param device The GPU the commands are replayed on. */
+    explicit command_buffer(gpu &device) : m_device(device) {}
+
+    command_buffer(const command_buffer &)            = delete;
+    command_buffer &operator=(const command_buffer &) = delete;
+
+    /** @brief Drops every recorded command, keeping the memory. */
+    void reset() { m_data.clear(); }
+
+    /**
+     * @brief Replays the recorded commands on the device, in order. Must be
+     * called from the thread owning the device. The commands are kept, so a
+     * buffer may be replayed again.
+     */
+    void execute() const;
+
+    /** @return True if nothing was recorded since the last `reset`. */
+    bool empty() const { return m_data.empty(); }
+
+    /** @return The size of the recorded commands in bytes. */
+    size_t size() const { return m_data.size(); }
+
+    gpu &get_device() override { return m_device; }
+
+    void new_frame() override;
+    void begin(primitive_type type) override;
+    void end() override;
+    void vertex(const vec3<real> &v) override;
+    void vertex(real x, real y, real z) override;
+    void color(const struct color &c) override;
+    void color(real r, real g, real b, real a = real(1)) override;
+    void normal(const vec3<real> &n) override;
+    void normal(real x, real y, real z) override;
+    void tex_coord(const vec2<real> &uv) override;
+    void tex_coord(real u, real v) override;
+    void clear(const struct color &c, real depth) override;
+    void viewport(int width, int height) override;
+
+    void set_matrix_mode(matrix_mode mode) override;
+    void perspective_fov(real fov, real aspect, real near, real far) override;
+    void ortho(real left,
+               real right,
+               real bottom,
+               real top,
+               real near,
+               real far) override;
+    void translate(const vec3<real> &t) override;
+    void translate(real x, real y, real z) override;
+    void rotate(const vec3<real> &r) override;
+    void rotate(real x, real y, real z) override;
+    void scale(const vec3<real> &s) override;
+    void scale(real x, real y, real z) override;
+    void load_identity() override;
+    void load_matrix(const mat4<real> &m) override;
+    void push_matrix() override;
+    void pop_matrix() override;
+
+    void set_shade_model(shade_model model) override;
+    void enable_lighting(bool enabled) override;
+    void set_light(int id, const light *l) override;
+    void set_material(const material *m) override;
+
+    texture *create_texture(uint16_t width,
+                            uint16_t height,
+                            color_format format) override;
+    void bind_texture(texture *tex) override;
+    void unbind_texture() override;
+
+    display_list *create_display_list() override;
+    void begin_display_list(display_list *list) override;
+    void end_display_list() override;
+    void call_display_list(const display_list *list) override;
+
+    vertex_buffer *create_vertex_buffer() override;
+    index_buffer *create_index_buffer() override;
+    void draw_indexed(primitive_type type,
+                      const vertex_buffer *vertices,
+                      const index_buffer *indices) override;
+    void draw_indexed_range(primitive_type type,
+                            const vertex_buffer *vertices,
+                            const index_buffer *indices,
+                            size_t first_index,
+                            size_t index_count) override;
+    bool draw_skinned(primitive_type type,
+                      const vertex_buffer *vertices,
+                      const index_buffer *indices,
+                      const mat4<real> *palette,
+                      size_t palette_size) override;
+    bool draw_instanced(primitive_type type,
+                        const vertex_buffer *vertices,
+                        const index_buffer *indices,
+                        const mat4<real> *model_views,
+                        size_t count) override;
+
+    void begin_timing(const char *name) override;
+    void end_timing() override;
+    span<const gpu_timing> get_timings() const override;
+    gpu_frame_stats get_frame_stats() const override;
+
+    void enable_fog(bool enabled) override;
+    void set_fog_start(float start) override;
+    void set_fog_end(float end) override;
+    void set_fog_color(const struct color &c) override;
+
+    void enable_depth_test(bool enabled) override;
+    void enable_blend(bool enabled) override;
+    void set_blend_func(blend_factor src, blend_factor dst) override;
+    void enable_scissor_test(bool enabled) override;
+    void set_scissor(int x, int y, int width, int height) override;
+    void set_viewport_rect(int x, int y, int width, int height) override;
+
+private:
+    enum class op : uint8_t;
+
+    /** @brief Appends an opcode followed by its arguments. */
+    template <class... Args> void record(op code, const Args &...args);
+
+    /** @brief Grows the buffer by `size` bytes, returning where they start. */
+    uint8_t *append(size_t size);
+
+    /** @brief Appends the bytes of a trivially copyable value. */
+    template <class T> void write(const T &value);
+
+    /** @brief Pads the buffer so the next write starts `alignment` aligned. */
+    void align(size_t alignment);
+
+    gpu &m_device;
+    vector<uint8_t> m_data;
+};
+} // namespace zabato
@@ -1,6 +1,10 @@
 #pragma once
 
+#include <zabato/allocator.hpp>
 #include <zabato/object.hpp>
+#include <zabato/vector.hpp>
+
+#include <stdint.h>
 
 namespace zabato
 {
@@ -32,12 +36,48 @@ public:
     void set_object(object *obj);
     object *get_object() const { return m_object; }
 
+    /**
+     * @return The estimated work of one `update`, in units of about one
+     * world transform update, the cost a spatial adds. Controllers doing
+     * more, e.g. driving an `animator`, override it; the default is 1.
+     */
+    virtual uint32_t get_update_cost() const { return 1; }
+
+    int get_memory_used() const override;
+
+    /** @brief Adds the controller and its update cost. */
+    void add_cost(scene_cost &cost) const override;
+
+    /** @brief Runs on the updating thread, after every other group. */
+    static constexpr uint32_t serial_group = 0;
+
+    /** @brief Touches only its own state, so runs alongside anything. */
+    static constexpr uint32_t independent_group = UINT32_MAX;
+
+    /**
+     * @brief Declares which controllers this one may run in parallel with.
+     *
+     * Controllers sharing any other group depend on each other, so they run
+     * one after another in update order, while different groups run in
+     * parallel. The default is `serial_group`.
+     */
+    void set_update_group(uint32_t group) { m_update_group = group; }
+    uint32_t get_update_group() const { return m_update_group; }
+
+    /**
+     * @brief Updates every controller of a list starting at `head`, running
+     * the independent controllers and the other groups through the job
+     * system, then the serial group on the calling thread.
+     */
+    static void update_list(controller *head, real dt);
+
     // Intrusive list pointers for world
     controller *next() const { return m_next; }
     controller *prev() const { return m_prev; }
 
     // Friend world to allow it to manipulate links
     friend class world;
+    friend class controller_set;
 
 protected:
     object *m_object;
@@ -45,6 +85,59 @@ protected:
 private:
     controller *m_next;
     controller *m_prev;
+    uint32_t m_update_group;
+    uint32_t m_set_index; ///< Position in its `controller_set` bucket.
+};
+
+/**
+ * @class controller_batch
+ * @brief Controllers collected for one update, run by their update groups.
+ *
+ * Keeps its arrays between runs, so updating every frame does not allocate.
+ */
+class controller_batch
+{
+public:
+    void clear();
+
+    /** @brief Queues `ctrl->update(dt)`, after the ones already added. */
+    void add(controller *ctrl, real dt);
+
+    /**
+     * @brief Runs the independent controllers and the other groups through
+     * the job system, then the serial group on the calling thread, and
+     * clears the batch.
+     */
+    void run();
+
+private:
+    struct entry
+    {
+        controller *ctrl;
+        real dt;
+    };
+
+    struct grouped_entry
+    {
+        uint32_t group;
+        uint32_t order;
+        entry item;
+    };
+
+    struct group_range
+    {
+        const grouped_entry *begin;
+        const grouped_entry *end;
+    };
+
+    template <class T> using array = vector<T, scene_allocator<T>>;
+
+    static void run_group(void *data);
+
+    array<entry> m_independent;
+    array<entry> m_serial;
+    array<grouped_entry> m_grouped;
+    array<group_range> m_groups;
 };
 
 } // namespace zabato
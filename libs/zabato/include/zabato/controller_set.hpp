@@ -0,0 +1,76 @@
+#pragma once
+
+#include <zabato/controller.hpp>
+
+namespace zabato
+{
+/**
+ * @class controller_set
+ * @brief Controllers bucketed by exact type, each bucket updated as one
+ * contiguous array at its own tick rate.
+ *
+ * Every controller in a bucket shares a vtable, so a bucket runs one
+ * `update` function over and over instead of jumping between types. A
+ * bucket with a tick interval accumulates frame time and updates only once
+ * the interval elapsed, passing the accumulated time, which throttles
+ * expensive controller types such as AI.
+ *
+ * The set does not own its controllers, they must be removed before they
+ * are destroyed. Removing swaps the last controller of the bucket into the
+ * hole, so order within a type is not kept.
+ */
+class controller_set
+{
+public:
+    controller_set() = default;
+
+    controller_set(const controller_set &)            = delete;
+    controller_set &operator=(const controller_set &) = delete;
+
+    /** @brief Adds a controller, which must not be in any set yet. */
+    void add(controller *ctrl);
+
+    /** @brief Removes a controller of this set. */
+    void remove(controller *ctrl);
+
+    /** @return Whether a controller belongs to this set. */
+    bool contains(const controller *ctrl) const;
+
+    /** @return The number of controllers. */
+    size_t size() const { return m_size; }
+
+    /**
+     * @brief Sets how often controllers of exactly `type` update.
+     * @param interval Seconds between updates, 0 to update every frame.
+     */
+    void set_tick_interval(const rtti &type, real interval);
+    real get_tick_interval(const rtti &type) const;
+
+    /**
+     * @brief Updates the buckets that are due, through a `controller_batch`,
+     * so update groups still apply.
+     */
+    void update(real dt);
+
+    /** @brief Removes every controller, keeping the tick intervals. */
+    void clear();
+
+private:
+    template <class T> using array = vector<T, scene_allocator<T>>;
+
+    struct bucket
+    {
+        const rtti *type = nullptr;
+        array<controller *> items;
+        real interval = real(0);
+        real elapsed  = real(0);
+    };
+
+    bucket &bucket_for(const rtti &type);
+    const bucket *find_bucket(const rtti &type) const;
+
+    array<bucket> m_buckets;
+    controller_batch m_batch;
+    size_t m_size = 0;
+};
+} // namespace zabato
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <zabato/color.hpp>
+#include <zabato/gpu.hpp>
+#include <zabato/math.hpp>
+#include <zabato/real.hpp>
+#include <zabato/vector.hpp>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace zabato
+{
+/** @brief One vertex of a debug primitive, laid out for `vertex_layout`. */
+struct debug_vertex
+{
+    vec3<real> position;
+    class color color;
+};
+
+/**
+ * @class debug_draw_batch
+ * @brief Accumulates debug lines, triangles and points over a frame and draws
+ * them together.
+ *
+ * Primitives are appended to one vertex array per primitive type, with the
+ * color stored per vertex. `flush` uploads each array to retained buffers and
+ * issues one indexed draw for it (split every 65535 vertices, the reach of
+ * 16-bit indices). On backends without retained geometry it falls back to one
+ * `begin`/`end` pair per primitive type.
+ */
+class debug_draw_batch
+{
+public:
+    debug_draw_batch() = default;
+    ~debug_draw_batch() { release_buffers(); }
+
+    debug_draw_batch(const debug_draw_batch &)            = delete;
+    debug_draw_batch &operator=(const debug_draw_batch &) = delete;
+
+    /** @brief Appends a line segment. */
+    void add_line(const vec3<real> &a, const vec3<real> &b, const color &c)
+    {
+        m_lines.push_back({a, c});
+        m_lines.push_back({b, c});
+    }
+
+    /** @brief Appends a filled triangle. */
+    void add_triangle(const vec3<real> &a,
+                      const vec3<real> &b,
+                      const vec3<real> &c,
+                      const color &col)
+    {
+        m_triangles.push_back({a, col});
+        m_triangles.push_back({b, col});
+        m_triangles.push_back({c, col});
+    }
+
+    /** @brief Appends a point. */
+    void add_point(const vec3<real> &p, const color &c)
+    {
+        m_points.push_back({p, c});
+    }
+
+    /** @brief Drops every accumulated primitive, keeping the storage. */
+    void clear();
+
+    /** @return True if no primitive has been added since the last flush. */
+    bool empty() const
+    {
+        return m_lines.size() == 0 && m_triangles.size() == 0 &&
+               m_points.size() == 0;
+    }
+
+    /**
+     * @brief Draws every accumulated primitive, then clears the batch.
+     * @param gpu The GPU interface to draw with.
+     */
+    void flush(gpu &gpu);
+
+    /** @brief Destroys the retained buffers, e.g. before the GPU goes away. */
+    void release_buffers();
+
+    /** @return The layout of `debug_vertex` for the retained buffers. */
+    static vertex_layout get_vertex_layout();
+
+private:
+    struct chunk
+    {
+        vertex_buffer *vertices = nullptr;
+        index_buffer *indices   = nullptr;
+    };
+
+    void bind_gpu(gpu &gpu);
+    bool draw_retained(gpu &gpu,
+                       primitive_type type,
+                       const vector<debug_vertex> &vertices,
+                       size_t per_primitive,
+                       size_t &next_chunk);
+    static void draw_immediate(gpu &gpu,
+                               primitive_type type,
+                               const vector<debug_vertex> &vertices);
+
+    vector<debug_vertex> m_lines;
+    vector<debug_vertex> m_triangles;
+    vector<debug_vertex> m_points;
+
+    vector<uint16_t> m_indices; ///< 0, 1, 2, ... shared by every chunk.
+    vector<chunk> m_chunks;
+    gpu *m_gpu = nullptr;
+};
+} // namespace zabato
@@ -20,7 +20,7 @@ public:
 
     static void initialize()
     {
-        s_start_objects = object::s_in_use.size();
+        s_start_objects = object::get_registry().size();
         if (s_start_objects > 0)
         {
             assert(s_start_objects == 0);
@@ -39,7 +39,7 @@ public:
 
         delete m_initializers;
         m_initializers  = nullptr;
-        s_start_objects = object::s_in_use.size();
+        s_start_objects = object::get_registry().size();
 
         if (failed)
             assert(false);
@@ -4,6 +4,7 @@
 #include <zabato/math.hpp>
 #include <zabato/real.hpp>
 #include <zabato/resource.hpp>
+#include <zabato/span.hpp>
 #include <stdint.h>
 
 namespace zabato
@@ -92,6 +93,43 @@ static inline const char *color_format_name(color_format format)
     }
 }
 
+/** @return The bits of a pixel in the format, 0 if undefined. */
+static inline uint32_t color_format_bits(color_format format)
+{
+    switch (format)
+    {
+    case color_format::rgba5551:
+    case color_format::rgba4444:
+        return 16;
+    case color_format::palette16:
+        return 4;
+    case color_format::palette64:
+    case color_format::palette128:
+    case color_format::palette256:
+        return 8;
+    default:
+        return 0;
+    }
+}
+
+/** @return The colors in the palette of the format, 0 if it has none. */
+static inline uint32_t color_format_palette_count(color_format format)
+{
+    switch (format)
+    {
+    case color_format::palette16:
+        return 16;
+    case color_format::palette64:
+        return 64;
+    case color_format::palette128:
+        return 128;
+    case color_format::palette256:
+        return 256;
+    default:
+        return 0;
+    }
+}
+
 #pragma endregion
 
 #pragma region Data Structs
@@ -129,6 +167,32 @@ struct material
     real shininess;
 };
 
+/**
+ * @struct gpu_frame_stats
+ * @brief What was submitted to a `gpu` since its last `new_frame`.
+ *
+ * Together with the GPU times of `gpu::get_timings`, tells whether a frame
+ * is bound by submission on the CPU or by the GPU itself.
+ */
+struct gpu_frame_stats
+{
+    size_t draw_calls    = 0; ///< Draws and display list calls sent.
+    size_t vertices      = 0; ///< Vertices sent, indices for indexed draws.
+    size_t texture_binds = 0; ///< Textures bound, past the state cache.
+    size_t state_changes = 0; ///< Other states set, past the state cache.
+};
+
+/**
+ * @struct gpu_timing
+ * @brief The GPU time of a scope opened by `gpu::begin_timing`.
+ */
+struct gpu_timing
+{
+    const char *name;     ///< The name given to `begin_timing`.
+    uint32_t depth;       ///< The number of scopes enclosing this one.
+    uint64_t nanoseconds; ///< The GPU time between the scope's two ends.
+};
+
 #pragma endregion
 
 #pragma region Texture Interface
@@ -164,7 +228,8 @@ public:
                       const void *data) = 0;
 
     /**
-     * @brief Copies the texture's pixel data out to a buffer.
+     * @brief Copies the texture's pixel data out to a buffer. Backends that
+     * do not keep the pixel data report a size of 0.
      * @param[out] width Pointer to store the texture width.
      * @param[out] height Pointer to store the texture height.
      * @param[out] format Pointer to store the texture format.
@@ -191,6 +256,15 @@ public:
      * @return The color format of the texture.
      */
     virtual color_format get_format() const = 0;
+
+    /** @return The pixels and the palette, stored as 32-bit colors. */
+    size_t get_gpu_memory_used() const override
+    {
+        const vec2<uint16_t> size = get_size();
+        const color_format format = get_format();
+        return ((size_t)size.x * size.y * color_format_bits(format) + 7) / 8 +
+               color_format_palette_count(format) * sizeof(uint32_t);
+    }
 };
 
 #pragma endregion
@@ -216,6 +290,90 @@ public:
 
 #pragma endregion
 
+#pragma region Vertex Buffer Interface
+
+/**
+ * @struct vertex_layout
+ * @brief Describes where each attribute lives inside an interleaved vertex.
+ *
+ * The position (`vec3<real>`) is always stored at offset 0. Normals are
+ * `vec3<real>`, colors are `color`, texture coordinates are `vec2<real>` and
+ * bone weights are four `{int16_t bone_id, ICE_R16 weight}` pairs. An offset
+ * of -1 means the attribute is not present.
+ */
+struct vertex_layout
+{
+    uint16_t stride           = 0;  ///< Size of one vertex in bytes.
+    int16_t normal_offset     = -1; ///< Byte offset of the normal.
+    int16_t color_offset      = -1; ///< Byte offset of the color.
+    int16_t texcoord_offset   = -1; ///< Byte offset of the texture coordinate.
+    int16_t boneweight_offset = -1; ///< Byte offset of the bone weights.
+};
+
+/**
+ * @class vertex_buffer
+ * @brief An abstract handle to vertex data retained in GPU memory.
+ *
+ * Vertex buffers are created and managed by a `gpu_context` instance.
+ */
+class vertex_buffer : public resource
+{
+public:
+    static constexpr chunk_id CHUNK_ID = chunk_id("VTXB");
+
+    virtual ~vertex_buffer() = default;
+
+    /** @brief Deletes the vertex buffer and releases its resources. */
+    virtual void destroy() = 0;
+
+    /**
+     * @brief Uploads interleaved vertex data, replacing any previous contents.
+     * @param layout The layout of a single vertex inside `data`.
+     * @param vertex_count The number of vertices in `data`.
+     * @param data A pointer to `vertex_count * layout.stride` bytes.
+     */
+    virtual void load(const vertex_layout &layout,
+                      size_t vertex_count,
+                      const void *data) = 0;
+
+    /** @return The number of vertices currently stored in the buffer. */
+    virtual size_t get_vertex_count() const = 0;
+};
+
+/**
+ * @class index_buffer
+ * @brief An abstract handle to 16-bit index data retained in GPU memory.
+ *
+ * Index buffers are created and managed by a `gpu_context` instance.
+ */
+class index_buffer : public resource
+{
+public:
+    static constexpr chunk_id CHUNK_ID = chunk_id("IDXB");
+
+    virtual ~index_buffer() = default;
+
+    /** @brief Deletes the index buffer and releases its resources. */
+    virtual void destroy() = 0;
+
+    /**
+     * @brief Uploads index data, replacing any previous contents.
+     * @param index_count The number of indices in `indices`.
+     * @param indices A pointer to the index data.
+     */
+    virtual void load(size_t index_count, const uint16_t *indices) = 0;
+
+    /** @return The number of indices currently stored in the buffer. */
+    virtual size_t get_index_count() const = 0;
+
+    size_t get_gpu_memory_used() const override
+    {
+        return get_index_count() * sizeof(uint16_t);
+    }
+};
+
+#pragma endregion
+
 #pragma region GPU Interface
 
 /**
@@ -230,6 +388,12 @@ class gpu
 public:
     virtual ~gpu() = default;
 
+    /**
+     * @brief Gets the GPU owning the resources used through this one, e.g.
+     * the device a `command_buffer` replays on.
+     */
+    virtual gpu &get_device() { return *this; }
+
 #pragma region Basic Drawing
 
     virtual void new_frame()                                     = 0;
@@ -299,6 +463,113 @@ public:
 
 #pragma endregion
 
+#pragma region Vertex Buffers
+
+    /**
+     * @brief Creates a retained vertex buffer.
+     * @return The new buffer, or nullptr if the backend has no retained
+     * geometry support (callers should fall back to immediate mode).
+     */
+    virtual vertex_buffer *create_vertex_buffer() = 0;
+
+    /**
+     * @brief Creates a retained index buffer.
+     * @return The new buffer, or nullptr if the backend has no retained
+     * geometry support (callers should fall back to immediate mode).
+     */
+    virtual index_buffer *create_index_buffer() = 0;
+
+    /**
+     * @brief Draws indexed primitives from retained buffers in a single call.
+     * @param type The primitive type the indices describe.
+     * @param vertices The vertex buffer providing the attributes.
+     * @param indices The index buffer selecting the vertices.
+     */
+    virtual void draw_indexed(primitive_type type,
+                              const vertex_buffer *vertices,
+                              const index_buffer *indices) = 0;
+
+    /**
+     * @brief Draws a range of the indices of retained buffers in a single
+     * call, e.g. one command of a streamed batch.
+     * @param type The primitive type the indices describe.
+     * @param vertices The vertex buffer providing the attributes.
+     * @param indices The index buffer selecting the vertices.
+     * @param first_index The first index of the range.
+     * @param index_count The number of indices in the range.
+     */
+    virtual void draw_indexed_range(primitive_type type,
+                                    const vertex_buffer *vertices,
+                                    const index_buffer *indices,
+                                    size_t first_index,
+                                    size_t index_count) = 0;
+
+    /**
+     * @brief Draws indexed primitives, blending every vertex by its bone
+     * weights on the GPU instead of the CPU.
+     * @param type The primitive type the indices describe.
+     * @param vertices The bind-pose vertices; `boneweight_offset` must be set.
+     * @param indices The index buffer selecting the vertices.
+     * @param palette The bone matrices, indexed by bone id.
+     * @param palette_size The number of matrices in the palette.
+     * @return False if the backend cannot skin on the GPU or the palette is too
+     * large, in which case nothing is drawn and the caller should skin on the
+     * CPU.
+     */
+    virtual bool draw_skinned(primitive_type type,
+                              const vertex_buffer *vertices,
+                              const index_buffer *indices,
+                              const mat4<real> *palette,
+                              size_t palette_size) = 0;
+
+    /**
+     * @brief Draws the same indexed primitives once per model-view matrix,
+     * binding the geometry only once for all of them.
+     * @param type The primitive type the indices describe.
+     * @param vertices The vertex buffer providing the attributes.
+     * @param indices The index buffer selecting the vertices.
+     * @param model_views The matrix replacing the current
+     * `matrix_mode::modelview` matrix for each instance.
+     * @param count The number of instances.
+     * @return False if the backend cannot draw instances, in which case
+     * nothing is drawn and the caller should draw every instance on its own.
+     * The current modelview matrix is left unchanged.
+     */
+    virtual bool draw_instanced(primitive_type type,
+                                const vertex_buffer *vertices,
+                                const index_buffer *indices,
+                                const mat4<real> *model_views,
+                                size_t count) = 0;
+
+#pragma endregion
+
+#pragma region Profiling
+
+    /**
+     * @brief Opens a GPU timing scope, timing the GPU work of the calls made
+     * until the matching `end_timing`. Scopes nest.
+     * @param name The scope's name, kept by pointer, e.g. a string literal.
+     */
+    virtual void begin_timing(const char *name) = 0;
+
+    /** @brief Closes the innermost scope opened by `begin_timing`. */
+    virtual void end_timing() = 0;
+
+    /**
+     * @return The scopes of the latest frame the GPU finished, in the order
+     * they were opened. Reading them never waits for the GPU, so they lag a
+     * frame or two behind. Empty if the backend cannot time the GPU.
+     */
+    virtual span<const gpu_timing> get_timings() const = 0;
+
+    /**
+     * @return What was submitted since the last `new_frame`, read before the
+     * next one for the totals of a frame.
+     */
+    virtual gpu_frame_stats get_frame_stats() const = 0;
+
+#pragma endregion
+
 #pragma region Fog / Depth Cueing
 
     virtual void enable_fog(bool enabled)             = 0;
@@ -240,6 +240,221 @@ struct gamepad_state
     real analogs[static_cast<int>(gamepad_analog::max)];
 };
 
+/**
+ * @class input_state
+ * @brief The keys, mouse and gamepads as of the last `poll_events`, kept as
+ * bitsets so queries are bit tests.
+ *
+ * The window system feeds it the event queue once per frame: `begin_frame`
+ * clears the edges and deltas, then every event sets bits. Besides what is
+ * held down, each frame records what was pressed and what was released,
+ * so a tap that starts and ends within one frame still reads as pressed.
+ * Key repeats do not count as presses.
+ */
+class input_state
+{
+public:
+    static constexpr int key_count     = static_cast<int>(key_code::last) + 1;
+    static constexpr int mouse_buttons = 4;
+    static constexpr int max_gamepads  = 4;
+    static constexpr int gamepad_analogs =
+        static_cast<int>(gamepad_analog::max);
+
+    /** @brief Clears the edges and deltas of the previous frame. */
+    void begin_frame()
+    {
+        for (int i = 0; i < key_words; ++i)
+            m_keys[i].pressed = m_keys[i].released = 0;
+        m_mouse.pressed = m_mouse.released = 0;
+        for (gamepad &pad : m_gamepads)
+            pad.buttons.pressed = pad.buttons.released = 0;
+        m_cursor_delta = vec2<real>();
+        m_scroll       = vec2<real>();
+    }
+
+#pragma region Events
+    void on_key(key_code key, bool down)
+    {
+        const int k = static_cast<int>(key);
+        if (k > 0 && k < key_count)
+            m_keys[k / 64].set(k % 64, down);
+    }
+
+    void on_mouse_button(mouse_button button, bool down)
+    {
+        const int b = static_cast<int>(button);
+        if (b > 0 && b < mouse_buttons)
+            m_mouse.set(b, down);
+    }
+
+    void on_cursor(const vec2<real> &position)
+    {
+        m_cursor_delta += position - m_cursor;
+        m_cursor = position;
+    }
+
+    void on_scroll(const vec2<real> &delta) { m_scroll += delta; }
+
+    void on_gamepad_connected(int jid, bool connected)
+    {
+        if (jid < 0 || jid >= max_gamepads)
+            return;
+        if (connected)
+            m_gamepads_connected |= uint8_t(1 << jid);
+        else
+        {
+            m_gamepads_connected &= uint8_t(~(1 << jid));
+            m_gamepads[jid] = gamepad();
+        }
+    }
+
+    void on_gamepad_button(int jid, gamepad_button button, bool down)
+    {
+        const int b = static_cast<int>(button);
+        if (jid >= 0 && jid < max_gamepads && b > 0 &&
+            b < static_cast<int>(gamepad_button::max))
+            m_gamepads[jid].buttons.set(b, down);
+    }
+
+    void on_gamepad_analog(int jid, gamepad_analog analog, real value)
+    {
+        const int a = static_cast<int>(analog);
+        if (jid >= 0 && jid < max_gamepads && a >= 0 && a < gamepad_analogs)
+            m_gamepads[jid].analogs[a] = value;
+    }
+#pragma endregion Events
+
+#pragma region Queries
+    bool is_key_down(key_code key) const { return test(key, &bits::down); }
+    bool was_key_pressed(key_code key) const
+    {
+        return test(key, &bits::pressed);
+    }
+    bool was_key_released(key_code key) const
+    {
+        return test(key, &bits::released);
+    }
+
+    bool is_mouse_button_down(mouse_button button) const
+    {
+        return m_mouse.test(static_cast<int>(button), &bits::down);
+    }
+    bool was_mouse_button_pressed(mouse_button button) const
+    {
+        return m_mouse.test(static_cast<int>(button), &bits::pressed);
+    }
+    bool was_mouse_button_released(mouse_button button) const
+    {
+        return m_mouse.test(static_cast<int>(button), &bits::released);
+    }
+
+    const vec2<real> &get_cursor() const { return m_cursor; }
+    /** @return How far the cursor moved this frame. */
+    const vec2<real> &get_cursor_delta() const { return m_cursor_delta; }
+    /** @return How far the wheel scrolled this frame. */
+    const vec2<real> &get_scroll() const { return m_scroll; }
+
+    bool is_gamepad_connected(int jid) const
+    {
+        return jid >= 0 && jid < max_gamepads &&
+               ((m_gamepads_connected >> jid) & 1);
+    }
+    bool is_gamepad_button_down(int jid, gamepad_button button) const
+    {
+        return test(jid, button, &bits::down);
+    }
+    bool was_gamepad_button_pressed(int jid, gamepad_button button) const
+    {
+        return test(jid, button, &bits::pressed);
+    }
+    bool was_gamepad_button_released(int jid, gamepad_button button) const
+    {
+        return test(jid, button, &bits::released);
+    }
+    /** @return The analog value, from -1 to 1, or 0 to 1 for triggers. */
+    real get_gamepad_analog(int jid, gamepad_analog analog) const
+    {
+        if (jid < 0 || jid >= max_gamepads)
+            return real(0);
+        return m_gamepads[jid].analogs[static_cast<int>(analog)];
+    }
+#pragma endregion Queries
+
+private:
+    /** @brief What is held down, and the edges of this frame. */
+    struct bits
+    {
+        uint64_t down     = 0;
+        uint64_t pressed  = 0;
+        uint64_t released = 0;
+
+        void set(int bit, bool is_down)
+        {
+            const uint64_t mask = uint64_t(1) << bit;
+            if (is_down && !(down & mask))
+            {
+                down |= mask;
+                pressed |= mask;
+            }
+            else if (!is_down && (down & mask))
+            {
+                down &= ~mask;
+                released |= mask;
+            }
+        }
+
+        bool test(int bit, uint64_t bits::*set) const
+        {
+            return bit >= 0 && bit < 64 && ((this->*set >> bit) & 1);
+        }
+    };
+
+    struct gamepad
+    {
+        bits buttons;
+        real analogs[gamepad_analogs];
+    };
+
+    static constexpr int key_words = (key_count + 63) / 64;
+
+    bool test(key_code key, uint64_t bits::*set) const
+    {
+        const int k = static_cast<int>(key);
+        return k >= 0 && k < key_count && m_keys[k / 64].test(k % 64, set);
+    }
+
+    bool test(int jid, gamepad_button button, uint64_t bits::*set) const
+    {
+        return jid >= 0 && jid < max_gamepads &&
+               m_gamepads[jid].buttons.test(static_cast<int>(button), set);
+    }
+
+    bits m_keys[key_words];
+    bits m_mouse;
+    gamepad m_gamepads[max_gamepads];
+    uint8_t m_gamepads_connected = 0;
+    vec2<real> m_cursor;
+    vec2<real> m_cursor_delta;
+    vec2<real> m_scroll;
+};
+
+/**
+ * @brief The input of one frame with the time it was captured, handed by the
+ * thread handling window events to threads that must not query the window,
+ * e.g. a simulation thread.
+ */
+struct input_snapshot
+{
+    input_state state;
+    uint64_t time = 0; ///< `time::now` in nanoseconds when captured.
+
+    bool is_key_down(key_code key) const { return state.is_key_down(key); }
+    bool is_mouse_button_down(mouse_button button) const
+    {
+        return state.is_mouse_button_down(button);
+    }
+};
+
 const char *to_string(key_code key);
 const char *to_string(mouse_button button);
 const char *to_string(mouse_icon icon);
@@ -2,6 +2,7 @@
 
 #include <zabato/allocator.hpp>
 #include <zabato/animator.hpp>
+#include <zabato/bounds.hpp>
 #include <zabato/color.hpp>
 #include <zabato/error.hpp>
 #include <zabato/gpu.hpp>
@@ -9,6 +10,8 @@
 #include <zabato/math.hpp>
 #include <zabato/real.hpp>
 #include <zabato/resource.hpp>
+#include <zabato/skinning.hpp>
+#include <zabato/span.hpp>
 #include <zabato/vector.hpp>
 
 #include <assert.h>
@@ -107,13 +110,31 @@ using color_t      = color;
 using texcoord_t   = vec2<real>;
 using boneweight_t = bone_weight[4];
 
+/**
+ * @struct vertex_streams
+ * @brief The vertices of a mesh as one contiguous array per attribute, see
+ * `mesh::get_vertex_streams`. The arrays of attributes the mesh lacks are
+ * empty.
+ */
+struct vertex_streams
+{
+    span<const position_t> positions;
+    span<const normal_t> normals;
+    span<const color_t> colors;
+    span<const texcoord_t> texcoords;
+    span<const bone_weight> bone_weights; ///< Four per vertex.
+};
+
 class mesh : public resource
 {
 public:
     static constexpr chunk_id CHUNK_ID = chunk_id("MESH");
 
     inline mesh() : m_vertex_count(0) {};
-    inline ~mesh() {};
+    inline ~mesh() { release_buffers(); };
+
+    mesh(const mesh &)            = delete;
+    mesh &operator=(const mesh &) = delete;
 
     void init(mesh_flags flags, primitive_type type)
     {
@@ -121,11 +142,24 @@ public:
         m_type  = type;
         calculate_offsets();
         resize();
+        invalidate_buffers();
+        m_bounds_dirty = true;
     }
 
     constexpr size_t get_index_count_per_primitive() const
     {
-        return static_cast<size_t>(m_type) + 1;
+        switch (m_type)
+        {
+        case primitive_type::quads:
+            return 4;
+        case primitive_type::triangles:
+            return 3;
+        case primitive_type::points:
+            return 1;
+        case primitive_type::lines:
+            return 2;
+        }
+        return 0;
     }
 
     constexpr primitive_type get_primitive_type() const { return m_type; }
@@ -138,6 +172,8 @@ public:
     {
         m_vertex_count = count;
         m_data.resize(count * m_vertex_size);
+        invalidate_buffers();
+        m_bounds_dirty = true;
         return m_vertex_count;
     }
 
@@ -146,6 +182,7 @@ public:
     {
         m_primitive_count = count;
         m_indices.resize(count * get_index_count_per_primitive());
+        invalidate_buffers();
         return m_primitive_count;
     }
 
@@ -171,6 +208,7 @@ public:
         uint16_t *index_ptr =
             m_indices.data() + index * get_index_count_per_primitive();
         memcpy(index_ptr, &prim, sizeof(point_primitive));
+        invalidate_buffers();
     }
 
     void get_primitive(uint16_t index, line_primitive &prim) const
@@ -195,6 +233,7 @@ public:
         uint16_t *index_ptr =
             m_indices.data() + index * get_index_count_per_primitive();
         memcpy(index_ptr, &prim, sizeof(line_primitive));
+        invalidate_buffers();
     }
 
     void get_primitive(uint16_t index, triangle_primitive &prim) const
@@ -219,6 +258,7 @@ public:
         uint16_t *index_ptr =
             m_indices.data() + index * get_index_count_per_primitive();
         memcpy(index_ptr, &prim, sizeof(triangle_primitive));
+        invalidate_buffers();
     }
 
     void get_primitive(uint16_t index, quad_primitive &prim) const
@@ -243,12 +283,14 @@ public:
         uint16_t *index_ptr =
             m_indices.data() + index * get_index_count_per_primitive();
         memcpy(index_ptr, &prim, sizeof(quad_primitive));
+        invalidate_buffers();
     }
 
     uint16_t get_bone_count() const { return m_bone_infos.size(); }
     uint16_t set_bone_count(uint16_t count)
     {
         m_bone_infos.resize(count);
+        m_skeleton_id = next_skeleton_id();
         return m_bone_infos.size();
     }
 
@@ -258,6 +300,7 @@ public:
         if (index >= m_bone_infos.size())
             return;
         m_bone_infos[index] = bone;
+        m_skeleton_id       = next_skeleton_id();
     }
 
     void get_bone(uint16_t index, bone_info &bone) const
@@ -282,6 +325,7 @@ public:
             return;
         vertex_ptr += m_color_offset;
         memcpy(vertex_ptr, &c, sizeof(color_t));
+        invalidate_buffers();
     }
 
     void get_color(uint16_t index, color &c) const
@@ -300,6 +344,8 @@ public:
         if (!vertex_ptr)
             return;
         memcpy(vertex_ptr, &pos, sizeof(position_t));
+        invalidate_buffers();
+        m_bounds_dirty = true;
     }
 
     void get_position(uint16_t index, vec3<real> &pos) const
@@ -318,6 +364,7 @@ public:
             return;
         vertex_ptr += m_normal_offset;
         memcpy(vertex_ptr, &norm, sizeof(normal_t));
+        invalidate_buffers();
     }
 
     void get_normal(uint16_t index, vec3<real> &norm) const
@@ -338,6 +385,7 @@ public:
             return;
         vertex_ptr += m_texcoord_offset;
         memcpy(vertex_ptr, &tex, sizeof(texcoord_t));
+        invalidate_buffers();
     }
 
     void get_texcoord(uint16_t index, texcoord_t &tex) const
@@ -358,6 +406,7 @@ public:
             return;
         vertex_ptr += m_boneweight_offset;
         memcpy(vertex_ptr, &bones, sizeof(boneweight_t));
+        invalidate_buffers();
     }
 
     void get_boneweight(uint16_t index, boneweight_t &bones) const
@@ -380,6 +429,24 @@ public:
 
     const vector<bone_info> &get_bones() { return m_bone_infos; }
 
+    /**
+     * @return The box around the bind pose positions, recomputed after they
+     * change. Loading computes it, so models can size their bounds for free.
+     */
+    const aabb &get_bounds() const
+    {
+        if (m_bounds_dirty)
+            update_bounds();
+        return m_bounds;
+    }
+
+    /**
+     * @return An identifier of the current skeleton. It is unique across all
+     * meshes and changes whenever a bone is modified, so it can key caches
+     * derived from the bones.
+     */
+    uint32_t get_skeleton_id() const { return m_skeleton_id; }
+
     /**
      * @brief Renders the model using a given GPU context.
      * @param gpu The GPU interface to use for drawing commands.
@@ -389,10 +456,122 @@ public:
      */
     void render(gpu &gpu, const animator *anim = nullptr) const;
 
+    /**
+     * @brief Renders the bind pose once per model-view matrix, binding the
+     * geometry only once when the GPU supports instancing and falling back to
+     * one `render` per instance otherwise.
+     * @param gpu The GPU interface to use for drawing commands.
+     * @param model_views The matrix loaded into `matrix_mode::modelview` for
+     * each instance. The current modelview matrix is left unchanged.
+     * @param count The number of instances.
+     */
+    void render_instanced(gpu &gpu,
+                          const mat4<real> *model_views,
+                          size_t count) const;
+
+    /**
+     * @brief Enables or disables caching of the bind pose in a display list.
+     *
+     * When enabled (the default), the first `render` call without skinning
+     * compiles the mesh into a `display_list` that is replayed afterwards and
+     * recompiled only after the mesh is modified.
+     */
+    void set_display_list_caching(bool enabled)
+    {
+        if (m_display_list_enabled == enabled)
+            return;
+        m_display_list_enabled = enabled;
+        release_buffers();
+    }
+
+    bool get_display_list_caching() const { return m_display_list_enabled; }
+
+    /**
+     * @brief Enables or disables the vertex streams cache, off by default.
+     *
+     * When enabled, the vertices are also kept as one array per attribute,
+     * rebuilt on first use after the mesh is modified. Immediate mode drawing
+     * and the bounds then read the arrays in order, instead of fetching each
+     * attribute of each vertex from the interleaved data. They take as much
+     * memory again as the vertices.
+     */
+    void set_stream_caching(bool enabled)
+    {
+        m_stream_caching = enabled;
+        if (!enabled)
+            release_vertex_streams();
+    }
+
+    bool get_stream_caching() const { return m_stream_caching; }
+
+    /**
+     * @return The vertices as one array per attribute, valid until the mesh
+     * is modified. They are built if not cached, and kept until the mesh is
+     * modified or `set_stream_caching(false)` is called.
+     */
+    vertex_streams get_vertex_streams() const;
+
+    /**
+     * @brief Releases the retained GPU buffers and display list, if any. They
+     * will be rebuilt on the next call to `render`.
+     */
+    void release_buffers() const;
+
+    /** @return CPU memory held by the mesh, GPU buffers are not counted. */
+    size_t get_memory_used() const override
+    {
+        return sizeof(*this) + m_data.capacity() +
+               m_indices.capacity() * sizeof(uint16_t) +
+               m_bone_infos.capacity() * sizeof(bone_info) +
+               m_skinned_data.capacity() +
+               m_positions.capacity() * sizeof(position_t) +
+               m_normals.capacity() * sizeof(normal_t) +
+               m_colors.capacity() * sizeof(color_t) +
+               m_texcoords.capacity() * sizeof(texcoord_t) +
+               m_bone_weights.capacity() * sizeof(bone_weight);
+    }
+
+    /**
+     * @return GPU memory of the retained and skinned vertex buffers and the
+     * index buffer. Display lists are backend specific and not counted.
+     */
+    size_t get_gpu_memory_used() const override;
+
+    /** @brief Adds the memory and vertex count of the mesh. */
+    void add_cost(scene_cost &cost) const override;
+
 private:
-    vector<uint8_t> m_data;
-    vector<uint16_t> m_indices;
+    vector<uint8_t, resource_allocator<uint8_t>> m_data;
+    vector<uint16_t, resource_allocator<uint16_t>> m_indices;
     vector<bone_info> m_bone_infos;
+    uint32_t m_skeleton_id = next_skeleton_id();
+
+    // Retained copies of m_data/m_indices on the GPU, built lazily by render.
+    mutable gpu *m_buffer_gpu              = nullptr;
+    mutable vertex_buffer *m_vertex_buffer = nullptr;
+    mutable index_buffer *m_index_buffer   = nullptr;
+    mutable display_list *m_display_list   = nullptr;
+    mutable bool m_buffers_dirty           = true;
+    mutable bool m_display_list_dirty      = true;
+    bool m_display_list_enabled            = true;
+
+    // Per-frame output of the CPU skinning pass, same layout as m_data.
+    mutable vector<uint8_t, resource_allocator<uint8_t>> m_skinned_data;
+    mutable vertex_buffer *m_skinned_buffer = nullptr;
+    mutable bool m_skinned_dirty            = true;
+
+    mutable aabb m_bounds;
+    mutable bool m_bounds_dirty = true;
+
+    // Copies of m_data split by attribute, see `get_vertex_streams`.
+    template <class T> using stream = vector<T, resource_allocator<T>>;
+    mutable stream<position_t> m_positions;
+    mutable stream<normal_t> m_normals;
+    mutable stream<color_t> m_colors;
+    mutable stream<texcoord_t> m_texcoords;
+    mutable stream<bone_weight> m_bone_weights;
+    mutable bool m_streams_dirty = true;
+    bool m_stream_caching        = false;
 
     mesh_flags m_flags;
     primitive_type m_type;
@@ -406,6 +585,8 @@ private:
     size_t m_texcoord_offset;
     size_t m_boneweight_offset;
 
+    static uint32_t next_skeleton_id();
+
     uint8_t *get_vertex_ptr(uint16_t index)
     {
         assert(index < m_vertex_count);
@@ -439,11 +620,11 @@ private:
                         (has_color * sizeof(color_t)) +
                         (has_tex * sizeof(texcoord_t)) +
                         (has_bone * sizeof(boneweight_t));
-        m_normal_offset   = 0 + has_normal * sizeof(normal_t);
-        m_color_offset    = m_normal_offset + has_color * sizeof(color_t);
-        m_texcoord_offset = m_color_offset + has_color * sizeof(texcoord_t);
+        m_normal_offset   = sizeof(position_t);
+        m_color_offset    = m_normal_offset + has_normal * sizeof(normal_t);
+        m_texcoord_offset = m_color_offset + has_color * sizeof(color_t);
         m_boneweight_offset =
-            m_texcoord_offset + has_bone * sizeof(boneweight_t);
+            m_texcoord_offset + has_tex * sizeof(texcoord_t);
     }
 
     inline void resize()
@@ -452,6 +633,25 @@ private:
         m_indices.resize(m_primitive_count * get_index_count_per_primitive());
     }
 
+    inline void invalidate_buffers() const
+    {
+        m_buffers_dirty      = true;
+        m_display_list_dirty = true;
+        m_skinned_dirty      = true;
+        m_streams_dirty      = true;
+    }
+
+    void update_bounds() const;
+    void update_vertex_streams() const;
+    void release_vertex_streams() const;
+    vertex_layout get_vertex_layout() const;
+    void bind_gpu(gpu &gpu) const;
+    bool upload_buffers() const;
+    bool render_cached(gpu &gpu) const;
+    bool render_retained(gpu &gpu) const;
+    bool render_skinned(gpu &gpu, const animator &anim) const;
+    void render_immediate(gpu &gpu, const animator *anim) const;
+
     inline void vertex(bool has_normal,
                        bool has_color,
                        bool has_tex,
@@ -488,26 +688,55 @@ private:
         {
             boneweight_t bone_weights;
             get_boneweight(index, bone_weights);
+            gpu.vertex(blend_position(pos, bone_weights, *final_bone_matrices));
+        }
+        else
+            gpu.vertex(pos);
+    }
 
-            size_t bone_count = 0;
+    /** @brief Submits a vertex read from the vertex streams. */
+    inline void vertex(const vertex_streams &streams,
+                       gpu &gpu,
+                       size_t index,
+                       const vector<mat4<real>> *final_bone_matrices) const
+    {
+        if (!streams.normals.empty())
+            gpu.normal(streams.normals[index]);
+        if (!streams.colors.empty())
+            gpu.color(streams.colors[index]);
+        if (!streams.texcoords.empty())
+            gpu.tex_coord(streams.texcoords[index]);
+
+        const vec3<real> &pos = streams.positions[index];
+        if (!streams.bone_weights.empty() && final_bone_matrices)
+            gpu.vertex(blend_position(pos,
+                                      &streams.bone_weights[index * 4],
+                                      *final_bone_matrices));
+        else
+            gpu.vertex(pos);
+    }
 
-            vec3<real> final_position = {0};
-            for (auto j = 0; j < 4; ++j)
+    /** @return The position moved by the weighted bones, as drawn. */
+    static vec3<real> blend_position(const vec3<real> &pos,
+                                     const bone_weight *bone_weights,
+                                     const vector<mat4<real>> &matrices)
+    {
+        vec3<real> final_position = {0};
+        real total_weight         = real(0);
+        for (auto j = 0; j < 4; ++j)
+        {
+            const auto &bw = bone_weights[j];
+            if (bw.bone_id >= 0 && size_t(bw.bone_id) < matrices.size() &&
+                bw.weight > real(0))
             {
-                const auto &bw = bone_weights[j];
-                if (bw.bone_id >= 0 && bw.bone_id < bone_count &&
-                    bw.weight > real(0))
-                {
-                    vec4<real> pos4(pos, 1);
-                    vec4<real> transformed_pos =
-                        final_bone_matrices->operator[](bw.bone_id) * pos4;
-
-                    final_position += transformed_pos.xyz() * bw.weight;
-                }
+                vec4<real> pos4(pos, 1);
+                vec4<real> transformed_pos = matrices[bw.bone_id] * pos4;
+
+                final_position += transformed_pos.xyz() * bw.weight;
+                total_weight += bw.weight;
             }
         }
-        else
-            gpu.vertex(pos);
+        return total_weight > real(0) ? final_position / total_weight : pos;
     }
 
     template <typename T>
@@ -551,8 +780,22 @@ template <> inline result<void> serialize(ice_writer &writer, const mesh &m)
     const bool use_8bit_indices             = m.get_vertex_count() <= 256;
     const uint8_t index_count_per_primitive = m.get_index_count_per_primitive();
 
+    const bool has_normal =
+        (m.m_flags & mesh_flags::normal) != mesh_flags::none;
+    const bool has_color = (m.m_flags & mesh_flags::color) != mesh_flags::none;
+    const bool has_tex   = (m.m_flags & mesh_flags::tex) != mesh_flags::none;
+    const bool has_bone  = (m.m_flags & mesh_flags::bone) != mesh_flags::none;
+
+    // Vertices are stored quantized, smaller than in m_data.
+    const size_t stored_vertex_size =
+        sizeof(ICE_VEC3_R16) + has_normal * sizeof(ICE_NORM3) +
+        has_color * sizeof(uint16_t) + has_tex * sizeof(ICE_VEC2_U16) +
+        has_bone * 4 * sizeof(ICE_VEC2<int16_t, ICE_R16>);
+
     size_t total_size = sizeof(ICE_MESH_HEADER);
-    total_size += m.m_vertex_size * m.get_vertex_count();
+    for (const auto &bone_info : m.m_bone_infos)
+        total_size += sizeof(ICE_BONE_INFO_HEADER) + bone_info.name.size();
+    total_size += stored_vertex_size * m.get_vertex_count();
     total_size += m.get_primitive_count() * index_count_per_primitive *
                   (use_8bit_indices ? 1 : 2);
 
@@ -580,12 +823,6 @@ template <> inline result<void> serialize(ice_writer &writer, const mesh &m)
         writer.write(bone_info.name.c_str(), bone_header.nameLen);
     }
 
-    const bool has_normal =
-        (m.m_flags & mesh_flags::normal) != mesh_flags::none;
-    const bool has_color = (m.m_flags & mesh_flags::color) != mesh_flags::none;
-    const bool has_tex   = (m.m_flags & mesh_flags::tex) != mesh_flags::none;
-    const bool has_bone  = (m.m_flags & mesh_flags::bone) != mesh_flags::none;
-
     // Write vertices
     for (uint16_t i = 0; i < m.get_vertex_count(); ++i)
     {
@@ -665,28 +902,39 @@ template <> inline result<void> deserialize(ice_reader &reader, mesh &m)
 {
     TRACE_FUNCTION;
 
-    ICE_MESH_HEADER header;
-    reader.read(&header, sizeof(header));
+    auto broken = []()
+    {
+        return report_error(error_code::chunk_broken,
+                            mesh::CHUNK_ID.to_string().c_str(),
+                            (uint32_t)mesh::CHUNK_ID);
+    };
 
-    const bool use_8bit_indices = header.is_index_8bit();
+    ICE_MESH_HEADER header;
+    if (reader.read(header) != sizeof(header))
+        return report_error(error_code::unable_to_read);
 
+    // The layout first, the counts size the arrays by it.
+    m.init(header.flags(), header.type());
     m.set_vertex_count(header.vertexCount);
     m.set_primitive_count(header.primitiveCount);
     m.set_bone_count(header.boneCount);
 
-    m.init(header.flags(), header.type());
-
     // Read bone info
     for (uint16_t i = 0; i < header.boneCount; ++i)
     {
         ICE_BONE_INFO_HEADER bone_header;
-        reader.read(&bone_header, sizeof(bone_header));
+        if (reader.read(bone_header) != sizeof(bone_header))
+            return report_error(error_code::unable_to_read);
+
+        char name_buf[33] = {};
+        if (bone_header.nameLen >= sizeof(name_buf))
+            return broken();
 
         bone_info bone;
         bone.offset_transform = bone_header.offset;
 
-        char name_buf[33] = {};
-        reader.read(name_buf, bone_header.nameLen);
+        if (reader.read(name_buf, bone_header.nameLen) != bone_header.nameLen)
+            return report_error(error_code::unable_to_read);
         bone.name    = name_buf;
         bone.bone_id = i;
 
@@ -701,75 +949,98 @@ template <> inline result<void> deserialize(ice_reader &reader, mesh &m)
     const bool has_bone =
         (header.flags() & mesh_flags::bone) != mesh_flags::none;
 
-    // Read vertices
-    for (uint16_t i = 0; i < header.vertexCount; ++i)
+    const size_t vertex_count = header.vertexCount;
+    const size_t index_count  = m.m_indices.size();
+    const size_t index_size   = header.is_index_8bit() ? 1 : 2;
+
+    const size_t stored_vertex_size =
+        sizeof(ICE_VEC3_R16) + has_normal * sizeof(ICE_NORM3) +
+        has_color * sizeof(uint16_t) + has_tex * sizeof(ICE_VEC2_U16) +
+        has_bone * 4 * sizeof(ICE_VEC2<int16_t, ICE_R16>);
+
+    const size_t payload_size =
+        stored_vertex_size * vertex_count + index_size * index_count;
+
+    // Memory-backed streams lend the vertices and indices in place, others
+    // read them whole once. Either way they decode from memory.
+    vector<uint8_t> owned;
+    const uint8_t *payload = reader.view(payload_size);
+    if (!payload)
     {
-        position_t pos;
-        ICE_VEC3_R16 p;
-        reader.read(&p, sizeof(p));
-        pos = p;
-        m.set_position(i, pos);
+        owned.resize(payload_size);
+        if (reader.read(owned.data(), payload_size) != payload_size)
+            return report_error(error_code::unable_to_read);
+        payload = owned.data();
+    }
+
+    // The ICE structs are packed, so they can be read at any address.
+    const uint8_t *src = payload;
+    uint8_t *dst       = m.m_data.data();
+    for (size_t i = 0; i < vertex_count; ++i)
+    {
+        const position_t pos = *(const ICE_VEC3_R16 *)src;
+        memcpy(dst, &pos, sizeof(pos));
+        src += sizeof(ICE_VEC3_R16);
 
         if (has_normal)
         {
-            normal_t norm;
-            ICE_NORM3 n;
-            reader.read(&n, sizeof(n));
-            norm = n;
-            m.set_normal(i, norm);
+            const normal_t norm = *(const ICE_NORM3 *)src;
+            memcpy(dst + m.m_normal_offset, &norm, sizeof(norm));
+            src += sizeof(ICE_NORM3);
         }
 
         if (has_color)
         {
-            color_t c;
             color5551 ic;
-            reader.read(&ic.value, sizeof(ic.value));
-            c = ic.as_color();
-            m.set_color(i, c);
+            memcpy(&ic.value, src, sizeof(ic.value));
+            const color_t c = ic.as_color();
+            memcpy(dst + m.m_color_offset, &c, sizeof(c));
+            src += sizeof(ic.value);
         }
 
         if (has_tex)
         {
-            texcoord_t uv;
-            ICE_VEC2_U16 iuv;
-            reader.read(&iuv, sizeof(iuv));
-            uv = iuv;
-            m.set_texcoord(i, uv);
+            const texcoord_t uv = *(const ICE_VEC2_U16 *)src;
+            memcpy(dst + m.m_texcoord_offset, &uv, sizeof(uv));
+            src += sizeof(ICE_VEC2_U16);
         }
 
         if (has_bone)
         {
+            const auto *ibones = (const ICE_VEC2<int16_t, ICE_R16> *)src;
             boneweight_t bones;
-            ICE_VEC2<int16_t, ICE_R16> ibones[4];
-            reader.read(ibones, sizeof(ibones));
             for (int j = 0; j < 4; ++j)
             {
                 bones[j].bone_id = ibones[j].x;
                 bones[j].weight  = ibones[j].y;
             }
-            m.set_boneweight(i, bones);
+            memcpy(dst + m.m_boneweight_offset, &bones, sizeof(bones));
+            src += 4 * sizeof(ICE_VEC2<int16_t, ICE_R16>);
         }
-    }
 
-    const size_t primitive_size = m.get_index_count_per_primitive();
+        dst += m.m_vertex_size;
+    }
 
     // Read indices
+    uint16_t *indices = m.m_indices.data();
     if (header.is_index_8bit())
     {
-        uint8_t primitive[4];
-        for (uint16_t i = 0; i < header.primitiveCount; ++i)
-        {
-            reader.read(&primitive[0], primitive_size);
-            for (size_t j = 0; j < primitive_size; ++j)
-                m.m_indices[i * primitive_size + j] = primitive[j];
-        }
+        for (size_t i = 0; i < index_count; ++i)
+            indices[i] = src[i];
     }
     else
     {
-        reader.read(m.m_indices.data(),
-                    header.primitiveCount * primitive_size * sizeof(uint16_t));
+        memcpy(indices, src, index_count * sizeof(uint16_t));
     }
 
+    // Drawing trusts the indices, a broken chunk must not reach past the
+    // vertices.
+    for (size_t i = 0; i < index_count; ++i)
+        if (indices[i] >= vertex_count)
+            return broken();
+
+    m.invalidate_buffers();
+    m.update_bounds();
     return error_code::ok;
 }
 
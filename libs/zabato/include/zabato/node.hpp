@@ -3,6 +3,8 @@
 #include "object.hpp"
 #include "spatial.hpp"
 
+#include <zabato/small_vector.hpp>
+
 namespace zabato
 {
 class xml_serializer;
@@ -31,8 +33,22 @@ public:
     pointer<spatial> child_at(int index) { return m_children[index]; }
     pointer<spatial> set_child_at(int index, spatial *child);
 
+    void collect_visible(const frustum &f,
+                         uint32_t mask,
+                         vector<spatial *> &visible) override;
+
+    /** @return The node with the child list, without the children. */
+    int get_memory_used() const override;
+
 protected:
-    vector<pointer<spatial>> m_children;
+    void mark_world_dirty() override;
+
+    /** @brief Merges the model bound with the bounds of every child. */
+    void update_world_bound() override;
+
+    /** Most nodes hold a handful of children, kept inline. */
+    small_vector<pointer<spatial>, 4, scene_allocator<pointer<spatial>>>
+        m_children;
 };
 
 } // namespace zabato
\ No newline at end of file
@@ -0,0 +1,306 @@
+#pragma once
+
+#include <zabato/gpu.hpp>
+#include <zabato/span.hpp>
+#include <zabato/vector.hpp>
+
+namespace zabato
+{
+/** @brief The calls of the `gpu` interface, overloads sharing one. */
+enum class gpu_call : uint8_t
+{
+    new_frame,
+    begin,
+    end,
+    vertex,
+    color,
+    normal,
+    tex_coord,
+    clear,
+    viewport,
+    set_matrix_mode,
+    perspective_fov,
+    ortho,
+    translate,
+    rotate,
+    scale,
+    load_identity,
+    load_matrix,
+    push_matrix,
+    pop_matrix,
+    set_shade_model,
+    enable_lighting,
+    set_light,
+    set_material,
+    create_texture,
+    bind_texture,
+    unbind_texture,
+    create_display_list,
+    begin_display_list,
+    end_display_list,
+    call_display_list,
+    create_vertex_buffer,
+    create_index_buffer,
+    draw_indexed,
+    draw_indexed_range,
+    draw_skinned,
+    draw_instanced,
+    begin_timing,
+    end_timing,
+    enable_fog,
+    set_fog_start,
+    set_fog_end,
+    set_fog_color,
+    enable_depth_test,
+    enable_blend,
+    set_blend_func,
+    enable_scissor_test,
+    set_scissor,
+    set_viewport_rect,
+    count
+};
+
+/** @return The name of the `gpu` method, e.g. "draw_indexed". */
+const char *get_gpu_call_name(gpu_call call);
+
+/**
+ * @class null_gpu
+ * @brief A `gpu` that draws nothing and only counts what it is sent, for
+ * running the renderer headless, e.g. in benchmarks on machines without a
+ * display.
+ *
+ * Timing the engine against it measures the CPU side of submission alone,
+ * without the driver. It also counts, and when asked records, the sequence
+ * of calls, so it doubles as a replay target checking what a
+ * `command_buffer` or a renderer sends.
+ *
+ * Its retained buffers keep their sizes but no data, so meshes take the same
+ * retained paths they take on a real device. Every state call counts as a
+ * state change, since there is no state to compare against.
+ */
+class null_gpu : public gpu
+{
+public:
+    null_gpu()                            = default;
+    null_gpu(const null_gpu &)            = delete;
+    null_gpu &operator=(const null_gpu &) = delete;
+
+    /** @return The calls made since construction, of any kind. */
+    size_t get_command_count() const { return m_commands; }
+
+    /** @return The calls of one kind made since construction. */
+    size_t get_call_count(gpu_call call) const
+    {
+        return m_call_counts[size_t(call)];
+    }
+
+    /**
+     * @brief Starts or stops keeping the sequence of calls, appended to
+     * what was kept before.
+     */
+    void set_recording(bool recording) { m_recording = recording; }
+    bool is_recording() const { return m_recording; }
+
+    /** @return The calls made while recording, in order. */
+    span<const gpu_call> get_recorded_calls() const { return m_recorded; }
+
+    /** @brief Drops the recorded calls, keeping the memory. */
+    void clear_recorded_calls() { m_recorded.clear(); }
+
+    void new_frame() override;
+    void begin(primitive_type type) override;
+    void end() override { count_call(gpu_call::end); }
+    void vertex(const vec3<real> &v) override;
+    void vertex(real x, real y, real z) override;
+    void color(const class color &c) override { count_call(gpu_call::color); }
+    void color(real r, real g, real b, real a = real(1)) override
+    {
+        count_call(gpu_call::color);
+    }
+    void normal(const vec3<real> &n) override { count_call(gpu_call::normal); }
+    void normal(real x, real y, real z) override
+    {
+        count_call(gpu_call::normal);
+    }
+    void tex_coord(const vec2<real> &uv) override
+    {
+        count_call(gpu_call::tex_coord);
+    }
+    void tex_coord(real u, real v) override { count_call(gpu_call::tex_coord); }
+    void clear(const struct color &c, real depth) override
+    {
+        count_call(gpu_call::clear);
+    }
+    void viewport(int width, int height) override
+    {
+        count_state(gpu_call::viewport);
+    }
+
+    void set_matrix_mode(matrix_mode mode) override
+    {
+        count_call(gpu_call::set_matrix_mode);
+    }
+    void perspective_fov(real fov, real aspect, real near, real far) override
+    {
+        count_call(gpu_call::perspective_fov);
+    }
+    void ortho(real left,
+               real right,
+               real bottom,
+               real top,
+               real near,
+               real far) override
+    {
+        count_call(gpu_call::ortho);
+    }
+    void translate(const vec3<real> &t) override
+    {
+        count_call(gpu_call::translate);
+    }
+    void translate(real x, real y, real z) override
+    {
+        count_call(gpu_call::translate);
+    }
+    void rotate(const vec3<real> &r) override { count_call(gpu_call::rotate); }
+    void rotate(real x, real y, real z) override
+    {
+        count_call(gpu_call::rotate);
+    }
+    void scale(const vec3<real> &s) override { count_call(gpu_call::scale); }
+    void scale(real x, real y, real z) override
+    {
+        count_call(gpu_call::scale);
+    }
+    void load_identity() override { count_call(gpu_call::load_identity); }
+    void load_matrix(const mat4<real> &m) override
+    {
+        count_call(gpu_call::load_matrix);
+    }
+    void push_matrix() override { count_call(gpu_call::push_matrix); }
+    void pop_matrix() override { count_call(gpu_call::pop_matrix); }
+
+    void set_shade_model(shade_model model) override
+    {
+        count_state(gpu_call::set_shade_model);
+    }
+    void enable_lighting(bool enabled) override
+    {
+        count_state(gpu_call::enable_lighting);
+    }
+    void set_light(int id, const light *l) override
+    {
+        count_state(gpu_call::set_light);
+    }
+    void set_material(const material *m) override
+    {
+        count_state(gpu_call::set_material);
+    }
+
+    texture *create_texture(uint16_t width,
+                            uint16_t height,
+                            color_format format) override;
+    void bind_texture(texture *tex) override;
+    void unbind_texture() override;
+
+    display_list *create_display_list() override;
+    void begin_display_list(display_list *list) override
+    {
+        count_call(gpu_call::begin_display_list);
+    }
+    void end_display_list() override
+    {
+        count_call(gpu_call::end_display_list);
+    }
+    void call_display_list(const display_list *list) override;
+
+    vertex_buffer *create_vertex_buffer() override;
+    index_buffer *create_index_buffer() override;
+    void draw_indexed(primitive_type type,
+                      const vertex_buffer *vertices,
+                      const index_buffer *indices) override;
+    void draw_indexed_range(primitive_type type,
+                            const vertex_buffer *vertices,
+                            const index_buffer *indices,
+                            size_t first_index,
+                            size_t index_count) override;
+    bool draw_skinned(primitive_type type,
+                      const vertex_buffer *vertices,
+                      const index_buffer *indices,
+                      const mat4<real> *palette,
+                      size_t palette_size) override;
+    bool draw_instanced(primitive_type type,
+                        const vertex_buffer *vertices,
+                        const index_buffer *indices,
+                        const mat4<real> *model_views,
+                        size_t count) override;
+
+    void begin_timing(const char *name) override
+    {
+        count_call(gpu_call::begin_timing);
+    }
+    void end_timing() override { count_call(gpu_call::end_timing); }
+    span<const gpu_timing> get_timings() const override { return {}; }
+    gpu_frame_stats get_frame_stats() const override { return m_frame_stats; }
+
+    void enable_fog(bool enabled) override
+    {
+        count_state(gpu_call::enable_fog);
+    }
+    void set_fog_start(float start) override
+    {
+        count_state(gpu_call::set_fog_start);
+    }
+    void set_fog_end(float end) override { count_state(gpu_call::set_fog_end); }
+    void set_fog_color(const struct color &c) override
+    {
+        count_state(gpu_call::set_fog_color);
+    }
+
+    void enable_depth_test(bool enabled) override
+    {
+        count_state(gpu_call::enable_depth_test);
+    }
+    void enable_blend(bool enabled) override
+    {
+        count_state(gpu_call::enable_blend);
+    }
+    void set_blend_func(blend_factor src, blend_factor dst) override
+    {
+        count_state(gpu_call::set_blend_func);
+    }
+    void enable_scissor_test(bool enabled) override
+    {
+        count_state(gpu_call::enable_scissor_test);
+    }
+    void set_scissor(int x, int y, int width, int height) override
+    {
+        count_state(gpu_call::set_scissor);
+    }
+    void set_viewport_rect(int x, int y, int width, int height) override
+    {
+        count_state(gpu_call::set_viewport_rect);
+    }
+
+private:
+    void count_call(gpu_call call)
+    {
+        ++m_commands;
+        ++m_call_counts[size_t(call)];
+        if (m_recording)
+            m_recorded.push_back(call);
+    }
+    void count_state(gpu_call call)
+    {
+        count_call(call);
+        ++m_frame_stats.state_changes;
+    }
+    void count_draw(gpu_call call, size_t vertices);
+
+    size_t m_commands                             = 0;
+    size_t m_call_counts[size_t(gpu_call::count)] = {};
+    bool m_recording                              = false;
+    vector<gpu_call> m_recorded;
+    gpu_frame_stats m_frame_stats;
+    texture *m_bound_texture = nullptr;
+};
+} // namespace zabato
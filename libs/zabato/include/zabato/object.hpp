@@ -3,8 +3,11 @@
 #include <tinyxml2.h>
 
 #include <zabato/hash_map.hpp>
+#include <zabato/object_registry.hpp>
 #include <zabato/resource.hpp>
 #include <zabato/rtti.hpp>
+#include <zabato/small_vector.hpp>
+#include <zabato/symbol.hpp>
 #include <zabato/uuid.hpp>
 #include <zabato/vector.hpp>
 #include <zabato/xml_serializer.hpp>
@@ -19,7 +22,133 @@ class world;
 class controller;
 struct symbol;
 
-template <class T> class pointer;
+/**
+ * @brief Smart pointer class for automatic reference counting management.
+ *
+ * This class provides intrusive reference counting semantics for objects
+ * derived from `object`. It automatically calls add_ref() when a pointer is
+ * attached/copied and release() when the pointer is destroyed or reassigned.
+ * This ensures objects are not deleted while valid references exist and are
+ * automatically cleaned up when the last reference is dropped.
+ *
+ * @tparam T The type of object pointed to. Must inherit from `object`.
+ */
+template <class T> class pointer
+{
+public:
+    /**
+     * @brief Constructs a smart pointer from a raw pointer.
+     *
+     * Increments the reference count of the target object if it is not null.
+     *
+     * @param ptr The raw pointer to take ownership of. Defaults to nullptr.
+     */
+    pointer(T *ptr = nullptr)
+    {
+        m_object = ptr;
+        if (m_object)
+            m_object->add_ref();
+    }
+
+    /**
+     * @brief Copy constructor.
+     *
+     * Shares ownership of the object pointed to by `ptr`. Increments the
+     * reference count.
+     *
+     * @param ptr The other smart pointer to copy from.
+     */
+    pointer(const pointer &ptr)
+    {
+        m_object = ptr.m_object;
+        if (m_object)
+            m_object->add_ref();
+    }
+
+    /**
+     * @brief Destructor.
+     *
+     * Decrements the reference count of the managed object. If the count
+     * reaches zero, the object automatically deletes itself (via
+     * `object::release`).
+     */
+    ~pointer()
+    {
+        if (m_object)
+            m_object->release();
+    }
+
+    operator T *() const { return m_object; }
+    T &operator*() const { return *m_object; }
+    T *operator->() const { return m_object; }
+
+    /**
+     * @brief Assignment operator from raw pointer.
+     *
+     * Releases the currently held object (if any) and takes shared ownership of
+     * the new object. Handles self-assignment checks implicitly via logic order
+     * or explicit checks.
+     *
+     * @param obj The new raw pointer to manage.
+     * @return Reference to this smart pointer.
+     */
+    pointer &operator=(T *obj)
+    {
+        if (m_object == obj)
+            return *this;
+
+        if (obj)
+            obj->add_ref();
+
+        if (m_object)
+            m_object->release();
+
+        m_object = obj;
+
+        return *this;
+    }
+
+    /**
+     * @brief Assignment operator from another smart pointer.
+     *
+     * Releases the currently held object (if any) and shares ownership of the
+     * object held by `reference`.
+     *
+     * @param reference The other smart pointer to assign from.
+     * @return Reference to this smart pointer.
+     */
+    pointer &operator=(const pointer &reference)
+    {
+        if (m_object == reference.m_object)
+            return *this;
+
+        if (reference.m_object)
+            reference.m_object->add_ref();
+
+        if (m_object)
+            m_object->release();
+
+        m_object = reference.m_object;
+
+        return *this;
+    }
+
+    bool operator==(T *obj) const { return m_object == obj; }
+    bool operator!=(T *obj) const { return m_object != obj; }
+
+    bool operator==(const pointer &reference) const
+    {
+        return m_object == reference.m_object;
+    }
+
+    bool operator!=(const pointer &reference) const
+    {
+        return m_object != reference.m_object;
+    }
+
+protected:
+    T *m_object;
+};
 
 class object
 {
@@ -27,6 +156,9 @@ public:
     object();
     virtual ~object();
 
+    object(const object &)            = delete;
+    object &operator=(const object &) = delete;
+
 #pragma region Type
     static const rtti TYPE;
 
@@ -130,6 +262,15 @@ public:
      */
     uuid id() const { return m_uiID; }
 
+    /**
+     * @brief Set the unique ID, for loaders restoring a saved object.
+     * @param id The ID the object was saved with.
+     */
+    void set_id(uuid id);
+
+    /** @return The handle of this object in `get_registry()`. */
+    pool_handle handle() const { return m_handle; }
+
     /**
      * @brief Search for an object by its unique ID.
      * @param uiID The ID to search for.
@@ -147,14 +288,21 @@ public:
     typedef object *(*factory_function)(serializer &);
     typedef object *(*factory_function_xml)(xml_serializer &serializer,
                                             tinyxml2::XMLElement &element);
+    typedef object *(*create_function)();
 
     enum
     {
         FACTORY_MAP_SIZE = 256
     };
 
-    static hash_map<string, factory_function> *s_factory;
-    static hash_map<string, factory_function_xml> *s_factory_xml;
+    /** @brief Factory maps keyed by `rtti::name_symbol`. */
+    template <typename F>
+    using factory_map = hash_map<const symbol *, F, symbol_ptr_hasher>;
+
+    static factory_map<factory_function> *s_factory;
+    static factory_map<factory_function_xml> *s_factory_xml;
+    /** @brief Creates default constructed objects, for `scene_file`. */
+    static factory_map<create_function> *s_factory_create;
 
     /**
      * @brief Register the factory for this class.
@@ -177,7 +325,8 @@ public:
      *
      * This method reads the RTTI type name from the stream, looks up the
      * corresponding factory function in the global registry, and invokes it to
-     * instantiate and load the object.
+     * instantiate and load the object. The name is looked up as an interned
+     * symbol, never interning names of unknown types.
      *
      * @param stream The serializer stream containing the object data.
      * @return A pointer to the created object, or nullptr if the factory is not
@@ -187,6 +336,15 @@ public:
     static object *factory(xml_serializer &serializer,
                            tinyxml2::XMLElement &element);
 
+    /**
+     * @brief Looks up the function creating a type, to create many objects
+     * of it without looking up its name each time.
+     * @param type_name The RTTI type name.
+     * @return The function, or nullptr if the factory is not initialized or
+     * the type is unknown.
+     */
+    static create_function find_create_function(const char *type_name);
+
     /**
      * @brief Load object data from a stream.
      * @param stream The stream to read from.
@@ -237,16 +395,29 @@ public:
 
     /**
      * @brief Get the memory usage of this object.
+     *
+     * Each type adds the bytes of its members past its base class and what
+     * they own on the heap, as `node` does, so types that add members should
+     * override it. Controllers and child spatials are objects of their own
+     * and are not counted.
+     *
      * @return Memory used in bytes.
      */
     virtual int get_memory_used() const;
 
     /**
      * @brief Get the disk space usage of this object.
-     * @return Disk space used in bytes.
+     * @return The bytes `save` writes for this object.
      */
     virtual int get_disk_used() const;
 
+    /**
+     * @brief Adds what this object costs a scene: its memory and disk space.
+     * Types holding resources, e.g. a mesh or an animator, override it to
+     * add theirs through `resource::add_cost` or `animator::add_cost`.
+     */
+    virtual void add_cost(scene_cost &cost) const;
+
     /**
      * @brief Save the object's representation to a string tree.
      * @param tree The string tree to append data to.
@@ -255,7 +426,11 @@ public:
 #pragma endregion Streaming
 
 #pragma region Reference Count
-    static hash_map<uuid, object *> s_in_use;
+    /**
+     * @brief The index of every live object, by handle, id and name.
+     * @return The registry, created by the first object.
+     */
+    static object_registry &get_registry();
     static void print_in_use(const char *file, const char *acMessage) {}
 
     /**
@@ -289,6 +464,9 @@ public:
 #pragma endregion World
 
 #pragma region Controllers
+    /** @brief Objects rarely carry more than a couple of controllers. */
+    using controller_list = small_vector<pointer<controller>, 2>;
+
     /**
      * @brief Add a controller to this object.
      * @param ctrl The controller to add.
@@ -330,7 +508,7 @@ public:
      * @brief Get all controllers attached to this object.
      * @return The list of controllers.
      */
-    const vector<pointer<controller>> &get_controllers() const
+    const controller_list &get_controllers() const
     {
         return m_controllers;
     }
@@ -340,8 +518,9 @@ private:
     symbol *m_name;
     uuid m_uiID;
     unsigned int m_uiRefCount;
+    pool_handle m_handle;
 
-    vector<pointer<controller>> m_controllers;
+    controller_list m_controllers;
 };
 
 /**
@@ -378,132 +557,4 @@ template <class T> const T *c_dynamic_cast(const object *obj)
     return obj && obj->is_derived(T::TYPE) ? (const T *)obj : nullptr;
 }
 
-/**
- * @brief Smart pointer class for automatic reference counting management.
- *
- * This class provides intrusive reference counting semantics for objects
- * derived from `object`. It automatically calls add_ref() when a pointer is
- * attached/copied and release() when the pointer is destroyed or reassigned.
- * This ensures objects are not deleted while valid references exist and are
- * automatically cleaned up when the last reference is dropped.
- *
- * @tparam T The type of object pointed to. Must inherit from `object`.
- */
-template <class T> class pointer
-{
-public:
-    /**
-     * @brief Constructs a smart pointer from a raw pointer.
-     *
-     * Increments the reference count of the target object if it is not null.
-     *
-     * @param ptr The raw pointer to take ownership of. Defaults to nullptr.
-     */
-    pointer(T *ptr = nullptr)
-    {
-        m_object = ptr;
-        if (m_object)
-            m_object->add_ref();
-    }
-
-    /**
-     * @brief Copy constructor.
-     *
-     * Shares ownership of the object pointed to by `ptr`. Increments the
-     * reference count.
-     *
-     * @param ptr The other smart pointer to copy from.
-     */
-    pointer(const pointer &ptr)
-    {
-        m_object = ptr.m_object;
-        if (m_object)
-            m_object->add_ref();
-    }
-
-    /**
-     * @brief Destructor.
-     *
-     * Decrements the reference count of the managed object. If the count
-     * reaches zero, the object automatically deletes itself (via
-     * `object::release`).
-     */
-    ~pointer()
-    {
-        if (m_object)
-            m_object->release();
-    }
-
-    operator T *() const { return m_object; }
-    T &operator*() const { return *m_object; }
-    T *operator->() const { return m_object; }
-
-    /**
-     * @brief Assignment operator from raw pointer.
-     *
-     * Releases the currently held object (if any) and takes shared ownership of
-     * the new object. Handles self-assignment checks implicitly via logic order
-     * or explicit checks.
-     *
-     * @param obj The new raw pointer to manage.
-     * @return Reference to this smart pointer.
-     */
-    pointer &operator=(T *obj)
-    {
-        if (m_object == obj)
-            return *this;
-
-        if (obj)
-            obj->add_ref();
-
-        if (m_object)
-            m_object->release();
-
-        m_object = obj;
-
-        return *this;
-    }
-
-    /**
-     * @brief Assignment operator from another smart pointer.
-     *
-     * Releases the currently held object (if any) and shares ownership of the
-     * object held by `reference`.
-     *
-     * @param reference The other smart pointer to assign from.
-     * @return Reference to this smart pointer.
-     */
-    pointer &operator=(const pointer &reference)
-    {
-        if (m_object == reference.m_object)
-            return *this;
-
-        if (reference.m_object)
-            reference.m_object->add_ref();
-
-        if (m_object)
-            m_object->release();
-
-        m_object = reference.m_object;
-
-        return *this;
-    }
-
-    bool operator==(T *obj) const { return m_object == obj; }
-    bool operator!=(T *obj) const { return m_object != obj; }
-
-    bool operator==(const pointer &reference) const
-    {
-        return m_object == reference.m_object;
-    }
-
-    bool operator!=(const pointer &reference) const
-    {
-        return m_object != reference.m_object;
-    }
-
-protected:
-    T *m_object;
-};
-
 } // namespace zabato
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <zabato/hash_map.hpp>
+#include <zabato/pool.hpp>
+#include <zabato/symbol.hpp>
+#include <zabato/thread.hpp>
+#include <zabato/uuid.hpp>
+#include <zabato/vector.hpp>
+
+#include <stdint.h>
+
+namespace zabato
+{
+class object;
+
+/**
+ * @class object_registry
+ * @brief Indexes the live objects by handle, by id and by name.
+ *
+ * Every object adds itself on construction and removes itself on
+ * destruction, and keeps the index up to date when it is renamed or given
+ * another id, so looking an object up costs one hash probe however large the
+ * scene is. Objects sharing a name are chained through their slots, most
+ * recently named first.
+ *
+ * Handles are the `pool_handle`s of the slots: stale handles stop resolving
+ * instead of reaching the object reusing the slot. Objects past `max_size`
+ * get the zero handle and are not indexed.
+ *
+ * Objects may be created on any thread, e.g. by `resource_manager::load_batch`,
+ * so every call takes the registry's lock.
+ */
+class object_registry
+{
+public:
+    /** @brief The most objects indexed at once, the reach of the handles. */
+    static constexpr size_t max_size = pool_handle::index_mask + 1;
+
+    object_registry()                                   = default;
+    object_registry(const object_registry &)            = delete;
+    object_registry &operator=(const object_registry &) = delete;
+
+    /**
+     * @brief Indexes an object by its id and name.
+     * @return The handle of the object, or the zero handle if the registry
+     * is full.
+     */
+    pool_handle add(object *obj, uuid id, const symbol *name);
+
+    /** @brief Drops an object, given the id and name it is indexed by. */
+    void remove(pool_handle handle, uuid id, const symbol *name);
+
+    /** @brief Moves an object from one name to another in the name index. */
+    void rename(pool_handle handle, const symbol *from, const symbol *to);
+
+    /** @brief Moves an object from one id to another in the id index. */
+    void change_id(pool_handle handle, uuid from, uuid to);
+
+    /** @return The object of a handle, or null if it is stale. */
+    object *find(pool_handle handle) const;
+
+    /**
+     * @return The object with an id, or null. Ids are expected to be unique;
+     * when they are not, the first object indexed keeps the id.
+     */
+    object *find(uuid id) const;
+
+    /** @return The object most recently given a name, or null. */
+    object *find_by_name(const symbol *name) const;
+
+    /** @brief Appends every object with a name, most recently named first. */
+    void find_all_by_name(const symbol *name, vector<object *> &objects) const;
+
+    /** @return The number of live objects indexed. */
+    size_t size() const;
+
+private:
+    static constexpr uint32_t end_of_list = 0xFFFFFFFF;
+    static constexpr uint32_t max_generation =
+        0xFFFFFFFF >> pool_handle::index_bits;
+
+    struct slot
+    {
+        object *obj         = nullptr;
+        uint32_t generation = 1;
+        uint32_t prev_name  = end_of_list; ///< Next free slot if not live.
+        uint32_t next_name  = end_of_list;
+    };
+
+    uint32_t index_of(pool_handle handle) const;
+    void link_name(uint32_t index, const symbol *name);
+    void unlink_name(uint32_t index, const symbol *name);
+
+    mutable mutex m_mutex;
+    vector<slot> m_slots;
+    uint32_t m_free_head = end_of_list;
+    size_t m_count       = 0;
+    hash_map<uuid, uint32_t> m_by_id;
+    hash_map<const symbol *, uint32_t, symbol_ptr_hasher> m_by_name;
+};
+} // namespace zabato
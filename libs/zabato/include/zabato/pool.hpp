@@ -1,8 +1,13 @@
 #pragma once
 
+#include <zabato/utils.hpp>
+#include <zabato/vector.hpp>
+
 #include <assert.h>
+#include <new>
 #include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
 namespace zabato
 {
@@ -72,4 +77,263 @@ public:
     size_t count() const { return m_used_count; }
     size_t capacity() const { return N; }
 };
+
+/**
+ * @brief A 32-bit reference to an object of an `object_pool`.
+ *
+ * The low bits hold the slot index and the high bits the generation of the
+ * slot when the object was created. Destroying the object bumps the
+ * generation, so handles to it stop resolving instead of reaching whatever
+ * reuses the slot. The zero handle is never valid.
+ */
+struct pool_handle
+{
+    static constexpr uint32_t index_bits = 20;
+    static constexpr uint32_t index_mask = (1u << index_bits) - 1;
+
+    uint32_t value = 0;
+
+    uint32_t get_index() const { return value & index_mask; }
+    uint32_t get_generation() const { return value >> index_bits; }
+    explicit operator bool() const { return value != 0; }
+
+    bool operator==(const pool_handle &other) const
+    {
+        return value == other.value;
+    }
+    bool operator!=(const pool_handle &other) const
+    {
+        return value != other.value;
+    }
+};
+
+/**
+ * @class object_pool
+ * @brief A pool that grows in pages of `PageSize` objects without moving
+ * them, referenced through generation-checked `pool_handle`s.
+ *
+ * Objects are constructed by `create` and destroyed by `destroy`, `clear` or
+ * the pool, and keep their address while alive. Freed slots are reused most
+ * recently freed first. Live objects are also listed densely, so iterating
+ * them visits no free slots; `destroy` swaps the last one into the hole, so
+ * objects destroyed while iterating should be visited back to front.
+ *
+ * @tparam T The type of the objects.
+ * @tparam PageSize The objects allocated at once when the pool grows.
+ */
+template <typename T, size_t PageSize = 64> class object_pool
+{
+public:
+    static_assert(PageSize > 0, "object_pool pages hold at least one object");
+
+    /** @brief The most objects a pool can hold, the reach of the index. */
+    static constexpr size_t max_size = pool_handle::index_mask + 1;
+
+    object_pool() = default;
+    ~object_pool()
+    {
+        clear();
+        for (page *p : m_pages)
+            delete p;
+    }
+
+    object_pool(const object_pool &)            = delete;
+    object_pool &operator=(const object_pool &) = delete;
+
+    /**
+     * @brief Constructs an object in a free slot, adding a page if needed.
+     * @return The handle of the object, or the zero handle if the pool is at
+     * `max_size`.
+     */
+    template <typename... Args> pool_handle create(Args &&...args)
+    {
+        if (m_free_head == end_of_list && !grow())
+            return {};
+
+        const uint32_t index = m_free_head;
+        slot_info &info      = m_slots[index];
+        m_free_head          = info.link;
+
+        new (address(index)) T(forward<Args>(args)...);
+        info.link = (uint32_t)m_dense.size();
+        m_dense.push_back(index);
+        return make_handle(index, info.generation);
+    }
+
+    /**
+     * @brief Destroys the object of a handle.
+     * @return False if the handle was stale or zero.
+     */
+    bool destroy(pool_handle handle)
+    {
+        if (!is_valid(handle))
+            return false;
+
+        const uint32_t index = handle.get_index();
+        slot_info &info      = m_slots[index];
+        address(index)->~T();
+
+        // The last live object takes the place of this one in the dense list.
+        const uint32_t moved = m_dense.back();
+        m_dense[info.link]   = moved;
+        m_slots[moved].link  = info.link;
+        m_dense.pop_back();
+
+        info.generation = next_generation(info.generation);
+        info.link       = m_free_head;
+        m_free_head     = index;
+        return true;
+    }
+
+    /** @return True if the handle refers to a live object. */
+    bool is_valid(pool_handle handle) const
+    {
+        const uint32_t index = handle.get_index();
+        return handle && index < m_slots.size() &&
+               m_slots[index].generation == handle.get_generation();
+    }
+
+    /** @return The object of a handle, or null if it is stale. */
+    T *get(pool_handle handle)
+    {
+        return is_valid(handle) ? address(handle.get_index()) : nullptr;
+    }
+
+    /** @copydoc get */
+    const T *get(pool_handle handle) const
+    {
+        return is_valid(handle) ? address(handle.get_index()) : nullptr;
+    }
+
+    /** @brief Destroys every object, keeping the pages. */
+    void clear()
+    {
+        while (!m_dense.empty())
+            destroy(handle_at(m_dense.size() - 1));
+    }
+
+    /** @brief Adds pages until `count` objects fit without growing. */
+    bool reserve(size_t count)
+    {
+        while (capacity() < count)
+            if (!grow())
+                return false;
+        return true;
+    }
+
+    /** @return The number of live objects. */
+    size_t size() const { return m_dense.size(); }
+
+    /** @return The number of objects that fit in the current pages. */
+    size_t capacity() const { return m_pages.size() * PageSize; }
+
+    /** @return The `i`-th live object, in dense order. */
+    T &at(size_t i) { return *address(m_dense[i]); }
+
+    /** @copydoc at */
+    const T &at(size_t i) const { return *address(m_dense[i]); }
+
+    /** @return The handle of the `i`-th live object, in dense order. */
+    pool_handle handle_at(size_t i) const
+    {
+        const uint32_t index = m_dense[i];
+        return make_handle(index, m_slots[index].generation);
+    }
+
+    /** @brief Visits the live objects in dense order. */
+    template <typename Pool, typename Value> class basic_iterator
+    {
+    public:
+        basic_iterator(Pool *pool, size_t i) : m_pool(pool), m_i(i) {}
+
+        Value &operator*() const { return m_pool->at(m_i); }
+        Value *operator->() const { return &m_pool->at(m_i); }
+
+        basic_iterator &operator++()
+        {
+            ++m_i;
+            return *this;
+        }
+
+        bool operator==(const basic_iterator &other) const
+        {
+            return m_i == other.m_i;
+        }
+        bool operator!=(const basic_iterator &other) const
+        {
+            return m_i != other.m_i;
+        }
+
+    private:
+        Pool *m_pool;
+        size_t m_i;
+    };
+
+    using iterator       = basic_iterator<object_pool, T>;
+    using const_iterator = basic_iterator<const object_pool, const T>;
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, size()); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, size()); }
+
+private:
+    struct page
+    {
+        struct storage
+        {
+            alignas(T) unsigned char bytes[sizeof(T)];
+        };
+        storage objects[PageSize];
+    };
+
+    struct slot_info
+    {
+        uint32_t generation = 1;
+        uint32_t link       = 0; ///< Dense position if live, else next free.
+    };
+
+    static constexpr uint32_t end_of_list = 0xFFFFFFFF;
+    static constexpr uint32_t max_generation =
+        0xFFFFFFFF >> pool_handle::index_bits;
+
+    static pool_handle make_handle(uint32_t index, uint32_t generation)
+    {
+        return {(generation << pool_handle::index_bits) | index};
+    }
+
+    /** @brief Skips 0 when wrapping around, so no handle is ever zero. */
+    static uint32_t next_generation(uint32_t generation)
+    {
+        return generation == max_generation ? 1 : generation + 1;
+    }
+
+    T *address(uint32_t index) const
+    {
+        page *p = m_pages[index / PageSize];
+        return (T *)p->objects[index % PageSize].bytes;
+    }
+
+    /** @brief Adds a page and threads its slots onto the free list. */
+    bool grow()
+    {
+        const size_t first = capacity();
+        if (first + PageSize > max_size)
+            return false;
+
+        m_pages.push_back(new page);
+        m_slots.resize(first + PageSize);
+        for (size_t i = first + PageSize; i-- > first;)
+        {
+            m_slots[i].link = m_free_head;
+            m_free_head     = (uint32_t)i;
+        }
+        return true;
+    }
+
+    vector<page *> m_pages;
+    vector<slot_info> m_slots;
+    vector<uint32_t> m_dense; ///< Slot indices of the live objects.
+    uint32_t m_free_head = end_of_list;
+};
 } // namespace zabato
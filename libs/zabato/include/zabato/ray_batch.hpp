@@ -0,0 +1,116 @@
+#pragma once
+
+#include <zabato/collision.hpp>
+#include <zabato/math.hpp>
+#include <zabato/real.hpp>
+#include <zabato/vector.hpp>
+#include <stddef.h>
+
+namespace zabato
+{
+/**
+ * @class ray_obstacle_set
+ * @brief A set of obstacles laid out for casting many rays against it.
+ *
+ * Circles and rects are copied into structure-of-arrays storage and tested
+ * four at a time with SSE or NEON, or a scalar loop on other targets. Other
+ * shapes are kept as pointers and go through `raycast_shape`. The set holds a
+ * snapshot: it must be rebuilt after its shapes move.
+ */
+class ray_obstacle_set
+{
+public:
+    /** @brief Removes every obstacle. */
+    void clear();
+
+    /** @brief Adds one obstacle. */
+    void add(const collision_shape *shape);
+
+    /**
+     * @brief Replaces the set with a list of shapes.
+     * @param shapes The obstacles.
+     * @param exclude A shape to leave out, e.g. the object being looked at.
+     */
+    void assign(const vector<const collision_shape *> &shapes,
+                const collision_shape *exclude = nullptr);
+
+    /** @return The number of obstacles. */
+    size_t size() const
+    {
+        return m_circles.size() + m_rects.size() + m_others.size();
+    }
+
+    /**
+     * @brief Casts a ray and finds the closest obstacle it hits.
+     * @see zabato::raycast
+     */
+    raycast_result
+    raycast(vec2<real> origin, vec2<real> direction, real max_distance) const;
+
+    /**
+     * @brief Tests whether any obstacle is hit closer than a distance.
+     *
+     * Cheaper than `raycast`: it stops at the first hit and builds no result.
+     *
+     * @param origin The starting point of the ray.
+     * @param direction The normalized direction of the ray.
+     * @param max_distance Hits at or beyond this distance are ignored.
+     * @param ignore A shape that never occludes, e.g. the ray's target.
+     */
+    bool occluded(vec2<real> origin,
+                  vec2<real> direction,
+                  real max_distance,
+                  const collision_shape *ignore = nullptr) const;
+
+    /**
+     * @brief Tests a packet of rays sharing an origin, each obstacle block
+     * being loaded once for the whole packet.
+     * @param origin The starting point of every ray.
+     * @param directions The normalized direction of each ray.
+     * @param max_distances The distance limit of each ray.
+     * @param count The number of rays.
+     * @param[out] out Receives whether each ray is occluded.
+     * @param ignore A shape that never occludes, e.g. the rays' target.
+     */
+    void occluded(vec2<real> origin,
+                  const vec2<real> *directions,
+                  const real *max_distances,
+                  size_t count,
+                  bool *out,
+                  const collision_shape *ignore = nullptr) const;
+
+private:
+    // SoA lanes, padded to a multiple of four. Lanes past the shape count are
+    // masked out.
+    vector<float> m_circle_x;
+    vector<float> m_circle_y;
+    vector<float> m_circle_radius_sq;
+    vector<const collision_shape *> m_circles;
+
+    vector<float> m_rect_min_x;
+    vector<float> m_rect_min_y;
+    vector<float> m_rect_max_x;
+    vector<float> m_rect_max_y;
+    vector<const collision_shape *> m_rects;
+
+    vector<const collision_shape *> m_others;
+};
+
+/**
+ * @brief Determines the visibility of an object against a prepared obstacle
+ * set. Reuse one set when checking many objects against the same obstacles.
+ * The object itself never blocks its own rays, so it may be in the set.
+ * @see zabato::check_visibility
+ */
+visibility_result check_visibility(const vision_cone &cone,
+                                   const collision_shape &object,
+                                   const ray_obstacle_set &obstacles);
+
+/**
+ * @brief Determines the visibility of an object from a cone whose per-cone
+ * terms are already computed, for observers that check many objects.
+ */
+visibility_result check_visibility(const prepared_vision_cone &cone,
+                                   const collision_shape &object,
+                                   const ray_obstacle_set &obstacles);
+} // namespace zabato
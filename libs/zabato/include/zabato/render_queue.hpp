@@ -0,0 +1,128 @@
+#pragma once
+
+#include <zabato/allocator.hpp>
+#include <zabato/gpu.hpp>
+#include <zabato/hash_map.hpp>
+#include <zabato/math.hpp>
+#include <zabato/real.hpp>
+#include <zabato/vector.hpp>
+
+#include <stdint.h>
+
+namespace zabato
+{
+class animator;
+class mesh;
+
+/**
+ * @class render_queue
+ * @brief Draws collected during traversal, sorted to minimize state changes
+ * before they reach the `gpu`.
+ *
+ * Every draw gets a 64-bit sort key, from the most significant bits down:
+ *
+ * | bits  | opaque             | translucent                 |
+ * |-------|--------------------|-----------------------------|
+ * | 60-63 | layer              | layer                       |
+ * | 59    | 0                  | 1                           |
+ * | 35-58 | texture, material  | depth, far to near          |
+ * | 23-34 | mesh               | texture, material           |
+ * | 11-22 | depth, near to far | texture, material           |
+ * | 0-10  | depth, near to far | 0                           |
+ *
+ * so each layer draws its opaque geometry batched by texture, material and
+ * mesh, then its translucent geometry back to front. The keys are radix
+ * sorted and `submit` only touches the texture, material and blend state
+ * when they change between consecutive draws. Consecutive unanimated draws
+ * of the same mesh and material go through `mesh::render_instanced`.
+ */
+class render_queue
+{
+public:
+    static constexpr uint32_t layer_count = 16;
+
+    /** @brief Drops every draw, keeping the memory for the next frame. */
+    void clear();
+
+    /**
+     * @brief Sets the view depths that map to the whole depth key range.
+     * Depths outside are clamped, so they only lose ordering among
+     * themselves.
+     */
+    void set_depth_range(real near_depth, real far_depth);
+
+    /**
+     * @brief Queues a draw.
+     * @param geometry The mesh to render.
+     * @param mat The material, which also picks the texture. May be null.
+     * @param model_view The matrix loaded into `matrix_mode::modelview`.
+     * @param depth The view depth of the draw, e.g. of its bound center.
+     * @param translucent Drawn after the opaque draws of its layer, blended
+     * and back to front.
+     * @param layer Drawn after every lower layer, below `layer_count`.
+     * @param anim The animator to skin with, or null for the bind pose.
+     */
+    void add(const mesh *geometry,
+             const material *mat,
+             const mat4<real> &model_view,
+             real depth,
+             bool translucent,
+             uint8_t layer        = 0,
+             const animator *anim = nullptr);
+
+    /** @brief Sorts the queued draws by their keys. */
+    void sort();
+
+    /** @brief Issues the sorted draws, then restores the default state. */
+    void submit(gpu &g) const;
+
+    /** @return The number of queued draws. */
+    size_t size() const { return m_draws.size(); }
+
+private:
+    template <class T> using array = vector<T, scene_allocator<T>>;
+
+    struct draw
+    {
+        mat4<real> model_view;
+        const mesh *geometry;
+        const material *mat;
+        const animator *anim;
+        bool translucent;
+    };
+
+    struct sort_item
+    {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    uint32_t state_id(const void *state);
+    uint32_t geometry_id(const mesh *geometry);
+    uint32_t quantize_depth(real depth) const;
+
+    array<draw> m_draws;
+    array<sort_item> m_items;
+    array<sort_item> m_scratch;
+    mutable array<mat4<real>> m_instances; ///< Matrices of one instanced draw.
+
+    /** @brief Small ids for the textures and materials of the frame. */
+    hash_map<const void *,
+             uint32_t,
+             hash<const void *>,
+             equal_to<const void *>,
+             scene_allocator<uint32_t>>
+        m_state_ids;
+
+    /** @brief Small ids for the meshes of the frame. */
+    hash_map<const mesh *,
+             uint32_t,
+             hash<const mesh *>,
+             equal_to<const mesh *>,
+             scene_allocator<uint32_t>>
+        m_geometry_ids;
+
+    real m_near_depth = real(0);
+    real m_far_depth  = real(1000);
+};
+} // namespace zabato
@@ -1,64 +1,515 @@
 #pragma once
 
+#include <zabato/fs.hpp>
 #include <zabato/hash_map.hpp>
 #include <zabato/ice.hpp>
 #include <zabato/shared_ptr.hpp>
 #include <zabato/stream.hpp>
 #include <zabato/string.hpp>
+#include <zabato/thread.hpp>
+#include <zabato/vector.hpp>
 
 namespace zabato
 {
+/**
+ * @brief What part of a scene costs, summed over a subtree by
+ * `scene_printer::print_costs`. Resources shared by several objects are
+ * counted by each of them.
+ */
+struct scene_cost
+{
+    size_t memory        = 0; ///< CPU bytes, objects and what they own.
+    size_t gpu_memory    = 0; ///< Textures and retained buffers, in bytes.
+    size_t disk          = 0; ///< Bytes the objects write when saved.
+    size_t vertices      = 0;
+    size_t spatials      = 0;
+    size_t controllers   = 0;
+    uint32_t update_cost = 0; ///< See `controller::get_update_cost`.
+
+    void add(const scene_cost &other)
+    {
+        memory += other.memory;
+        gpu_memory += other.gpu_memory;
+        disk += other.disk;
+        vertices += other.vertices;
+        spatials += other.spatials;
+        controllers += other.controllers;
+        update_cost += other.update_cost;
+    }
+};
+
 class resource
 {
 public:
     virtual ~resource() = default;
+
+    /**
+     * @brief Gets the memory held by the resource, counted against the budget
+     * of its `resource_manager`.
+     * @return Memory used in bytes, 0 if unknown, in which case the manager
+     * counts the size of the object.
+     */
+    virtual size_t get_memory_used() const { return 0; }
+
+    /** @return The GPU memory held by the resource in bytes, 0 if none. */
+    virtual size_t get_gpu_memory_used() const { return 0; }
+
+    /** @brief Adds the memory of the resource to the cost of its user. */
+    virtual void add_cost(scene_cost &cost) const
+    {
+        cost.memory += get_memory_used();
+        cost.gpu_memory += get_gpu_memory_used();
+    }
+
+    /**
+     * @brief Takes over the content of a fresh load of the same file, so the
+     * handles to this object see the file as it is now. Used by
+     * `resource_manager::reload`.
+     * @param loaded The fresh load, of the same type, dropped afterwards.
+     * @return False if the type cannot be replaced in place, the default; the
+     * fresh load then replaces this object in the cache instead.
+     */
+    virtual bool replace_with(resource &loaded)
+    {
+        (void)loaded;
+        return false;
+    }
+};
+
+/** @brief Counters of a `resource_manager` cache. */
+struct resource_stats
+{
+    uint64_t hits         = 0; ///< Requests served without reading a file.
+    uint64_t misses       = 0; ///< Requests that read a file.
+    uint64_t evictions    = 0; ///< Resources dropped to fit the budget.
+    size_t resident_bytes = 0; ///< Memory of the cached resources.
+    size_t resident_count = 0; ///< Number of cached resources.
+};
+
+struct resource_request;
+class resource_batch;
+
+/**
+ * @class resource_future
+ * @brief A handle to an asynchronous load of `resource_manager::load_async`.
+ *
+ * Handles are used from the thread that calls `resource_manager::update`, the
+ * main thread, which is also where they become ready.
+ */
+template <typename T> class resource_future
+{
+public:
+    resource_future() = default;
+    explicit resource_future(shared_ptr<resource_request> request)
+        : m_request(move(request))
+    {
+    }
+
+    /** @return True if the handle refers to a load. */
+    bool valid() const { return bool(m_request); }
+
+    /** @return True once `resource_manager::update` delivered the load. */
+    bool ready() const;
+
+    /** @return The loaded resource or the error of the load, once ready. */
+    result<shared_ptr<T>> get() const;
+
+private:
+    shared_ptr<resource_request> m_request;
 };
 
+/**
+ * @class resource_manager
+ * @brief Loads resources from ICE files and caches them by path.
+ *
+ * Files are read through a `fs::file_system`, typically a `fs::virtual_fs`
+ * with `fs::ice_fs` archives mounted, or with `fopen` when none is set.
+ * `prefetch` reads the files of a manifest ahead of their loads in storage
+ * order, so a level packed in one archive is read front to back once.
+ *
+ * `load` reads on the calling thread. `load_async` hands the read to worker
+ * threads instead, started on its first call, and `update` delivers finished
+ * loads: it caches them and runs their callbacks on the thread calling it.
+ * Requests for a path already in flight join the pending load rather than
+ * reading the file again. Without threads, `update` runs one queued load per
+ * call itself.
+ *
+ * `load_batch` loads a set of resources at once, e.g. those of a level,
+ * decoding them concurrently on the `job_system`.
+ *
+ * With a memory budget, the cache drops the least recently used resources
+ * that nothing else references (`use_count() == 1`) whenever it holds more
+ * than the budget. Resources still in use are never dropped, so the cache may
+ * stay over budget until they are released.
+ *
+ * For iteration on loose files, `watch_files` makes the file system report
+ * changes, and `reload_changed` reloads only the cached resources whose
+ * files changed. Types implementing `resource::replace_with` are updated in
+ * place, under the handles already given out.
+ */
 class resource_manager
 {
 public:
     using resource_ptr = shared_ptr<resource>;
 
-    template <typename T> result<shared_ptr<T>> load(const string &path)
+    /** @brief Reads an object of the requested type from a stream. */
+    using decode_function = result<void> (*)(ice_reader &reader,
+                                             resource &obj);
+
+    /**
+     * @brief Called from `update` when an asynchronous load finished.
+     * @param user The pointer given to `load_async`.
+     * @param path The path of the resource.
+     * @param resource The resource, or the error of the load.
+     */
+    using load_callback = void (*)(void *user,
+                                   const string &path,
+                                   const result<resource_ptr> &resource);
+
+    static constexpr uint32_t max_workers = 8;
+
+    /**
+     * @param worker_count Threads reading and decoding `load_async` requests,
+     * 0 for every hardware thread, up to `max_workers`.
+     */
+    explicit resource_manager(uint32_t worker_count = 1);
+    ~resource_manager();
+
+    resource_manager(const resource_manager &)            = delete;
+    resource_manager &operator=(const resource_manager &) = delete;
+
+    /**
+     * @brief Loads a resource, or returns the cached one.
+     * @param path The path of the resource. A cached resource is found
+     * without copying the path.
+     */
+    template <typename T> result<shared_ptr<T>> load(string_view path)
     {
         resource_ptr resource;
-        if (m_resources.try_get_value(path, resource))
+        if (find_cached(path, resource))
         {
             shared_ptr<T> ptr = static_pointer_cast<T>(resource);
             return ptr;
         }
 
+        ++m_stats.misses;
+        const string key(path);
         auto obj = make_shared<T>();
-
-        FILE *file = fopen(path.c_str(), "rb");
-        assert(file);
-        if (!file)
-            return report_error(error_code::file_not_found, path.c_str());
-
-        file_stream stream(file);
-        ice_reader reader(stream);
-        auto res = deserialize(reader, *obj.get());
+        auto res = read(key, decode<T>, *obj.get());
         if (res.has_error())
-        {
-            fclose(file);
             return res.error;
-        }
 
-        fclose(file);
-        m_resources.set(path, obj);
+        cache(key, obj, type_of<T>());
         return obj;
     }
 
+    /**
+     * @brief Loads a resource on the worker threads.
+     *
+     * The callback always runs from a later `update`, even for resources
+     * that are already cached. A synchronous `load` of a path in flight reads
+     * it on its own.
+     *
+     * @param path The path of the resource.
+     * @param callback Called once the load finished, may be null.
+     * @param user Passed to the callback.
+     * @return A handle that becomes ready in the same `update`.
+     */
+    template <typename T>
+    resource_future<T> load_async(string_view path,
+                                  load_callback callback = nullptr,
+                                  void *user             = nullptr)
+    {
+        return resource_future<T>(request(path, callback, user, type_of<T>()));
+    }
+
+    /**
+     * @brief Delivers the finished asynchronous loads: caches them, then runs
+     * their callbacks. Call it regularly from the main thread.
+     */
+    void update();
+
+    /** @return The number of asynchronous loads not delivered yet. */
+    size_t pending() const { return m_in_flight.size(); }
+
+    /**
+     * @brief Sets the file system resources are read from. Set it before any
+     * load, the workers read through it.
+     * @param fs The file system, must outlive the manager, or null to read
+     * host paths with `fopen` (the default).
+     */
+    void set_file_system(fs::file_system *fs) { m_fs = fs; }
+
+    /** @return The file system resources are read from, may be null. */
+    fs::file_system *get_file_system() const { return m_fs; }
+
+    /**
+     * @brief Reads the files of a manifest, e.g. the resources of the next
+     * level, in one sequential pass.
+     *
+     * The paths are sorted by `fs::file_system::get_storage_offset` and read
+     * whole in that order. Their bytes are kept until the first `load` or
+     * `load_async` of each path decodes them without touching the file
+     * system again. Paths already cached, in flight or prefetched, and paths
+     * that cannot be opened, are skipped.
+     *
+     * @param paths The paths to read.
+     * @return The number of files read.
+     */
+    size_t prefetch(const vector<string> &paths);
+
+    /** @return The number of prefetched files not loaded yet. */
+    size_t prefetched() const { return m_prefetched.size(); }
+
+    /**
+     * @brief Loads every resource of a batch, returning once all are loaded
+     * or failed.
+     *
+     * Resources not cached are read and decoded as jobs of
+     * `job_system::get()`, the calling thread taking part, so independent
+     * files decode concurrently. Decoding only builds the CPU side of a
+     * resource; GPU objects are still created on first use on the render
+     * thread. The loaded resources are then cached on the calling thread.
+     * Prefetched bytes are used when there are some.
+     *
+     * @param batch The resources, whose results `resource_batch::get` then
+     * returns.
+     * @return The number of resources that failed to load.
+     */
+    size_t load_batch(resource_batch &batch);
+
+    /**
+     * @brief Sets the memory the cache may hold, then evicts down to it.
+     * @param bytes The budget in bytes, 0 for none (the default).
+     */
+    void set_memory_budget(size_t bytes);
+
+    /** @return The memory budget in bytes, 0 if there is none. */
+    size_t get_memory_budget() const { return m_memory_budget; }
+
+    /** @return The cache counters since construction or `reset_stats`. */
+    resource_stats get_stats() const;
+
+    /** @brief Zeroes the hit, miss and eviction counters. */
+    void reset_stats();
+
+    /**
+     * @brief Watches the file system for the changes `reload_changed` picks
+     * up, see `fs::file_system::watch`.
+     * @return False if there is no file system or it cannot watch.
+     */
+    bool watch_files();
+
+    /**
+     * @brief Reloads the cached resources whose files changed since the last
+     * call, and drops the prefetched bytes of changed files. Call it from the
+     * main thread between frames, e.g. before `update`.
+     * @return The number of resources reloaded.
+     */
+    size_t reload_changed();
+
+    /**
+     * @brief Reads a cached resource from its file again. The resource is
+     * updated in place if its type implements `resource::replace_with`;
+     * otherwise the fresh load is cached in its stead, and the handles given
+     * out before keep the old one. On failure the cache keeps the old one.
+     * @param path The path the resource was loaded with.
+     */
+    result<void> reload(string_view path);
+
+    /**
+     * @brief Sets a function called after every `reload` that succeeded,
+     * with the resource now cached, e.g. to rebuild what was made from it.
+     */
+    void set_reload_callback(load_callback callback, void *user)
+    {
+        m_reload_callback = callback;
+        m_reload_user     = user;
+    }
+
     // Unloads a resource by path
-    void unload(const string &path) { m_resources.erase(path); }
+    void unload(string_view path);
 
-    // Unloads all resources
-    void unload_all() { m_resources.clear(); }
+    // Unloads all resources, and drops the prefetched files
+    void unload_all();
 
 private:
-    hash_map<string, resource_ptr> m_resources;
+    using request_ptr     = shared_ptr<resource_request>;
+    using create_function = resource_ptr (*)();
+
+    struct resource_type
+    {
+        create_function create;
+        decode_function decode;
+        size_t size; ///< Counted when the resource does not report its own.
+    };
+
+    struct cache_entry
+    {
+        resource_ptr resource;
+        resource_type type = {}; ///< For `reload`.
+        size_t size        = 0;
+        uint64_t last_use = 0; ///< Value of `m_clock` at the last request.
+    };
+
+    template <typename T> static result<void> decode(ice_reader &reader,
+                                                     resource &obj)
+    {
+        return deserialize(reader, static_cast<T &>(obj));
+    }
+
+    template <typename T> static resource_ptr create()
+    {
+        return make_shared<T>();
+    }
+
+    template <typename T> static resource_type type_of()
+    {
+        return {create<T>, decode<T>, sizeof(T)};
+    }
+
+    result<void>
+    read_file(const string &path, decode_function decode, resource &obj) const;
+    result<void> read_bytes(const string &path, vector<uint8_t> &out) const;
+    result<void>
+    read(const string &path, decode_function decode, resource &obj);
+    static result<void>
+    decode_bytes(vector<uint8_t> &data, decode_function decode, resource &obj);
+    void run(resource_request &request) const;
+    static void worker(void *self);
+
+    request_ptr request(string_view path,
+                        load_callback callback,
+                        void *user,
+                        const resource_type &type);
+    bool find_cached(string_view path, resource_ptr &out);
+    void cache(const string &path,
+               const resource_ptr &obj,
+               const resource_type &type);
+    void trim();
+    void start_workers();
+    request_ptr pop_queued();
+    void finish(const request_ptr &request);
+
+    friend class resource_batch;
+    friend struct resource_request;
+
+    hash_map<string, cache_entry> m_resources;
+    hash_map<string, request_ptr> m_in_flight;
+    hash_map<string, vector<uint8_t>> m_prefetched;
+    fs::file_system *m_fs = nullptr;
+    load_callback m_reload_callback = nullptr;
+    void *m_reload_user             = nullptr;
+    resource_stats m_stats;
+    size_t m_memory_budget = 0;
+    uint64_t m_clock       = 0;
+
+    // Shared with the workers, under `m_mutex`.
+    mutex m_mutex;
+    condition_variable m_wake;
+    vector<request_ptr> m_queue;
+    size_t m_queue_head = 0;
+    vector<request_ptr> m_completed;
+    bool m_stopping = false;
+
+    thread m_workers[max_workers];
+    uint32_t m_worker_count  = 0; ///< Requested, 0 once started.
+    uint32_t m_started_count = 0;
 };
 
+/** @brief One asynchronous load, shared by its handles and the manager. */
+struct resource_request
+{
+    struct callback
+    {
+        resource_manager::load_callback function;
+        void *user;
+    };
+
+    string path;
+    shared_ptr<resource> object; ///< The object being loaded into.
+    vector<uint8_t> data;        ///< Prefetched bytes, read instead if set.
+    resource_manager::resource_type type = {};
+    error_code error                     = error_code::ok;
+    bool done                            = false; ///< Set by `update`.
+    vector<callback> callbacks;
+};
+
+/**
+ * @class resource_batch
+ * @brief Resources to load together with `resource_manager::load_batch`.
+ */
+class resource_batch
+{
+public:
+    /**
+     * @brief Adds a resource to the batch.
+     * @param path The path of the resource. A path added twice is loaded once.
+     * @return The index of the resource, for `get`.
+     */
+    template <typename T> size_t add(string_view path)
+    {
+        m_entries.emplace_back();
+        entry &e = m_entries.back();
+        e.path   = path;
+        e.type   = resource_manager::type_of<T>();
+        return m_entries.size() - 1;
+    }
+
+    /** @return The number of resources added. */
+    size_t size() const { return m_entries.size(); }
+
+    /** @brief Drops the resources and their results. */
+    void clear() { m_entries.clear(); }
+
+    /**
+     * @return The resource at `index`, or the error of its load. Only valid
+     * after `resource_manager::load_batch`, with the type it was added as.
+     */
+    template <typename T> result<shared_ptr<T>> get(size_t index) const
+    {
+        const entry &e = m_entries[index];
+        if (bool(e.error))
+            return e.error;
+        if (!e.object)
+            return report_error(
+                error_code::operation, " get", " The batch was not loaded.");
+        shared_ptr<T> ptr = static_pointer_cast<T>(e.object);
+        return ptr;
+    }
+
+private:
+    friend class resource_manager;
+
+    struct entry
+    {
+        string path;
+        resource_manager::resource_type type = {};
+        shared_ptr<resource> object;
+        vector<uint8_t> data; ///< Prefetched bytes, read instead if set.
+        error_code error = error_code::ok;
+        bool loaded      = false; ///< Decoded by the batch, not yet cached.
+    };
+
+    vector<entry> m_entries;
+};
+
+template <typename T> bool resource_future<T>::ready() const
+{
+    return m_request && m_request->done;
+}
+
+template <typename T> result<shared_ptr<T>> resource_future<T>::get() const
+{
+    if (!ready())
+        return report_error(
+            error_code::operation, " get", " The load has not finished.");
+    if (bool(m_request->error))
+        return m_request->error;
+    shared_ptr<T> ptr = static_pointer_cast<T>(m_request->object);
+    return ptr;
+}
+
 class resource_ref
 {
 public:
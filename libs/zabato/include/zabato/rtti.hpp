@@ -3,6 +3,9 @@
 #include <zabato/string.hpp>
 #include <zabato/symbol.hpp>
 
+#include <stdatomic.h>
+#include <stdint.h>
+
 namespace zabato
 {
 /**
@@ -11,10 +14,18 @@ namespace zabato
  * Provides a mechanism to store and query type information at runtime,
  * supporting single inheritance hierarchies. It allows for type comparison and
  * derivation checks.
+ *
+ * Each type keeps the chain of its bases indexed by depth, so `is_derived`
+ * compares one entry instead of walking the bases. The chain is built on the
+ * first query, since types defined in other translation units may not be
+ * constructed yet when a derived type is.
  */
 class rtti
 {
 public:
+    /** @brief The deepest hierarchy kept as a chain, deeper types walk. */
+    static constexpr uint32_t max_depth = 16;
+
     /**
      * @brief Construct a new RTTI object.
      * @param name The name of the type.
@@ -23,14 +34,9 @@ public:
      */
     rtti(const char *name, const rtti *base_type)
     {
-        m_name      = get_symbol(name);
+        m_name      = get_permanent_symbol(name);
         m_base_type = base_type;
-    }
-
-    ~rtti()
-    {
-        if (m_name)
-            release_symbol(m_name);
+        atomic_init(&m_state, chain_unset);
     }
 
     /**
@@ -44,6 +50,16 @@ public:
         return "";
     }
 
+    /**
+     * @brief Get the name of the type as an interned symbol, e.g. to key
+     * tables by type name with pointer hashing.
+     * @return The permanent symbol of the name.
+     */
+    symbol *name_symbol() const { return m_name; }
+
+    /** @return The RTTI of the base class, or nullptr for a root class. */
+    const rtti *base_type() const { return m_base_type; }
+
     /**
      * @brief Check if this type is exactly the same as another type.
      * @param type The type to compare with.
@@ -58,6 +74,12 @@ public:
      */
     bool is_derived(const rtti &type) const
     {
+        if (has_chain() && type.has_chain())
+        {
+            const uint32_t depth = type.m_depth;
+            return depth <= m_depth && m_chain[depth] == &type;
+        }
+
         const rtti *search = this;
         while (search)
         {
@@ -69,7 +91,30 @@ public:
     }
 
 private:
+    enum : unsigned int
+    {
+        chain_unset,
+        chain_building,
+        chain_ready,
+        chain_too_deep
+    };
+
+    /** @return True once the chain is built, building it if no one is. */
+    bool has_chain() const
+    {
+        const unsigned int state =
+            atomic_load_explicit(&m_state, memory_order_acquire);
+        return state == chain_ready || (state == chain_unset && build_chain());
+    }
+
+    bool build_chain() const;
+
     symbol *m_name;
     const rtti *m_base_type;
+
+    // Written once by the thread that moves `m_state` out of `chain_unset`.
+    mutable atomic_uint m_state;
+    mutable uint32_t m_depth = 0; ///< The number of bases.
+    mutable const rtti *m_chain[max_depth]; ///< The root first, then bases.
 };
-} // namespace zabato
\ No newline at end of file
+} // namespace zabato
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <zabato/error.hpp>
+#include <zabato/ice.hpp>
+#include <zabato/object.hpp>
+#include <zabato/resource.hpp>
+#include <zabato/spatial.hpp>
+
+#include <stdint.h>
+
+namespace tinyxml2
+{
+class XMLElement;
+}
+
+namespace zabato
+{
+template <typename T> result<void> deserialize(ice_reader &reader, T &obj);
+
+#pragma pack(push, 1)
+
+/**
+ * @brief Header of the SCEN chunk, a scene graph compiled from XML by
+ * `compile_scene`.
+ *
+ * The header is followed by `type_count` ice_uint32_t offsets of the type
+ * names, then `node_count` ICE_SCENE_NODE with every parent before its
+ * children, then `controller_count` ICE_SCENE_CONTROLLER, then `link_count`
+ * ICE_SCENE_LINK, then the NUL-terminated strings the records point into.
+ */
+struct ICE_SCENE_HEADER
+{
+    ice_uint32_t version;
+    ice_uint32_t type_count;
+    ice_uint32_t node_count;
+    ice_uint32_t controller_count;
+    ice_uint32_t link_count;
+};
+
+/** @brief A spatial of the scene, with the state its XML element held. */
+struct ICE_SCENE_NODE
+{
+    ice_uint32_t type;        //< Index into the type table
+    ice_int32_t parent;       //< Index of the parent node, -1 for the root
+    ice_uint32_t name_offset; //< Offset into the strings
+    uint8_t id[16];           //< uuid bytes
+    ice_float translate[3];
+    ice_float rotate[4]; //< Quaternion, x y z w
+    ice_float scale[3];
+};
+
+/** @brief A controller, added to its owner in the order of the records. */
+struct ICE_SCENE_CONTROLLER
+{
+    ice_uint32_t type;        //< Index into the type table
+    ice_uint32_t owner;       //< Index of the node it controls
+    ice_uint32_t name_offset; //< Offset into the strings
+    uint8_t id[16];           //< uuid bytes
+};
+
+/**
+ * @brief A `ref` element of the XML, a node attached to a second parent,
+ * with the uuid already resolved to the node's index.
+ */
+struct ICE_SCENE_LINK
+{
+    ice_uint32_t parent; //< Index of the node attaching the target
+    ice_uint32_t target; //< Index of the attached node
+};
+
+#pragma pack(pop)
+
+/** @brief Version of the SCEN chunk layout. */
+static constexpr uint32_t ICE_SCENE_VERSION = 1;
+
+/**
+ * @class scene_file
+ * @brief A scene graph loaded from a SCEN chunk.
+ *
+ * Loading XML scenes parses the document, then builds the objects by looking
+ * up each element's name as a string, then walks the tree a second time to
+ * link it. `compile_scene` does that work offline: type names go to a table
+ * resolved once per load, nodes are a flat array in parent order and uuid
+ * references are already indices, so loading is one read and one linear pass
+ * over the records.
+ *
+ * Types are created through `object::s_factory_create`, so each type in a
+ * scene must be registered there. The chunk holds the state `object`,
+ * `spatial` and `node` write to XML: names, ids, local transforms,
+ * controllers and the tree; a type writing more of its own is compiled
+ * without it.
+ */
+class scene_file : public resource
+{
+public:
+    static constexpr chunk_id CHUNK_ID = chunk_id("SCEN");
+
+    /** @return The root of the scene, null until loaded. */
+    spatial *get_root() const { return m_root; }
+
+    /** @return The number of spatials the scene was loaded with. */
+    size_t get_node_count() const { return m_node_count; }
+
+    size_t get_memory_used() const override { return sizeof(*this); }
+
+private:
+    pointer<spatial> m_root;
+    size_t m_node_count = 0;
+
+    template <typename T>
+    friend result<void> deserialize(ice_reader &reader, T &obj);
+};
+
+template <> result<void> deserialize(ice_reader &reader, scene_file &scene);
+
+/**
+ * @brief Compiles the root element of an XML scene, as `xml_serializer`
+ * saves it, into a SCEN chunk.
+ *
+ * The elements are read as they are, without creating objects, so the
+ * compiler needs no types registered.
+ *
+ * @param root The root element of the scene.
+ * @param writer Where to write the chunk.
+ * @return An error if an id is missing or unparsable, or a `ref` names an
+ * id the scene does not have.
+ */
+result<void> compile_scene(const tinyxml2::XMLElement &root,
+                           ice_writer &writer);
+} // namespace zabato
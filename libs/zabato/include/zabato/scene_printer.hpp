@@ -1,9 +1,12 @@
 #pragma once
 
+#include <zabato/resource.hpp>
 #include <zabato/string_tree.hpp>
+#include <zabato/vector.hpp>
 
 namespace zabato
 {
+class spatial;
 
 class scene_printer
 {
@@ -13,10 +16,35 @@ public:
 
     void print(const string_tree *tree);
 
+    /**
+     * @brief Prints what every subtree of a scene costs, one line per
+     * spatial, indented like `print`: its memory, GPU memory and disk space,
+     * and its vertex, spatial and controller counts and estimated update
+     * cost, each summed over the subtree. Children are sorted by memory,
+     * GPU memory included, so the heaviest prefabs come first.
+     *
+     * The numbers come from `object::add_cost` of every spatial and
+     * controller. Resources shared by several objects are counted by each.
+     */
+    void print_costs(spatial *root);
+
 private:
+    /** @brief The cost of a subtree, and its children's, most memory first. */
+    struct subtree
+    {
+        spatial *root = nullptr;
+        scene_cost cost;
+        vector<uint32_t> children; ///< Indices into the subtrees.
+    };
+
     void print_recursive(const string_tree *tree, int indentation);
     void print_indentation(int indentation);
 
+    uint32_t collect_costs(spatial *root, vector<subtree> &subtrees);
+    void print_costs_recursive(const vector<subtree> &subtrees,
+                               uint32_t index,
+                               int indentation);
+
     const char *m_filename;
     FILE *m_file;
 };
@@ -69,6 +69,12 @@ private:
  * specialized methods for reading/writing basic types and objects.
  * It manages the mapping of object pointers to unique IDs to handle
  * shared references and cycles during serialization.
+ *
+ * By default an object's ID is its address at save time, so loading hashes
+ * every ID to find the object it became. Saved with `set_dense_ids`, objects
+ * are instead numbered from 1 in save order, 0 being null, and loading finds
+ * them by indexing a table sized from the object count in the header. The
+ * header tells `load` which kind of IDs a stream has.
  */
 class serializer
 {
@@ -199,6 +205,13 @@ public:
      */
     bool load(stream &stream);
 
+    /**
+     * @brief Whether `save` numbers objects in save order instead of writing
+     * their addresses, so loading resolves them by index.
+     */
+    void set_dense_ids(bool dense) { m_dense_ids = dense; }
+    bool has_dense_ids() const { return m_dense_ids; }
+
     resource_manager *get_manager() const { return m_manager; }
 
 private:
@@ -207,6 +220,10 @@ private:
     vector<const object *> m_ordered_objects;
     vector<serializer_link *> m_links;
 
+    bool m_dense_ids = false;
+    /** @brief While loading dense IDs, the link of each ID minus 1. */
+    vector<object *> m_dense_map;
+
     ice_reader *m_reader = nullptr;
     ice_writer *m_writer = nullptr;
 };
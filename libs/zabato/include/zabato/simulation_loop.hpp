@@ -0,0 +1,206 @@
+#pragma once
+
+#include <zabato/input.hpp>
+#include <zabato/real.hpp>
+#include <zabato/thread.hpp>
+#include <zabato/time.hpp>
+#include <zabato/triple_buffer.hpp>
+
+#include <stdatomic.h>
+#include <stdint.h>
+
+namespace zabato
+{
+/**
+ * @brief Two consecutive states of a `simulation_loop`, for rendering
+ * between them.
+ */
+template <typename State> struct simulation_frame
+{
+    State previous;
+    State current;
+    uint64_t time = 0; ///< When the tick making `current` was due, in ns.
+    uint64_t tick = 0; ///< The number of ticks run to reach `current`.
+};
+
+/**
+ * @class simulation_loop
+ * @brief Runs a simulation at a fixed tick on its own thread, decoupled from
+ * the event and render loop.
+ *
+ * The thread handling window events captures an `input_snapshot` every frame
+ * with `capture_input` and hands it over with `publish_input`. Every tick the
+ * simulation takes the latest snapshot, advances its state by one fixed step
+ * and publishes the state with the one before it. The render loop takes the
+ * latest pair with `update_frame` and blends them by `get_alpha`, so motion
+ * stays smooth at any frame rate while showing the simulation one tick late.
+ *
+ * Both directions go through `triple_buffer`s: a slow frame never stalls the
+ * simulation, and a slow tick never stalls rendering, each just keeps the
+ * last value it got. Snapshots published between two ticks are skipped, so
+ * the simulation sees held inputs, not every press.
+ *
+ * When the simulation falls more than `max_catch_up` ticks behind, e.g. after
+ * a debugger break, it drops the missed time instead of racing to catch up.
+ *
+ * @tparam State The simulation state, copied twice per tick, so keep it to
+ * what rendering needs.
+ */
+template <typename State> class simulation_loop
+{
+public:
+    /**
+     * @brief Advances the state by one tick.
+     * @param user The pointer given to `start`.
+     * @param input The latest input snapshot, zeroed until one is published.
+     * @param dt The fixed tick, in seconds.
+     * @param state The state to advance, in place.
+     */
+    using tick_function = void (*)(void *user,
+                                   const input_snapshot &input,
+                                   real dt,
+                                   State &state);
+
+    static constexpr uint32_t max_catch_up = 5;
+
+    simulation_loop() { atomic_init(&m_running, false); }
+    ~simulation_loop() { stop(); }
+
+    simulation_loop(const simulation_loop &)            = delete;
+    simulation_loop &operator=(const simulation_loop &) = delete;
+
+    /**
+     * @brief Starts ticking on a new thread.
+     * @param tick The function advancing the state.
+     * @param user Passed to `tick`.
+     * @param initial The state before the first tick.
+     * @param tick_seconds The fixed tick, e.g. 1/60.
+     * @return False if already running or the thread could not start.
+     */
+    bool start(tick_function tick,
+               void *user,
+               const State &initial,
+               real tick_seconds = real(1) / real(60))
+    {
+        if (atomic_load_explicit(&m_running, memory_order_relaxed))
+            return false;
+
+        m_tick       = tick;
+        m_user       = user;
+        m_state      = initial;
+        m_tick_nanos = time::from_seconds(tick_seconds).as_nanoseconds();
+        m_dt         = tick_seconds;
+
+        simulation_frame<State> &first = m_frames.write_buffer();
+        first.previous                 = initial;
+        first.current                  = initial;
+        first.time                     = time::now().as_nanoseconds();
+        first.tick                     = 0;
+        m_frames.publish();
+
+        atomic_store_explicit(&m_running, true, memory_order_relaxed);
+        if (!m_thread.start(run, this))
+        {
+            atomic_store_explicit(&m_running, false, memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+
+    /** @brief Stops ticking and waits for the thread. */
+    void stop()
+    {
+        atomic_store_explicit(&m_running, false, memory_order_relaxed);
+        m_thread.join();
+    }
+
+    /** @return Whether the simulation thread runs. */
+    bool is_running() const
+    {
+        return atomic_load_explicit(&m_running, memory_order_relaxed);
+    }
+
+    /**
+     * @brief Hands the simulation the latest input. Call it from one thread,
+     * the one capturing the snapshots.
+     */
+    void publish_input(const input_snapshot &input)
+    {
+        m_input.write_buffer() = input;
+        m_input.publish();
+    }
+
+    /**
+     * @brief Takes the latest pair of states, if the simulation ticked since
+     * the last call. Call it from one thread, the render loop.
+     * @return True if `get_frame` changed.
+     */
+    bool update_frame() { return m_frames.update(); }
+
+    /** @return The pair of states taken by the last `update_frame`. */
+    const simulation_frame<State> &get_frame() const
+    {
+        return m_frames.read_buffer();
+    }
+
+    /**
+     * @return How far rendering is from `previous` to `current` of the frame,
+     * from 0 to 1.
+     * @param now `time::now` in nanoseconds.
+     */
+    real get_alpha(uint64_t now) const
+    {
+        const uint64_t due = m_frames.read_buffer().time;
+        if (now <= due)
+            return real(0);
+        if (now - due >= m_tick_nanos)
+            return real(1);
+        return real(int64_t(now - due)) / real(int64_t(m_tick_nanos));
+    }
+
+private:
+    static void run(void *self)
+    {
+        static_cast<simulation_loop *>(self)->loop();
+    }
+
+    void loop()
+    {
+        uint64_t next  = time::now().as_nanoseconds();
+        uint64_t ticks = 0;
+        while (atomic_load_explicit(&m_running, memory_order_relaxed))
+        {
+            const uint64_t now = time::now().as_nanoseconds();
+            if (now < next)
+            {
+                thread::sleep_for(next - now);
+                continue;
+            }
+            if (now - next > max_catch_up * m_tick_nanos)
+                next = now;
+
+            m_input.update();
+            simulation_frame<State> &frame = m_frames.write_buffer();
+            frame.previous                 = m_state;
+            m_tick(m_user, m_input.read_buffer(), m_dt, m_state);
+            frame.current = m_state;
+            frame.time    = next;
+            frame.tick    = ++ticks;
+            m_frames.publish();
+
+            next += m_tick_nanos;
+        }
+    }
+
+    tick_function m_tick = nullptr;
+    void *m_user         = nullptr;
+    real m_dt;
+    uint64_t m_tick_nanos = 0;
+    State m_state{}; ///< Owned by the simulation thread while it runs.
+
+    triple_buffer<input_snapshot> m_input;
+    triple_buffer<simulation_frame<State>> m_frames;
+    atomic_bool m_running;
+    thread m_thread;
+};
+} // namespace zabato
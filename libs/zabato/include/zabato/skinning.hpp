@@ -0,0 +1,45 @@
+#pragma once
+
+#include <zabato/math.hpp>
+#include <zabato/real.hpp>
+#include <stddef.h>
+#include <stdint.h>
+
+namespace zabato
+{
+/**
+ * @struct skinning_stream
+ * @brief Describes an interleaved vertex stream to be skinned.
+ *
+ * Source and destination share the same layout: a `vec3<real>` position at
+ * offset 0, an optional `vec3<real>` normal and a `bone_weight[4]` block. Only
+ * the position and normal of the destination are written, every other
+ * attribute is left untouched so it can be copied in once and reused.
+ */
+struct skinning_stream
+{
+    const uint8_t *source    = nullptr; ///< Bind-pose vertices.
+    uint8_t *destination     = nullptr; ///< Skinned output vertices.
+    size_t vertex_count      = 0;       ///< Number of vertices to process.
+    size_t stride            = 0;       ///< Size of one vertex in bytes.
+    ptrdiff_t normal_offset  = -1;      ///< Normal offset, or -1 if absent.
+    size_t boneweight_offset = 0;       ///< Offset of the `bone_weight[4]`.
+};
+
+/**
+ * @brief Skins every vertex of a stream against a bone palette in one pass.
+ *
+ * For each vertex the (up to four) influencing bone matrices are blended by
+ * weight and the bind-pose position and normal are transformed by the result.
+ * Uses SSE or NEON when available, a scalar loop otherwise. Vertices without
+ * valid influences keep their bind pose.
+ *
+ * @param stream The vertex stream to read and write.
+ * @param palette The final bone matrices, indexed by `bone_weight::bone_id`.
+ * @param palette_size The number of matrices in the palette.
+ */
+void skin_vertices(const skinning_stream &stream,
+                   const mat4<real> *palette,
+                   size_t palette_size);
+
+} // namespace zabato
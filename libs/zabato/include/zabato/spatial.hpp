@@ -1,5 +1,6 @@
 #pragma once
 
+#include "bounds.hpp"
 #include "object.hpp"
 #include "transformation.hpp"
 
@@ -25,9 +26,10 @@ public:
     virtual void link(xml_serializer &serializer,
                       tinyxml2::XMLElement &element) override;
 
+    /** @return The world of the root, null for a tree not in a world. */
     virtual world *get_world() const override final
     {
-        return parent()->get_world();
+        return m_parent ? m_parent->get_world() : nullptr;
     }
 
     transformation &get_local() { return local; }
@@ -47,12 +49,13 @@ public:
 
     void set_local(const transformation &local)
     {
-        this->local    = local;
-        is_world_dirty = true;
+        this->local = local;
+        mark_world_dirty();
     }
 
     void set_world(const transformation &world)
     {
+        mark_world_dirty();
         this->world_transform = world;
         is_world_dirty        = false;
 
@@ -69,7 +72,75 @@ public:
         }
     }
 
+    /**
+     * @brief Sets the bound of the spatial's own geometry in local space,
+     * e.g. `bounding_sphere::from_aabb(mesh.get_bounds())` once a model
+     * loads its mesh. Empty for spatials that draw nothing.
+     */
+    void set_model_bound(const bounding_sphere &bound)
+    {
+        m_model_bound = bound;
+        mark_bound_dirty();
+    }
+
+    const bounding_sphere &get_model_bound() const { return m_model_bound; }
+
+    /**
+     * @brief The world space sphere around this spatial and everything below
+     * it, recomputed only after a transform or model bound below changed.
+     */
+    const bounding_sphere &get_world_bound()
+    {
+        if (m_bound_dirty)
+        {
+            update_world_bound();
+            m_bound_dirty = false;
+        }
+        return m_world_bound;
+    }
+
+    /**
+     * @brief Appends the spatials with geometry whose bounds touch the
+     * frustum, skipping whole subtrees that lie outside it.
+     * @param mask The planes left to test, `frustum::all_planes` at the root.
+     */
+    virtual void collect_visible(const frustum &f,
+                                 uint32_t mask,
+                                 vector<spatial *> &visible);
+
+    int get_memory_used() const override;
+
+    /** @brief Adds the spatial, and one update of its world transform. */
+    void add_cost(scene_cost &cost) const override;
+
 protected:
+    friend class node; // Marks its children dirty.
+
+    /**
+     * @brief Marks the world transform stale, along with those of every
+     * descendant. A dirty spatial always has a dirty subtree, since world
+     * transforms are only cleaned from the root down.
+     */
+    virtual void mark_world_dirty()
+    {
+        is_world_dirty = true;
+        mark_bound_dirty();
+    }
+
+    /**
+     * @brief Marks the world bound stale, along with those of every
+     * ancestor. Bounds are cleaned from the leaves up, so a dirty bound
+     * always has dirty ancestors and the walk stops at the first one.
+     */
+    void mark_bound_dirty()
+    {
+        for (spatial *s = this; s && !s->m_bound_dirty; s = s->m_parent)
+            s->m_bound_dirty = true;
+    }
+
+    /** @brief Recomputes `m_world_bound` from the model bound. */
+    virtual void update_world_bound();
+
     transformation local;
     transformation world_transform;
     bool is_world_dirty;
@@ -77,11 +148,21 @@ protected:
     spatial() : m_parent(nullptr), is_world_dirty(false) {}
     spatial *m_parent;
 
+    bounding_sphere m_model_bound;
+    bounding_sphere m_world_bound;
+    bool m_bound_dirty = true;
+
 public:
     void set_parent(spatial *parent)
     {
-        m_parent       = parent;
-        is_world_dirty = true;
+        // Both parents' bounds change with this subtree, even when the
+        // subtree itself is already dirty.
+        if (m_parent)
+            m_parent->mark_bound_dirty();
+        m_parent = parent;
+        if (m_parent)
+            m_parent->mark_bound_dirty();
+        mark_world_dirty();
     }
 };
 } // namespace zabato
\ No newline at end of file
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <zabato/allocator.hpp>
+#include <zabato/color.hpp>
+#include <zabato/gpu.hpp>
+#include <zabato/math.hpp>
+#include <zabato/real.hpp>
+#include <zabato/vector.hpp>
+
+#include <stdint.h>
+
+namespace zabato
+{
+/** @brief A textured quad queued in a `sprite_batch`. */
+struct sprite
+{
+    texture *tex = nullptr; ///< Drawn untextured when null.
+    vec2<real> position;    ///< The corner drawn with `uv_min`.
+    vec2<real> size;
+    vec2<real> uv_min = vec2<real>(real(0));
+    vec2<real> uv_max = vec2<real>(real(1));
+    color tint        = color(real(1), real(1), real(1), real(1));
+    real z            = real(0); ///< Sprites with a lower z draw first.
+};
+
+/**
+ * @class sprite_batch
+ * @brief Collects sprites and draws them with as few draws as possible.
+ *
+ * `end` sorts the sprites by z, then texture, then submission order, writes
+ * them into one vertex array and issues one draw per run of sprites sharing a
+ * texture, so sprites packed into an atlas draw together. GPUs without
+ * retained geometry get one `begin`/`end` block per run instead.
+ *
+ * The batch only binds textures; the projection, blending and depth state are
+ * left to the caller. z only orders the sprites, every vertex is at depth 0.
+ */
+class sprite_batch
+{
+public:
+    sprite_batch() = default;
+    ~sprite_batch();
+
+    sprite_batch(const sprite_batch &)            = delete;
+    sprite_batch &operator=(const sprite_batch &) = delete;
+
+    /** @brief Drops the queued sprites, keeping the memory. */
+    void begin();
+
+    /** @brief Queues a sprite. */
+    void draw(const sprite &s);
+
+    /** @brief Sorts and draws the queued sprites, then clears the batch. */
+    void end(gpu &g);
+
+    /** @return The number of queued sprites. */
+    size_t size() const { return m_sprites.size(); }
+
+    /** @return The draws issued by the last `end`. */
+    size_t get_draw_count() const { return m_draw_count; }
+
+private:
+    template <class T> using array = vector<T, scene_allocator<T>>;
+
+    struct sort_item
+    {
+        uint32_t z; ///< Order preserving bits of the sprite's z.
+        uint32_t index;
+    };
+
+    struct sprite_vertex
+    {
+        vec3<real> position;
+        color tint;
+        vec2<real> uv;
+    };
+
+    void bind_gpu(gpu &g);
+    void release_buffers();
+    void write_quad(const sprite &s, sprite_vertex *out) const;
+    void flush(gpu &g, size_t first, size_t count);
+    void flush_immediate(gpu &g, size_t first, size_t count);
+    void bind(gpu &g, texture *tex);
+
+    array<sprite> m_sprites;
+    array<sort_item> m_items;
+    array<sprite_vertex> m_vertices;
+    array<uint16_t> m_indices;
+
+    gpu *m_gpu                     = nullptr; ///< Owner of the buffers.
+    vertex_buffer *m_vertex_buffer = nullptr;
+    index_buffer *m_index_buffer   = nullptr;
+    texture *m_bound               = nullptr;
+    bool m_bound_known             = false; ///< Set once `end` bound a texture.
+    size_t m_draw_count            = 0;
+};
+} // namespace zabato
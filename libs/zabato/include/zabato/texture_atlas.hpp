@@ -0,0 +1,81 @@
+#pragma once
+
+#include <zabato/error.hpp>
+#include <zabato/ice.hpp>
+#include <zabato/math.hpp>
+#include <zabato/real.hpp>
+#include <zabato/resource.hpp>
+#include <zabato/string.hpp>
+#include <zabato/vector.hpp>
+
+#include <stdint.h>
+
+namespace zabato
+{
+template <typename T> result<void> deserialize(ice_reader &reader, T &obj);
+
+/** @brief Where a texture packed into an atlas went. */
+struct atlas_region
+{
+    string_view page;   ///< Archive path of the page texture.
+    uint16_t x      = 0; ///< Pixel rect of the texture in the page.
+    uint16_t y      = 0;
+    uint16_t width  = 0;
+    uint16_t height = 0;
+    vec2<real> uv_min; ///< The rect in texture coordinates of the page.
+    vec2<real> uv_max;
+};
+
+/**
+ * @class texture_atlas
+ * @brief The ATLS table of an archive packed with
+ * `fs::ice_packer::set_texture_atlas`, resolving the original path of a packed
+ * texture to its page and rect.
+ *
+ * Load it from `<directory>/atlas.ice` through a `resource_manager`, then load
+ * the page texture and draw with the region's UVs, e.g. as a `sprite`.
+ */
+class texture_atlas : public resource
+{
+public:
+    static constexpr chunk_id CHUNK_ID = chunk_id("ATLS");
+
+    /**
+     * @brief Finds where a texture was packed.
+     * @param path The archive path the texture had before packing.
+     * @param[out] out The region, whose `page` points into the atlas.
+     * @return False if the texture was not packed into the atlas.
+     */
+    bool find(string_view path, atlas_region &out) const;
+
+    /** @return The number of packed textures. */
+    size_t size() const { return m_region_count; }
+
+    /** @return The number of pages. */
+    size_t get_page_count() const { return m_page_count; }
+
+    size_t get_memory_used() const override
+    {
+        return sizeof(*this) + m_data.size();
+    }
+
+    /** @brief Takes the table of a reloaded atlas. */
+    bool replace_with(resource &loaded) override;
+
+private:
+    const ICE_ATLAS_PAGE *pages() const;
+    const ICE_ATLAS_REGION *regions() const;
+    string_view path_at(uint32_t offset) const;
+
+    vector<uint8_t> m_data; ///< The ATLS payload past its header.
+    uint32_t m_page_count   = 0;
+    uint32_t m_region_count = 0;
+    size_t m_paths_offset   = 0; ///< Where the paths start in `m_data`.
+
+    template <typename T>
+    friend result<void> deserialize(ice_reader &reader, T &obj);
+};
+
+template <>
+result<void> deserialize(ice_reader &reader, texture_atlas &atlas);
+} // namespace zabato
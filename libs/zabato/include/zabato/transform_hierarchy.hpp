@@ -0,0 +1,122 @@
+#pragma once
+
+#include <zabato/allocator.hpp>
+#include <zabato/transformation.hpp>
+#include <zabato/vector.hpp>
+
+#include <assert.h>
+#include <stdint.h>
+
+namespace zabato
+{
+/**
+ * @class transform_hierarchy
+ * @brief A flat store of parented transforms, updated in one linear pass.
+ *
+ * Transforms are kept as parallel arrays in depth-first order, so a parent
+ * always comes before its children and every subtree is a contiguous range.
+ * Changing a local transform marks its whole subtree dirty with one range
+ * fill, and `update` walks the arrays once, recomputing only dirty world
+ * transforms from their already updated parents.
+ *
+ * Transforms are addressed by stable handles, since adding, removing and
+ * reparenting move the entries around to keep the order.
+ */
+class transform_hierarchy
+{
+public:
+    using handle = int32_t;
+
+    static constexpr handle invalid_handle = -1;
+
+    /**
+     * @brief Adds a transform as the last child of `parent`.
+     * @param local The local transform.
+     * @param parent The parent, or `invalid_handle` for a new root.
+     * @return The handle of the new transform.
+     */
+    handle add(const transformation &local, handle parent = invalid_handle);
+
+    /** @brief Removes a transform and its whole subtree. */
+    void remove(handle h);
+
+    /**
+     * @brief Moves a transform and its subtree under another parent.
+     * @param parent The new parent, or `invalid_handle` to make it a root. It
+     * must not be inside the moved subtree.
+     */
+    void set_parent(handle h, handle parent);
+
+    /** @return The parent of a transform, or `invalid_handle` for a root. */
+    handle parent(handle h) const;
+
+    /** @brief Replaces a local transform, marking its subtree dirty. */
+    void set_local(handle h, const transformation &local);
+
+    const transformation &get_local(handle h) const
+    {
+        return m_local[slot_of(h)];
+    }
+
+    /** @return The world transform as of the last `update`. */
+    const transformation &get_world(handle h) const
+    {
+        return m_world[slot_of(h)];
+    }
+
+    /** @return Whether the world transform changed since the last update. */
+    bool is_dirty(handle h) const { return m_dirty[slot_of(h)] != 0; }
+
+    /** @return Whether a handle refers to a live transform. */
+    bool contains(handle h) const
+    {
+        return h >= 0 && size_t(h) < m_slots.size() && m_slots[h] >= 0;
+    }
+
+    /** @return The number of transforms. */
+    size_t size() const { return m_local.size(); }
+
+    /**
+     * @brief Recomputes every dirty world transform.
+     *
+     * Subtrees of different roots are independent, so with more than one
+     * thread the roots are split into contiguous chunks, one per worker.
+     * Small hierarchies always run on the calling thread.
+     *
+     * @param thread_count The number of threads to use, including the calling
+     * one. 0 uses every hardware thread.
+     */
+    void update(uint32_t thread_count = 1);
+
+    /** @brief Removes every transform. */
+    void clear();
+
+private:
+    template <class T> using array = vector<T, scene_allocator<T>>;
+
+    int32_t slot_of(handle h) const
+    {
+        assert(contains(h));
+        return m_slots[h];
+    }
+
+    void open_gap(size_t pos, size_t count);
+    void close_gap(size_t pos, size_t count);
+    void resize_ancestors(int32_t slot, int32_t delta);
+    void mark_dirty(int32_t slot);
+    void update_range(size_t begin, size_t end);
+
+    static void update_chunk(void *context);
+
+    // One entry per transform, in depth-first order.
+    array<transformation> m_local;
+    array<transformation> m_world;
+    array<int32_t> m_parent;       ///< Slot of the parent, -1 for roots.
+    array<int32_t> m_subtree_size; ///< Entries in the subtree, itself included.
+    array<handle> m_handle;        ///< Handle of every slot.
+    array<uint8_t> m_dirty;
+
+    array<int32_t> m_slots;    ///< Slot of every handle, -1 once removed.
+    array<handle> m_free_list; ///< Removed handles, reused by `add`.
+};
+} // namespace zabato
@@ -9,18 +9,23 @@ namespace zabato
 class transformation
 {
 public:
-    transformation() {}
+    transformation() { make_identity(); }
     ~transformation() {}
 
     static const transformation IDENTITY;
 
-    void set_rotate(const quat<real> &rotate) { m_rotation = rotate; }
+    void set_rotate(const quat<real> &rotate)
+    {
+        m_rotation    = rotate;
+        m_is_identity = false;
+    }
 
     quat<real> rotate() const { return m_rotation; }
 
     void set_translate(const vec3<real> &translate)
     {
         m_translation = translate;
+        m_is_identity = false;
     }
 
     vec3<real> translate() const { return m_translation; }
@@ -29,6 +34,7 @@ public:
     {
         m_scale            = scale;
         m_is_uniform_scale = scale.x == scale.y && scale.y == scale.z;
+        m_is_identity      = false;
     }
 
     vec3<real> scale() const { return m_scale; }
@@ -53,6 +59,7 @@ public:
     {
         m_scale            = vec3<real>(scale);
         m_is_uniform_scale = true;
+        m_is_identity      = false;
     }
 
     void make_identity()
@@ -86,10 +93,37 @@ public:
 
     void apply_forward(size_t count, vec3<real> *points) const
     {
-        for (size_t i = 0; i < count; ++i)
-            points[i] = apply_forward(points[i]);
+        apply_forward(count, points, points);
     }
 
+    /**
+     * @brief Transforms an array of points, converting the transformation to
+     * a matrix once and running a SIMD loop over the points.
+     * @param count The number of points.
+     * @param points The points to read.
+     * @param out Receives the transformed points, may be `points`.
+     */
+    void apply_forward(size_t count,
+                       const vec3<real> *points,
+                       vec3<real> *out) const;
+
+    /**
+     * @brief Transforms points stored as separate x, y and z arrays, in place.
+     * Four points are processed per step.
+     */
+    void apply_forward(size_t count, real *x, real *y, real *z) const;
+
+    /**
+     * @brief Transforms an array of normals by the rotation and inverse scale,
+     * renormalizing them.
+     * @param count The number of normals.
+     * @param normals The normals to read.
+     * @param out Receives the transformed normals, may be `normals`.
+     */
+    void apply_forward_normals(size_t count,
+                               const vec3<real> *normals,
+                               vec3<real> *out) const;
+
     plane3<real> apply_forward(const plane3<real> &plane) const
     {
         if (m_is_identity)
@@ -122,11 +156,60 @@ public:
 
     void apply_backward(size_t count, vec3<real> *points) const
     {
-        if (m_is_identity)
-            return;
+        apply_backward(count, points, points);
+    }
+
+    /**
+     * @brief Applies the inverse transformation to an array of points.
+     * @param count The number of points.
+     * @param points The points to read.
+     * @param out Receives the transformed points, may be `points`.
+     */
+    void apply_backward(size_t count,
+                        const vec3<real> *points,
+                        vec3<real> *out) const;
+
+    /** @brief Applies the inverse transformation to points stored as
+     * separate x, y and z arrays, in place. */
+    void apply_backward(size_t count, real *x, real *y, real *z) const;
+
+    /** @return The matrix `translate * rotate * scale`. */
+    mat4<real> to_matrix() const
+    {
+        mat4<real> m = mat4_from_quat(m_rotation);
+        for (int row = 0; row < 3; ++row)
+        {
+            m.m[0][row] = m.m[0][row] * m_scale.x;
+            m.m[1][row] = m.m[1][row] * m_scale.y;
+            m.m[2][row] = m.m[2][row] * m_scale.z;
+        }
+        m.m03 = m_translation.x;
+        m.m13 = m_translation.y;
+        m.m23 = m_translation.z;
+        return m;
+    }
+
+    /** @return The matrix of `apply_backward`, without a general inverse. */
+    mat4<real> to_inverse_matrix() const
+    {
+        // (T * R * S)^-1 = S^-1 * R^T * T^-1
+        const mat4<real> r         = mat4_from_quat(m_rotation);
+        const vec3<real> inv_scale = vec3<real>(1) / m_scale;
 
-        for (size_t i = 0; i < count; ++i)
-            points[i] = apply_backward(points[i]);
+        mat4<real> m = mat4<real>::identity();
+        for (int row = 0; row < 3; ++row)
+        {
+            const real s = (&inv_scale.x)[row];
+            for (int col = 0; col < 3; ++col)
+                m.m[col][row] = r.m[row][col] * s;
+        }
+        m.m03 = -(m.m00 * m_translation.x + m.m01 * m_translation.y +
+                  m.m02 * m_translation.z);
+        m.m13 = -(m.m10 * m_translation.x + m.m11 * m_translation.y +
+                  m.m12 * m_translation.z);
+        m.m23 = -(m.m20 * m_translation.x + m.m21 * m_translation.y +
+                  m.m22 * m_translation.z);
+        return m;
     }
 
     void product(const transformation &a, const transformation &b)
@@ -154,13 +237,7 @@ public:
         }
         else
         {
-            mat4<real> ma = mat4_translation(a.m_translation) *
-                            mat4_from_quat(a.m_rotation) *
-                            mat4_scaling(a.m_scale);
-            mat4<real> mb = mat4_translation(b.m_translation) *
-                            mat4_from_quat(b.m_rotation) *
-                            mat4_scaling(b.m_scale);
-            mat4<real> m = ma * mb;
+            mat4<real> m = a.to_matrix() * b.to_matrix();
             mat4_decompose(m, m_translation, m_scale, m_rotation);
             m_is_uniform_scale = abs(m_scale.x - m_scale.y) < real::epsilon() &&
                                  abs(m_scale.x - m_scale.z) < real::epsilon();
@@ -168,6 +245,20 @@ public:
         }
     }
 
+    /**
+     * @brief Composes `parents[i]` with `children[i]` into `out[i]`, for
+     * updating the world transforms of a level of a hierarchy at once.
+     * @param count The number of pairs.
+     * @param parents The parent world transforms.
+     * @param children The child local transforms.
+     * @param out Receives the child world transforms, must not overlap the
+     * inputs.
+     */
+    static void product(size_t count,
+                        const transformation *parents,
+                        const transformation *children,
+                        transformation *out);
+
     void inverse(transformation &inv) const
     {
         if (m_is_identity)
@@ -187,8 +278,7 @@ public:
         }
         else
         {
-            mat4<real> m = mat4_translation(m_translation) *
-                           mat4_from_quat(m_rotation) * mat4_scaling(m_scale);
+            mat4<real> m = to_matrix();
             mat4<real> m_inv;
             if (zabato::inverse(m, m_inv))
             {
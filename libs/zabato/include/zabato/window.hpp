@@ -384,6 +384,21 @@ bool get_gamepad_state(int jid, gamepad_state *state);
  */
 const char *get_gamepad_name(int jid);
 
+/**
+ * @brief The keys, mouse and gamepads as of the last `poll_events` or
+ * `wait_events`, which process the event queue into it once per frame.
+ * Read it from the thread handling the events.
+ */
+const input_state &get_input();
+
+/**
+ * @brief Captures the state of the keys, mouse and gamepads. Call it from
+ * the thread handling the events, after `poll_events`, and hand the snapshot
+ * to other threads instead of letting them query the window.
+ * @param snapshot Overwritten whole.
+ */
+void capture_input(input_snapshot &snapshot);
+
 using gamepad_callback = void (*)(int, connect_event);
 /**
  * @brief Sets the global gamepad connection callback.
@@ -2,9 +2,12 @@
 
 #include <zabato/camera.hpp>
 #include <zabato/controller.hpp>
+#include <zabato/controller_set.hpp>
 #include <zabato/model.hpp>
 #include <zabato/renderer.hpp> // forward decl?
 #include <zabato/spatial.hpp>
+#include <zabato/transform_hierarchy.hpp>
+#include <zabato/world_partition.hpp>
 
 namespace zabato
 {
@@ -35,6 +38,35 @@ public:
      */
     spatial *get_scene_root() const { return m_root; }
 
+    /**
+     * @brief The index of the live objects, for lookups by handle, id or
+     * name without walking the scene. It holds every object, attached to the
+     * scene or not, since objects are created before they are attached.
+     */
+    object_registry &get_objects() const { return get_registry(); }
+
+    using object::get_all_objects_by_name;
+    using object::get_object_by_name;
+
+    /** @brief Finds a live object by id through the registry. */
+    object *get_object_by_id(uuid id) override
+    {
+        return get_registry().find(id);
+    }
+
+    /** @brief Finds the live object most recently given a name. */
+    object *get_object_by_name(const symbol *name) override
+    {
+        return get_registry().find_by_name(name);
+    }
+
+    /** @brief Appends every live object with a name. */
+    void get_all_objects_by_name(const symbol *name,
+                                 vector<object *> &objects) override
+    {
+        get_registry().find_all_by_name(name, objects);
+    }
+
     /**
      * @brief Register a model to the world.
      * Use this if the model is already in the scene graph but not tracked by
@@ -66,6 +98,28 @@ public:
      */
     void unregister_controllers_recursive(spatial *s);
 
+    /**
+     * @brief The controllers of the world, bucketed by type. Per-type tick
+     * intervals are set here.
+     */
+    controller_set &get_controllers() { return m_controllers; }
+    const controller_set &get_controllers() const { return m_controllers; }
+
+    /**
+     * @brief The flat transform store of the world. `transform_hierarchy::
+     * update` recomputes its dirty entries in one pass.
+     */
+    transform_hierarchy &get_transforms() { return m_transforms; }
+    const transform_hierarchy &get_transforms() const { return m_transforms; }
+
+    /**
+     * @brief The cells of an open level streamed around the camera. Give it
+     * a node under the scene root with `world_partition::set_target`, then
+     * update it with the camera position after `resource_manager::update`.
+     */
+    world_partition &get_partition() { return m_partition; }
+    const world_partition &get_partition() const { return m_partition; }
+
     /**
      * @brief Update the world (scene graph transforms, animations, etc).
      * @param dt Delta time in seconds.
@@ -78,9 +132,12 @@ private:
     void update_node(spatial *node, real dt);
 
     pointer<spatial> m_root;
-    vector<pointer<model>> m_models;
+    vector<pointer<model>, scene_allocator<pointer<model>>> m_models;
+    transform_hierarchy m_transforms;
+    world_partition m_partition;
 
     controller *m_controller_head;
+    controller_set m_controllers;
 };
 
 } // namespace zabato
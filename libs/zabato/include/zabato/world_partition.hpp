@@ -0,0 +1,131 @@
+#pragma once
+
+#include <zabato/hash_map.hpp>
+#include <zabato/math.hpp>
+#include <zabato/node.hpp>
+#include <zabato/resource.hpp>
+#include <zabato/scene_file.hpp>
+#include <zabato/string.hpp>
+#include <zabato/vector.hpp>
+
+#include <stdint.h>
+
+namespace zabato
+{
+/**
+ * @class world_partition
+ * @brief Streams the cells of an open level in and out around a point,
+ * usually the camera.
+ *
+ * The level is cut into square cells on the XZ plane, each a separate file
+ * holding a SCEN chunk compiled by `compile_scene`. `update` requests the
+ * cells within the load radius through `resource_manager::load_async`,
+ * attaches the root of each one that arrived to the partition's node, and
+ * detaches and unloads the cells beyond the unload radius. The unload radius
+ * is larger, so a point moving along a cell border does not load and unload
+ * the same cells every frame.
+ *
+ * Memory and load time follow the cells near the point rather than the size
+ * of the level, and the work per update follows the cells in use.
+ */
+class world_partition
+{
+public:
+    /** @brief How far a cell is, measured to its closest point. */
+    struct settings
+    {
+        real cell_size     = real(64);
+        real load_radius   = real(128);
+        real unload_radius = real(160); ///< At least `load_radius`.
+    };
+
+    world_partition()                                   = default;
+    world_partition(const world_partition &)            = delete;
+    world_partition &operator=(const world_partition &) = delete;
+    ~world_partition();
+
+    /**
+     * @brief Sets where cells are loaded from and attached to. Set both
+     * before the first `update`.
+     * @param manager Loads the cells, and must outlive the partition.
+     * @param root The node the roots of the cells are attached to.
+     */
+    void set_target(resource_manager *manager, node *root);
+
+    void set_settings(const settings &s) { m_settings = s; }
+    const settings &get_settings() const { return m_settings; }
+
+    /**
+     * @brief Registers a cell of the level.
+     * @param x The column of the cell, covering `x * cell_size` onwards.
+     * @param z The row of the cell, covering `z * cell_size` onwards.
+     * @param path The file holding the cell's SCEN chunk.
+     * @return False if the cell was already registered.
+     */
+    bool add_cell(int32_t x, int32_t z, string_view path);
+
+    /**
+     * @brief Streams the cells around a point. Call it after
+     * `resource_manager::update`, which delivers the loads it requested.
+     * @param position The point, usually the camera's position.
+     */
+    void update(const vec3<real> &position);
+
+    /** @brief Detaches and unloads every cell. */
+    void unload_all();
+
+    /** @return The number of registered cells. */
+    size_t get_cell_count() const { return m_cells.size(); }
+
+    /** @return The number of cells attached to the root. */
+    size_t get_loaded_count() const { return m_loaded_count; }
+
+    /** @return The number of cells requested and not arrived yet. */
+    size_t get_loading_count() const
+    {
+        return m_active.size() - m_loaded_count;
+    }
+
+    /** @return The root of a loaded cell, or null. */
+    spatial *get_cell_root(int32_t x, int32_t z) const;
+
+private:
+    enum class cell_state : uint8_t
+    {
+        unloaded,
+        loading,
+        loaded,
+        failed ///< Not requested again.
+    };
+
+    struct cell
+    {
+        int32_t x = 0;
+        int32_t z = 0;
+        string path;
+        cell_state state = cell_state::unloaded;
+        resource_future<scene_file> future;
+        shared_ptr<scene_file> scene;
+    };
+
+    static uint64_t key_of(int32_t x, int32_t z)
+    {
+        return (uint64_t(uint32_t(x)) << 32) | uint32_t(z);
+    }
+
+    /** @return The squared distance from a point to a cell, on XZ. */
+    real distance_sq(const cell &c, const vec3<real> &position) const;
+
+    void arrive(cell &c);
+    void release(cell &c);
+
+    resource_manager *m_manager = nullptr;
+    pointer<node> m_root;
+    settings m_settings;
+
+    vector<cell> m_cells;
+    hash_map<uint64_t, uint32_t> m_by_coord; ///< Index into `m_cells`.
+    vector<uint32_t> m_active; ///< The cells loading or loaded.
+    size_t m_loaded_count = 0;
+};
+} // namespace zabato
@@ -1,23 +1,152 @@
 #include <zabato/animator.hpp>
+#include <zabato/profiler.hpp>
 
 namespace zabato
 {
-void animator::play_animation(animation *anim, const mesh &mesh_ref, bool loop)
+/**
+ * @brief Greedy keyframe reduction shared by every curve type.
+ *
+ * Extends the segment from the last kept key for as long as linear
+ * interpolation across it keeps every skipped key within tolerance.
+ *
+ * @param keys The keys to reduce, sorted by timestamp.
+ * @param fits Whether interpolating `(a, b, t)` reproduces a key.
+ */
+template <typename Key, typename Fits>
+static void reduce_curve(vector<Key> &keys, const Fits &fits)
 {
-    m_current_animation = anim;
-    m_loop              = loop;
-    m_current_time      = real(0);
-    m_bone_id_to_anim_bone_index.clear();
+    if (keys.size() < 2)
+        return;
 
-    for (auto &mat : m_final_bone_matrices)
-        mat = mat4<real>::identity();
+    vector<Key> kept;
+    kept.push_back(keys[0]);
 
-    if (!anim)
+    size_t anchor = 0;
+    for (size_t end = 2; end < keys.size(); ++end)
+    {
+        const real t0 = keys[anchor].timestamp;
+        const real t1 = keys[end].timestamp;
+        for (size_t i = anchor + 1; i < end; ++i)
+        {
+            real t = animation_track::get_scale_factor(
+                t0, t1, keys[i].timestamp);
+            if (!fits(keys[anchor], keys[end], t, keys[i]))
+            {
+                anchor = end - 1;
+                kept.push_back(keys[anchor]);
+                break;
+            }
+        }
+    }
+    kept.push_back(keys.back());
+
+    // A curve that never leaves its first value needs a single key.
+    if (kept.size() == 2 && fits(kept[0], kept[0], real(0), kept[1]))
+        kept.resize(1);
+
+    keys = kept;
+}
+
+void animation_track::reduce(const key_tolerance &tolerance)
+{
+    reduce_curve(positions,
+                 [&](const key_position &a,
+                     const key_position &b,
+                     real t,
+                     const key_position &k)
+                 {
+                     vec3<real> p = lerp<vec3<real>>(a.position, b.position, t);
+                     return length(p - (vec3<real>)k.position) <=
+                            tolerance.position;
+                 });
+
+    reduce_curve(rotations,
+                 [&](const key_rotation &a,
+                     const key_rotation &b,
+                     real t,
+                     const key_rotation &k)
+                 {
+                     quat<real> q = slerp<real>(a.rotation, b.rotation, t);
+                     real d = min(abs(dot(q, (quat<real>)k.rotation)), real(1));
+                     return real(2) * acos(d) <= tolerance.rotation;
+                 });
+
+    reduce_curve(scales,
+                 [&](const key_scale &a,
+                     const key_scale &b,
+                     real t,
+                     const key_scale &k)
+                 {
+                     vec3<real> d = lerp<vec3<real>>(a.scale, b.scale, t) -
+                                    (vec3<real>)k.scale;
+                     return max(max(abs(d.x), abs(d.y)), abs(d.z)) <=
+                            tolerance.scale;
+                 });
+}
+
+/** @brief Resolves each node's bone by name against the mesh skeleton. */
+static void bind_nodes_recursive(animation_node &node, const mesh &mesh_ref)
+{
+    node.bone = mesh_ref.find_bone_info(node.name.c_str());
+    for (auto &child : node.children)
+        bind_nodes_recursive(child, mesh_ref);
+}
+
+/** @brief Records the decomposed node transform of every bound bone. */
+static void collect_rest_recursive(const animation_node &node,
+                                   vector<bone_pose> &rest)
+{
+    if (node.bone && node.bone->bone_id >= 0 &&
+        size_t(node.bone->bone_id) < rest.size())
+    {
+        bone_pose &pose = rest[node.bone->bone_id];
+        mat4_decompose<real>(
+            node.transform, pose.position, pose.scale, pose.rotation);
+    }
+    for (const auto &child : node.children)
+        collect_rest_recursive(child, rest);
+}
+
+namespace
+{
+/**
+ * @brief Drops the entries only `map` still references, once it has grown to
+ * `sweep_size`, and doubles the threshold from what is left.
+ */
+template <typename Key, typename Value>
+void sweep_unreferenced(hash_map<Key, Value> &map, size_t &sweep_size)
+{
+    if (map.size() < sweep_size)
         return;
 
+    vector<Key> unused;
+    for (const auto &entry : map)
+        if (entry.value.use_count() == 1)
+            unused.push_back(entry.key);
+    for (const auto &key : unused)
+        map.erase(key);
+    sweep_size = max(map.size() * 2, (size_t)16);
+}
+} // namespace
+
+shared_ptr<const animation_binding>
+animation::bind(const mesh &mesh_ref) const
+{
+    const uint32_t key = mesh_ref.get_skeleton_id();
+
+    shared_ptr<const animation_binding> cached;
+    {
+        lock_guard lock(m_cache_lock);
+        if (m_bindings.try_get_value(key, cached))
+            return cached;
+    }
+
+    auto binding         = make_shared<animation_binding>();
+    binding->root        = m_root_node;
+    binding->skeleton_id = key;
+    bind_nodes_recursive(binding->root, mesh_ref);
+
     const auto model_bone_count = mesh_ref.get_bone_count();
-    if (model_bone_count == 0)
-        return;
 
     int32_t max_bone_id = -1;
     for (uint16_t i = 0; i < model_bone_count; ++i)
@@ -28,22 +157,550 @@ void animator::play_animation(animation *anim, const mesh &mesh_ref, bool loop)
             max_bone_id = bone.bone_id;
     }
 
-    if (max_bone_id > -1)
+    // The palette is indexed by mesh bone id, as referenced by the per-vertex
+    // bone weights.
+    binding->remap.resize(max_bone_id + 1, -1);
+    for (uint16_t i = 0; i < model_bone_count; ++i)
+    {
+        bone_info bone = {};
+        mesh_ref.get_bone(i, bone);
+        if (bone.bone_id >= 0)
+            binding->remap[bone.bone_id] = find_bone_index(bone.name.c_str());
+    }
+
+    binding->rest.resize(binding->remap.size());
+    collect_rest_recursive(binding->root, binding->rest);
+
+    // Another thread may have bound the same skeleton meanwhile, keep its
+    // binding so every animator shares one.
+    lock_guard lock(m_cache_lock);
+    if (m_bindings.try_get_value(key, cached))
+        return cached;
+    sweep_unreferenced(m_bindings, m_binding_sweep_size);
+    m_bindings.add(key, binding);
+    return binding;
+}
+
+namespace
+{
+/** @return The bytes of the children below `node`, not of `node` itself. */
+size_t get_children_memory(const animation_node &node)
+{
+    size_t bytes = node.children.capacity() * sizeof(animation_node);
+    for (const animation_node &child : node.children)
+        bytes += get_children_memory(child);
+    return bytes;
+}
+
+template <typename Map> size_t get_table_memory(const Map &map)
+{
+    return map.capacity() * (sizeof(typename Map::entry) + 1);
+}
+} // namespace
+
+size_t animation::get_memory_used() const
+{
+    lock_guard lock(m_cache_lock);
+    size_t bytes = sizeof(*this) + get_children_memory(m_root_node) +
+                   m_channels.capacity() * sizeof(anim_bone) +
+                   get_table_memory(m_bone_index) +
+                   get_table_memory(m_bindings) + get_table_memory(m_poses);
+
+    for (const anim_bone &channel : m_channels)
     {
-        m_bone_id_to_anim_bone_index.resize(max_bone_id + 1, -1);
-        for (uint16_t i = 0; i < model_bone_count; ++i)
+        const animation_track &track = channel.track;
+        bytes += track.positions.capacity() * sizeof(key_position) +
+                 track.rotations.capacity() * sizeof(key_rotation) +
+                 track.scales.capacity() * sizeof(key_scale);
+    }
+
+    // Shared with the animators playing the clip, counted once here.
+    for (const auto &entry : m_bindings)
+    {
+        const animation_binding &binding = *entry.value;
+        bytes += sizeof(binding) + get_children_memory(binding.root) +
+                 binding.remap.capacity() * sizeof(int32_t) +
+                 binding.rest.capacity() * sizeof(bone_pose);
+    }
+    for (const auto &entry : m_poses)
+        bytes += sizeof(animation_pose) +
+                 entry.value->matrices.capacity() * sizeof(mat4<real>);
+    return bytes;
+}
+
+shared_ptr<const animation_pose> animation::find_pose(uint64_t key) const
+{
+    shared_ptr<const animation_pose> pose;
+    lock_guard lock(m_cache_lock);
+    m_poses.try_get_value(key, pose);
+    return pose;
+}
+
+void animation::add_pose(uint64_t key,
+                         const shared_ptr<const animation_pose> &pose)
+{
+    lock_guard lock(m_cache_lock);
+    sweep_unreferenced(m_poses, m_pose_sweep_size);
+    m_poses.add_or_set(key, pose);
+}
+
+void animator::play_animation(animation *anim, const mesh &mesh_ref, bool loop)
+{
+    m_fade = animation_layer();
+
+    for (auto &mat : m_final_bone_matrices)
+        mat = mat4<real>::identity();
+
+    start_clip(anim, mesh_ref, loop);
+}
+
+void animator::cross_fade(animation *anim,
+                          const mesh &mesh_ref,
+                          real duration,
+                          bool loop)
+{
+    if (!m_current_animation || !anim || duration <= real(0))
+    {
+        play_animation(anim, mesh_ref, loop);
+        return;
+    }
+
+    // The current clip becomes the outgoing layer, time and cursors intact.
+    m_fade.clip     = m_current_animation;
+    m_fade.binding  = m_binding;
+    m_fade.time     = m_current_time;
+    m_fade.weight   = real(1);
+    m_fade.loop     = m_loop;
+    m_fade.additive = false;
+    swap(m_fade.cursors, m_cursors);
+    m_fade_duration = duration;
+    m_fade_elapsed  = real(0);
+
+    start_clip(anim, mesh_ref, loop);
+}
+
+size_t animator::add_layer(animation *anim,
+                           const mesh &mesh_ref,
+                           real weight,
+                           bool additive,
+                           bool loop)
+{
+    assert(anim);
+
+    animation_layer layer = {};
+    layer.clip            = anim;
+    layer.binding         = anim->bind(mesh_ref);
+    layer.weight          = clamp(weight, real(0), real(1));
+    layer.loop            = loop;
+    layer.additive        = additive;
+    layer.cursors.resize(anim->get_bones().size());
+
+    m_layers.push_back(move(layer));
+    return m_layers.size() - 1;
+}
+
+void animator::start_clip(animation *anim, const mesh &mesh_ref, bool loop)
+{
+    m_current_animation = anim;
+    m_loop              = loop;
+    m_current_time      = real(0);
+    m_binding.reset();
+    m_shared_pose.reset();
+
+    if (!anim)
+        return;
+
+    m_cursors.clear();
+    m_cursors.resize(anim->get_bones().size());
+
+    m_binding = anim->bind(mesh_ref);
+    m_final_bone_matrices.resize(m_binding->remap.size(),
+                                 mat4<real>::identity());
+    m_stale = true;
+}
+
+/** @brief Advances a layer's playback time by `delta_time` seconds. */
+static void advance_layer(animation_layer &layer, real delta_time)
+{
+    if (!layer.clip)
+        return;
+
+    layer.time += layer.clip->get_ticks_per_second() * delta_time;
+    if (layer.loop)
+        layer.time = mod(layer.time, layer.clip->get_duration());
+}
+
+namespace
+{
+/**
+ * @brief Recycles pose scratch buffers across evaluations and animators.
+ * Each thread owns a pool, as controller groups evaluate in parallel.
+ */
+class pose_pool
+{
+public:
+    ~pose_pool()
+    {
+        for (auto *pose : m_free)
+            delete pose;
+    }
+
+    vector<bone_pose> *acquire()
+    {
+        if (m_free.empty())
+            return new vector<bone_pose>();
+        vector<bone_pose> *pose = m_free.back();
+        m_free.pop_back();
+        return pose;
+    }
+
+    void release(vector<bone_pose> *pose) { m_free.push_back(pose); }
+
+private:
+    vector<vector<bone_pose> *> m_free;
+};
+
+thread_local pose_pool g_pose_pool;
+
+/** @brief A pose buffer borrowed from the pool for one evaluation. */
+struct pose_scratch
+{
+    vector<bone_pose> *pose = g_pose_pool.acquire();
+
+    pose_scratch()                                = default;
+    pose_scratch(const pose_scratch &)            = delete;
+    pose_scratch &operator=(const pose_scratch &) = delete;
+    ~pose_scratch() { g_pose_pool.release(pose); }
+};
+} // namespace
+
+/** @brief Samples every animated bone of a clip into a local pose. */
+static void sample_pose(const animation &clip,
+                        const animation_binding &binding,
+                        vector<track_cursor> &cursors,
+                        real time,
+                        size_t bone_count,
+                        vector<bone_pose> &pose)
+{
+    pose.resize(bone_count);
+    for (size_t i = 0; i < bone_count; ++i)
+        pose[i] = i < binding.rest.size() ? binding.rest[i] : bone_pose();
+
+    const auto &channels = clip.get_bones();
+    const size_t count   = min(bone_count, binding.remap.size());
+    for (size_t i = 0; i < count; ++i)
+    {
+        const int32_t channel = binding.remap[i];
+        if (channel < 0)
+            continue;
+
+        const animation_track &track = channels[channel].track;
+        track_cursor &cursor         = cursors[channel];
+        bone_pose &bone              = pose[i];
+
+        bone.position = track.sample_position(time, cursor.position);
+        bone.rotation = track.sample_rotation(time, cursor.rotation);
+        bone.scale    = track.sample_scale(time, cursor.scale);
+        bone.animated = true;
+    }
+}
+
+/** @brief Blends `pose` toward the animated bones of `other`. */
+static void blend_pose(vector<bone_pose> &pose,
+                       const vector<bone_pose> &other,
+                       real weight)
+{
+    const size_t count = min(pose.size(), other.size());
+    for (size_t i = 0; i < count; ++i)
+    {
+        const bone_pose &b = other[i];
+        if (!b.animated)
+            continue;
+
+        bone_pose &a = pose[i];
+        a.position   = lerp(a.position, b.position, weight);
+        a.rotation   = normalize(slerp(a.rotation, b.rotation, weight));
+        a.scale      = lerp(a.scale, b.scale, weight);
+        a.animated   = true;
+    }
+}
+
+/** @brief Adds the offset of `other` from its rest pose, scaled by weight. */
+static void add_pose(vector<bone_pose> &pose,
+                     const vector<bone_pose> &other,
+                     const vector<bone_pose> &rest,
+                     real weight)
+{
+    const size_t count = min(min(pose.size(), other.size()), rest.size());
+    for (size_t i = 0; i < count; ++i)
+    {
+        const bone_pose &b = other[i];
+        if (!b.animated)
+            continue;
+
+        const bone_pose &r = rest[i];
+        bone_pose &a       = pose[i];
+
+        quat<real> delta = conjugate(r.rotation) * b.rotation;
+
+        a.position += (b.position - r.position) * weight;
+        a.rotation = normalize(a.rotation * slerp(quat<real>(), delta, weight));
+
+        const real *bs = &b.scale.x;
+        const real *rs = &r.scale.x;
+        real *as       = &a.scale.x;
+        for (int j = 0; j < 3; ++j)
         {
-            bone_info bone = {};
-            mesh_ref.get_bone(i, bone);
+            real ratio = rs[j] != real(0) ? bs[j] / rs[j] : real(1);
+            as[j] *= real(1) + (ratio - real(1)) * weight;
+        }
+        a.animated = true;
+    }
+}
+
+/** @brief Blends two palettes entry by entry into `out`. */
+static void blend_palettes(const vector<mat4<real>> &from,
+                           const vector<mat4<real>> &to,
+                           real factor,
+                           vector<mat4<real>> &out)
+{
+    const size_t count = min(min(from.size(), to.size()), out.size());
+    for (size_t i = 0; i < count; ++i)
+    {
+        const real *a = &from[i].m00;
+        const real *b = &to[i].m00;
+        real *r       = &out[i].m00;
+        for (size_t j = 0; j < 16; ++j)
+            r[j] = a[j] + (b[j] - a[j]) * factor;
+    }
+}
+
+void animator::update(real delta_time)
+{
+    PROFILE_SCOPE("animator::update");
+    if (!m_current_animation)
+        return;
+
+    m_current_time += m_current_animation->get_ticks_per_second() * delta_time;
+
+    if (m_loop)
+    {
+        m_current_time =
+            mod(m_current_time, m_current_animation->get_duration());
+    }
+
+    if (m_fade.clip)
+    {
+        advance_layer(m_fade, delta_time);
+        m_fade_elapsed += delta_time;
+        if (m_fade_elapsed >= m_fade_duration)
+            m_fade = animation_layer();
+        else
+            m_fade.weight = real(1) - m_fade_elapsed / m_fade_duration;
+    }
+
+    for (auto &layer : m_layers)
+        advance_layer(layer, delta_time);
+
+    // Offscreen characters keep their time but hold the last pose.
+    if (!m_hint_visible && m_policy.pause_offscreen)
+    {
+        m_stale = true;
+        return;
+    }
+
+    const uint8_t interval = get_update_interval();
+    if (interval <= 1)
+    {
+        evaluate(m_final_bone_matrices);
+        m_stale = true;
+        return;
+    }
+
+    // Entering reduced rate, seed both poses with a fresh evaluation.
+    const bool blend = m_policy.interpolate && !m_instanced;
+    if (m_stale)
+    {
+        evaluate(m_final_bone_matrices);
+        if (blend)
+        {
+            m_pose_from = m_final_bone_matrices;
+            m_pose_to   = m_final_bone_matrices;
+        }
+        m_skipped_updates = 1;
+        m_stale           = false;
+        return;
+    }
 
-            auto anim_bone = anim->find_bone_index(bone.name.c_str());
-            m_bone_id_to_anim_bone_index[bone.bone_id] = anim_bone;
+    if (m_skipped_updates == 0)
+    {
+        if (blend)
+        {
+            swap(m_pose_from, m_pose_to);
+            evaluate(m_pose_to);
         }
+        else
+            evaluate(m_final_bone_matrices);
+    }
+
+    m_skipped_updates = uint8_t((m_skipped_updates + 1) % interval);
+
+    if (blend)
+    {
+        const uint8_t step = m_skipped_updates ? m_skipped_updates : interval;
+        blend_palettes(m_pose_from,
+                       m_pose_to,
+                       real(int32_t(step)) / real(int32_t(interval)),
+                       m_final_bone_matrices);
     }
 }
 
+size_t animator::get_memory_used() const
+{
+    size_t bytes = sizeof(*this) +
+                   (m_final_bone_matrices.capacity() + m_pose_from.capacity() +
+                    m_pose_to.capacity()) *
+                       sizeof(mat4<real>) +
+                   (m_cursors.capacity() + m_fade.cursors.capacity()) *
+                       sizeof(track_cursor) +
+                   m_layers.capacity() * sizeof(animation_layer);
+    for (const animation_layer &layer : m_layers)
+        bytes += layer.cursors.capacity() * sizeof(track_cursor);
+    return bytes;
+}
+
+uint32_t animator::get_update_cost() const
+{
+    if (!m_current_animation || (!m_hint_visible && m_policy.pause_offscreen))
+        return 0;
+
+    const uint32_t clips =
+        1 + (m_fade.clip ? 1 : 0) + (uint32_t)m_layers.size();
+    const uint32_t bones = (uint32_t)get_final_bone_matrices().size();
+    return bones * clips / get_update_interval();
+}
+
+uint8_t animator::get_update_interval() const
+{
+    if (m_policy.reduced_interval <= 1 ||
+        m_hint_distance <= m_policy.full_rate_distance)
+        return 1;
+    return m_policy.reduced_interval;
+}
+
+void animator::evaluate(vector<mat4<real>> &palette)
+{
+    // Blended poses depend on more than the clip and time, never share them.
+    if (m_fade.clip || !m_layers.empty())
+    {
+        m_shared_pose.reset();
+        evaluate_layered(palette);
+        return;
+    }
+
+    if (!m_instanced)
+    {
+        m_shared_pose.reset();
+        calculate_bone_transform(
+            &m_binding->root, mat4<real>::identity(), m_current_time, palette);
+        return;
+    }
+
+    const real step    = m_instance_time_step;
+    const real frame   = floor(m_current_time / step);
+    const uint64_t key = (uint64_t(m_binding->skeleton_id) << 32) |
+                         uint32_t(int32_t(frame));
+    if (m_shared_pose && m_shared_key == key)
+        return;
+
+    m_shared_key  = key;
+    m_shared_pose = m_current_animation->find_pose(key);
+    if (m_shared_pose)
+        return;
+
+    auto pose = make_shared<animation_pose>();
+    pose->matrices.resize(m_binding->remap.size(), mat4<real>::identity());
+    calculate_bone_transform(&m_binding->root,
+                             mat4<real>::identity(),
+                             frame * step,
+                             pose->matrices);
+
+    m_shared_pose = pose;
+    m_current_animation->add_pose(key, m_shared_pose);
+}
+
+void animator::evaluate_layered(vector<mat4<real>> &palette)
+{
+    const size_t bone_count = m_binding->remap.size();
+
+    pose_scratch base, layer;
+    sample_pose(*m_current_animation,
+                *m_binding,
+                m_cursors,
+                m_current_time,
+                bone_count,
+                *base.pose);
+
+    if (m_fade.clip)
+    {
+        sample_pose(*m_fade.clip,
+                    *m_fade.binding,
+                    m_fade.cursors,
+                    m_fade.time,
+                    bone_count,
+                    *layer.pose);
+        blend_pose(*base.pose, *layer.pose, m_fade.weight);
+    }
+
+    for (auto &l : m_layers)
+    {
+        if (l.weight <= real(0))
+            continue;
+
+        sample_pose(
+            *l.clip, *l.binding, l.cursors, l.time, bone_count, *layer.pose);
+        if (l.additive)
+            add_pose(*base.pose, *layer.pose, l.binding->rest, l.weight);
+        else
+            blend_pose(*base.pose, *layer.pose, l.weight);
+    }
+
+    compose_pose(&m_binding->root, mat4<real>::identity(), *base.pose, palette);
+}
+
+void animator::compose_pose(const animation_node *node,
+                            const mat4<real> &parent_transform,
+                            const vector<bone_pose> &pose,
+                            vector<mat4<real>> &palette) const
+{
+    const bone_info *bone  = node->bone;
+    const bone_pose *local = nullptr;
+    if (bone && bone->bone_id >= 0 && size_t(bone->bone_id) < pose.size() &&
+        pose[bone->bone_id].animated)
+        local = &pose[bone->bone_id];
+
+    mat4<real> node_transform = node->transform;
+    if (local)
+        node_transform = mat4_translation(local->position) *
+                         mat4_from_quat(local->rotation) *
+                         mat4_scaling(local->scale);
+
+    mat4<real> global_transform = parent_transform * node_transform;
+    if (local && size_t(bone->bone_id) < palette.size())
+    {
+        palette[bone->bone_id] =
+            m_current_animation->get_global_inverse_transform() *
+            global_transform * (mat4<real>)bone->offset_transform;
+    }
+
+    for (const auto &child : node->children)
+        compose_pose(&child, global_transform, pose, palette);
+}
+
 void animator::calculate_bone_transform(const animation_node *node,
-                                        const mat4<real> &parent_transform)
+                                        const mat4<real> &parent_transform,
+                                        real time,
+                                        vector<mat4<real>> &palette)
 {
     assert(node);
 
@@ -57,9 +714,10 @@ void animator::calculate_bone_transform(const animation_node *node,
     if (bone_info)
     {
         int16_t mesh_bone_id = bone_info->bone_id;
-        if (mesh_bone_id < m_bone_id_to_anim_bone_index.size())
+        const auto &remap    = m_binding->remap;
+        if (mesh_bone_id >= 0 && size_t(mesh_bone_id) < remap.size())
         {
-            anim_bone_index = m_bone_id_to_anim_bone_index[mesh_bone_id];
+            anim_bone_index = remap[mesh_bone_id];
             if (anim_bone_index >= 0)
                 anim_bone = &animation_bones[anim_bone_index];
         }
@@ -67,22 +725,23 @@ void animator::calculate_bone_transform(const animation_node *node,
 
     if (anim_bone)
     {
-        anim_bone->update(m_current_time);
+        anim_bone->update(time, m_cursors[anim_bone_index]);
         node_transform = anim_bone->local_transform;
     }
 
     mat4<real> global_transform = parent_transform * node_transform;
     if (bone_info && anim_bone_index >= 0)
     {
-        if (anim_bone_index < m_final_bone_matrices.size())
+        const int16_t mesh_bone_id = bone_info->bone_id;
+        if (mesh_bone_id >= 0 && size_t(mesh_bone_id) < palette.size())
         {
-            m_final_bone_matrices[anim_bone_index] =
+            palette[mesh_bone_id] =
                 animation->get_global_inverse_transform() * global_transform *
                 (mat4<real>)bone_info->offset_transform;
         }
     }
 
     for (const auto &child : node->children)
-        calculate_bone_transform(&child, global_transform);
+        calculate_bone_transform(&child, global_transform, time, palette);
 }
 } // namespace zabato
\ No newline at end of file
@@ -0,0 +1,141 @@
+#include <zabato/bounds.hpp>
+
+namespace zabato
+{
+void aabb::extend(const vec3<real> &point)
+{
+    min.x = zabato::min(min.x, point.x);
+    min.y = zabato::min(min.y, point.y);
+    min.z = zabato::min(min.z, point.z);
+    max.x = zabato::max(max.x, point.x);
+    max.y = zabato::max(max.y, point.y);
+    max.z = zabato::max(max.z, point.z);
+}
+
+void aabb::extend(const aabb &other)
+{
+    if (other.is_empty())
+        return;
+    extend(other.min);
+    extend(other.max);
+}
+
+bounding_sphere bounding_sphere::from_aabb(const aabb &box)
+{
+    bounding_sphere sphere;
+    if (!box.is_empty())
+    {
+        sphere.center = box.center();
+        sphere.radius = length(box.extents());
+    }
+    return sphere;
+}
+
+void bounding_sphere::merge(const bounding_sphere &other)
+{
+    if (other.is_empty())
+        return;
+    if (is_empty())
+    {
+        *this = other;
+        return;
+    }
+
+    const vec3<real> offset = other.center - center;
+    const real distance     = length(offset);
+    if (distance + other.radius <= radius)
+        return;
+    if (distance + radius <= other.radius)
+    {
+        *this = other;
+        return;
+    }
+
+    // Neither holds the other, so the centers are apart.
+    const real merged = (distance + radius + other.radius) * real(0.5);
+    center            = center + offset * ((merged - radius) / distance);
+    radius            = merged;
+}
+
+bounding_sphere bounding_sphere::transformed(const transformation &t) const
+{
+    if (is_empty() || t.is_identity())
+        return *this;
+
+    const vec3<real> scale = t.scale();
+    const real max_scale =
+        zabato::max(abs(scale.x), zabato::max(abs(scale.y), abs(scale.z)));
+
+    bounding_sphere sphere;
+    sphere.center = t.apply_forward(center);
+    sphere.radius = radius * max_scale;
+    return sphere;
+}
+
+frustum frustum::from_matrix(const mat4<real> &m)
+{
+    // Row i of the matrix is (m[0][i], m[1][i], m[2][i], m[3][i]).
+    auto combine = [&m](int row, real sign)
+    {
+        return normalize(plane3<real>(m.m[0][3] + m.m[0][row] * sign,
+                                      m.m[1][3] + m.m[1][row] * sign,
+                                      m.m[2][3] + m.m[2][row] * sign,
+                                      m.m[3][3] + m.m[3][row] * sign));
+    };
+
+    frustum f;
+    f.planes[left_plane]   = combine(0, real(1));
+    f.planes[right_plane]  = combine(0, real(-1));
+    f.planes[bottom_plane] = combine(1, real(1));
+    f.planes[top_plane]    = combine(1, real(-1));
+    f.planes[near_plane]   = combine(2, real(1));
+    f.planes[far_plane]    = combine(2, real(-1));
+    return f;
+}
+
+cull_result frustum::test(const bounding_sphere &sphere, uint32_t &mask) const
+{
+    if (sphere.is_empty())
+        return cull_result::outside;
+
+    for (uint32_t i = 0; i < plane_count; ++i)
+    {
+        const uint32_t bit = 1u << i;
+        if (!(mask & bit))
+            continue;
+
+        const real distance = signed_distance(planes[i], sphere.center);
+        if (distance < -sphere.radius)
+            return cull_result::outside;
+        if (distance >= sphere.radius)
+            mask &= ~bit;
+    }
+    return mask ? cull_result::intersecting : cull_result::inside;
+}
+
+cull_result frustum::test(const aabb &box, uint32_t &mask) const
+{
+    if (box.is_empty())
+        return cull_result::outside;
+
+    const vec3<real> center  = box.center();
+    const vec3<real> extents = box.extents();
+    for (uint32_t i = 0; i < plane_count; ++i)
+    {
+        const uint32_t bit = 1u << i;
+        if (!(mask & bit))
+            continue;
+
+        // The box's half size along the plane normal.
+        const vec3<real> &n = planes[i].normal;
+        const real radius   = abs(n.x) * extents.x + abs(n.y) * extents.y +
+                            abs(n.z) * extents.z;
+        const real distance = signed_distance(planes[i], center);
+        if (distance < -radius)
+            return cull_result::outside;
+        if (distance >= radius)
+            mask &= ~bit;
+    }
+    return mask ? cull_result::intersecting : cull_result::inside;
+}
+} // namespace zabato
@@ -1,7 +1,10 @@
+#include <stdatomic.h>
 #include <stdlib.h>
 #include <zabato/collision.hpp>
+#include <zabato/debug_draw.hpp>
 #include <zabato/gpu.hpp>
 #include <zabato/math.hpp>
+#include <zabato/ray_batch.hpp>
 #include <zabato/real.hpp>
 
 namespace zabato
@@ -124,11 +127,13 @@ void project_polygon(const vec2<real> &axis,
                      real &minValue,
                      real &maxValue)
 {
-    minValue = dot(poly.vertices[0], axis);
+    const polygon_shape::vertex_list &vertices = poly.get_vertices();
+
+    minValue = dot(vertices[0], axis);
     maxValue = minValue;
-    for (size_t i = 1; i < poly.vertices.size(); ++i)
+    for (size_t i = 1; i < vertices.size(); ++i)
     {
-        real p   = dot(poly.vertices[i], axis);
+        real p   = dot(vertices[i], axis);
         minValue = min(minValue, p);
         maxValue = max(maxValue, p);
     }
@@ -144,34 +149,66 @@ void project_circle(const vec2<real> &axis,
     max              = center_proj + circle.radius;
 }
 
+/** @brief Rejects shapes whose bounding circles do not touch. */
+bool bounding_circles_overlap(vec2<real> a_center,
+                              real a_radius,
+                              vec2<real> b_center,
+                              real b_radius)
+{
+    real r = a_radius + b_radius;
+    return length_sq(b_center - a_center) <= r * r;
+}
+
+/** @brief Unit axis from one center to another, or nothing if they meet. */
+void center_axis(vec2<real> from, vec2<real> to, vec2<real> *axis)
+{
+    vec2<real> d = to - from;
+    if (axis && length_sq(d) > real::epsilon())
+        *axis = normalize(d);
+}
+
 bool polygon_vs_polygon(const polygon_shape &a,
                         const polygon_shape &b,
-                        collision_result &result)
+                        collision_result &result,
+                        vec2<real> *separating_axis = nullptr)
 {
     result.collides = false;
     result.distance = real::max_val();
 
-    vec2<real> center[2] = {vec2<real>(0, 0), vec2<real>(0, 0)};
+    if (a.get_vertices().empty() || b.get_vertices().empty())
+        return false;
+    if (!bounding_circles_overlap(
+            a.get_center(), a.get_radius(), b.get_center(), b.get_radius()))
+    {
+        center_axis(a.get_center(), b.get_center(), separating_axis);
+        return false;
+    }
 
-    const polygon_shape *list[] = {&a, &b};
+    // Each polygon's projections on its own normals are cached, only the
+    // other polygon needs projecting.
+    const polygon_shape *list[]  = {&a, &b};
+    const polygon_shape *other[] = {&b, &a};
     for (size_t j = 0; j < 2; j++)
     {
-        const polygon_shape &poly = *list[j];
-        for (size_t i = 0; i < poly.vertices.size(); ++i)
+        const polygon_shape::vertex_list &normals = list[j]->get_normals();
+        const polygon_shape::vertex_list &extents = list[j]->get_extents();
+        for (size_t i = 0; i < normals.size(); ++i)
         {
-            center[j] += poly.vertices[i];
-            vec2<real> edge = poly.vertices[(i + 1) % poly.vertices.size()] -
-                              poly.vertices[i];
-            vec2<real> axis = normalize(vec2<real>(-edge.y, edge.x));
+            const vec2<real> &axis = normals[i];
 
-            real a_min, a_max, b_min, b_max;
-            project_polygon(axis, a, a_min, a_max);
-            project_polygon(axis, b, b_min, b_max);
+            real own_min = extents[i].x, own_max = extents[i].y;
+            real other_min, other_max;
+            project_polygon(axis, *other[j], other_min, other_max);
 
-            if (a_max < b_min || b_max < a_min) // found a separating axis
+            // found a separating axis
+            if (own_max < other_min || other_max < own_min)
+            {
+                if (separating_axis)
+                    *separating_axis = axis;
                 return false;
+            }
 
-            real overlap = min(a_max, b_max) - max(a_min, b_min);
+            real overlap = min(own_max, other_max) - max(own_min, other_min);
             if (overlap < result.distance)
             {
                 result.distance = overlap;
@@ -180,10 +217,7 @@ bool polygon_vs_polygon(const polygon_shape &a,
         }
     }
 
-    center[0] /= real((uint32_t)a.vertices.size());
-    center[1] /= real((uint32_t)b.vertices.size());
-
-    if (dot(center[1] - center[0], result.normal) < 0)
+    if (dot(b.get_center() - a.get_center(), result.normal) < 0)
         result.normal = -result.normal;
 
     result.penetration = result.normal * result.distance;
@@ -193,30 +227,43 @@ bool polygon_vs_polygon(const polygon_shape &a,
 
 bool circle_vs_polygon(const circle_shape &circle,
                        const polygon_shape &poly,
-                       collision_result &result)
+                       collision_result &result,
+                       vec2<real> *separating_axis = nullptr)
 {
     result.collides = false;
     result.distance = real::max_val();
 
-    vec2<real> poly_center = vec2<real>(0, 0);
+    const polygon_shape::vertex_list &vertices = poly.get_vertices();
+    if (vertices.empty())
+        return false;
+    if (!bounding_circles_overlap(circle.position,
+                                  circle.radius,
+                                  poly.get_center(),
+                                  poly.get_radius()))
+    {
+        center_axis(circle.position, poly.get_center(), separating_axis);
+        return false;
+    }
+
+    const polygon_shape::vertex_list &normals = poly.get_normals();
+    const polygon_shape::vertex_list &extents = poly.get_extents();
 
     vec2<real> closest_vertex;
     real min_dist_sq = real::max_val();
-    for (size_t i = 0; i < poly.vertices.size(); ++i)
+    for (size_t i = 0; i < vertices.size(); ++i)
     {
-        vec2<real> vertex = poly.vertices[i];
-        vec2<real> edge =
-            poly.vertices[(i + 1) % poly.vertices.size()] - vertex;
-        vec2<real> axis = normalize(vec2<real>(-edge.y, edge.x));
-
-        poly_center += vertex;
+        const vec2<real> &axis = normals[i];
 
-        real poly_min, poly_max, circle_min, circle_max;
-        project_polygon(axis, poly, poly_min, poly_max);
+        real poly_min = extents[i].x, poly_max = extents[i].y;
+        real circle_min, circle_max;
         project_circle(axis, circle, circle_min, circle_max);
 
-        if (poly_max < circle_min && circle_max < poly_min)
+        if (poly_max < circle_min || circle_max < poly_min)
+        {
+            if (separating_axis)
+                *separating_axis = axis;
             return false;
+        }
 
         real overlap = min(poly_max, circle_max) - max(poly_min, circle_min);
         if (overlap < result.distance)
@@ -225,11 +272,11 @@ bool circle_vs_polygon(const circle_shape &circle,
             result.normal   = axis;
         }
 
-        real d2 = length_sq(vertex - circle.position);
+        real d2 = length_sq(vertices[i] - circle.position);
         if (d2 < min_dist_sq)
         {
             min_dist_sq    = d2;
-            closest_vertex = vertex;
+            closest_vertex = vertices[i];
         }
     }
 
@@ -239,7 +286,11 @@ bool circle_vs_polygon(const circle_shape &circle,
     project_circle(axis, circle, circle_min, circle_max);
 
     if (poly_max < circle_min || circle_max < poly_min)
+    {
+        if (separating_axis)
+            *separating_axis = axis;
         return false;
+    }
 
     real overlap = min(poly_max, circle_max) - max(poly_min, circle_min);
     if (overlap < result.distance)
@@ -249,8 +300,7 @@ bool circle_vs_polygon(const circle_shape &circle,
     }
 
     result.collides = true;
-    poly_center /= real((uint32_t)poly.vertices.size());
-    if (dot(poly_center - circle.position, result.normal) < 0)
+    if (dot(poly.get_center() - circle.position, result.normal) < 0)
         result.normal = -result.normal;
 
     result.penetration = result.normal * result.distance;
@@ -259,20 +309,68 @@ bool circle_vs_polygon(const circle_shape &circle,
 
 bool rect_vs_polygon(const rect_shape &rect,
                      const polygon_shape &poly,
-                     collision_result &result)
+                     collision_result &result,
+                     vec2<real> *separating_axis = nullptr)
 {
+    result.collides = false;
+    result.distance = real::max_val();
+
+    if (poly.get_vertices().empty())
+        return false;
+
     vec2<real> half = rect.size * 0.5;
-    polygon_shape rect_as_poly;
-    rect_as_poly.vertices.resize(4);
-    rect_as_poly.vertices[0] = {rect.position.x - half.x,
-                                rect.position.y - half.y};
-    rect_as_poly.vertices[1] = {rect.position.x + half.x,
-                                rect.position.y - half.y};
-    rect_as_poly.vertices[2] = {rect.position.x + half.x,
-                                rect.position.y + half.y};
-    rect_as_poly.vertices[3] = {rect.position.x - half.x,
-                                rect.position.y + half.y};
-    return polygon_vs_polygon(rect_as_poly, poly, result);
+    if (!bounding_circles_overlap(
+            rect.position, length(half), poly.get_center(), poly.get_radius()))
+    {
+        center_axis(rect.position, poly.get_center(), separating_axis);
+        return false;
+    }
+
+    // The rect's edge normals are the world axes, and its projection on any
+    // axis follows from the half size, so no polygon is built for it.
+    const vec2<real> rect_axes[2] = {{1, 0}, {0, 1}};
+    const polygon_shape::vertex_list &normals = poly.get_normals();
+    const polygon_shape::vertex_list &extents = poly.get_extents();
+    for (size_t i = 0; i < 2 + normals.size(); ++i)
+    {
+        const vec2<real> &axis = i < 2 ? rect_axes[i] : normals[i - 2];
+
+        real center   = dot(rect.position, axis);
+        real extent   = abs(axis.x) * half.x + abs(axis.y) * half.y;
+        real rect_min = center - extent;
+        real rect_max = center + extent;
+
+        real poly_min, poly_max;
+        if (i < 2)
+            project_polygon(axis, poly, poly_min, poly_max);
+        else
+        {
+            poly_min = extents[i - 2].x;
+            poly_max = extents[i - 2].y;
+        }
+
+        // found a separating axis
+        if (rect_max < poly_min || poly_max < rect_min)
+        {
+            if (separating_axis)
+                *separating_axis = axis;
+            return false;
+        }
+
+        real overlap = min(rect_max, poly_max) - max(rect_min, poly_min);
+        if (overlap < result.distance)
+        {
+            result.distance = overlap;
+            result.normal   = axis;
+        }
+    }
+
+    if (dot(poly.get_center() - rect.position, result.normal) < 0)
+        result.normal = -result.normal;
+
+    result.penetration = result.normal * result.distance;
+    result.collides    = true;
+    return true;
 }
 
 bool ray_vs_rectr(vec2<real> origin,
@@ -282,8 +380,8 @@ bool ray_vs_rectr(vec2<real> origin,
 {
     vec2<real> inv_dir   = vec2<real>(1.0, 1.0) / dir;
     vec2<real> half_size = rect.size * 0.5;
-    vec2<real> t_near    = (rect.position - half_size.x - origin) * inv_dir;
-    vec2<real> t_far     = (rect.position + half_size.y - origin) * inv_dir;
+    vec2<real> t_near    = (rect.position - half_size - origin) * inv_dir;
+    vec2<real> t_far     = (rect.position + half_size - origin) * inv_dir;
 
     if (t_near.x > t_far.x)
         swap(t_near.x, t_far.x);
@@ -294,7 +392,7 @@ bool ray_vs_rectr(vec2<real> origin,
         return false;
 
     real t_hit_near = max(t_near.x, t_near.y);
-    real t_hit_far  = max(t_near.x, t_far.y);
+    real t_hit_far  = min(t_far.x, t_far.y);
 
     if (t_hit_far < 0)
         return false;
@@ -304,9 +402,9 @@ bool ray_vs_rectr(vec2<real> origin,
     result.point    = origin + dir * t_hit_near;
 
     if (t_near.x > t_near.y)
-        result.normal = (inv_dir.x < 0) ? vec2<real>(1, 0) : vec2<real>(1, 0);
+        result.normal = inv_dir.x < 0 ? vec2<real>(1, 0) : vec2<real>(-1, 0);
     else
-        result.normal = (inv_dir.y < 0) ? vec2<real>(0, 1) : vec2<real>(0, -1);
+        result.normal = inv_dir.y < 0 ? vec2<real>(0, 1) : vec2<real>(0, -1);
 
     return true;
 }
@@ -344,15 +442,25 @@ bool ray_vs_polygon(vec2<real> origin,
                     const polygon_shape &poly,
                     raycast_result &result)
 {
+    // Rays that miss the bounding circle miss every edge.
+    vec2<real> oc = origin - poly.get_center();
+    real b        = dot(oc, dir);
+    real c        = dot(oc, oc) - poly.get_radius() * poly.get_radius();
+    if ((c > 0 && b > 0) || b * b - c < 0)
+        return false;
+
+    const polygon_shape::vertex_list &vertices = poly.get_vertices();
+    const polygon_shape::vertex_list &normals  = poly.get_normals();
+
     real min_dist = real::max_val();
     bool hit      = false;
 
-    for (size_t i = 0; i < poly.vertices.size(); ++i)
+    for (size_t i = 0; i < vertices.size(); ++i)
     {
-        const vec2<real> v1 = poly.vertices[i];
-        const vec2<real> v2 = poly.vertices[(i + 1) % poly.vertices.size()];
-        vec2<real> edge     = v2 - v1;
-        vec2<real> normal   = normalize(vec2<real>(-edge.y, edge.x));
+        const vec2<real> v1      = vertices[i];
+        const vec2<real> v2      = vertices[(i + 1) % vertices.size()];
+        vec2<real> edge          = v2 - v1;
+        const vec2<real> &normal = normals[i];
 
         real dot_dir_norm = dot(dir, normal);
         if (abs(dot_dir_norm) < real::epsilon())
@@ -382,103 +490,528 @@ bool ray_vs_polygon(vec2<real> origin,
     return hit;
 }
 
-void get_collision_bounds(const collision_shape &shape,
-                          vec2<real> &min_out,
-                          vec2<real> &max_out)
+/**
+ * @brief Casts a ray against a box with rounded corners, the Minkowski sum of
+ * a box and a circle. An origin inside reports a distance of 0 or less.
+ */
+bool ray_vs_rounded_rect(vec2<real> origin,
+                         vec2<real> dir,
+                         vec2<real> center,
+                         vec2<real> half_size,
+                         real radius,
+                         raycast_result &result)
 {
-    switch (shape.get_type())
+    rect_shape wide, tall;
+    wide.position = center;
+    wide.size     = vec2<real>(half_size.x + radius, half_size.y) * real(2);
+    tall.position = center;
+    tall.size     = vec2<real>(half_size.x, half_size.y + radius) * real(2);
+
+    raycast_result piece;
+    bool hit        = false;
+    result.distance = real::max_val();
+
+    const rect_shape *slabs[2] = {&wide, &tall};
+    for (const rect_shape *slab : slabs)
     {
-    case collision_type::rect:
+        if (ray_vs_rectr(origin, dir, *slab, piece) &&
+            piece.distance < result.distance)
+        {
+            result = piece;
+            hit    = true;
+        }
+    }
+
+    circle_shape corner;
+    corner.radius = radius;
+    for (int i = 0; i < 4; ++i)
     {
-        const auto rect      = *static_cast<const rect_shape *>(&shape);
-        vec2<real> half_size = rect.size * real(0.5);
-        min_out              = rect.position - half_size;
-        max_out              = rect.position + half_size;
-        break;
+        corner.position = {center.x + ((i & 1) ? half_size.x : -half_size.x),
+                           center.y + ((i & 2) ? half_size.y : -half_size.y)};
+        if (ray_vs_circle(origin, dir, corner, piece) &&
+            piece.distance < result.distance)
+        {
+            result = piece;
+            hit    = true;
+        }
     }
-    case collision_type::circle:
+
+    return hit;
+}
+
+/**
+ * @brief Casts a ray against a polygon grown by a radius, the Minkowski sum of
+ * the polygon and a circle: each edge pushed out along its normal, joined by a
+ * circle around each vertex. An origin inside reports a distance of 0.
+ */
+bool ray_vs_rounded_polygon(vec2<real> origin,
+                            vec2<real> dir,
+                            const polygon_shape &poly,
+                            real radius,
+                            raycast_result &result)
+{
+    const polygon_shape::vertex_list &vertices = poly.get_vertices();
+    const polygon_shape::vertex_list &normals  = poly.get_normals();
+    const size_t count                 = vertices.size();
+    if (count == 0)
+        return false;
+
+    // Rays that miss the grown bounding circle miss every piece.
+    const real reach = poly.get_radius() + radius;
+    vec2<real> oc    = origin - poly.get_center();
+    real b           = dot(oc, dir);
+    real c           = dot(oc, oc) - reach * reach;
+    if ((c > 0 && b > 0) || b * b - c < 0)
+        return false;
+
+    // The cached normals follow the winding, flip them to face outwards.
+    const real side =
+        dot(normals[0], vertices[0] - poly.get_center()) < real(0) ? real(-1)
+                                                                    : real(1);
+
+    // An origin within `radius` of the polygon starts in contact.
+    real outside = -real::max_val();
+    for (size_t i = 0; i < count; ++i)
+        outside = max(outside, dot(origin - vertices[i], normals[i]) * side);
+
+    bool inside = outside <= real(0);
+    for (size_t i = 0; !inside && outside <= radius && i < count; ++i)
     {
-        const auto circle = *static_cast<const circle_shape *>(&shape);
-        min_out           = {circle.position.x - circle.radius,
-                             circle.position.y - circle.radius};
-        max_out           = {circle.position.x + circle.radius,
-                             circle.position.y + circle.radius};
-        break;
+        const vec2<real> v1   = vertices[i];
+        const vec2<real> edge = vertices[(i + 1) % count] - v1;
+        real along = dot(origin - v1, edge) / length_sq(edge);
+        along      = clamp(along, real(0), real(1));
+        inside     = length_sq(origin - (v1 + edge * along)) <= radius * radius;
     }
-    case collision_type::polygon:
+
+    if (inside)
+    {
+        result.distance = real(0);
+        result.point    = origin;
+        result.normal   = -dir;
+        return true;
+    }
+
+    real min_dist = real::max_val();
+    bool hit      = false;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const vec2<real> normal = normals[i] * side;
+        real dot_dir_norm       = dot(dir, normal);
+        if (dot_dir_norm > -real::epsilon())
+            continue; // Leaving or parallel to the edge
+
+        const vec2<real> v1   = vertices[i] + normal * radius;
+        const vec2<real> edge = vertices[(i + 1) % count] - vertices[i];
+
+        real t = dot(v1 - origin, normal) / dot_dir_norm;
+        if (t >= 0 && t < min_dist)
+        {
+            vec2<real> intersection_point = origin + dir * t;
+            real along                    = dot(intersection_point - v1, edge);
+
+            if (along >= 0 && along <= length_sq(edge))
+            {
+                min_dist      = t;
+                result.point  = intersection_point;
+                result.normal = normal;
+                hit           = true;
+            }
+        }
+    }
+
+    raycast_result piece;
+    circle_shape corner;
+    corner.radius = radius;
+    for (size_t i = 0; i < count; ++i)
     {
-        const auto poly = *static_cast<const polygon_shape *>(&shape);
-        if (poly.vertices.empty())
+        corner.position = vertices[i];
+        if (ray_vs_circle(origin, dir, corner, piece) &&
+            piece.distance < min_dist)
         {
-            min_out = max_out = {real(0), real(0)};
-            return;
+            min_dist      = piece.distance;
+            result.point  = piece.point;
+            result.normal = piece.normal;
+            hit           = true;
+        }
+    }
+
+    if (hit)
+        result.distance = min_dist;
+    return hit;
+}
+
+/**
+ * @brief Sweeps a box against a polygon with the separating axis theorem,
+ * finding when the projections first overlap on every axis at once.
+ */
+bool sweep_rect_vs_polygon(const rect_shape &rect,
+                           vec2<real> motion,
+                           const polygon_shape &poly,
+                           sweep_result &result)
+{
+    const polygon_shape::vertex_list &vertices = poly.get_vertices();
+    const polygon_shape::vertex_list &normals  = poly.get_normals();
+    const polygon_shape::vertex_list &extents  = poly.get_extents();
+    if (vertices.size() == 0)
+        return false;
+
+    const vec2<real> half = rect.size * real(0.5);
+
+    real t_enter            = -real::max_val();
+    real t_exit             = real::max_val();
+    vec2<real> enter_normal = {real(0), real(0)};
+    bool enter_on_polygon   = false;
+
+    // The polygon normals, then the box axes, on which the polygon projects
+    // onto its bounds.
+    for (size_t i = 0; i < normals.size() + 2; ++i)
+    {
+        vec2<real> axis;
+        real lo, hi;
+        if (i < normals.size())
+        {
+            axis = normals[i];
+            lo   = extents[i].x;
+            hi   = extents[i].y;
         }
-        min_out = max_out = poly.vertices[0];
-        for (size_t i = 1; i < poly.vertices.size(); ++i)
+        else if (i == normals.size())
         {
-            min_out.x = min(min_out.x, poly.vertices[i].x);
-            min_out.y = min(min_out.y, poly.vertices[i].y);
-            max_out.x = max(max_out.x, poly.vertices[i].x);
-            max_out.y = max(max_out.y, poly.vertices[i].y);
+            axis = {real(1), real(0)};
+            lo   = poly.get_bounds_min().x;
+            hi   = poly.get_bounds_max().x;
         }
-        break;
+        else
+        {
+            axis = {real(0), real(1)};
+            lo   = poly.get_bounds_min().y;
+            hi   = poly.get_bounds_max().y;
+        }
+
+        // The projections overlap while the box center moved in [near, far].
+        real center = dot(rect.position, axis);
+        real extent = half.x * abs(axis.x) + half.y * abs(axis.y);
+        real speed  = dot(motion, axis);
+        real near   = lo - extent - center;
+        real far    = hi + extent - center;
+
+        if (abs(speed) < real::epsilon())
+        {
+            if (near > real(0) || far < real(0))
+                return false;
+            continue;
+        }
+
+        real t0 = near / speed;
+        real t1 = far / speed;
+        if (t0 > t1)
+            swap(t0, t1);
+
+        if (t0 > t_enter)
+        {
+            t_enter          = t0;
+            enter_normal     = speed > real(0) ? -axis : axis;
+            enter_on_polygon = i < normals.size();
+        }
+        t_exit = min(t_exit, t1);
+
+        if (t_enter > t_exit || t_enter > real(1) || t_exit < real(0))
+            return false;
+    }
+
+    result.hit = true;
+    if (t_enter <= real(0))
+    {
+        result.time   = real(0);
+        result.point  = rect.position;
+        result.normal = length_sq(motion) > real(0) ? -normalize(motion)
+                                                    : vec2<real>(0, 0);
+        return true;
+    }
+
+    result.time   = t_enter;
+    result.normal = enter_normal;
+
+    if (enter_on_polygon)
+    {
+        // A box corner reaches the face of the polygon.
+        vec2<real> corner = {enter_normal.x > real(0) ? -half.x : half.x,
+                             enter_normal.y > real(0) ? -half.y : half.y};
+        result.point      = rect.position + motion * t_enter + corner;
     }
+    else
+    {
+        // A polygon vertex reaches the face of the box.
+        result.point = vertices[0];
+        for (const vec2<real> &v : vertices)
+            if (dot(v, enter_normal) > dot(result.point, enter_normal))
+                result.point = v;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Turns an obstacle ray hit, cast along `motion` from the center of the
+ * moving shape, into a sweep result. The contact point is left to the caller.
+ */
+bool finish_sweep(const raycast_result &hit,
+                  vec2<real> motion,
+                  real length,
+                  sweep_result &result)
+{
+    if (hit.distance > length)
+        return false;
+
+    result.hit = true;
+    if (hit.distance <= real(0))
+    {
+        result.time   = real(0);
+        result.normal = length > real(0) ? -motion / length : vec2<real>(0, 0);
+    }
+    else
+    {
+        result.time   = hit.distance / length;
+        result.normal = hit.normal;
+    }
+    return true;
+}
+
+bool sweep_circle(const circle_shape &circle,
+                  vec2<real> motion,
+                  const collision_shape &obstacle,
+                  sweep_result &result)
+{
+    const real length    = zabato::length(motion);
+    const vec2<real> dir = length > real(0) ? motion / length
+                                            : vec2<real>(1, 0);
+
+    raycast_result hit;
+    switch (obstacle.get_type())
+    {
+    case collision_type::circle:
+    {
+        const auto &other = *static_cast<const circle_shape *>(&obstacle);
+        circle_shape grown;
+        grown.position = other.position;
+        grown.radius   = other.radius + circle.radius;
+        if (!ray_vs_circle(circle.position, dir, grown, hit) ||
+            !finish_sweep(hit, motion, length, result))
+            return false;
+        result.point = other.position + hit.normal * other.radius;
+        return true;
+    }
+    case collision_type::rect:
+    {
+        const auto &rect = *static_cast<const rect_shape *>(&obstacle);
+        if (!ray_vs_rounded_rect(circle.position,
+                                 dir,
+                                 rect.position,
+                                 rect.size * real(0.5),
+                                 circle.radius,
+                                 hit) ||
+            !finish_sweep(hit, motion, length, result))
+            return false;
+        result.point = hit.point - hit.normal * circle.radius;
+        return true;
+    }
+    case collision_type::polygon:
+    {
+        const auto &poly = *static_cast<const polygon_shape *>(&obstacle);
+        if (!ray_vs_rounded_polygon(
+                circle.position, dir, poly, circle.radius, hit) ||
+            !finish_sweep(hit, motion, length, result))
+            return false;
+        result.point = hit.point - hit.normal * circle.radius;
+        return true;
+    }
+    case collision_type::none:
     default:
-        min_out = max_out = {real(0), real(0)};
-        break;
+        return false;
     }
 }
 
-void draw_cone_helper(gpu &gpu_api,
+bool sweep_rect(const rect_shape &rect,
+                vec2<real> motion,
+                const collision_shape &obstacle,
+                sweep_result &result)
+{
+    const real length     = zabato::length(motion);
+    const vec2<real> dir  = length > real(0) ? motion / length
+                                             : vec2<real>(1, 0);
+    const vec2<real> half = rect.size * real(0.5);
+
+    raycast_result hit;
+    switch (obstacle.get_type())
+    {
+    case collision_type::rect:
+    {
+        const auto &other = *static_cast<const rect_shape *>(&obstacle);
+        rect_shape grown;
+        grown.position = other.position;
+        grown.size     = other.size + rect.size;
+        if (!ray_vs_rectr(rect.position, dir, grown, hit) ||
+            !finish_sweep(hit, motion, length, result))
+            return false;
+
+        // The touching box face, clamped to the obstacle.
+        const vec2<real> other_half = other.size * real(0.5);
+        result.point = clamp(hit.point - hit.normal * half,
+                             other.position - other_half,
+                             other.position + other_half);
+        return true;
+    }
+    case collision_type::circle:
+    {
+        const auto &circle = *static_cast<const circle_shape *>(&obstacle);
+        if (!ray_vs_rounded_rect(rect.position,
+                                 dir,
+                                 circle.position,
+                                 half,
+                                 circle.radius,
+                                 hit) ||
+            !finish_sweep(hit, motion, length, result))
+            return false;
+        result.point = circle.position + hit.normal * circle.radius;
+        return true;
+    }
+    case collision_type::polygon:
+        return sweep_rect_vs_polygon(
+            rect,
+            motion,
+            *static_cast<const polygon_shape *>(&obstacle),
+            result);
+    case collision_type::none:
+    default:
+        return false;
+    }
+}
+
+void draw_cone_helper(debug_draw_batch &batch,
                       const vision_cone &cone,
                       real z,
+                      color c,
                       uint32_t segments)
 {
     vec2<real> norm_dir = normalize(cone.direction);
+    vec3<real> apex     = {cone.position.x, z, cone.position.y};
 
     // Draw the two edge lines of the cone
-    gpu_api.begin(primitive_type::lines);
+    real left_angle  = atan2(norm_dir.y, norm_dir.x) - cone.angle;
+    real right_angle = atan2(norm_dir.y, norm_dir.x) + cone.angle;
 
-    // Left edge
-    real left_angle           = atan2(norm_dir.y, norm_dir.x) - cone.angle;
-    vec2<real> left_far_point = {
+    vec3<real> left_far_point = {
         cone.position.x + cone.far_dist * cos(left_angle),
+        z,
         cone.position.y + cone.far_dist * sin(left_angle)};
-    gpu_api.vertex(cone.position.x, z, cone.position.y);
-    gpu_api.vertex(left_far_point.x, z, left_far_point.y);
-
-    // Right edge
-    real right_angle           = atan2(norm_dir.y, norm_dir.x) + cone.angle;
-    vec2<real> right_far_point = {
+    vec3<real> right_far_point = {
         cone.position.x + cone.far_dist * cos(right_angle),
+        z,
         cone.position.y + cone.far_dist * sin(right_angle)};
-    gpu_api.vertex(cone.position.x, z, cone.position.y);
-    gpu_api.vertex(right_far_point.x, z, right_far_point.y);
+    batch.add_line(apex, left_far_point, c);
+    batch.add_line(apex, right_far_point, c);
 
-    gpu_api.end();
-
-    // Draw the far arc
-    gpu_api.begin(primitive_type::lines);
+    // Draw the far arc, reusing the end of each segment as the next start
     real angle_step = (cone.angle * real(2.0)) / real(segments);
-    for (uint32_t i = 0; i < segments; ++i)
+    vec3<real> p1   = left_far_point;
+    for (uint32_t i = 1; i <= segments; ++i)
+    {
+        real angle    = left_angle + real(i) * angle_step;
+        vec3<real> p2 = {cone.position.x + cone.far_dist * cos(angle),
+                         z,
+                         cone.position.y + cone.far_dist * sin(angle)};
+        batch.add_line(p1, p2, c);
+        p1 = p2;
+    }
+}
+
+} // anonymous namespace
+
+void polygon_shape::update_cache()
+{
+    // Polygons may be built on collision_world worker threads.
+    static atomic_uint next_revision;
+    m_revision =
+        atomic_fetch_add_explicit(&next_revision, 1, memory_order_relaxed) + 1;
+
+    const size_t count = m_vertices.size();
+    m_normals.resize(count);
+    m_extents.resize(count);
+
+    if (count == 0)
+    {
+        m_bounds_min = m_bounds_max = m_center = {real(0), real(0)};
+        m_radius                               = real(0);
+        return;
+    }
+
+    m_bounds_min = m_bounds_max = m_vertices[0];
+    m_center                    = vec2<real>(0, 0);
+    for (size_t i = 0; i < count; ++i)
     {
-        real angle1 = left_angle + real(i) * angle_step;
-        real angle2 = left_angle + real(i + 1) * angle_step;
+        const vec2<real> &v = m_vertices[i];
+        m_bounds_min.x      = min(m_bounds_min.x, v.x);
+        m_bounds_min.y      = min(m_bounds_min.y, v.y);
+        m_bounds_max.x      = max(m_bounds_max.x, v.x);
+        m_bounds_max.y      = max(m_bounds_max.y, v.y);
+        m_center += v;
+
+        vec2<real> edge = m_vertices[(i + 1) % count] - v;
+        m_normals[i]    = normalize(vec2<real>(-edge.y, edge.x));
+    }
+    m_center /= real((uint32_t)count);
 
-        vec2<real> p1 = {cone.position.x + cone.far_dist * cos(angle1),
-                         cone.position.y + cone.far_dist * sin(angle1)};
-        vec2<real> p2 = {cone.position.x + cone.far_dist * cos(angle2),
-                         cone.position.y + cone.far_dist * sin(angle2)};
+    m_radius = real(0);
+    for (size_t i = 0; i < count; ++i)
+        m_radius = max(m_radius, length_sq(m_vertices[i] - m_center));
+    m_radius = sqrt(m_radius);
 
-        gpu_api.vertex(p1.x, z, p1.y);
-        gpu_api.vertex(p2.x, z, p2.y);
+    for (size_t i = 0; i < count; ++i)
+    {
+        real lo, hi;
+        project_polygon(m_normals[i], *this, lo, hi);
+        m_extents[i] = {lo, hi};
     }
-    gpu_api.end();
 }
 
-} // anonymous namespace
+void get_collision_bounds(const collision_shape &shape,
+                          vec2<real> &min_out,
+                          vec2<real> &max_out)
+{
+    switch (shape.get_type())
+    {
+    case collision_type::rect:
+    {
+        const auto rect      = *static_cast<const rect_shape *>(&shape);
+        vec2<real> half_size = rect.size * real(0.5);
+        min_out              = rect.position - half_size;
+        max_out              = rect.position + half_size;
+        break;
+    }
+    case collision_type::circle:
+    {
+        const auto circle = *static_cast<const circle_shape *>(&shape);
+        min_out           = {circle.position.x - circle.radius,
+                             circle.position.y - circle.radius};
+        max_out           = {circle.position.x + circle.radius,
+                             circle.position.y + circle.radius};
+        break;
+    }
+    case collision_type::polygon:
+    {
+        const auto &poly = *static_cast<const polygon_shape *>(&shape);
+        min_out          = poly.get_bounds_min();
+        max_out          = poly.get_bounds_max();
+        break;
+    }
+    default:
+        min_out = max_out = {real(0), real(0)};
+        break;
+    }
+}
 
-inline bool check_collision(const collision_shape &shape, vec2<real> position)
+bool check_collision(const collision_shape &shape, vec2<real> position)
 {
     switch (shape.get_type())
     {
@@ -490,16 +1023,16 @@ inline bool check_collision(const collision_shape &shape, vec2<real> position)
                                *static_cast<const circle_shape *>(&shape));
     case collision_type::polygon:
     {
-        const auto *poly = static_cast<const polygon_shape *>(&shape);
-        if (poly->vertices.size() < 3)
+        const auto &vertices =
+            static_cast<const polygon_shape *>(&shape)->get_vertices();
+        if (vertices.size() < 3)
             return false;
         bool inside = false;
-        for (size_t i = 0, j = poly->vertices.size() - 1;
-             i < poly->vertices.size();
+        for (size_t i = 0, j = vertices.size() - 1; i < vertices.size();
              j = i++)
         {
-            const vec2<real> &vi = poly->vertices[i];
-            const vec2<real> &vj = poly->vertices[j];
+            const vec2<real> &vi = vertices[i];
+            const vec2<real> &vj = vertices[j];
             if (((vi.y > position.y) != (vj.y > position.y)) &&
                 (position.x <
                  (vj.x - vi.x) * (position.y - vi.y) / (vj.y - vi.y) + vi.x))
@@ -514,8 +1047,15 @@ inline bool check_collision(const collision_shape &shape, vec2<real> position)
     }
 }
 
-inline collision_result test_collision(const collision_shape &first,
-                                       const collision_shape &second)
+namespace
+{
+/**
+ * @brief Dispatches a pair to its narrowphase test. Polygon tests that find
+ * the pair apart report the axis that separated it.
+ */
+collision_result narrowphase(const collision_shape &first,
+                             const collision_shape &second,
+                             vec2<real> *separating_axis)
 {
     collision_result result;
     result.collides = false;
@@ -556,21 +1096,24 @@ inline collision_result test_collision(const collision_shape &first,
     {
         polygon_vs_polygon(*static_cast<const polygon_shape *>(&first),
                            *static_cast<const polygon_shape *>(&second),
-                           result);
+                           result,
+                           separating_axis);
     }
     else if (type1 == collision_type::circle &&
              type2 == collision_type::polygon)
     {
         circle_vs_polygon(*static_cast<const circle_shape *>(&first),
                           *static_cast<const polygon_shape *>(&second),
-                          result);
+                          result,
+                          separating_axis);
     }
     else if (type1 == collision_type::polygon &&
              type2 == collision_type::circle)
     {
         circle_vs_polygon(*static_cast<const circle_shape *>(&second),
                           *static_cast<const polygon_shape *>(&first),
-                          result);
+                          result,
+                          separating_axis);
         if (result.collides)
         {
             result.normal      = -result.normal;
@@ -581,13 +1124,15 @@ inline collision_result test_collision(const collision_shape &first,
     {
         rect_vs_polygon(*static_cast<const rect_shape *>(&first),
                         *static_cast<const polygon_shape *>(&second),
-                        result);
+                        result,
+                        separating_axis);
     }
     else if (type1 == collision_type::polygon && type2 == collision_type::rect)
     {
         rect_vs_polygon(*static_cast<const rect_shape *>(&second),
                         *static_cast<const polygon_shape *>(&first),
-                        result);
+                        result,
+                        separating_axis);
         if (result.collides)
         {
             result.normal      = -result.normal;
@@ -598,10 +1143,109 @@ inline collision_result test_collision(const collision_shape &first,
     return result;
 }
 
-inline raycast_result raycast(vec2<real> origin,
-                              vec2<real> direction,
-                              real max_distance,
-                              const vector<const collision_shape *> &objects)
+/** @brief Projects any shape onto an axis. */
+void project_shape(const vec2<real> &axis,
+                   const collision_shape &shape,
+                   real &min_out,
+                   real &max_out)
+{
+    switch (shape.get_type())
+    {
+    case collision_type::rect:
+    {
+        const auto &rect = *static_cast<const rect_shape *>(&shape);
+        vec2<real> half  = rect.size * 0.5;
+        real center      = dot(rect.position, axis);
+        real extent      = abs(axis.x) * half.x + abs(axis.y) * half.y;
+        min_out          = center - extent;
+        max_out          = center + extent;
+        break;
+    }
+    case collision_type::circle:
+        project_circle(
+            axis, *static_cast<const circle_shape *>(&shape), min_out, max_out);
+        break;
+    case collision_type::polygon:
+    {
+        const auto &poly = *static_cast<const polygon_shape *>(&shape);
+        if (poly.get_vertices().empty())
+        {
+            min_out = max_out = real(0);
+            break;
+        }
+        project_polygon(axis, poly, min_out, max_out);
+        break;
+    }
+    default:
+        min_out = max_out = real(0);
+        break;
+    }
+}
+
+} // anonymous namespace
+
+collision_result test_collision(const collision_shape &first,
+                                const collision_shape &second)
+{
+    return narrowphase(first, second, nullptr);
+}
+
+collision_result test_collision(const collision_shape &first,
+                                const collision_shape &second,
+                                contact_state &state)
+{
+    if (state.has_axis)
+    {
+        real first_min, first_max, second_min, second_max;
+        project_shape(state.separating_axis, first, first_min, first_max);
+        project_shape(state.separating_axis, second, second_min, second_max);
+        if (first_max < second_min || second_max < first_min)
+        {
+            state.contact = collision_result();
+            return state.contact;
+        }
+    }
+
+    vec2<real> axis = {real(0), real(0)};
+    state.contact   = narrowphase(first, second, &axis);
+    state.has_axis  = !state.contact.collides && length_sq(axis) > real(0);
+    if (state.has_axis)
+        state.separating_axis = axis;
+    return state.contact;
+}
+
+bool raycast_shape(vec2<real> origin,
+                   vec2<real> direction,
+                   const collision_shape &shape,
+                   raycast_result &result)
+{
+    switch (shape.get_type())
+    {
+    case collision_type::rect:
+        return ray_vs_rectr(origin,
+                            direction,
+                            *static_cast<const rect_shape *>(&shape),
+                            result);
+    case collision_type::circle:
+        return ray_vs_circle(origin,
+                             direction,
+                             *static_cast<const circle_shape *>(&shape),
+                             result);
+    case collision_type::polygon:
+        return ray_vs_polygon(origin,
+                              direction,
+                              *static_cast<const polygon_shape *>(&shape),
+                              result);
+    case collision_type::none:
+    default:
+        return false;
+    }
+}
+
+raycast_result raycast(vec2<real> origin,
+                       vec2<real> direction,
+                       real max_distance,
+                       const vector<const collision_shape *> &objects)
 {
 
     raycast_result final_result;
@@ -613,31 +1257,7 @@ inline raycast_result raycast(vec2<real> origin,
     for (const auto &obj : objects)
     {
         raycast_result temp_result;
-        bool object_hit = false;
-
-        switch (obj->get_type())
-        {
-        case collision_type::rect:
-            object_hit = ray_vs_rectr(origin,
-                                      norm_dir,
-                                      *static_cast<const rect_shape *>(obj),
-                                      temp_result);
-            break;
-        case collision_type::circle:
-            object_hit = ray_vs_circle(origin,
-                                       norm_dir,
-                                       *static_cast<const circle_shape *>(obj),
-                                       temp_result);
-        case collision_type::polygon:
-            object_hit =
-                ray_vs_polygon(origin,
-                               norm_dir,
-                               *static_cast<const polygon_shape *>(obj),
-                               temp_result);
-        case collision_type::none:
-        default:
-            break;
-        }
+        bool object_hit = raycast_shape(origin, norm_dir, *obj, temp_result);
 
         if (object_hit && temp_result.distance >= 0 &&
             temp_result.distance < final_result.distance)
@@ -651,26 +1271,77 @@ inline raycast_result raycast(vec2<real> origin,
     return final_result;
 }
 
+bool sweep_shape(const collision_shape &moving,
+                 vec2<real> motion,
+                 const collision_shape &obstacle,
+                 sweep_result &result)
+{
+    bool hit = false;
+    switch (moving.get_type())
+    {
+    case collision_type::circle:
+        hit = sweep_circle(*static_cast<const circle_shape *>(&moving),
+                           motion,
+                           obstacle,
+                           result);
+        break;
+    case collision_type::rect:
+        hit = sweep_rect(*static_cast<const rect_shape *>(&moving),
+                         motion,
+                         obstacle,
+                         result);
+        break;
+    case collision_type::polygon:
+    case collision_type::none:
+    default:
+        return false;
+    }
+
+    if (hit)
+        result.object = &obstacle;
+    return hit;
+}
+
 bool is_point_in_vision_cone(const vision_cone &cone, vec2<real> point)
 {
-    vec2<real> to_point = point - cone.position;
+    return is_point_in_vision_cone(prepare_vision_cone(cone), point);
+}
+
+prepared_vision_cone prepare_vision_cone(const vision_cone &cone)
+{
+    prepared_vision_cone prepared;
+    auto [sin_angle, cos_angle] = sincos(cone.angle);
+
+    prepared.cone      = cone;
+    prepared.direction = normalize(cone.direction);
+    prepared.cos_angle = cos_angle;
+    prepared.sin_angle = sin_angle;
+    prepared.near_sq   = cone.near_dist * cone.near_dist;
+    prepared.far_sq    = cone.far_dist * cone.far_dist;
+    return prepared;
+}
+
+bool is_point_in_vision_cone(const prepared_vision_cone &cone,
+                             vec2<real> point)
+{
+    vec2<real> to_point = point - cone.cone.position;
     real dist_sq        = length_sq(to_point);
 
     // Check if the point is within the near and far planes
-    if (dist_sq < cone.near_dist * cone.near_dist ||
-        dist_sq > cone.far_dist * cone.far_dist)
+    if (dist_sq < cone.near_sq || dist_sq > cone.far_sq)
         return false;
 
     // If the point is effectivelly at the cone's origin, it's inside (if near
     // istance allows it)
     if (dist_sq < real::epsilon())
-        return cone.near_dist <= 0;
-
-    // Check if the point is within the cone's angle
-    vec2<real> to_point_norm = to_point / sqrt(dist_sq); // normalize
-    real cos_angle           = dot(normalize(cone.direction), to_point_norm);
-
-    return cos_angle >= cos(cone.angle);
+        return cone.cone.near_dist <= 0;
+
+    // cos(to_point, direction) >= cos_angle, squared to skip the square root.
+    real d         = dot(cone.direction, to_point);
+    real threshold = cone.cos_angle * cone.cos_angle * dist_sq;
+    if (cone.cos_angle >= 0)
+        return d >= 0 && d * d >= threshold;
+    return d >= 0 || d * d <= threshold;
 }
 
 visibility_result
@@ -678,6 +1349,25 @@ check_visibility(const vision_cone &cone,
                  const collision_shape &object,
                  const vector<const collision_shape *> &obstacles)
 {
+    // Reused across calls so the SoA lanes keep their capacity.
+    thread_local ray_obstacle_set scratch;
+    scratch.assign(obstacles);
+    return check_visibility(cone, object, scratch);
+}
+
+visibility_result check_visibility(const vision_cone &cone,
+                                   const collision_shape &object,
+                                   const ray_obstacle_set &obstacles)
+{
+    return check_visibility(prepare_vision_cone(cone), object, obstacles);
+}
+
+visibility_result check_visibility(const prepared_vision_cone &prepared,
+                                   const collision_shape &object,
+                                   const ray_obstacle_set &obstacles)
+{
+    const vision_cone &cone = prepared.cone;
+
     visibility_result result;
     vec2<real> obj_center, min_b, max_b;
     real obj_radius;
@@ -687,7 +1377,7 @@ check_visibility(const vision_cone &cone,
     obj_radius = length(max_b - obj_center);
 
     result.distance_to_observer = length(obj_center - cone.position);
-    result.in_vision_cone       = is_point_in_vision_cone(cone, obj_center);
+    result.in_vision_cone       = is_point_in_vision_cone(prepared, obj_center);
 
     if (!result.in_vision_cone)
     {
@@ -697,7 +1387,9 @@ check_visibility(const vision_cone &cone,
     }
 
     const int ray_count = 5;
-    int visible_rays    = 0;
+    vec2<real> directions[ray_count];
+    real max_distances[ray_count];
+    bool occluded[ray_count];
 
     for (int i = 0; i < ray_count; ++i)
     {
@@ -715,15 +1407,18 @@ check_visibility(const vision_cone &cone,
             target_point = obj_center + offset;
         }
 
-        vec2<real> dir = normalize(target_point - cone.position);
+        // A hit at the target distance is the object itself.
+        directions[i]    = normalize(target_point - cone.position);
+        max_distances[i] = result.distance_to_observer - real::epsilon();
+    }
 
-        raycast_result ray_res =
-            raycast(cone.position, dir, result.distance_to_observer, obstacles);
+    obstacles.occluded(
+        cone.position, directions, max_distances, ray_count, occluded, &object);
 
-        if (!ray_res.hit ||
-            ray_res.distance >= result.distance_to_observer - real::epsilon())
+    int visible_rays = 0;
+    for (int i = 0; i < ray_count; ++i)
+        if (!occluded[i])
             visible_rays++;
-    }
 
     result.visibility_factor = real(visible_rays) / real(ray_count);
     if (result.visibility_factor >= 0.99)
@@ -736,77 +1431,130 @@ check_visibility(const vision_cone &cone,
     return result;
 }
 
-inline bool create_convex_hull(const vec2<real> *points,
-                               uint32_t point_count,
-                               vector<vec2<real>> &out_vertices)
+namespace
+{
+/** @return Twice the signed area of `o, a, b`, positive for a left turn. */
+inline real turn(const vec2<real> &o, const vec2<real> &a, const vec2<real> &b)
+{
+    return (a.x - o.x) * (b.y - o.y) - (a.y - o.y) * (b.x - o.x);
+}
+
+inline bool lexicographic_less(const vec2<real> &a, const vec2<real> &b)
 {
-    if (point_count < 3)
+    return a.x < b.x || (a.x == b.x && a.y < b.y);
+}
+} // anonymous namespace
+
+bool create_convex_hull(const vec2<real> *points,
+                        size_t point_count,
+                        vector<vec2<real>> &out_vertices,
+                        vector<vec2<real>> &scratch,
+                        bool sorted)
+{
+    out_vertices.clear();
+    if (point_count == 0)
         return false;
 
-    // Find pivot point (lowest y, then lowest x)
-    size_t pivot_idx = 0;
-    for (size_t i = 1; i < point_count; ++i)
+    const vec2<real> *p = points;
+    if (!sorted)
     {
-        if (points[i].y < points[pivot_idx].y ||
-            (points[i].y == points[pivot_idx].y &&
-             points[i].x < points[pivot_idx].x))
-        {
-            pivot_idx = i;
-        }
+        scratch.assign(points, points + point_count);
+        sort(scratch.begin(), scratch.end(), lexicographic_less);
+        p = scratch.data();
     }
 
-    vec2<real> pivot = points[pivot_idx];
-    out_vertices.assign(points, points + point_count);
-
-    swap(out_vertices[0], out_vertices[pivot_idx]);
-
-    // Sort points by polar angle around pivot
-    sort(out_vertices.begin(),
-         out_vertices.end(),
-         [&](const vec2<real> &a, const vec2<real> &b)
-         {
-             if (a == pivot)
-                 return true;
-             if (b == pivot)
-                 return false;
-             real cross_product = (a.x - pivot.x) * (b.y - pivot.y) -
-                                  (a.y - pivot.y) * (b.x - pivot.x);
-             if (cross_product == real(0))
-             {
-                 return length_sq(a - pivot) < length_sq(b - pivot);
-             }
-             return cross_product > real(0);
-         });
-
-    // Build the hull
-    vector<vec2<real>> hull;
-    for (const auto &pt : out_vertices)
-    {
-        while (hull.size() >= 2)
-        {
-            vec2<real> p1 = hull[hull.size() - 2];
-            vec2<real> p2 = hull[hull.size() - 1];
-            if ((p2.x - p1.x) * (pt.y - p1.y) - (p2.y - p1.y) * (pt.x - p1.x) <=
-                real(0))
-            {
-                hull.pop_back();
-            }
-            else
-            {
-                break;
-            }
-        }
-        hull.push_back(pt);
+    // Lower then upper chain, popping every vertex that does not turn left.
+    out_vertices.resize(point_count * 2);
+    vec2<real> *hull = out_vertices.data();
+    size_t k         = 0;
+    for (size_t i = 0; i < point_count; ++i)
+    {
+        while (k >= 2 && turn(hull[k - 2], hull[k - 1], p[i]) <= real(0))
+            --k;
+        hull[k++] = p[i];
     }
-    out_vertices = hull;
+    for (size_t i = point_count - 1, lower = k + 1; i > 0; --i)
+    {
+        while (k >= lower &&
+               turn(hull[k - 2], hull[k - 1], p[i - 1]) <= real(0))
+            --k;
+        hull[k++] = p[i - 1];
+    }
+
+    // The upper chain ends where the lower one started.
+    out_vertices.resize(k > 1 ? k - 1 : k);
+    return out_vertices.size() >= 3;
+}
+
+vector<vec2<real>> create_convex_hull(const vector<vec2<real>> &points)
+{
+    vector<vec2<real>> hull, scratch;
+    create_convex_hull(points.data(), points.size(), hull, scratch);
+    return hull;
+}
+
+bool convex_hull_builder::add_point(vec2<real> point)
+{
+    const size_t count = m_hull.size();
+    for (size_t i = 0; i < count; ++i)
+        if (m_hull[i] == point)
+            return false;
+
+    // While collinear the hull is at most two end points, rebuild it.
+    if (count < 3)
+    {
+        vec2<real> points[3];
+        for (size_t i = 0; i < count; ++i)
+            points[i] = m_hull[i];
+        points[count] = point;
+        create_convex_hull(points, count + 1, m_hull, m_scratch);
+        return true;
+    }
+
+    // Edge i, from vertex i to i + 1, has the point on its right, or on its
+    // line when `or_on` is set.
+    auto sees = [&](size_t edge, bool or_on)
+    {
+        real t = turn(m_hull[edge % count], m_hull[(edge + 1) % count], point);
+        return or_on ? t <= real(0) : t < real(0);
+    };
+
+    size_t seen = count;
+    for (size_t i = 0; i < count && seen == count; ++i)
+        if (sees(i, false))
+            seen = i;
+    if (seen == count)
+        return false; // Inside or on the boundary.
+
+    // Grow over the edges that see the point, or would leave it collinear.
+    size_t first_visible = seen, last_visible = seen;
+    while (sees(first_visible + count - 1, true))
+        first_visible = (first_visible + count - 1) % count;
+    while (sees(last_visible + 1, true))
+        last_visible = (last_visible + 1) % count;
+
+    // Keep the vertices that are not hidden behind the new point, then it.
+    m_scratch.clear();
+    for (size_t i = (last_visible + 1) % count;; i = (i + 1) % count)
+    {
+        m_scratch.push_back(m_hull[i]);
+        if (i == first_visible)
+            break;
+    }
+    m_scratch.push_back(point);
+    swap(m_hull, m_scratch);
     return true;
 }
 
 /**
  * @brief Helper function to draw a rectangle
  */
-static void
-draw_rect(gpu &gpu, vec2<real> position, vec2<real> size, real z, bool filled)
+static void draw_rect(debug_draw_batch &batch,
+                      vec2<real> position,
+                      vec2<real> size,
+                      real z,
+                      color c,
+                      bool filled)
 {
     vec2<real> halfSize = size * 0.5;
 
@@ -815,127 +1563,84 @@ draw_rect(gpu &gpu, vec2<real> position, vec2<real> size, real z, bool filled)
     real top    = position.y - halfSize.y;
     real bottom = position.y + halfSize.y;
 
+    const vec3<real> top_left     = {left, z, top};
+    const vec3<real> top_right    = {right, z, top};
+    const vec3<real> bottom_right = {right, z, bottom};
+    const vec3<real> bottom_left  = {left, z, bottom};
+
     if (filled)
     {
-        gpu.begin(primitive_type::quads);
-        gpu.vertex(left, z, top);
-        gpu.vertex(right, z, top);
-        gpu.vertex(right, z, bottom);
-        gpu.vertex(left, z, bottom);
-        gpu.end();
+        batch.add_triangle(top_left, top_right, bottom_right, c);
+        batch.add_triangle(top_left, bottom_right, bottom_left, c);
     }
     else
     {
-        gpu.begin(primitive_type::lines);
-
-        // Top edge
-        gpu.vertex(left, z, top);
-        gpu.vertex(right, z, top);
-
-        // Right edge
-        gpu.vertex(right, z, top);
-        gpu.vertex(right, z, bottom);
-
-        // Bottom edge
-        gpu.vertex(right, z, bottom);
-        gpu.vertex(left, z, bottom);
-
-        // Left edge
-        gpu.vertex(left, z, bottom);
-        gpu.vertex(left, z, top);
-
-        gpu.end();
+        batch.add_line(top_left, top_right, c);
+        batch.add_line(top_right, bottom_right, c);
+        batch.add_line(bottom_right, bottom_left, c);
+        batch.add_line(bottom_left, top_left, c);
     }
 }
 
-static void draw_circle(gpu &gpu,
+static void draw_circle(debug_draw_batch &batch,
                         vec2<real> position,
                         real radius,
                         real z,
+                        color c,
                         uint32_t segments,
                         bool filled)
 {
-    const real angleStep = (real::pi() * real(2.0)) / real(segments);
-
-    if (filled)
-    {
-        gpu.begin(primitive_type::triangles);
-        for (uint32_t i = 0; i < segments; ++i)
-        {
-            const real angle1 = real(i) * angleStep;
-            const real angle2 = real(i + 1) * angleStep;
-
-            const auto [s1, c1] = sincos(angle1);
-            const auto [s2, c2] = sincos(angle2);
+    const real angleStep    = (real::pi() * real(2.0)) / real(segments);
+    const vec3<real> center = {position.x, z, position.y};
 
-            const vec2<real> p1 = position + vec2(c1, s1) * radius;
-            const vec2<real> p2 = position + vec2(c2, s2) * radius;
-
-            gpu.vertex(p1.x, z, p1.y);
-            gpu.vertex(p2.x, z, p2.y);
-        }
-        gpu.end();
-    }
-    else
+    vec3<real> p1 = {position.x + radius, z, position.y};
+    for (uint32_t i = 1; i <= segments; ++i)
     {
-        gpu.begin(primitive_type::lines);
-        for (uint32_t i = 0; i < segments; ++i)
-        {
-            const real angle1 = real(i) * angleStep;
-            const real angle2 = real(i + 1) * angleStep;
+        const auto [s, co]  = sincos(real(i) * angleStep);
+        const vec3<real> p2 = {
+            position.x + co * radius, z, position.y + s * radius};
 
-            const auto [s1, c1] = sincos(angle1);
-            const auto [s2, c2] = sincos(angle2);
-
-            const vec2<real> p1 = position + vec2(c1, s1) * radius;
-            const vec2<real> p2 = position + vec2(c2, s2) * radius;
-
-            // Draw line segment between two points on circumference
-            gpu.vertex(p1.x, z, p1.y);
-            gpu.vertex(p2.x, z, p2.y);
-        }
-        gpu.end();
+        if (filled)
+            batch.add_triangle(center, p1, p2, c);
+        else
+            batch.add_line(p1, p2, c);
+        p1 = p2;
     }
 }
 
-static void
-draw_polygon(gpu &gpu, const vector<vec2<real>> &vertices, real z, bool filled)
+static void draw_polygon(debug_draw_batch &batch,
+                         const polygon_shape::vertex_list &vertices,
+                         real z,
+                         color c,
+                         bool filled)
 {
     if (filled)
     {
-        gpu.begin(primitive_type::triangles);
+        const vec3<real> v0 = {vertices[0].x, z, vertices[0].y};
         for (size_t i = 1; i < vertices.size() - 1; ++i)
         {
-            const vec2<real> &v0 = vertices[0];
             const vec2<real> &v1 = vertices[i];
             const vec2<real> &v2 = vertices[i + 1];
-
-            gpu.vertex(v0.x, z, v0.y); //< center of fan
-            gpu.vertex(v1.x, z, v1.y); //< second
-            gpu.vertex(v2.x, z, v2.y); //< third
+            batch.add_triangle(v0, {v1.x, z, v1.y}, {v2.x, z, v2.y}, c);
         }
-        gpu.end();
     }
     else
     {
-        gpu.begin(primitive_type::lines);
         for (size_t i = 0; i < vertices.size(); i++)
         {
             const vec2<real> &v0 = vertices[i];
             const vec2<real> &v1 = vertices[(i + 1) % vertices.size()];
-            gpu.vertex(v0.x, z, v0.y);
-            gpu.vertex(v1.x, z, v1.y);
+            batch.add_line({v0.x, z, v0.y}, {v1.x, z, v1.y}, c);
         }
-        gpu.end();
     }
 }
 
-static void draw_polygon_normals(gpu &gpu,
-                                 const vector<vec2<real>> &vertices,
+static void draw_polygon_normals(debug_draw_batch &batch,
+                                 const polygon_shape::vertex_list &vertices,
                                  real z,
+                                 color c,
                                  real normalLength)
 {
-    gpu.begin(primitive_type::lines);
     for (size_t i = 0; i < vertices.size(); i++)
     {
         const vec2<real> &v0 = vertices[i];
@@ -947,100 +1652,123 @@ static void draw_polygon_normals(gpu &gpu,
         normal              = normalize(normal) * normalLength;
 
         // draw normal line
-        gpu.vertex(midpoint.x, z, midpoint.y);
-        gpu.vertex(midpoint.x + normal.x, z, midpoint.y + normal.y);
+        batch.add_line({midpoint.x, z, midpoint.y},
+                       {midpoint.x + normal.x, z, midpoint.y + normal.y},
+                       c);
     }
-    gpu.end();
 }
 
-static void
-draw_polygon_vertices(gpu &gpu, const vector<vec2<real>> &vertices, real z)
+static void draw_polygon_vertices(debug_draw_batch &batch,
+                                  const polygon_shape::vertex_list &vertices,
+                                  real z,
+                                  color c)
 {
-    gpu.begin(primitive_type::points);
     for (size_t i = 0; i < vertices.size(); i++)
     {
         const vec2<real> &v0 = vertices[i];
-        gpu.vertex(v0.x, z, v0.y);
+        batch.add_point({v0.x, z, v0.y}, c);
     }
-    gpu.end();
 }
 
-inline void draw_collision(gpu &gpu,
-                           const collision_shape *shape,
-                           real z,
-                           color c,
-                           collision_debug_flags flags)
+static bool has_flag(collision_debug_flags flags, collision_debug_flags flag)
 {
-    if (!shape)
-        return;
+    return (flags & flag) == flag;
+}
 
-    gpu.color(c);
-    switch (shape->get_type())
+void draw_collision(debug_draw_batch &batch,
+                    const collision_shape &shape,
+                    real z,
+                    color c,
+                    collision_debug_flags flags)
+{
+    switch (shape.get_type())
     {
     case collision_type::rect:
     {
-        const rect_shape &rect = *(const rect_shape *)shape;
-        if ((flags & collision_debug_flags::filled) ==
-            collision_debug_flags::filled)
-            draw_rect(gpu, rect.position, rect.size, z, true);
-        else if ((flags & collision_debug_flags::wireframe) ==
-                 collision_debug_flags::wireframe)
-            draw_rect(gpu, rect.position, rect.size, z, false);
+        const auto &rect = *static_cast<const rect_shape *>(&shape);
+        if (has_flag(flags, collision_debug_flags::filled))
+            draw_rect(batch, rect.position, rect.size, z, c, true);
+        else if (has_flag(flags, collision_debug_flags::wireframe))
+            draw_rect(batch, rect.position, rect.size, z, c, false);
         break;
     }
     case collision_type::circle:
     {
-        const circle_shape &circle = *(const circle_shape *)shape;
+        const auto &circle = *static_cast<const circle_shape *>(&shape);
         const uint32_t segments    = 32;
 
-        if ((flags & collision_debug_flags::filled) ==
-            collision_debug_flags::filled)
-            draw_circle(gpu, circle.position, circle.radius, z, segments, true);
+        if (has_flag(flags, collision_debug_flags::filled))
+            draw_circle(
+                batch, circle.position, circle.radius, z, c, segments, true);
 
-        if ((flags & collision_debug_flags::wireframe) ==
-            collision_debug_flags::wireframe)
+        if (has_flag(flags, collision_debug_flags::wireframe))
             draw_circle(
-                gpu, circle.position, circle.radius, z, segments, false);
+                batch, circle.position, circle.radius, z, c, segments, false);
         break;
     }
     case collision_type::polygon:
     {
-        const polygon_shape &poly = *(const polygon_shape *)shape;
+        const auto &poly = *static_cast<const polygon_shape *>(&shape);
 
-        if (poly.vertices.size() == 0)
+        const polygon_shape::vertex_list &vertices = poly.get_vertices();
+        if (vertices.size() == 0)
             return;
 
-        if ((flags & collision_debug_flags::filled) ==
-            collision_debug_flags::filled)
-            draw_polygon(gpu, poly.vertices, z, true);
+        if (has_flag(flags, collision_debug_flags::filled))
+            draw_polygon(batch, vertices, z, c, true);
 
-        if ((flags & collision_debug_flags::wireframe) ==
-            collision_debug_flags::wireframe)
-            draw_polygon(gpu, poly.vertices, z, false);
+        if (has_flag(flags, collision_debug_flags::wireframe))
+            draw_polygon(batch, vertices, z, c, false);
 
-        if ((flags & collision_debug_flags::normals) ==
-            collision_debug_flags::normals)
-            draw_polygon_normals(gpu, poly.vertices, z, 1.0);
+        if (has_flag(flags, collision_debug_flags::normals))
+            draw_polygon_normals(batch, vertices, z, c, 1.0);
 
-        if ((flags & collision_debug_flags::vertices) ==
-            collision_debug_flags::vertices)
-            draw_polygon_vertices(gpu, poly.vertices, z);
+        if (has_flag(flags, collision_debug_flags::vertices))
+            draw_polygon_vertices(batch, vertices, z, c);
         break;
     }
     case collision_type::none:
     default:
-        break;
+        return;
     }
+
+    if (has_flag(flags, collision_debug_flags::bounds))
+    {
+        vec2<real> min, max;
+        get_collision_bounds(shape, min, max);
+        draw_rect(batch, (min + max) * real(0.5), max - min, z, c, false);
+    }
+}
+
+void draw_vision_cone(debug_draw_batch &batch,
+                      const vision_cone &cone,
+                      real z,
+                      color c,
+                      uint32_t segments)
+{
+    draw_cone_helper(batch, cone, z, c, segments);
 }
 
-inline void draw_vision_cone(gpu &gpu,
-                             const vision_cone &cone,
-                             real z,
-                             color c,
-                             uint32_t segments)
+void draw_collision(gpu &gpu,
+                    const collision_shape &shape,
+                    real z,
+                    color c,
+                    collision_debug_flags flags)
+{
+    thread_local debug_draw_batch batch;
+    draw_collision(batch, shape, z, c, flags);
+    batch.flush(gpu);
+}
+
+void draw_vision_cone(gpu &gpu,
+                      const vision_cone &cone,
+                      real z,
+                      color c,
+                      uint32_t segments)
 {
-    gpu.color(c);
-    draw_cone_helper(gpu, cone, z, segments);
+    thread_local debug_draw_batch batch;
+    draw_cone_helper(batch, cone, z, c, segments);
+    batch.flush(gpu);
 }
 
 } // namespace zabato
@@ -0,0 +1,778 @@
+#include <assert.h>
+#include <zabato/collision_world.hpp>
+#include <zabato/job_system.hpp>
+#include <zabato/profiler.hpp>
+#include <zabato/ray_batch.hpp>
+
+namespace zabato
+{
+namespace
+{
+/**
+ * @brief Fixed traversal stack. The tree is height balanced, so its depth
+ * stays far below the capacity for any realistic shape count.
+ */
+struct node_stack
+{
+    static constexpr size_t capacity = 128;
+
+    int32_t items[capacity];
+    size_t count = 0;
+
+    bool empty() const { return count == 0; }
+    int32_t pop() { return items[--count]; }
+    void push(int32_t index)
+    {
+        assert(count < capacity);
+        if (count < capacity)
+            items[count++] = index;
+    }
+};
+
+/** @brief Slab test of a ray against a box, clipped to `[0, max_t]`. */
+bool ray_vs_bounds(vec2<real> origin,
+                   vec2<real> direction,
+                   real max_t,
+                   const collision_bounds &bounds)
+{
+    real t_min = real(0);
+    real t_max = max_t;
+
+    const real *o    = &origin.x;
+    const real *d    = &direction.x;
+    const real *bmin = &bounds.min.x;
+    const real *bmax = &bounds.max.x;
+    for (int axis = 0; axis < 2; ++axis)
+    {
+        if (abs(d[axis]) < real::epsilon())
+        {
+            if (o[axis] < bmin[axis] || o[axis] > bmax[axis])
+                return false;
+            continue;
+        }
+
+        real inv = real(1) / d[axis];
+        real t0  = (bmin[axis] - o[axis]) * inv;
+        real t1  = (bmax[axis] - o[axis]) * inv;
+        if (t0 > t1)
+            swap(t0, t1);
+
+        t_min = max(t_min, t0);
+        t_max = min(t_max, t1);
+        if (t_min > t_max)
+            return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Splits `[0, count)` into contiguous ranges, one per thread, and runs
+ * them on the job system workers and the calling thread.
+ */
+void run_batch(size_t count,
+               uint32_t thread_count,
+               job_range_function run,
+               void *context)
+{
+    // Below this many pairs per range, scheduling dominates.
+    constexpr size_t min_pairs_per_range = 256;
+
+    job_system &jobs = job_system::get();
+    size_t threads   = size_t(jobs.worker_count()) + 1;
+    if (thread_count != 0)
+        threads = min(threads, (size_t)thread_count);
+
+    const size_t per_thread = (count + threads - 1) / threads;
+    const size_t grain      = max(per_thread, min_pairs_per_range);
+    jobs.parallel_for(count, grain, run, context);
+}
+
+/** @brief The arguments of a narrowphase batch. */
+struct narrowphase_batch
+{
+    const collision_pair *pairs;
+    collision_result *results;
+};
+
+void run_narrowphase(void *context, size_t begin, size_t end)
+{
+    const narrowphase_batch &batch = *static_cast<narrowphase_batch *>(context);
+    for (size_t i = begin; i < end; ++i)
+    {
+        const collision_pair &pair = batch.pairs[i];
+        batch.results[i]           = test_collision(*pair.first, *pair.second);
+    }
+}
+
+/** @return The revision of a polygon, 0 for shapes defined by their bounds. */
+uint32_t get_shape_revision(const collision_shape &shape)
+{
+    if (shape.get_type() != collision_type::polygon)
+        return 0;
+    return static_cast<const polygon_shape *>(&shape)->get_revision();
+}
+
+/** @brief The box around the sector a cone can see. */
+collision_bounds get_cone_bounds(const prepared_vision_cone &cone)
+{
+    const vec2<real> p = cone.cone.position;
+    const vec2<real> d = cone.direction;
+    const real far     = cone.cone.far_dist;
+    const real c       = cone.cos_angle;
+    const real s       = cone.sin_angle;
+
+    collision_bounds bounds = {p, p};
+
+    // The cone edges, the direction rotated by plus and minus the angle.
+    const vec2<real> left =
+        p + vec2<real>(d.x * c - d.y * s, d.x * s + d.y * c) * far;
+    const vec2<real> right =
+        p + vec2<real>(d.x * c + d.y * s, d.y * c - d.x * s) * far;
+    bounds = collision_bounds::merge(bounds, {left, left});
+    bounds = collision_bounds::merge(bounds, {right, right});
+
+    // The arc reaches past its end points along the axes it spans.
+    const vec2<real> axes[] = {{1, 0}, {-1, 0}, {0, 1}, {0, -1}};
+    for (const vec2<real> &axis : axes)
+    {
+        if (dot(axis, d) < c)
+            continue;
+        const vec2<real> extreme = p + axis * far;
+        bounds = collision_bounds::merge(bounds, {extreme, extreme});
+    }
+
+    return bounds;
+}
+} // anonymous namespace
+
+void test_collisions(const collision_pair *pairs,
+                     size_t count,
+                     collision_result *results,
+                     uint32_t thread_count)
+{
+    narrowphase_batch batch = {pairs, results};
+    run_batch(count, thread_count, run_narrowphase, &batch);
+}
+
+#pragma region Contact Cache
+
+contact_cache::pair_entry &contact_cache::get_entry(const collision_pair &pair)
+{
+    pair_entry *entry = m_pairs.find(pair);
+    if (entry)
+        return *entry;
+    m_pairs.add(pair, pair_entry());
+    return *m_pairs.find(pair);
+}
+
+collision_result contact_cache::test_entry(const collision_pair &pair,
+                                           pair_entry &entry,
+                                           uint32_t frame)
+{
+    collision_bounds first_bounds, second_bounds;
+    get_collision_bounds(*pair.first, first_bounds.min, first_bounds.max);
+    get_collision_bounds(*pair.second, second_bounds.min, second_bounds.max);
+    const uint32_t first_revision  = get_shape_revision(*pair.first);
+    const uint32_t second_revision = get_shape_revision(*pair.second);
+
+    entry.last_frame = frame;
+
+    // Neither shape changed since the last test, neither did the answer.
+    if (entry.tested && entry.first_bounds == first_bounds &&
+        entry.second_bounds == second_bounds &&
+        entry.first_revision == first_revision &&
+        entry.second_revision == second_revision)
+        return entry.state.contact;
+
+    entry.first_bounds    = first_bounds;
+    entry.second_bounds   = second_bounds;
+    entry.first_revision  = first_revision;
+    entry.second_revision = second_revision;
+    entry.tested          = true;
+    return test_collision(*pair.first, *pair.second, entry.state);
+}
+
+collision_result contact_cache::test(const collision_shape &first,
+                                     const collision_shape &second)
+{
+    const collision_pair pair = {&first, &second};
+    return test_entry(pair, get_entry(pair), m_frame);
+}
+
+/** @brief The arguments of a cached narrowphase batch. */
+struct contact_cache::batch_context
+{
+    const collision_pair *pairs;
+    collision_result *results;
+    pair_entry *const *entries;
+    uint32_t frame;
+};
+
+void contact_cache::run_batch(void *context, size_t begin, size_t end)
+{
+    const batch_context &batch = *static_cast<batch_context *>(context);
+    for (size_t i = begin; i < end; ++i)
+        batch.results[i] =
+            test_entry(batch.pairs[i], *batch.entries[i], batch.frame);
+}
+
+void contact_cache::test(const collision_pair *pairs,
+                         size_t count,
+                         collision_result *results,
+                         uint32_t thread_count)
+{
+    // Create every entry first: the table must not grow while workers hold
+    // pointers into it.
+    for (size_t i = 0; i < count; ++i)
+        get_entry(pairs[i]);
+
+    m_batch.resize(count);
+    for (size_t i = 0; i < count; ++i)
+        m_batch[i] = m_pairs.find(pairs[i]);
+
+    batch_context batch = {pairs, results, m_batch.data(), m_frame};
+    zabato::run_batch(count, thread_count, contact_cache::run_batch, &batch);
+}
+
+void contact_cache::end_frame(uint32_t max_age)
+{
+    m_stale.clear();
+    for (const auto &entry : m_pairs)
+        if (m_frame - entry.value.last_frame >= max_age)
+            m_stale.push_back(entry.key);
+
+    for (const collision_pair &pair : m_stale)
+        m_pairs.erase(pair);
+
+    ++m_frame;
+}
+
+void contact_cache::remove(const collision_shape *shape)
+{
+    m_stale.clear();
+    for (const auto &entry : m_pairs)
+        if (entry.key.first == shape || entry.key.second == shape)
+            m_stale.push_back(entry.key);
+
+    for (const collision_pair &pair : m_stale)
+        m_pairs.erase(pair);
+}
+
+#pragma endregion
+
+#pragma region Node Pool
+
+int32_t collision_world::allocate_node()
+{
+    if (m_free_list == -1)
+    {
+        m_nodes.push_back(node());
+        return int32_t(m_nodes.size() - 1);
+    }
+
+    int32_t index  = m_free_list;
+    m_free_list    = m_nodes[index].parent;
+    m_nodes[index] = node();
+    return index;
+}
+
+void collision_world::free_node(int32_t index)
+{
+    m_nodes[index]        = node();
+    m_nodes[index].parent = m_free_list;
+    m_free_list           = index;
+}
+
+#pragma endregion
+
+#pragma region Proxies
+
+collision_bounds
+collision_world::get_fat_bounds(const collision_shape &shape) const
+{
+    collision_bounds bounds;
+    get_collision_bounds(shape, bounds.min, bounds.max);
+    bounds.min -= vec2<real>(m_margin);
+    bounds.max += vec2<real>(m_margin);
+    return bounds;
+}
+
+collision_world::proxy_id collision_world::insert(const collision_shape *shape)
+{
+    assert(shape);
+
+    int32_t leaf         = allocate_node();
+    m_nodes[leaf].bounds = get_fat_bounds(*shape);
+    m_nodes[leaf].shape  = shape;
+    m_nodes[leaf].height = 0;
+    insert_leaf(leaf);
+    m_proxy_count++;
+    return leaf;
+}
+
+void collision_world::remove(proxy_id proxy)
+{
+    assert(proxy >= 0 && size_t(proxy) < m_nodes.size());
+    assert(m_nodes[proxy].is_leaf() && m_nodes[proxy].height == 0);
+
+    remove_leaf(proxy);
+    free_node(proxy);
+    m_proxy_count--;
+}
+
+bool collision_world::move(proxy_id proxy)
+{
+    assert(proxy >= 0 && size_t(proxy) < m_nodes.size());
+    assert(m_nodes[proxy].is_leaf() && m_nodes[proxy].height == 0);
+
+    collision_bounds tight;
+    get_collision_bounds(*m_nodes[proxy].shape, tight.min, tight.max);
+    if (m_nodes[proxy].bounds.contains(tight))
+        return false;
+
+    remove_leaf(proxy);
+    m_nodes[proxy].bounds = get_fat_bounds(*m_nodes[proxy].shape);
+    insert_leaf(proxy);
+    return true;
+}
+
+void collision_world::clear()
+{
+    m_nodes.clear();
+    m_root        = -1;
+    m_free_list   = -1;
+    m_proxy_count = 0;
+}
+
+#pragma endregion
+
+#pragma region Tree
+
+void collision_world::insert_leaf(int32_t leaf)
+{
+    if (m_root == -1)
+    {
+        m_root               = leaf;
+        m_nodes[leaf].parent = -1;
+        return;
+    }
+
+    // Descend toward the sibling that grows the total perimeter the least.
+    const collision_bounds leaf_bounds = m_nodes[leaf].bounds;
+    int32_t index                      = m_root;
+    while (!m_nodes[index].is_leaf())
+    {
+        const node &n = m_nodes[index];
+
+        real area          = n.bounds.get_perimeter();
+        real combined_area =
+            collision_bounds::merge(n.bounds, leaf_bounds).get_perimeter();
+
+        // Cost of making a new parent for this node and the leaf.
+        real cost = real(2) * combined_area;
+        // Minimum cost of pushing the leaf further down the tree.
+        real inheritance = real(2) * (combined_area - area);
+
+        real child_cost[2];
+        const int32_t children[2] = {n.child1, n.child2};
+        for (int i = 0; i < 2; ++i)
+        {
+            const node &child = m_nodes[children[i]];
+            real merged =
+                collision_bounds::merge(leaf_bounds, child.bounds)
+                    .get_perimeter();
+            if (child.is_leaf())
+                child_cost[i] = merged + inheritance;
+            else
+                child_cost[i] =
+                    merged - child.bounds.get_perimeter() + inheritance;
+        }
+
+        if (cost < child_cost[0] && cost < child_cost[1])
+            break;
+
+        index = child_cost[0] < child_cost[1] ? children[0] : children[1];
+    }
+
+    const int32_t sibling    = index;
+    const int32_t old_parent = m_nodes[sibling].parent;
+    const int32_t new_parent = allocate_node();
+
+    node &parent  = m_nodes[new_parent];
+    parent.parent = old_parent;
+    parent.bounds =
+        collision_bounds::merge(leaf_bounds, m_nodes[sibling].bounds);
+    parent.height = m_nodes[sibling].height + 1;
+    parent.child1 = sibling;
+    parent.child2 = leaf;
+
+    if (old_parent != -1)
+    {
+        if (m_nodes[old_parent].child1 == sibling)
+            m_nodes[old_parent].child1 = new_parent;
+        else
+            m_nodes[old_parent].child2 = new_parent;
+    }
+    else
+        m_root = new_parent;
+
+    m_nodes[sibling].parent = new_parent;
+    m_nodes[leaf].parent    = new_parent;
+
+    // Refit and rebalance the ancestors.
+    index = m_nodes[leaf].parent;
+    while (index != -1)
+    {
+        index = balance(index);
+
+        node &n  = m_nodes[index];
+        n.height = 1 + max(m_nodes[n.child1].height, m_nodes[n.child2].height);
+        n.bounds = collision_bounds::merge(m_nodes[n.child1].bounds,
+                                           m_nodes[n.child2].bounds);
+        index    = n.parent;
+    }
+}
+
+void collision_world::remove_leaf(int32_t leaf)
+{
+    if (leaf == m_root)
+    {
+        m_root = -1;
+        return;
+    }
+
+    const int32_t parent      = m_nodes[leaf].parent;
+    const int32_t grandparent = m_nodes[parent].parent;
+    const int32_t sibling     = m_nodes[parent].child1 == leaf
+                                    ? m_nodes[parent].child2
+                                    : m_nodes[parent].child1;
+
+    if (grandparent == -1)
+    {
+        m_root                  = sibling;
+        m_nodes[sibling].parent = -1;
+        free_node(parent);
+        return;
+    }
+
+    // Splice the sibling into the grandparent, then refit upwards.
+    if (m_nodes[grandparent].child1 == parent)
+        m_nodes[grandparent].child1 = sibling;
+    else
+        m_nodes[grandparent].child2 = sibling;
+    m_nodes[sibling].parent = grandparent;
+    free_node(parent);
+
+    int32_t index = grandparent;
+    while (index != -1)
+    {
+        index = balance(index);
+
+        node &n  = m_nodes[index];
+        n.bounds = collision_bounds::merge(m_nodes[n.child1].bounds,
+                                           m_nodes[n.child2].bounds);
+        n.height = 1 + max(m_nodes[n.child1].height, m_nodes[n.child2].height);
+        index    = n.parent;
+    }
+}
+
+int32_t collision_world::balance(int32_t a_index)
+{
+    node &a = m_nodes[a_index];
+    if (a.is_leaf() || a.height < 2)
+        return a_index;
+
+    const int32_t b_index = a.child1;
+    const int32_t c_index = a.child2;
+    node &b               = m_nodes[b_index];
+    node &c               = m_nodes[c_index];
+
+    const int32_t skew = c.height - b.height;
+    if (skew >= -1 && skew <= 1)
+        return a_index;
+
+    // Rotate the taller child up, mirrored for either side.
+    const bool rotate_c   = skew > 1;
+    const int32_t up      = rotate_c ? c_index : b_index;
+    const int32_t other   = rotate_c ? b_index : c_index;
+    node &u               = m_nodes[up];
+    const int32_t f_index = u.child1;
+    const int32_t g_index = u.child2;
+    node &f               = m_nodes[f_index];
+    node &g               = m_nodes[g_index];
+
+    u.child1 = a_index;
+    u.parent = a.parent;
+    a.parent = up;
+
+    if (u.parent != -1)
+    {
+        if (m_nodes[u.parent].child1 == a_index)
+            m_nodes[u.parent].child1 = up;
+        else
+            m_nodes[u.parent].child2 = up;
+    }
+    else
+        m_root = up;
+
+    // The taller grandchild stays under `up`, the shorter moves to `a`.
+    const bool keep_f     = f.height > g.height;
+    const int32_t kept    = keep_f ? f_index : g_index;
+    const int32_t moved   = keep_f ? g_index : f_index;
+    u.child2              = kept;
+    m_nodes[moved].parent = a_index;
+    if (rotate_c)
+        a.child2 = moved;
+    else
+        a.child1 = moved;
+
+    const node &o = m_nodes[other];
+    const node &m = m_nodes[moved];
+    const node &k = m_nodes[kept];
+    a.bounds      = collision_bounds::merge(o.bounds, m.bounds);
+    a.height      = 1 + max(o.height, m.height);
+    u.bounds      = collision_bounds::merge(a.bounds, k.bounds);
+    u.height      = 1 + max(a.height, k.height);
+    return up;
+}
+
+#pragma endregion
+
+#pragma region Queries
+
+void collision_world::query_bounds(const collision_bounds &bounds,
+                                   vector<const collision_shape *> &out) const
+{
+    if (m_root == -1)
+        return;
+
+    node_stack stack;
+    stack.push(m_root);
+    while (!stack.empty())
+    {
+        const node &n = m_nodes[stack.pop()];
+        if (!n.bounds.overlaps(bounds))
+            continue;
+
+        if (n.is_leaf())
+            out.push_back(n.shape);
+        else
+        {
+            stack.push(n.child1);
+            stack.push(n.child2);
+        }
+    }
+}
+
+void collision_world::query_point(vec2<real> point,
+                                  vector<const collision_shape *> &out) const
+{
+    if (m_root == -1)
+        return;
+
+    node_stack stack;
+    stack.push(m_root);
+    while (!stack.empty())
+    {
+        const node &n = m_nodes[stack.pop()];
+        if (!n.bounds.contains(point))
+            continue;
+
+        if (!n.is_leaf())
+        {
+            stack.push(n.child1);
+            stack.push(n.child2);
+        }
+        else if (check_collision(*n.shape, point))
+            out.push_back(n.shape);
+    }
+}
+
+void collision_world::query_pairs(vector<collision_pair> &out) const
+{
+    PROFILE_SCOPE("collision_world::query_pairs");
+    for (size_t i = 0; i < m_nodes.size(); ++i)
+    {
+        const node &leaf = m_nodes[i];
+        if (leaf.height != 0)
+            continue;
+
+        node_stack stack;
+        stack.push(m_root);
+        while (!stack.empty())
+        {
+            const int32_t index = stack.pop();
+            const node &n       = m_nodes[index];
+            if (!n.bounds.overlaps(leaf.bounds))
+                continue;
+
+            if (!n.is_leaf())
+            {
+                stack.push(n.child1);
+                stack.push(n.child2);
+            }
+            else if (size_t(index) > i) // Report each pair once.
+                out.push_back({leaf.shape, n.shape});
+        }
+    }
+}
+
+raycast_result collision_world::raycast(vec2<real> origin,
+                                        vec2<real> direction,
+                                        real max_distance) const
+{
+    PROFILE_SCOPE("collision_world::raycast");
+    raycast_result final_result;
+    final_result.distance = max_distance;
+    final_result.hit      = false;
+
+    if (m_root == -1)
+        return final_result;
+
+    const vec2<real> norm_dir = normalize(direction);
+
+    node_stack stack;
+    stack.push(m_root);
+    while (!stack.empty())
+    {
+        const node &n = m_nodes[stack.pop()];
+
+        // Boxes beyond the closest hit so far cannot hold a closer one.
+        if (!ray_vs_bounds(origin, norm_dir, final_result.distance, n.bounds))
+            continue;
+
+        if (!n.is_leaf())
+        {
+            stack.push(n.child1);
+            stack.push(n.child2);
+            continue;
+        }
+
+        raycast_result hit;
+        if (raycast_shape(origin, norm_dir, *n.shape, hit) &&
+            hit.distance >= real(0) && hit.distance < final_result.distance)
+        {
+            final_result        = hit;
+            final_result.object = n.shape;
+            final_result.hit    = true;
+        }
+    }
+
+    return final_result;
+}
+
+sweep_result collision_world::sweep(const collision_shape &moving,
+                                    vec2<real> motion) const
+{
+    PROFILE_SCOPE("collision_world::sweep");
+    sweep_result final_result;
+    if (m_root == -1)
+        return final_result;
+
+    collision_bounds start;
+    get_collision_bounds(moving, start.min, start.max);
+    const vec2<real> center = (start.min + start.max) * real(0.5);
+    const vec2<real> half   = (start.max - start.min) * real(0.5);
+
+    node_stack stack;
+    stack.push(m_root);
+    while (!stack.empty())
+    {
+        const node &n = m_nodes[stack.pop()];
+
+        // The center path against the box grown by the moving extents, cut
+        // at the earliest contact so far.
+        const collision_bounds grown = {n.bounds.min - half,
+                                        n.bounds.max + half};
+        if (!ray_vs_bounds(center, motion, final_result.time, grown))
+            continue;
+
+        if (!n.is_leaf())
+        {
+            stack.push(n.child1);
+            stack.push(n.child2);
+            continue;
+        }
+
+        sweep_result hit;
+        if (n.shape != &moving &&
+            sweep_shape(moving, motion, *n.shape, hit) &&
+            (!final_result.hit || hit.time < final_result.time))
+            final_result = hit;
+    }
+
+    return final_result;
+}
+
+visibility_result
+collision_world::check_visibility(const vision_cone &cone,
+                                  const collision_shape &object) const
+{
+    PROFILE_SCOPE("collision_world::check_visibility");
+    // Only shapes between the observer and the object can block the rays.
+    collision_bounds sight;
+    get_collision_bounds(object, sight.min, sight.max);
+    sight = collision_bounds::merge(sight, {cone.position, cone.position});
+
+    thread_local vector<const collision_shape *> candidates;
+    thread_local ray_obstacle_set obstacles;
+    candidates.clear();
+    query_bounds(sight, candidates);
+    obstacles.assign(candidates, &object);
+
+    return zabato::check_visibility(cone, object, obstacles);
+}
+
+void collision_world::check_visibility(const vision_cone *cones,
+                                       size_t cone_count,
+                                       const collision_world &targets,
+                                       vector<visibility_pair> &out) const
+{
+    PROFILE_SCOPE("collision_world::check_visibility");
+    thread_local vector<const collision_shape *> candidates;
+    thread_local vector<const collision_shape *> blockers;
+    thread_local ray_obstacle_set obstacles;
+
+    for (size_t i = 0; i < cone_count; ++i)
+    {
+        const prepared_vision_cone cone = prepare_vision_cone(cones[i]);
+
+        candidates.clear();
+        targets.query_bounds(get_cone_bounds(cone), candidates);
+
+        // Keep the targets whose center is in the cone, and grow the sight
+        // box over them so it covers every ray.
+        collision_bounds sight = {cone.cone.position, cone.cone.position};
+        size_t kept            = 0;
+        for (size_t j = 0; j < candidates.size(); ++j)
+        {
+            collision_bounds bounds;
+            get_collision_bounds(*candidates[j], bounds.min, bounds.max);
+            vec2<real> center = bounds.min + (bounds.max - bounds.min) * 0.5;
+            if (!is_point_in_vision_cone(cone, center))
+                continue;
+
+            sight              = collision_bounds::merge(sight, bounds);
+            candidates[kept++] = candidates[j];
+        }
+        if (kept == 0)
+            continue;
+
+        blockers.clear();
+        query_bounds(sight, blockers);
+        obstacles.assign(blockers);
+
+        for (size_t j = 0; j < kept; ++j)
+        {
+            visibility_pair pair;
+            pair.observer   = i;
+            pair.target     = candidates[j];
+            pair.visibility = zabato::check_visibility(
+                cone, *candidates[j], obstacles);
+            out.push_back(pair);
+        }
+    }
+}
+
+#pragma endregion
+} // namespace zabato
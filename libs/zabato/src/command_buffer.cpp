@@ -0,0 +1,563 @@
+#include <zabato/command_buffer.hpp>
+
+#include <string.h>
+
+namespace zabato
+{
+enum class command_buffer::op : uint8_t
+{
+    new_frame,
+    begin,
+    end,
+    vertex,
+    color,
+    normal,
+    tex_coord,
+    clear,
+    viewport,
+    set_matrix_mode,
+    perspective_fov,
+    ortho,
+    translate,
+    rotate,
+    scale,
+    load_identity,
+    load_matrix,
+    push_matrix,
+    pop_matrix,
+    set_shade_model,
+    enable_lighting,
+    set_light,
+    set_material,
+    bind_texture,
+    unbind_texture,
+    begin_display_list,
+    end_display_list,
+    call_display_list,
+    draw_indexed,
+    draw_indexed_range,
+    draw_instanced,
+    begin_timing,
+    end_timing,
+    enable_fog,
+    set_fog_start,
+    set_fog_end,
+    set_fog_color,
+    enable_depth_test,
+    enable_blend,
+    set_blend_func,
+    enable_scissor_test,
+    set_scissor,
+    set_viewport_rect,
+};
+
+namespace
+{
+/** @brief Reads the commands back in the order they were written. */
+class command_reader
+{
+public:
+    command_reader(const uint8_t *begin, const uint8_t *end)
+        : m_begin(begin), m_at(begin), m_end(end)
+    {
+    }
+
+    bool done() const { return m_at >= m_end; }
+
+    template <class T> T read()
+    {
+        T value;
+        memcpy(&value, m_at, sizeof(T));
+        m_at += sizeof(T);
+        return value;
+    }
+
+    /** @brief Reads `count` values of `T` written after an `align`. */
+    template <class T> const T *read_array(size_t count)
+    {
+        const size_t offset = size_t(m_at - m_begin);
+        m_at += (alignof(T) - offset % alignof(T)) % alignof(T);
+
+        const T *values = reinterpret_cast<const T *>(m_at);
+        m_at += count * sizeof(T);
+        return values;
+    }
+
+private:
+    const uint8_t *m_begin;
+    const uint8_t *m_at;
+    const uint8_t *m_end;
+};
+} // namespace
+
+uint8_t *command_buffer::append(size_t size)
+{
+    // `resize` grows to the exact size, so grow geometrically here.
+    const size_t at = m_data.size();
+    if (at + size > m_data.capacity())
+        m_data.reserve(max(at + size, max(m_data.capacity() * 2, size_t(256))));
+    m_data.resize(at + size);
+    return m_data.data() + at;
+}
+
+template <class T> void command_buffer::write(const T &value)
+{
+    memcpy(append(sizeof(T)), &value, sizeof(T));
+}
+
+template <class... Args>
+void command_buffer::record(op code, const Args &...args)
+{
+    write(code);
+    (write(args), ...);
+}
+
+void command_buffer::align(size_t alignment)
+{
+    const size_t padding = (alignment - m_data.size() % alignment) % alignment;
+    memset(append(padding), 0, padding);
+}
+
+void command_buffer::execute() const
+{
+    gpu &g = m_device;
+    command_reader in(m_data.data(), m_data.data() + m_data.size());
+    while (!in.done())
+    {
+        switch (in.read<op>())
+        {
+        case op::new_frame:
+            g.new_frame();
+            break;
+        case op::begin:
+            g.begin(in.read<primitive_type>());
+            break;
+        case op::end:
+            g.end();
+            break;
+        case op::vertex:
+            g.vertex(in.read<vec3<real>>());
+            break;
+        case op::color:
+            g.color(in.read<struct color>());
+            break;
+        case op::normal:
+            g.normal(in.read<vec3<real>>());
+            break;
+        case op::tex_coord:
+            g.tex_coord(in.read<vec2<real>>());
+            break;
+        case op::clear:
+        {
+            const struct color c = in.read<struct color>();
+            g.clear(c, in.read<real>());
+            break;
+        }
+        case op::viewport:
+        {
+            const int width = in.read<int>();
+            g.viewport(width, in.read<int>());
+            break;
+        }
+        case op::set_matrix_mode:
+            g.set_matrix_mode(in.read<matrix_mode>());
+            break;
+        case op::perspective_fov:
+        {
+            const real fov    = in.read<real>();
+            const real aspect = in.read<real>();
+            const real near   = in.read<real>();
+            g.perspective_fov(fov, aspect, near, in.read<real>());
+            break;
+        }
+        case op::ortho:
+        {
+            const real left   = in.read<real>();
+            const real right  = in.read<real>();
+            const real bottom = in.read<real>();
+            const real top    = in.read<real>();
+            const real near   = in.read<real>();
+            g.ortho(left, right, bottom, top, near, in.read<real>());
+            break;
+        }
+        case op::translate:
+            g.translate(in.read<vec3<real>>());
+            break;
+        case op::rotate:
+            g.rotate(in.read<vec3<real>>());
+            break;
+        case op::scale:
+            g.scale(in.read<vec3<real>>());
+            break;
+        case op::load_identity:
+            g.load_identity();
+            break;
+        case op::load_matrix:
+            g.load_matrix(in.read<mat4<real>>());
+            break;
+        case op::push_matrix:
+            g.push_matrix();
+            break;
+        case op::pop_matrix:
+            g.pop_matrix();
+            break;
+        case op::set_shade_model:
+            g.set_shade_model(in.read<shade_model>());
+            break;
+        case op::enable_lighting:
+            g.enable_lighting(in.read<bool>());
+            break;
+        case op::set_light:
+        {
+            const int id = in.read<int>();
+            if (in.read<bool>())
+            {
+                const light l = in.read<light>();
+                g.set_light(id, &l);
+            }
+            else
+                g.set_light(id, nullptr);
+            break;
+        }
+        case op::set_material:
+            if (in.read<bool>())
+            {
+                const material m = in.read<material>();
+                g.set_material(&m);
+            }
+            else
+                g.set_material(nullptr);
+            break;
+        case op::bind_texture:
+            g.bind_texture(in.read<texture *>());
+            break;
+        case op::unbind_texture:
+            g.unbind_texture();
+            break;
+        case op::begin_display_list:
+            g.begin_display_list(in.read<display_list *>());
+            break;
+        case op::end_display_list:
+            g.end_display_list();
+            break;
+        case op::call_display_list:
+            g.call_display_list(in.read<const display_list *>());
+            break;
+        case op::draw_indexed:
+        {
+            const primitive_type type = in.read<primitive_type>();
+            const vertex_buffer *vb   = in.read<const vertex_buffer *>();
+            g.draw_indexed(type, vb, in.read<const index_buffer *>());
+            break;
+        }
+        case op::draw_indexed_range:
+        {
+            const primitive_type type = in.read<primitive_type>();
+            const vertex_buffer *vb   = in.read<const vertex_buffer *>();
+            const index_buffer *ib    = in.read<const index_buffer *>();
+            const size_t first        = in.read<size_t>();
+            g.draw_indexed_range(type, vb, ib, first, in.read<size_t>());
+            break;
+        }
+        case op::draw_instanced:
+        {
+            const primitive_type type     = in.read<primitive_type>();
+            const vertex_buffer *vb       = in.read<const vertex_buffer *>();
+            const index_buffer *ib        = in.read<const index_buffer *>();
+            const size_t count            = in.read<size_t>();
+            const mat4<real> *model_views = in.read_array<mat4<real>>(count);
+            if (g.draw_instanced(type, vb, ib, model_views, count))
+                break;
+
+            // The device cannot instance, so draw every instance on its own.
+            g.set_matrix_mode(matrix_mode::modelview);
+            g.push_matrix();
+            for (size_t i = 0; i < count; ++i)
+            {
+                g.load_matrix(model_views[i]);
+                g.draw_indexed(type, vb, ib);
+            }
+            g.pop_matrix();
+            break;
+        }
+        case op::begin_timing:
+            g.begin_timing(in.read<const char *>());
+            break;
+        case op::end_timing:
+            g.end_timing();
+            break;
+        case op::enable_fog:
+            g.enable_fog(in.read<bool>());
+            break;
+        case op::set_fog_start:
+            g.set_fog_start(in.read<float>());
+            break;
+        case op::set_fog_end:
+            g.set_fog_end(in.read<float>());
+            break;
+        case op::set_fog_color:
+            g.set_fog_color(in.read<struct color>());
+            break;
+        case op::enable_depth_test:
+            g.enable_depth_test(in.read<bool>());
+            break;
+        case op::enable_blend:
+            g.enable_blend(in.read<bool>());
+            break;
+        case op::set_blend_func:
+        {
+            const blend_factor src = in.read<blend_factor>();
+            g.set_blend_func(src, in.read<blend_factor>());
+            break;
+        }
+        case op::enable_scissor_test:
+            g.enable_scissor_test(in.read<bool>());
+            break;
+        case op::set_scissor:
+        {
+            const int x     = in.read<int>();
+            const int y     = in.read<int>();
+            const int width = in.read<int>();
+            g.set_scissor(x, y, width, in.read<int>());
+            break;
+        }
+        case op::set_viewport_rect:
+        {
+            const int x     = in.read<int>();
+            const int y     = in.read<int>();
+            const int width = in.read<int>();
+            g.set_viewport_rect(x, y, width, in.read<int>());
+            break;
+        }
+        }
+    }
+}
+
+void command_buffer::new_frame() { record(op::new_frame); }
+void command_buffer::begin(primitive_type type) { record(op::begin, type); }
+void command_buffer::end() { record(op::end); }
+void command_buffer::vertex(const vec3<real> &v) { record(op::vertex, v); }
+void command_buffer::vertex(real x, real y, real z)
+{
+    record(op::vertex, vec3<real>(x, y, z));
+}
+void command_buffer::color(const struct color &c) { record(op::color, c); }
+void command_buffer::color(real r, real g, real b, real a)
+{
+    record(op::color, zabato::color(r, g, b, a));
+}
+void command_buffer::normal(const vec3<real> &n) { record(op::normal, n); }
+void command_buffer::normal(real x, real y, real z)
+{
+    record(op::normal, vec3<real>(x, y, z));
+}
+void command_buffer::tex_coord(const vec2<real> &uv)
+{
+    record(op::tex_coord, uv);
+}
+void command_buffer::tex_coord(real u, real v)
+{
+    record(op::tex_coord, vec2<real>(u, v));
+}
+void command_buffer::clear(const struct color &c, real depth)
+{
+    record(op::clear, c, depth);
+}
+void command_buffer::viewport(int width, int height)
+{
+    record(op::viewport, width, height);
+}
+
+void command_buffer::set_matrix_mode(matrix_mode mode)
+{
+    record(op::set_matrix_mode, mode);
+}
+void command_buffer::perspective_fov(real fov,
+                                     real aspect,
+                                     real near,
+                                     real far)
+{
+    record(op::perspective_fov, fov, aspect, near, far);
+}
+void command_buffer::ortho(
+    real left, real right, real bottom, real top, real near, real far)
+{
+    record(op::ortho, left, right, bottom, top, near, far);
+}
+void command_buffer::translate(const vec3<real> &t)
+{
+    record(op::translate, t);
+}
+void command_buffer::translate(real x, real y, real z)
+{
+    record(op::translate, vec3<real>(x, y, z));
+}
+void command_buffer::rotate(const vec3<real> &r) { record(op::rotate, r); }
+void command_buffer::rotate(real x, real y, real z)
+{
+    record(op::rotate, vec3<real>(x, y, z));
+}
+void command_buffer::scale(const vec3<real> &s) { record(op::scale, s); }
+void command_buffer::scale(real x, real y, real z)
+{
+    record(op::scale, vec3<real>(x, y, z));
+}
+void command_buffer::load_identity() { record(op::load_identity); }
+void command_buffer::load_matrix(const mat4<real> &m)
+{
+    record(op::load_matrix, m);
+}
+void command_buffer::push_matrix() { record(op::push_matrix); }
+void command_buffer::pop_matrix() { record(op::pop_matrix); }
+
+void command_buffer::set_shade_model(shade_model model)
+{
+    record(op::set_shade_model, model);
+}
+void command_buffer::enable_lighting(bool enabled)
+{
+    record(op::enable_lighting, enabled);
+}
+void command_buffer::set_light(int id, const light *l)
+{
+    record(op::set_light, id, l != nullptr);
+    if (l)
+        write(*l);
+}
+void command_buffer::set_material(const material *m)
+{
+    record(op::set_material, m != nullptr);
+    if (m)
+        write(*m);
+}
+
+texture *command_buffer::create_texture(uint16_t, uint16_t, color_format)
+{
+    return nullptr;
+}
+void command_buffer::bind_texture(texture *tex)
+{
+    record(op::bind_texture, tex);
+}
+void command_buffer::unbind_texture() { record(op::unbind_texture); }
+
+display_list *command_buffer::create_display_list() { return nullptr; }
+void command_buffer::begin_display_list(display_list *list)
+{
+    record(op::begin_display_list, list);
+}
+void command_buffer::end_display_list() { record(op::end_display_list); }
+void command_buffer::call_display_list(const display_list *list)
+{
+    record(op::call_display_list, list);
+}
+
+vertex_buffer *command_buffer::create_vertex_buffer()
+{
+    return m_device.create_vertex_buffer();
+}
+index_buffer *command_buffer::create_index_buffer()
+{
+    return m_device.create_index_buffer();
+}
+
+void command_buffer::draw_indexed(primitive_type type,
+                                  const vertex_buffer *vertices,
+                                  const index_buffer *indices)
+{
+    record(op::draw_indexed, type, vertices, indices);
+}
+
+void command_buffer::draw_indexed_range(primitive_type type,
+                                        const vertex_buffer *vertices,
+                                        const index_buffer *indices,
+                                        size_t first_index,
+                                        size_t index_count)
+{
+    record(op::draw_indexed_range,
+           type,
+           vertices,
+           indices,
+           first_index,
+           index_count);
+}
+
+bool command_buffer::draw_skinned(primitive_type,
+                                  const vertex_buffer *,
+                                  const index_buffer *,
+                                  const mat4<real> *,
+                                  size_t)
+{
+    // Whether the device can skin is only known on the render thread.
+    return false;
+}
+
+bool command_buffer::draw_instanced(primitive_type type,
+                                    const vertex_buffer *vertices,
+                                    const index_buffer *indices,
+                                    const mat4<real> *model_views,
+                                    size_t count)
+{
+    if (!vertices || !indices || !model_views)
+        return false;
+
+    record(op::draw_instanced, type, vertices, indices, count);
+    align(alignof(mat4<real>));
+    const size_t size = count * sizeof(mat4<real>);
+    memcpy(append(size), model_views, size);
+    return true;
+}
+
+void command_buffer::begin_timing(const char *name)
+{
+    record(op::begin_timing, name);
+}
+void command_buffer::end_timing() { record(op::end_timing); }
+span<const gpu_timing> command_buffer::get_timings() const
+{
+    return m_device.get_timings();
+}
+gpu_frame_stats command_buffer::get_frame_stats() const
+{
+    return m_device.get_frame_stats();
+}
+
+void command_buffer::enable_fog(bool enabled)
+{
+    record(op::enable_fog, enabled);
+}
+void command_buffer::set_fog_start(float start)
+{
+    record(op::set_fog_start, start);
+}
+void command_buffer::set_fog_end(float end) { record(op::set_fog_end, end); }
+void command_buffer::set_fog_color(const struct color &c)
+{
+    record(op::set_fog_color, c);
+}
+
+void command_buffer::enable_depth_test(bool enabled)
+{
+    record(op::enable_depth_test, enabled);
+}
+void command_buffer::enable_blend(bool enabled)
+{
+    record(op::enable_blend, enabled);
+}
+void command_buffer::set_blend_func(blend_factor src, blend_factor dst)
+{
+    record(op::set_blend_func, src, dst);
+}
+void command_buffer::enable_scissor_test(bool enabled)
+{
+    record(op::enable_scissor_test, enabled);
+}
+void command_buffer::set_scissor(int x, int y, int width, int height)
+{
+    record(op::set_scissor, x, y, width, height);
+}
+void command_buffer::set_viewport_rect(int x, int y, int width, int height)
+{
+    record(op::set_viewport_rect, x, y, width, height);
+}
+} // namespace zabato
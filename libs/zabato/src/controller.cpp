@@ -1,11 +1,14 @@
 #include <zabato/controller.hpp>
+#include <zabato/job_system.hpp>
 
 namespace zabato
 {
 
 const rtti controller::TYPE("zabato.controller", &object::TYPE);
 
-controller::controller() : m_object(nullptr), m_next(nullptr), m_prev(nullptr)
+controller::controller()
+    : m_object(nullptr), m_next(nullptr), m_prev(nullptr),
+      m_update_group(serial_group), m_set_index(UINT32_MAX)
 {
 }
 
@@ -13,4 +16,97 @@ controller::~controller() {}
 
 void controller::set_object(object *obj) { m_object = obj; }
 
+int controller::get_memory_used() const
+{
+    return object::get_memory_used() +
+           (int)(sizeof(controller) - sizeof(object));
+}
+
+void controller::add_cost(scene_cost &cost) const
+{
+    object::add_cost(cost);
+    ++cost.controllers;
+    cost.update_cost += get_update_cost();
+}
+
+void controller::update_list(controller *head, real dt)
+{
+    static thread_local controller_batch batch;
+    for (controller *c = head; c; c = c->m_next)
+        batch.add(c, dt);
+    batch.run();
+}
+
+void controller_batch::clear()
+{
+    m_independent.clear();
+    m_serial.clear();
+    m_grouped.clear();
+    m_groups.clear();
+}
+
+void controller_batch::add(controller *ctrl, real dt)
+{
+    const uint32_t group = ctrl->get_update_group();
+    if (group == controller::serial_group)
+        m_serial.push_back({ctrl, dt});
+    else if (group == controller::independent_group)
+        m_independent.push_back({ctrl, dt});
+    else
+        m_grouped.push_back({group, uint32_t(m_grouped.size()), {ctrl, dt}});
+}
+
+void controller_batch::run()
+{
+    // Sorting by insertion order too keeps each group in update order.
+    sort(m_grouped.begin(),
+         m_grouped.end(),
+         [](const grouped_entry &a, const grouped_entry &b)
+         {
+             if (a.group != b.group)
+                 return a.group < b.group;
+             return a.order < b.order;
+         });
+
+    const grouped_entry *grouped = m_grouped.data();
+    const size_t grouped_count   = m_grouped.size();
+    for (size_t begin = 0, end = 0; begin < grouped_count; begin = end)
+    {
+        const uint32_t group = grouped[begin].group;
+        while (end < grouped_count && grouped[end].group == group)
+            ++end;
+        m_groups.push_back({grouped + begin, grouped + end});
+    }
+
+    // Groups go first, so workers take them while this thread starts on the
+    // independent controllers.
+    job_system &jobs = job_system::get();
+    job_counter counter;
+    for (group_range &group : m_groups)
+        jobs.run(run_group, &group, &counter);
+
+    const entry *independent = m_independent.data();
+    jobs.parallel_for(m_independent.size(),
+                      0,
+                      [independent](size_t begin, size_t end)
+                      {
+                          for (size_t i = begin; i < end; ++i)
+                              independent[i].ctrl->update(independent[i].dt);
+                      });
+
+    jobs.wait(counter);
+
+    for (const entry &e : m_serial)
+        e.ctrl->update(e.dt);
+
+    clear();
+}
+
+void controller_batch::run_group(void *data)
+{
+    const group_range *range = static_cast<const group_range *>(data);
+    for (const grouped_entry *it = range->begin; it != range->end; ++it)
+        it->item.ctrl->update(it->item.dt);
+}
+
 } // namespace zabato
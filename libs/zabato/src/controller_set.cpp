@@ -0,0 +1,110 @@
+#include <zabato/controller_set.hpp>
+#include <zabato/profiler.hpp>
+
+#include <assert.h>
+
+namespace zabato
+{
+void controller_set::add(controller *ctrl)
+{
+    assert(ctrl->m_set_index == UINT32_MAX &&
+           "Controller already belongs to a set");
+
+    bucket &b         = bucket_for(ctrl->type());
+    ctrl->m_set_index = uint32_t(b.items.size());
+    b.items.push_back(ctrl);
+    ++m_size;
+}
+
+void controller_set::remove(controller *ctrl)
+{
+    assert(contains(ctrl) && "Controller does not belong to this set");
+
+    bucket &b            = bucket_for(ctrl->type());
+    const uint32_t index = ctrl->m_set_index;
+    controller *last     = b.items.back();
+    b.items[index]       = last;
+    last->m_set_index    = index;
+    b.items.pop_back();
+    ctrl->m_set_index = UINT32_MAX;
+    --m_size;
+}
+
+bool controller_set::contains(const controller *ctrl) const
+{
+    const bucket *b = find_bucket(ctrl->type());
+    return b && ctrl->m_set_index < b->items.size() &&
+           b->items[ctrl->m_set_index] == ctrl;
+}
+
+void controller_set::set_tick_interval(const rtti &type, real interval)
+{
+    bucket &b  = bucket_for(type);
+    b.interval = interval;
+    b.elapsed  = real(0);
+}
+
+real controller_set::get_tick_interval(const rtti &type) const
+{
+    const bucket *b = find_bucket(type);
+    return b ? b->interval : real(0);
+}
+
+void controller_set::update(real dt)
+{
+    PROFILE_SCOPE("controller_set::update");
+    for (bucket &b : m_buckets)
+    {
+        if (b.items.empty())
+            continue;
+
+        real step = dt;
+        if (b.interval > real(0))
+        {
+            b.elapsed += dt;
+            if (b.elapsed < b.interval)
+                continue;
+            step      = b.elapsed;
+            b.elapsed = real(0);
+        }
+
+        for (controller *c : b.items)
+            m_batch.add(c, step);
+    }
+
+    m_batch.run();
+}
+
+void controller_set::clear()
+{
+    for (bucket &b : m_buckets)
+    {
+        for (controller *c : b.items)
+            c->m_set_index = UINT32_MAX;
+        b.items.clear();
+        b.elapsed = real(0);
+    }
+    m_size = 0;
+}
+
+controller_set::bucket &controller_set::bucket_for(const rtti &type)
+{
+    // There are few controller types, a linear scan beats hashing.
+    for (bucket &b : m_buckets)
+        if (b.type == &type)
+            return b;
+
+    m_buckets.emplace_back();
+    m_buckets.back().type = &type;
+    return m_buckets.back();
+}
+
+const controller_set::bucket *
+controller_set::find_bucket(const rtti &type) const
+{
+    for (const bucket &b : m_buckets)
+        if (b.type == &type)
+            return &b;
+    return nullptr;
+}
+} // namespace zabato
@@ -0,0 +1,148 @@
+#include <zabato/debug_draw.hpp>
+
+#include <stddef.h>
+
+namespace zabato
+{
+namespace
+{
+/** @brief Vertices per indexed draw, the reach of 16-bit indices. */
+constexpr size_t max_chunk_vertices = 65535;
+} // namespace
+
+vertex_layout debug_draw_batch::get_vertex_layout()
+{
+    vertex_layout layout;
+    layout.stride       = static_cast<uint16_t>(sizeof(debug_vertex));
+    layout.color_offset = static_cast<int16_t>(offsetof(debug_vertex, color));
+    return layout;
+}
+
+void debug_draw_batch::clear()
+{
+    m_lines.clear();
+    m_triangles.clear();
+    m_points.clear();
+}
+
+void debug_draw_batch::release_buffers()
+{
+    for (chunk &c : m_chunks)
+    {
+        if (c.vertices)
+        {
+            c.vertices->destroy();
+            delete c.vertices;
+        }
+        if (c.indices)
+        {
+            c.indices->destroy();
+            delete c.indices;
+        }
+    }
+    m_chunks.clear();
+    m_gpu = nullptr;
+}
+
+/**
+ * @brief Makes sure the retained buffers belong to `gpu`, dropping them if
+ * the batch was last flushed with a different context.
+ */
+void debug_draw_batch::bind_gpu(gpu &gpu)
+{
+    if (m_gpu == &gpu)
+        return;
+
+    release_buffers();
+    m_gpu = &gpu;
+}
+
+/**
+ * @brief Draws one vertex array from retained buffers, one chunk per draw.
+ * @param per_primitive Vertices per primitive, so a chunk never splits one.
+ * @param[in,out] next_chunk The first chunk not used yet this flush.
+ * @return False if the GPU has no retained geometry support.
+ */
+bool debug_draw_batch::draw_retained(gpu &gpu,
+                                     primitive_type type,
+                                     const vector<debug_vertex> &vertices,
+                                     size_t per_primitive,
+                                     size_t &next_chunk)
+{
+    const size_t chunk_size =
+        max_chunk_vertices - max_chunk_vertices % per_primitive;
+    const vertex_layout layout = get_vertex_layout();
+
+    for (size_t first = 0; first < vertices.size(); first += chunk_size)
+    {
+        if (next_chunk == m_chunks.size())
+        {
+            chunk c;
+            c.vertices = gpu.create_vertex_buffer();
+            c.indices  = gpu.create_index_buffer();
+            m_chunks.push_back(c);
+        }
+
+        chunk &c = m_chunks[next_chunk++];
+        if (!c.vertices || !c.indices)
+            return false;
+
+        size_t count = vertices.size() - first;
+        if (count > chunk_size)
+            count = chunk_size;
+
+        while (m_indices.size() < count)
+            m_indices.push_back(static_cast<uint16_t>(m_indices.size()));
+
+        c.vertices->load(layout, count, vertices.data() + first);
+        c.indices->load(count, m_indices.data());
+        gpu.draw_indexed(type, c.vertices, c.indices);
+    }
+
+    return true;
+}
+
+void debug_draw_batch::draw_immediate(gpu &gpu,
+                                      primitive_type type,
+                                      const vector<debug_vertex> &vertices)
+{
+    if (vertices.size() == 0)
+        return;
+
+    gpu.begin(type);
+    const color *last = nullptr;
+    for (const debug_vertex &v : vertices)
+    {
+        if (!last || *last != v.color)
+        {
+            gpu.color(v.color);
+            last = &v.color;
+        }
+        gpu.vertex(v.position);
+    }
+    gpu.end();
+}
+
+void debug_draw_batch::flush(gpu &gpu)
+{
+    if (empty())
+        return;
+
+    bind_gpu(gpu);
+
+    // Buffers are either always or never available, so when one is missing
+    // nothing was drawn yet.
+    size_t next = 0;
+    if (!draw_retained(gpu, primitive_type::triangles, m_triangles, 3, next) ||
+        !draw_retained(gpu, primitive_type::lines, m_lines, 2, next) ||
+        !draw_retained(gpu, primitive_type::points, m_points, 1, next))
+    {
+        release_buffers();
+        draw_immediate(gpu, primitive_type::triangles, m_triangles);
+        draw_immediate(gpu, primitive_type::lines, m_lines);
+        draw_immediate(gpu, primitive_type::points, m_points);
+    }
+
+    clear();
+}
+} // namespace zabato
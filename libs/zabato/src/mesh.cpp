@@ -1,7 +1,17 @@
 #include <zabato/mesh.hpp>
+#include <zabato/profiler.hpp>
+
+#include <stdatomic.h>
 
 namespace zabato
 {
+uint32_t mesh::next_skeleton_id()
+{
+    // Meshes decode on job system workers during batched loads.
+    static atomic_uint next_id;
+    return atomic_fetch_add_explicit(&next_id, 1, memory_order_relaxed) + 1;
+}
+
 /**
  * @brief Renders the model using a given GPU context.
  * @param gpu The GPU interface to use for drawing commands.
@@ -11,90 +21,384 @@ namespace zabato
  */
 void mesh::render(gpu &gpu, const animator *anim) const
 {
-    const auto primitive_type = get_primitive_type();
+    PROFILE_SCOPE("mesh::render");
+    const bool has_bone = (get_flags() & mesh_flags::bone) != mesh_flags::none;
 
-    gpu.begin(primitive_type);
+    // Skinned meshes are transformed on the CPU each frame, so they bypass the
+    // display list and draw from a per-frame skinned vertex stream instead.
+    if (anim && has_bone)
+    {
+        bind_gpu(gpu);
+        if (!render_skinned(gpu, *anim))
+            render_immediate(gpu, anim);
+        return;
+    }
 
-    const auto final_bone_matrices =
-        anim ? &anim->get_final_bone_matrices() : nullptr;
+    bind_gpu(gpu);
+
+    if (render_cached(gpu) || render_retained(gpu))
+        return;
+
+    render_immediate(gpu, nullptr);
+}
+
+void mesh::render_instanced(gpu &gpu,
+                            const mat4<real> *model_views,
+                            size_t count) const
+{
+    PROFILE_SCOPE("mesh::render_instanced");
+    if (count == 0)
+        return;
+
+    bind_gpu(gpu);
+    if (upload_buffers() &&
+        gpu.draw_instanced(get_primitive_type(),
+                           m_vertex_buffer,
+                           m_index_buffer,
+                           model_views,
+                           count))
+        return;
+
+    gpu.set_matrix_mode(matrix_mode::modelview);
+    gpu.push_matrix();
+    for (size_t i = 0; i < count; ++i)
+    {
+        gpu.load_matrix(model_views[i]);
+        render(gpu);
+    }
+    gpu.pop_matrix();
+}
+
+void mesh::release_buffers() const
+{
+    if (m_display_list)
+    {
+        m_display_list->destroy();
+        delete m_display_list;
+        m_display_list = nullptr;
+    }
 
-    const auto primitive_count = get_primitive_count();
-    const auto flags           = get_flags();
+    if (m_vertex_buffer)
+    {
+        m_vertex_buffer->destroy();
+        delete m_vertex_buffer;
+        m_vertex_buffer = nullptr;
+    }
+
+    if (m_index_buffer)
+    {
+        m_index_buffer->destroy();
+        delete m_index_buffer;
+        m_index_buffer = nullptr;
+    }
+
+    if (m_skinned_buffer)
+    {
+        m_skinned_buffer->destroy();
+        delete m_skinned_buffer;
+        m_skinned_buffer = nullptr;
+    }
+
+    m_buffer_gpu    = nullptr;
+    invalidate_buffers();
+}
+
+/**
+ * @brief Makes sure the retained resources belong to `gpu`, recreating them
+ * if the mesh was last drawn with a different context.
+ */
+void mesh::bind_gpu(gpu &gpu) const
+{
+    // Recording into a command buffer keeps the buffers of its device.
+    class gpu &device = gpu.get_device();
+    if (m_buffer_gpu == &device)
+        return;
+
+    release_buffers();
+    m_buffer_gpu    = &device;
+    m_vertex_buffer = gpu.create_vertex_buffer();
+    m_index_buffer  = gpu.create_index_buffer();
+    if (m_display_list_enabled)
+        m_display_list = gpu.create_display_list();
+    if ((get_flags() & mesh_flags::bone) != mesh_flags::none)
+        m_skinned_buffer = gpu.create_vertex_buffer();
+}
+
+void mesh::update_bounds() const
+{
+    m_bounds = aabb();
+    if (m_stream_caching)
+    {
+        for (const position_t &pos : get_vertex_streams().positions)
+            m_bounds.extend(pos);
+    }
+    else
+    {
+        for (uint16_t i = 0; i < m_vertex_count; ++i)
+        {
+            position_t pos;
+            memcpy(
+                &pos, m_data.data() + i * m_vertex_size, sizeof(position_t));
+            m_bounds.extend(pos);
+        }
+    }
+    m_bounds_dirty = false;
+}
+
+vertex_streams mesh::get_vertex_streams() const
+{
+    if (m_streams_dirty || m_positions.size() != m_vertex_count)
+        update_vertex_streams();
+
+    return vertex_streams{
+        .positions    = m_positions,
+        .normals      = m_normals,
+        .colors       = m_colors,
+        .texcoords    = m_texcoords,
+        .bone_weights = m_bone_weights,
+    };
+}
+
+/**
+ * @brief Splits `m_data` into the vertex streams, one attribute at a time so
+ * every pass writes one array in order.
+ */
+void mesh::update_vertex_streams() const
+{
+    const auto flags      = get_flags();
+    const bool has_normal = (flags & mesh_flags::normal) != mesh_flags::none;
     const bool has_color  = (flags & mesh_flags::color) != mesh_flags::none;
+    const bool has_tex    = (flags & mesh_flags::tex) != mesh_flags::none;
+    const bool has_bone   = (flags & mesh_flags::bone) != mesh_flags::none;
+
+    const size_t count  = m_vertex_count;
+    const uint8_t *data = m_data.data();
+
+    m_positions.resize(count);
+    for (size_t i = 0; i < count; ++i)
+        memcpy(&m_positions[i], data + i * m_vertex_size, sizeof(position_t));
+
+    m_normals.resize(has_normal ? count : 0);
+    for (size_t i = 0; i < m_normals.size(); ++i)
+        memcpy(&m_normals[i],
+               data + i * m_vertex_size + m_normal_offset,
+               sizeof(normal_t));
+
+    m_colors.resize(has_color ? count : 0);
+    for (size_t i = 0; i < m_colors.size(); ++i)
+        memcpy(&m_colors[i],
+               data + i * m_vertex_size + m_color_offset,
+               sizeof(color_t));
+
+    m_texcoords.resize(has_tex ? count : 0);
+    for (size_t i = 0; i < m_texcoords.size(); ++i)
+        memcpy(&m_texcoords[i],
+               data + i * m_vertex_size + m_texcoord_offset,
+               sizeof(texcoord_t));
+
+    m_bone_weights.resize(has_bone ? count * 4 : 0);
+    if (has_bone)
+        for (size_t i = 0; i < count; ++i)
+            memcpy(&m_bone_weights[i * 4],
+                   data + i * m_vertex_size + m_boneweight_offset,
+                   sizeof(boneweight_t));
+
+    m_streams_dirty = false;
+}
+
+void mesh::release_vertex_streams() const
+{
+    m_positions     = {};
+    m_normals       = {};
+    m_colors        = {};
+    m_texcoords     = {};
+    m_bone_weights  = {};
+    m_streams_dirty = true;
+}
+
+vertex_layout mesh::get_vertex_layout() const
+{
+    const auto flags      = get_flags();
     const bool has_normal = (flags & mesh_flags::normal) != mesh_flags::none;
+    const bool has_color  = (flags & mesh_flags::color) != mesh_flags::none;
     const bool has_tex    = (flags & mesh_flags::tex) != mesh_flags::none;
     const bool has_bone   = (flags & mesh_flags::bone) != mesh_flags::none;
 
-    switch (primitive_type)
+    vertex_layout layout;
+    layout.stride = static_cast<uint16_t>(m_vertex_size);
+    if (has_normal)
+        layout.normal_offset = static_cast<int16_t>(m_normal_offset);
+    if (has_color)
+        layout.color_offset = static_cast<int16_t>(m_color_offset);
+    if (has_tex)
+        layout.texcoord_offset = static_cast<int16_t>(m_texcoord_offset);
+    if (has_bone)
+        layout.boneweight_offset =
+            static_cast<int16_t>(m_boneweight_offset);
+    return layout;
+}
+
+size_t mesh::get_gpu_memory_used() const
+{
+    size_t bytes = 0;
+    if (m_vertex_buffer)
+        bytes += m_vertex_buffer->get_vertex_count() * m_vertex_size;
+    if (m_skinned_buffer)
+        bytes += m_skinned_buffer->get_vertex_count() * m_vertex_size;
+    if (m_index_buffer)
+        bytes += m_index_buffer->get_gpu_memory_used();
+    return bytes;
+}
+
+void mesh::add_cost(scene_cost &cost) const
+{
+    resource::add_cost(cost);
+    cost.vertices += m_vertex_count;
+}
+
+/**
+ * @brief Uploads `m_data` and `m_indices` to the retained buffers if they
+ * changed since the last upload.
+ * @return False if the GPU has no retained geometry support.
+ */
+bool mesh::upload_buffers() const
+{
+    if (!m_vertex_buffer || !m_index_buffer)
+        return false;
+
+    if (m_buffers_dirty)
     {
-    case primitive_type::quads:
-        for (size_t i = 0; i < primitive_count; ++i)
-        {
-            quad_primitive primitive = {};
-            get_primitive(i, primitive);
-            for (size_t j = 0; j < 4; ++j)
-            {
-                uint16_t index = primitive.v[j];
-                vertex(has_normal,
-                       has_color,
-                       has_tex,
-                       has_bone,
-                       gpu,
-                       index,
-                       final_bone_matrices);
-            }
-        }
-        break;
-    case primitive_type::triangles:
-        for (size_t i = 0; i < primitive_count; ++i)
-        {
-            triangle_primitive primitive = {};
-            get_primitive(i, primitive);
-            for (size_t j = 0; j < 3; ++j)
-            {
-                uint16_t index = primitive.v[j];
-                vertex(has_normal,
-                       has_color,
-                       has_tex,
-                       has_bone,
-                       gpu,
-                       index,
-                       final_bone_matrices);
-            }
-        }
-        break;
-    case primitive_type::points:
-        for (size_t i = 0; i < primitive_count; ++i)
-        {
-            point_primitive primitive = {};
-            get_primitive(i, primitive);
-            uint16_t index = primitive.v;
+        m_vertex_buffer->load(
+            get_vertex_layout(), m_vertex_count, m_data.data());
+        m_index_buffer->load(m_indices.size(), m_indices.data());
+        m_buffers_dirty = false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Draws the mesh from retained GPU buffers, uploading `m_data` and
+ * `m_indices` first if they changed since the last upload.
+ * @return False if the GPU has no retained geometry support, in which case
+ * the caller must fall back to immediate mode.
+ */
+bool mesh::render_retained(gpu &gpu) const
+{
+    if (!upload_buffers())
+        return false;
+
+    gpu.draw_indexed(get_primitive_type(), m_vertex_buffer, m_index_buffer);
+    return true;
+}
+
+/**
+ * @brief Replays the cached display list, compiling it first if the mesh
+ * changed since it was last recorded.
+ * @return False if display list caching is disabled or unavailable.
+ */
+bool mesh::render_cached(gpu &gpu) const
+{
+    if (!m_display_list)
+        return false;
+
+    if (m_display_list_dirty)
+    {
+        gpu.begin_display_list(m_display_list);
+        if (!render_retained(gpu))
+            render_immediate(gpu, nullptr);
+        gpu.end_display_list();
+        m_display_list_dirty = false;
+    }
+
+    gpu.call_display_list(m_display_list);
+    return true;
+}
+
+/**
+ * @brief Draws the mesh posed by the animator's bone palette. The GPU blends
+ * the vertices when the backend supports it, otherwise the whole mesh is
+ * skinned on the CPU in one batched pass and drawn with a single call.
+ * @return False if the GPU has no retained geometry support.
+ */
+bool mesh::render_skinned(gpu &gpu, const animator &anim) const
+{
+    if (!upload_buffers())
+        return false;
+
+    // Prefer blending on the GPU straight from the bind-pose buffer.
+    const auto &palette = anim.get_final_bone_matrices();
+    if (gpu.draw_skinned(get_primitive_type(),
+                         m_vertex_buffer,
+                         m_index_buffer,
+                         palette.data(),
+                         palette.size()))
+        return true;
+
+    if (!m_skinned_buffer)
+        return false;
+
+    // Attributes other than position and normal are never touched by the
+    // skinning pass, so they only need copying after the mesh changes.
+    if (m_skinned_dirty || m_skinned_data.size() != m_data.size())
+    {
+        m_skinned_data  = m_data;
+        m_skinned_dirty = false;
+    }
+
+    const bool has_normal =
+        (get_flags() & mesh_flags::normal) != mesh_flags::none;
+
+    skinning_stream stream;
+    stream.source            = m_data.data();
+    stream.destination       = m_skinned_data.data();
+    stream.vertex_count      = m_vertex_count;
+    stream.stride            = m_vertex_size;
+    stream.normal_offset     = has_normal ? ptrdiff_t(m_normal_offset) : -1;
+    stream.boneweight_offset = m_boneweight_offset;
+
+    skin_vertices(stream, palette.data(), palette.size());
+
+    m_skinned_buffer->load(
+        get_vertex_layout(), m_vertex_count, m_skinned_data.data());
+    gpu.draw_indexed(get_primitive_type(), m_skinned_buffer, m_index_buffer);
+    return true;
+}
+
+void mesh::render_immediate(gpu &gpu, const animator *anim) const
+{
+    const auto final_bone_matrices =
+        anim ? &anim->get_final_bone_matrices() : nullptr;
+
+    // Every primitive type submits its indices in order.
+    const size_t index_count =
+        size_t(get_primitive_count()) * get_index_count_per_primitive();
+
+    gpu.begin(get_primitive_type());
+    if (m_stream_caching)
+    {
+        const vertex_streams streams = get_vertex_streams();
+        for (size_t i = 0; i < index_count; ++i)
+            vertex(streams, gpu, m_indices[i], final_bone_matrices);
+    }
+    else
+    {
+        const auto flags = get_flags();
+        const bool has_color =
+            (flags & mesh_flags::color) != mesh_flags::none;
+        const bool has_normal =
+            (flags & mesh_flags::normal) != mesh_flags::none;
+        const bool has_tex  = (flags & mesh_flags::tex) != mesh_flags::none;
+        const bool has_bone = (flags & mesh_flags::bone) != mesh_flags::none;
+
+        for (size_t i = 0; i < index_count; ++i)
             vertex(has_normal,
                    has_color,
                    has_tex,
                    has_bone,
                    gpu,
-                   index,
+                   m_indices[i],
                    final_bone_matrices);
-        }
-    case primitive_type::lines:
-        for (size_t i = 0; i < primitive_count; ++i)
-        {
-            line_primitive primitive = {};
-            get_primitive(i, primitive);
-            for (size_t j = 0; j < 2; ++j)
-            {
-                uint16_t index = primitive.v[j];
-                vertex(has_normal,
-                       has_color,
-                       has_tex,
-                       has_bone,
-                       gpu,
-                       index,
-                       final_bone_matrices);
-            }
-        }
-        break;
     }
     gpu.end();
 }
@@ -85,6 +85,48 @@ pointer<spatial> node::set_child_at(int index, spatial *child)
     return nullptr;
 }
 
+void node::mark_world_dirty()
+{
+    if (is_world_dirty)
+        return;
+
+    spatial::mark_world_dirty();
+    for (const auto &child : m_children)
+        if (child)
+            child->mark_world_dirty();
+}
+
+void node::collect_visible(const frustum &f,
+                           uint32_t mask,
+                           vector<spatial *> &visible)
+{
+    // Once inside every plane, the subtree is drawn without more tests.
+    if (mask && f.test(get_world_bound(), mask) == cull_result::outside)
+        return;
+
+    if (!m_model_bound.is_empty())
+        visible.push_back(this);
+    for (const auto &child : m_children)
+        if (child)
+            child->collect_visible(f, mask, visible);
+}
+
+int node::get_memory_used() const
+{
+    size_t bytes = sizeof(node) - sizeof(spatial);
+    if (m_children.capacity() > m_children.inline_capacity)
+        bytes += m_children.capacity() * sizeof(pointer<spatial>);
+    return spatial::get_memory_used() + (int)bytes;
+}
+
+void node::update_world_bound()
+{
+    spatial::update_world_bound();
+    for (const auto &child : m_children)
+        if (child)
+            m_world_bound.merge(child->get_world_bound());
+}
+
 void node::save_xml(xml_serializer &serializer, tinyxml2::XMLElement &el) const
 {
     spatial::save_xml(serializer, el);
@@ -0,0 +1,253 @@
+#include <zabato/null_gpu.hpp>
+
+namespace zabato
+{
+namespace
+{
+class null_texture : public texture
+{
+public:
+    null_texture(uint16_t width, uint16_t height, color_format format)
+        : m_size(width, height), m_format(format)
+    {
+    }
+
+    void destroy() override {}
+    vec2<uint16_t> get_size() const override { return m_size; }
+
+    void load(uint16_t width,
+              uint16_t height,
+              color_format format,
+              size_t data_size,
+              const void *data) override
+    {
+        m_size   = {width, height};
+        m_format = format;
+    }
+
+    void copy(uint16_t *width,
+              uint16_t *height,
+              color_format *format,
+              void *pixel_data,
+              size_t *size) const override
+    {
+        *width  = m_size.x;
+        *height = m_size.y;
+        *format = m_format;
+        *size   = 0;
+    }
+
+    color8888 sample8888(uint8_t u, uint8_t v) const override { return {}; }
+    color_format get_format() const override { return m_format; }
+
+private:
+    vec2<uint16_t> m_size;
+    color_format m_format;
+};
+
+class null_display_list : public display_list
+{
+public:
+    void destroy() override {}
+};
+
+class null_vertex_buffer : public vertex_buffer
+{
+public:
+    void destroy() override { m_vertex_count = 0; }
+
+    void load(const vertex_layout &layout,
+              size_t vertex_count,
+              const void *data) override
+    {
+        m_vertex_count = vertex_count;
+    }
+
+    size_t get_vertex_count() const override { return m_vertex_count; }
+
+private:
+    size_t m_vertex_count = 0;
+};
+
+class null_index_buffer : public index_buffer
+{
+public:
+    void destroy() override { m_index_count = 0; }
+
+    void load(size_t index_count, const uint16_t *indices) override
+    {
+        m_index_count = index_count;
+    }
+
+    size_t get_index_count() const override { return m_index_count; }
+
+private:
+    size_t m_index_count = 0;
+};
+} // namespace
+
+const char *get_gpu_call_name(gpu_call call)
+{
+    static const char *const names[] = {
+    "new_frame",
+    "begin",
+    "end",
+    "vertex",
+    "color",
+    "normal",
+    "tex_coord",
+    "clear",
+    "viewport",
+    "set_matrix_mode",
+    "perspective_fov",
+    "ortho",
+    "translate",
+    "rotate",
+    "scale",
+    "load_identity",
+    "load_matrix",
+    "push_matrix",
+    "pop_matrix",
+    "set_shade_model",
+    "enable_lighting",
+    "set_light",
+    "set_material",
+    "create_texture",
+    "bind_texture",
+    "unbind_texture",
+    "create_display_list",
+    "begin_display_list",
+    "end_display_list",
+    "call_display_list",
+    "create_vertex_buffer",
+    "create_index_buffer",
+    "draw_indexed",
+    "draw_indexed_range",
+    "draw_skinned",
+    "draw_instanced",
+    "begin_timing",
+    "end_timing",
+    "enable_fog",
+    "set_fog_start",
+    "set_fog_end",
+    "set_fog_color",
+    "enable_depth_test",
+    "enable_blend",
+    "set_blend_func",
+    "enable_scissor_test",
+    "set_scissor",
+    "set_viewport_rect",
+    };
+    static_assert(sizeof(names) / sizeof(names[0]) == size_t(gpu_call::count));
+    return call < gpu_call::count ? names[size_t(call)] : "unknown";
+}
+
+void null_gpu::new_frame()
+{
+    count_call(gpu_call::new_frame);
+    m_frame_stats = {};
+}
+
+void null_gpu::begin(primitive_type type) { count_draw(gpu_call::begin, 0); }
+
+void null_gpu::vertex(const vec3<real> &v)
+{
+    count_call(gpu_call::vertex);
+    ++m_frame_stats.vertices;
+}
+
+void null_gpu::vertex(real x, real y, real z)
+{
+    count_call(gpu_call::vertex);
+    ++m_frame_stats.vertices;
+}
+
+texture *
+null_gpu::create_texture(uint16_t width, uint16_t height, color_format format)
+{
+    count_call(gpu_call::create_texture);
+    return new null_texture(width, height, format);
+}
+
+void null_gpu::bind_texture(texture *tex)
+{
+    count_call(gpu_call::bind_texture);
+    if (tex != m_bound_texture)
+    {
+        m_bound_texture = tex;
+        ++m_frame_stats.texture_binds;
+    }
+}
+
+void null_gpu::unbind_texture()
+{
+    count_call(gpu_call::unbind_texture);
+    m_bound_texture = nullptr;
+}
+
+display_list *null_gpu::create_display_list()
+{
+    count_call(gpu_call::create_display_list);
+    return new null_display_list();
+}
+
+void null_gpu::call_display_list(const display_list *list)
+{
+    count_draw(gpu_call::call_display_list, 0);
+}
+
+vertex_buffer *null_gpu::create_vertex_buffer()
+{
+    count_call(gpu_call::create_vertex_buffer);
+    return new null_vertex_buffer();
+}
+
+index_buffer *null_gpu::create_index_buffer()
+{
+    count_call(gpu_call::create_index_buffer);
+    return new null_index_buffer();
+}
+
+void null_gpu::draw_indexed(primitive_type type,
+                            const vertex_buffer *vertices,
+                            const index_buffer *indices)
+{
+    count_draw(gpu_call::draw_indexed, indices->get_index_count());
+}
+
+void null_gpu::draw_indexed_range(primitive_type type,
+                                  const vertex_buffer *vertices,
+                                  const index_buffer *indices,
+                                  size_t first_index,
+                                  size_t index_count)
+{
+    count_draw(gpu_call::draw_indexed_range, index_count);
+}
+
+bool null_gpu::draw_skinned(primitive_type type,
+                            const vertex_buffer *vertices,
+                            const index_buffer *indices,
+                            const mat4<real> *palette,
+                            size_t palette_size)
+{
+    count_draw(gpu_call::draw_skinned, indices->get_index_count());
+    return true;
+}
+
+bool null_gpu::draw_instanced(primitive_type type,
+                              const vertex_buffer *vertices,
+                              const index_buffer *indices,
+                              const mat4<real> *model_views,
+                              size_t count)
+{
+    count_draw(gpu_call::draw_instanced, count * indices->get_index_count());
+    return true;
+}
+
+void null_gpu::count_draw(gpu_call call, size_t vertices)
+{
+    count_call(call);
+    ++m_frame_stats.draw_calls;
+    m_frame_stats.vertices += vertices;
+}
+} // namespace zabato
@@ -1,8 +1,11 @@
 #include <stdio.h>
+#include <string.h>
 #include <tinyxml2.h>
 #include <zabato/controller.hpp>
 #include <zabato/hash_map.hpp>
+#include <zabato/node.hpp>
 #include <zabato/object.hpp>
+#include <zabato/object_registry.hpp>
 #include <zabato/serializer.hpp>
 #include <zabato/stream.hpp>
 #include <zabato/string_tree.hpp>
@@ -14,14 +17,20 @@ namespace zabato
 {
 
 const rtti object::TYPE("zabato.object", nullptr);
-hash_map<uuid, object *> object::s_in_use;
-hash_map<string, object::factory_function> *object::s_factory         = nullptr;
-hash_map<string, object::factory_function_xml> *object::s_factory_xml = nullptr;
+object::factory_map<object::factory_function> *object::s_factory = nullptr;
+object::factory_map<object::factory_function_xml> *object::s_factory_xml =
+    nullptr;
+object::factory_map<object::create_function> *object::s_factory_create =
+    nullptr;
 
-object::object() : m_name(nullptr), m_uiID(uuid::generate()), m_uiRefCount(0) {}
+object::object() : m_name(nullptr), m_uiID(uuid::generate()), m_uiRefCount(0)
+{
+    m_handle = get_registry().add(this, m_uiID, nullptr);
+}
 
 object::~object()
 {
+    get_registry().remove(m_handle, m_uiID, m_name);
     if (m_name)
         release_symbol(m_name);
 }
@@ -36,11 +45,17 @@ bool object::register_factory()
 void object::initialize_factory()
 {
     if (!s_factory)
-        s_factory = new hash_map<string, factory_function>(FACTORY_MAP_SIZE);
+        s_factory = new factory_map<factory_function>(FACTORY_MAP_SIZE);
 
     if (!s_factory_xml)
-        s_factory_xml =
-            new hash_map<string, factory_function_xml>(FACTORY_MAP_SIZE);
+        s_factory_xml = new factory_map<factory_function_xml>(FACTORY_MAP_SIZE);
+
+    if (!s_factory_create)
+    {
+        s_factory_create = new factory_map<create_function>(FACTORY_MAP_SIZE);
+        s_factory_create->add(node::TYPE.name_symbol(),
+                              []() -> object * { return new node(); });
+    }
 }
 
 void object::terminate_factory()
@@ -56,6 +71,12 @@ void object::terminate_factory()
         delete s_factory_xml;
         s_factory_xml = nullptr;
     }
+
+    if (s_factory_create)
+    {
+        delete s_factory_create;
+        s_factory_create = nullptr;
+    }
 }
 
 object *object::factory(serializer &stream)
@@ -75,7 +96,8 @@ object *object::factory(serializer &stream)
     // 1. Instantiating the specific class (e.g., via new).
     // 2. invoking the Load() method to populate the object from the stream.
     // Note that the RTTI name has already been consumed by this dispatcher.
-    if (s_factory->try_get_value(name, pFunc))
+    const symbol *type = find_symbol(name.c_str());
+    if (type && s_factory->try_get_value(type, pFunc))
         return (*pFunc)(stream);
 
     // If the class is not registered in the factory map, return nullptr.
@@ -89,13 +111,22 @@ object *object::factory(xml_serializer &serializer, tinyxml2::XMLElement &el)
     if (!s_factory)
         return nullptr;
 
-    string name                = el.Name();
+    const symbol *type         = find_symbol(el.Name());
     factory_function_xml pFunc = nullptr;
-    if (s_factory_xml->try_get_value(name, pFunc))
+    if (type && s_factory_xml->try_get_value(type, pFunc))
         return (*pFunc)(serializer, el);
     return nullptr;
 }
 
+object::create_function object::find_create_function(const char *type_name)
+{
+    create_function pFunc = nullptr;
+    const symbol *type    = find_symbol(type_name);
+    if (s_factory_create && type)
+        s_factory_create->try_get_value(type, pFunc);
+    return pFunc;
+}
+
 bool object::register_object(serializer &stream) const
 {
     object *pkThis = (object *)this;
@@ -110,7 +141,7 @@ bool object::register_object(serializer &stream) const
 void object::save(serializer &stream) const
 {
     stream.write(string(type().name()));
-    stream.write((object *)this);
+    stream.write((const object *)this);
 
     string n = name();
     stream.write(n);
@@ -200,7 +231,7 @@ void object::save_xml(xml_serializer &serializer,
             el.InsertNewChildElement("controllers");
         for (auto &ctrl : m_controllers)
         {
-            rtti type = ctrl->type();
+            const rtti &type = ctrl->type();
             tinyxml2::XMLElement *controller =
                 controllers->InsertNewChildElement(type.name());
             ctrl->save_xml(serializer, *controller);
@@ -229,9 +260,28 @@ void object::link(xml_serializer &serializer, tinyxml2::XMLElement &el)
     }
 }
 
-int object::get_memory_used() const { return sizeof(*this); }
+int object::get_memory_used() const
+{
+    size_t bytes = sizeof(object);
+    if (m_controllers.capacity() > controller_list::inline_capacity)
+        bytes += m_controllers.capacity() * sizeof(pointer<controller>);
+    return (int)bytes;
+}
+
+int object::get_disk_used() const
+{
+    // The type name and the name, each after its length, the id and the
+    // link count.
+    return (int)(sizeof(ice_int32_t) + strlen(type().name()) +
+                 sizeof(const object *) + sizeof(ice_int32_t) +
+                 strlen(name()) + sizeof(int));
+}
 
-int object::get_disk_used() const { return 0; }
+void object::add_cost(scene_cost &cost) const
+{
+    cost.memory += (size_t)get_memory_used();
+    cost.disk += (size_t)get_disk_used();
+}
 
 object *object::clone(resource_manager &manager) const
 {
@@ -261,9 +311,11 @@ void object::save_strings(string_tree *tree)
 
 void object::set_name(const char *name)
 {
-    if (m_name)
-        release_symbol(m_name);
-    m_name = get_symbol(name);
+    symbol *old = m_name;
+    m_name      = get_symbol(name);
+    get_registry().rename(m_handle, old, m_name);
+    if (old)
+        release_symbol(old);
 }
 
 void object::add_controller(pointer<controller> ctrl)
@@ -324,12 +376,28 @@ void object::get_controllers(const rtti &type,
 
 void object::set_name(symbol *name)
 {
-    if (m_name)
-        release_symbol(m_name);
+    if (name)
+        ref_symbol(name);
 
-    m_name = name;
-    if (m_name)
-        ref_symbol(m_name);
+    symbol *old = m_name;
+    m_name      = name;
+    get_registry().rename(m_handle, old, m_name);
+    if (old)
+        release_symbol(old);
+}
+
+void object::set_id(uuid id)
+{
+    get_registry().change_id(m_handle, m_uiID, id);
+    m_uiID = id;
+}
+
+object_registry &object::get_registry()
+{
+    // Created on first use, so objects constructed during static
+    // initialization of other translation units still find it.
+    static object_registry registry;
+    return registry;
 }
 
 const char *object::name() const
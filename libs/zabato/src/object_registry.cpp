@@ -0,0 +1,164 @@
+#include <zabato/object_registry.hpp>
+
+namespace zabato
+{
+pool_handle object_registry::add(object *obj, uuid id, const symbol *name)
+{
+    lock_guard lock(m_mutex);
+
+    uint32_t index = m_free_head;
+    if (index != end_of_list)
+        m_free_head = m_slots[index].prev_name;
+    else if (m_slots.size() < max_size)
+    {
+        index = (uint32_t)m_slots.size();
+        m_slots.push_back(slot());
+    }
+    else
+        return {};
+
+    slot &s     = m_slots[index];
+    s.obj       = obj;
+    s.prev_name = end_of_list;
+    s.next_name = end_of_list;
+    ++m_count;
+
+    m_by_id.add(id, index);
+    if (name)
+        link_name(index, name);
+    return {(s.generation << pool_handle::index_bits) | index};
+}
+
+void object_registry::remove(pool_handle handle, uuid id, const symbol *name)
+{
+    lock_guard lock(m_mutex);
+
+    const uint32_t index = index_of(handle);
+    if (index == end_of_list)
+        return;
+
+    uint32_t indexed = end_of_list;
+    if (m_by_id.try_get_value(id, indexed) && indexed == index)
+        m_by_id.erase(id);
+    if (name)
+        unlink_name(index, name);
+
+    slot &s      = m_slots[index];
+    s.obj        = nullptr;
+    s.generation = s.generation == max_generation ? 1 : s.generation + 1;
+    s.prev_name  = m_free_head;
+    m_free_head  = index;
+    --m_count;
+}
+
+void object_registry::rename(pool_handle handle,
+                             const symbol *from,
+                             const symbol *to)
+{
+    lock_guard lock(m_mutex);
+
+    const uint32_t index = index_of(handle);
+    if (index == end_of_list || from == to)
+        return;
+
+    if (from)
+        unlink_name(index, from);
+    if (to)
+        link_name(index, to);
+}
+
+void object_registry::change_id(pool_handle handle, uuid from, uuid to)
+{
+    lock_guard lock(m_mutex);
+
+    const uint32_t index = index_of(handle);
+    if (index == end_of_list || from == to)
+        return;
+
+    uint32_t indexed = end_of_list;
+    if (m_by_id.try_get_value(from, indexed) && indexed == index)
+        m_by_id.erase(from);
+    m_by_id.add(to, index);
+}
+
+object *object_registry::find(pool_handle handle) const
+{
+    lock_guard lock(m_mutex);
+
+    const uint32_t index = index_of(handle);
+    return index != end_of_list ? m_slots[index].obj : nullptr;
+}
+
+object *object_registry::find(uuid id) const
+{
+    lock_guard lock(m_mutex);
+
+    uint32_t index = end_of_list;
+    return m_by_id.try_get_value(id, index) ? m_slots[index].obj : nullptr;
+}
+
+object *object_registry::find_by_name(const symbol *name) const
+{
+    lock_guard lock(m_mutex);
+
+    uint32_t index = end_of_list;
+    return m_by_name.try_get_value(name, index) ? m_slots[index].obj : nullptr;
+}
+
+void object_registry::find_all_by_name(const symbol *name,
+                                       vector<object *> &objects) const
+{
+    lock_guard lock(m_mutex);
+
+    uint32_t index = end_of_list;
+    m_by_name.try_get_value(name, index);
+    for (; index != end_of_list; index = m_slots[index].next_name)
+        objects.push_back(m_slots[index].obj);
+}
+
+size_t object_registry::size() const
+{
+    lock_guard lock(m_mutex);
+    return m_count;
+}
+
+uint32_t object_registry::index_of(pool_handle handle) const
+{
+    const uint32_t index = handle.get_index();
+    if (!handle || index >= m_slots.size() || !m_slots[index].obj ||
+        m_slots[index].generation != handle.get_generation())
+        return end_of_list;
+    return index;
+}
+
+void object_registry::link_name(uint32_t index, const symbol *name)
+{
+    uint32_t *head = m_by_name.find(name);
+    if (!head)
+    {
+        m_by_name.add(name, index);
+        return;
+    }
+
+    m_slots[index].next_name = *head;
+    m_slots[*head].prev_name = index;
+    *head                    = index;
+}
+
+void object_registry::unlink_name(uint32_t index, const symbol *name)
+{
+    slot &s = m_slots[index];
+    if (s.next_name != end_of_list)
+        m_slots[s.next_name].prev_name = s.prev_name;
+
+    if (s.prev_name != end_of_list)
+        m_slots[s.prev_name].next_name = s.next_name;
+    else if (s.next_name != end_of_list)
+        m_by_name.set(name, s.next_name);
+    else
+        m_by_name.erase(name);
+
+    s.prev_name = end_of_list;
+    s.next_name = end_of_list;
+}
+} // namespace zabato
@@ -0,0 +1,491 @@
+#include <zabato/ray_batch.hpp>
+
+#include <math.h>
+
+#if defined(__SSE__) || defined(_M_X64) ||                                     \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define ZABATO_RAY_BATCH_SSE
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+#include <arm_neon.h>
+#define ZABATO_RAY_BATCH_NEON
+#endif
+
+namespace zabato
+{
+namespace
+{
+#pragma region 4-wide helpers
+
+#if defined(ZABATO_RAY_BATCH_SSE)
+using float4 = __m128;
+using mask4  = __m128;
+
+inline float4 load4(const float *p) { return _mm_loadu_ps(p); }
+inline float4 set4(float s) { return _mm_set1_ps(s); }
+inline void store4(float *p, float4 v) { _mm_storeu_ps(p, v); }
+inline float4 add4(float4 a, float4 b) { return _mm_add_ps(a, b); }
+inline float4 sub4(float4 a, float4 b) { return _mm_sub_ps(a, b); }
+inline float4 mul4(float4 a, float4 b) { return _mm_mul_ps(a, b); }
+inline float4 min4(float4 a, float4 b) { return _mm_min_ps(a, b); }
+inline float4 max4(float4 a, float4 b) { return _mm_max_ps(a, b); }
+inline float4 sqrt4(float4 a) { return _mm_sqrt_ps(a); }
+inline mask4 le4(float4 a, float4 b) { return _mm_cmple_ps(a, b); }
+inline mask4 lt4(float4 a, float4 b) { return _mm_cmplt_ps(a, b); }
+inline mask4 and4(mask4 a, mask4 b) { return _mm_and_ps(a, b); }
+inline mask4 or4(mask4 a, mask4 b) { return _mm_or_ps(a, b); }
+inline int bits4(mask4 m) { return _mm_movemask_ps(m); }
+#elif defined(ZABATO_RAY_BATCH_NEON)
+using float4 = float32x4_t;
+using mask4  = uint32x4_t;
+
+inline float4 load4(const float *p) { return vld1q_f32(p); }
+inline float4 set4(float s) { return vdupq_n_f32(s); }
+inline void store4(float *p, float4 v) { vst1q_f32(p, v); }
+inline float4 add4(float4 a, float4 b) { return vaddq_f32(a, b); }
+inline float4 sub4(float4 a, float4 b) { return vsubq_f32(a, b); }
+inline float4 mul4(float4 a, float4 b) { return vmulq_f32(a, b); }
+inline float4 min4(float4 a, float4 b) { return vminq_f32(a, b); }
+inline float4 max4(float4 a, float4 b) { return vmaxq_f32(a, b); }
+inline float4 sqrt4(float4 a) { return vsqrtq_f32(a); }
+inline mask4 le4(float4 a, float4 b) { return vcleq_f32(a, b); }
+inline mask4 lt4(float4 a, float4 b) { return vcltq_f32(a, b); }
+inline mask4 and4(mask4 a, mask4 b) { return vandq_u32(a, b); }
+inline mask4 or4(mask4 a, mask4 b) { return vorrq_u32(a, b); }
+inline int bits4(mask4 m)
+{
+    uint32_t lanes[4];
+    vst1q_u32(lanes, m);
+    return (lanes[0] & 1) | (lanes[1] & 2) | (lanes[2] & 4) | (lanes[3] & 8);
+}
+#else
+struct float4
+{
+    float v[4];
+};
+using mask4 = int; ///< One bit per lane.
+
+template <typename F> inline float4 map4(float4 a, float4 b, F f)
+{
+    for (int i = 0; i < 4; ++i)
+        a.v[i] = f(a.v[i], b.v[i]);
+    return a;
+}
+
+template <typename F> inline mask4 compare4(float4 a, float4 b, F f)
+{
+    mask4 m = 0;
+    for (int i = 0; i < 4; ++i)
+        m |= f(a.v[i], b.v[i]) ? 1 << i : 0;
+    return m;
+}
+
+inline float4 load4(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline float4 set4(float s) { return {{s, s, s, s}}; }
+inline void store4(float *p, float4 v)
+{
+    for (int i = 0; i < 4; ++i)
+        p[i] = v.v[i];
+}
+inline float4 add4(float4 a, float4 b)
+{
+    return map4(a, b, [](float x, float y) { return x + y; });
+}
+inline float4 sub4(float4 a, float4 b)
+{
+    return map4(a, b, [](float x, float y) { return x - y; });
+}
+inline float4 mul4(float4 a, float4 b)
+{
+    return map4(a, b, [](float x, float y) { return x * y; });
+}
+inline float4 min4(float4 a, float4 b)
+{
+    return map4(a, b, [](float x, float y) { return x < y ? x : y; });
+}
+inline float4 max4(float4 a, float4 b)
+{
+    return map4(a, b, [](float x, float y) { return x > y ? x : y; });
+}
+inline float4 sqrt4(float4 a)
+{
+    for (int i = 0; i < 4; ++i)
+        a.v[i] = sqrtf(a.v[i]);
+    return a;
+}
+inline mask4 le4(float4 a, float4 b)
+{
+    return compare4(a, b, [](float x, float y) { return x <= y; });
+}
+inline mask4 lt4(float4 a, float4 b)
+{
+    return compare4(a, b, [](float x, float y) { return x < y; });
+}
+inline mask4 and4(mask4 a, mask4 b) { return a & b; }
+inline mask4 or4(mask4 a, mask4 b) { return a | b; }
+inline int bits4(mask4 m) { return m; }
+#endif
+
+#pragma endregion
+
+/** @brief A ray broadcast across the four lanes of a block. */
+struct packet_ray
+{
+    float4 origin_x, origin_y;
+    float4 dir_x, dir_y;
+    float4 inv_x, inv_y; ///< Reciprocal direction, kept finite.
+    float4 max_t;
+};
+
+/** @brief 1 / d, with zero clamped to a tiny value so slabs never see NaN. */
+inline float slab_inverse(float d)
+{
+    const float tiny = 1e-20f;
+    if (fabsf(d) < tiny)
+        d = d < 0 ? -tiny : tiny;
+    return 1.0f / d;
+}
+
+packet_ray
+prepare_ray(vec2<real> origin, vec2<real> direction, real max_distance)
+{
+    packet_ray ray;
+    ray.origin_x = set4(float(origin.x));
+    ray.origin_y = set4(float(origin.y));
+    ray.dir_x    = set4(float(direction.x));
+    ray.dir_y    = set4(float(direction.y));
+    ray.inv_x    = set4(slab_inverse(float(direction.x)));
+    ray.inv_y    = set4(slab_inverse(float(direction.y)));
+    ray.max_t    = set4(float(max_distance));
+    return ray;
+}
+
+/** @return The bits of the lanes holding one of `remaining` shapes. */
+inline int lane_bits(size_t remaining)
+{
+    return remaining >= 4 ? 0xF : (1 << remaining) - 1;
+}
+
+/**
+ * @brief Quadratic test of a ray against four circles, the same as the scalar
+ * `ray_vs_circle`: a ray starting inside a circle hits it at distance 0.
+ * @param[out] t The entry distance of each lane.
+ * @return The bits of the lanes hit closer than the ray's limit.
+ */
+inline int hit_circles(const packet_ray &ray,
+                       const float *x,
+                       const float *y,
+                       const float *radius_sq,
+                       float4 &t)
+{
+    const float4 zero = set4(0.0f);
+
+    float4 oc_x = sub4(ray.origin_x, load4(x));
+    float4 oc_y = sub4(ray.origin_y, load4(y));
+    float4 b    = add4(mul4(oc_x, ray.dir_x), mul4(oc_y, ray.dir_y));
+    float4 c    = sub4(add4(mul4(oc_x, oc_x), mul4(oc_y, oc_y)),
+                    load4(radius_sq));
+    float4 disc = sub4(mul4(b, b), c);
+
+    t = max4(zero, sub4(sub4(zero, b), sqrt4(max4(disc, zero))));
+
+    // Outside and facing away, no real root, or past the limit.
+    mask4 hit = and4(le4(zero, disc), or4(le4(c, zero), le4(b, zero)));
+    return bits4(and4(hit, lt4(t, ray.max_t)));
+}
+
+/**
+ * @brief Slab test of a ray against four boxes, the same as the scalar
+ * `ray_vs_rectr`: a ray starting inside a box does not hit it.
+ * @param[out] t The entry distance of each lane.
+ * @return The bits of the lanes hit closer than the ray's limit.
+ */
+inline int hit_rects(const packet_ray &ray,
+                     const float *min_x,
+                     const float *min_y,
+                     const float *max_x,
+                     const float *max_y,
+                     float4 &t)
+{
+    float4 tx1 = mul4(sub4(load4(min_x), ray.origin_x), ray.inv_x);
+    float4 tx2 = mul4(sub4(load4(max_x), ray.origin_x), ray.inv_x);
+    float4 ty1 = mul4(sub4(load4(min_y), ray.origin_y), ray.inv_y);
+    float4 ty2 = mul4(sub4(load4(max_y), ray.origin_y), ray.inv_y);
+
+    t = max4(min4(tx1, tx2), min4(ty1, ty2));
+    float4 t_far = min4(max4(tx1, tx2), max4(ty1, ty2));
+
+    mask4 hit = and4(le4(t, t_far), le4(set4(0.0f), t));
+    return bits4(and4(hit, lt4(t, ray.max_t)));
+}
+
+/** @brief Keeps the closest of the lanes set in `hits`. */
+inline void closest_lane(int hits,
+                         float4 t,
+                         const collision_shape *const *shapes,
+                         float &best_t,
+                         const collision_shape *&best)
+{
+    float lanes[4];
+    store4(lanes, t);
+    for (int lane = 0; lane < 4; ++lane)
+    {
+        if ((hits & (1 << lane)) && lanes[lane] < best_t)
+        {
+            best_t = lanes[lane];
+            best   = shapes[lane];
+        }
+    }
+}
+
+/** @brief Clears the lanes of `hits` that hold `ignore`. */
+inline int drop_lane(int hits,
+                     const collision_shape *const *shapes,
+                     const collision_shape *ignore)
+{
+    for (int lane = 0; lane < 4; ++lane)
+        if ((hits & (1 << lane)) && shapes[lane] == ignore)
+            hits &= ~(1 << lane);
+    return hits;
+}
+
+/** @brief Grows SoA lanes to hold `count` shapes, in blocks of four. */
+inline void pad_lanes(vector<float> &lanes, size_t count)
+{
+    lanes.resize((count + 3) & ~size_t(3), 0.0f);
+}
+} // namespace
+
+#pragma region ray_obstacle_set
+
+void ray_obstacle_set::clear()
+{
+    m_circle_x.clear();
+    m_circle_y.clear();
+    m_circle_radius_sq.clear();
+    m_circles.clear();
+
+    m_rect_min_x.clear();
+    m_rect_min_y.clear();
+    m_rect_max_x.clear();
+    m_rect_max_y.clear();
+    m_rects.clear();
+
+    m_others.clear();
+}
+
+void ray_obstacle_set::add(const collision_shape *shape)
+{
+    switch (shape->get_type())
+    {
+    case collision_type::circle:
+    {
+        const auto &circle = *static_cast<const circle_shape *>(shape);
+        const size_t index = m_circles.size();
+        m_circles.push_back(shape);
+        pad_lanes(m_circle_x, m_circles.size());
+        pad_lanes(m_circle_y, m_circles.size());
+        pad_lanes(m_circle_radius_sq, m_circles.size());
+        m_circle_x[index]         = float(circle.position.x);
+        m_circle_y[index]         = float(circle.position.y);
+        m_circle_radius_sq[index] = float(circle.radius * circle.radius);
+        break;
+    }
+    case collision_type::rect:
+    {
+        const auto &rect    = *static_cast<const rect_shape *>(shape);
+        const size_t index  = m_rects.size();
+        vec2<real> half     = rect.size * 0.5;
+        m_rects.push_back(shape);
+        pad_lanes(m_rect_min_x, m_rects.size());
+        pad_lanes(m_rect_min_y, m_rects.size());
+        pad_lanes(m_rect_max_x, m_rects.size());
+        pad_lanes(m_rect_max_y, m_rects.size());
+        m_rect_min_x[index] = float(rect.position.x - half.x);
+        m_rect_min_y[index] = float(rect.position.y - half.y);
+        m_rect_max_x[index] = float(rect.position.x + half.x);
+        m_rect_max_y[index] = float(rect.position.y + half.y);
+        break;
+    }
+    default:
+        m_others.push_back(shape);
+        break;
+    }
+}
+
+void ray_obstacle_set::assign(const vector<const collision_shape *> &shapes,
+                              const collision_shape *exclude)
+{
+    clear();
+    for (const collision_shape *shape : shapes)
+        if (shape != exclude)
+            add(shape);
+}
+
+raycast_result ray_obstacle_set::raycast(vec2<real> origin,
+                                         vec2<real> direction,
+                                         real max_distance) const
+{
+    raycast_result final_result;
+    final_result.distance = max_distance;
+    final_result.hit      = false;
+
+    const vec2<real> norm_dir = normalize(direction);
+    const packet_ray ray      = prepare_ray(origin, norm_dir, max_distance);
+
+    float best_t                = float(max_distance);
+    const collision_shape *best = nullptr;
+
+    float4 t;
+    for (size_t i = 0; i < m_circles.size(); i += 4)
+    {
+        int hits = hit_circles(ray,
+                               &m_circle_x[i],
+                               &m_circle_y[i],
+                               &m_circle_radius_sq[i],
+                               t) &
+                   lane_bits(m_circles.size() - i);
+        if (hits)
+            closest_lane(hits, t, &m_circles[i], best_t, best);
+    }
+    for (size_t i = 0; i < m_rects.size(); i += 4)
+    {
+        int hits = hit_rects(ray,
+                             &m_rect_min_x[i],
+                             &m_rect_min_y[i],
+                             &m_rect_max_x[i],
+                             &m_rect_max_y[i],
+                             t) &
+                   lane_bits(m_rects.size() - i);
+        if (hits)
+            closest_lane(hits, t, &m_rects[i], best_t, best);
+    }
+
+    // Only the winner needs its point and normal, from the scalar test.
+    if (best)
+    {
+        if (!raycast_shape(origin, norm_dir, *best, final_result))
+        {
+            final_result.distance = real(best_t);
+            final_result.point    = origin + norm_dir * final_result.distance;
+        }
+        final_result.object = best;
+        final_result.hit    = true;
+    }
+
+    for (const collision_shape *obj : m_others)
+    {
+        raycast_result temp_result;
+        if (raycast_shape(origin, norm_dir, *obj, temp_result) &&
+            temp_result.distance >= 0 &&
+            temp_result.distance < final_result.distance)
+        {
+            final_result        = temp_result;
+            final_result.object = obj;
+            final_result.hit    = true;
+        }
+    }
+
+    return final_result;
+}
+
+bool ray_obstacle_set::occluded(vec2<real> origin,
+                                vec2<real> direction,
+                                real max_distance,
+                                const collision_shape *ignore) const
+{
+    bool result;
+    occluded(origin, &direction, &max_distance, 1, &result, ignore);
+    return result;
+}
+
+void ray_obstacle_set::occluded(vec2<real> origin,
+                                const vec2<real> *directions,
+                                const real *max_distances,
+                                size_t count,
+                                bool *out,
+                                const collision_shape *ignore) const
+{
+    const size_t packet_size = 8;
+
+    for (size_t first = 0; first < count; first += packet_size)
+    {
+        const size_t rays = min(packet_size, count - first);
+        packet_ray packet[packet_size];
+        for (size_t j = 0; j < rays; ++j)
+        {
+            packet[j] = prepare_ray(
+                origin, directions[first + j], max_distances[first + j]);
+            out[first + j] = false;
+        }
+
+        bool *hit   = out + first;
+        size_t open = rays;
+        float4 t;
+        for (size_t i = 0; open && i < m_circles.size(); i += 4)
+        {
+            const int lanes = lane_bits(m_circles.size() - i);
+            for (size_t j = 0; j < rays; ++j)
+            {
+                if (hit[j])
+                    continue;
+                int hits = hit_circles(packet[j],
+                                       &m_circle_x[i],
+                                       &m_circle_y[i],
+                                       &m_circle_radius_sq[i],
+                                       t) &
+                           lanes;
+                if (hits && ignore)
+                    hits = drop_lane(hits, &m_circles[i], ignore);
+                if (hits)
+                {
+                    hit[j] = true;
+                    --open;
+                }
+            }
+        }
+        for (size_t i = 0; open && i < m_rects.size(); i += 4)
+        {
+            const int lanes = lane_bits(m_rects.size() - i);
+            for (size_t j = 0; j < rays; ++j)
+            {
+                if (hit[j])
+                    continue;
+                int hits = hit_rects(packet[j],
+                                     &m_rect_min_x[i],
+                                     &m_rect_min_y[i],
+                                     &m_rect_max_x[i],
+                                     &m_rect_max_y[i],
+                                     t) &
+                           lanes;
+                if (hits && ignore)
+                    hits = drop_lane(hits, &m_rects[i], ignore);
+                if (hits)
+                {
+                    hit[j] = true;
+                    --open;
+                }
+            }
+        }
+        for (size_t j = 0; open && j < rays; ++j)
+        {
+            const vec2<real> &dir = directions[first + j];
+            const real limit      = max_distances[first + j];
+            for (size_t i = 0; !hit[j] && i < m_others.size(); ++i)
+            {
+                if (m_others[i] == ignore)
+                    continue;
+                raycast_result result;
+                if (raycast_shape(origin, dir, *m_others[i], result) &&
+                    result.distance >= 0 && result.distance < limit)
+                {
+                    hit[j] = true;
+                    --open;
+                }
+            }
+        }
+    }
+}
+
+#pragma endregion
+} // namespace zabato
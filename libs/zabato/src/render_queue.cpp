@@ -0,0 +1,227 @@
+#include <zabato/mesh.hpp>
+#include <zabato/render_queue.hpp>
+
+#include <string.h>
+
+namespace zabato
+{
+namespace
+{
+constexpr uint32_t depth_bits = 24;
+constexpr uint32_t depth_max  = (1u << depth_bits) - 1;
+constexpr uint32_t state_bits = 12;
+constexpr uint32_t state_max  = (1u << state_bits) - 1;
+
+constexpr uint32_t layer_shift       = 60;
+constexpr uint32_t translucent_shift = 59;
+constexpr uint32_t high_shift        = 35; ///< Bits 35-58, 24 bits.
+constexpr uint32_t low_shift         = 11; ///< Bits 11-34, 24 bits.
+constexpr uint32_t geometry_shift    = 23; ///< Bits 23-34, 12 bits.
+} // namespace
+
+void render_queue::clear()
+{
+    m_draws.clear();
+    m_items.clear();
+    m_state_ids.clear();
+    m_geometry_ids.clear();
+}
+
+void render_queue::set_depth_range(real near_depth, real far_depth)
+{
+    m_near_depth = near_depth;
+    m_far_depth  = far_depth;
+}
+
+void render_queue::add(const mesh *geometry,
+                       const material *mat,
+                       const mat4<real> &model_view,
+                       real depth,
+                       bool translucent,
+                       uint8_t layer,
+                       const animator *anim)
+{
+    assert(layer < layer_count);
+
+    const uint64_t tex_id = state_id(mat ? mat->texture : nullptr);
+    const uint64_t mat_id = state_id(mat);
+    const uint64_t state  = (tex_id << state_bits) | mat_id;
+    const uint64_t z      = quantize_depth(depth);
+
+    uint64_t key = uint64_t(layer & (layer_count - 1)) << layer_shift;
+    if (translucent)
+        key |= (uint64_t(1) << translucent_shift) |
+               (uint64_t(depth_max - z) << high_shift) | (state << low_shift);
+    else
+        key |= (state << high_shift) |
+               (uint64_t(geometry_id(geometry)) << geometry_shift) | (z >> 1);
+
+    m_items.push_back({key, uint32_t(m_draws.size())});
+    m_draws.push_back({model_view, geometry, mat, anim, translucent});
+}
+
+void render_queue::sort()
+{
+    const size_t count = m_items.size();
+    if (count < 2)
+        return;
+
+    // Count every byte of every key in one read.
+    uint32_t histograms[8][256] = {};
+    for (const sort_item &item : m_items)
+        for (uint32_t pass = 0; pass < 8; ++pass)
+            ++histograms[pass][(item.key >> (pass * 8)) & 0xFF];
+
+    m_scratch.resize(count);
+    sort_item *src = m_items.data();
+    sort_item *dst = m_scratch.data();
+    for (uint32_t pass = 0; pass < 8; ++pass)
+    {
+        uint32_t *histogram  = histograms[pass];
+        const uint32_t shift = pass * 8;
+
+        // A byte shared by every key does not reorder anything.
+        if (histogram[(src[0].key >> shift) & 0xFF] == count)
+            continue;
+
+        uint32_t offset = 0;
+        for (uint32_t digit = 0; digit < 256; ++digit)
+        {
+            const uint32_t bucket_count = histogram[digit];
+            histogram[digit]            = offset;
+            offset += bucket_count;
+        }
+
+        for (size_t i = 0; i < count; ++i)
+            dst[histogram[(src[i].key >> shift) & 0xFF]++] = src[i];
+
+        sort_item *swap = src;
+        src             = dst;
+        dst             = swap;
+    }
+
+    if (src != m_items.data())
+        memcpy(m_items.data(), src, count * sizeof(sort_item));
+}
+
+void render_queue::submit(gpu &g) const
+{
+    if (m_items.empty())
+        return;
+
+    g.set_matrix_mode(matrix_mode::modelview);
+    g.push_matrix();
+
+    const material *current_mat = nullptr;
+    texture *current_tex        = nullptr;
+    bool blending               = false;
+    bool first                  = true;
+    for (size_t i = 0; i < m_items.size();)
+    {
+        const draw &d = m_draws[m_items[i].index];
+
+        if (d.translucent != blending)
+        {
+            blending = d.translucent;
+            g.enable_blend(blending);
+            if (blending)
+                g.set_blend_func(blend_factor::src_alpha,
+                                 blend_factor::one_minus_src_alpha);
+        }
+
+        if (first || d.mat != current_mat)
+        {
+            current_mat = d.mat;
+            g.set_material(d.mat);
+        }
+
+        texture *tex = d.mat ? d.mat->texture : nullptr;
+        if (first || tex != current_tex)
+        {
+            current_tex = tex;
+            if (tex)
+                g.bind_texture(tex);
+            else
+                g.unbind_texture();
+        }
+        first = false;
+
+        // Consecutive bind pose draws of the same mesh and state become
+        // instances of a single draw.
+        size_t end = i + 1;
+        if (!d.anim)
+        {
+            while (end < m_items.size())
+            {
+                const draw &next = m_draws[m_items[end].index];
+                if (next.geometry != d.geometry || next.mat != d.mat ||
+                    next.translucent != d.translucent || next.anim)
+                    break;
+                ++end;
+            }
+        }
+
+        if (end - i > 1)
+        {
+            m_instances.clear();
+            for (size_t j = i; j < end; ++j)
+                m_instances.push_back(m_draws[m_items[j].index].model_view);
+            d.geometry->render_instanced(
+                g, m_instances.data(), m_instances.size());
+        }
+        else
+        {
+            g.load_matrix(d.model_view);
+            d.geometry->render(g, d.anim);
+        }
+        i = end;
+    }
+
+    if (blending)
+        g.enable_blend(false);
+    if (current_tex)
+        g.unbind_texture();
+    g.pop_matrix();
+}
+
+uint32_t render_queue::state_id(const void *state)
+{
+    // 0 stands for no state, so untextured draws batch together.
+    if (!state)
+        return 0;
+
+    uint32_t id;
+    if (m_state_ids.try_get_value(state, id))
+        return id;
+
+    // Past the key's range, ids share the last value and only batch less.
+    id = min(uint32_t(m_state_ids.size() + 1), state_max);
+    m_state_ids.add_or_set(state, id);
+    return id;
+}
+
+uint32_t render_queue::geometry_id(const mesh *geometry)
+{
+    uint32_t id;
+    if (m_geometry_ids.try_get_value(geometry, id))
+        return id;
+
+    // Past the key's range, meshes share the last id and only instance less.
+    id = min(uint32_t(m_geometry_ids.size()), state_max);
+    m_geometry_ids.add_or_set(geometry, id);
+    return id;
+}
+
+uint32_t render_queue::quantize_depth(real depth) const
+{
+    const real range = m_far_depth - m_near_depth;
+    if (range <= real(0) || depth <= m_near_depth)
+        return 0;
+    if (depth >= m_far_depth)
+        return depth_max;
+
+    // Through double, so fixed point reals keep every step of the range.
+    const double t = double(depth - m_near_depth) / double(range);
+    return uint32_t(t * double(depth_max));
+}
+} // namespace zabato
@@ -0,0 +1,619 @@
+#include <zabato/hash_set.hpp>
+#include <zabato/job_system.hpp>
+#include <zabato/profiler.hpp>
+#include <zabato/resource.hpp>
+#include <zabato/utils.hpp>
+
+namespace zabato
+{
+resource_manager::resource_manager(uint32_t worker_count)
+{
+    if (worker_count == 0)
+        worker_count = thread::hardware_concurrency();
+    m_worker_count = min(worker_count, max_workers);
+}
+
+resource_manager::~resource_manager()
+{
+    {
+        lock_guard lock(m_mutex);
+        m_stopping = true;
+    }
+    m_wake.notify_all();
+
+    // Requests still queued are dropped with the manager.
+    for (uint32_t i = 0; i < m_started_count; ++i)
+        m_workers[i].join();
+}
+
+namespace
+{
+/** @brief Reads a `fs::file` as a stream. */
+class vfs_stream : public stream
+{
+public:
+    explicit vfs_stream(fs::file &file) : m_file(file) {}
+
+    size_t read(buffer &buffer) override { return m_file.read(buffer); }
+
+    size_t write(const buffer &buffer) override
+    {
+        return m_file.write(const_buffer(buffer.data(), buffer.size()));
+    }
+
+    void skip(int64_t offset) override
+    {
+        m_file.seek(offset, fs::origin::current);
+    }
+
+    bool eof() const override { return m_file.eof(); }
+
+    void rewind() override { m_file.seek(0, fs::origin::begin); }
+
+    size_t tell() const override { return m_file.tell(); }
+
+    void pos(int64_t offset) override
+    {
+        m_file.seek(offset, fs::origin::begin);
+    }
+
+    const uint8_t *view(size_t size) override { return m_file.view(size); }
+
+private:
+    fs::file &m_file;
+};
+
+/** @brief Closes and deletes a file opened from a `fs::file_system`. */
+void close_file(fs::file *file)
+{
+    file->close();
+    delete file;
+}
+} // namespace
+
+result<void> resource_manager::read_file(const string &path,
+                                         decode_function decode,
+                                         resource &obj) const
+{
+    PROFILE_SCOPE("resource_manager::read_file");
+    // The buffers are destroyed, and sync their source, before files close.
+    result<void> res;
+    if (m_fs)
+    {
+        fs::file *file = m_fs->open(path, fs::open_mode::read);
+        if (!file)
+            return report_error(error_code::file_not_found, path.c_str());
+
+        {
+            vfs_stream stream(*file);
+            buffered_stream buffered(stream);
+            ice_reader reader(buffered);
+            res = decode(reader, obj);
+        }
+
+        close_file(file);
+        return res;
+    }
+
+    FILE *file = fopen(path.c_str(), "rb");
+    if (!file)
+        return report_error(error_code::file_not_found, path.c_str());
+
+    {
+        file_stream stream(file);
+        buffered_stream buffered(stream);
+        ice_reader reader(buffered);
+        res = decode(reader, obj);
+    }
+
+    fclose(file);
+    return res;
+}
+
+result<void> resource_manager::read_bytes(const string &path,
+                                          vector<uint8_t> &out) const
+{
+    fs::file *vfs_file = nullptr;
+    FILE *host_file    = nullptr;
+    if (m_fs)
+        vfs_file = m_fs->open(path, fs::open_mode::read);
+    else
+        host_file = fopen(path.c_str(), "rb");
+    if (!vfs_file && !host_file)
+        return report_error(error_code::file_not_found, path.c_str());
+
+    const size_t step = buffered_stream::default_window;
+    for (;;)
+    {
+        const size_t size = out.size();
+        out.resize(size + step);
+
+        uint8_t *data = out.data() + size;
+        const size_t count =
+            vfs_file ? vfs_file->read(buffer(data, step))
+                     : fread(data, 1, step, host_file);
+        out.resize(size + count);
+        if (count < step)
+            break;
+    }
+
+    if (vfs_file)
+        close_file(vfs_file);
+    else
+        fclose(host_file);
+    return {};
+}
+
+result<void> resource_manager::decode_bytes(vector<uint8_t> &data,
+                                            decode_function decode,
+                                            resource &obj)
+{
+    PROFILE_SCOPE("resource_manager::decode_bytes");
+    memory_stream stream(data);
+    ice_reader reader(stream);
+    return decode(reader, obj);
+}
+
+/** @brief Decodes a resource on the calling thread, prefetched or not. */
+result<void> resource_manager::read(const string &path,
+                                    decode_function decode,
+                                    resource &obj)
+{
+    vector<uint8_t> *data = m_prefetched.find(path);
+    if (!data)
+        return read_file(path, decode, obj);
+
+    result<void> res = decode_bytes(*data, decode, obj);
+    m_prefetched.erase(path);
+    return res;
+}
+
+size_t resource_manager::prefetch(const vector<string> &paths)
+{
+    struct item
+    {
+        const string *path;
+        uint64_t offset;
+        size_t order; ///< Keeps the manifest order among equal offsets.
+    };
+
+    vector<item> items;
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        const string &path = paths[i];
+        if (m_resources.contains_key(path) || m_in_flight.contains_key(path) ||
+            m_prefetched.contains_key(path))
+            continue;
+
+        const uint64_t offset = m_fs ? m_fs->get_storage_offset(path) : 0;
+        items.push_back({&path, offset, i});
+    }
+
+    sort(items.begin(),
+         items.end(),
+         [](const item &a, const item &b)
+         {
+             if (a.offset != b.offset)
+                 return a.offset < b.offset;
+             return a.order < b.order;
+         });
+
+    // Read in place, entries are moved rather than copied when the map grows.
+    size_t count = 0;
+    for (const item &it : items)
+    {
+        if (!m_prefetched.add(*it.path, vector<uint8_t>()))
+            continue; // Listed twice.
+        if (read_bytes(*it.path, *m_prefetched.find(*it.path)).has_error())
+        {
+            m_prefetched.erase(*it.path);
+            continue;
+        }
+        ++count;
+    }
+    return count;
+}
+
+size_t resource_manager::load_batch(resource_batch &batch)
+{
+    PROFILE_SCOPE("resource_manager::load_batch");
+
+    // Cache lookups and prefetched bytes are taken here, the jobs only touch
+    // their own entries.
+    using entry = resource_batch::entry;
+    hash_map<string, size_t> first;
+    vector<entry *> pending;
+    for (size_t i = 0; i < batch.m_entries.size(); ++i)
+    {
+        entry &e = batch.m_entries[i];
+        e.error  = error_code::ok;
+        e.loaded = false;
+        e.object = nullptr;
+        if (find_cached(e.path, e.object) || !first.add(e.path, i))
+            continue;
+
+        ++m_stats.misses;
+        e.object = e.type.create();
+        if (vector<uint8_t> *data = m_prefetched.find(e.path))
+        {
+            e.data = move(*data);
+            m_prefetched.erase(e.path);
+        }
+        pending.push_back(&e);
+    }
+
+    entry *const *work = pending.data();
+    job_system::get().parallel_for(
+        pending.size(),
+        1,
+        [this, work](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                entry &e = *work[i];
+                if (e.data.empty())
+                    e.error = read_file(e.path, e.type.decode, *e.object).error;
+                else
+                    e.error = decode_bytes(e.data, e.type.decode, *e.object)
+                                  .error;
+                e.data.clear();
+                e.data.shrink_to_fit();
+                e.loaded = !bool(e.error);
+            }
+        });
+
+    size_t failed = 0;
+    for (size_t i = 0; i < batch.m_entries.size(); ++i)
+    {
+        entry &e = batch.m_entries[i];
+        if (e.loaded)
+            cache(e.path, e.object, e.type);
+
+        // Repeated paths share the result of the first.
+        size_t index = i;
+        if (first.try_get_value(e.path, index) && index != i)
+        {
+            e.object = batch.m_entries[index].object;
+            e.error  = batch.m_entries[index].error;
+        }
+        if (bool(e.error))
+        {
+            e.object = nullptr;
+            ++failed;
+        }
+    }
+    return failed;
+}
+
+resource_manager::request_ptr
+resource_manager::request(string_view path,
+                          load_callback callback,
+                          void *user,
+                          const resource_type &type)
+{
+    request_ptr pending;
+    if (m_in_flight.try_get_value(path, pending))
+    {
+        ++m_stats.hits;
+        if (callback)
+            pending->callbacks.push_back({callback, user});
+        return pending;
+    }
+
+    pending       = make_shared<resource_request>();
+    pending->path = path;
+    pending->type = type;
+    if (callback)
+        pending->callbacks.push_back({callback, user});
+    m_in_flight.add_or_set(pending->path, pending);
+
+    // Cached resources skip the workers but are still delivered by `update`.
+    resource_ptr cached;
+    if (find_cached(path, cached))
+    {
+        pending->object = cached;
+        lock_guard lock(m_mutex);
+        m_completed.push_back(pending);
+        return pending;
+    }
+
+    ++m_stats.misses;
+    pending->object = type.create();
+    if (vector<uint8_t> *data = m_prefetched.find(path))
+    {
+        pending->data = move(*data);
+        m_prefetched.erase(path);
+    }
+    start_workers();
+    {
+        lock_guard lock(m_mutex);
+        m_queue.push_back(pending);
+    }
+    m_wake.notify_one();
+    return pending;
+}
+
+void resource_manager::start_workers()
+{
+    for (uint32_t i = 0; i < m_worker_count; ++i)
+        if (m_workers[m_started_count].start(worker, this))
+            ++m_started_count;
+    m_worker_count = 0;
+}
+
+/** @brief Takes the oldest queued request, with `m_mutex` held. */
+resource_manager::request_ptr resource_manager::pop_queued()
+{
+    request_ptr request = move(m_queue[m_queue_head++]);
+    if (m_queue_head == m_queue.size())
+    {
+        m_queue.clear();
+        m_queue_head = 0;
+    }
+    return request;
+}
+
+/** @brief Reads and decodes a request, off the main thread if any. */
+void resource_manager::run(resource_request &request) const
+{
+    if (request.data.empty())
+    {
+        request.error =
+            read_file(request.path, request.type.decode, *request.object)
+                .error;
+        return;
+    }
+
+    request.error =
+        decode_bytes(request.data, request.type.decode, *request.object).error;
+    request.data.clear();
+    request.data.shrink_to_fit();
+}
+
+void resource_manager::worker(void *self)
+{
+    resource_manager &manager = *static_cast<resource_manager *>(self);
+    for (;;)
+    {
+        request_ptr request;
+        {
+            lock_guard lock(manager.m_mutex);
+            while (!manager.m_stopping &&
+                   manager.m_queue_head == manager.m_queue.size())
+                manager.m_wake.wait(manager.m_mutex);
+            if (manager.m_stopping)
+                return;
+            request = manager.pop_queued();
+        }
+
+        manager.run(*request);
+
+        lock_guard lock(manager.m_mutex);
+        manager.m_completed.push_back(move(request));
+    }
+}
+
+void resource_manager::update()
+{
+    // Without workers the loads progress here instead, one per call.
+    if (m_started_count == 0)
+    {
+        request_ptr request;
+        {
+            lock_guard lock(m_mutex);
+            if (m_queue_head < m_queue.size())
+                request = pop_queued();
+        }
+        if (request)
+        {
+            run(*request);
+            lock_guard lock(m_mutex);
+            m_completed.push_back(move(request));
+        }
+    }
+
+    vector<request_ptr> completed;
+    {
+        lock_guard lock(m_mutex);
+        swap(completed, m_completed);
+    }
+
+    for (const request_ptr &request : completed)
+        finish(request);
+}
+
+void resource_manager::finish(const request_ptr &request)
+{
+    // A later request for the path may have replaced this one, after an
+    // `unload` of the cached resource.
+    request_ptr current;
+    if (m_in_flight.try_get_value(request->path, current) &&
+        current.get() == request.get())
+        m_in_flight.erase(request->path);
+
+    const bool failed = bool(request->error);
+    if (!failed)
+        cache(request->path, request->object, request->type);
+    request->done = true;
+
+    const result<resource_ptr> loaded =
+        failed ? result<resource_ptr>(request->error)
+               : result<resource_ptr>(request->object);
+
+    // Callbacks may start new loads, which must not see this list.
+    vector<resource_request::callback> callbacks = move(request->callbacks);
+    for (const resource_request::callback &callback : callbacks)
+        callback.function(callback.user, request->path, loaded);
+}
+
+bool resource_manager::find_cached(string_view path, resource_ptr &out)
+{
+    cache_entry *entry = m_resources.find(path);
+    if (!entry)
+        return false;
+
+    ++m_stats.hits;
+    entry->last_use = ++m_clock;
+    out             = entry->resource;
+    return true;
+}
+
+void resource_manager::cache(const string &path,
+                             const resource_ptr &obj,
+                             const resource_type &type)
+{
+    cache_entry entry;
+    entry.resource = obj;
+    entry.type     = type;
+    entry.size     = obj->get_memory_used();
+    entry.last_use = ++m_clock;
+    if (entry.size == 0)
+        entry.size = type.size;
+
+    const cache_entry *previous = m_resources.find(path);
+    if (previous)
+        m_stats.resident_bytes -= previous->size;
+    m_stats.resident_bytes += entry.size;
+    m_resources.add_or_set(path, entry);
+    trim();
+}
+
+void resource_manager::trim()
+{
+    if (m_memory_budget == 0 || m_stats.resident_bytes <= m_memory_budget)
+        return;
+
+    struct candidate
+    {
+        const string *path;
+        uint64_t last_use;
+        size_t size;
+    };
+
+    vector<candidate> candidates;
+    for (auto it = m_resources.begin(); it != m_resources.end(); ++it)
+        if (it->value.resource.use_count() == 1)
+            candidates.push_back(
+                {&it->key, it->value.last_use, it->value.size});
+
+    sort(candidates.begin(),
+         candidates.end(),
+         [](const candidate &a, const candidate &b)
+         { return a.last_use < b.last_use; });
+
+    // Erasing leaves the other entries in place, so the paths stay valid.
+    for (const candidate &c : candidates)
+    {
+        if (m_stats.resident_bytes <= m_memory_budget)
+            break;
+        m_stats.resident_bytes -= c.size;
+        ++m_stats.evictions;
+        m_resources.erase(*c.path);
+    }
+}
+
+void resource_manager::set_memory_budget(size_t bytes)
+{
+    m_memory_budget = bytes;
+    trim();
+}
+
+resource_stats resource_manager::get_stats() const
+{
+    resource_stats stats = m_stats;
+    stats.resident_count = m_resources.size();
+    return stats;
+}
+
+void resource_manager::reset_stats()
+{
+    m_stats.hits      = 0;
+    m_stats.misses    = 0;
+    m_stats.evictions = 0;
+}
+
+bool resource_manager::watch_files() { return m_fs && m_fs->watch(); }
+
+size_t resource_manager::reload_changed()
+{
+    vector<string> changed;
+    if (!m_fs || m_fs->poll_changes(changed) == 0)
+        return 0;
+
+    PROFILE_SCOPE("resource_manager::reload_changed");
+
+    // Compared normalized, so "data/a.ice" matches "/data/./a.ice".
+    fs::virtual_fs::path_buffer normalized;
+    hash_set<string> paths;
+    for (const string &path : changed)
+        if (fs::normalize(path, normalized, true))
+            paths.add(string(normalized));
+
+    auto is_changed = [&](const string &path)
+    {
+        return fs::normalize(path, normalized, true) &&
+               paths.contains(string_view(normalized));
+    };
+
+    vector<string> stale;
+    for (auto it = m_prefetched.begin(); it != m_prefetched.end(); ++it)
+        if (is_changed(it->key))
+            stale.push_back(it->key);
+    for (const string &path : stale)
+        m_prefetched.erase(path);
+
+    vector<string> reloads;
+    for (auto it = m_resources.begin(); it != m_resources.end(); ++it)
+        if (is_changed(it->key))
+            reloads.push_back(it->key);
+
+    size_t count = 0;
+    for (const string &path : reloads)
+        if (!reload(path).has_error())
+            ++count;
+    return count;
+}
+
+result<void> resource_manager::reload(string_view path)
+{
+    const cache_entry *entry = m_resources.find(path);
+    if (!entry)
+        return report_error(
+            error_code::operation, " reload", " The resource is not cached.");
+
+    const string key(path);
+    const resource_type type = entry->type;
+    m_prefetched.erase(key);
+
+    resource_ptr fresh  = type.create();
+    result<void> loaded = read_file(key, type.decode, *fresh);
+    if (loaded.has_error())
+        return loaded;
+
+    resource_ptr current = entry->resource;
+    if (!current->replace_with(*fresh))
+        current = fresh;
+    cache(key, current, type);
+
+    if (m_reload_callback)
+        m_reload_callback(m_reload_user, key, result<resource_ptr>(current));
+    return {};
+}
+
+void resource_manager::unload(string_view path)
+{
+    const cache_entry *entry = m_resources.find(path);
+    if (!entry)
+        return;
+
+    m_stats.resident_bytes -= entry->size;
+    m_resources.erase(path);
+}
+
+void resource_manager::unload_all()
+{
+    m_resources.clear();
+    m_prefetched.clear();
+    m_stats.resident_bytes = 0;
+}
+} // namespace zabato
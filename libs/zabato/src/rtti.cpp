@@ -0,0 +1,32 @@
+#include <zabato/rtti.hpp>
+
+namespace zabato
+{
+bool rtti::build_chain() const
+{
+    // Threads losing the race walk the bases until the winner is done.
+    unsigned int expected = chain_unset;
+    if (!atomic_compare_exchange_strong_explicit(&m_state,
+                                                 &expected,
+                                                 chain_building,
+                                                 memory_order_acquire,
+                                                 memory_order_acquire))
+        return expected == chain_ready;
+
+    uint32_t depth = 0;
+    for (const rtti *base = m_base_type; base; base = base->m_base_type)
+        ++depth;
+    if (depth >= max_depth)
+    {
+        atomic_store_explicit(&m_state, chain_too_deep, memory_order_release);
+        return false;
+    }
+
+    m_depth          = depth;
+    const rtti *type = this;
+    for (uint32_t i = depth + 1; i-- > 0; type = type->m_base_type)
+        m_chain[i] = type;
+    atomic_store_explicit(&m_state, chain_ready, memory_order_release);
+    return true;
+}
+} // namespace zabato
@@ -0,0 +1,393 @@
+#include <zabato/controller.hpp>
+#include <zabato/hash_map.hpp>
+#include <zabato/node.hpp>
+#include <zabato/profiler.hpp>
+#include <zabato/scene_file.hpp>
+
+#include <string.h>
+#include <tinyxml2.h>
+
+namespace zabato
+{
+namespace
+{
+/** @brief The tables of a SCEN chunk, filled in while walking the XML. */
+class scene_compiler
+{
+public:
+    result<void> add_node(const tinyxml2::XMLElement &el, int32_t parent);
+    result<void> resolve_links();
+    result<void> write(ice_writer &writer) const;
+
+private:
+    /** @brief A `ref` element, resolved once every id is known. */
+    struct pending_link
+    {
+        uint32_t parent;
+        const char *id;
+    };
+
+    uint32_t add_string(const char *text);
+    uint32_t add_type(const char *name);
+    result<void> read_id(const tinyxml2::XMLElement &el, uint8_t out[16]);
+    void add_controllers(const tinyxml2::XMLElement &el, uint32_t owner);
+
+    vector<char> m_strings;
+    hash_map<string, uint32_t> m_string_offsets;
+    vector<ice_uint32_t> m_types;
+    hash_map<string, uint32_t> m_type_indices;
+    vector<ICE_SCENE_NODE> m_nodes;
+    vector<ICE_SCENE_CONTROLLER> m_controllers;
+    vector<ICE_SCENE_LINK> m_links;
+    vector<pending_link> m_pending;
+    hash_map<uuid, uint32_t> m_node_ids;
+};
+
+uint32_t scene_compiler::add_string(const char *text)
+{
+    uint32_t offset = 0;
+    if (m_string_offsets.try_get_value(string_view(text), offset))
+        return offset;
+
+    offset = (uint32_t)m_strings.size();
+    for (const char *c = text; *c; ++c)
+        m_strings.push_back(*c);
+    m_strings.push_back(0);
+    m_string_offsets.add(string(text), offset);
+    return offset;
+}
+
+uint32_t scene_compiler::add_type(const char *name)
+{
+    uint32_t index = 0;
+    if (m_type_indices.try_get_value(string_view(name), index))
+        return index;
+
+    index = (uint32_t)m_types.size();
+    m_types.push_back(add_string(name));
+    m_type_indices.add(string(name), index);
+    return index;
+}
+
+result<void> scene_compiler::read_id(const tinyxml2::XMLElement &el,
+                                     uint8_t out[16])
+{
+    const char *text = el.Attribute("id");
+    if (!text)
+        return report_error(error_code::value, el.Name());
+
+    uuid id;
+    if (!uuid::try_parse({text, strlen(text)}, id))
+        return report_error(error_code::value, text);
+    memcpy(out, id.data(), 16);
+    return error_code::ok;
+}
+
+void scene_compiler::add_controllers(const tinyxml2::XMLElement &el,
+                                     uint32_t owner)
+{
+    const tinyxml2::XMLElement *list = el.FirstChildElement("controllers");
+    for (; list; list = list->NextSiblingElement("controllers"))
+    {
+        const tinyxml2::XMLElement *ctrl = list->FirstChildElement();
+        for (; ctrl; ctrl = ctrl->NextSiblingElement())
+        {
+            ICE_SCENE_CONTROLLER record = {};
+            record.type                 = add_type(ctrl->Name());
+            record.owner                = owner;
+            const char *name            = ctrl->Attribute("name");
+            record.name_offset          = add_string(name ? name : "");
+
+            // Controllers are not referenced, a missing id is a fresh one.
+            const char *text = ctrl->Attribute("id");
+            uuid id          = uuid::generate();
+            if (text)
+                uuid::try_parse({text, strlen(text)}, id);
+            memcpy(record.id, id.data(), 16);
+            m_controllers.push_back(record);
+        }
+    }
+}
+
+result<void> scene_compiler::add_node(const tinyxml2::XMLElement &el,
+                                      int32_t parent)
+{
+    const uint32_t index  = (uint32_t)m_nodes.size();
+    ICE_SCENE_NODE record = {};
+    record.type           = add_type(el.Name());
+    record.parent         = parent;
+    const char *name      = el.Attribute("name");
+    record.name_offset    = add_string(name ? name : "");
+
+    auto id_result = read_id(el, record.id);
+    if (id_result.has_error())
+        return id_result;
+    if (!m_node_ids.add(uuid(record.id), index))
+        return report_error(error_code::value, el.Attribute("id"));
+
+    // The defaults of `transformation`, for what the XML leaves out.
+    float transform[10] = {0, 0, 0, 0, 0, 0, 1, 1, 1, 1};
+    if (const tinyxml2::XMLElement *t = el.FirstChildElement("transform"))
+    {
+        const char *parts[]       = {"position", "rotation", "scale"};
+        const size_t firsts[]     = {0, 3, 7};
+        const char *components[]  = {"x", "y", "z", "w"};
+        const size_t dimensions[] = {3, 4, 3};
+        for (size_t p = 0; p < 3; ++p)
+        {
+            const tinyxml2::XMLElement *part = t->FirstChildElement(parts[p]);
+            if (!part)
+                continue;
+            for (size_t c = 0; c < dimensions[p]; ++c)
+                transform[firsts[p] + c] =
+                    part->FloatAttribute(components[c]);
+        }
+    }
+    for (size_t i = 0; i < 3; ++i)
+    {
+        record.translate[i] = transform[i];
+        record.scale[i]     = transform[7 + i];
+    }
+    for (size_t i = 0; i < 4; ++i)
+        record.rotate[i] = transform[3 + i];
+    m_nodes.push_back(record);
+
+    add_controllers(el, index);
+
+    // Every other element is a child, added after its parent.
+    const tinyxml2::XMLElement *child = el.FirstChildElement();
+    for (; child; child = child->NextSiblingElement())
+    {
+        const char *child_name = child->Name();
+        if (!strcmp(child_name, "transform") ||
+            !strcmp(child_name, "controllers"))
+            continue;
+
+        if (!strcmp(child_name, "ref"))
+        {
+            if (const char *id = child->Attribute("id"))
+                m_pending.push_back({index, id});
+            continue;
+        }
+
+        auto child_result = add_node(*child, (int32_t)index);
+        if (child_result.has_error())
+            return child_result;
+    }
+    return error_code::ok;
+}
+
+result<void> scene_compiler::resolve_links()
+{
+    for (const pending_link &link : m_pending)
+    {
+        uuid id;
+        uint32_t target = 0;
+        if (!uuid::try_parse({link.id, strlen(link.id)}, id) ||
+            !m_node_ids.try_get_value(id, target))
+            return report_error(error_code::value, link.id);
+        m_links.push_back({link.parent, target});
+    }
+    return error_code::ok;
+}
+
+result<void> scene_compiler::write(ice_writer &writer) const
+{
+    const ICE_SCENE_HEADER header = {
+        .version          = ICE_SCENE_VERSION,
+        .type_count       = (uint32_t)m_types.size(),
+        .node_count       = (uint32_t)m_nodes.size(),
+        .controller_count = (uint32_t)m_controllers.size(),
+        .link_count       = (uint32_t)m_links.size(),
+    };
+    const size_t types_size = m_types.size() * sizeof(ice_uint32_t);
+    const size_t nodes_size = m_nodes.size() * sizeof(ICE_SCENE_NODE);
+    const size_t ctrls_size = m_controllers.size() * sizeof(m_controllers[0]);
+    const size_t links_size = m_links.size() * sizeof(ICE_SCENE_LINK);
+    const size_t size = sizeof(header) + types_size + nodes_size + ctrls_size +
+                        links_size + m_strings.size();
+
+    auto header_result = writer.write_chunk_header(scene_file::CHUNK_ID, size);
+    if (header_result.has_error())
+        return header_result.error;
+
+    const struct
+    {
+        const void *data;
+        size_t size;
+    } parts[] = {
+        {&header, sizeof(header)},
+        {m_types.data(), types_size},
+        {m_nodes.data(), nodes_size},
+        {m_controllers.data(), ctrls_size},
+        {m_links.data(), links_size},
+        {m_strings.data(), m_strings.size()},
+    };
+    for (const auto &part : parts)
+    {
+        if (!part.size)
+            continue;
+        auto write_result = writer.write(part.data, part.size);
+        if (write_result.has_error())
+            return write_result.error;
+    }
+    return error_code::ok;
+}
+} // namespace
+
+result<void> compile_scene(const tinyxml2::XMLElement &root,
+                           ice_writer &writer)
+{
+    scene_compiler compiler;
+    auto add_result = compiler.add_node(root, -1);
+    if (add_result.has_error())
+        return add_result;
+    auto link_result = compiler.resolve_links();
+    if (link_result.has_error())
+        return link_result;
+    return compiler.write(writer);
+}
+
+template <> result<void> deserialize(ice_reader &reader, scene_file &scene)
+{
+    PROFILE_SCOPE("scene_file::deserialize");
+
+    auto [error, chunk] = reader.find_chunk(scene_file::CHUNK_ID);
+    if (error)
+        return error;
+
+    auto broken = []
+    {
+        return report_error(error_code::chunk_broken,
+                            scene_file::CHUNK_ID.to_string().c_str(),
+                            (uint32_t)scene_file::CHUNK_ID);
+    };
+
+    ICE_SCENE_HEADER header;
+    if (chunk.size < sizeof(header) ||
+        reader.read(&header, sizeof(header)) != sizeof(header) ||
+        header.version != ICE_SCENE_VERSION || header.node_count == 0)
+        return broken();
+
+    const uint64_t payload          = chunk.size - sizeof(header);
+    const uint32_t type_count       = header.type_count;
+    const uint32_t node_count       = header.node_count;
+    const uint32_t controller_count = header.controller_count;
+    const uint32_t link_count       = header.link_count;
+    const uint64_t records =
+        type_count * uint64_t(sizeof(ice_uint32_t)) +
+        node_count * uint64_t(sizeof(ICE_SCENE_NODE)) +
+        controller_count * uint64_t(sizeof(ICE_SCENE_CONTROLLER)) +
+        link_count * uint64_t(sizeof(ICE_SCENE_LINK));
+    if (records >= payload)
+        return broken();
+
+    vector<uint8_t> data(payload);
+    if (reader.read(data.data(), data.size()) != data.size() ||
+        data.back() != 0)
+        return broken();
+
+    const uint8_t *cursor     = data.data();
+    const ice_uint32_t *types = (const ice_uint32_t *)cursor;
+    cursor += type_count * sizeof(ice_uint32_t);
+    const ICE_SCENE_NODE *nodes = (const ICE_SCENE_NODE *)cursor;
+    cursor += node_count * sizeof(ICE_SCENE_NODE);
+    const ICE_SCENE_CONTROLLER *controllers =
+        (const ICE_SCENE_CONTROLLER *)cursor;
+    cursor += controller_count * sizeof(ICE_SCENE_CONTROLLER);
+    const ICE_SCENE_LINK *links = (const ICE_SCENE_LINK *)cursor;
+    cursor += link_count * sizeof(ICE_SCENE_LINK);
+    const char *strings         = (const char *)cursor;
+    const uint64_t strings_size = payload - records;
+
+    // Each type name is looked up once, the records then index the table.
+    vector<object::create_function> creates(type_count);
+    for (uint32_t i = 0; i < type_count; ++i)
+    {
+        const uint32_t offset = types[i];
+        if (offset >= strings_size)
+            return broken();
+        creates[i] = object::find_create_function(strings + offset);
+        if (!creates[i])
+            return report_error(error_code::value, strings + offset);
+    }
+
+    auto restore = [&](object &obj, uint32_t name_offset, const uint8_t *id)
+    {
+        obj.set_name(strings + name_offset);
+        obj.set_id(uuid(id));
+    };
+
+    // Parents come first, so one pass attaches every node to a built parent.
+    // The vector holds the nodes until the tree does, and on failure.
+    vector<pointer<spatial>> built;
+    built.reserve(node_count);
+    for (uint32_t i = 0; i < node_count; ++i)
+    {
+        const ICE_SCENE_NODE &r = nodes[i];
+        const int32_t parent    = r.parent;
+        if (r.type >= type_count || r.name_offset >= strings_size ||
+            parent >= int32_t(i) || (parent < 0) != (i == 0))
+            return broken();
+
+        object *obj = creates[(uint32_t)r.type]();
+        spatial *s  = c_dynamic_cast<spatial>(obj);
+        if (!s)
+        {
+            delete obj;
+            return broken();
+        }
+        built.emplace_back(s);
+        restore(*s, r.name_offset, r.id);
+
+        transformation local;
+        local.set_translate(vec3<real>(real(float(r.translate[0])),
+                                       real(float(r.translate[1])),
+                                       real(float(r.translate[2]))));
+        local.set_rotate(quat<real>(real(float(r.rotate[0])),
+                                    real(float(r.rotate[1])),
+                                    real(float(r.rotate[2])),
+                                    real(float(r.rotate[3]))));
+        local.set_scale(vec3<real>(real(float(r.scale[0])),
+                                   real(float(r.scale[1])),
+                                   real(float(r.scale[2]))));
+        s->set_local(local);
+
+        // As `node::load_xml`, only nodes take children.
+        if (parent >= 0)
+            if (node *n = c_dynamic_cast<node>(built[parent]))
+                n->attach_child(s);
+    }
+
+    for (uint32_t i = 0; i < controller_count; ++i)
+    {
+        const ICE_SCENE_CONTROLLER &r = controllers[i];
+        if (r.type >= type_count || r.owner >= node_count ||
+            r.name_offset >= strings_size)
+            return broken();
+
+        object *obj              = creates[(uint32_t)r.type]();
+        pointer<controller> ctrl = c_dynamic_cast<controller>(obj);
+        if (!ctrl)
+        {
+            delete obj;
+            return broken();
+        }
+        restore(*ctrl, r.name_offset, r.id);
+        built[(uint32_t)r.owner]->add_controller(ctrl);
+    }
+
+    for (uint32_t i = 0; i < link_count; ++i)
+    {
+        const ICE_SCENE_LINK &r = links[i];
+        if (r.parent >= node_count || r.target >= node_count)
+            return broken();
+        if (node *n = c_dynamic_cast<node>(built[(uint32_t)r.parent]))
+            n->attach_child(built[(uint32_t)r.target]);
+    }
+
+    scene.m_root       = built[0];
+    scene.m_node_count = node_count;
+    return error_code::ok;
+}
+} // namespace zabato
@@ -1,9 +1,33 @@
+#include <zabato/controller.hpp>
+#include <zabato/node.hpp>
 #include <zabato/scene_printer.hpp>
+#include <zabato/utils.hpp>
+
 #include <stdio.h>
 
 namespace zabato
 {
 
+namespace
+{
+/** @brief Formats a byte count with a binary unit. */
+void format_bytes(size_t bytes, char (&out)[16])
+{
+    static const char *const units[] = {"B", "KiB", "MiB", "GiB"};
+    double value = (double)bytes;
+    size_t unit  = 0;
+    while (value >= 1024.0 && unit + 1 < sizeof(units) / sizeof(units[0]))
+    {
+        value /= 1024.0;
+        ++unit;
+    }
+    if (unit == 0)
+        snprintf(out, sizeof(out), "%zu B", bytes);
+    else
+        snprintf(out, sizeof(out), "%.1f %s", value, units[unit]);
+}
+} // namespace
+
 scene_printer::scene_printer(const char *filename)
     : m_filename(filename), m_file(nullptr)
 {
@@ -37,6 +61,98 @@ void scene_printer::print_recursive(const string_tree *tree, int indentation)
     }
 }
 
+void scene_printer::print_costs(spatial *root)
+{
+    if (!root || !m_filename)
+        return;
+
+    vector<subtree> subtrees;
+    collect_costs(root, subtrees);
+
+    m_file = fopen(m_filename, "wt");
+    if (!m_file)
+        return;
+
+    fprintf(m_file,
+            "%10s %10s %10s %9s %8s %11s %7s  %s\n",
+            "memory",
+            "gpu",
+            "disk",
+            "vertices",
+            "spatials",
+            "controllers",
+            "cost",
+            "subtree");
+    print_costs_recursive(subtrees, 0, 0);
+
+    fclose(m_file);
+    m_file = nullptr;
+}
+
+uint32_t scene_printer::collect_costs(spatial *root, vector<subtree> &subtrees)
+{
+    const uint32_t index = (uint32_t)subtrees.size();
+    subtrees.push_back(subtree());
+    subtrees[index].root = root;
+
+    scene_cost cost;
+    root->add_cost(cost);
+    for (const pointer<controller> &c : root->get_controllers())
+        if (c)
+            c->add_cost(cost);
+
+    vector<uint32_t> children;
+    if (root->is_derived(node::TYPE))
+    {
+        node *parent = static_cast<node *>(root);
+        for (int i = 0; i < parent->quantity(); ++i)
+        {
+            spatial *child = parent->child_at(i);
+            if (!child)
+                continue;
+            const uint32_t child_index = collect_costs(child, subtrees);
+            cost.add(subtrees[child_index].cost);
+            children.push_back(child_index);
+        }
+    }
+
+    auto weight = [&](uint32_t i)
+    { return subtrees[i].cost.memory + subtrees[i].cost.gpu_memory; };
+    sort(children.begin(),
+         children.end(),
+         [&](uint32_t a, uint32_t b) { return weight(a) > weight(b); });
+
+    subtrees[index].cost     = cost;
+    subtrees[index].children = move(children);
+    return index;
+}
+
+void scene_printer::print_costs_recursive(const vector<subtree> &subtrees,
+                                          uint32_t index,
+                                          int indentation)
+{
+    const subtree &tree = subtrees[index];
+    char memory[16], gpu_memory[16], disk[16];
+    format_bytes(tree.cost.memory, memory);
+    format_bytes(tree.cost.gpu_memory, gpu_memory);
+    format_bytes(tree.cost.disk, disk);
+
+    fprintf(m_file,
+            "%10s %10s %10s %9zu %8zu %11zu %7u  ",
+            memory,
+            gpu_memory,
+            disk,
+            tree.cost.vertices,
+            tree.cost.spatials,
+            tree.cost.controllers,
+            tree.cost.update_cost);
+    print_indentation(indentation);
+    fprintf(m_file, "%s: %s\n", tree.root->type().name(), tree.root->name());
+
+    for (uint32_t child : tree.children)
+        print_costs_recursive(subtrees, child, indentation + 4);
+}
+
 void scene_printer::print_indentation(int indentation)
 {
     for (int i = 0; i < indentation; ++i)
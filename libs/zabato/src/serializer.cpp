@@ -5,6 +5,12 @@
 
 namespace zabato
 {
+namespace
+{
+/** @brief The headers of streams with address and with dense IDs. */
+const string_view top_level       = "Top Level";
+const string_view dense_top_level = "Top Level Dense";
+} // namespace
 
 const rtti serializer_link::TYPE("zabato.serializer_link", &object::TYPE);
 
@@ -41,10 +47,23 @@ bool serializer::insert_in_map(const object *obj, void *value)
 void serializer::insert_in_ordered(const object *obj)
 {
     m_ordered_objects.push_back(obj);
+
+    // The dense ID, looked up when writing references to the object.
+    if (m_dense_ids)
+        m_unique_map.set(obj, (void *)(uintptr_t)m_ordered_objects.size());
 }
 
 bool serializer::insert_in_map(void *unique_id, object *obj_or_link)
 {
+    if (m_reader && !m_dense_map.empty())
+    {
+        const uintptr_t index = (uintptr_t)unique_id - 1;
+        if (index >= m_dense_map.size() || m_dense_map[index])
+            return false;
+        m_dense_map[index] = obj_or_link;
+        return true;
+    }
+
     if (m_unique_map.contains_key(unique_id))
         return false;
 
@@ -55,17 +74,25 @@ bool serializer::insert_in_map(void *unique_id, object *obj_or_link)
 object *serializer::get_from_map(void *unique_id)
 {
     void *result = nullptr;
-    if (m_unique_map.try_get_value(unique_id, result))
+    if (m_reader && !m_dense_map.empty())
+    {
+        const uintptr_t index = (uintptr_t)unique_id - 1;
+        if (index < m_dense_map.size())
+            result = m_dense_map[index];
+    }
+    else
     {
-        if (result)
+        m_unique_map.try_get_value(unique_id, result);
+    }
+
+    if (result)
+    {
+        object *obj = (object *)result;
+        if (obj->is_derived(serializer_link::TYPE))
         {
-            object *obj = (object *)result;
-            if (obj->is_derived(serializer_link::TYPE))
-            {
-                return ((serializer_link *)obj)->get_object();
-            }
-            return obj;
+            return ((serializer_link *)obj)->get_object();
         }
+        return obj;
     }
     return nullptr;
 }
@@ -81,7 +108,17 @@ size_t serializer::read(object *&obj)
     return bytes_read;
 }
 
-size_t serializer::write(const object *obj) { return write((void *)obj); }
+size_t serializer::write(const object *obj)
+{
+    if (!m_dense_ids)
+        return write((void *)obj);
+
+    // Objects not registered for saving are written as null.
+    void *id = nullptr;
+    if (obj)
+        m_unique_map.try_get_value(obj, id);
+    return write(id);
+}
 
 size_t serializer::read(string &str)
 {
@@ -158,8 +195,7 @@ bool serializer::save(stream &stream, const object *root)
     if (root)
         root->register_object(*this);
 
-    string top_level = "Top Level";
-    write(top_level);
+    write(m_dense_ids ? dense_top_level : top_level);
 
     ice_int32_t count = (ice_int32_t)m_ordered_objects.size();
     write(count);
@@ -174,15 +210,19 @@ bool serializer::save(stream &stream, const object *root)
 
 bool serializer::load(stream &stream)
 {
-    ice_reader reader(stream);
+    // Objects are read field by field, so serve them from a window.
+    buffered_stream buffered(stream);
+    ice_reader reader(buffered);
     m_reader = &reader;
 
     m_unique_map.clear();
     m_links.clear();
+    m_dense_map.clear();
 
     string header;
     read(header);
-    if (header != "Top Level")
+    const bool dense = header == dense_top_level;
+    if (!dense && header != top_level)
     {
         m_reader = nullptr;
         return false;
@@ -190,6 +230,8 @@ bool serializer::load(stream &stream)
 
     ice_int32_t count = 0;
     read(count);
+    if (dense && count > 0)
+        m_dense_map.resize((int32_t)count, nullptr);
 
     for (int i = 0; i < count; ++i)
     {
@@ -200,16 +242,27 @@ bool serializer::load(stream &stream)
     }
 
     // Link Phase
-    for (auto it = m_unique_map.begin(); it != m_unique_map.end(); ++it)
+    auto link_object = [&](void *value)
     {
         // Value in map is link*
-        serializer_link *link = (serializer_link *)(it->value);
+        serializer_link *link = (serializer_link *)value;
         if (link && link->get_object())
         {
             link->get_object()->link(*this, link);
         }
+    };
+    if (!m_dense_map.empty())
+    {
+        for (object *link : m_dense_map)
+            link_object(link);
+    }
+    else
+    {
+        for (auto it = m_unique_map.begin(); it != m_unique_map.end(); ++it)
+            link_object(it->value);
     }
 
+    m_dense_map.clear();
     m_reader = nullptr;
     return true;
 }
@@ -0,0 +1,183 @@
+#include <zabato/mesh.hpp>
+#include <zabato/skinning.hpp>
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64) ||                                     \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define ZABATO_SKINNING_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ZABATO_SKINNING_NEON
+#endif
+
+namespace zabato
+{
+namespace
+{
+#pragma region 4-wide helpers
+
+#if defined(ZABATO_SKINNING_SSE)
+using float4 = __m128;
+
+inline float4 load4(const float *p) { return _mm_loadu_ps(p); }
+inline float4 zero4() { return _mm_setzero_ps(); }
+inline void store4(float *p, float4 v) { _mm_storeu_ps(p, v); }
+inline float4 madd4(float4 acc, float4 v, float s)
+{
+    return _mm_add_ps(acc, _mm_mul_ps(v, _mm_set1_ps(s)));
+}
+#elif defined(ZABATO_SKINNING_NEON)
+using float4 = float32x4_t;
+
+inline float4 load4(const float *p) { return vld1q_f32(p); }
+inline float4 zero4() { return vdupq_n_f32(0.0f); }
+inline void store4(float *p, float4 v) { vst1q_f32(p, v); }
+inline float4 madd4(float4 acc, float4 v, float s)
+{
+    return vmlaq_n_f32(acc, v, s);
+}
+#else
+struct float4
+{
+    float v[4];
+};
+
+inline float4 load4(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline float4 zero4() { return {{0.0f, 0.0f, 0.0f, 0.0f}}; }
+inline void store4(float *p, float4 v) { memcpy(p, v.v, sizeof(v.v)); }
+inline float4 madd4(float4 acc, float4 v, float s)
+{
+    for (int i = 0; i < 4; ++i)
+        acc.v[i] += v.v[i] * s;
+    return acc;
+}
+#endif
+
+#pragma endregion
+
+inline void load_vec3(const uint8_t *p, float out[3])
+{
+    vec3<real> v;
+    memcpy(&v, p, sizeof(v));
+    out[0] = float(v.x);
+    out[1] = float(v.y);
+    out[2] = float(v.z);
+}
+
+inline void store_vec3(uint8_t *p, const float in[3])
+{
+    vec3<real> v = {real(in[0]), real(in[1]), real(in[2])};
+    memcpy(p, &v, sizeof(v));
+}
+
+/** @brief Copies a bone palette into column-major float storage. */
+void convert_palette(const mat4<real> *palette, size_t count, float *out)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        mat4<float> m = palette[i];
+        memcpy(out + i * 16, &m.m00, 16 * sizeof(float));
+    }
+}
+} // namespace
+
+void skin_vertices(const skinning_stream &stream,
+                   const mat4<real> *palette,
+                   size_t palette_size)
+{
+    if (!stream.source || !stream.destination || !palette)
+        return;
+
+    // Most skeletons fit on the stack, larger ones spill to the frame arena.
+    constexpr size_t max_stack_bones = 128;
+    float stack_palette[max_stack_bones * 16];
+    arena_scope scratch(frame_arena::get());
+    vector<float, frame_allocator<float>> heap_palette;
+
+    float *matrices = stack_palette;
+    if (palette_size > max_stack_bones)
+    {
+        heap_palette.resize(palette_size * 16);
+        matrices = heap_palette.data();
+    }
+    convert_palette(palette, palette_size, matrices);
+
+    const bool has_normal = stream.normal_offset >= 0;
+
+    for (size_t i = 0; i < stream.vertex_count; ++i)
+    {
+        const uint8_t *src = stream.source + i * stream.stride;
+        uint8_t *dst       = stream.destination + i * stream.stride;
+
+        boneweight_t weights;
+        memcpy(&weights, src + stream.boneweight_offset, sizeof(weights));
+
+        // Blend the influencing matrices column by column.
+        float4 c0 = zero4(), c1 = zero4(), c2 = zero4(), c3 = zero4();
+        float total_weight = 0.0f;
+        for (int j = 0; j < 4; ++j)
+        {
+            const int16_t id = weights[j].bone_id;
+            const float w    = float(real(weights[j].weight));
+            if (id < 0 || size_t(id) >= palette_size || w <= 0.0f)
+                continue;
+
+            const float *m = matrices + size_t(id) * 16;
+            c0             = madd4(c0, load4(m + 0), w);
+            c1             = madd4(c1, load4(m + 4), w);
+            c2             = madd4(c2, load4(m + 8), w);
+            c3             = madd4(c3, load4(m + 12), w);
+            total_weight += w;
+        }
+
+        if (total_weight <= 0.0f)
+        {
+            memcpy(dst, src, sizeof(position_t));
+            if (has_normal)
+                memcpy(dst + stream.normal_offset,
+                       src + stream.normal_offset,
+                       sizeof(normal_t));
+            continue;
+        }
+
+        // Quantized weights rarely sum to exactly one, renormalize them.
+        if (total_weight != 1.0f)
+        {
+            const float inv_weight = 1.0f / total_weight;
+            c0                     = madd4(zero4(), c0, inv_weight);
+            c1                     = madd4(zero4(), c1, inv_weight);
+            c2                     = madd4(zero4(), c2, inv_weight);
+            c3                     = madd4(zero4(), c3, inv_weight);
+        }
+
+        float p[3], out[4];
+        load_vec3(src, p);
+        float4 r = madd4(madd4(madd4(c3, c0, p[0]), c1, p[1]), c2, p[2]);
+        store4(out, r);
+        store_vec3(dst, out);
+
+        if (has_normal)
+        {
+            float n[3];
+            load_vec3(src + stream.normal_offset, n);
+            float4 rn = madd4(zero4(), c0, n[0]);
+            rn        = madd4(madd4(rn, c1, n[1]), c2, n[2]);
+            store4(out, rn);
+
+            const float len_sq = out[0] * out[0] + out[1] * out[1] +
+                                 out[2] * out[2];
+            if (len_sq > 0.0f)
+            {
+                const float inv_len = 1.0f / sqrtf(len_sq);
+                out[0] *= inv_len;
+                out[1] *= inv_len;
+                out[2] *= inv_len;
+            }
+            store_vec3(dst + stream.normal_offset, out);
+        }
+    }
+}
+} // namespace zabato
@@ -10,6 +10,34 @@ namespace zabato
 
 const rtti spatial::TYPE("zabato::spatial", &object::TYPE);
 
+void spatial::collect_visible(const frustum &f,
+                              uint32_t mask,
+                              vector<spatial *> &visible)
+{
+    if (m_model_bound.is_empty())
+        return;
+    if (mask && f.test(get_world_bound(), mask) == cull_result::outside)
+        return;
+    visible.push_back(this);
+}
+
+void spatial::update_world_bound()
+{
+    m_world_bound = m_model_bound.transformed(get_world_transform());
+}
+
+int spatial::get_memory_used() const
+{
+    return object::get_memory_used() + (int)(sizeof(spatial) - sizeof(object));
+}
+
+void spatial::add_cost(scene_cost &cost) const
+{
+    object::add_cost(cost);
+    ++cost.spatials;
+    ++cost.update_cost;
+}
+
 void spatial::save_xml(xml_serializer &serializer,
                        tinyxml2::XMLElement &element) const
 {
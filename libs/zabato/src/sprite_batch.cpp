@@ -0,0 +1,220 @@
+#include <zabato/sprite_batch.hpp>
+#include <zabato/utils.hpp>
+
+#include <stddef.h>
+#include <string.h>
+
+namespace zabato
+{
+namespace
+{
+/** @brief The most sprites per upload, for 16-bit indices. */
+constexpr size_t max_sprites = 65536 / 4;
+
+/** @return Bits of `z` that sort as unsigned integers in the order of `z`. */
+uint32_t sortable_bits(real z)
+{
+    const float f = float(z);
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+}
+} // namespace
+
+sprite_batch::~sprite_batch() { release_buffers(); }
+
+void sprite_batch::begin()
+{
+    m_sprites.clear();
+    m_items.clear();
+}
+
+void sprite_batch::draw(const sprite &s)
+{
+    m_items.push_back({sortable_bits(s.z), uint32_t(m_sprites.size())});
+    m_sprites.push_back(s);
+}
+
+void sprite_batch::end(gpu &g)
+{
+    m_draw_count = 0;
+    if (m_sprites.empty())
+        return;
+
+    // The index keeps sprites of equal z and texture in submission order.
+    const sprite *sprites = m_sprites.data();
+    sort(m_items.begin(),
+         m_items.end(),
+         [sprites](const sort_item &a, const sort_item &b)
+         {
+             if (a.z != b.z)
+                 return a.z < b.z;
+             const uintptr_t ta = uintptr_t(sprites[a.index].tex);
+             const uintptr_t tb = uintptr_t(sprites[b.index].tex);
+             if (ta != tb)
+                 return ta < tb;
+             return a.index < b.index;
+         });
+
+    bind_gpu(g);
+    m_bound_known = false;
+    for (size_t first = 0; first < m_items.size(); first += max_sprites)
+    {
+        const size_t count = min(max_sprites, m_items.size() - first);
+        if (m_vertex_buffer && m_index_buffer)
+            flush(g, first, count);
+        else
+            flush_immediate(g, first, count);
+    }
+
+    if (m_bound)
+        g.unbind_texture();
+    m_bound = nullptr;
+    begin();
+}
+
+void sprite_batch::bind_gpu(gpu &g)
+{
+    gpu &device = g.get_device();
+    if (m_gpu == &device)
+        return;
+
+    release_buffers();
+    m_gpu           = &device;
+    m_vertex_buffer = g.create_vertex_buffer();
+    m_index_buffer  = g.create_index_buffer();
+}
+
+void sprite_batch::release_buffers()
+{
+    if (m_vertex_buffer)
+    {
+        m_vertex_buffer->destroy();
+        delete m_vertex_buffer;
+        m_vertex_buffer = nullptr;
+    }
+
+    if (m_index_buffer)
+    {
+        m_index_buffer->destroy();
+        delete m_index_buffer;
+        m_index_buffer = nullptr;
+    }
+
+    m_gpu = nullptr;
+}
+
+void sprite_batch::write_quad(const sprite &s, sprite_vertex *out) const
+{
+    const vec2<real> &p  = s.position;
+    const vec2<real> &uv = s.uv_min;
+    const vec2<real> end = s.position + s.size;
+
+    out[0] = {vec3<real>(p.x, p.y, real(0)), s.tint, uv};
+    out[1] = {vec3<real>(end.x, p.y, real(0)),
+              s.tint,
+              vec2<real>(s.uv_max.x, uv.y)};
+    out[2] = {vec3<real>(end.x, end.y, real(0)), s.tint, s.uv_max};
+    out[3] = {vec3<real>(p.x, end.y, real(0)),
+              s.tint,
+              vec2<real>(uv.x, s.uv_max.y)};
+}
+
+void sprite_batch::bind(gpu &g, texture *tex)
+{
+    if (m_bound_known && tex == m_bound)
+        return;
+
+    if (tex)
+        g.bind_texture(tex);
+    else
+        g.unbind_texture();
+    m_bound       = tex;
+    m_bound_known = true;
+}
+
+/**
+ * @brief Uploads `count` sorted sprites from `first` into the retained
+ * buffers and draws each run of one texture with a single call.
+ */
+void sprite_batch::flush(gpu &g, size_t first, size_t count)
+{
+    m_vertices.resize(count * 4);
+    for (size_t i = 0; i < count; ++i)
+        write_quad(m_sprites[m_items[first + i].index], &m_vertices[i * 4]);
+
+    // Every quad has the same two triangles, so the indices only grow.
+    const size_t built = m_indices.size() / 6;
+    if (built < count)
+    {
+        m_indices.resize(count * 6);
+        for (size_t i = built; i < count; ++i)
+        {
+            uint16_t *quad    = &m_indices[i * 6];
+            const uint16_t at = uint16_t(i * 4);
+            quad[0]           = at;
+            quad[1]           = uint16_t(at + 1);
+            quad[2]           = uint16_t(at + 2);
+            quad[3]           = at;
+            quad[4]           = uint16_t(at + 2);
+            quad[5]           = uint16_t(at + 3);
+        }
+    }
+
+    vertex_layout layout;
+    layout.stride          = sizeof(sprite_vertex);
+    layout.color_offset    = offsetof(sprite_vertex, tint);
+    layout.texcoord_offset = offsetof(sprite_vertex, uv);
+    m_vertex_buffer->load(layout, count * 4, m_vertices.data());
+    m_index_buffer->load(count * 6, m_indices.data());
+
+    for (size_t run = 0; run < count;)
+    {
+        texture *tex = m_sprites[m_items[first + run].index].tex;
+        size_t end   = run + 1;
+        while (end < count && m_sprites[m_items[first + end].index].tex == tex)
+            ++end;
+
+        bind(g, tex);
+        g.draw_indexed_range(primitive_type::triangles,
+                             m_vertex_buffer,
+                             m_index_buffer,
+                             run * 6,
+                             (end - run) * 6);
+        ++m_draw_count;
+        run = end;
+    }
+}
+
+/** @brief Draws `count` sorted sprites from `first`, one block per run. */
+void sprite_batch::flush_immediate(gpu &g, size_t first, size_t count)
+{
+    texture *tex = nullptr;
+    bool open    = false;
+    for (size_t i = 0; i < count; ++i)
+    {
+        const sprite &s = m_sprites[m_items[first + i].index];
+        if (!open || s.tex != tex)
+        {
+            if (open)
+                g.end();
+            tex = s.tex;
+            bind(g, tex);
+            g.begin(primitive_type::quads);
+            open = true;
+            ++m_draw_count;
+        }
+
+        sprite_vertex quad[4];
+        write_quad(s, quad);
+        for (const sprite_vertex &v : quad)
+        {
+            g.color(v.tint);
+            g.tex_coord(v.uv);
+            g.vertex(v.position);
+        }
+    }
+    if (open)
+        g.end();
+}
+} // namespace zabato
@@ -0,0 +1,142 @@
+#include <zabato/texture_atlas.hpp>
+
+#include <string.h>
+
+namespace zabato
+{
+namespace
+{
+/** @brief Orders paths byte by byte, as the packer sorts them. */
+int compare_paths(string_view a, string_view b)
+{
+    const int common = memcmp(a.data(), b.data(), min(a.size(), b.size()));
+    if (common != 0)
+        return common;
+    return a.size() < b.size() ? -1 : a.size() > b.size();
+}
+} // namespace
+
+const ICE_ATLAS_PAGE *texture_atlas::pages() const
+{
+    return reinterpret_cast<const ICE_ATLAS_PAGE *>(m_data.data());
+}
+
+const ICE_ATLAS_REGION *texture_atlas::regions() const
+{
+    return reinterpret_cast<const ICE_ATLAS_REGION *>(
+        m_data.data() + m_page_count * sizeof(ICE_ATLAS_PAGE));
+}
+
+string_view texture_atlas::path_at(uint32_t offset) const
+{
+    return string_view(reinterpret_cast<const char *>(m_data.data()) +
+                       m_paths_offset + offset);
+}
+
+bool texture_atlas::replace_with(resource &loaded)
+{
+    texture_atlas &atlas = static_cast<texture_atlas &>(loaded);
+    swap(m_data, atlas.m_data);
+    m_page_count   = atlas.m_page_count;
+    m_region_count = atlas.m_region_count;
+    m_paths_offset = atlas.m_paths_offset;
+    return true;
+}
+
+bool texture_atlas::find(string_view path, atlas_region &out) const
+{
+    const ICE_ATLAS_REGION *table = regions();
+    size_t low = 0, high = m_region_count;
+    while (low < high)
+    {
+        const size_t mid = low + (high - low) / 2;
+        const int order  = compare_paths(path_at(table[mid].path_offset), path);
+        if (order < 0)
+            low = mid + 1;
+        else if (order > 0)
+            high = mid;
+        else
+        {
+            const ICE_ATLAS_REGION &r = table[mid];
+            const ICE_ATLAS_PAGE &p   = pages()[(uint32_t)r.page];
+            const real width          = real((uint16_t)p.width);
+            const real height         = real((uint16_t)p.height);
+
+            out.page   = path_at(p.path_offset);
+            out.x      = r.x;
+            out.y      = r.y;
+            out.width  = r.width;
+            out.height = r.height;
+            out.uv_min = vec2<real>(real(out.x) / width, real(out.y) / height);
+            out.uv_max = vec2<real>(real(out.x + out.width) / width,
+                                    real(out.y + out.height) / height);
+            return true;
+        }
+    }
+    return false;
+}
+
+template <>
+result<void> deserialize(ice_reader &reader, texture_atlas &atlas)
+{
+    auto [error, chunk] = reader.find_chunk(texture_atlas::CHUNK_ID);
+    if (error)
+        return error;
+
+    auto broken = []
+    {
+        return report_error(error_code::chunk_broken,
+                            texture_atlas::CHUNK_ID.to_string().c_str(),
+                            (uint32_t)texture_atlas::CHUNK_ID);
+    };
+
+    ICE_ATLAS_HEADER header;
+    if (chunk.size < sizeof(header) ||
+        reader.read(&header, sizeof(header)) != sizeof(header) ||
+        header.version != ICE_ATLAS_VERSION)
+        return broken();
+
+    const uint64_t payload      = chunk.size - sizeof(header);
+    const uint32_t page_count   = header.page_count;
+    const uint32_t region_count = header.region_count;
+    const uint64_t records =
+        page_count * uint64_t(sizeof(ICE_ATLAS_PAGE)) +
+        region_count * uint64_t(sizeof(ICE_ATLAS_REGION));
+    if (records >= payload)
+        return broken();
+
+    vector<uint8_t> data(payload);
+    if (reader.read(data.data(), data.size()) != data.size() ||
+        data.back() != 0)
+        return broken();
+
+    atlas.m_data         = move(data);
+    atlas.m_page_count   = page_count;
+    atlas.m_region_count = region_count;
+    atlas.m_paths_offset = records;
+
+    // Checked once, so lookups trust the table.
+    const uint64_t paths_size = payload - records;
+    bool valid                = true;
+    for (uint32_t i = 0; valid && i < page_count; ++i)
+    {
+        const ICE_ATLAS_PAGE &p = atlas.pages()[i];
+        valid = p.path_offset < paths_size && p.width > 0 && p.height > 0;
+    }
+    for (uint32_t i = 0; valid && i < region_count; ++i)
+    {
+        const ICE_ATLAS_REGION &r = atlas.regions()[i];
+        valid = r.path_offset < paths_size && r.page < page_count &&
+                r.x + r.width <= atlas.pages()[(uint32_t)r.page].width &&
+                r.y + r.height <= atlas.pages()[(uint32_t)r.page].height;
+    }
+    if (!valid)
+    {
+        atlas.m_data.clear();
+        atlas.m_page_count   = 0;
+        atlas.m_region_count = 0;
+        return broken();
+    }
+    return error_code::ok;
+}
+} // namespace zabato
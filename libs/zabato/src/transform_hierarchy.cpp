@@ -0,0 +1,286 @@
+#include <zabato/thread.hpp>
+#include <zabato/transform_hierarchy.hpp>
+
+#include <string.h>
+
+namespace zabato
+{
+namespace
+{
+/** @brief Moves `[pos, size)` up by `count`, growing the array. */
+template <class Array> void shift_up(Array &a, size_t pos, size_t count)
+{
+    const size_t size = a.size();
+    a.resize(size + count);
+    for (size_t i = size; i > pos; --i)
+        a[i - 1 + count] = a[i - 1];
+}
+
+/** @brief Moves `[pos + count, size)` down by `count`, shrinking the array. */
+template <class Array> void shift_down(Array &a, size_t pos, size_t count)
+{
+    const size_t size = a.size();
+    for (size_t i = pos + count; i < size; ++i)
+        a[i - count] = a[i];
+    a.resize(size - count);
+}
+
+/** @brief A contiguous run of root subtrees, updated by one worker. */
+struct update_chunk_args
+{
+    transform_hierarchy *hierarchy;
+    size_t begin;
+    size_t end;
+};
+} // namespace
+
+transform_hierarchy::handle
+transform_hierarchy::add(const transformation &local, handle parent)
+{
+    int32_t parent_slot = -1;
+    size_t pos          = size();
+    if (parent != invalid_handle)
+    {
+        parent_slot = slot_of(parent);
+        pos         = size_t(parent_slot + m_subtree_size[parent_slot]);
+    }
+
+    handle h;
+    if (!m_free_list.empty())
+    {
+        h = m_free_list.back();
+        m_free_list.pop_back();
+    }
+    else
+    {
+        h = handle(m_slots.size());
+        m_slots.push_back(-1);
+    }
+
+    open_gap(pos, 1);
+    m_local[pos]        = local;
+    m_world[pos]        = local;
+    m_parent[pos]       = parent_slot;
+    m_subtree_size[pos] = 1;
+    m_handle[pos]       = h;
+    m_dirty[pos]        = 1;
+    m_slots[h]          = int32_t(pos);
+
+    resize_ancestors(parent_slot, 1);
+    return h;
+}
+
+void transform_hierarchy::remove(handle h)
+{
+    const int32_t slot  = slot_of(h);
+    const int32_t count = m_subtree_size[slot];
+
+    for (int32_t i = slot; i < slot + count; ++i)
+    {
+        m_slots[m_handle[i]] = -1;
+        m_free_list.push_back(m_handle[i]);
+    }
+
+    resize_ancestors(m_parent[slot], -count);
+    close_gap(size_t(slot), size_t(count));
+}
+
+void transform_hierarchy::set_parent(handle h, handle parent)
+{
+    int32_t slot        = slot_of(h);
+    const int32_t count = m_subtree_size[slot];
+    if (parent != invalid_handle)
+    {
+        const int32_t parent_slot = slot_of(parent);
+        assert((parent_slot < slot || parent_slot >= slot + count) &&
+               "Cannot move a transform under its own subtree");
+        if (m_parent[slot] == parent_slot)
+            return;
+    }
+
+    // Take the subtree out, with parents relative to its root.
+    array<transformation> locals;
+    array<int32_t> parents, sizes;
+    array<handle> handles;
+    locals.reserve(count);
+    parents.reserve(count);
+    sizes.reserve(count);
+    handles.reserve(count);
+    for (int32_t i = 0; i < count; ++i)
+    {
+        locals.push_back(m_local[slot + i]);
+        parents.push_back(i == 0 ? -1 : m_parent[slot + i] - slot);
+        sizes.push_back(m_subtree_size[slot + i]);
+        handles.push_back(m_handle[slot + i]);
+    }
+
+    resize_ancestors(m_parent[slot], -count);
+    close_gap(size_t(slot), size_t(count));
+
+    // Put it back at the end of the new parent's subtree.
+    int32_t parent_slot = -1;
+    size_t pos          = size();
+    if (parent != invalid_handle)
+    {
+        parent_slot = slot_of(parent);
+        pos         = size_t(parent_slot + m_subtree_size[parent_slot]);
+    }
+
+    open_gap(pos, size_t(count));
+    slot = int32_t(pos);
+    for (int32_t i = 0; i < count; ++i)
+    {
+        m_local[slot + i]        = locals[i];
+        m_parent[slot + i]       = i == 0 ? parent_slot : slot + parents[i];
+        m_subtree_size[slot + i] = sizes[i];
+        m_handle[slot + i]       = handles[i];
+        m_dirty[slot + i]        = 1;
+        m_slots[handles[i]]      = slot + i;
+    }
+
+    resize_ancestors(parent_slot, count);
+}
+
+transform_hierarchy::handle transform_hierarchy::parent(handle h) const
+{
+    const int32_t parent_slot = m_parent[slot_of(h)];
+    return parent_slot >= 0 ? m_handle[parent_slot] : invalid_handle;
+}
+
+void transform_hierarchy::set_local(handle h, const transformation &local)
+{
+    const int32_t slot = slot_of(h);
+    m_local[slot]      = local;
+    mark_dirty(slot);
+}
+
+void transform_hierarchy::update(uint32_t thread_count)
+{
+    // Below this many transforms per worker, thread startup dominates.
+    constexpr size_t min_transforms_per_thread = 1024;
+    constexpr uint32_t max_threads             = 64;
+
+    const size_t count = size();
+    if (thread_count == 0)
+        thread_count = thread::hardware_concurrency();
+
+    size_t workers = min((size_t)thread_count,
+                         count / min_transforms_per_thread);
+    workers        = min(workers, (size_t)max_threads);
+
+    if (workers <= 1)
+    {
+        update_range(0, count);
+        return;
+    }
+
+    // Chunks end on root boundaries, so no subtree is split between workers.
+    update_chunk_args chunks[max_threads];
+    const size_t per_worker = (count + workers - 1) / workers;
+    size_t chunk_count      = 0;
+    for (size_t begin = 0; begin < count;)
+    {
+        size_t end = begin;
+        while (end < count && end - begin < per_worker)
+            end += size_t(m_subtree_size[end]);
+        if (chunk_count + 1 == workers)
+            end = count;
+        chunks[chunk_count++] = {this, begin, end};
+        begin                 = end;
+    }
+
+    thread threads[max_threads - 1];
+    for (size_t w = 0; w + 1 < chunk_count; ++w)
+        if (!threads[w].start(update_chunk, &chunks[w]))
+            update_chunk(&chunks[w]);
+
+    update_chunk(&chunks[chunk_count - 1]);
+
+    for (size_t w = 0; w + 1 < chunk_count; ++w)
+        threads[w].join();
+}
+
+void transform_hierarchy::clear()
+{
+    m_local.clear();
+    m_world.clear();
+    m_parent.clear();
+    m_subtree_size.clear();
+    m_handle.clear();
+    m_dirty.clear();
+    m_slots.clear();
+    m_free_list.clear();
+}
+
+void transform_hierarchy::open_gap(size_t pos, size_t count)
+{
+    shift_up(m_local, pos, count);
+    shift_up(m_world, pos, count);
+    shift_up(m_parent, pos, count);
+    shift_up(m_subtree_size, pos, count);
+    shift_up(m_handle, pos, count);
+    shift_up(m_dirty, pos, count);
+
+    // Parents come first, so only entries after the gap can point past it.
+    for (size_t i = pos + count; i < size(); ++i)
+    {
+        if (m_parent[i] >= int32_t(pos))
+            m_parent[i] += int32_t(count);
+        m_slots[m_handle[i]] = int32_t(i);
+    }
+}
+
+void transform_hierarchy::close_gap(size_t pos, size_t count)
+{
+    shift_down(m_local, pos, count);
+    shift_down(m_world, pos, count);
+    shift_down(m_parent, pos, count);
+    shift_down(m_subtree_size, pos, count);
+    shift_down(m_handle, pos, count);
+    shift_down(m_dirty, pos, count);
+
+    for (size_t i = pos; i < size(); ++i)
+    {
+        if (m_parent[i] >= int32_t(pos))
+            m_parent[i] -= int32_t(count);
+        m_slots[m_handle[i]] = int32_t(i);
+    }
+}
+
+void transform_hierarchy::resize_ancestors(int32_t slot, int32_t delta)
+{
+    for (; slot >= 0; slot = m_parent[slot])
+        m_subtree_size[slot] += delta;
+}
+
+void transform_hierarchy::mark_dirty(int32_t slot)
+{
+    // A dirty entry already has its whole subtree dirty.
+    if (m_dirty[slot])
+        return;
+    memset(&m_dirty[slot], 1, size_t(m_subtree_size[slot]));
+}
+
+void transform_hierarchy::update_range(size_t begin, size_t end)
+{
+    for (size_t i = begin; i < end; ++i)
+    {
+        if (!m_dirty[i])
+            continue;
+
+        const int32_t parent_slot = m_parent[i];
+        if (parent_slot >= 0)
+            m_world[i].product(m_world[parent_slot], m_local[i]);
+        else
+            m_world[i] = m_local[i];
+        m_dirty[i] = 0;
+    }
+}
+
+void transform_hierarchy::update_chunk(void *context)
+{
+    const update_chunk_args *chunk =
+        static_cast<const update_chunk_args *>(context);
+    chunk->hierarchy->update_range(chunk->begin, chunk->end);
+}
+} // namespace zabato
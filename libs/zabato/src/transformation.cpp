@@ -0,0 +1,243 @@
+#include <zabato/transformation.hpp>
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64) ||                                     \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define ZABATO_TRANSFORM_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define ZABATO_TRANSFORM_NEON
+#endif
+
+namespace zabato
+{
+namespace
+{
+#pragma region 4-wide helpers
+
+#if defined(ZABATO_TRANSFORM_SSE)
+using float4 = __m128;
+
+inline float4 load4(const float *p) { return _mm_loadu_ps(p); }
+inline float4 zero4() { return _mm_setzero_ps(); }
+inline float4 set4(float s) { return _mm_set1_ps(s); }
+inline void store4(float *p, float4 v) { _mm_storeu_ps(p, v); }
+inline float4 madd4(float4 acc, float4 v, float s)
+{
+    return _mm_add_ps(acc, _mm_mul_ps(v, _mm_set1_ps(s)));
+}
+#elif defined(ZABATO_TRANSFORM_NEON)
+using float4 = float32x4_t;
+
+inline float4 load4(const float *p) { return vld1q_f32(p); }
+inline float4 zero4() { return vdupq_n_f32(0.0f); }
+inline float4 set4(float s) { return vdupq_n_f32(s); }
+inline void store4(float *p, float4 v) { vst1q_f32(p, v); }
+inline float4 madd4(float4 acc, float4 v, float s)
+{
+    return vmlaq_n_f32(acc, v, s);
+}
+#else
+struct float4
+{
+    float v[4];
+};
+
+inline float4 load4(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+inline float4 zero4() { return {{0.0f, 0.0f, 0.0f, 0.0f}}; }
+inline float4 set4(float s) { return {{s, s, s, s}}; }
+inline void store4(float *p, float4 v) { memcpy(p, v.v, sizeof(v.v)); }
+inline float4 madd4(float4 acc, float4 v, float s)
+{
+    for (int i = 0; i < 4; ++i)
+        acc.v[i] += v.v[i] * s;
+    return acc;
+}
+#endif
+
+#pragma endregion
+
+/**
+ * @brief Multiplies interleaved vectors by the upper 3x4 of a matrix, one
+ * vector per step with the columns held in registers.
+ * @param translate False for directions, which ignore the translation.
+ * @param renormalize True to scale every result back to unit length.
+ */
+void transform_aos(const mat4<float> &m,
+                   bool translate,
+                   bool renormalize,
+                   size_t count,
+                   const vec3<real> *in,
+                   vec3<real> *out)
+{
+    const float4 c0 = load4(&m.m00);
+    const float4 c1 = load4(&m.m01);
+    const float4 c2 = load4(&m.m02);
+    const float4 c3 = translate ? load4(&m.m03) : zero4();
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const float x = float(in[i].x);
+        const float y = float(in[i].y);
+        const float z = float(in[i].z);
+
+        float r[4];
+        store4(r, madd4(madd4(madd4(c3, c0, x), c1, y), c2, z));
+
+        if (renormalize)
+        {
+            const float len_sq = r[0] * r[0] + r[1] * r[1] + r[2] * r[2];
+            if (len_sq > 0.0f)
+            {
+                const float inv_len = 1.0f / sqrtf(len_sq);
+                r[0] *= inv_len;
+                r[1] *= inv_len;
+                r[2] *= inv_len;
+            }
+        }
+
+        out[i] = vec3<real>(real(r[0]), real(r[1]), real(r[2]));
+    }
+}
+
+/**
+ * @brief Transforms points stored as separate coordinate arrays. Each step
+ * loads four x, y and z values and broadcasts the matrix elements.
+ */
+void transform_soa(const mat4<float> &m,
+                   size_t count,
+                   real *x,
+                   real *y,
+                   real *z)
+{
+    size_t i = 0;
+
+    if constexpr (detail::is_float_storage<real>::value)
+    {
+        float *fx = reinterpret_cast<float *>(x);
+        float *fy = reinterpret_cast<float *>(y);
+        float *fz = reinterpret_cast<float *>(z);
+
+        for (; i + 4 <= count; i += 4)
+        {
+            const float4 vx = load4(fx + i);
+            const float4 vy = load4(fy + i);
+            const float4 vz = load4(fz + i);
+
+            store4(fx + i,
+                   madd4(madd4(madd4(set4(m.m03), vx, m.m00), vy, m.m01),
+                         vz,
+                         m.m02));
+            store4(fy + i,
+                   madd4(madd4(madd4(set4(m.m13), vx, m.m10), vy, m.m11),
+                         vz,
+                         m.m12));
+            store4(fz + i,
+                   madd4(madd4(madd4(set4(m.m23), vx, m.m20), vy, m.m21),
+                         vz,
+                         m.m22));
+        }
+    }
+
+    for (; i < count; ++i)
+    {
+        const float px = float(x[i]);
+        const float py = float(y[i]);
+        const float pz = float(z[i]);
+
+        x[i] = real(m.m00 * px + m.m01 * py + m.m02 * pz + m.m03);
+        y[i] = real(m.m10 * px + m.m11 * py + m.m12 * pz + m.m13);
+        z[i] = real(m.m20 * px + m.m21 * py + m.m22 * pz + m.m23);
+    }
+}
+
+void copy_points(size_t count, const vec3<real> *in, vec3<real> *out)
+{
+    if (in != out)
+        memmove(out, in, count * sizeof(vec3<real>));
+}
+} // namespace
+
+void transformation::apply_forward(size_t count,
+                                   const vec3<real> *points,
+                                   vec3<real> *out) const
+{
+    if (m_is_identity)
+    {
+        copy_points(count, points, out);
+        return;
+    }
+
+    transform_aos(to_matrix(), true, false, count, points, out);
+}
+
+void transformation::apply_forward(size_t count,
+                                   real *x,
+                                   real *y,
+                                   real *z) const
+{
+    if (m_is_identity)
+        return;
+
+    transform_soa(to_matrix(), count, x, y, z);
+}
+
+void transformation::apply_forward_normals(size_t count,
+                                           const vec3<real> *normals,
+                                           vec3<real> *out) const
+{
+    if (m_is_identity)
+    {
+        copy_points(count, normals, out);
+        return;
+    }
+
+    // Normals follow the inverse transpose, `rotate * scale^-1`.
+    mat4<real> m               = mat4_from_quat(m_rotation);
+    const vec3<real> inv_scale = vec3<real>(1) / m_scale;
+    for (int row = 0; row < 3; ++row)
+    {
+        m.m[0][row] = m.m[0][row] * inv_scale.x;
+        m.m[1][row] = m.m[1][row] * inv_scale.y;
+        m.m[2][row] = m.m[2][row] * inv_scale.z;
+    }
+
+    transform_aos(m, false, true, count, normals, out);
+}
+
+void transformation::apply_backward(size_t count,
+                                    const vec3<real> *points,
+                                    vec3<real> *out) const
+{
+    if (m_is_identity)
+    {
+        copy_points(count, points, out);
+        return;
+    }
+
+    transform_aos(to_inverse_matrix(), true, false, count, points, out);
+}
+
+void transformation::apply_backward(size_t count,
+                                    real *x,
+                                    real *y,
+                                    real *z) const
+{
+    if (m_is_identity)
+        return;
+
+    transform_soa(to_inverse_matrix(), count, x, y, z);
+}
+
+void transformation::product(size_t count,
+                             const transformation *parents,
+                             const transformation *children,
+                             transformation *out)
+{
+    for (size_t i = 0; i < count; ++i)
+        out[i].product(parents[i], children[i]);
+}
+} // namespace zabato
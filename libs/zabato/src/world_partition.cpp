@@ -0,0 +1,153 @@
+#include <zabato/profiler.hpp>
+#include <zabato/world_partition.hpp>
+
+namespace zabato
+{
+world_partition::~world_partition() { unload_all(); }
+
+void world_partition::set_target(resource_manager *manager, node *root)
+{
+    unload_all();
+    m_manager = manager;
+    m_root    = root;
+}
+
+bool world_partition::add_cell(int32_t x, int32_t z, string_view path)
+{
+    if (!m_by_coord.add(key_of(x, z), (uint32_t)m_cells.size()))
+        return false;
+
+    m_cells.emplace_back();
+    cell &c = m_cells.back();
+    c.x     = x;
+    c.z     = z;
+    c.path  = path;
+    return true;
+}
+
+void world_partition::update(const vec3<real> &position)
+{
+    PROFILE_SCOPE("world_partition::update");
+    if (!m_manager || !m_root)
+        return;
+
+    const real unload_sq = m_settings.unload_radius * m_settings.unload_radius;
+    for (size_t i = m_active.size(); i-- > 0;)
+    {
+        cell &c = m_cells[m_active[i]];
+        if (c.state == cell_state::loading && c.future.ready())
+            arrive(c);
+
+        // A cell still loading cannot be cancelled, it goes once it arrives.
+        if (c.state == cell_state::loading)
+            continue;
+        if (c.state == cell_state::loaded &&
+            distance_sq(c, position) <= unload_sq)
+            continue;
+
+        release(c);
+        m_active[i] = m_active.back();
+        m_active.pop_back();
+    }
+
+    const real size    = m_settings.cell_size;
+    const real radius  = m_settings.load_radius;
+    const real load_sq = radius * radius;
+    const int32_t x0   = (int32_t)floor((position.x - radius) / size);
+    const int32_t x1   = (int32_t)floor((position.x + radius) / size);
+    const int32_t z0   = (int32_t)floor((position.z - radius) / size);
+    const int32_t z1   = (int32_t)floor((position.z + radius) / size);
+
+    for (int32_t z = z0; z <= z1; ++z)
+        for (int32_t x = x0; x <= x1; ++x)
+        {
+            uint32_t index = 0;
+            if (!m_by_coord.try_get_value(key_of(x, z), index))
+                continue;
+
+            cell &c = m_cells[index];
+            if (c.state != cell_state::unloaded ||
+                distance_sq(c, position) > load_sq)
+                continue;
+
+            c.future = m_manager->load_async<scene_file>(c.path);
+            c.state  = cell_state::loading;
+            m_active.push_back(index);
+        }
+}
+
+void world_partition::unload_all()
+{
+    for (uint32_t index : m_active)
+        release(m_cells[index]);
+    m_active.clear();
+}
+
+spatial *world_partition::get_cell_root(int32_t x, int32_t z) const
+{
+    uint32_t index = 0;
+    if (!m_by_coord.try_get_value(key_of(x, z), index))
+        return nullptr;
+
+    const cell &c = m_cells[index];
+    return c.state == cell_state::loaded ? c.scene->get_root() : nullptr;
+}
+
+real world_partition::distance_sq(const cell &c,
+                                  const vec3<real> &position) const
+{
+    const real size  = m_settings.cell_size;
+    const real min_x = real(c.x) * size;
+    const real min_z = real(c.z) * size;
+
+    real dx = real(0);
+    if (position.x < min_x)
+        dx = min_x - position.x;
+    else if (position.x > min_x + size)
+        dx = position.x - (min_x + size);
+
+    real dz = real(0);
+    if (position.z < min_z)
+        dz = min_z - position.z;
+    else if (position.z > min_z + size)
+        dz = position.z - (min_z + size);
+
+    return dx * dx + dz * dz;
+}
+
+void world_partition::arrive(cell &c)
+{
+    const result<shared_ptr<scene_file>> loaded = c.future.get();
+    c.future = resource_future<scene_file>();
+    if (loaded.has_error())
+    {
+        c.state = cell_state::failed;
+        return;
+    }
+
+    c.scene = loaded.value;
+    if (spatial *root = c.scene->get_root())
+        m_root->attach_child(root);
+    c.state = cell_state::loaded;
+    ++m_loaded_count;
+}
+
+void world_partition::release(cell &c)
+{
+    if (c.state == cell_state::loaded)
+    {
+        if (spatial *root = c.scene->get_root())
+            m_root->detach_child(root);
+        c.scene.reset();
+        m_manager->unload(c.path);
+        --m_loaded_count;
+        c.state = cell_state::unloaded;
+    }
+    else if (c.state == cell_state::loading)
+    {
+        // Dropping the future leaves the load to finish into the cache.
+        c.future = resource_future<scene_file>();
+        c.state  = cell_state::unloaded;
+    }
+}
+} // namespace zabato
@@ -147,7 +147,7 @@ void xml_serializer::write_object(tinyxml2::XMLElement &el, object *obj)
     }
     else
     {
-        rtti type                  = obj->type();
+        const rtti &type           = obj->type();
         tinyxml2::XMLElement *idEl = el.InsertNewChildElement(type.name());
         char sid[37];
         id.to_chars(sid);
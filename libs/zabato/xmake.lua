@@ -16,6 +16,14 @@ target("zabato")
         end
     end
 
+target("cli_scene")
+    set_kind("binary")
+    set_languages("c++23")
+    add_files("cli/scene_compiler.cpp")
+    add_deps("zabato")
+    add_packages("tinyxml2")
+    set_basename("zabato_scene")
+
 target("zabato_header")
     set_kind("headeronly")
     add_includedirs("include", {public = true})
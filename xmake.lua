@@ -1,6 +1,26 @@
 add_rules("mode.debug", "mode.release")
 add_rules("plugin.compile_commands.autoupdate", {outputdir = ".vscode"})
 
+option("memory_tracking")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Count heap memory per memory_category")
+option_end()
+
+option("profiler")
+    set_default(false)
+    set_showmenu(true)
+    set_description("Record PROFILE_SCOPE zones for the profiler")
+option_end()
+
+option("log_level")
+    set_default("info")
+    set_showmenu(true)
+    set_values("none", "error", "warning", "info", "trace")
+    set_description("The least severe LOG_ macro compiled in")
+option_end()
+
 includes("ext")
 includes("libs")
-includes("editor")
\ No newline at end of file
+includes("editor")
+includes("bench")
\ No newline at end of file